@@ -0,0 +1,42 @@
+/** @file
+  Multi-stream LZMA GUIDed section.
+
+  The section data is a MULTI_STREAM_LZMA_HEADER followed by an index of
+  streams. Each stream is a complete LZMA GUIDed section that decodes to
+  StreamSize bytes (the last one may be shorter), so the streams can be
+  decoded independently and in any order.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef MULTI_STREAM_LZMA_H_
+#define MULTI_STREAM_LZMA_H_
+
+#define SOPHGO_MULTI_STREAM_LZMA_GUID \
+  { 0x5C3B7E2A, 0x8F41, 0x4D6B, { 0x9A, 0x1E, 0x37, 0xC2, 0x64, 0xB8, 0x0D, 0x95 } }
+
+#define MULTI_STREAM_LZMA_SIGNATURE  SIGNATURE_32 ('M', 'S', 'L', 'Z')
+
+#pragma pack (1)
+
+typedef struct {
+  UINT32    Offset;             // From the start of MULTI_STREAM_LZMA_HEADER
+  UINT32    Length;             // Length of the LZMA GUIDed section
+} MULTI_STREAM_LZMA_ENTRY;
+
+typedef struct {
+  UINT32    Signature;
+  UINT32    StreamCount;
+  UINT32    StreamSize;         // Decoded size of every stream but the last
+  UINT32    UncompressedSize;
+  // MULTI_STREAM_LZMA_ENTRY  Entries[StreamCount];
+} MULTI_STREAM_LZMA_HEADER;
+
+#pragma pack ()
+
+extern EFI_GUID  gSophgoMultiStreamLzmaGuid;
+
+#endif
@@ -0,0 +1,77 @@
+/** @file
+  Definition of the MMC Cache Statistics Protocol
+
+  MmcDxe installs this protocol on each MMC device handle whose block
+  cache is enabled, so tools can tell how well the cache serves the boot.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+ **/
+
+#ifndef __MMC_CACHE_STATS_PROTOCOL_H__
+#define __MMC_CACHE_STATS_PROTOCOL_H__
+
+/*
+ * Global ID for the MMC Cache Statistics Protocol
+ */
+#define MMC_CACHE_STATS_PROTOCOL_GUID \
+  { 0x26fa7a19, 0xdc43, 0x4c22, {0x84, 0x3c, 0xae, 0x58, 0xb2, 0x75, 0xbe, 0x83 } }
+
+///
+/// Forward declaration for MMC_CACHE_STATS_PROTOCOL
+///
+typedef struct _MMC_CACHE_STATS_PROTOCOL  MMC_CACHE_STATS_PROTOCOL;
+
+typedef struct {
+  UINT64    Hits;               // Cache lines found in the cache
+  UINT64    Misses;             // Cache lines read from the device on demand
+  UINT64    Bypassed;           // Reads large enough to go straight to the device
+  UINT64    ReadAheadLines;     // Cache lines read ahead of a sequential stream
+  UINT64    ReadAheadHits;      // Read-ahead lines a later read actually used
+  UINT64    Evictions;          // Valid cache lines dropped to make room
+} MMC_CACHE_STATS;
+
+/**
+  Return the counters of the block cache.
+
+  @param[in]  This        Pointer to the MMC_CACHE_STATS_PROTOCOL instance.
+  @param[out] Stats       The counters since the last reset.
+
+  @retval EFI_SUCCESS             The counters were returned.
+  @retval EFI_INVALID_PARAMETER   Stats is NULL.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *MMC_CACHE_GET_STATS)(
+  IN  MMC_CACHE_STATS_PROTOCOL  *This,
+  OUT MMC_CACHE_STATS           *Stats
+  );
+
+/**
+  Clear the counters of the block cache. The cached data is kept.
+
+  @param[in]  This        Pointer to the MMC_CACHE_STATS_PROTOCOL instance.
+
+  @retval EFI_SUCCESS             The counters were cleared.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *MMC_CACHE_RESET_STATS)(
+  IN  MMC_CACHE_STATS_PROTOCOL  *This
+  );
+
+struct _MMC_CACHE_STATS_PROTOCOL {
+  UINT32                    Revision;
+  UINT32                    CacheSize;        // Bytes of block data the cache holds
+  UINT32                    ReadAheadSize;    // Bytes read ahead of a sequential stream
+  MMC_CACHE_GET_STATS       GetStats;
+  MMC_CACHE_RESET_STATS     ResetStats;
+};
+
+#define MMC_CACHE_STATS_PROTOCOL_REVISION   0x00010000    // 1.0
+
+#endif /* __MMC_CACHE_STATS_PROTOCOL_H__ */
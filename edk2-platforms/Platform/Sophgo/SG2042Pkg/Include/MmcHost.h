@@ -51,6 +51,8 @@ typedef UINT32  MMC_IDX;
 #define MMC_CMD_WAIT_RESPONSE      (1 << 16)
 #define MMC_CMD_LONG_RESPONSE      (1 << 17)
 #define MMC_CMD_NO_CRC_RESPONSE    (1 << 18)
+#define MMC_CMD_WITH_DATA          (1 << 19)   // Command index shared with a command without data
+#define MMC_CMD_AUTO_CMD23         (1 << 20)   // Host sends CMD23 ahead of CMD18/CMD25 by itself
 
 #define MMC_INDX(Index)       ((Index) & 0xFFFF)
 #define MMC_GET_INDX(MmcCmd)  ((MmcCmd) & 0xFFFF)
@@ -61,8 +63,10 @@ typedef UINT32  MMC_IDX;
 #define MMC_CMD3              (MMC_INDX(3))
 #define MMC_CMD5              (MMC_INDX(5))
 #define MMC_CMD6              (MMC_INDX(6))
+#define MMC_CMD6_SWITCH_FUNC  (MMC_INDX(6) | MMC_CMD_WITH_DATA)    // SD SWITCH_FUNC, 64-byte status
 #define MMC_CMD7              (MMC_INDX(7))
 #define MMC_CMD8              (MMC_INDX(8))
+#define MMC_CMD8_SEND_EXT_CSD (MMC_INDX(8) | MMC_CMD_WITH_DATA)    // eMMC SEND_EXT_CSD, 512-byte register
 #define MMC_CMD9              (MMC_INDX(9))
 #define MMC_CMD11             (MMC_INDX(11))
 #define MMC_CMD12             (MMC_INDX(12))
@@ -70,7 +74,9 @@ typedef UINT32  MMC_IDX;
 #define MMC_CMD16             (MMC_INDX(16))
 #define MMC_CMD17             (MMC_INDX(17))
 #define MMC_CMD18             (MMC_INDX(18))
+#define MMC_CMD19             (MMC_INDX(19))
 #define MMC_CMD20             (MMC_INDX(20))
+#define MMC_CMD21             (MMC_INDX(21))
 #define MMC_CMD23             (MMC_INDX(23))
 #define MMC_CMD24             (MMC_INDX(24))
 #define MMC_CMD25             (MMC_INDX(25))
@@ -115,6 +121,43 @@ typedef enum _CARD_DETECT_STATE {
 #define EMMCHS400DDR1V8      (1 << 6)      // HS400 Dual Data Rate @400MHz 1.8V I/O
 #define EMMCHS400DDR1V2      (1 << 7)      // HS400 Dual Data Rate @400MHz 1.2V I/O
 
+//
+// Bus timings that can be selected through EFI_MMC_HOST_PROTOCOL.SetTiming
+//
+typedef enum _MMC_BUS_TIMING {
+  MmcTimingLegacy = 0,        // SD default speed, up to 25MHz
+  MmcTimingSdHs,              // SD High Speed, up to 50MHz
+  MmcTimingUhsSdr12,          // UHS-I SDR12, 1.8V
+  MmcTimingUhsSdr25,          // UHS-I SDR25, 1.8V
+  MmcTimingUhsSdr50,          // UHS-I SDR50, 1.8V, up to 100MHz
+  MmcTimingUhsSdr104,         // UHS-I SDR104, 1.8V, up to 208MHz
+  MmcTimingUhsDdr50,          // UHS-I DDR50, 1.8V
+  MmcTimingMmcHs,             // eMMC High Speed, up to 52MHz
+  MmcTimingMmcDdr52,          // eMMC High Speed DDR, up to 52MHz
+  MmcTimingMmcHs200,          // eMMC HS200, 1.8V, up to 200MHz
+  MmcTimingMmcHs400,          // eMMC HS400, 1.8V, 200MHz DDR, sampling point tuned at HS200
+  MmcTimingMmcHs400Es,        // eMMC HS400, 1.8V, 200MHz DDR, enhanced strobe
+  MmcTimingMax
+} MMC_BUS_TIMING;
+
+//
+// Host capabilities returned by EFI_MMC_HOST_PROTOCOL.GetCapabilities
+//
+#define MMC_HOST_CAP_HIGHSPEED      BIT0
+#define MMC_HOST_CAP_1V8_SIGNALING  BIT1
+#define MMC_HOST_CAP_SDR50          BIT2
+#define MMC_HOST_CAP_SDR104         BIT3
+#define MMC_HOST_CAP_DDR50          BIT4
+#define MMC_HOST_CAP_SDR50_TUNING   BIT5
+#define MMC_HOST_CAP_8BIT           BIT6
+#define MMC_HOST_CAP_AUTO_CMD23     BIT7    // MMC_CMD_AUTO_CMD23 is honoured
+#define MMC_HOST_CAP_BLKCNT_32BIT   BIT8    // A transfer may exceed 65535 blocks
+#define MMC_HOST_CAP_DDR52          BIT9    // eMMC DDR52, at 3.3V or 1.8V signaling
+#define MMC_HOST_CAP_HS200          BIT10
+#define MMC_HOST_CAP_HS400          BIT11
+#define MMC_HOST_CAP_HS400_ES       BIT12
+#define MMC_HOST_CAP_ANY_ALIGN      BIT13   // Data buffers need no alignment, the host maps them for DMA
+
 ///
 /// Forward declaration for EFI_MMC_HOST_PROTOCOL
 ///
@@ -197,6 +240,32 @@ BOOLEAN
   IN  EFI_MMC_HOST_PROTOCOL     *This
   );
 
+typedef
+UINT32
+(EFIAPI *MMC_GETCAPABILITIES) (
+  IN  EFI_MMC_HOST_PROTOCOL     *This
+  );
+
+typedef
+EFI_STATUS
+(EFIAPI *MMC_SETTIMING) (
+  IN  EFI_MMC_HOST_PROTOCOL     *This,
+  IN  MMC_BUS_TIMING            Timing
+  );
+
+typedef
+EFI_STATUS
+(EFIAPI *MMC_SWITCHSIGNALVOLTAGE) (
+  IN  EFI_MMC_HOST_PROTOCOL     *This
+  );
+
+typedef
+EFI_STATUS
+(EFIAPI *MMC_EXECUTETUNING) (
+  IN  EFI_MMC_HOST_PROTOCOL     *This,
+  IN  MMC_IDX                   TuningCmd
+  );
+
 struct _EFI_MMC_HOST_PROTOCOL {
   UINT32                  Revision;
   MMC_ISCARDPRESENT       IsCardPresent;
@@ -213,13 +282,21 @@ struct _EFI_MMC_HOST_PROTOCOL {
   MMC_SETIOS              SetIos;
   MMC_PREPARE             Prepare;
   MMC_ISMULTIBLOCK        IsMultiBlock;
+
+  MMC_GETCAPABILITIES     GetCapabilities;
+  MMC_SETTIMING           SetTiming;
+  MMC_SWITCHSIGNALVOLTAGE SwitchSignalVoltage;
+  MMC_EXECUTETUNING       ExecuteTuning;
 };
 
-#define MMC_HOST_PROTOCOL_REVISION      0x00010002    // 1.2
+#define MMC_HOST_PROTOCOL_REVISION      0x00010003    // 1.3
 
 #define MMC_HOST_HAS_SETIOS(Host)       (Host->Revision >= MMC_HOST_PROTOCOL_REVISION && \
                                          Host->SetIos != NULL)
 #define MMC_HOST_HAS_ISMULTIBLOCK(Host) (Host->Revision >= MMC_HOST_PROTOCOL_REVISION && \
                                          Host->IsMultiBlock != NULL)
+#define MMC_HOST_HAS_SETTIMING(Host)    (Host->Revision >= 0x00010003 && \
+                                         Host->GetCapabilities != NULL && \
+                                         Host->SetTiming != NULL)
 
 #endif /* __MMC_HOST_PROTOCOL_H__ */
@@ -0,0 +1,558 @@
+/** @file
+  Parse the PCIe root complexes of the SG2042 out of the device tree.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <PiDxe.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/DxeServicesTableLib.h>
+#include <Library/HobLib.h>
+#include <Guid/FdtHob.h>
+#include <IndustryStandard/Pci.h>
+#include <libfdt.h>
+
+#include "PciHostBridgeFdt.h"
+
+//
+// The space code of the first cell of a PCI address, see the PCI Bus
+// Binding to IEEE Std 1275-1994.
+//
+#define DTB_PCI_ADDRESS_SPACE_MASK    (BIT25 | BIT24)
+#define DTB_PCI_ADDRESS_SPACE_IO      BIT24
+#define DTB_PCI_ADDRESS_SPACE_MMIO32  BIT25
+#define DTB_PCI_ADDRESS_SPACE_MMIO64  (BIT25 | BIT24)
+#define DTB_PCI_ADDRESS_PREFETCHABLE  BIT30
+#define DTB_PCI_ADDRESS_CELLS         3
+
+SG2042_PCIE_HOST  mPciHostBridgeFdtHosts[SG2042_PCIE_MAX_HOSTS];
+UINTN             mPciHostBridgeFdtHostCount;
+
+STATIC CONST CHAR8 *CONST  mPciHostBridgeFdtCompatible[] = {
+  "sophgo,sg2042-pcie-host",
+  "pci-host-ecam-generic"
+};
+
+/**
+  Get the number of cells of an address or a size of the children of a node.
+
+  @param  Fdt                    The device tree.
+  @param  Node                   The node.
+  @param  Name                   "#address-cells" or "#size-cells".
+  @param  Default                The number of cells if the node has no such property.
+
+  @return The number of cells, or 0 if the property is invalid.
+
+**/
+STATIC
+UINT32
+PciHostBridgeFdtGetCells (
+  IN CONST VOID   *Fdt,
+  IN INT32        Node,
+  IN CONST CHAR8  *Name,
+  IN UINT32       Default
+  )
+{
+  CONST fdt32_t  *Prop;
+  INT32          Len;
+  UINT32         Cells;
+
+  Prop = fdt_getprop (Fdt, Node, Name, &Len);
+  if (Prop == NULL) {
+    return Default;
+  }
+
+  if (Len != sizeof (*Prop)) {
+    return 0;
+  }
+
+  //
+  // Addresses and sizes of more than two cells do not fit in a UINT64
+  //
+  Cells = fdt32_to_cpu (*Prop);
+  if ((Cells == 0) || (Cells > 2)) {
+    return 0;
+  }
+
+  return Cells;
+}
+
+/**
+  Read a number of one or two cells.
+
+**/
+STATIC
+UINT64
+PciHostBridgeFdtReadCells (
+  IN CONST fdt32_t  *Cells,
+  IN UINT32         Count
+  )
+{
+  UINT64  Value;
+
+  Value = 0;
+  while (Count-- > 0) {
+    Value = LShiftU64 (Value, 32) | fdt32_to_cpu (*Cells++);
+  }
+
+  return Value;
+}
+
+/**
+  Check whether a node is an enabled root complex this library knows.
+
+**/
+STATIC
+BOOLEAN
+PciHostBridgeFdtIsHost (
+  IN CONST VOID  *Fdt,
+  IN INT32       Node
+  )
+{
+  CONST CHAR8  *Status;
+  INT32        Len;
+  UINTN        Index;
+
+  Status = fdt_getprop (Fdt, Node, "status", &Len);
+  if ((Status != NULL) &&
+      (AsciiStrCmp (Status, "okay") != 0) &&
+      (AsciiStrCmp (Status, "ok") != 0))
+  {
+    return FALSE;
+  }
+
+  for (Index = 0; Index < ARRAY_SIZE (mPciHostBridgeFdtCompatible); Index++) {
+    if (fdt_node_check_compatible (Fdt, Node, mPciHostBridgeFdtCompatible[Index]) == 0) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**
+  Find the index of the ECAM window in the "reg" property of a root complex.
+
+**/
+STATIC
+UINTN
+PciHostBridgeFdtEcamIndex (
+  IN CONST VOID  *Fdt,
+  IN INT32       Node
+  )
+{
+  CONST CHAR8  *Names;
+  INT32        Len;
+  UINTN        Index;
+  UINTN        NameLen;
+
+  Names = fdt_getprop (Fdt, Node, "reg-names", &Len);
+  if (Names == NULL) {
+    return 0;
+  }
+
+  for (Index = 0; Len > 0; Index++) {
+    if (AsciiStrCmp (Names, "cfg") == 0) {
+      return Index;
+    }
+
+    NameLen = AsciiStrnLenS (Names, (UINTN)Len) + 1;
+    Names  += NameLen;
+    Len    -= (INT32)NameLen;
+  }
+
+  return MAX_UINTN;
+}
+
+/**
+  Put a range of the "ranges" property of a root complex in its window.
+
+**/
+STATIC
+VOID
+PciHostBridgeFdtAddRange (
+  IN OUT SG2042_PCIE_HOST  *Host,
+  IN     UINT32            Space,
+  IN     UINT64            PciBase,
+  IN     UINT64            CpuBase,
+  IN     UINT64            Size
+  )
+{
+  SG2042_PCIE_WINDOW  *Window;
+  BOOLEAN             Prefetchable;
+
+  Prefetchable = (BOOLEAN)((Space & DTB_PCI_ADDRESS_PREFETCHABLE) != 0);
+  switch (Space & DTB_PCI_ADDRESS_SPACE_MASK) {
+    case DTB_PCI_ADDRESS_SPACE_IO:
+      Window = &Host->Io;
+      break;
+
+    case DTB_PCI_ADDRESS_SPACE_MMIO32:
+    case DTB_PCI_ADDRESS_SPACE_MMIO64:
+      //
+      // What matters to the host bridge is where the window is, not the
+      // space code: a 64-bit range below 4 GB still holds 32-bit BARs
+      //
+      if (PciBase + Size <= SIZE_4GB) {
+        Window = Prefetchable ? &Host->PMem : &Host->Mem;
+      } else {
+        Window = Prefetchable ? &Host->PMemAbove4G : &Host->MemAbove4G;
+      }
+
+      break;
+
+    default:
+      return;
+  }
+
+  if (Window->Size != 0) {
+    DEBUG ((
+      DEBUG_WARN,
+      "%a: segment %d: ignoring range [0x%lx+0x%lx) of space 0x%x\n",
+      __func__,
+      Host->Segment,
+      PciBase,
+      Size,
+      Space
+      ));
+    return;
+  }
+
+  Window->Base        = PciBase;
+  Window->Size        = Size;
+  Window->Translation = PciBase - CpuBase;
+}
+
+/**
+  Parse a root complex node.
+
+  @param  Fdt                    The device tree.
+  @param  Node                   The node.
+  @param  Host                   The root complex. Segment is set to its rank.
+
+  @retval EFI_SUCCESS            The root complex was parsed.
+  @retval EFI_UNSUPPORTED        The node does not describe an ECAM root complex.
+
+**/
+STATIC
+EFI_STATUS
+PciHostBridgeFdtParseHost (
+  IN     CONST VOID        *Fdt,
+  IN     INT32             Node,
+  IN OUT SG2042_PCIE_HOST  *Host
+  )
+{
+  CONST fdt32_t  *Prop;
+  INT32          Len;
+  INT32          Parent;
+  UINT32         ParentAddressCells;
+  UINT32         ParentSizeCells;
+  UINT32         SizeCells;
+  UINT32         RecordCells;
+  UINTN          EcamIndex;
+  UINT32         BusMin;
+  UINT32         BusMax;
+
+  Parent             = fdt_parent_offset (Fdt, Node);
+  ParentAddressCells = PciHostBridgeFdtGetCells (Fdt, Parent, "#address-cells", 2);
+  ParentSizeCells    = PciHostBridgeFdtGetCells (Fdt, Parent, "#size-cells", 1);
+  SizeCells          = PciHostBridgeFdtGetCells (Fdt, Node, "#size-cells", 2);
+  if ((Parent < 0) || (ParentAddressCells == 0) || (ParentSizeCells == 0) || (SizeCells == 0)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Prop = fdt_getprop (Fdt, Node, "linux,pci-domain", &Len);
+  if ((Prop != NULL) && (Len == sizeof (*Prop))) {
+    if (fdt32_to_cpu (*Prop) > MAX_UINT16) {
+      return EFI_UNSUPPORTED;
+    }
+
+    Host->Segment = (UINT16)fdt32_to_cpu (*Prop);
+  }
+
+  //
+  // The ECAM window
+  //
+  RecordCells = ParentAddressCells + ParentSizeCells;
+  EcamIndex   = PciHostBridgeFdtEcamIndex (Fdt, Node);
+  Prop        = fdt_getprop (Fdt, Node, "reg", &Len);
+  if ((Prop == NULL) || (EcamIndex >= Len / (RecordCells * sizeof (fdt32_t)))) {
+    DEBUG ((DEBUG_ERROR, "%a: segment %d: no ECAM window\n", __func__, Host->Segment));
+    return EFI_UNSUPPORTED;
+  }
+
+  Prop          += EcamIndex * RecordCells;
+  Host->EcamBase = PciHostBridgeFdtReadCells (Prop, ParentAddressCells);
+  Host->EcamSize = PciHostBridgeFdtReadCells (Prop + ParentAddressCells, ParentSizeCells);
+
+  //
+  // The bus range, inclusive. The ECAM window starts at its first bus and
+  // must cover all of them.
+  //
+  BusMin = 0;
+  BusMax = PCI_MAX_BUS;
+  Prop   = fdt_getprop (Fdt, Node, "bus-range", &Len);
+  if (Prop != NULL) {
+    if (Len != 2 * sizeof (*Prop)) {
+      return EFI_UNSUPPORTED;
+    }
+
+    BusMin = fdt32_to_cpu (Prop[0]);
+    BusMax = fdt32_to_cpu (Prop[1]);
+  }
+
+  if ((BusMin > BusMax) || (BusMax > PCI_MAX_BUS) ||
+      (Host->EcamSize < LShiftU64 (BusMax - BusMin + 1, 20)) ||
+      ((Host->EcamBase & (SIZE_1MB - 1)) != 0))
+  {
+    DEBUG ((
+      DEBUG_ERROR,
+      "%a: segment %d: ECAM window [0x%lx+0x%lx) does not cover buses 0x%x-0x%x\n",
+      __func__,
+      Host->Segment,
+      Host->EcamBase,
+      Host->EcamSize,
+      BusMin,
+      BusMax
+      ));
+    return EFI_UNSUPPORTED;
+  }
+
+  Host->BusMin = (UINT8)BusMin;
+  Host->BusMax = (UINT8)BusMax;
+
+  //
+  // The windows of the PCI address space
+  //
+  RecordCells = DTB_PCI_ADDRESS_CELLS + ParentAddressCells + SizeCells;
+  Prop        = fdt_getprop (Fdt, Node, "ranges", &Len);
+  if ((Prop == NULL) || (Len <= 0) || ((Len % (RecordCells * sizeof (fdt32_t))) != 0)) {
+    DEBUG ((DEBUG_ERROR, "%a: segment %d: 'ranges' not found or invalid\n", __func__, Host->Segment));
+    return EFI_UNSUPPORTED;
+  }
+
+  for ( ; Len > 0; Len -= RecordCells * sizeof (fdt32_t), Prop += RecordCells) {
+    PciHostBridgeFdtAddRange (
+      Host,
+      fdt32_to_cpu (Prop[0]),
+      PciHostBridgeFdtReadCells (Prop + 1, 2),
+      PciHostBridgeFdtReadCells (Prop + DTB_PCI_ADDRESS_CELLS, ParentAddressCells),
+      PciHostBridgeFdtReadCells (Prop + DTB_PCI_ADDRESS_CELLS + ParentAddressCells, SizeCells)
+      );
+  }
+
+  if ((Host->Mem.Size == 0) && (Host->PMem.Size == 0) &&
+      (Host->MemAbove4G.Size == 0) && (Host->PMemAbove4G.Size == 0))
+  {
+    DEBUG ((DEBUG_ERROR, "%a: segment %d: no memory window\n", __func__, Host->Segment));
+    return EFI_UNSUPPORTED;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Parse the enabled ECAM root complexes of the device tree.
+
+  A root complex node is compatible with "sophgo,sg2042-pcie-host" or
+  "pci-host-ecam-generic". Its ECAM window is the "cfg" entry of "reg" when
+  the node has "reg-names", and the first entry otherwise, and must cover
+  all the buses of "bus-range". Its segment is "linux,pci-domain", or its
+  rank among the root complexes when the node has none. Nodes that do not
+  follow this are skipped.
+
+  @param  Fdt                    The device tree.
+  @param  Hosts                  The root complexes found, sorted by segment.
+  @param  MaxHosts               The number of entries of Hosts.
+
+  @return The number of root complexes found.
+
+**/
+UINTN
+PciHostBridgeFdtParse (
+  IN  CONST VOID        *Fdt,
+  OUT SG2042_PCIE_HOST  *Hosts,
+  IN  UINTN             MaxHosts
+  )
+{
+  INT32             Node;
+  UINTN             Rank;
+  UINTN             Count;
+  UINTN             Index;
+  SG2042_PCIE_HOST  Host;
+
+  Count = 0;
+  Rank  = 0;
+  for (Node = fdt_next_node (Fdt, -1, NULL); Node >= 0; Node = fdt_next_node (Fdt, Node, NULL)) {
+    if (!PciHostBridgeFdtIsHost (Fdt, Node)) {
+      continue;
+    }
+
+    ZeroMem (&Host, sizeof (Host));
+    Host.Segment = (UINT16)Rank++;
+    if (EFI_ERROR (PciHostBridgeFdtParseHost (Fdt, Node, &Host))) {
+      continue;
+    }
+
+    //
+    // Keep the root complexes sorted by segment, and each segment once
+    //
+    for (Index = Count; Index > 0 && Hosts[Index - 1].Segment > Host.Segment; Index--) {
+    }
+
+    if ((Index > 0) && (Hosts[Index - 1].Segment == Host.Segment)) {
+      DEBUG ((DEBUG_ERROR, "%a: segment %d described twice\n", __func__, Host.Segment));
+      continue;
+    }
+
+    if (Count == MaxHosts) {
+      DEBUG ((DEBUG_ERROR, "%a: too many root complexes\n", __func__));
+      break;
+    }
+
+    CopyMem (&Hosts[Index + 1], &Hosts[Index], (Count - Index) * sizeof (Host));
+    CopyMem (&Hosts[Index], &Host, sizeof (Host));
+    Count++;
+  }
+
+  return Count;
+}
+
+/**
+  Return the device tree the boot firmware handed over to SEC.
+
+  @return The device tree, or NULL if there is none.
+
+**/
+STATIC
+CONST VOID *
+PciHostBridgeFdtGet (
+  VOID
+  )
+{
+  EFI_HOB_GUID_TYPE  *GuidHob;
+  CONST VOID         *Fdt;
+
+  GuidHob = GetFirstGuidHob (&gFdtHobGuid);
+  if (GuidHob == NULL) {
+    return NULL;
+  }
+
+  Fdt = (CONST VOID *)*(UINTN *)GET_GUID_HOB_DATA (GuidHob);
+  if ((Fdt == NULL) || (fdt_check_header (Fdt) != 0)) {
+    return NULL;
+  }
+
+  return Fdt;
+}
+
+/**
+  Map the ECAM window of a root complex in the GCD memory space map as
+  uncached MMIO. The window may already be MMIO when it is in the peripheral
+  window SEC describes.
+
+  @param  Base                   The base of the window.
+  @param  Size                   The size of the window.
+
+  @retval EFI_SUCCESS            The window is mapped.
+  @retval others                 The window could not be added or set uncached.
+
+**/
+STATIC
+EFI_STATUS
+MapGcdMmioSpace (
+  IN UINT64  Base,
+  IN UINT64  Size
+  )
+{
+  EFI_STATUS                       Status;
+  EFI_GCD_MEMORY_SPACE_DESCRIPTOR  Descriptor;
+
+  Status = gDS->GetMemorySpaceDescriptor (Base, &Descriptor);
+  if (EFI_ERROR (Status) || (Descriptor.GcdMemoryType == EfiGcdMemoryTypeNonExistent)) {
+    Status = gDS->AddMemorySpace (
+                    EfiGcdMemoryTypeMemoryMappedIo,
+                    Base,
+                    Size,
+                    EFI_MEMORY_UC
+                    );
+    if (EFI_ERROR (Status)) {
+      DEBUG ((
+        DEBUG_ERROR,
+        "%a: failed to add GCD memory space for region [0x%Lx+0x%Lx)\n",
+        __func__,
+        Base,
+        Size
+        ));
+      return Status;
+    }
+  }
+
+  Status = gDS->SetMemorySpaceAttributes (Base, Size, EFI_MEMORY_UC);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((
+      DEBUG_ERROR,
+      "%a: failed to set memory space attributes for region [0x%Lx+0x%Lx)\n",
+      __func__,
+      Base,
+      Size
+      ));
+  }
+
+  return Status;
+}
+
+/**
+  Parse the root complexes of the device tree once for the library, and map
+  their ECAM windows. The root complexes whose window cannot be mapped are
+  dropped, so that they are neither root bridges nor segments.
+
+  @param  ImageHandle            The image handle of the module.
+  @param  SystemTable            The EFI system table.
+
+  @retval EFI_SUCCESS            Always, a device tree without root complexes
+                                 has no root bridges and no segments.
+
+**/
+EFI_STATUS
+EFIAPI
+PciHostBridgeLibConstructor (
+  IN EFI_HANDLE        ImageHandle,
+  IN EFI_SYSTEM_TABLE  *SystemTable
+  )
+{
+  CONST VOID        *Fdt;
+  SG2042_PCIE_HOST  *Host;
+  UINTN             Count;
+  UINTN             Index;
+
+  Fdt = PciHostBridgeFdtGet ();
+  if (Fdt == NULL) {
+    DEBUG ((DEBUG_ERROR, "%a: no device tree\n", __func__));
+    return EFI_SUCCESS;
+  }
+
+  Count = PciHostBridgeFdtParse (
+            Fdt,
+            mPciHostBridgeFdtHosts,
+            ARRAY_SIZE (mPciHostBridgeFdtHosts)
+            );
+  for (Index = 0; Index < Count; Index++) {
+    Host = &mPciHostBridgeFdtHosts[Index];
+    if (EFI_ERROR (MapGcdMmioSpace (Host->EcamBase, Host->EcamSize))) {
+      DEBUG ((DEBUG_ERROR, "%a: segment %d dropped\n", __func__, Host->Segment));
+      continue;
+    }
+
+    if (mPciHostBridgeFdtHostCount != Index) {
+      CopyMem (&mPciHostBridgeFdtHosts[mPciHostBridgeFdtHostCount], Host, sizeof (*Host));
+    }
+
+    mPciHostBridgeFdtHostCount++;
+  }
+
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,73 @@
+/** @file
+  PCIe root complexes of the SG2042 as described by the device tree.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#ifndef PCI_HOST_BRIDGE_FDT_H_
+#define PCI_HOST_BRIDGE_FDT_H_
+
+//
+// The SG2042 has four PCIe controllers, each of them may be split in two
+// root complexes.
+//
+#define SG2042_PCIE_MAX_HOSTS  8
+
+//
+// A window of the PCI address space. Base is the PCI address and
+// Translation is the PCI address minus the CPU address. Size is 0 when the
+// root complex has no such window.
+//
+typedef struct {
+  UINT64    Base;
+  UINT64    Size;
+  UINT64    Translation;
+} SG2042_PCIE_WINDOW;
+
+typedef struct {
+  UINT16                Segment;
+  UINT64                EcamBase;
+  UINT64                EcamSize;
+  UINT8                 BusMin;
+  UINT8                 BusMax;
+  SG2042_PCIE_WINDOW    Io;
+  SG2042_PCIE_WINDOW    Mem;
+  SG2042_PCIE_WINDOW    PMem;
+  SG2042_PCIE_WINDOW    MemAbove4G;
+  SG2042_PCIE_WINDOW    PMemAbove4G;
+} SG2042_PCIE_HOST;
+
+//
+// The root complexes of the device tree whose ECAM window is mapped, sorted
+// by segment, as parsed by the constructor of the library. Both the root
+// bridges and the segments are built from them.
+//
+extern SG2042_PCIE_HOST  mPciHostBridgeFdtHosts[SG2042_PCIE_MAX_HOSTS];
+extern UINTN             mPciHostBridgeFdtHostCount;
+
+/**
+  Parse the enabled ECAM root complexes of the device tree.
+
+  A root complex node is compatible with "sophgo,sg2042-pcie-host" or
+  "pci-host-ecam-generic". Its ECAM window is the "cfg" entry of "reg" when
+  the node has "reg-names", and the first entry otherwise, and must cover
+  all the buses of "bus-range". Its segment is "linux,pci-domain", or its
+  rank among the root complexes when the node has none. Nodes that do not
+  follow this are skipped.
+
+  @param  Fdt                    The device tree.
+  @param  Hosts                  The root complexes found, sorted by segment.
+  @param  MaxHosts               The number of entries of Hosts.
+
+  @return The number of root complexes found.
+
+**/
+UINTN
+PciHostBridgeFdtParse (
+  IN  CONST VOID        *Fdt,
+  OUT SG2042_PCIE_HOST  *Hosts,
+  IN  UINTN             MaxHosts
+  );
+
+#endif
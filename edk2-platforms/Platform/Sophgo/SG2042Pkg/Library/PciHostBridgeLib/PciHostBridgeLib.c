@@ -0,0 +1,254 @@
+/** @file
+  PCI Host Bridge Library instance for the SG2042, describing the ECAM PCIe
+  root complexes of the device tree.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <PiDxe.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PciHostBridgeLib.h>
+#include <Protocol/PciHostBridgeResourceAllocation.h>
+#include <Protocol/PciRootBridgeIo.h>
+
+#include "PciHostBridgeFdt.h"
+
+GLOBAL_REMOVE_IF_UNREFERENCED
+STATIC CHAR16 CONST *CONST  mPciHostBridgeLibAcpiAddressSpaceTypeStr[] = {
+  L"Mem", L"I/O", L"Bus"
+};
+
+#pragma pack (1)
+typedef struct {
+  ACPI_HID_DEVICE_PATH        AcpiDevicePath;
+  EFI_DEVICE_PATH_PROTOCOL    EndDevicePath;
+} EFI_PCI_ROOT_BRIDGE_DEVICE_PATH;
+#pragma pack ()
+
+STATIC CONST EFI_PCI_ROOT_BRIDGE_DEVICE_PATH  mEfiPciRootBridgeDevicePath = {
+  {
+    {
+      ACPI_DEVICE_PATH,
+      ACPI_DP,
+      {
+        (UINT8)sizeof (ACPI_HID_DEVICE_PATH),
+        (UINT8)(sizeof (ACPI_HID_DEVICE_PATH) >> 8)
+      }
+    },
+    EISA_PNP_ID (0x0A08), // PCIe
+    0
+  },
+  {
+    END_DEVICE_PATH_TYPE,
+    END_ENTIRE_DEVICE_PATH_SUBTYPE,
+    {
+      END_DEVICE_PATH_LENGTH,
+      0
+    }
+  }
+};
+
+/**
+  Fill in an aperture of a root bridge from a window of a root complex.
+
+**/
+STATIC
+VOID
+SetAperture (
+  OUT PCI_ROOT_BRIDGE_APERTURE  *Aperture,
+  IN  CONST SG2042_PCIE_WINDOW  *Window
+  )
+{
+  if (Window->Size == 0) {
+    Aperture->Base  = MAX_UINT64;
+    Aperture->Limit = 0;
+    return;
+  }
+
+  Aperture->Base        = Window->Base;
+  Aperture->Limit       = Window->Base + Window->Size - 1;
+  Aperture->Translation = Window->Translation;
+}
+
+/**
+  Return all the root bridge instances in an array.
+
+  @param Count  Return the count of root bridge instances.
+
+  @return All the root bridge instances in an array.
+          The array should be passed into PciHostBridgeFreeRootBridges()
+          when it's not used.
+**/
+PCI_ROOT_BRIDGE *
+EFIAPI
+PciHostBridgeGetRootBridges (
+  UINTN  *Count
+  )
+{
+  SG2042_PCIE_HOST                 *Hosts;
+  UINTN                            Index;
+  PCI_ROOT_BRIDGE                  *Bridges;
+  PCI_ROOT_BRIDGE                  *Bridge;
+  EFI_PCI_ROOT_BRIDGE_DEVICE_PATH  *DevicePath;
+
+  *Count = 0;
+
+  Hosts = mPciHostBridgeFdtHosts;
+  if (mPciHostBridgeFdtHostCount == 0) {
+    DEBUG ((DEBUG_INFO, "%a: no PCIe root complex\n", __func__));
+    return NULL;
+  }
+
+  Bridges = AllocateZeroPool (mPciHostBridgeFdtHostCount * sizeof (*Bridges));
+  if (Bridges == NULL) {
+    return NULL;
+  }
+
+  for (Index = 0; Index < mPciHostBridgeFdtHostCount; Index++) {
+    DevicePath = AllocateCopyPool (sizeof (*DevicePath), &mEfiPciRootBridgeDevicePath);
+    if (DevicePath == NULL) {
+      break;
+    }
+
+    DevicePath->AcpiDevicePath.UID = Hosts[Index].Segment;
+
+    Bridge                        = &Bridges[*Count];
+    Bridge->Segment               = Hosts[Index].Segment;
+    Bridge->DmaAbove4G            = TRUE;
+    Bridge->NoExtendedConfigSpace = FALSE;
+    Bridge->ResourceAssigned      = FALSE;
+    Bridge->Bus.Base              = Hosts[Index].BusMin;
+    Bridge->Bus.Limit             = Hosts[Index].BusMax;
+    Bridge->DevicePath            = (EFI_DEVICE_PATH_PROTOCOL *)DevicePath;
+
+    //
+    // Each root complex reaches the I/O space through its own MMIO window,
+    // which the generic host bridge has no way to translate to; the devices
+    // behind the root ports only need memory BARs, so no I/O aperture is
+    // reported.
+    //
+    Bridge->Io.Base  = MAX_UINT64;
+    Bridge->Io.Limit = 0;
+    SetAperture (&Bridge->Mem, &Hosts[Index].Mem);
+    SetAperture (&Bridge->PMem, &Hosts[Index].PMem);
+    SetAperture (&Bridge->MemAbove4G, &Hosts[Index].MemAbove4G);
+    SetAperture (&Bridge->PMemAbove4G, &Hosts[Index].PMemAbove4G);
+
+    if ((Hosts[Index].PMem.Size == 0) && (Hosts[Index].PMemAbove4G.Size == 0)) {
+      Bridge->AllocationAttributes |= EFI_PCI_HOST_BRIDGE_COMBINE_MEM_PMEM;
+    }
+
+    if ((Hosts[Index].MemAbove4G.Size != 0) || (Hosts[Index].PMemAbove4G.Size != 0)) {
+      Bridge->AllocationAttributes |= EFI_PCI_HOST_BRIDGE_MEM64_DECODE;
+    }
+
+    DEBUG ((
+      DEBUG_INFO,
+      "%a: segment %d: ECAM 0x%lx, buses 0x%lx-0x%lx\n",
+      __func__,
+      Bridge->Segment,
+      Hosts[Index].EcamBase,
+      Bridge->Bus.Base,
+      Bridge->Bus.Limit
+      ));
+
+    (*Count)++;
+  }
+
+  if (*Count == 0) {
+    FreePool (Bridges);
+    return NULL;
+  }
+
+  return Bridges;
+}
+
+/**
+  Free the root bridge instances array returned from PciHostBridgeGetRootBridges().
+
+  @param Bridges The root bridge instances array.
+  @param Count   The count of the array.
+**/
+VOID
+EFIAPI
+PciHostBridgeFreeRootBridges (
+  PCI_ROOT_BRIDGE  *Bridges,
+  UINTN            Count
+  )
+{
+  UINTN  Index;
+
+  if ((Bridges == NULL) || (Count == 0)) {
+    return;
+  }
+
+  for (Index = 0; Index < Count; Index++) {
+    FreePool (Bridges[Index].DevicePath);
+  }
+
+  FreePool (Bridges);
+}
+
+/**
+  Inform the platform that the resource conflict happens.
+
+  @param HostBridgeHandle Handle of the Host Bridge.
+  @param Configuration    Pointer to PCI I/O and PCI memory resource
+                          descriptors. The Configuration contains the resources
+                          for all the root bridges. The resource for each root
+                          bridge is terminated with END descriptor and an
+                          additional END is appended indicating the end of the
+                          entire resources. The resource descriptor field
+                          values follow the description in
+                          EFI_PCI_HOST_BRIDGE_RESOURCE_ALLOCATION_PROTOCOL.\
+                          SubmitResources().
+**/
+VOID
+EFIAPI
+PciHostBridgeResourceConflict (
+  EFI_HANDLE  HostBridgeHandle,
+  VOID        *Configuration
+  )
+{
+  EFI_ACPI_ADDRESS_SPACE_DESCRIPTOR  *Descriptor;
+
+  DEBUG ((DEBUG_ERROR, "PciHostBridge: Resource conflict happened!\n"));
+  Descriptor = (EFI_ACPI_ADDRESS_SPACE_DESCRIPTOR *)Configuration;
+
+  while (Descriptor->Desc == ACPI_ADDRESS_SPACE_DESCRIPTOR) {
+    for ( ; Descriptor->Desc == ACPI_ADDRESS_SPACE_DESCRIPTOR; Descriptor++) {
+      ASSERT (Descriptor->ResType < ARRAY_SIZE (mPciHostBridgeLibAcpiAddressSpaceTypeStr));
+      DEBUG ((
+        DEBUG_ERROR,
+        " %s: Length/Alignment = 0x%lx / 0x%lx\n",
+        mPciHostBridgeLibAcpiAddressSpaceTypeStr[Descriptor->ResType],
+        Descriptor->AddrLen,
+        Descriptor->AddrRangeMax
+        ));
+      if (Descriptor->ResType == ACPI_ADDRESS_SPACE_TYPE_MEM) {
+        DEBUG ((
+          DEBUG_ERROR,
+          "     Granularity/SpecificFlag = %ld / %02x%s\n",
+          Descriptor->AddrSpaceGranularity,
+          Descriptor->SpecificFlag,
+          ((Descriptor->SpecificFlag &
+            EFI_ACPI_MEMORY_RESOURCE_SPECIFIC_FLAG_CACHEABLE_PREFETCHABLE
+            ) != 0) ? L" (Prefetchable)" : L""
+          ));
+      }
+    }
+
+    //
+    // Skip the END descriptor for root bridge
+    //
+    ASSERT (Descriptor->Desc == ACPI_END_TAG_DESCRIPTOR);
+    Descriptor = (EFI_ACPI_ADDRESS_SPACE_DESCRIPTOR *)(
+                   (EFI_ACPI_END_TAG_DESCRIPTOR *)Descriptor + 1
+                   );
+  }
+}
@@ -0,0 +1,57 @@
+/** @file
+  PCI segment information of the SG2042, from the ECAM windows of the PCIe
+  root complexes of the device tree.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <PiDxe.h>
+#include <Library/BaseLib.h>
+#include <Library/PciSegmentInfoLib.h>
+
+#include "PciHostBridgeFdt.h"
+
+STATIC PCI_SEGMENT_INFO  mPciSegmentInfo[SG2042_PCIE_MAX_HOSTS];
+STATIC UINTN             mPciSegmentCount = MAX_UINTN;
+
+/**
+  Return an array of PCI_SEGMENT_INFO holding the segment information.
+
+  Note: The returned array/buffer is owned by callee.
+
+  @param  Count  Return the count of segments.
+
+  @retval A callee owned array holding the segment information.
+**/
+PCI_SEGMENT_INFO *
+EFIAPI
+GetPciSegmentInfo (
+  UINTN  *Count
+  )
+{
+  UINTN  Index;
+
+  //
+  // PciSegmentLib asks for the segments on every configuration access, only
+  // build them the first time
+  //
+  if (mPciSegmentCount == MAX_UINTN) {
+    for (Index = 0; Index < mPciHostBridgeFdtHostCount; Index++) {
+      //
+      // The ECAM window of the device tree starts at the first bus of the
+      // segment, BaseAddress is where bus 0 would be
+      //
+      mPciSegmentInfo[Index].SegmentNumber  = mPciHostBridgeFdtHosts[Index].Segment;
+      mPciSegmentInfo[Index].BaseAddress    = mPciHostBridgeFdtHosts[Index].EcamBase -
+                                              LShiftU64 (mPciHostBridgeFdtHosts[Index].BusMin, 20);
+      mPciSegmentInfo[Index].StartBusNumber = mPciHostBridgeFdtHosts[Index].BusMin;
+      mPciSegmentInfo[Index].EndBusNumber   = mPciHostBridgeFdtHosts[Index].BusMax;
+    }
+
+    mPciSegmentCount = mPciHostBridgeFdtHostCount;
+  }
+
+  *Count = mPciSegmentCount;
+  return mPciSegmentInfo;
+}
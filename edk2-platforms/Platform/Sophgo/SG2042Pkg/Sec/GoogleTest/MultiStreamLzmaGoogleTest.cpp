@@ -0,0 +1,608 @@
+/** @file
+  Host test of the multi-stream LZMA GUIDed section.
+
+  The sections are encoded by Tools/Sg2042MultiLzmaCompress, the way GenFds
+  does, and decoded by the decoder of SEC in MultiStreamLzma.c through the
+  ExtractGuidedSectionLib. The SBI HSM calls of the decoder start a host
+  thread per hart, which enters the decoder like SecEntry.S does, so the
+  streams are decoded in parallel. A timing comparison decodes the same
+  data as one LZMA section through LzmaCustomDecompressLib, the way the DXE
+  FV is decoded without the multi-stream layout.
+
+  The tests are skipped when the tool or LzmaCompress can not be run.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+#include <Library/GoogleTestLib.h>
+#include <atomic>
+#include <chrono>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+  #include <PiPei.h>
+  #include <Library/BaseLib.h>
+  #include <Library/BaseMemoryLib.h>
+  #include <Library/BaseRiscVSbiLib.h>
+  #include <Library/ExtractGuidedSectionLib.h>
+  #include <Library/MemoryAllocationLib.h>
+  #include <Guid/LzmaDecompress.h>
+  #include <Guid/MultiStreamLzma.h>
+  #include "../SecMain.h"
+
+  //
+  // Provided by LzmaCustomDecompressLib, which has no public header for it
+  //
+  EFI_STATUS
+  EFIAPI
+  LzmaDecompressLibConstructor (
+    VOID
+    );
+
+  VOID
+  EFIAPI
+  MultiStreamLzmaWorker (
+    IN VOID  *Worker
+    );
+}
+
+using namespace testing;
+
+#define HART_COUNT   FixedPcdGet32 (PcdNumberofC920Cores)
+#define STREAM_SIZE  SIZE_256KB
+
+//
+// The harts of the SBI HSM model. A hart that is not present fails to start.
+//
+STATIC EFI_RISCV_FIRMWARE_CONTEXT    mFirmwareContext;
+STATIC BOOLEAN                       mHartPresent[HART_COUNT];
+STATIC std::atomic<UINTN>            mHartState[HART_COUNT];
+STATIC std::vector<std::thread>      mHartThreads;
+STATIC std::atomic<UINT32>           mHartStarts;
+STATIC std::atomic<UINT32>           mRunningHartStarts;   // Starts of a hart that runs
+STATIC std::atomic<UINT32>           mBadStacks;
+STATIC UINT8                         *mScratch;
+STATIC UINTN                         mScratchSize;
+STATIC thread_local std::jmp_buf     mHartStop;
+
+/**
+  Entry of a secondary hart, which SecEntry.S implements on the board by
+  switching to the stack of the worker.
+
+**/
+extern "C"
+VOID
+EFIAPI
+MultiStreamLzmaHartEntry (
+  IN  UINTN  HartId,
+  IN  VOID   *Worker
+  )
+{
+  UINT64  StackTop;
+
+  //
+  // The stack the worker gets has to be in the scratch buffer, aligned for
+  // the RISC-V calling convention
+  //
+  StackTop = *(UINT64 *)Worker;
+  if ((StackTop <= (UINTN)mScratch) || (StackTop > (UINTN)mScratch + mScratchSize) || ((StackTop & 0xF) != 0)) {
+    mBadStacks++;
+  }
+
+  MultiStreamLzmaWorker (Worker);
+}
+
+STATIC
+VOID
+HartThread (
+  IN  UINTN  HartId,
+  IN  UINTN  StartAddress,
+  IN  UINTN  Opaque
+  )
+{
+  if (setjmp (mHartStop) == 0) {
+    ((VOID (EFIAPI *)(UINTN, VOID *))StartAddress)(HartId, (VOID *)Opaque);
+  }
+
+  mHartState[HartId] = SBI_HSM_STATE_STOPPED;
+}
+
+extern "C"
+SBI_RET
+EFIAPI
+SbiCall (
+  IN  UINTN  ExtId,
+  IN  UINTN  FuncId,
+  IN  UINTN  NumArgs,
+  ...
+  )
+{
+  VA_LIST  Args;
+  UINTN    HartId;
+  UINTN    StartAddress;
+  UINTN    Opaque;
+  SBI_RET  Ret;
+
+  Ret.Error = SBI_SUCCESS;
+  Ret.Value = 0;
+  if (ExtId != SBI_EXT_HSM) {
+    Ret.Error = SBI_ERR_NOT_SUPPORTED;
+    return Ret;
+  }
+
+  VA_START (Args, NumArgs);
+  switch (FuncId) {
+    case SBI_EXT_HSM_HART_START:
+      HartId       = VA_ARG (Args, UINTN);
+      StartAddress = VA_ARG (Args, UINTN);
+      Opaque       = VA_ARG (Args, UINTN);
+      if ((HartId >= HART_COUNT) || !mHartPresent[HartId]) {
+        Ret.Error = SBI_ERR_INVALID_PARAM;
+      } else if (mHartState[HartId] != SBI_HSM_STATE_STOPPED) {
+        mRunningHartStarts++;
+        Ret.Error = SBI_ERR_ALREADY_AVAILABLE;
+      } else {
+        mHartStarts++;
+        mHartState[HartId] = SBI_HSM_STATE_STARTED;
+        mHartThreads.emplace_back (HartThread, HartId, StartAddress, Opaque);
+      }
+
+      break;
+
+    case SBI_EXT_HSM_HART_STOP:
+      VA_END (Args);
+      std::longjmp (mHartStop, 1);
+
+    case SBI_EXT_HSM_HART_GET_STATUS:
+      HartId = VA_ARG (Args, UINTN);
+      if (HartId >= HART_COUNT) {
+        Ret.Error = SBI_ERR_INVALID_PARAM;
+      } else {
+        Ret.Value = mHartState[HartId];
+      }
+
+      break;
+
+    default:
+      Ret.Error = SBI_ERR_NOT_SUPPORTED;
+      break;
+  }
+
+  VA_END (Args);
+  return Ret;
+}
+
+extern "C"
+VOID
+EFIAPI
+GetFirmwareContextPointer (
+  IN OUT EFI_RISCV_FIRMWARE_CONTEXT  **FirmwareContextPtr
+  )
+{
+  *FirmwareContextPtr = &mFirmwareContext;
+}
+
+//
+// Run a tool of the build, returning whether it succeeded.
+//
+STATIC
+bool
+RunTool (
+  const std::string  &Command
+  )
+{
+ #ifdef _WIN32
+  return std::system ((Command + " > NUL 2>&1").c_str ()) == 0;
+ #else
+  return std::system ((Command + " > /dev/null 2>&1").c_str ()) == 0;
+ #endif
+}
+
+STATIC
+std::vector<UINT8>
+ReadFile (
+  const std::string  &Path
+  )
+{
+  std::ifstream  File (Path, std::ios::binary);
+
+  return std::vector<UINT8>((std::istreambuf_iterator<char>(File)), std::istreambuf_iterator<char>());
+}
+
+STATIC
+void
+WriteFile (
+  const std::string         &Path,
+  const std::vector<UINT8>  &Data
+  )
+{
+  std::ofstream  File (Path, std::ios::binary);
+
+  File.write ((const char *)Data.data (), Data.size ());
+}
+
+//
+// Wrap the output of a GUIDed section tool in a GUID defined section, the
+// way GenSec does.
+//
+STATIC
+std::vector<UINT8>
+GuidedSection (
+  const EFI_GUID            *Guid,
+  const std::vector<UINT8>  &Data
+  )
+{
+  std::vector<UINT8>        Section (sizeof (EFI_GUID_DEFINED_SECTION) + Data.size ());
+  EFI_GUID_DEFINED_SECTION  *Header;
+
+  Header = (EFI_GUID_DEFINED_SECTION *)Section.data ();
+  Header->CommonHeader.Type = EFI_SECTION_GUID_DEFINED;
+  Header->CommonHeader.Size[0] = (UINT8)Section.size ();
+  Header->CommonHeader.Size[1] = (UINT8)(Section.size () >> 8);
+  Header->CommonHeader.Size[2] = (UINT8)(Section.size () >> 16);
+  CopyGuid (&Header->SectionDefinitionGuid, Guid);
+  Header->DataOffset = sizeof (EFI_GUID_DEFINED_SECTION);
+  Header->Attributes = EFI_GUIDED_SECTION_PROCESSING_REQUIRED;
+  memcpy (Section.data () + sizeof (EFI_GUID_DEFINED_SECTION), Data.data (), Data.size ());
+  return Section;
+}
+
+class MultiStreamLzmaTest : public Test {
+protected:
+  static std::vector<UINT8>  Input;
+  static std::vector<UINT8>  MultiStream;     // The multi-stream section
+  static std::vector<UINT8>  SingleStream;    // The same data in one LZMA section
+  static std::string         SkipReason;
+
+  //
+  // Something like a DXE FV: code built from a limited set of instruction
+  // patterns, and zeroed padding between the files.
+  //
+  static void
+  MakeInput (
+    UINTN  Size
+    )
+  {
+    UINT32  Seed;
+    UINT32  Patterns[512];
+    UINTN   Index;
+
+    Seed = 0x2042;
+    for (Index = 0; Index < ARRAY_SIZE (Patterns); Index++) {
+      Seed            = Seed * 1103515245 + 12345;
+      Patterns[Index] = Seed;
+    }
+
+    Input.clear ();
+    while (Input.size () < Size) {
+      Seed = Seed * 1103515245 + 12345;
+      if ((Seed >> 16) % 64 == 0) {
+        Input.resize (Input.size () + (Seed >> 8) % 2048, 0);
+      } else {
+        Input.insert (Input.end (), (UINT8 *)&Patterns[(Seed >> 12) % 512], (UINT8 *)&Patterns[(Seed >> 12) % 512] + 4);
+        Input.push_back ((UINT8)(Seed >> 24));
+      }
+    }
+
+    Input.resize (Size);
+  }
+
+  static void
+  SetUpTestSuite (
+    )
+  {
+    std::string  Tool;
+    std::string  Dir;
+    std::string  Name;
+    UINTN        Index;
+
+    //
+    // The tool is in the Tools directory of the package
+    //
+    Tool = __FILE__;
+    for (Index = 0; Index < 3; Index++) {
+      Tool = Tool.substr (0, Tool.find_last_of ("/\\"));
+    }
+
+    Tool += "/Tools/Sg2042MultiLzmaCompress";
+    if (!std::ifstream (Tool).good ()) {
+      SkipReason = Tool + " not found";
+      return;
+    }
+
+    if (!RunTool ("LzmaCompress --version")) {
+      SkipReason = "LzmaCompress not found";
+      return;
+    }
+
+    Dir = std::getenv ("TMPDIR") != NULL ? std::getenv ("TMPDIR") : "/tmp";
+    Name = Dir + "/MultiStreamLzmaGoogleTest." + std::to_string ((unsigned long long)std::chrono::steady_clock::now ().time_since_epoch ().count ());
+
+    MakeInput (SIZE_2MB + 0x1234);
+    WriteFile (Name + ".in", Input);
+    if (!RunTool ("python3 \"" + Tool + "\" -e -s " + std::to_string (STREAM_SIZE) + " -o \"" + Name + ".mslz\" \"" + Name + ".in\"") ||
+        !RunTool ("LzmaCompress -e -o \"" + Name + ".lzma\" \"" + Name + ".in\""))
+    {
+      SkipReason = "the tools failed to encode " + Name + ".in";
+      return;
+    }
+
+    MultiStream  = GuidedSection (&gSophgoMultiStreamLzmaGuid, ReadFile (Name + ".mslz"));
+    SingleStream = GuidedSection (&gLzmaCustomDecompressGuid, ReadFile (Name + ".lzma"));
+    std::remove ((Name + ".in").c_str ());
+    std::remove ((Name + ".mslz").c_str ());
+    std::remove ((Name + ".lzma").c_str ());
+
+    //
+    // SEC registers both decoders, the constructors of the libraries do not
+    // run in a host application
+    //
+    ASSERT_EQ (MultiStreamLzmaRegister (), RETURN_SUCCESS);
+    ASSERT_EQ (LzmaDecompressLibConstructor (), EFI_SUCCESS);
+  }
+
+  void
+  SetUp (
+    ) override
+  {
+    if (!SkipReason.empty ()) {
+      GTEST_SKIP () << SkipReason;
+    }
+
+    mFirmwareContext.BootHartId = 0;
+    SetHartsPresent (HART_COUNT);
+    mHartStarts        = 0;
+    mRunningHartStarts = 0;
+    mBadStacks         = 0;
+  }
+
+  void
+  TearDown (
+    ) override
+  {
+    for (auto &Thread : mHartThreads) {
+      Thread.join ();
+    }
+
+    mHartThreads.clear ();
+  }
+
+  //
+  // Let the first harts be present, the others fail to start.
+  //
+  static void
+  SetHartsPresent (
+    UINTN  Count
+    )
+  {
+    for (UINTN Hart = 0; Hart < HART_COUNT; Hart++) {
+      mHartPresent[Hart] = Hart < Count;
+      mHartState[Hart]   = SBI_HSM_STATE_STOPPED;
+    }
+  }
+
+  //
+  // Decode a section through the ExtractGuidedSectionLib like SEC does,
+  // returning the nanoseconds the decoding took.
+  //
+  RETURN_STATUS
+  Decode (
+    const std::vector<UINT8>  &Section,
+    std::vector<UINT8>        &Output,
+    UINT64                    *Time = NULL
+    )
+  {
+    RETURN_STATUS  Status;
+    UINT32         OutputSize;
+    UINT32         ScratchSize;
+    UINT16         Attributes;
+    UINT32         AuthenticationStatus;
+    VOID           *OutputBuffer;
+
+    Status = ExtractGuidedSectionGetInfo (Section.data (), &OutputSize, &ScratchSize, &Attributes);
+    if (RETURN_ERROR (Status)) {
+      return Status;
+    }
+
+    Output.assign (OutputSize, 0);
+    mScratchSize = ScratchSize;
+    mScratch     = (UINT8 *)AllocatePool (ScratchSize);
+    OutputBuffer = Output.data ();
+
+    auto  Start = std::chrono::steady_clock::now ();
+
+    Status = ExtractGuidedSectionDecode (Section.data (), &OutputBuffer, mScratch, &AuthenticationStatus);
+
+    if (Time != NULL) {
+      *Time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now () - Start).count ();
+    }
+
+    //
+    // The decoder must have waited for the harts to stop before it returned
+    //
+    for (UINTN Hart = 0; Hart < HART_COUNT; Hart++) {
+      if (Hart != mFirmwareContext.BootHartId) {
+        EXPECT_EQ (mHartState[Hart], (UINTN)SBI_HSM_STATE_STOPPED);
+      }
+    }
+
+    EXPECT_EQ (mRunningHartStarts, 0U);
+
+    FreePool (mScratch);
+    mScratch = NULL;
+    return Status;
+  }
+
+  //
+  // The fastest of a few decodings, in nanoseconds.
+  //
+  UINT64
+  BestTime (
+    const std::vector<UINT8>  &Section
+    )
+  {
+    std::vector<UINT8>  Output;
+    UINT64              Time;
+    UINT64              Best;
+
+    Best = MAX_UINT64;
+    for (UINTN Run = 0; Run < 5; Run++) {
+      EXPECT_EQ (Decode (Section, Output, &Time), RETURN_SUCCESS);
+      EXPECT_TRUE (Output == Input);
+      Best = MIN (Best, Time);
+    }
+
+    return Best;
+  }
+};
+
+std::vector<UINT8>  MultiStreamLzmaTest::Input;
+std::vector<UINT8>  MultiStreamLzmaTest::MultiStream;
+std::vector<UINT8>  MultiStreamLzmaTest::SingleStream;
+std::string         MultiStreamLzmaTest::SkipReason;
+
+//
+// The output of the tool decodes back to its input on all harts.
+//
+TEST_F (MultiStreamLzmaTest, RoundTripOnAllHarts) {
+  std::vector<UINT8>        Output;
+  MULTI_STREAM_LZMA_HEADER  *Header;
+
+  Header = (MULTI_STREAM_LZMA_HEADER *)(MultiStream.data () + sizeof (EFI_GUID_DEFINED_SECTION));
+  ASSERT_EQ (Header->Signature, (UINT32)MULTI_STREAM_LZMA_SIGNATURE);
+  EXPECT_EQ (Header->StreamSize, (UINT32)STREAM_SIZE);
+  EXPECT_EQ (Header->UncompressedSize, Input.size ());
+  EXPECT_EQ (Header->StreamCount, (Input.size () + STREAM_SIZE - 1) / STREAM_SIZE);
+
+  ASSERT_EQ (Decode (MultiStream, Output), RETURN_SUCCESS);
+  EXPECT_TRUE (Output == Input);
+  EXPECT_EQ (mHartStarts, MIN (Header->StreamCount, HART_COUNT) - 1);
+  EXPECT_EQ (mBadStacks, 0U);
+}
+
+//
+// The boot hart is not started again, wherever it is.
+//
+TEST_F (MultiStreamLzmaTest, RoundTripFromAnotherBootHart) {
+  std::vector<UINT8>  Output;
+
+  mFirmwareContext.BootHartId = 3;
+  mHartState[3]               = SBI_HSM_STATE_STARTED;
+  ASSERT_EQ (Decode (MultiStream, Output), RETURN_SUCCESS);
+  mHartState[3] = SBI_HSM_STATE_STOPPED;
+  EXPECT_TRUE (Output == Input);
+  EXPECT_GT (mHartStarts, 0U);
+}
+
+//
+// The boot hart decodes the streams the harts that did not start leave.
+//
+TEST_F (MultiStreamLzmaTest, RoundTripWithFewerHarts) {
+  std::vector<UINT8>  Output;
+
+  SetHartsPresent (3);
+  ASSERT_EQ (Decode (MultiStream, Output), RETURN_SUCCESS);
+  EXPECT_TRUE (Output == Input);
+  EXPECT_EQ (mHartStarts, 2U);
+
+  SetHartsPresent (0);
+  mHartStarts = 0;
+  ASSERT_EQ (Decode (MultiStream, Output), RETURN_SUCCESS);
+  EXPECT_TRUE (Output == Input);
+  EXPECT_EQ (mHartStarts, 0U);
+}
+
+//
+// An index pointing out of the section is rejected before any hart starts.
+//
+TEST_F (MultiStreamLzmaTest, RejectsBadIndex) {
+  std::vector<UINT8>        Section;
+  std::vector<UINT8>        Output;
+  MULTI_STREAM_LZMA_HEADER  *Header;
+  MULTI_STREAM_LZMA_ENTRY   *Entries;
+
+  Section = MultiStream;
+  Header  = (MULTI_STREAM_LZMA_HEADER *)(Section.data () + sizeof (EFI_GUID_DEFINED_SECTION));
+  Entries = (MULTI_STREAM_LZMA_ENTRY *)(Header + 1);
+  Entries[Header->StreamCount - 1].Length += 0x1000;
+
+  EXPECT_EQ (Decode (Section, Output), RETURN_INVALID_PARAMETER);
+  EXPECT_EQ (mHartStarts, 0U);
+}
+
+//
+// A stream that fails to decode on a hart fails the section, after all
+// the harts have stopped.
+//
+TEST_F (MultiStreamLzmaTest, FailsOnBadStream) {
+  std::vector<UINT8>        Section;
+  std::vector<UINT8>        Output;
+  MULTI_STREAM_LZMA_HEADER  *Header;
+  MULTI_STREAM_LZMA_ENTRY   *Entries;
+  UINT8                     *Stream;
+
+  Section = MultiStream;
+  Header  = (MULTI_STREAM_LZMA_HEADER *)(Section.data () + sizeof (EFI_GUID_DEFINED_SECTION));
+  Entries = (MULTI_STREAM_LZMA_ENTRY *)(Header + 1);
+  Stream  = (UINT8 *)Header + Entries[2].Offset;
+
+  //
+  // Leave the sizes, which the boot hart checks, and break the properties
+  //
+  Stream[sizeof (EFI_GUID_DEFINED_SECTION)] = 0xFF;
+
+  EXPECT_EQ (Decode (Section, Output), RETURN_INVALID_PARAMETER);
+  EXPECT_GT (mHartStarts, 0U);
+}
+
+//
+// Compare the multi-stream layout on one hart and on all harts with a
+// single LZMA section decoded by LzmaCustomDecompressLib. The host threads
+// stand in for the harts, so the speedup depends on the CPUs of the host.
+//
+TEST_F (MultiStreamLzmaTest, DecodeTime) {
+  UINT64  Single;
+  UINT64  OneHart;
+  UINT64  AllHarts;
+
+  Single = BestTime (SingleStream);
+  SetHartsPresent (0);
+  OneHart = BestTime (MultiStream);
+  SetHartsPresent (HART_COUNT);
+  AllHarts = BestTime (MultiStream);
+
+  printf (
+    "  %u KB in %u streams, %u KB compressed (%u KB as one stream)\n"
+    "  LzmaCustomDecompressLib: %6llu us, %4llu MB/s\n"
+    "  multi-stream, 1 hart:    %6llu us, %4llu MB/s\n"
+    "  multi-stream, %2u harts:  %6llu us, %4llu MB/s, %u host CPUs\n",
+    (unsigned)(Input.size () / SIZE_1KB),
+    (unsigned)((Input.size () + STREAM_SIZE - 1) / STREAM_SIZE),
+    (unsigned)(MultiStream.size () / SIZE_1KB),
+    (unsigned)(SingleStream.size () / SIZE_1KB),
+    (unsigned long long)(Single / 1000),
+    (unsigned long long)(Input.size () * 1000 / MAX (Single, 1)),
+    (unsigned long long)(OneHart / 1000),
+    (unsigned long long)(Input.size () * 1000 / MAX (OneHart, 1)),
+    (unsigned)HART_COUNT,
+    (unsigned long long)(AllHarts / 1000),
+    (unsigned long long)(Input.size () * 1000 / MAX (AllHarts, 1)),
+    std::thread::hardware_concurrency ()
+    );
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
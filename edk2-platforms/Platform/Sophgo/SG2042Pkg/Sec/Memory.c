@@ -95,7 +95,8 @@ InitMmu (
   )
 {
   //
-  // Set supervisor translation mode to Bare mode
+  // Set supervisor translation mode to Bare mode. CpuDxe enables paging
+  // once the GCD memory space is known.
   //
   RiscVSetSupervisorAddressTranslationRegister ((UINT64)SATP_MODE_OFF << 60);
   DEBUG ((DEBUG_INFO, "%a: Set Supervisor address mode to bare-metal mode.\n", __func__));
@@ -293,6 +294,46 @@ AddRuntimeServicesMemoryMap(
   );
 }
 
+/**
+  Publish the peripheral MMIO window, so that the DXE core adds it to the
+  GCD memory space and CpuDxe maps it uncached. The window lies beyond the
+  reach of Sv39, so on the Sv39 only C920 it keeps paging disabled.
+
+**/
+STATIC
+VOID
+AddMmioMemoryMap (
+  VOID
+  )
+{
+  EFI_PHYSICAL_ADDRESS  Addr;
+  UINT64                Size;
+
+  Addr = FixedPcdGet64 (PcdSG2042MmioBase);
+  Size = FixedPcdGet64 (PcdSG2042MmioSize);
+  if (Size == 0) {
+    return;
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "%a: Adding MMIO Addr = 0x%llx, Size = 0x%llx\n",
+    __func__,
+    Addr,
+    Size
+  ));
+
+  BuildResourceDescriptorHob (
+    EFI_RESOURCE_MEMORY_MAPPED_IO,
+    EFI_RESOURCE_ATTRIBUTE_PRESENT |
+    EFI_RESOURCE_ATTRIBUTE_INITIALIZED |
+    EFI_RESOURCE_ATTRIBUTE_UNCACHEABLE |
+    EFI_RESOURCE_ATTRIBUTE_TESTED,
+    Addr,
+    Size
+    );
+}
+
 /**
   Initialize memory hob based on the DTB information.
 
@@ -408,6 +449,8 @@ MemoryPeimInitialization (
 
   AddRuntimeServicesMemoryMap();
 
+  AddMmioMemoryMap ();
+
   InitMmu ();
 
   BuildMemoryTypeInformationHob ();
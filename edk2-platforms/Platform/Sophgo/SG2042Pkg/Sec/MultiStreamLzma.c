@@ -0,0 +1,427 @@
+/** @file
+  Decoder of the multi-stream LZMA GUIDed section.
+
+  The streams are handed out to the boot hart and to secondary harts, which
+  are started through the SBI HSM extension and stopped again once there is
+  no stream left. Secondary harts only run the LZMA decoder: they must not
+  touch the HOB list, the firmware context or the serial port.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "SecMain.h"
+
+#include <Library/SynchronizationLib.h>
+#include <Guid/MultiStreamLzma.h>
+
+#define MSLZ_STACK_SIZE  SIZE_16KB
+
+typedef struct {
+  CONST MULTI_STREAM_LZMA_HEADER    *Header;
+  CONST MULTI_STREAM_LZMA_ENTRY     *Entries;
+  UINT8                             *Output;
+  UINT8                             *Scratch;
+  UINT32                            ScratchSize;
+  volatile UINT32                   NextStream;
+  volatile UINT32                   DoneStreams;
+  volatile UINT32                   FailedStreams;
+} MSLZ_JOB;
+
+//
+// The layout of the first two fields is known to MultiStreamLzmaHartEntry
+//
+typedef struct {
+  UINT64      StackTop;
+  MSLZ_JOB    *Job;
+  UINTN       Slot;
+  UINTN       HartId;
+} MSLZ_WORKER;
+
+//
+// Provided by LzmaDecompressLib, which has no public header for them
+//
+RETURN_STATUS
+EFIAPI
+LzmaGuidedSectionGetInfo (
+  IN  CONST VOID  *InputSection,
+  OUT UINT32      *OutputBufferSize,
+  OUT UINT32      *ScratchBufferSize,
+  OUT UINT16      *SectionAttribute
+  );
+
+RETURN_STATUS
+EFIAPI
+LzmaGuidedSectionExtraction (
+  IN CONST  VOID    *InputSection,
+  OUT       VOID    **OutputBuffer,
+  OUT       VOID    *ScratchBuffer         OPTIONAL,
+  OUT       UINT32  *AuthenticationStatus
+  );
+
+/**
+  Entry of a secondary hart, see SecEntry.S.
+
+  @param[in]  HartId      Hart ID passed by the SBI implementation.
+  @param[in]  Worker      MSLZ_WORKER of the hart.
+**/
+VOID
+EFIAPI
+MultiStreamLzmaHartEntry (
+  IN  UINTN  HartId,
+  IN  VOID   *Worker
+  );
+
+/**
+  Return the multi-stream header of a GUIDed section.
+
+  @param[in]   InputSection  The GUIDed section.
+  @param[out]  Length        The size of the section data.
+
+  @return The header, or NULL if the section is not a multi-stream LZMA section.
+**/
+STATIC
+CONST MULTI_STREAM_LZMA_HEADER *
+MultiStreamLzmaGetHeader (
+  IN  CONST VOID  *InputSection,
+  OUT UINT32      *Length
+  )
+{
+  CONST EFI_GUID                  *Guid;
+  CONST MULTI_STREAM_LZMA_HEADER  *Header;
+  UINT32                          SectionLength;
+  UINT16                          DataOffset;
+
+  if (IS_SECTION2 (InputSection)) {
+    Guid          = &((EFI_GUID_DEFINED_SECTION2 *)InputSection)->SectionDefinitionGuid;
+    DataOffset    = ((EFI_GUID_DEFINED_SECTION2 *)InputSection)->DataOffset;
+    SectionLength = SECTION2_SIZE (InputSection);
+  } else {
+    Guid          = &((EFI_GUID_DEFINED_SECTION *)InputSection)->SectionDefinitionGuid;
+    DataOffset    = ((EFI_GUID_DEFINED_SECTION *)InputSection)->DataOffset;
+    SectionLength = SECTION_SIZE (InputSection);
+  }
+
+  if (!CompareGuid (Guid, &gSophgoMultiStreamLzmaGuid) ||
+      (SectionLength < DataOffset + sizeof (MULTI_STREAM_LZMA_HEADER)))
+  {
+    return NULL;
+  }
+
+  Header = (CONST MULTI_STREAM_LZMA_HEADER *)((UINT8 *)InputSection + DataOffset);
+  if ((Header->Signature != MULTI_STREAM_LZMA_SIGNATURE) || (Header->StreamCount == 0) ||
+      (Header->StreamSize == 0) ||
+      (Header->StreamCount > (SectionLength - DataOffset - sizeof (MULTI_STREAM_LZMA_HEADER)) /
+                             sizeof (MULTI_STREAM_LZMA_ENTRY)) ||
+      ((UINT64)Header->StreamSize * (Header->StreamCount - 1) >= Header->UncompressedSize) ||
+      ((UINT64)Header->StreamSize * Header->StreamCount < Header->UncompressedSize))
+  {
+    return NULL;
+  }
+
+  *Length = SectionLength - DataOffset;
+  return Header;
+}
+
+/**
+  Return the number of harts, the boot hart included, that decode the streams.
+
+  @param[in]  Header      The multi-stream header.
+**/
+STATIC
+UINT32
+MultiStreamLzmaSlots (
+  IN  CONST MULTI_STREAM_LZMA_HEADER  *Header
+  )
+{
+  return MIN (Header->StreamCount, FixedPcdGet32 (PcdNumberofC920Cores));
+}
+
+/**
+  Decode streams until there is none left.
+
+  Runs on the boot hart and on the secondary harts.
+
+  @param[in]  Job         The decoding job.
+  @param[in]  Slot        Index of the LZMA scratch buffer of the hart.
+**/
+STATIC
+VOID
+MultiStreamLzmaDecodeStreams (
+  IN  MSLZ_JOB  *Job,
+  IN  UINTN     Slot
+  )
+{
+  RETURN_STATUS  Status;
+  UINT32         Index;
+  UINT32         AuthenticationStatus;
+  VOID           *Output;
+
+  for ( ; ;) {
+    Index = InterlockedIncrement (&Job->NextStream) - 1;
+    if (Index >= Job->Header->StreamCount) {
+      break;
+    }
+
+    Output = Job->Output + (UINTN)Index * Job->Header->StreamSize;
+    Status = LzmaGuidedSectionExtraction (
+               (UINT8 *)Job->Header + Job->Entries[Index].Offset,
+               &Output,
+               Job->Scratch + Slot * Job->ScratchSize,
+               &AuthenticationStatus
+               );
+    if (RETURN_ERROR (Status)) {
+      InterlockedIncrement (&Job->FailedStreams);
+    }
+
+    InterlockedIncrement (&Job->DoneStreams);
+  }
+}
+
+/**
+  C entry of a secondary hart. Decodes streams and stops the hart.
+
+  @param[in]  Worker      MSLZ_WORKER of the hart.
+**/
+VOID
+EFIAPI
+MultiStreamLzmaWorker (
+  IN  MSLZ_WORKER  *Worker
+  )
+{
+  MultiStreamLzmaDecodeStreams (Worker->Job, Worker->Slot);
+
+  SbiCall (SBI_EXT_HSM, SBI_EXT_HSM_HART_STOP, 0);
+  CpuDeadLoop ();
+}
+
+/**
+  Get the decoded size and the scratch size of a multi-stream LZMA section.
+
+  The scratch buffer holds the job, the stacks of the secondary harts and
+  one LZMA scratch buffer per hart.
+
+  @param[in]   InputSection       A pointer to a GUIDed section.
+  @param[out]  OutputBufferSize   The size of the decoded data.
+  @param[out]  ScratchBufferSize  The size of the scratch buffer.
+  @param[out]  SectionAttribute   The attribute of the GUIDed section.
+
+  @retval RETURN_SUCCESS            The information was returned.
+  @retval RETURN_INVALID_PARAMETER  The section is not a valid multi-stream LZMA section.
+**/
+STATIC
+RETURN_STATUS
+EFIAPI
+MultiStreamLzmaGetInfo (
+  IN  CONST VOID  *InputSection,
+  OUT UINT32      *OutputBufferSize,
+  OUT UINT32      *ScratchBufferSize,
+  OUT UINT16      *SectionAttribute
+  )
+{
+  RETURN_STATUS                   Status;
+  CONST MULTI_STREAM_LZMA_HEADER  *Header;
+  CONST MULTI_STREAM_LZMA_ENTRY   *Entries;
+  UINT32                          Length;
+  UINT32                          OutputSize;
+  UINT32                          ScratchSize;
+  UINT16                          Attribute;
+
+  Header = MultiStreamLzmaGetHeader (InputSection, &Length);
+  if (Header == NULL) {
+    return RETURN_INVALID_PARAMETER;
+  }
+
+  Entries = (CONST MULTI_STREAM_LZMA_ENTRY *)(Header + 1);
+  if ((Entries[0].Offset > Length) || (Entries[0].Length > Length - Entries[0].Offset)) {
+    return RETURN_INVALID_PARAMETER;
+  }
+
+  Status = LzmaGuidedSectionGetInfo (
+             (UINT8 *)Header + Entries[0].Offset,
+             &OutputSize,
+             &ScratchSize,
+             &Attribute
+             );
+  if (RETURN_ERROR (Status)) {
+    return Status;
+  }
+
+  *OutputBufferSize  = Header->UncompressedSize;
+  *ScratchBufferSize = ALIGN_VALUE (sizeof (MSLZ_JOB), 16) +
+                       MultiStreamLzmaSlots (Header) *
+                       (ALIGN_VALUE (sizeof (MSLZ_WORKER), 16) + MSLZ_STACK_SIZE + ALIGN_VALUE (ScratchSize, 16));
+  *SectionAttribute = EFI_GUIDED_SECTION_PROCESSING_REQUIRED;
+
+  return RETURN_SUCCESS;
+}
+
+/**
+  Decode a multi-stream LZMA section on all available harts.
+
+  @param[in]   InputSection          A pointer to a GUIDed section.
+  @param[out]  OutputBuffer          A pointer to the output buffer.
+  @param[in]   ScratchBuffer         A scratch buffer of the size returned by GetInfo.
+  @param[out]  AuthenticationStatus  The authentication status of the section.
+
+  @retval RETURN_SUCCESS            The section was decoded.
+  @retval RETURN_INVALID_PARAMETER  The section is not a valid multi-stream LZMA section,
+                                    or a stream could not be decoded.
+**/
+STATIC
+RETURN_STATUS
+EFIAPI
+MultiStreamLzmaDecode (
+  IN CONST  VOID    *InputSection,
+  OUT       VOID    **OutputBuffer,
+  OUT       VOID    *ScratchBuffer         OPTIONAL,
+  OUT       UINT32  *AuthenticationStatus
+  )
+{
+  RETURN_STATUS                   Status;
+  CONST MULTI_STREAM_LZMA_HEADER  *Header;
+  CONST MULTI_STREAM_LZMA_ENTRY   *Entries;
+  EFI_RISCV_FIRMWARE_CONTEXT      *FirmwareContext;
+  MSLZ_JOB                        *Job;
+  MSLZ_WORKER                     *Workers;
+  UINT8                           *Stacks;
+  SBI_RET                         Ret;
+  UINT32                          Length;
+  UINT32                          Index;
+  UINT32                          OutputSize;
+  UINT32                          ExpectedSize;
+  UINT32                          ScratchSize;
+  UINT32                          Slots;
+  UINT32                          Started;
+  UINT16                          Attribute;
+  UINTN                           HartId;
+
+  ASSERT (OutputBuffer != NULL);
+  ASSERT (*OutputBuffer != NULL);
+  ASSERT (ScratchBuffer != NULL);
+
+  Header = MultiStreamLzmaGetHeader (InputSection, &Length);
+  if (Header == NULL) {
+    return RETURN_INVALID_PARAMETER;
+  }
+
+  //
+  // Check all streams on the boot hart, so that the harts only see valid input
+  //
+  Entries     = (CONST MULTI_STREAM_LZMA_ENTRY *)(Header + 1);
+  ScratchSize = 0;
+  for (Index = 0; Index < Header->StreamCount; Index++) {
+    if ((Entries[Index].Offset > Length) || (Entries[Index].Length > Length - Entries[Index].Offset) ||
+        (Entries[Index].Length < sizeof (EFI_GUID_DEFINED_SECTION)))
+    {
+      return RETURN_INVALID_PARAMETER;
+    }
+
+    Status = LzmaGuidedSectionGetInfo (
+               (UINT8 *)Header + Entries[Index].Offset,
+               &OutputSize,
+               &ScratchSize,
+               &Attribute
+               );
+    ExpectedSize = MIN (Header->StreamSize, Header->UncompressedSize - Index * Header->StreamSize);
+    if (RETURN_ERROR (Status) || (OutputSize != ExpectedSize)) {
+      return RETURN_INVALID_PARAMETER;
+    }
+  }
+
+  Slots = MultiStreamLzmaSlots (Header);
+
+  Job     = ScratchBuffer;
+  Workers = (MSLZ_WORKER *)((UINT8 *)Job + ALIGN_VALUE (sizeof (MSLZ_JOB), 16));
+  Stacks  = (UINT8 *)Workers + Slots * ALIGN_VALUE (sizeof (MSLZ_WORKER), 16);
+
+  ZeroMem (Job, sizeof (MSLZ_JOB));
+  Job->Header      = Header;
+  Job->Entries     = Entries;
+  Job->Output      = *OutputBuffer;
+  Job->Scratch     = Stacks + Slots * MSLZ_STACK_SIZE;
+  Job->ScratchSize = ALIGN_VALUE (ScratchSize, 16);
+
+  GetFirmwareContextPointer (&FirmwareContext);
+
+  //
+  // Slot 0 belongs to the boot hart, the other slots go to the first
+  // secondary harts that can be started
+  //
+  Started = 0;
+  for (HartId = 0; (HartId < FixedPcdGet32 (PcdNumberofC920Cores)) && (Started + 1 < Slots); HartId++) {
+    if (HartId == FirmwareContext->BootHartId) {
+      continue;
+    }
+
+    Workers[Started].StackTop = (UINT64)(UINTN)(Stacks + (Started + 1) * MSLZ_STACK_SIZE);
+    Workers[Started].Job      = Job;
+    Workers[Started].Slot     = Started + 1;
+    Workers[Started].HartId   = HartId;
+    MemoryFence ();
+
+    Ret = SbiCall (
+            SBI_EXT_HSM,
+            SBI_EXT_HSM_HART_START,
+            3,
+            HartId,
+            (UINTN)MultiStreamLzmaHartEntry,
+            (UINTN)&Workers[Started]
+            );
+    if (Ret.Error == SBI_SUCCESS) {
+      Started++;
+    }
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "%a: %u streams of 0x%x bytes on %u harts\n",
+    __func__,
+    Header->StreamCount,
+    Header->StreamSize,
+    Started + 1
+    ));
+
+  MultiStreamLzmaDecodeStreams (Job, 0);
+
+  while (Job->DoneStreams != Header->StreamCount) {
+    CpuPause ();
+  }
+
+  //
+  // The stacks and the scratch buffers are in use until the harts are stopped
+  //
+  for (Index = 0; Index < Started; Index++) {
+    do {
+      Ret = SbiCall (SBI_EXT_HSM, SBI_EXT_HSM_HART_GET_STATUS, 1, Workers[Index].HartId);
+    } while ((Ret.Error == SBI_SUCCESS) && (Ret.Value != SBI_HSM_STATE_STOPPED));
+  }
+
+  if (Job->FailedStreams != 0) {
+    DEBUG ((DEBUG_ERROR, "%a: %u streams failed to decode\n", __func__, Job->FailedStreams));
+    return RETURN_INVALID_PARAMETER;
+  }
+
+  *AuthenticationStatus = 0;
+  return RETURN_SUCCESS;
+}
+
+/**
+  Register the decoder of the multi-stream LZMA GUIDed section.
+
+  @retval RETURN_SUCCESS    The handlers were registered.
+  @retval Others            The handlers could not be registered.
+**/
+RETURN_STATUS
+MultiStreamLzmaRegister (
+  VOID
+  )
+{
+  return ExtractGuidedSectionRegisterHandlers (
+           &gSophgoMultiStreamLzmaGuid,
+           MultiStreamLzmaGetInfo,
+           MultiStreamLzmaDecode
+           );
+}
@@ -81,6 +81,7 @@ SecStartup (
   UINT64                      UefiMemoryBase;
   UINT64                      StackBase;
   UINT32                      StackSize;
+  UINT64                      StartTicks;
 
   SerialPortInitialize ();
 
@@ -121,10 +122,21 @@ SecStartup (
   //
   ProcessLibraryConstructorList ();
 
+  Status = MultiStreamLzmaRegister ();
+  ASSERT_RETURN_ERROR (Status);
+
   // Assume the FV that contains the SEC (our code) also contains a compressed FV.
-  Status = DecompressFirstFv ();
+  StartTicks = GetPerformanceCounter ();
+  Status     = DecompressFirstFv ();
   ASSERT_EFI_ERROR (Status);
 
+  DEBUG ((
+    DEBUG_INFO,
+    "%a: decompressed the DXE FV in %lu us\n",
+    __func__,
+    DivU64x32 (GetTimeInNanoSecond (GetPerformanceCounter () - StartTicks), 1000)
+    ));
+
   // Load the DXE Core and transfer control to it
   Status = LoadDxeCoreFromFv (NULL, 0);
   ASSERT_EFI_ERROR (Status);
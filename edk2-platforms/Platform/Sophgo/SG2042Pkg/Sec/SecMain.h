@@ -29,8 +29,20 @@
 #include <Library/PrePiLib.h>
 #include <Library/PrePiHobListPointerLib.h>
 #include <Library/SerialPortLib.h>
+#include <Library/TimerLib.h>
 #include <Register/RiscV64/RiscVImpl.h>
 
+//
+// SBI Hart State Management extension
+//
+#define SBI_EXT_HSM                  0x48534D
+#define SBI_EXT_HSM_HART_START       0x0
+#define SBI_EXT_HSM_HART_STOP        0x1
+#define SBI_EXT_HSM_HART_GET_STATUS  0x2
+
+#define SBI_HSM_STATE_STARTED  0x0
+#define SBI_HSM_STATE_STOPPED  0x1
+
 /**
   Entry point to the C language phase of SEC. After the SEC assembly
   code has initialized some temporary memory and set up the stack,
@@ -110,4 +122,15 @@ BuildRiscVSmbiosHobs (
   VOID
   );
 
+/**
+  Register the decoder of the multi-stream LZMA GUIDed section.
+
+  @retval RETURN_SUCCESS    The handlers were registered.
+  @retval Others            The handlers could not be registered.
+**/
+RETURN_STATUS
+MultiStreamLzmaRegister (
+  VOID
+  );
+
 #endif
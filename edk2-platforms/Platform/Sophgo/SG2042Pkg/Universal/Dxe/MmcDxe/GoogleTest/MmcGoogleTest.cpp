@@ -0,0 +1,656 @@
+/** @file
+  Host tests of the bus timing fallback and of the BlockIo2 request queue
+  of MmcDxe.
+
+  The driver identifies an SD card on a model of the MMC host, which lets
+  the block commands fail at chosen bus timings the way the ADMA2 wait of
+  SdHostDxe does: EFI_TIMEOUT when the transfer never completes and
+  EFI_DEVICE_ERROR on a CRC error. A transfer that fails that way has to
+  move the card down to the next bus timing and complete there, with the
+  media of the BlockIo consumers left valid.
+
+  The BlockIo2 requests are worked by a timer at TPL_CALLBACK, which the
+  model runs on its own clock. A consumer at TPL_CALLBACK that waits for
+  its request, as the partition and file system drivers do, has to find
+  it complete without the timer.
+
+  The block cache benchmark replays the reads of a boot from an SD card,
+  with and without the cache, and reports the time the model takes for
+  them along with the counters of the cache.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <Library/GoogleTestLib.h>
+#include <vector>
+
+extern "C" {
+  #include <Uefi.h>
+  #include <Library/BaseLib.h>
+  #include <Library/BaseMemoryLib.h>
+  #include <Library/DebugLib.h>
+  #include <Library/MemoryAllocationLib.h>
+  #include <Library/UefiBootServicesTableLib.h>
+
+  //
+  // Mmc.h has a UINT64_C of its own, <stdint.h> came in with <vector>.
+  //
+  #undef UINT64_C
+  #include "../Mmc.h"
+  #include "MmcHostModel.h"
+
+  VOID
+  InitializeMmcHostPool (
+    VOID
+    );
+
+  VOID
+  InsertMmcHost (
+    IN MMC_HOST_INSTANCE  *MmcHostInstance
+    );
+
+  VOID
+  RemoveMmcHost (
+    IN MMC_HOST_INSTANCE  *MmcHostInstance
+    );
+
+  MMC_HOST_INSTANCE *
+  CreateMmcHostInstance (
+    IN EFI_MMC_HOST_PROTOCOL  *MmcHost
+    );
+
+  EFI_STATUS
+  DestroyMmcHostInstance (
+    IN MMC_HOST_INSTANCE  *MmcHostInstance
+    );
+}
+
+using namespace testing;
+
+#define CARD_BLOCKS  (SIZE_16MB / MMC_BLOCK_SIZE)
+
+class MmcHostTest : public Test {
+protected:
+  MMC_HOST_INSTANCE  *Instance;
+  UINT8              *Card;
+  UINT32             MediaId;
+
+  void
+  SetUp (
+    ) override
+  {
+    UINTN  Index;
+
+    MmcHostModelReset (CARD_BLOCKS);
+    Card = MmcHostModelCard ();
+    for (Index = 0; Index < CARD_BLOCKS * MMC_BLOCK_SIZE; Index++) {
+      Card[Index] = (UINT8)(Index * 7 + (Index >> 9));
+    }
+
+    InitializeMmcHostPool ();
+    Instance = CreateMmcHostInstance (&mMmcHostModelProtocol);
+    ASSERT_NE (Instance, nullptr);
+    InsertMmcHost (Instance);
+    CheckCardsCallback (NULL, NULL);
+
+    ASSERT_TRUE (Instance->Initialized);
+    ASSERT_EQ (Instance->BlockIo.Media->LastBlock, (EFI_LBA)(CARD_BLOCKS - 1));
+    ASSERT_EQ (Instance->Timing, MmcTimingUhsSdr104);
+    ASSERT_EQ (MmcHostModelTiming (), MmcTimingUhsSdr104);
+    MediaId = Instance->BlockIo.Media->MediaId;
+  }
+
+  void
+  TearDown (
+    ) override
+  {
+    if (Instance != NULL) {
+      RemoveMmcHost (Instance);
+      DestroyMmcHostInstance (Instance);
+    }
+
+    MmcHostModelFree ();
+  }
+
+  EFI_STATUS
+  Read (
+    IN EFI_LBA  Lba,
+    IN UINTN    Blocks,
+    OUT VOID    *Buffer
+    )
+  {
+    return Instance->BlockIo.ReadBlocks (&Instance->BlockIo, MediaId, Lba, Blocks * MMC_BLOCK_SIZE, Buffer);
+  }
+
+  EFI_STATUS
+  Write (
+    IN EFI_LBA  Lba,
+    IN UINTN    Blocks,
+    IN VOID     *Buffer
+    )
+  {
+    return Instance->BlockIo.WriteBlocks (&Instance->BlockIo, MediaId, Lba, Blocks * MMC_BLOCK_SIZE, Buffer);
+  }
+};
+
+class MmcTimingFallbackTest : public MmcHostTest {
+};
+
+//
+// Identification picks the fastest timing both sides support.
+//
+TEST_F (MmcTimingFallbackTest, IdentifiesAtSdr104) {
+  UINT8  Buffer[8 * MMC_BLOCK_SIZE];
+
+  EXPECT_EQ (Instance->TimingMask, MAX_UINT32);
+  EXPECT_TRUE (Instance->SetBlockCount);
+  ASSERT_EQ (Read (1000, 8, Buffer), EFI_SUCCESS);
+  EXPECT_EQ (CompareMem (Buffer, Card + 1000 * MMC_BLOCK_SIZE, sizeof (Buffer)), 0);
+  EXPECT_EQ (mMmcHostModelStatistics.Faults, 0U);
+  EXPECT_EQ (mMmcHostModelStatistics.PowerCycles, 1U);
+}
+
+//
+// A read that times out, the way a stuck ADMA2 transfer ends now that the
+// wait for it is bounded, moves the card down to SDR50 and completes there.
+//
+TEST_F (MmcTimingFallbackTest, ReadTimeoutDowngrades) {
+  UINT8  Buffer[8 * MMC_BLOCK_SIZE];
+
+  mMmcHostModelFaultTimings = MMC_TIMING_BIT (MmcTimingUhsSdr104);
+  mMmcHostModelFaultStatus  = EFI_TIMEOUT;
+
+  ASSERT_EQ (Read (2048, 8, Buffer), EFI_SUCCESS);
+  EXPECT_EQ (CompareMem (Buffer, Card + 2048 * MMC_BLOCK_SIZE, sizeof (Buffer)), 0);
+
+  EXPECT_EQ (mMmcHostModelStatistics.Faults, 1U);
+  EXPECT_EQ (mMmcHostModelStatistics.PowerCycles, 2U);
+  EXPECT_EQ (Instance->Timing, MmcTimingUhsSdr50);
+  EXPECT_EQ (MmcHostModelTiming (), MmcTimingUhsSdr50);
+  EXPECT_EQ (Instance->TimingMask & MMC_TIMING_BIT (MmcTimingUhsSdr104), 0U);
+  EXPECT_EQ (Instance->TimingStats[MmcTimingUhsSdr104].Errors, 1U);
+  EXPECT_GT (Instance->TimingStats[MmcTimingUhsSdr50].ReadBytes, 0U);
+
+  // The BlockIo consumers keep their media
+  EXPECT_EQ (Instance->BlockIo.Media->MediaId, MediaId);
+  EXPECT_TRUE (Instance->BlockIo.Media->MediaPresent);
+}
+
+//
+// A write that fails with a CRC error gets the same treatment, and the data
+// ends up on the card.
+//
+TEST_F (MmcTimingFallbackTest, WriteDeviceErrorDowngrades) {
+  UINT8  Buffer[16 * MMC_BLOCK_SIZE];
+
+  SetMem (Buffer, sizeof (Buffer), 0x5A);
+  mMmcHostModelFaultTimings = MMC_TIMING_BIT (MmcTimingUhsSdr104);
+  mMmcHostModelFaultStatus  = EFI_DEVICE_ERROR;
+
+  ASSERT_EQ (Write (4096, 16, Buffer), EFI_SUCCESS);
+  EXPECT_EQ (CompareMem (Card + 4096 * MMC_BLOCK_SIZE, Buffer, sizeof (Buffer)), 0);
+
+  EXPECT_EQ (mMmcHostModelStatistics.Faults, 1U);
+  EXPECT_EQ (Instance->Timing, MmcTimingUhsSdr50);
+  EXPECT_EQ (Instance->TimingStats[MmcTimingUhsSdr104].Errors, 1U);
+  EXPECT_EQ (Instance->BlockIo.Media->MediaId, MediaId);
+}
+
+//
+// Each timing that fails is given up in turn until one works.
+//
+TEST_F (MmcTimingFallbackTest, WalksDownToAWorkingTiming) {
+  UINT8  Buffer[4 * MMC_BLOCK_SIZE];
+
+  mMmcHostModelFaultTimings = MMC_TIMING_BIT (MmcTimingUhsSdr104) | MMC_TIMING_BIT (MmcTimingUhsSdr50) |
+                              MMC_TIMING_BIT (MmcTimingUhsDdr50);
+  mMmcHostModelFaultStatus = EFI_TIMEOUT;
+
+  ASSERT_EQ (Read (100, 4, Buffer), EFI_SUCCESS);
+  EXPECT_EQ (CompareMem (Buffer, Card + 100 * MMC_BLOCK_SIZE, sizeof (Buffer)), 0);
+
+  EXPECT_EQ (mMmcHostModelStatistics.Faults, 3U);
+  EXPECT_EQ (Instance->Timing, MmcTimingUhsSdr25);
+  EXPECT_EQ (MmcHostModelTiming (), MmcTimingUhsSdr25);
+  EXPECT_EQ (Instance->TimingMask & (MMC_TIMING_BIT (MmcTimingUhsSdr104) | MMC_TIMING_BIT (MmcTimingUhsSdr50) |
+                                     MMC_TIMING_BIT (MmcTimingUhsDdr50)), 0U);
+
+  // The card stays at the timing that works
+  mMmcHostModelFaultTimings = 0;
+  ASSERT_EQ (Read (200, 4, Buffer), EFI_SUCCESS);
+  EXPECT_EQ (Instance->Timing, MmcTimingUhsSdr25);
+  EXPECT_EQ (mMmcHostModelStatistics.Faults, 3U);
+}
+
+//
+// With no timing left to fall back to, the error reaches the caller.
+//
+TEST_F (MmcTimingFallbackTest, FailsAtTheDefaultTiming) {
+  UINT8  Buffer[MMC_BLOCK_SIZE];
+
+  mMmcHostModelFaultTimings = MAX_UINT32;
+  mMmcHostModelFaultStatus  = EFI_TIMEOUT;
+
+  EXPECT_EQ (Read (10, 1, Buffer), EFI_TIMEOUT);
+  EXPECT_EQ (Instance->Timing, MmcTimingLegacy);
+  EXPECT_EQ (MmcHostModelTiming (), MmcTimingLegacy);
+  EXPECT_EQ (Instance->BlockIo.Media->MediaId, MediaId);
+  EXPECT_EQ (Instance->TimingStats[MmcTimingLegacy].Errors, 1U);
+}
+
+//
+// Other errors are not a sign of the bus timing.
+//
+TEST_F (MmcTimingFallbackTest, OtherErrorsDoNotDowngrade) {
+  UINT8  Buffer[MMC_BLOCK_SIZE];
+
+  mMmcHostModelFaultTimings = MMC_TIMING_BIT (MmcTimingUhsSdr104);
+  mMmcHostModelFaultStatus  = EFI_NO_RESPONSE;
+
+  EXPECT_EQ (Read (10, 1, Buffer), EFI_NO_RESPONSE);
+  EXPECT_EQ (Instance->Timing, MmcTimingUhsSdr104);
+  EXPECT_EQ (Instance->TimingMask, MAX_UINT32);
+  EXPECT_EQ (mMmcHostModelStatistics.PowerCycles, 1U);
+}
+
+class MmcAsyncQueueTest : public MmcHostTest {
+protected:
+  EFI_BLOCK_IO2_TOKEN  Tokens[4];
+
+  void
+  SetUp (
+    ) override
+  {
+    UINTN  Index;
+
+    // The model closes the events when the test is over
+    MmcHostTest::SetUp ();
+    for (Index = 0; Index < ARRAY_SIZE (Tokens); Index++) {
+      ASSERT_EQ (gBS->CreateEvent (0, TPL_CALLBACK, NULL, NULL, &Tokens[Index].Event), EFI_SUCCESS);
+      Tokens[Index].TransactionStatus = EFI_SUCCESS;
+    }
+  }
+
+  EFI_STATUS
+  ReadEx (
+    IN EFI_LBA  Lba,
+    IN UINTN    Blocks,
+    OUT VOID    *Buffer,
+    IN UINTN    Token
+    )
+  {
+    return Instance->BlockIo2.ReadBlocksEx (&Instance->BlockIo2, MediaId, Lba, &Tokens[Token],
+                                            Blocks * MMC_BLOCK_SIZE, Buffer);
+  }
+
+  EFI_STATUS
+  WriteEx (
+    IN EFI_LBA  Lba,
+    IN UINTN    Blocks,
+    IN VOID     *Buffer,
+    IN UINTN    Token
+    )
+  {
+    return Instance->BlockIo2.WriteBlocksEx (&Instance->BlockIo2, MediaId, Lba, &Tokens[Token],
+                                             Blocks * MMC_BLOCK_SIZE, Buffer);
+  }
+
+  //
+  // Wait for a token the way a consumer does, polling its event. Time passes
+  // between the polls, the timers run as the TPL of the caller allows.
+  //
+  BOOLEAN
+  Wait (
+    IN UINTN  Token,
+    IN UINTN  Ticks
+    )
+  {
+    while (gBS->CheckEvent (Tokens[Token].Event) == EFI_NOT_READY) {
+      if (Ticks-- == 0) {
+        return FALSE;
+      }
+
+      MmcHostModelRunTimers (MMC_HOST_MODEL_TICK);
+    }
+
+    return TRUE;
+  }
+};
+
+//
+// A request from TPL_APPLICATION is queued and moved one chunk per timer
+// tick.
+//
+TEST_F (MmcAsyncQueueTest, QueuedReadCompletesOnTimerTicks) {
+  UINTN  Size;
+  UINT8  *Buffer;
+
+  Size   = 4 * MMC_ASYNC_CHUNK_SIZE;
+  Buffer = (UINT8 *)AllocatePool (Size);
+  ASSERT_NE (Buffer, nullptr);
+
+  ASSERT_EQ (ReadEx (8192, Size / MMC_BLOCK_SIZE, Buffer, 0), EFI_SUCCESS);
+  EXPECT_EQ (Tokens[0].TransactionStatus, EFI_NOT_READY);
+  EXPECT_EQ (mMmcHostModelStatistics.BytesRead, 0U);
+
+  // The timer comes due on the second tick at the latest
+  MmcHostModelRunTimers (2 * MMC_HOST_MODEL_TICK);
+  EXPECT_EQ (Tokens[0].TransactionStatus, EFI_NOT_READY);
+  EXPECT_GE (mMmcHostModelStatistics.BytesRead, (UINT64)MMC_ASYNC_CHUNK_SIZE);
+  EXPECT_LT (mMmcHostModelStatistics.BytesRead, (UINT64)Size);
+
+  ASSERT_TRUE (Wait (0, 50));
+  EXPECT_EQ (Tokens[0].TransactionStatus, EFI_SUCCESS);
+  EXPECT_EQ (CompareMem (Buffer, Card + 8192 * MMC_BLOCK_SIZE, Size), 0);
+
+  FreePool (Buffer);
+}
+
+//
+// The timer can't run under a caller at TPL_CALLBACK, so its request
+// completes before ReadBlocksEx () returns. Waiting for it from there
+// used to never end.
+//
+TEST_F (MmcAsyncQueueTest, ReadAtCallbackCompletesInline) {
+  UINT8    Buffer[64 * MMC_BLOCK_SIZE];
+  EFI_TPL  OldTpl;
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  ASSERT_EQ (ReadEx (300, 64, Buffer, 0), EFI_SUCCESS);
+  EXPECT_EQ (Tokens[0].TransactionStatus, EFI_SUCCESS);
+  EXPECT_TRUE (Wait (0, 100));
+  gBS->RestoreTPL (OldTpl);
+
+  EXPECT_EQ (CompareMem (Buffer, Card + 300 * MMC_BLOCK_SIZE, sizeof (Buffer)), 0);
+}
+
+//
+// A request that fails inline reports the error through its token, as a
+// queued one would.
+//
+TEST_F (MmcAsyncQueueTest, ErrorAtCallbackGoesToToken) {
+  UINT8    Buffer[MMC_BLOCK_SIZE];
+  EFI_TPL  OldTpl;
+
+  mMmcHostModelFaultTimings = MAX_UINT32;
+  mMmcHostModelFaultStatus  = EFI_TIMEOUT;
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  EXPECT_EQ (ReadEx (300, 1, Buffer, 0), EFI_SUCCESS);
+  EXPECT_TRUE (Wait (0, 0));
+  EXPECT_EQ (Tokens[0].TransactionStatus, EFI_TIMEOUT);
+  gBS->RestoreTPL (OldTpl);
+}
+
+//
+// Requests already queued complete ahead of one carried out inline, so a
+// read at TPL_CALLBACK sees a write queued before it.
+//
+TEST_F (MmcAsyncQueueTest, QueuedRequestsCompleteFirst) {
+  UINT8    Data[2][16 * MMC_BLOCK_SIZE];
+  UINT8    Buffer[16 * MMC_BLOCK_SIZE];
+  EFI_TPL  OldTpl;
+
+  SetMem (Data[0], sizeof (Data[0]), 0xA5);
+  SetMem (Data[1], sizeof (Data[1]), 0x3C);
+  ASSERT_EQ (WriteEx (500, 16, Data[0], 0), EFI_SUCCESS);
+  ASSERT_EQ (WriteEx (500, 16, Data[1], 1), EFI_SUCCESS);
+  EXPECT_EQ (Tokens[0].TransactionStatus, EFI_NOT_READY);
+  EXPECT_EQ (Tokens[1].TransactionStatus, EFI_NOT_READY);
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  ASSERT_EQ (ReadEx (500, 16, Buffer, 2), EFI_SUCCESS);
+  EXPECT_TRUE (Wait (2, 0));
+  EXPECT_TRUE (Wait (1, 0));
+  EXPECT_TRUE (Wait (0, 0));
+  gBS->RestoreTPL (OldTpl);
+
+  EXPECT_EQ (Tokens[0].TransactionStatus, EFI_SUCCESS);
+  EXPECT_EQ (Tokens[1].TransactionStatus, EFI_SUCCESS);
+  EXPECT_EQ (Tokens[2].TransactionStatus, EFI_SUCCESS);
+  EXPECT_EQ (CompareMem (Buffer, Data[1], sizeof (Buffer)), 0);
+  EXPECT_EQ (CompareMem (Card + 500 * MMC_BLOCK_SIZE, Data[1], sizeof (Buffer)), 0);
+}
+
+//
+// A flush at TPL_CALLBACK waits for the queued writes and completes inline.
+//
+TEST_F (MmcAsyncQueueTest, FlushAtCallbackCompletesInline) {
+  UINT8    Data[8 * MMC_BLOCK_SIZE];
+  EFI_TPL  OldTpl;
+
+  SetMem (Data, sizeof (Data), 0x77);
+  ASSERT_EQ (WriteEx (700, 8, Data, 0), EFI_SUCCESS);
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  ASSERT_EQ (Instance->BlockIo2.FlushBlocksEx (&Instance->BlockIo2, &Tokens[1]), EFI_SUCCESS);
+  EXPECT_TRUE (Wait (1, 0));
+  EXPECT_TRUE (Wait (0, 0));
+  gBS->RestoreTPL (OldTpl);
+
+  EXPECT_EQ (CompareMem (Card + 700 * MMC_BLOCK_SIZE, Data, sizeof (Data)), 0);
+}
+
+//
+// A reset aborts the queued requests.
+//
+TEST_F (MmcAsyncQueueTest, ResetAbortsQueuedRequests) {
+  UINT8  Buffer[2][MMC_BLOCK_SIZE];
+
+  ASSERT_EQ (ReadEx (10, 1, Buffer[0], 0), EFI_SUCCESS);
+  ASSERT_EQ (ReadEx (20, 1, Buffer[1], 1), EFI_SUCCESS);
+  ASSERT_EQ (Instance->BlockIo2.Reset (&Instance->BlockIo2, FALSE), EFI_SUCCESS);
+
+  EXPECT_TRUE (Wait (0, 0));
+  EXPECT_TRUE (Wait (1, 0));
+  EXPECT_EQ (Tokens[0].TransactionStatus, EFI_ABORTED);
+  EXPECT_EQ (Tokens[1].TransactionStatus, EFI_ABORTED);
+  EXPECT_EQ (mMmcHostModelStatistics.BytesRead, 0U);
+}
+
+//
+// One read of a trace: the blocks, and the time the consumer spends on the
+// data before it reads again.
+//
+typedef struct {
+  EFI_LBA    Lba;
+  UINTN      Blocks;
+  UINTN      ThinkTime;                   // Microseconds
+} MMC_TRACE_READ;
+
+//
+// The layout of the card the boot trace reads: a GPT and a FAT32 ESP with
+// 4KB clusters.
+//
+#define TRACE_ESP_START       2048
+#define TRACE_FAT_START       (TRACE_ESP_START + 32)
+#define TRACE_FAT_BLOCKS      64
+#define TRACE_DATA_START      (TRACE_FAT_START + 2 * TRACE_FAT_BLOCKS)
+#define TRACE_CLUSTER_BLOCKS  8
+#define TRACE_CLUSTER(n)      (TRACE_DATA_START + ((n) - 2) * TRACE_CLUSTER_BLOCKS)
+
+class MmcCacheBenchmark : public MmcHostTest {
+protected:
+  std::vector<MMC_TRACE_READ>  Trace;
+  UINT8                        *Buffer;
+
+  void
+  SetUp (
+    ) override
+  {
+    MmcHostTest::SetUp ();
+    Buffer = (UINT8 *)AllocatePool (SIZE_1MB);
+    ASSERT_NE (Buffer, nullptr);
+    BuildBootTrace ();
+  }
+
+  void
+  TearDown (
+    ) override
+  {
+    FreePool (Buffer);
+    MmcHostTest::TearDown ();
+  }
+
+  void
+  Add (
+    IN EFI_LBA  Lba,
+    IN UINTN    Blocks,
+    IN UINTN    ThinkTime
+    )
+  {
+    Trace.push_back ({ Lba, Blocks, ThinkTime });
+  }
+
+  //
+  // The FAT driver reads the FAT sector of a cluster before it follows the
+  // chain, then the cluster run. It keeps the FAT sector it read last.
+  //
+  void
+  AddFileRead (
+    IN UINTN  FirstCluster,
+    IN UINTN  Size,
+    IN UINTN  ChunkSize,
+    IN UINTN  ThinkTime
+    )
+  {
+    UINTN    Offset;
+    UINTN    Cluster;
+    EFI_LBA  FatLba;
+
+    FatLba = 0;
+    for (Offset = 0; Offset < Size; Offset += ChunkSize) {
+      Cluster = FirstCluster + Offset / (TRACE_CLUSTER_BLOCKS * MMC_BLOCK_SIZE);
+      if (FatLba != TRACE_FAT_START + Cluster / (MMC_BLOCK_SIZE / 4)) {
+        FatLba = TRACE_FAT_START + Cluster / (MMC_BLOCK_SIZE / 4);
+        Add (FatLba, 1, 5);
+      }
+
+      Add (TRACE_CLUSTER (Cluster), MIN (ChunkSize, Size - Offset) / MMC_BLOCK_SIZE, ThinkTime);
+    }
+  }
+
+  void
+  BuildBootTrace (
+    )
+  {
+    UINTN  Pass;
+    UINTN  Index;
+
+    // The partition driver, the boot manager and the OS loader each scan the GPT
+    for (Pass = 0; Pass < 3; Pass++) {
+      Add (0, 1, 20);
+      Add (1, 1, 20);
+      Add (2, 32, 50);
+      Add (CARD_BLOCKS - 1, 1, 20);
+      Add (CARD_BLOCKS - 33, 32, 50);
+    }
+
+    // FAT mounts the ESP and walks \EFI\BOOT to the loader and its config
+    Add (TRACE_ESP_START, 1, 20);
+    Add (TRACE_ESP_START + 1, 1, 20);
+    for (Index = 0; Index < 3; Index++) {
+      Add (TRACE_FAT_START, 1, 5);
+      Add (TRACE_CLUSTER (2 + Index), TRACE_CLUSTER_BLOCKS, 30);
+    }
+
+    AddFileRead (16, SIZE_128KB, SIZE_4KB, 100);        // The loader, read by the image loader
+    for (Pass = 0; Pass < 2; Pass++) {
+      AddFileRead (64, SIZE_8KB, SIZE_4KB, 200);        // The loader config, parsed twice
+    }
+
+    AddFileRead (256, SIZE_4MB, SIZE_32KB, 1000);       // The kernel, hashed as it is read
+    AddFileRead (2048, SIZE_4MB, SIZE_512KB, 2000);     // The initrd, large reads
+  }
+
+  //
+  // Replay the trace, returning the nanoseconds it took.
+  //
+  UINT64
+  Replay (
+    )
+  {
+    UINT64  Start;
+    UINTN   Index;
+
+    Start = MmcHostModelTime ();
+    for (Index = 0; Index < Trace.size (); Index++) {
+      EXPECT_EQ (Read (Trace[Index].Lba, Trace[Index].Blocks, Buffer), EFI_SUCCESS);
+      EXPECT_EQ (CompareMem (Buffer, Card + Trace[Index].Lba * MMC_BLOCK_SIZE, Trace[Index].Blocks * MMC_BLOCK_SIZE), 0);
+      MmcHostModelRunTimers ((UINT64)Trace[Index].ThinkTime * 1000);
+    }
+
+    return MmcHostModelTime () - Start;
+  }
+};
+
+//
+// The cache has to take the boot trace less time than the card alone.
+//
+TEST_F (MmcCacheBenchmark, BootTraceReplay) {
+  UINTN            LineCount;
+  UINT64           ThinkTime;
+  UINT64           Uncached;
+  UINT64           UncachedBytes;
+  UINT64           Cached;
+  UINT64           CachedBytes;
+  MMC_CACHE_STATS  *Stats;
+  UINTN            Index;
+
+  ASSERT_NE (Instance->Cache.LineCount, 0U);
+
+  ThinkTime = 0;
+  for (Index = 0; Index < Trace.size (); Index++) {
+    ThinkTime += (UINT64)Trace[Index].ThinkTime * 1000;
+  }
+
+  // Without the cache
+  LineCount                 = Instance->Cache.LineCount;
+  Instance->Cache.LineCount = 0;
+  ZeroMem (&mMmcHostModelStatistics, sizeof (mMmcHostModelStatistics));
+  Uncached                  = Replay ();
+  UncachedBytes             = mMmcHostModelStatistics.BytesRead;
+  Instance->Cache.LineCount = LineCount;
+
+  // With the cache, from cold
+  MmcCacheInvalidate (Instance);
+  ZeroMem (&Instance->Cache.Stats, sizeof (Instance->Cache.Stats));
+  ZeroMem (&mMmcHostModelStatistics, sizeof (mMmcHostModelStatistics));
+  Cached      = Replay ();
+  CachedBytes = mMmcHostModelStatistics.BytesRead;
+  Stats       = &Instance->Cache.Stats;
+
+  printf (
+    "  %u reads, %llu us of consumer time\n"
+    "  uncached: %llu us, %llu KB from the card\n"
+    "  cached:   %llu us, %llu KB from the card\n"
+    "  %llu hits, %llu misses, %llu bypassed, %llu of %llu prefetched lines used, %llu evictions\n",
+    (unsigned)Trace.size (),
+    (unsigned long long)(ThinkTime / 1000),
+    (unsigned long long)(Uncached / 1000),
+    (unsigned long long)(UncachedBytes / SIZE_1KB),
+    (unsigned long long)(Cached / 1000),
+    (unsigned long long)(CachedBytes / SIZE_1KB),
+    (unsigned long long)Stats->Hits,
+    (unsigned long long)Stats->Misses,
+    (unsigned long long)Stats->Bypassed,
+    (unsigned long long)Stats->ReadAheadHits,
+    (unsigned long long)Stats->ReadAheadLines,
+    (unsigned long long)Stats->Evictions
+    );
+
+  EXPECT_LT (Cached, Uncached);
+  EXPECT_GT (Stats->Hits, Stats->Misses);
+  EXPECT_GT (Stats->ReadAheadHits, 0U);
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
@@ -0,0 +1,1237 @@
+/** @file
+  A model of an MMC host and of the SD card behind it, for the host tests
+  of MmcDxe.
+
+  The host is an EFI_MMC_HOST_PROTOCOL that moves the data of a command
+  when the command is sent, the way SdHostDxe does with ADMA2, between the
+  buffer given to Prepare () and the image of the card. The card answers
+  the identification of an SDHC card with UHS-I and CMD23 support, follows
+  the states a transfer takes it through and fails a data command the host
+  sends at a bus timing or signaling voltage the card is not switched to.
+  Faults let the block commands fail at chosen bus timings.
+
+  The model keeps a clock. Commands and data advance it at the speed of the
+  bus, the delays of the driver advance it instead of sleeping, and TimerLib
+  reads it. Events, timers and the TPL are modelled as well, a timer event
+  fires on a tick of the clock once the test lets time pass.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/TimerLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+
+#include "../Mmc.h"
+#include "MmcHostModel.h"
+
+#define MODEL_RCA                0x1234
+#define MODEL_OCR_VOLTAGE        0x00FF8000
+#define MODEL_COMMAND_TIME       5000       // Nanoseconds per command
+#define MODEL_READ_LATENCY       100000     // Nanoseconds before the first block of a read
+#define MODEL_PROGRAM_TIME       250000     // Nanoseconds the card programs a write for
+#define MODEL_IDENTIFICATION_CLK 400000
+
+//
+// Access modes the card supports at 3.3V and at 1.8V signaling
+//
+#define MODEL_MODES_3V3  (BIT_32 (SD_ACCESS_MODE_SDR12) | BIT_32 (SD_ACCESS_MODE_SDR25))
+#define MODEL_MODES_1V8  (MODEL_MODES_3V3 | BIT_32 (SD_ACCESS_MODE_SDR50) | \
+                          BIT_32 (SD_ACCESS_MODE_SDR104) | BIT_32 (SD_ACCESS_MODE_DDR50))
+
+typedef struct {
+  LIST_ENTRY          Link;
+  UINT32              Type;
+  EFI_TPL             NotifyTpl;
+  EFI_EVENT_NOTIFY    Notify;
+  VOID                *Context;
+  BOOLEAN             Signaled;
+  UINT64              TriggerTime;          // 0 when the timer is off
+  UINT64              Period;
+} MODEL_EVENT;
+
+typedef struct {
+  UINT8               *Data;
+  UINT64              Blocks;
+  UINT32              State;                // MMC_R0_STATE_*
+  BOOLEAN             AppCmd;
+  BOOLEAN             S18Accepted;          // ACMD41 agreed to 1.8V signaling
+  BOOLEAN             Signal1V8;
+  UINT32              AccessMode;           // SD_ACCESS_MODE_*
+  UINT32              BlockCount;           // CMD23 argument, 0 without
+  UINT32              WrittenBlocks;        // For ACMD22
+} MODEL_CARD;
+
+typedef struct {
+  MMC_BUS_TIMING      Timing;
+  BOOLEAN             Signal1V8;
+  UINT32              Clock;
+  UINT32              BusWidth;             // MMC_BUS_WIDTH_*
+  UINT8               *Buffer;              // From Prepare ()
+  UINTN               Length;
+} MODEL_HOST;
+
+typedef struct {
+  EFI_HANDLE          Handle;               // NULL when the entry is free
+  EFI_GUID            *Protocol;
+  VOID                *Interface;
+} MODEL_INTERFACE;
+
+#define MODEL_HANDLES     8
+#define MODEL_INTERFACES  16
+
+UINT32                     mMmcHostModelCaps;
+UINT32                     mMmcHostModelFaultTimings;
+EFI_STATUS                 mMmcHostModelFaultStatus;
+MMC_HOST_MODEL_STATISTICS  mMmcHostModelStatistics;
+
+STATIC_ASSERT (sizeof (CSD) <= sizeof (UINT32) * 4, "CSD does not fit an R2 response");
+STATIC_ASSERT (sizeof (ECSD) <= sizeof (UINT32) * 4, "ECSD does not fit an R2 response");
+
+STATIC MODEL_CARD           mModelCard;
+STATIC MODEL_HOST           mModelHost;
+STATIC UINT64               mModelTime;
+STATIC EFI_TPL              mModelTpl = TPL_APPLICATION;
+STATIC LIST_ENTRY           mModelEvents = INITIALIZE_LIST_HEAD_VARIABLE (mModelEvents);
+STATIC EFI_BOOT_SERVICES    mModelBootServices;
+STATIC BOOLEAN              mModelActive;
+STATIC UINT8                mModelHandles[MODEL_HANDLES];
+STATIC MODEL_INTERFACE      mModelInterfaces[MODEL_INTERFACES];
+
+//
+// The access mode of the card each bus timing of the host goes with
+//
+STATIC CONST UINT32  mModelTimingAccessMode[MmcTimingMax] = {
+  SD_ACCESS_MODE_SDR12,      // MmcTimingLegacy
+  SD_ACCESS_MODE_SDR25,      // MmcTimingSdHs
+  SD_ACCESS_MODE_SDR12,      // MmcTimingUhsSdr12
+  SD_ACCESS_MODE_SDR25,      // MmcTimingUhsSdr25
+  SD_ACCESS_MODE_SDR50,      // MmcTimingUhsSdr50
+  SD_ACCESS_MODE_SDR104,     // MmcTimingUhsSdr104
+  SD_ACCESS_MODE_DDR50,      // MmcTimingUhsDdr50
+  MAX_UINT32,                // eMMC timings, not for an SD card
+  MAX_UINT32,
+  MAX_UINT32,
+  MAX_UINT32,
+  MAX_UINT32,
+};
+
+/**
+  Advance the clock of the model by the time a data phase takes on the bus.
+
+**/
+STATIC
+VOID
+ModelBusTime (
+  IN UINTN  Bytes
+  )
+{
+  UINT64  BitsPerSecond;
+
+  switch (mModelHost.BusWidth) {
+    case MMC_BUS_WIDTH_4:
+    case MMC_BUS_WIDTH_DDR_4:
+      BitsPerSecond = MultU64x32 (mModelHost.Clock, 4);
+      break;
+
+    case MMC_BUS_WIDTH_8:
+    case MMC_BUS_WIDTH_DDR_8:
+      BitsPerSecond = MultU64x32 (mModelHost.Clock, 8);
+      break;
+
+    default:
+      BitsPerSecond = mModelHost.Clock;
+      break;
+  }
+
+  if ((mModelHost.Timing == MmcTimingUhsDdr50) ||
+      (mModelHost.BusWidth == MMC_BUS_WIDTH_DDR_4) ||
+      (mModelHost.BusWidth == MMC_BUS_WIDTH_DDR_8)) {
+    BitsPerSecond *= 2;
+  }
+
+  ASSERT (BitsPerSecond != 0);
+  mModelTime += DivU64x64Remainder (MultU64x32 (MultU64x32 (Bytes, 8), 1000000000), BitsPerSecond, NULL);
+}
+
+/**
+  Check that the host samples the bus the way the card drives it.
+
+**/
+STATIC
+BOOLEAN
+ModelBusWorks (
+  VOID
+  )
+{
+  if (mModelHost.Signal1V8 != mModelCard.Signal1V8) {
+    return FALSE;
+  }
+
+  if ((MMC_TIMING_BIT (mModelHost.Timing) & MMC_TIMING_UHS_MASK) != 0U) {
+    if (!mModelHost.Signal1V8) {
+      return FALSE;
+    }
+  } else if ((mModelHost.Timing != MmcTimingLegacy) && mModelHost.Signal1V8) {
+    return FALSE;
+  }
+
+  return mModelTimingAccessMode[mModelHost.Timing] == mModelCard.AccessMode;
+}
+
+/**
+  Return the R1 card status of the card.
+
+**/
+STATIC
+UINT32
+ModelCardStatus (
+  VOID
+  )
+{
+  return (mModelCard.State << 9) | MMC_R0_READY_FOR_DATA | (mModelCard.AppCmd ? MMC_STATUS_APP_CMD : 0);
+}
+
+/**
+  Move a data block of a register read to the buffer given to Prepare ().
+
+**/
+STATIC
+EFI_STATUS
+ModelSendData (
+  IN CONST VOID  *Data,
+  IN UINTN       Length
+  )
+{
+  if ((mModelHost.Buffer == NULL) || (mModelHost.Length < Length)) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  if (!ModelBusWorks ()) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  CopyMem (mModelHost.Buffer, Data, Length);
+  ModelBusTime (Length);
+  mModelHost.Buffer = NULL;
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Run CMD6 SWITCH_FUNC, the card sends its 64-byte switch status.
+
+**/
+STATIC
+EFI_STATUS
+ModelSwitchFunc (
+  IN UINT32  Argument
+  )
+{
+  UINT8   Status[SWITCH_CMD_DATA_LENGTH];
+  UINT32  Modes;
+  UINT32  Function;
+
+  Modes    = mModelCard.Signal1V8 ? MODEL_MODES_1V8 : MODEL_MODES_3V3;
+  Function = Argument & 0xF;
+
+  ZeroMem (Status, sizeof (Status));
+  SD_SWITCH_ACCESS_MODE_SUPPORT (Status) = (UINT8)Modes;
+
+  if (Function == SD_SWITCH_KEEP_ACCESS_MODE) {
+    Status[16] = (UINT8)mModelCard.AccessMode;
+  } else if ((Modes & BIT_32 (Function)) != 0U) {
+    Status[16] = (UINT8)Function;
+  } else {
+    Status[16] = SD_SWITCH_KEEP_ACCESS_MODE;
+  }
+
+  // The card switches once the status block is out
+  if (EFI_ERROR (ModelSendData (Status, sizeof (Status)))) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  if (((Argument & BIT31) != 0U) && (Status[16] != SD_SWITCH_KEEP_ACCESS_MODE)) {
+    mModelCard.AccessMode = Status[16];
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Run a block command. The data moves between the card and the buffer given
+  to Prepare ().
+
+**/
+STATIC
+EFI_STATUS
+ModelBlockCommand (
+  IN MMC_IDX  Cmd,
+  IN UINT32   Argument
+  )
+{
+  UINTN    Blocks;
+  UINTN    Index;
+  BOOLEAN  Write;
+  UINT8    *Card;
+
+  Index = MMC_GET_INDX (Cmd);
+  Write = (Index == MMC_CMD24) || (Index == MMC_CMD25);
+
+  if ((mModelCard.State != MMC_R0_STATE_TRAN) || (mModelHost.Buffer == NULL) ||
+      (mModelHost.Length == 0) || ((mModelHost.Length % MMC_BLOCK_SIZE) != 0)) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  Blocks = mModelHost.Length / MMC_BLOCK_SIZE;
+  if ((Argument + (UINT64)Blocks > mModelCard.Blocks) ||
+      (((Index == MMC_CMD17) || (Index == MMC_CMD24)) && (Blocks != 1))) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  if ((Cmd & MMC_CMD_AUTO_CMD23) != 0U) {
+    if ((mMmcHostModelCaps & MMC_HOST_CAP_AUTO_CMD23) == 0U) {
+      return EFI_DEVICE_ERROR;
+    }
+
+    mModelCard.BlockCount = (UINT32)Blocks;
+  }
+
+  mMmcHostModelStatistics.BlockCommands++;
+  mModelTime += Write ? MODEL_PROGRAM_TIME : MODEL_READ_LATENCY;
+
+  // A block count that does not cover the transfer ends it early
+  if ((mModelCard.BlockCount != 0) && (mModelCard.BlockCount < Blocks)) {
+    mModelCard.BlockCount = 0;
+    return EFI_DEVICE_ERROR;
+  }
+
+  mModelCard.State = Write ? MMC_R0_STATE_RECV : MMC_R0_STATE_DATA;
+
+  if (((mMmcHostModelFaultTimings & MMC_TIMING_BIT (mModelHost.Timing)) != 0U) || !ModelBusWorks ()) {
+    mMmcHostModelStatistics.Faults++;
+    mModelCard.BlockCount = 0;
+    ModelBusTime (mModelHost.Length / 2);
+    return ((mMmcHostModelFaultTimings & MMC_TIMING_BIT (mModelHost.Timing)) != 0U) ?
+           mMmcHostModelFaultStatus : EFI_DEVICE_ERROR;
+  }
+
+  Card = mModelCard.Data + MultU64x32 (Argument, MMC_BLOCK_SIZE);
+  if (Write) {
+    CopyMem (Card, mModelHost.Buffer, mModelHost.Length);
+    mModelCard.WrittenBlocks               = (UINT32)Blocks;
+    mMmcHostModelStatistics.BytesWritten += mModelHost.Length;
+  } else {
+    CopyMem (mModelHost.Buffer, Card, mModelHost.Length);
+    mMmcHostModelStatistics.BytesRead += mModelHost.Length;
+  }
+
+  ModelBusTime (mModelHost.Length);
+  mModelHost.Buffer = NULL;
+
+  // Single blocks and pre-defined transfers end by themselves, open-ended ones with CMD12
+  if ((Blocks == 1) || (mModelCard.BlockCount != 0)) {
+    mModelCard.State = MMC_R0_STATE_TRAN;
+  }
+
+  mModelCard.BlockCount = 0;
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+BOOLEAN
+EFIAPI
+ModelIsCardPresent (
+  IN EFI_MMC_HOST_PROTOCOL  *This
+  )
+{
+  return mModelCard.Data != NULL;
+}
+
+STATIC
+BOOLEAN
+EFIAPI
+ModelIsReadOnly (
+  IN EFI_MMC_HOST_PROTOCOL  *This
+  )
+{
+  return FALSE;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelBuildDevicePath (
+  IN  EFI_MMC_HOST_PROTOCOL     *This,
+  OUT EFI_DEVICE_PATH_PROTOCOL  **DevicePath
+  )
+{
+  *DevicePath = CreateDeviceNode (HARDWARE_DEVICE_PATH, HW_VENDOR_DP, sizeof (VENDOR_DEVICE_PATH));
+  return (*DevicePath == NULL) ? EFI_OUT_OF_RESOURCES : EFI_SUCCESS;
+}
+
+/**
+  Initializing the host power cycles the card, which takes it back to
+  3.3V signaling.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+ModelNotifyState (
+  IN EFI_MMC_HOST_PROTOCOL  *This,
+  IN MMC_STATE              State
+  )
+{
+  if (State == MmcHwInitializationState) {
+    mMmcHostModelStatistics.PowerCycles++;
+
+    mModelHost.Timing      = MmcTimingLegacy;
+    mModelHost.Signal1V8   = FALSE;
+    mModelHost.Clock       = MODEL_IDENTIFICATION_CLK;
+    mModelHost.BusWidth    = MMC_BUS_WIDTH_1;
+    mModelHost.Buffer      = NULL;
+    mModelCard.State       = MMC_R0_STATE_IDLE;
+    mModelCard.AppCmd      = FALSE;
+    mModelCard.S18Accepted = FALSE;
+    mModelCard.Signal1V8   = FALSE;
+    mModelCard.AccessMode  = SD_ACCESS_MODE_SDR12;
+    mModelCard.BlockCount  = 0;
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelSendCommand (
+  IN EFI_MMC_HOST_PROTOCOL  *This,
+  IN MMC_IDX                Cmd,
+  IN UINT32                 Argument,
+  IN MMC_RESPONSE_TYPE      Type,
+  IN UINT32                 *Buffer
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      Response[4];
+  BOOLEAN     AppCmd;
+  CSD         *Csd;
+  ECSD        *CsdV2;
+  UINT8       Scr[8];
+  UINT8       Written[4];
+
+  mMmcHostModelStatistics.Commands++;
+  mModelTime += MODEL_COMMAND_TIME;
+
+  AppCmd            = mModelCard.AppCmd;
+  mModelCard.AppCmd = FALSE;
+  Status            = EFI_SUCCESS;
+  ZeroMem (Response, sizeof (Response));
+  Response[0] = ModelCardStatus ();
+
+  switch (MMC_GET_INDX (Cmd)) {
+    case MMC_CMD0:
+      mModelCard.State       = MMC_R0_STATE_IDLE;
+      mModelCard.AccessMode  = SD_ACCESS_MODE_SDR12;
+      mModelCard.BlockCount  = 0;
+      mModelCard.S18Accepted = FALSE;
+      break;
+
+    case MMC_CMD2:
+      mModelCard.State = MMC_R0_STATE_IDENT;
+      break;
+
+    case MMC_CMD3:
+      mModelCard.State = MMC_R0_STATE_STDBY;
+      Response[0]      = MODEL_RCA << 16;
+      break;
+
+    case MMC_CMD6:
+      if ((Cmd & MMC_CMD_WITH_DATA) != 0U) {
+        Status = ModelSwitchFunc (Argument);
+      } else if (!AppCmd || ((Argument != 0) && (Argument != 2))) {
+        // SET_BUS_WIDTH takes 1 or 4 bits, an SD card has no EXT_CSD to switch
+        Status = EFI_TIMEOUT;
+      }
+
+      break;
+
+    case MMC_CMD7:
+      mModelCard.State = ((Argument >> 16) == MODEL_RCA) ? MMC_R0_STATE_TRAN : MMC_R0_STATE_STDBY;
+      break;
+
+    case MMC_CMD8:
+      if (((Cmd & MMC_CMD_WITH_DATA) != 0U) || (mModelCard.State != MMC_R0_STATE_IDLE)) {
+        Status = EFI_TIMEOUT;
+      } else {
+        Response[0] = Argument & 0xFFF;
+      }
+
+      break;
+
+    case MMC_CMD9:
+      // The driver reads the fields of a version 2.0 CSD through both layouts
+      Csd                = (CSD *)Response;
+      Csd->CSD_STRUCTURE = 1;
+      Csd->TRAN_SPEED    = 0x32;                              // 25MHz
+      Csd->CCC           = 0x5B5;                             // With class 10, switch
+      Csd->READ_BL_LEN   = 9;
+      CsdV2              = (ECSD *)Response;
+      CsdV2->C_SIZELow16 = (UINT32)((mModelCard.Blocks / 1024 - 1) & 0xFFFF);
+      CsdV2->C_SIZEHigh6 = (UINT32)((mModelCard.Blocks / 1024 - 1) >> 16);
+      break;
+
+    case MMC_CMD11:
+      if (!mModelCard.S18Accepted) {
+        Status = EFI_TIMEOUT;
+      } else {
+        mModelCard.Signal1V8 = TRUE;
+      }
+
+      break;
+
+    case MMC_CMD12:
+      mMmcHostModelStatistics.StopCommands++;
+      if ((mModelCard.State == MMC_R0_STATE_DATA) || (mModelCard.State == MMC_R0_STATE_RECV)) {
+        mModelCard.State = MMC_R0_STATE_TRAN;
+      }
+
+      break;
+
+    case MMC_CMD13:
+      if ((Argument >> 16) != MODEL_RCA) {
+        Status = EFI_TIMEOUT;
+      }
+
+      break;
+
+    case MMC_CMD16:
+      break;
+
+    case MMC_CMD17:
+    case MMC_CMD18:
+    case MMC_CMD24:
+    case MMC_CMD25:
+      Status = ModelBlockCommand (Cmd, Argument);
+      break;
+
+    case MMC_CMD23:
+      mModelCard.BlockCount = Argument & MMC_CMD23_MAX_BLOCKS;
+      break;
+
+    case MMC_CMD55:
+      mModelCard.AppCmd = TRUE;
+      Response[0]       = ModelCardStatus ();
+      break;
+
+    default:
+      if (AppCmd && (MMC_GET_INDX (Cmd) == MMC_ACMD41)) {
+        mModelCard.State       = MMC_R0_STATE_READY;
+        mModelCard.S18Accepted = ((Argument & OCR_S18R) != 0U);
+        Response[0]            = MMC_OCR_POWERUP | OCR_HCS | MODEL_OCR_VOLTAGE |
+                                 (mModelCard.S18Accepted ? OCR_S18A : 0);
+      } else if (AppCmd && (MMC_GET_INDX (Cmd) == MMC_ACMD51)) {
+        // SD 3.0, 1 and 4 bit bus, CMD23, big-endian
+        Scr[0] = 0x02;
+        Scr[1] = 0x05;
+        Scr[2] = 0x80;
+        Scr[3] = 0x02;
+        Scr[4] = Scr[5] = Scr[6] = Scr[7] = 0;
+        Status = ModelSendData (Scr, sizeof (Scr));
+      } else if (AppCmd && (MMC_GET_INDX (Cmd) == MMC_ACMD22)) {
+        Written[0] = (UINT8)(mModelCard.WrittenBlocks >> 24);
+        Written[1] = (UINT8)(mModelCard.WrittenBlocks >> 16);
+        Written[2] = (UINT8)(mModelCard.WrittenBlocks >> 8);
+        Written[3] = (UINT8)mModelCard.WrittenBlocks;
+        Status     = ModelSendData (Written, sizeof (Written));
+      } else {
+        Status = EFI_TIMEOUT;
+      }
+
+      break;
+  }
+
+  if (!EFI_ERROR (Status) && (Buffer != NULL)) {
+    CopyMem (Buffer, Response, ((Type & MMC_RSP_136) != 0U) ? sizeof (Response) : sizeof (Response[0]));
+  }
+
+  return Status;
+}
+
+//
+// The data moved with the command, reading or writing the block data only
+// completes the transfer.
+//
+STATIC
+EFI_STATUS
+EFIAPI
+ModelReadBlockData (
+  IN  EFI_MMC_HOST_PROTOCOL  *This,
+  IN  EFI_LBA                Lba,
+  IN  UINTN                  Length,
+  OUT UINT32                 *Buffer
+  )
+{
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelWriteBlockData (
+  IN  EFI_MMC_HOST_PROTOCOL  *This,
+  IN  EFI_LBA                Lba,
+  IN  UINTN                  Length,
+  IN  UINT32                 *Buffer
+  )
+{
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelSetIos (
+  IN EFI_MMC_HOST_PROTOCOL  *This,
+  IN UINT32                 BusClockFreq,
+  IN UINT32                 BusWidth
+  )
+{
+  mModelHost.Clock    = BusClockFreq;
+  mModelHost.BusWidth = BusWidth;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelPrepare (
+  IN EFI_MMC_HOST_PROTOCOL  *This,
+  IN EFI_LBA                Lba,
+  IN UINTN                  Length,
+  IN UINTN                  Buffer
+  )
+{
+  mModelHost.Buffer = (UINT8 *)Buffer;
+  mModelHost.Length = Length;
+  return EFI_SUCCESS;
+}
+
+STATIC
+BOOLEAN
+EFIAPI
+ModelIsMultiBlock (
+  IN EFI_MMC_HOST_PROTOCOL  *This
+  )
+{
+  return TRUE;
+}
+
+STATIC
+UINT32
+EFIAPI
+ModelGetCapabilities (
+  IN EFI_MMC_HOST_PROTOCOL  *This
+  )
+{
+  return mMmcHostModelCaps;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelSetTiming (
+  IN EFI_MMC_HOST_PROTOCOL  *This,
+  IN MMC_BUS_TIMING         Timing
+  )
+{
+  if ((Timing >= MmcTimingMax) || (mModelTimingAccessMode[Timing] == MAX_UINT32)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  mModelHost.Timing = Timing;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelSwitchSignalVoltage (
+  IN EFI_MMC_HOST_PROTOCOL  *This
+  )
+{
+  if (!mModelCard.Signal1V8) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  mModelHost.Signal1V8 = TRUE;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelExecuteTuning (
+  IN EFI_MMC_HOST_PROTOCOL  *This,
+  IN MMC_IDX                TuningCmd
+  )
+{
+  mModelTime += 40 * MODEL_COMMAND_TIME;
+  return ((TuningCmd == MMC_CMD19) && ModelBusWorks ()) ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+}
+
+EFI_MMC_HOST_PROTOCOL  mMmcHostModelProtocol = {
+  MMC_HOST_PROTOCOL_REVISION,
+  ModelIsCardPresent,
+  ModelIsReadOnly,
+  ModelBuildDevicePath,
+  ModelNotifyState,
+  ModelSendCommand,
+  ModelReadBlockData,
+  ModelWriteBlockData,
+  ModelSetIos,
+  ModelPrepare,
+  ModelIsMultiBlock,
+  ModelGetCapabilities,
+  ModelSetTiming,
+  ModelSwitchSignalVoltage,
+  ModelExecuteTuning
+};
+
+/**
+  Run the notification functions of the signaled events the TPL allows,
+  highest TPL first.
+
+**/
+STATIC
+VOID
+ModelDispatch (
+  VOID
+  )
+{
+  LIST_ENTRY   *Link;
+  MODEL_EVENT  *Event;
+  MODEL_EVENT  *Next;
+  EFI_TPL      OldTpl;
+
+  for ( ; ;) {
+    Next = NULL;
+    for (Link = GetFirstNode (&mModelEvents); !IsNull (&mModelEvents, Link); Link = GetNextNode (&mModelEvents, Link)) {
+      Event = BASE_CR (Link, MODEL_EVENT, Link);
+      if (Event->Signaled && ((Event->Type & EVT_NOTIFY_SIGNAL) != 0U) && (Event->NotifyTpl > mModelTpl) &&
+          ((Next == NULL) || (Event->NotifyTpl > Next->NotifyTpl))) {
+        Next = Event;
+      }
+    }
+
+    if (Next == NULL) {
+      return;
+    }
+
+    Next->Signaled = FALSE;
+    OldTpl         = mModelTpl;
+    mModelTpl      = Next->NotifyTpl;
+    Next->Notify ((EFI_EVENT)Next, Next->Context);
+    mModelTpl = OldTpl;
+  }
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelStall (
+  IN UINTN  Microseconds
+  )
+{
+  mModelTime += MultU64x32 (Microseconds, 1000);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_TPL
+EFIAPI
+ModelRaiseTpl (
+  IN EFI_TPL  NewTpl
+  )
+{
+  EFI_TPL  OldTpl;
+
+  OldTpl = mModelTpl;
+  ASSERT (NewTpl >= OldTpl);
+  mModelTpl = NewTpl;
+  return OldTpl;
+}
+
+STATIC
+VOID
+EFIAPI
+ModelRestoreTpl (
+  IN EFI_TPL  OldTpl
+  )
+{
+  ASSERT (OldTpl <= mModelTpl);
+  mModelTpl = OldTpl;
+  ModelDispatch ();
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction OPTIONAL,
+  IN  VOID              *NotifyContext OPTIONAL,
+  OUT EFI_EVENT         *Event
+  )
+{
+  MODEL_EVENT  *ModelEvent;
+
+  if ((Event == NULL) || (((Type & (EVT_NOTIFY_SIGNAL | EVT_NOTIFY_WAIT)) != 0U) && (NotifyFunction == NULL))) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  ModelEvent = AllocateZeroPool (sizeof (MODEL_EVENT));
+  if (ModelEvent == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  ModelEvent->Type      = Type;
+  ModelEvent->NotifyTpl = NotifyTpl;
+  ModelEvent->Notify    = NotifyFunction;
+  ModelEvent->Context   = NotifyContext;
+  InsertTailList (&mModelEvents, &ModelEvent->Link);
+
+  *Event = (EFI_EVENT)ModelEvent;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  MODEL_EVENT  *ModelEvent;
+
+  ModelEvent = (MODEL_EVENT *)Event;
+  RemoveEntryList (&ModelEvent->Link);
+  FreePool (ModelEvent);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelSignalEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ((MODEL_EVENT *)Event)->Signaled = TRUE;
+  ModelDispatch ();
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCheckEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  MODEL_EVENT  *ModelEvent;
+
+  ModelEvent = (MODEL_EVENT *)Event;
+  if ((ModelEvent->Type & EVT_NOTIFY_SIGNAL) != 0U) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (!ModelEvent->Signaled && ((ModelEvent->Type & EVT_NOTIFY_WAIT) != 0U)) {
+    ModelEvent->Notify (Event, ModelEvent->Context);
+  }
+
+  if (!ModelEvent->Signaled) {
+    return EFI_NOT_READY;
+  }
+
+  ModelEvent->Signaled = FALSE;
+  return EFI_SUCCESS;
+}
+
+/**
+  Return the first tick of the clock at or after Time.
+
+**/
+STATIC
+UINT64
+ModelNextTick (
+  IN UINT64  Time
+  )
+{
+  return MultU64x32 (DivU64x32 (Time + MMC_HOST_MODEL_TICK - 1, MMC_HOST_MODEL_TICK), MMC_HOST_MODEL_TICK);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelSetTimer (
+  IN EFI_EVENT        Event,
+  IN EFI_TIMER_DELAY  Type,
+  IN UINT64           TriggerTime
+  )
+{
+  MODEL_EVENT  *ModelEvent;
+
+  ModelEvent = (MODEL_EVENT *)Event;
+  if ((ModelEvent->Type & EVT_TIMER) == 0U) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  ModelEvent->TriggerTime = 0;
+  ModelEvent->Period      = 0;
+  if (Type == TimerCancel) {
+    return EFI_SUCCESS;
+  }
+
+  // A timer comes due on the next tick at the earliest
+  ModelEvent->TriggerTime = ModelNextTick (mModelTime + MultU64x32 (TriggerTime, 100) + 1);
+  if (Type == TimerPeriodic) {
+    ModelEvent->Period = MAX (MultU64x32 (TriggerTime, 100), MMC_HOST_MODEL_TICK);
+  }
+
+  return EFI_SUCCESS;
+}
+
+//
+// The model keeps the handles of the driver and the protocols on them
+// itself. The handle database of the host test library logs each install
+// through the unit test framework, which a GoogleTest host test does not
+// run, and nothing the driver publishes is looked up again.
+//
+STATIC
+MODEL_INTERFACE *
+ModelFindInterface (
+  IN EFI_HANDLE  Handle,
+  IN EFI_GUID    *Protocol
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < MODEL_INTERFACES; Index++) {
+    if ((mModelInterfaces[Index].Handle == Handle) &&
+        ((Handle == NULL) || CompareGuid (mModelInterfaces[Index].Protocol, Protocol)))
+    {
+      return &mModelInterfaces[Index];
+    }
+  }
+
+  return NULL;
+}
+
+STATIC
+BOOLEAN
+ModelHandleInUse (
+  IN EFI_HANDLE  Handle
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < MODEL_INTERFACES; Index++) {
+    if (mModelInterfaces[Index].Handle == Handle) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelInstallMultipleProtocolInterfaces (
+  IN OUT EFI_HANDLE  *Handle,
+  ...
+  )
+{
+  VA_LIST          Args;
+  EFI_GUID         *Protocol;
+  MODEL_INTERFACE  *Entry;
+  UINTN            Index;
+
+  if (*Handle == NULL) {
+    for (Index = 0; Index < MODEL_HANDLES && ModelHandleInUse (&mModelHandles[Index]); Index++) {
+    }
+
+    if (Index == MODEL_HANDLES) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    *Handle = &mModelHandles[Index];
+  } else if (!ModelHandleInUse (*Handle)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  VA_START (Args, Handle);
+  for (Protocol = VA_ARG (Args, EFI_GUID *); Protocol != NULL; Protocol = VA_ARG (Args, EFI_GUID *)) {
+    ASSERT (ModelFindInterface (*Handle, Protocol) == NULL);
+    Entry = ModelFindInterface (NULL, NULL);
+    ASSERT (Entry != NULL);
+    Entry->Handle    = *Handle;
+    Entry->Protocol  = Protocol;
+    Entry->Interface = VA_ARG (Args, VOID *);
+  }
+
+  VA_END (Args);
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelUninstallMultipleProtocolInterfaces (
+  IN EFI_HANDLE  Handle,
+  ...
+  )
+{
+  VA_LIST          Args;
+  EFI_GUID         *Protocol;
+  MODEL_INTERFACE  *Entry;
+
+  VA_START (Args, Handle);
+  for (Protocol = VA_ARG (Args, EFI_GUID *); Protocol != NULL; Protocol = VA_ARG (Args, EFI_GUID *)) {
+    Entry = ModelFindInterface (Handle, Protocol);
+    if ((Entry == NULL) || (Entry->Interface != VA_ARG (Args, VOID *))) {
+      VA_END (Args);
+      return EFI_INVALID_PARAMETER;
+    }
+
+    ZeroMem (Entry, sizeof (*Entry));
+  }
+
+  VA_END (Args);
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelReinstallProtocolInterface (
+  IN EFI_HANDLE  Handle,
+  IN EFI_GUID    *Protocol,
+  IN VOID        *OldInterface,
+  IN VOID        *NewInterface
+  )
+{
+  MODEL_INTERFACE  *Entry;
+
+  Entry = ModelFindInterface (Handle, Protocol);
+  if ((Handle == NULL) || (Entry == NULL) || (Entry->Interface != OldInterface)) {
+    return EFI_NOT_FOUND;
+  }
+
+  Entry->Interface = NewInterface;
+
+  return EFI_SUCCESS;
+}
+
+VOID
+MmcHostModelRunTimers (
+  IN UINT64  Nanoseconds
+  )
+{
+  UINT64       End;
+  LIST_ENTRY   *Link;
+  MODEL_EVENT  *Event;
+  MODEL_EVENT  *Due;
+
+  End = mModelTime + Nanoseconds;
+  for ( ; ;) {
+    Due = NULL;
+    for (Link = GetFirstNode (&mModelEvents); !IsNull (&mModelEvents, Link); Link = GetNextNode (&mModelEvents, Link)) {
+      Event = BASE_CR (Link, MODEL_EVENT, Link);
+      if ((Event->TriggerTime != 0) && ((Due == NULL) || (Event->TriggerTime < Due->TriggerTime))) {
+        Due = Event;
+      }
+    }
+
+    if ((Due == NULL) || (Due->TriggerTime > End)) {
+      break;
+    }
+
+    // The work of the previous notification may have run past the tick
+    mModelTime = MAX (mModelTime, Due->TriggerTime);
+    if (Due->Period != 0) {
+      Due->TriggerTime = ModelNextTick (MAX (Due->TriggerTime + Due->Period, mModelTime));
+    } else {
+      Due->TriggerTime = 0;
+    }
+
+    Due->Signaled = TRUE;
+    ModelDispatch ();
+  }
+
+  mModelTime = MAX (mModelTime, End);
+}
+
+UINTN
+EFIAPI
+MicroSecondDelay (
+  IN UINTN  MicroSeconds
+  )
+{
+  mModelTime += MultU64x32 (MicroSeconds, 1000);
+  return MicroSeconds;
+}
+
+UINTN
+EFIAPI
+NanoSecondDelay (
+  IN UINTN  NanoSeconds
+  )
+{
+  mModelTime += NanoSeconds;
+  return NanoSeconds;
+}
+
+UINT64
+EFIAPI
+GetPerformanceCounter (
+  VOID
+  )
+{
+  return mModelTime;
+}
+
+UINT64
+EFIAPI
+GetPerformanceCounterProperties (
+  OUT UINT64  *StartValue  OPTIONAL,
+  OUT UINT64  *EndValue    OPTIONAL
+  )
+{
+  if (StartValue != NULL) {
+    *StartValue = 0;
+  }
+
+  if (EndValue != NULL) {
+    *EndValue = MAX_UINT64;
+  }
+
+  return 1000000000;
+}
+
+UINT64
+EFIAPI
+GetTimeInNanoSecond (
+  IN UINT64  Ticks
+  )
+{
+  return Ticks;
+}
+
+VOID
+MmcHostModelReset (
+  IN UINTN  CardBlocks
+  )
+{
+  ASSERT ((CardBlocks != 0) && ((CardBlocks % 1024) == 0));
+
+  MmcHostModelFree ();
+
+  ZeroMem (&mModelCard, sizeof (mModelCard));
+  ZeroMem (&mModelHost, sizeof (mModelHost));
+  mModelCard.Blocks = CardBlocks;
+  mModelCard.Data   = AllocateZeroPool ((UINTN)MultU64x32 (CardBlocks, MMC_BLOCK_SIZE));
+  ASSERT (mModelCard.Data != NULL);
+  mModelHost.Clock = MODEL_IDENTIFICATION_CLK;
+
+  mMmcHostModelCaps         = MMC_HOST_CAP_HIGHSPEED | MMC_HOST_CAP_1V8_SIGNALING | MMC_HOST_CAP_SDR50 |
+                              MMC_HOST_CAP_SDR104 | MMC_HOST_CAP_DDR50 | MMC_HOST_CAP_SDR50_TUNING;
+  mMmcHostModelFaultTimings = 0;
+  mMmcHostModelFaultStatus  = EFI_DEVICE_ERROR;
+  ZeroMem (&mMmcHostModelStatistics, sizeof (mMmcHostModelStatistics));
+
+  mModelTime = 0;
+  mModelTpl  = TPL_APPLICATION;
+
+  CopyMem (&mModelBootServices, gBS, sizeof (EFI_BOOT_SERVICES));
+  gBS->Stall       = ModelStall;
+  gBS->RaiseTPL    = ModelRaiseTpl;
+  gBS->RestoreTPL  = ModelRestoreTpl;
+  gBS->CreateEvent = ModelCreateEvent;
+  gBS->CloseEvent  = ModelCloseEvent;
+  gBS->SignalEvent = ModelSignalEvent;
+  gBS->CheckEvent  = ModelCheckEvent;
+  gBS->SetTimer    = ModelSetTimer;
+
+  ZeroMem (mModelInterfaces, sizeof (mModelInterfaces));
+  gBS->ReinstallProtocolInterface          = ModelReinstallProtocolInterface;
+  gBS->InstallMultipleProtocolInterfaces   = ModelInstallMultipleProtocolInterfaces;
+  gBS->UninstallMultipleProtocolInterfaces = ModelUninstallMultipleProtocolInterfaces;
+  mModelActive     = TRUE;
+}
+
+VOID
+MmcHostModelFree (
+  VOID
+  )
+{
+  MODEL_EVENT  *Event;
+
+  if (!mModelActive) {
+    return;
+  }
+
+  while (!IsListEmpty (&mModelEvents)) {
+    Event = BASE_CR (GetFirstNode (&mModelEvents), MODEL_EVENT, Link);
+    ModelCloseEvent ((EFI_EVENT)Event);
+  }
+
+  FreePool (mModelCard.Data);
+  mModelCard.Data = NULL;
+  CopyMem (gBS, &mModelBootServices, sizeof (EFI_BOOT_SERVICES));
+  mModelActive = FALSE;
+}
+
+UINT8 *
+MmcHostModelCard (
+  VOID
+  )
+{
+  return mModelCard.Data;
+}
+
+MMC_BUS_TIMING
+MmcHostModelTiming (
+  VOID
+  )
+{
+  return mModelHost.Timing;
+}
+
+UINT64
+MmcHostModelTime (
+  VOID
+  )
+{
+  return mModelTime;
+}
+
+EFI_TPL
+MmcHostModelTpl (
+  VOID
+  )
+{
+  return mModelTpl;
+}
@@ -0,0 +1,109 @@
+/** @file
+  Interface of the MMC host and SD card model to the host tests of MmcDxe.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#ifndef MMC_HOST_MODEL_H_
+#define MMC_HOST_MODEL_H_
+
+#include <Include/MmcHost.h>
+
+//
+// Timer events of the model fire on ticks of this many nanoseconds.
+//
+#define MMC_HOST_MODEL_TICK  1000000
+
+typedef struct {
+  UINT32    Commands;
+  UINT32    BlockCommands;    // CMD17, CMD18, CMD24 and CMD25
+  UINT32    StopCommands;     // CMD12
+  UINT32    PowerCycles;      // Times the driver initialized the host
+  UINT32    Faults;           // Block commands the model failed
+  UINT64    BytesRead;
+  UINT64    BytesWritten;
+} MMC_HOST_MODEL_STATISTICS;
+
+extern EFI_MMC_HOST_PROTOCOL      mMmcHostModelProtocol;
+extern UINT32                     mMmcHostModelCaps;          // MMC_HOST_CAP_* the host reports
+extern UINT32                     mMmcHostModelFaultTimings;  // Bit per MMC_BUS_TIMING block commands fail at
+extern EFI_STATUS                 mMmcHostModelFaultStatus;   // What they fail with
+extern MMC_HOST_MODEL_STATISTICS  mMmcHostModelStatistics;
+
+/**
+  Power the host and the card down, replace the card with a zeroed SDHC
+  card of the given size that supports the UHS-I timings and CMD23, clear
+  the faults and the statistics, and take over the boot services the
+  driver uses for delays, events and the TPL.
+
+  @param  CardBlocks             The size of the card in 512 byte blocks,
+                                 a multiple of 1024.
+
+**/
+VOID
+MmcHostModelReset (
+  IN UINTN  CardBlocks
+  );
+
+/**
+  Free the card, close the events left open and give the boot services
+  back.
+
+**/
+VOID
+MmcHostModelFree (
+  VOID
+  );
+
+/**
+  Return the image of the card.
+
+**/
+UINT8 *
+MmcHostModelCard (
+  VOID
+  );
+
+/**
+  Return the bus timing the host runs at.
+
+**/
+MMC_BUS_TIMING
+MmcHostModelTiming (
+  VOID
+  );
+
+/**
+  Return the time of the clock of the model in nanoseconds. Commands, data
+  transfers and delays of the driver advance it.
+
+**/
+UINT64
+MmcHostModelTime (
+  VOID
+  );
+
+/**
+  Return the TPL the driver runs at.
+
+**/
+EFI_TPL
+MmcHostModelTpl (
+  VOID
+  );
+
+/**
+  Let time pass at the TPL of the caller. The timer events that come due
+  are signaled on the ticks of the model, the notification functions run
+  as the TPL allows, in TPL order.
+
+  @param  Nanoseconds            How long to let time pass.
+
+**/
+VOID
+MmcHostModelRunTimers (
+  IN UINT64  Nanoseconds
+  );
+
+#endif
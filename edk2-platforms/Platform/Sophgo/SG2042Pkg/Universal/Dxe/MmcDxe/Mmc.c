@@ -8,6 +8,7 @@
 
 **/
 
+#include <Uefi.h>
 #include <Protocol/DevicePath.h>
 
 #include <Library/BaseLib.h>
@@ -43,6 +44,7 @@ LIST_ENTRY  mMmcHostPool;
 **/
 
 EFI_EVENT gCheckCardsEvent;
+EFI_EVENT mMmcExitBootServicesEvent;
 
 /**
   Initialize the MMC Host Pool to support multiple MMC devices
@@ -111,6 +113,9 @@ CreateMmcHostInstance (
 
   MmcHostInstance->State = MmcHwInitializationState;
 
+  MmcHostInstance->Timing     = MmcTimingLegacy;
+  MmcHostInstance->TimingMask = MAX_UINT32;
+
   MmcHostInstance->BlockIo.Media = AllocateCopyPool (sizeof (EFI_BLOCK_IO_MEDIA), &mMmcMediaTemplate);
   if (MmcHostInstance->BlockIo.Media == NULL) {
     goto FREE_INSTANCE;
@@ -122,17 +127,36 @@ CreateMmcHostInstance (
   MmcHostInstance->BlockIo.WriteBlocks = MmcWriteBlocks;
   MmcHostInstance->BlockIo.FlushBlocks = MmcFlushBlocks;
 
+  MmcHostInstance->BlockIo2.Media = MmcHostInstance->BlockIo.Media;
+  MmcHostInstance->BlockIo2.Reset = MmcResetEx;
+  MmcHostInstance->BlockIo2.ReadBlocksEx = MmcReadBlocksEx;
+  MmcHostInstance->BlockIo2.WriteBlocksEx = MmcWriteBlocksEx;
+  MmcHostInstance->BlockIo2.FlushBlocksEx = MmcFlushBlocksEx;
+
+  InitializeListHead (&MmcHostInstance->AsyncQueue);
+
+  Status = gBS->CreateEvent (
+                  EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                  TPL_CALLBACK,
+                  MmcAsyncRequestCallback,
+                  MmcHostInstance,
+                  &MmcHostInstance->AsyncEvent
+                );
+  if (EFI_ERROR (Status)) {
+    goto FREE_MEDIA;
+  }
+
   MmcHostInstance->MmcHost = MmcHost;
 
   // Create DevicePath for the new MMC Host
   Status = MmcHost->BuildDevicePath (MmcHost, &NewDevicePathNode);
   if (EFI_ERROR (Status)) {
-    goto FREE_MEDIA;
+    goto CLOSE_EVENT;
   }
 
   DevicePath = (EFI_DEVICE_PATH_PROTOCOL*)AllocatePool (END_DEVICE_PATH_LENGTH);
   if (DevicePath == NULL) {
-    goto FREE_MEDIA;
+    goto CLOSE_EVENT;
   }
 
   SetDevicePathEndNode (DevicePath);
@@ -142,6 +166,7 @@ CreateMmcHostInstance (
   Status = gBS->InstallMultipleProtocolInterfaces (
                   &MmcHostInstance->MmcHandle,
                   &gEfiBlockIoProtocolGuid, &MmcHostInstance->BlockIo,
+                  &gEfiBlockIo2ProtocolGuid, &MmcHostInstance->BlockIo2,
                   &gEfiDevicePathProtocolGuid, MmcHostInstance->DevicePath,
                   NULL
                 );
@@ -149,11 +174,16 @@ CreateMmcHostInstance (
     goto FREE_DEVICE_PATH;
   }
 
+  MmcCacheInit (MmcHostInstance);
+
   return MmcHostInstance;
 
 FREE_DEVICE_PATH:
   FreePool (DevicePath);
 
+CLOSE_EVENT:
+  gBS->CloseEvent (MmcHostInstance->AsyncEvent);
+
 FREE_MEDIA:
   FreePool (MmcHostInstance->BlockIo.Media);
 
@@ -180,10 +210,17 @@ DestroyMmcHostInstance (
 {
   EFI_STATUS Status;
 
+  // Complete whatever BlockIo2 consumers still wait for
+  MmcAbortAsyncRequests (MmcHostInstance);
+  MmcRemoveBootPartitions (MmcHostInstance);
+  gBS->CloseEvent (MmcHostInstance->AsyncEvent);
+  MmcCacheFree (MmcHostInstance);
+
   // Uninstall Protocol Interfaces
   Status = gBS->UninstallMultipleProtocolInterfaces (
                   MmcHostInstance->MmcHandle,
                   &gEfiBlockIoProtocolGuid, &(MmcHostInstance->BlockIo),
+                  &gEfiBlockIo2ProtocolGuid, &(MmcHostInstance->BlockIo2),
                   &gEfiDevicePathProtocolGuid, MmcHostInstance->DevicePath,
                   NULL
                 );
@@ -426,6 +463,10 @@ CheckCardsCallback (
       MmcHostInstance->Initialized = !MmcHostInstance->Initialized;
 
       if (MmcHostInstance->BlockIo.Media->MediaPresent) {
+        // A new card gets to try every bus timing again
+        MmcHostInstance->Timing     = MmcTimingLegacy;
+        MmcHostInstance->TimingMask = MAX_UINT32;
+
         Status = InitializeMmcDevice (MmcHostInstance);
         if (EFI_ERROR (Status)) {
           DEBUG ((DEBUG_ERROR, "CheckCardsCallback: Error InitializeMmcDevice, Status=%r.\n", Status));
@@ -444,6 +485,8 @@ CheckCardsCallback (
       if (EFI_ERROR (Status)) {
         Print (L"MMC Card: Error reinstalling BlockIo interface\n");
       }
+
+      MmcPublishBootPartitions (MmcHostInstance);
     }
 
     CurrentLink = CurrentLink->ForwardLink;
@@ -451,6 +494,31 @@ CheckCardsCallback (
 }
 
 
+/**
+  Report the throughput of each MMC host before the OS takes over.
+
+  @param[in] Event    The event that is being triggered
+  @param[in] Context  The context passed to the event
+
+**/
+STATIC
+VOID
+EFIAPI
+MmcExitBootServicesCallback (
+  IN  EFI_EVENT   Event,
+  IN  VOID        *Context
+  )
+{
+  LIST_ENTRY          *CurrentLink;
+
+  CurrentLink = mMmcHostPool.ForwardLink;
+  while (CurrentLink != NULL && CurrentLink != &mMmcHostPool) {
+    PrintThroughput (MMC_HOST_INSTANCE_FROM_LINK (CurrentLink));
+    PrintCacheStats (MMC_HOST_INSTANCE_FROM_LINK (CurrentLink));
+    CurrentLink = CurrentLink->ForwardLink;
+  }
+}
+
 EFI_DRIVER_BINDING_PROTOCOL gMmcDriverBinding = {
   MmcDriverBindingSupported,
   MmcDriverBindingStart,
@@ -523,5 +591,16 @@ MmcDxeInitialize (
                   (UINT64)(10 * 1000 * 200)); // 200 ms
   ASSERT_EFI_ERROR (Status);
 
+  DEBUG_CODE_BEGIN ();
+  Status = gBS->CreateEvent (
+                  EVT_SIGNAL_EXIT_BOOT_SERVICES,
+                  TPL_CALLBACK,
+                  MmcExitBootServicesCallback,
+                  NULL,
+                  &mMmcExitBootServicesEvent
+                );
+  ASSERT_EFI_ERROR (Status);
+  DEBUG_CODE_END ();
+
   return Status;
 }
@@ -13,8 +13,10 @@
 
 #include <Uefi.h>
 #include <Include/MmcHost.h>
+#include <Include/MmcCacheStats.h>
 #include <Protocol/DiskIo.h>
 #include <Protocol/BlockIo.h>
+#include <Protocol/BlockIo2.h>
 #include <Protocol/DevicePath.h>
 #include <Library/IoLib.h>
 #include <Library/UefiLib.h>
@@ -31,6 +33,24 @@
 
 #define MMC_IOBLOCKS_READ   0
 #define MMC_IOBLOCKS_WRITE  1
+#define MMC_IOBLOCKS_FLUSH  2   /* Only queued by FlushBlocksEx() */
+
+//
+// The async request worker moves at most this many bytes per run, so a
+// large request does not hold the boot CPU at TPL_CALLBACK in one go.
+//
+#define MMC_ASYNC_CHUNK_SIZE     SIZE_256KB
+#define MMC_ASYNC_POLL_INTERVAL  EFI_TIMER_PERIOD_MILLISECONDS (1)
+
+//
+// The block cache holds aligned runs of MMC_CACHE_LINE_SIZE bytes. Reads of
+// MMC_CACHE_BYPASS_SIZE bytes or more go straight to the device, they are
+// image loads that would only flush the FAT and GPT sectors out.
+//
+#define MMC_CACHE_LINE_SIZE      SIZE_32KB
+#define MMC_CACHE_BYPASS_SIZE    SIZE_128KB
+#define MMC_CACHE_HASH_BUCKETS   64
+#define MMC_CACHE_STREAM_MIN     2       // Sequential reads before read-ahead starts
 
 /* Value randomly chosen for eMMC RCA, it should be > 1 */
 #define MMC_FIX_RCA         6
@@ -41,6 +61,8 @@
 #define MMC_OCR_ACCESS_BYTE    0x1     /* bit[29] */
 #define MMC_OCR_ACCESS_SECTOR  0x2     /* bit[30] */
 #define OCR_HCS                BIT30
+#define OCR_S18R               BIT24   /* ACMD41 argument: switch to 1.8V requested */
+#define OCR_S18A               BIT24   /* ACMD41 response: switch to 1.8V accepted */
 #define OCR_BYTE_MODE          (0U << 29)
 #define OCR_SECTOR_MODE        (2U << 29)
 #define OCR_ACCESS_MODE_MASK   (3U << 29)
@@ -52,11 +74,24 @@
 #define MMC_FIX_RCA                  6
 #define RCA_SHIFT_OFFSET             16
 
+#define CMD_EXTCSD_BOOT_WP_STATUS    174
 #define CMD_EXTCSD_PARTITION_CONFIG  179
 #define CMD_EXTCSD_BUS_WIDTH         183
+#define CMD_EXTCSD_STROBE_SUPPORT    184
 #define CMD_EXTCSD_HS_TIMING         185
+#define CMD_EXTCSD_DEVICE_TYPE       196
 #define CMD_EXTCSD_PART_SWITCH_TIME  199
 #define CMD_EXTCSD_SEC_CNT           212
+#define CMD_EXTCSD_BOOT_SIZE_MULT    226
+
+#define EXTCSD_PART_ACCESS_MASK      0x7     /* PARTITION_CONFIG[2:0], 0 is the user area */
+#define EXTCSD_PART_ACCESS_BOOT1     1
+#define EXTCSD_BOOT_SIZE_UNIT        SIZE_128KB
+#define EXTCSD_BUS_WIDTH_STROBE      BIT7    /* enhanced strobe, with MMC_BUS_WIDTH_DDR_8 */
+#define EXTCSD_HS_TIMING_LEGACY      0
+#define EXTCSD_HS_TIMING_HS          1
+#define EXTCSD_HS_TIMING_HS200       2
+#define EXTCSD_HS_TIMING_HS400       3
 
 #define EXTCSD_SET_CMD               (0U << 24)
 #define EXTCSD_SET_BITS              (1U << 24)
@@ -102,12 +137,46 @@
 #define SD_HIGH_SPEED_SUPPORTED        0x200
 #define SD_DEFAULT_SPEED               25000000
 #define SD_HIGH_SPEED                  50000000
+#define SD_UHS_SDR50_SPEED             100000000
+#define SD_UHS_SDR104_SPEED            208000000
+#define EMMC_HS26_SPEED                26000000
+#define EMMC_HS52_SPEED                52000000
+#define EMMC_HS200_SPEED               200000000
 #define SWITCH_CMD_SUCCESS_MASK        0xf
+
+/* CMD6 SWITCH_FUNC, function group 1 is the access mode, the other groups are left unchanged */
+#define SD_SWITCH_MODE_CHECK           0x00FFFFF0U
+#define SD_SWITCH_MODE_SET             0x80FFFFF0U
+#define SD_SWITCH_KEEP_ACCESS_MODE     0xFU
+#define SD_SWITCH_ACCESS_MODE_SUPPORT(Status)  ((Status)[13])
+#define SD_SWITCH_ACCESS_MODE(Status)          ((Status)[16] & SWITCH_CMD_SUCCESS_MASK)
+
+#define SD_ACCESS_MODE_SDR12           0   /* default speed */
+#define SD_ACCESS_MODE_SDR25           1   /* high speed */
+#define SD_ACCESS_MODE_SDR50           2
+#define SD_ACCESS_MODE_SDR104          3
+#define SD_ACCESS_MODE_DDR50           4
+
+#define SD_CCC_SWITCH                  BIT10
 #define CMD8_CHECK_PATTERN             0xAAU
 #define VHS_2_7_3_6_V                  BIT8
 
+#define SD_SCR_SD_SPEC_MASK            0xF
 #define SD_SCR_BUS_WIDTH_1             BIT8
 #define SD_SCR_BUS_WIDTH_4             BIT10
+#define SD_SCR_CMD23_SUPPORT           BIT25   /* SCR bit 33, stored big-endian */
+
+//
+// CMD23 SET_BLOCK_COUNT carries the block count in argument bits [15:0]
+//
+#define MMC_CMD23_MAX_BLOCKS           0xFFFF
+
+#define MMC_TIMING_BIT(Timing)         (1U << (Timing))
+#define MMC_TIMING_UHS_MASK            (MMC_TIMING_BIT (MmcTimingUhsSdr12) | \
+                                        MMC_TIMING_BIT (MmcTimingUhsSdr25) | \
+                                        MMC_TIMING_BIT (MmcTimingUhsSdr50) | \
+                                        MMC_TIMING_BIT (MmcTimingUhsSdr104) | \
+                                        MMC_TIMING_BIT (MmcTimingUhsDdr50))
 
 typedef enum {
   UNKNOWN_CARD,
@@ -260,6 +329,82 @@ typedef struct {
   ECSD      *ECSDData;                         // MMC V2 extended card specific
 } CARD_INFO;
 
+//
+// Transfers done at one bus timing, in performance counter ticks.
+//
+typedef struct {
+  UINT64                    ReadBytes;
+  UINT64                    ReadTicks;
+  UINT64                    WriteBytes;
+  UINT64                    WriteTicks;
+  UINT32                    Errors;
+} MMC_TIMING_STATS;
+
+//
+// A BlockIo2 request waiting in the async queue of an MMC host instance.
+//
+typedef struct {
+  UINT32                    Signature;
+  LIST_ENTRY                Link;
+  EFI_BLOCK_IO2_TOKEN       *Token;
+  UINTN                     Transfer;                       // MMC_IOBLOCKS_READ, _WRITE or _FLUSH
+  UINT32                    MediaId;
+  EFI_LBA                   Lba;                            // Next block to transfer
+  UINTN                     BufferSize;                     // Bytes left to transfer
+  UINT8                     *Buffer;
+} MMC_ASYNC_REQUEST;
+
+#define MMC_ASYNC_REQUEST_SIGNATURE                 SIGNATURE_32('m', 'm', 'c', 'r')
+#define MMC_ASYNC_REQUEST_FROM_LINK(a)              CR (a, MMC_ASYNC_REQUEST, Link, MMC_ASYNC_REQUEST_SIGNATURE)
+
+//
+// One line of the block cache, a run of blocks starting at a line-aligned LBA.
+//
+typedef struct {
+  LIST_ENTRY                LruLink;                        // Most recently used first
+  LIST_ENTRY                HashLink;                       // Empty when the line holds no data
+  EFI_LBA                   Lba;
+  UINTN                     Blocks;                         // Valid blocks, fewer at the end of the media
+  UINT8                     *Data;
+  BOOLEAN                   ReadAhead;                      // Read ahead and not used yet
+} MMC_CACHE_LINE;
+
+typedef struct {
+  UINTN                     LineCount;                      // 0 when the cache is disabled
+  UINTN                     LineBlocks;
+  MMC_CACHE_LINE            *Lines;
+  UINT8                     *Data;
+  LIST_ENTRY                Lru;
+  LIST_ENTRY                Hash[MMC_CACHE_HASH_BUCKETS];
+
+  EFI_LBA                   StreamNextLba;                  // Where the current sequential stream goes on
+  UINTN                     StreamLength;                   // Sequential reads seen in a row
+  EFI_LBA                   ReadAheadLba;                   // Next block to read ahead
+  UINTN                     ReadAheadBlocks;                // Blocks left to read ahead
+  EFI_EVENT                 PrefetchEvent;                  // Timer deferring the read-ahead
+
+  MMC_CACHE_STATS           Stats;
+  MMC_CACHE_STATS_PROTOCOL  StatsProtocol;
+} MMC_CACHE;
+
+//
+// A boot partition of an eMMC device, published as a BlockIo of its own.
+// The user area stays selected outside of boot partition transfers.
+//
+typedef struct {
+  UINT32                    Signature;
+  EFI_HANDLE                Handle;
+  EFI_DEVICE_PATH_PROTOCOL  *DevicePath;
+  EFI_BLOCK_IO_PROTOCOL     BlockIo;
+  EFI_BLOCK_IO_MEDIA        Media;
+  UINT8                     Access;                         // PARTITION_ACCESS value that selects it
+  struct _MMC_HOST_INSTANCE *MmcHostInstance;
+} MMC_BOOT_PARTITION;
+
+#define MMC_BOOT_PARTITIONS                         2
+#define MMC_BOOT_PARTITION_SIGNATURE                SIGNATURE_32('m', 'm', 'c', 'b')
+#define MMC_BOOT_PARTITION_FROM_BLOCK_IO_THIS(a)    CR (a, MMC_BOOT_PARTITION, BlockIo, MMC_BOOT_PARTITION_SIGNATURE)
+
 typedef struct _MMC_HOST_INSTANCE {
   UINTN                     Signature;
   LIST_ENTRY                Link;
@@ -268,15 +413,33 @@ typedef struct _MMC_HOST_INSTANCE {
 
   MMC_STATE                 State;
   EFI_BLOCK_IO_PROTOCOL     BlockIo;
+  EFI_BLOCK_IO2_PROTOCOL    BlockIo2;
+  LIST_ENTRY                AsyncQueue;                     // MMC_ASYNC_REQUEST, in submission order
+  EFI_EVENT                 AsyncEvent;                     // Timer running the async request worker
   CARD_INFO                 CardInfo;
   EFI_MMC_HOST_PROTOCOL     *MmcHost;
 
   BOOLEAN                   Initialized;
+
+  MMC_BUS_TIMING            Timing;                         // Bus timing in use
+  UINT32                    TimingMask;                     // MMC_TIMING_BIT of the timings still allowed
+  UINT32                    HostCaps;                       // MMC_HOST_CAP_* of the MMC host
+  BOOLEAN                   SetBlockCount;                  // Card takes CMD23 ahead of multi-block transfers
+  MMC_TIMING_STATS          TimingStats[MmcTimingMax];
+
+  MMC_CACHE                 Cache;
+
+  UINT8                     PartitionConfig;                // EXT_CSD PARTITION_CONFIG as last written
+  UINT8                     BootWpStatus;                   // EXT_CSD BOOT_WP_STATUS
+  EFI_LBA                   BootPartitionBlocks;            // Size of each boot partition, 0 when there are none
+  MMC_BOOT_PARTITION        BootPartitions[MMC_BOOT_PARTITIONS];
 } MMC_HOST_INSTANCE;
 
 #define MMC_HOST_INSTANCE_SIGNATURE                 SIGNATURE_32('m', 'm', 'c', 'h')
 #define MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS(a)     CR (a, MMC_HOST_INSTANCE, BlockIo, MMC_HOST_INSTANCE_SIGNATURE)
+#define MMC_HOST_INSTANCE_FROM_BLOCK_IO2_THIS(a)    CR (a, MMC_HOST_INSTANCE, BlockIo2, MMC_HOST_INSTANCE_SIGNATURE)
 #define MMC_HOST_INSTANCE_FROM_LINK(a)              CR (a, MMC_HOST_INSTANCE, Link, MMC_HOST_INSTANCE_SIGNATURE)
+#define MMC_HOST_INSTANCE_FROM_CACHE_STATS(a)       CR (a, MMC_HOST_INSTANCE, Cache.StatsProtocol, MMC_HOST_INSTANCE_SIGNATURE)
 
 
 EFI_STATUS
@@ -304,6 +467,8 @@ extern EFI_DRIVER_DIAGNOSTICS2_PROTOCOL gMmcDriverDiagnostics2;
 
 extern LIST_ENTRY mMmcHostPool;
 
+extern EFI_BLOCK_IO_MEDIA mMmcMediaTemplate;
+
 /**
   Reset the block device.
 
@@ -411,6 +576,150 @@ MmcFlushBlocks (
   IN EFI_BLOCK_IO_PROTOCOL  *This
   );
 
+/**
+  Reset the block device and abort the queued requests.
+
+  This function implements EFI_BLOCK_IO2_PROTOCOL.Reset().
+
+  @param  This                   Indicates a pointer to the calling context.
+  @param  ExtendedVerification   Indicates that the driver may perform a more exhaustive
+                                 verification operation of the device during reset.
+
+  @retval EFI_SUCCESS            The block device was reset.
+  @retval EFI_DEVICE_ERROR       The block device is not functioning correctly and could not be reset.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcResetEx (
+  IN EFI_BLOCK_IO2_PROTOCOL   *This,
+  IN BOOLEAN                  ExtendedVerification
+  );
+
+/**
+  Reads the requested number of blocks from the device.
+
+  This function implements EFI_BLOCK_IO2_PROTOCOL.ReadBlocksEx().
+  If Token is NULL or Token->Event is NULL the read is blocking, otherwise
+  the request is queued and Token->Event is signaled once it completes.
+
+  @param  This                   Indicates a pointer to the calling context.
+  @param  MediaId                The media ID that the read request is for.
+  @param  Lba                    The starting logical block address to read from on the device.
+  @param  Token                  A pointer to the token associated with the transaction.
+  @param  BufferSize             The size of the Buffer in bytes.
+                                 This must be a multiple of the intrinsic block size of the device.
+  @param  Buffer                 A pointer to the destination buffer for the data.
+
+  @retval EFI_SUCCESS            The read request was queued if Token->Event is not NULL,
+                                 the data was read correctly from the device otherwise.
+  @retval EFI_DEVICE_ERROR       The device reported an error while attempting to perform the read operation.
+  @retval EFI_NO_MEDIA           There is no media in the device.
+  @retval EFI_MEDIA_CHANGED      The MediaId is not for the current media.
+  @retval EFI_BAD_BUFFER_SIZE    The BufferSize parameter is not a multiple of the intrinsic block size of the device.
+  @retval EFI_INVALID_PARAMETER  The read request contains LBAs that are not valid,
+                                 or the buffer is not on proper alignment.
+  @retval EFI_OUT_OF_RESOURCES   The request could not be queued due to a lack of resources.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcReadBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN     UINT32                  MediaId,
+  IN     EFI_LBA                 Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN     *Token,
+  IN     UINTN                   BufferSize,
+  OUT    VOID                    *Buffer
+  );
+
+/**
+  Writes a specified number of blocks to the device.
+
+  This function implements EFI_BLOCK_IO2_PROTOCOL.WriteBlocksEx().
+  If Token is NULL or Token->Event is NULL the write is blocking, otherwise
+  the request is queued and Token->Event is signaled once it completes.
+
+  @param  This                   Indicates a pointer to the calling context.
+  @param  MediaId                The media ID that the write request is for.
+  @param  Lba                    The starting logical block address to be written.
+  @param  Token                  A pointer to the token associated with the transaction.
+  @param  BufferSize             The size of the Buffer in bytes.
+                                 This must be a multiple of the intrinsic block size of the device.
+  @param  Buffer                 Pointer to the source buffer for the data.
+
+  @retval EFI_SUCCESS            The write request was queued if Token->Event is not NULL,
+                                 the data was written correctly to the device otherwise.
+  @retval EFI_WRITE_PROTECTED    The device cannot be written to.
+  @retval EFI_NO_MEDIA           There is no media in the device.
+  @retval EFI_MEDIA_CHANGED      The MediaId is not for the current media.
+  @retval EFI_DEVICE_ERROR       The device reported an error while attempting to perform the write operation.
+  @retval EFI_BAD_BUFFER_SIZE    The BufferSize parameter is not a multiple of the intrinsic
+                                 block size of the device.
+  @retval EFI_INVALID_PARAMETER  The write request contains LBAs that are not valid,
+                                 or the buffer is not on proper alignment.
+  @retval EFI_OUT_OF_RESOURCES   The request could not be queued due to a lack of resources.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcWriteBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN     UINT32                  MediaId,
+  IN     EFI_LBA                 Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN     *Token,
+  IN     UINTN                   BufferSize,
+  IN     VOID                    *Buffer
+  );
+
+/**
+  Flushes all modified data to a physical block device.
+
+  This function implements EFI_BLOCK_IO2_PROTOCOL.FlushBlocksEx().
+  The flush completes once every request queued before it has completed.
+
+  @param  This                   Indicates a pointer to the calling context.
+  @param  Token                  A pointer to the token associated with the transaction.
+
+  @retval EFI_SUCCESS            The flush request was queued if Token->Event is not NULL,
+                                 all outstanding data was written to the device otherwise.
+  @retval EFI_DEVICE_ERROR       The device reported an error while attempting to write data.
+  @retval EFI_NO_MEDIA           There is no media in the device.
+  @retval EFI_OUT_OF_RESOURCES   The request could not be queued due to a lack of resources.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcFlushBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN OUT EFI_BLOCK_IO2_TOKEN     *Token
+  );
+
+/**
+  Timer callback moving the queued BlockIo2 requests of an MMC host instance.
+
+  @param[in] Event    The event that is being triggered
+  @param[in] Context  The MMC_HOST_INSTANCE the event belongs to
+
+**/
+VOID
+EFIAPI
+MmcAsyncRequestCallback (
+  IN  EFI_EVENT   Event,
+  IN  VOID        *Context
+  );
+
+/**
+  Complete every queued BlockIo2 request of an MMC host instance with EFI_ABORTED.
+
+  @param[in] MmcHostInstance  MMC host instance.
+
+**/
+VOID
+MmcAbortAsyncRequests (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  );
+
 /**
   Sets the state of the MMC host instance and invokes the
   NotifyState function of the MMC host, passing the updated state.
@@ -441,6 +750,24 @@ InitializeMmcDevice (
   IN  MMC_HOST_INSTANCE     *MmcHost
   );
 
+/**
+  Drop the current bus timing after it produced transfer errors.
+
+  The timing is removed from the allowed timings and the card is identified
+  again, so it ends up in the fastest timing that is left.
+
+  @param[in] MmcHostInstance   MMC host instance
+
+  @retval EFI_SUCCESS          The card runs at a slower bus timing.
+  @retval EFI_UNSUPPORTED      The card already runs at the default timing.
+  @retval Other                MMC device initialization failed
+
+**/
+EFI_STATUS
+MmcDowngradeBusTiming (
+  IN  MMC_HOST_INSTANCE     *MmcHostInstance
+  );
+
 /**
   Callback function to check MMC cards.
 
@@ -510,4 +837,218 @@ PrintCID (
   IN UINT32* Cid
   );
 
+/**
+  Account a block transfer to the bus timing in use.
+
+  @param[in] MmcHostInstance  MMC host instance.
+  @param[in] Transfer         MMC_IOBLOCKS_READ or MMC_IOBLOCKS_WRITE.
+  @param[in] Bytes            Number of bytes transferred, 0 if the transfer failed.
+  @param[in] StartTick        Performance counter value when the transfer started.
+
+**/
+VOID
+MmcAccountTransfer (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance,
+  IN UINTN              Transfer,
+  IN UINTN              Bytes,
+  IN UINT64             StartTick
+  );
+
+/**
+  Print the read and write throughput seen at each bus timing.
+
+  @param[in] MmcHostInstance  MMC host instance.
+
+**/
+VOID
+PrintThroughput (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  );
+
+/**
+  Perform read or write operations on the MMC device.
+
+  @param[in]     This                    Pointer to the EFI_BLOCK_IO_PROTOCOL instance.
+  @param[in]     Transfer                Transfer type (MMC_IOBLOCKS_READ or MMC_IOBLOCKS_WRITE).
+  @param[in]     MediaId                 Media ID of the MMC device.
+  @param[in]     Lba                     Logical Block Address.
+  @param[in]     BufferSize              Size of the data buffer.
+  @param[out]    Buffer                  Pointer to the data buffer.
+
+  @retval EFI_SUCCESS                    The operation completed successfully.
+  @retval Other                          The parameters are invalid or the data transfer failed.
+
+**/
+EFI_STATUS
+MmcIoBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL    *This,
+  IN UINTN                    Transfer,
+  IN UINT32                   MediaId,
+  IN EFI_LBA                  Lba,
+  IN UINTN                    BufferSize,
+  OUT VOID                    *Buffer
+  );
+
+/**
+  Set up the block cache of an MMC host instance and publish its statistics.
+
+  Does nothing if PcdSG2042MmcCacheSize is 0 or the memory is not available,
+  the instance then works uncached.
+
+  @param[in] MmcHostInstance  MMC host instance, with its handle installed.
+
+**/
+VOID
+MmcCacheInit (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  );
+
+/**
+  Tear down the block cache of an MMC host instance.
+
+  @param[in] MmcHostInstance  MMC host instance.
+
+**/
+VOID
+MmcCacheFree (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  );
+
+/**
+  Drop every cached block, for a new card or a re-identified one.
+
+  @param[in] MmcHostInstance  MMC host instance.
+
+**/
+VOID
+MmcCacheInvalidate (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  );
+
+/**
+  Read blocks through the block cache.
+
+  The request must have been checked against the media already.
+  Must be called at TPL_CALLBACK.
+
+  @param[in]     MmcHostInstance         MMC host instance.
+  @param[in]     MediaId                 Media ID of the MMC device.
+  @param[in]     Lba                     Logical Block Address.
+  @param[in]     BufferSize              Size of the data buffer.
+  @param[out]    Buffer                  Pointer to the data buffer.
+
+  @retval EFI_SUCCESS                    The data was read.
+  @retval Other                          The data transfer failed.
+
+**/
+EFI_STATUS
+MmcCacheRead (
+  IN  MMC_HOST_INSTANCE   *MmcHostInstance,
+  IN  UINT32              MediaId,
+  IN  EFI_LBA             Lba,
+  IN  UINTN               BufferSize,
+  OUT VOID                *Buffer
+  );
+
+/**
+  Write blocks to the device and keep the block cache in sync.
+
+  The request must have been checked against the media already.
+  Must be called at TPL_CALLBACK.
+
+  @param[in]     MmcHostInstance         MMC host instance.
+  @param[in]     MediaId                 Media ID of the MMC device.
+  @param[in]     Lba                     Logical Block Address.
+  @param[in]     BufferSize              Size of the data buffer.
+  @param[in]     Buffer                  Pointer to the data buffer.
+
+  @retval EFI_SUCCESS                    The data was written.
+  @retval Other                          The data transfer failed.
+
+**/
+EFI_STATUS
+MmcCacheWrite (
+  IN MMC_HOST_INSTANCE    *MmcHostInstance,
+  IN UINT32               MediaId,
+  IN EFI_LBA              Lba,
+  IN UINTN                BufferSize,
+  IN VOID                 *Buffer
+  );
+
+/**
+  Print the counters of the block cache.
+
+  @param[in] MmcHostInstance  MMC host instance.
+
+**/
+VOID
+PrintCacheStats (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  );
+
+/**
+  Check the parameters of a read or write request against a media.
+
+  @param[in]     MmcHostInstance         Pointer to the MMC host instance.
+  @param[in]     Media                   The media the request is for.
+  @param[in]     Transfer                Transfer type (MMC_IOBLOCKS_READ or MMC_IOBLOCKS_WRITE).
+  @param[in]     MediaId                 Media ID of the MMC device.
+  @param[in]     Lba                     Logical Block Address.
+  @param[in]     BufferSize              Size of the data buffer.
+  @param[in]     Buffer                  Pointer to the data buffer.
+
+  @retval EFI_SUCCESS                    The request can be carried out.
+  @retval Other                          The request is not valid for the media.
+
+**/
+EFI_STATUS
+MmcCheckIoParameters (
+  IN MMC_HOST_INSTANCE        *MmcHostInstance,
+  IN EFI_BLOCK_IO_MEDIA       *Media,
+  IN UINTN                    Transfer,
+  IN UINT32                   MediaId,
+  IN EFI_LBA                  Lba,
+  IN UINTN                    BufferSize,
+  IN VOID                     *Buffer
+  );
+
+/**
+  Select the eMMC hardware partition the following transfers go to.
+
+  @param[in] MmcHostInstance   MMC host instance
+  @param[in] Access            PARTITION_ACCESS value, 0 for the user area
+
+  @retval EFI_SUCCESS          The partition is selected.
+  @retval Other                The card refused the switch.
+
+**/
+EFI_STATUS
+MmcSwitchPartition (
+  IN  MMC_HOST_INSTANCE     *MmcHostInstance,
+  IN  UINT8                 Access
+  );
+
+/**
+  Publish the boot partitions of the eMMC device, or withdraw their media
+  when the device is gone.
+
+  @param[in] MmcHostInstance   MMC host instance
+
+**/
+VOID
+MmcPublishBootPartitions (
+  IN  MMC_HOST_INSTANCE     *MmcHostInstance
+  );
+
+/**
+  Uninstall the boot partition handles of an MMC host instance.
+
+  @param[in] MmcHostInstance   MMC host instance
+
+**/
+VOID
+MmcRemoveBootPartitions (
+  IN  MMC_HOST_INSTANCE     *MmcHostInstance
+  );
+
 #endif
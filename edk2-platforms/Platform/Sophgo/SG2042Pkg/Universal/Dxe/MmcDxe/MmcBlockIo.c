@@ -8,13 +8,13 @@
 **/
 
 #include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/TimerLib.h>
 
 #include "Mmc.h"
 
 #define MMCI0_BLOCKLEN 512
 #define MMCI0_TIMEOUT  1000
-#define MAX_BUF_LEN    0x1D00000
-#define MAX_BLK_CNT    0xE800
 
 /**
   Check if the R1 response indicates that the card is in the "Tran" state and ready for data.
@@ -59,7 +59,8 @@ ValidateWrittenBlockCount (
   )
 {
   UINT32                 R1;
-  UINT8                  Data[4];
+  UINT32                 NumWrBlocks;
+  UINT8                  *Data;
   EFI_STATUS             Status;
   UINT32                 BlocksWritten;
   EFI_MMC_HOST_PROTOCOL  *MmcHost;
@@ -83,6 +84,14 @@ ValidateWrittenBlockCount (
     return Status;
   }
 
+  // ACMD22 returns the number of written blocks in a 4-byte data block
+  Data   = (UINT8 *)&NumWrBlocks;
+  Status = MmcHost->Prepare (MmcHost, 0, sizeof (NumWrBlocks), (UINTN)Data);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a(%u): error: %r\n", __FUNCTION__, __LINE__, Status));
+    return Status;
+  }
+
   Status = MmcHost->SendCommand (MmcHost, MMC_ACMD22, 0, MMC_RESPONSE_R1, &R1);
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR, "%a(%u): error: %r\n",
@@ -96,7 +105,7 @@ ValidateWrittenBlockCount (
   }
 
   // Read Data
-  Status = MmcHost->ReadBlockData (MmcHost, 0, sizeof (Data),
+  Status = MmcHost->ReadBlockData (MmcHost, 0, sizeof (NumWrBlocks),
                       (VOID*)Data);
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR, "%a(%u): error: %r\n", __FUNCTION__, __LINE__, Status));
@@ -168,7 +177,8 @@ WaitUntilTran (
     gBS->Stall(1000);
   }
 
-  if (0 == Timeout) {
+  // The loop leaves Timeout at -1 when the card never got ready
+  if (Timeout < 0) {
     DEBUG ((DEBUG_ERROR, "%a(%u) card is busy\n", __FUNCTION__, __LINE__));
     return EFI_NOT_READY;
   }
@@ -300,6 +310,10 @@ MmcStopTransmission (
   @param[out]    Buffer            Pointer to the data buffer.
   @param[out]    TransferredSize   Number of bytes transferred.
 
+  A multi-block transfer is announced with CMD23 when the card supports it,
+  so the card returns to the "Tran" state by itself after the last block
+  and no CMD12 is needed.
+
   @retval EFI_SUCCESS              The data transfer was successful.
   @retval EFI_NOT_READY            The MMC device is not ready for the transfer.
   @retval EFI_DEVICE_ERROR         An error occurred during the data transfer.
@@ -323,6 +337,8 @@ MmcTransferBlock (
   MMC_HOST_INSTANCE       *MmcHostInstance;
   EFI_MMC_HOST_PROTOCOL   *MmcHost;
   UINTN                   CmdArg;
+  UINTN                   BlockCount;
+  BOOLEAN                 PreDefined;
 
   MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This);
   MmcHost         = MmcHostInstance->MmcHost;
@@ -334,6 +350,22 @@ MmcTransferBlock (
     CmdArg = Lba * This->Media->BlockSize;
   }
 
+  BlockCount = BufferSize / This->Media->BlockSize;
+  PreDefined = (BlockCount > 1) && MmcHostInstance->SetBlockCount;
+  if (PreDefined) {
+    ASSERT (BlockCount <= MMC_CMD23_MAX_BLOCKS);
+    if ((MmcHostInstance->HostCaps & MMC_HOST_CAP_AUTO_CMD23) != 0U) {
+      Cmd |= MMC_CMD_AUTO_CMD23;
+    } else {
+      // CMD23: SET_BLOCK_COUNT
+      Status = MmcHost->SendCommand (MmcHost, MMC_CMD23, BlockCount, MMC_RESPONSE_R1, NULL);
+      if (EFI_ERROR (Status)) {
+        DEBUG ((DEBUG_ERROR, "%a(MMC_CMD23): Error %r\n", __func__, Status));
+        return Status;
+      }
+    }
+  }
+
   Status = MmcHost->SendCommand (MmcHost, Cmd, CmdArg, MMC_RESPONSE_R1, NULL);
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR, "%a(MMC_CMD%d): Error %r\n", __func__, MMC_INDX (Cmd), Status));
@@ -354,10 +386,10 @@ MmcTransferBlock (
   }
 
   if (EFI_ERROR (Status) ||
-      BufferSize > This->Media->BlockSize) {
+      ((BufferSize > This->Media->BlockSize) && !PreDefined)) {
     /*
-     * CMD12 needs to be set for multiblock (to transition from
-     * RECV to PROG) or for errors.
+     * CMD12 needs to be set for open-ended multiblock (to transition
+     * from RECV to PROG) or for errors.
      */
     EFI_STATUS Status2 = MmcStopTransmission (MmcHost);
     if (EFI_ERROR (Status2)) {
@@ -372,17 +404,20 @@ MmcTransferBlock (
       return Status;
     }
 
-    ASSERT (Cmd == MMC_CMD25 || Cmd == MMC_CMD18);
+    ASSERT (MMC_GET_INDX (Cmd) == MMC_CMD25 || MMC_GET_INDX (Cmd) == MMC_CMD18);
   }
 
   //
   // For reads, should be already in TRAN. For writes, wait
-  // until programming finishes.
+  // until programming finishes. A pre-defined read leaves the card
+  // in TRAN after the last block, the next command finds it there.
   //
-  Status = WaitUntilTran (MmcHostInstance);
-  if (EFI_ERROR (Status)) {
-    DEBUG ((DEBUG_ERROR, "WaitUntilTran after write failed\n"));
-    return Status;
+  if ((Transfer != MMC_IOBLOCKS_READ) || !PreDefined) {
+    Status = WaitUntilTran (MmcHostInstance);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "WaitUntilTran after write failed\n"));
+      return Status;
+    }
   }
 
   Status = MmcNotifyState (MmcHostInstance, MmcTransferState);
@@ -406,6 +441,76 @@ MmcTransferBlock (
   return Status;
 }
 
+/**
+  Check the parameters of a read or write request against a media.
+
+  @param[in]     MmcHostInstance         Pointer to the MMC host instance.
+  @param[in]     Media                   The media the request is for.
+  @param[in]     Transfer                Transfer type (MMC_IOBLOCKS_READ or MMC_IOBLOCKS_WRITE).
+  @param[in]     MediaId                 Media ID of the MMC device.
+  @param[in]     Lba                     Logical Block Address.
+  @param[in]     BufferSize              Size of the data buffer.
+  @param[in]     Buffer                  Pointer to the data buffer.
+
+  @retval EFI_SUCCESS                    The request can be carried out.
+  @retval EFI_MEDIA_CHANGED              The MediaId is not the current media.
+  @retval EFI_INVALID_PARAMETER          Invalid parameter passed to the function.
+  @retval EFI_NO_MEDIA                   There is no media present in the MMC device.
+  @retval EFI_WRITE_PROTECTED            The MMC device is write-protected.
+  @retval EFI_BAD_BUFFER_SIZE            The buffer size is not an exact multiple of the block size.
+
+**/
+EFI_STATUS
+MmcCheckIoParameters (
+  IN MMC_HOST_INSTANCE        *MmcHostInstance,
+  IN EFI_BLOCK_IO_MEDIA       *Media,
+  IN UINTN                    Transfer,
+  IN UINT32                   MediaId,
+  IN EFI_LBA                  Lba,
+  IN UINTN                    BufferSize,
+  IN VOID                     *Buffer
+  )
+{
+  if (Media->MediaId != MediaId) {
+    return EFI_MEDIA_CHANGED;
+  }
+
+  if ((MmcHostInstance->MmcHost == NULL) || (Buffer == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  // Check if a Card is Present
+  if (!Media->MediaPresent) {
+    return EFI_NO_MEDIA;
+  }
+
+  // All blocks must be within the device
+  if ((Lba + (BufferSize / Media->BlockSize)) > (Media->LastBlock + 1)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if ((Transfer == MMC_IOBLOCKS_WRITE) && (Media->ReadOnly == TRUE)) {
+    return EFI_WRITE_PROTECTED;
+  }
+
+  // Reading 0 Byte is valid
+  if (BufferSize == 0) {
+    return EFI_SUCCESS;
+  }
+
+  // The buffer size must be an exact multiple of the block size
+  if ((BufferSize % Media->BlockSize) != 0) {
+    return EFI_BAD_BUFFER_SIZE;
+  }
+
+  // Check the alignment
+  if ((Media->IoAlign > 2) && (((UINTN)Buffer & (Media->IoAlign - 1)) != 0)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  return EFI_SUCCESS;
+}
+
 /**
   Perform read or write operations on the MMC device.
 
@@ -441,7 +546,9 @@ MmcIoBlocks (
   EFI_MMC_HOST_PROTOCOL   *MmcHost;
   UINTN                   BytesRemainingToBeTransfered;
   UINTN                   BlockCount;
+  UINTN                   MaxBlockCount;
   UINTN                   ConsumeSize;
+  UINT64                  StartTick;
 
   BlockCount      = 1;
   MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This);
@@ -450,17 +557,9 @@ MmcIoBlocks (
   MmcHost = MmcHostInstance->MmcHost;
   ASSERT (MmcHost);
 
-  if (This->Media->MediaId != MediaId) {
-    return EFI_MEDIA_CHANGED;
-  }
-
-  if ((MmcHost == NULL) || (Buffer == NULL)) {
-    return EFI_INVALID_PARAMETER;
-  }
-
-  // Check if a Card is Present
-  if (!MmcHostInstance->BlockIo.Media->MediaPresent) {
-    return EFI_NO_MEDIA;
+  Status = MmcCheckIoParameters (MmcHostInstance, This->Media, Transfer, MediaId, Lba, BufferSize, Buffer);
+  if (EFI_ERROR (Status) || (BufferSize == 0)) {
+    return Status;
   }
 
   if (MMC_HOST_HAS_ISMULTIBLOCK (MmcHost) &&
@@ -468,28 +567,15 @@ MmcIoBlocks (
     BlockCount = (BufferSize + This->Media->BlockSize - 1) / This->Media->BlockSize;
   }
 
-  // All blocks must be within the device
-  if ((Lba + (BufferSize / This->Media->BlockSize)) > (This->Media->LastBlock + 1)) {
-    return EFI_INVALID_PARAMETER;
-  }
-
-  if ((Transfer == MMC_IOBLOCKS_WRITE) && (This->Media->ReadOnly == TRUE)) {
-    return EFI_WRITE_PROTECTED;
-  }
-
-  // Reading 0 Byte is valid
-  if (BufferSize == 0) {
-    return EFI_SUCCESS;
-  }
-
-  // The buffer size must be an exact multiple of the block size
-  if ((BufferSize % This->Media->BlockSize) != 0) {
-    return EFI_BAD_BUFFER_SIZE;
-  }
-
-  // Check the alignment
-  if ((This->Media->IoAlign > 2) && (((UINTN)Buffer & (This->Media->IoAlign - 1)) != 0)) {
-    return EFI_INVALID_PARAMETER;
+  //
+  // A transfer is bounded by the CMD23 argument, or by the block count
+  // register of the host for open-ended transfers.
+  //
+  if (MmcHostInstance->SetBlockCount ||
+      ((MmcHostInstance->HostCaps & MMC_HOST_CAP_BLKCNT_32BIT) == 0U)) {
+    MaxBlockCount = MMC_CMD23_MAX_BLOCKS;
+  } else {
+    MaxBlockCount = MAX_UINT32;
   }
 
   BytesRemainingToBeTransfered = BufferSize;
@@ -500,6 +586,14 @@ MmcIoBlocks (
       return Status;
     }
 
+    ConsumeSize = BlockCount * This->Media->BlockSize;
+    if (BytesRemainingToBeTransfered < ConsumeSize) {
+      ConsumeSize = BytesRemainingToBeTransfered;
+    }
+
+    BlockCount  = MIN (ConsumeSize / This->Media->BlockSize, MaxBlockCount);
+    ConsumeSize = BlockCount * This->Media->BlockSize;
+
     if (Transfer == MMC_IOBLOCKS_READ) {
       if (BlockCount == 1) {
         // Read a single block
@@ -518,29 +612,33 @@ MmcIoBlocks (
       }
     }
 
-    ConsumeSize = BlockCount * This->Media->BlockSize;
-    if (BytesRemainingToBeTransfered < ConsumeSize) {
-      ConsumeSize = BytesRemainingToBeTransfered;
-    }
+    StartTick = GetPerformanceCounter ();
 
-    if (ConsumeSize > MAX_BUF_LEN) {
-      ConsumeSize = MAX_BUF_LEN;
-      BlockCount  = MAX_BLK_CNT;
-    } else {
-      BlockCount = ConsumeSize / This->Media->BlockSize;
+    Status = MmcHost->Prepare (MmcHost, Lba, ConsumeSize, (UINTN)Buffer);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "%a(%u): error: %r\n", __FUNCTION__, __LINE__, Status));
+      return Status;
     }
 
-    MmcHost->Prepare (MmcHost, Lba, ConsumeSize, (UINTN)Buffer);
-
     Status = MmcTransferBlock (This, Cmd, Transfer, MediaId, Lba, ConsumeSize, Buffer, &ConsumeSize);
     if (EFI_ERROR (Status)) {
       DEBUG ((DEBUG_ERROR, "%a(): Failed to transfer block and Status:%r\n", __func__, Status));
+      MmcAccountTransfer (MmcHostInstance, Transfer, 0, StartTick);
+
+      // CRC and timeout errors are the sign of a bus timing the card or the board can't keep up with
+      if (((Status == EFI_DEVICE_ERROR) || (Status == EFI_TIMEOUT)) &&
+          !EFI_ERROR (MmcDowngradeBusTiming (MmcHostInstance))) {
+        continue;
+      }
+
       return Status;
     }
 
+    MmcAccountTransfer (MmcHostInstance, Transfer, ConsumeSize, StartTick);
+
     BytesRemainingToBeTransfered -= ConsumeSize;
     if (BytesRemainingToBeTransfered > 0) {
-      Lba += BlockCount;
+      Lba += ConsumeSize / This->Media->BlockSize;
       Buffer = (UINT8*)Buffer + ConsumeSize;
     }
   }
@@ -548,6 +646,51 @@ MmcIoBlocks (
   return EFI_SUCCESS;
 }
 
+/**
+  Perform read or write operations through the block cache of the MMC device.
+
+  Must be called at TPL_CALLBACK.
+
+  @param[in]     This                    Pointer to the EFI_BLOCK_IO_PROTOCOL instance.
+  @param[in]     Transfer                Transfer type (MMC_IOBLOCKS_READ or MMC_IOBLOCKS_WRITE).
+  @param[in]     MediaId                 Media ID of the MMC device.
+  @param[in]     Lba                     Logical Block Address.
+  @param[in]     BufferSize              Size of the data buffer.
+  @param[out]    Buffer                  Pointer to the data buffer.
+
+  @retval EFI_SUCCESS                    The operation completed successfully.
+  @retval Other                          The parameters are invalid or the data transfer failed.
+
+**/
+STATIC
+EFI_STATUS
+MmcCachedIoBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL    *This,
+  IN UINTN                    Transfer,
+  IN UINT32                   MediaId,
+  IN EFI_LBA                  Lba,
+  IN UINTN                    BufferSize,
+  OUT VOID                    *Buffer
+  )
+{
+  EFI_STATUS              Status;
+  MMC_HOST_INSTANCE       *MmcHostInstance;
+
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO_THIS (This);
+
+  // Validate up front so that requests served from the cache fail the same way
+  Status = MmcCheckIoParameters (MmcHostInstance, This->Media, Transfer, MediaId, Lba, BufferSize, Buffer);
+  if (EFI_ERROR (Status) || (BufferSize == 0)) {
+    return Status;
+  }
+
+  if (Transfer == MMC_IOBLOCKS_READ) {
+    return MmcCacheRead (MmcHostInstance, MediaId, Lba, BufferSize, Buffer);
+  }
+
+  return MmcCacheWrite (MmcHostInstance, MediaId, Lba, BufferSize, Buffer);
+}
+
 /**
   Reads the requested number of blocks from the device.
 
@@ -582,7 +725,15 @@ MmcReadBlocks (
   OUT VOID                    *Buffer
   )
 {
-  return MmcIoBlocks (This, MMC_IOBLOCKS_READ, MediaId, Lba, BufferSize, Buffer);
+  EFI_STATUS  Status;
+  EFI_TPL     OldTpl;
+
+  // Keep the async request worker off the bus
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  Status = MmcCachedIoBlocks (This, MMC_IOBLOCKS_READ, MediaId, Lba, BufferSize, Buffer);
+  gBS->RestoreTPL (OldTpl);
+
+  return Status;
 }
 
 /**
@@ -620,7 +771,15 @@ MmcWriteBlocks (
   IN VOID                     *Buffer
   )
 {
-  return MmcIoBlocks (This, MMC_IOBLOCKS_WRITE, MediaId, Lba, BufferSize, Buffer);
+  EFI_STATUS  Status;
+  EFI_TPL     OldTpl;
+
+  // Keep the async request worker off the bus
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  Status = MmcCachedIoBlocks (This, MMC_IOBLOCKS_WRITE, MediaId, Lba, BufferSize, Buffer);
+  gBS->RestoreTPL (OldTpl);
+
+  return Status;
 }
 
 /**
@@ -641,3 +800,380 @@ MmcFlushBlocks (
 {
   return EFI_SUCCESS;
 }
+
+/**
+  Complete a queued BlockIo2 request and release it.
+
+  @param[in] Request  The request, already removed from the queue.
+  @param[in] Status   The transaction status to report.
+
+**/
+STATIC
+VOID
+MmcCompleteAsyncRequest (
+  IN MMC_ASYNC_REQUEST  *Request,
+  IN EFI_STATUS         Status
+  )
+{
+  Request->Token->TransactionStatus = Status;
+  gBS->SignalEvent (Request->Token->Event);
+  FreePool (Request);
+}
+
+/**
+  Timer callback moving the queued BlockIo2 requests of an MMC host instance.
+
+  Requests are served in submission order. A run moves at most one chunk of
+  MMC_ASYNC_CHUNK_SIZE bytes, so the boot CPU gets back to the BlockIo2
+  consumers between chunks. Flush requests complete as soon as they reach
+  the head of the queue, since every write queued before them is done.
+
+  @param[in] Event    The event that is being triggered
+  @param[in] Context  The MMC_HOST_INSTANCE the event belongs to
+
+**/
+VOID
+EFIAPI
+MmcAsyncRequestCallback (
+  IN  EFI_EVENT   Event,
+  IN  VOID        *Context
+  )
+{
+  MMC_HOST_INSTANCE   *MmcHostInstance;
+  MMC_ASYNC_REQUEST   *Request;
+  EFI_STATUS          Status;
+  UINTN               ChunkSize;
+  BOOLEAN             Moved;
+
+  MmcHostInstance = (MMC_HOST_INSTANCE *)Context;
+  Moved           = FALSE;
+
+  while (!IsListEmpty (&MmcHostInstance->AsyncQueue)) {
+    Request = MMC_ASYNC_REQUEST_FROM_LINK (GetFirstNode (&MmcHostInstance->AsyncQueue));
+
+    Status = EFI_SUCCESS;
+    if ((Request->Transfer != MMC_IOBLOCKS_FLUSH) && (Request->BufferSize > 0)) {
+      if (Moved) {
+        break;
+      }
+
+      ChunkSize = MIN (Request->BufferSize, MMC_ASYNC_CHUNK_SIZE);
+      Status    = MmcCachedIoBlocks (&MmcHostInstance->BlockIo, Request->Transfer, Request->MediaId,
+                    Request->Lba, ChunkSize, Request->Buffer);
+      Moved     = TRUE;
+
+      if (!EFI_ERROR (Status)) {
+        Request->Lba        += ChunkSize / MmcHostInstance->BlockIo.Media->BlockSize;
+        Request->Buffer     += ChunkSize;
+        Request->BufferSize -= ChunkSize;
+        if (Request->BufferSize > 0) {
+          continue;
+        }
+      }
+    }
+
+    RemoveEntryList (&Request->Link);
+    MmcCompleteAsyncRequest (Request, Status);
+  }
+
+  if (IsListEmpty (&MmcHostInstance->AsyncQueue)) {
+    gBS->SetTimer (MmcHostInstance->AsyncEvent, TimerCancel, 0);
+  }
+}
+
+/**
+  Complete every queued BlockIo2 request of an MMC host instance with EFI_ABORTED.
+
+  @param[in] MmcHostInstance  MMC host instance.
+
+**/
+VOID
+MmcAbortAsyncRequests (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  )
+{
+  MMC_ASYNC_REQUEST   *Request;
+  EFI_TPL             OldTpl;
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  while (!IsListEmpty (&MmcHostInstance->AsyncQueue)) {
+    Request = MMC_ASYNC_REQUEST_FROM_LINK (GetFirstNode (&MmcHostInstance->AsyncQueue));
+    RemoveEntryList (&Request->Link);
+    MmcCompleteAsyncRequest (Request, EFI_ABORTED);
+  }
+
+  gBS->SetTimer (MmcHostInstance->AsyncEvent, TimerCancel, 0);
+
+  gBS->RestoreTPL (OldTpl);
+}
+
+/**
+  Run the queued BlockIo2 requests of an MMC host instance to completion.
+
+  Must be called at TPL_CALLBACK.
+
+  @param[in] MmcHostInstance  MMC host instance.
+
+**/
+STATIC
+VOID
+MmcDrainAsyncRequests (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  )
+{
+  while (!IsListEmpty (&MmcHostInstance->AsyncQueue)) {
+    MmcAsyncRequestCallback (MmcHostInstance->AsyncEvent, MmcHostInstance);
+  }
+}
+
+/**
+  Carry out a BlockIo2 request, either right away or through the async queue.
+
+  The async queue is worked by a TPL_CALLBACK timer. A caller already at
+  TPL_CALLBACK or above keeps that timer from running until it returns, so
+  waiting there for a queued request never ends. Its requests complete
+  before this function returns instead, after the ones queued ahead of them,
+  and the token is signaled as for a queued request.
+
+  @param[in]     MmcHostInstance         MMC host instance.
+  @param[in]     Transfer                MMC_IOBLOCKS_READ, MMC_IOBLOCKS_WRITE or MMC_IOBLOCKS_FLUSH.
+  @param[in]     MediaId                 Media ID of the MMC device.
+  @param[in]     Lba                     Logical Block Address.
+  @param[in,out] Token                   The BlockIo2 token, NULL or with a NULL event for a blocking request.
+  @param[in]     BufferSize              Size of the data buffer.
+  @param[in]     Buffer                  Pointer to the data buffer.
+
+  @retval EFI_SUCCESS                    The request was queued or completed successfully.
+  @retval EFI_OUT_OF_RESOURCES           The request could not be queued.
+  @retval Other                          The parameters are invalid, or the blocking request failed.
+
+**/
+STATIC
+EFI_STATUS
+MmcSubmitRequest (
+  IN     MMC_HOST_INSTANCE    *MmcHostInstance,
+  IN     UINTN                Transfer,
+  IN     UINT32               MediaId,
+  IN     EFI_LBA              Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN  *Token,
+  IN     UINTN                BufferSize,
+  IN     VOID                 *Buffer
+  )
+{
+  EFI_STATUS          Status;
+  EFI_TPL             OldTpl;
+  MMC_ASYNC_REQUEST   *Request;
+
+  if (Transfer == MMC_IOBLOCKS_FLUSH) {
+    Status = MmcHostInstance->BlockIo.Media->MediaPresent ? EFI_SUCCESS : EFI_NO_MEDIA;
+  } else {
+    Status = MmcCheckIoParameters (MmcHostInstance, MmcHostInstance->BlockIo.Media, Transfer, MediaId, Lba, BufferSize, Buffer);
+  }
+
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  if ((Token == NULL) || (Token->Event == NULL) || (OldTpl >= TPL_CALLBACK)) {
+    // A request carried out right away still sees the queued ones complete first
+    MmcDrainAsyncRequests (MmcHostInstance);
+    if (Transfer != MMC_IOBLOCKS_FLUSH) {
+      Status = MmcCachedIoBlocks (&MmcHostInstance->BlockIo, Transfer, MediaId, Lba, BufferSize, Buffer);
+    }
+
+    if (Token != NULL) {
+      Token->TransactionStatus = Status;
+      if (Token->Event != NULL) {
+        gBS->SignalEvent (Token->Event);
+        Status = EFI_SUCCESS;
+      }
+    }
+
+    gBS->RestoreTPL (OldTpl);
+
+    return Status;
+  }
+
+  Request = AllocatePool (sizeof (MMC_ASYNC_REQUEST));
+  if (Request == NULL) {
+    gBS->RestoreTPL (OldTpl);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Request->Signature  = MMC_ASYNC_REQUEST_SIGNATURE;
+  Request->Token      = Token;
+  Request->Transfer   = Transfer;
+  Request->MediaId    = MediaId;
+  Request->Lba        = Lba;
+  Request->BufferSize = BufferSize;
+  Request->Buffer     = Buffer;
+
+  Token->TransactionStatus = EFI_NOT_READY;
+
+  if (IsListEmpty (&MmcHostInstance->AsyncQueue)) {
+    Status = gBS->SetTimer (MmcHostInstance->AsyncEvent, TimerPeriodic, MMC_ASYNC_POLL_INTERVAL);
+  }
+
+  if (!EFI_ERROR (Status)) {
+    InsertTailList (&MmcHostInstance->AsyncQueue, &Request->Link);
+  }
+
+  gBS->RestoreTPL (OldTpl);
+
+  if (EFI_ERROR (Status)) {
+    FreePool (Request);
+  }
+
+  return Status;
+}
+
+/**
+  Reset the block device and abort the queued requests.
+
+  This function implements EFI_BLOCK_IO2_PROTOCOL.Reset().
+
+  @param  This                   Indicates a pointer to the calling context.
+  @param  ExtendedVerification   Indicates that the driver may perform a more exhaustive
+                                 verification operation of the device during reset.
+
+  @retval EFI_SUCCESS            The block device was reset.
+  @retval EFI_DEVICE_ERROR       The block device is not functioning correctly and could not be reset.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcResetEx (
+  IN EFI_BLOCK_IO2_PROTOCOL   *This,
+  IN BOOLEAN                  ExtendedVerification
+  )
+{
+  MMC_HOST_INSTANCE       *MmcHostInstance;
+
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO2_THIS (This);
+
+  MmcAbortAsyncRequests (MmcHostInstance);
+
+  return MmcReset (&MmcHostInstance->BlockIo, ExtendedVerification);
+}
+
+/**
+  Reads the requested number of blocks from the device.
+
+  This function implements EFI_BLOCK_IO2_PROTOCOL.ReadBlocksEx().
+  If Token is NULL or Token->Event is NULL the read is blocking, otherwise
+  the request is queued and Token->Event is signaled once it completes.
+  Called at TPL_CALLBACK or above, the request completes before the
+  function returns.
+
+  @param  This                   Indicates a pointer to the calling context.
+  @param  MediaId                The media ID that the read request is for.
+  @param  Lba                    The starting logical block address to read from on the device.
+  @param  Token                  A pointer to the token associated with the transaction.
+  @param  BufferSize             The size of the Buffer in bytes.
+                                 This must be a multiple of the intrinsic block size of the device.
+  @param  Buffer                 A pointer to the destination buffer for the data.
+
+  @retval EFI_SUCCESS            The read request was queued if Token->Event is not NULL,
+                                 the data was read correctly from the device otherwise.
+  @retval EFI_DEVICE_ERROR       The device reported an error while attempting to perform the read operation.
+  @retval EFI_NO_MEDIA           There is no media in the device.
+  @retval EFI_MEDIA_CHANGED      The MediaId is not for the current media.
+  @retval EFI_BAD_BUFFER_SIZE    The BufferSize parameter is not a multiple of the intrinsic block size of the device.
+  @retval EFI_INVALID_PARAMETER  The read request contains LBAs that are not valid,
+                                 or the buffer is not on proper alignment.
+  @retval EFI_OUT_OF_RESOURCES   The request could not be queued due to a lack of resources.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcReadBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN     UINT32                  MediaId,
+  IN     EFI_LBA                 Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN     *Token,
+  IN     UINTN                   BufferSize,
+  OUT    VOID                    *Buffer
+  )
+{
+  return MmcSubmitRequest (MMC_HOST_INSTANCE_FROM_BLOCK_IO2_THIS (This), MMC_IOBLOCKS_READ,
+           MediaId, Lba, Token, BufferSize, Buffer);
+}
+
+/**
+  Writes a specified number of blocks to the device.
+
+  This function implements EFI_BLOCK_IO2_PROTOCOL.WriteBlocksEx().
+  If Token is NULL or Token->Event is NULL the write is blocking, otherwise
+  the request is queued and Token->Event is signaled once it completes.
+  Called at TPL_CALLBACK or above, the request completes before the
+  function returns.
+
+  @param  This                   Indicates a pointer to the calling context.
+  @param  MediaId                The media ID that the write request is for.
+  @param  Lba                    The starting logical block address to be written.
+  @param  Token                  A pointer to the token associated with the transaction.
+  @param  BufferSize             The size of the Buffer in bytes.
+                                 This must be a multiple of the intrinsic block size of the device.
+  @param  Buffer                 Pointer to the source buffer for the data.
+
+  @retval EFI_SUCCESS            The write request was queued if Token->Event is not NULL,
+                                 the data was written correctly to the device otherwise.
+  @retval EFI_WRITE_PROTECTED    The device cannot be written to.
+  @retval EFI_NO_MEDIA           There is no media in the device.
+  @retval EFI_MEDIA_CHANGED      The MediaId is not for the current media.
+  @retval EFI_DEVICE_ERROR       The device reported an error while attempting to perform the write operation.
+  @retval EFI_BAD_BUFFER_SIZE    The BufferSize parameter is not a multiple of the intrinsic
+                                 block size of the device.
+  @retval EFI_INVALID_PARAMETER  The write request contains LBAs that are not valid,
+                                 or the buffer is not on proper alignment.
+  @retval EFI_OUT_OF_RESOURCES   The request could not be queued due to a lack of resources.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcWriteBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN     UINT32                  MediaId,
+  IN     EFI_LBA                 Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN     *Token,
+  IN     UINTN                   BufferSize,
+  IN     VOID                    *Buffer
+  )
+{
+  return MmcSubmitRequest (MMC_HOST_INSTANCE_FROM_BLOCK_IO2_THIS (This), MMC_IOBLOCKS_WRITE,
+           MediaId, Lba, Token, BufferSize, Buffer);
+}
+
+/**
+  Flushes all modified data to a physical block device.
+
+  This function implements EFI_BLOCK_IO2_PROTOCOL.FlushBlocksEx().
+  The flush completes once every request queued before it has completed.
+
+  @param  This                   Indicates a pointer to the calling context.
+  @param  Token                  A pointer to the token associated with the transaction.
+
+  @retval EFI_SUCCESS            The flush request was queued if Token->Event is not NULL,
+                                 all outstanding data was written to the device otherwise.
+  @retval EFI_DEVICE_ERROR       The device reported an error while attempting to write data.
+  @retval EFI_NO_MEDIA           There is no media in the device.
+  @retval EFI_OUT_OF_RESOURCES   The request could not be queued due to a lack of resources.
+
+**/
+EFI_STATUS
+EFIAPI
+MmcFlushBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL  *This,
+  IN OUT EFI_BLOCK_IO2_TOKEN     *Token
+  )
+{
+  MMC_HOST_INSTANCE       *MmcHostInstance;
+
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_BLOCK_IO2_THIS (This);
+
+  return MmcSubmitRequest (MmcHostInstance, MMC_IOBLOCKS_FLUSH, MmcHostInstance->BlockIo.Media->MediaId,
+           0, Token, 0, NULL);
+}
@@ -0,0 +1,329 @@
+/** @file
+  Boot partitions of eMMC devices.
+
+  An eMMC device has two boot partitions next to the user area. Each one is
+  published on a handle of its own, below the device path of the MMC host,
+  with a BlockIo that selects the partition for the duration of a transfer.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Uefi.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+#include "Mmc.h"
+
+#define BOOT_WP_STATUS_BITS(Index)    ((MmcHostInstance->BootWpStatus >> ((Index) * 2)) & 0x3)
+
+/**
+  Reset the boot partition.
+
+  The partition shares the device with the user area, which is reset through
+  the BlockIo of the MMC host instance.
+
+  @param[in]  This                  Indicates a pointer to the calling context.
+  @param[in]  ExtendedVerification  Driver may perform diagnostics on reset.
+
+  @retval EFI_SUCCESS               The device was reset.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+MmcBootPartitionReset (
+  IN EFI_BLOCK_IO_PROTOCOL    *This,
+  IN BOOLEAN                  ExtendedVerification
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Read or write blocks of a boot partition.
+
+  @param[in]     Partition               The boot partition.
+  @param[in]     Transfer                Transfer type (MMC_IOBLOCKS_READ or MMC_IOBLOCKS_WRITE).
+  @param[in]     MediaId                 Media ID of the boot partition.
+  @param[in]     Lba                     Logical Block Address within the partition.
+  @param[in]     BufferSize              Size of the data buffer.
+  @param[in,out] Buffer                  Pointer to the data buffer.
+
+  @retval EFI_SUCCESS                    The data transfer was successful.
+  @retval Other                          The parameters are invalid or the data transfer failed.
+
+**/
+STATIC
+EFI_STATUS
+MmcBootPartitionIo (
+  IN     MMC_BOOT_PARTITION   *Partition,
+  IN     UINTN                Transfer,
+  IN     UINT32               MediaId,
+  IN     EFI_LBA              Lba,
+  IN     UINTN                BufferSize,
+  IN OUT VOID                 *Buffer
+  )
+{
+  EFI_STATUS          Status;
+  EFI_STATUS          SwitchStatus;
+  EFI_TPL             OldTpl;
+  MMC_HOST_INSTANCE   *MmcHostInstance;
+
+  MmcHostInstance = Partition->MmcHostInstance;
+
+  // Keep the async request worker and the read-ahead off the bus while
+  // the boot partition is selected
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  Status = MmcCheckIoParameters (MmcHostInstance, &Partition->Media, Transfer, MediaId, Lba, BufferSize, Buffer);
+  if (!EFI_ERROR (Status) && (BufferSize != 0)) {
+    Status = MmcSwitchPartition (MmcHostInstance, Partition->Access);
+    if (!EFI_ERROR (Status)) {
+      Status = MmcIoBlocks (&MmcHostInstance->BlockIo, Transfer, MmcHostInstance->BlockIo.Media->MediaId,
+                 Lba, BufferSize, Buffer);
+
+      SwitchStatus = MmcSwitchPartition (MmcHostInstance, 0);
+      if (!EFI_ERROR (Status)) {
+        Status = SwitchStatus;
+      }
+    }
+  }
+
+  gBS->RestoreTPL (OldTpl);
+
+  return Status;
+}
+
+/**
+  Read blocks from a boot partition.
+
+  @param  This                   Indicates a pointer to the calling context.
+  @param  MediaId                The media ID that the read request is for.
+  @param  Lba                    The starting logical block address to be read.
+  @param  BufferSize             The size of the Buffer in bytes.
+  @param  Buffer                 A pointer to the destination buffer for the data.
+
+  @retval EFI_SUCCESS            The data was read correctly from the device.
+  @retval Other                  The parameters are invalid or the read failed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+MmcBootPartitionReadBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL    *This,
+  IN UINT32                   MediaId,
+  IN EFI_LBA                  Lba,
+  IN UINTN                    BufferSize,
+  OUT VOID                    *Buffer
+  )
+{
+  return MmcBootPartitionIo (MMC_BOOT_PARTITION_FROM_BLOCK_IO_THIS (This), MMC_IOBLOCKS_READ,
+           MediaId, Lba, BufferSize, Buffer);
+}
+
+/**
+  Write blocks to a boot partition.
+
+  @param  This                   Indicates a pointer to the calling context.
+  @param  MediaId                The media ID that the write request is for.
+  @param  Lba                    The starting logical block address to be written.
+  @param  BufferSize             The size of the Buffer in bytes.
+  @param  Buffer                 Pointer to the source buffer for the data.
+
+  @retval EFI_SUCCESS            The data were written correctly to the device.
+  @retval EFI_WRITE_PROTECTED    The boot partition is write protected.
+  @retval Other                  The parameters are invalid or the write failed.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+MmcBootPartitionWriteBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL    *This,
+  IN UINT32                   MediaId,
+  IN EFI_LBA                  Lba,
+  IN UINTN                    BufferSize,
+  IN VOID                     *Buffer
+  )
+{
+  return MmcBootPartitionIo (MMC_BOOT_PARTITION_FROM_BLOCK_IO_THIS (This), MMC_IOBLOCKS_WRITE,
+           MediaId, Lba, BufferSize, Buffer);
+}
+
+/**
+  Flush a boot partition. Writes go to the device directly.
+
+  @param  This                   Indicates a pointer to the calling context.
+
+  @retval EFI_SUCCESS            All outstanding data were written correctly to the device.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+MmcBootPartitionFlushBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL  *This
+  )
+{
+  return EFI_SUCCESS;
+}
+
+/**
+  Install the BlockIo and the device path of a boot partition.
+
+  @param[in] MmcHostInstance   MMC host instance
+  @param[in] Index             Index of the boot partition
+
+  @retval EFI_SUCCESS          The boot partition is published.
+  @retval Other                The boot partition could not be published.
+
+**/
+STATIC
+EFI_STATUS
+MmcInstallBootPartition (
+  IN  MMC_HOST_INSTANCE     *MmcHostInstance,
+  IN  UINTN                 Index
+  )
+{
+  EFI_STATUS              Status;
+  MMC_BOOT_PARTITION      *Partition;
+  CONTROLLER_DEVICE_PATH  ControllerNode;
+
+  Partition = &MmcHostInstance->BootPartitions[Index];
+
+  Partition->Signature       = MMC_BOOT_PARTITION_SIGNATURE;
+  Partition->MmcHostInstance = MmcHostInstance;
+  Partition->Access          = (UINT8)(EXTCSD_PART_ACCESS_BOOT1 + Index);
+
+  Partition->BlockIo.Revision    = EFI_BLOCK_IO_INTERFACE_REVISION;
+  Partition->BlockIo.Media       = &Partition->Media;
+  Partition->BlockIo.Reset       = MmcBootPartitionReset;
+  Partition->BlockIo.ReadBlocks  = MmcBootPartitionReadBlocks;
+  Partition->BlockIo.WriteBlocks = MmcBootPartitionWriteBlocks;
+  Partition->BlockIo.FlushBlocks = MmcBootPartitionFlushBlocks;
+
+  ZeroMem (&ControllerNode, sizeof (ControllerNode));
+  ControllerNode.Header.Type    = HARDWARE_DEVICE_PATH;
+  ControllerNode.Header.SubType = HW_CONTROLLER_DP;
+  SetDevicePathNodeLength (&ControllerNode.Header, sizeof (ControllerNode));
+  ControllerNode.ControllerNumber = Partition->Access;
+
+  Partition->DevicePath = AppendDevicePathNode (MmcHostInstance->DevicePath,
+                            (EFI_DEVICE_PATH_PROTOCOL *)&ControllerNode);
+  if (Partition->DevicePath == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = gBS->InstallMultipleProtocolInterfaces (
+                  &Partition->Handle,
+                  &gEfiBlockIoProtocolGuid, &Partition->BlockIo,
+                  &gEfiDevicePathProtocolGuid, Partition->DevicePath,
+                  NULL
+                );
+  if (EFI_ERROR (Status)) {
+    FreePool (Partition->DevicePath);
+    Partition->DevicePath = NULL;
+    Partition->Handle     = NULL;
+  }
+
+  return Status;
+}
+
+/**
+  Publish the boot partitions of the eMMC device, or withdraw their media
+  when the device is gone.
+
+  @param[in] MmcHostInstance   MMC host instance
+
+**/
+VOID
+MmcPublishBootPartitions (
+  IN  MMC_HOST_INSTANCE     *MmcHostInstance
+  )
+{
+  EFI_STATUS              Status;
+  MMC_BOOT_PARTITION      *Partition;
+  EFI_BLOCK_IO_MEDIA      *Media;
+  UINT32                  MediaId;
+  BOOLEAN                 Present;
+  UINTN                   Index;
+
+  Present = MmcHostInstance->BlockIo.Media->MediaPresent &&
+            (MmcHostInstance->CardInfo.CardType == EMMC_CARD) &&
+            (MmcHostInstance->BootPartitionBlocks != 0);
+
+  for (Index = 0; Index < MMC_BOOT_PARTITIONS; Index++) {
+    Partition = &MmcHostInstance->BootPartitions[Index];
+
+    if ((Partition->Handle == NULL) && !Present) {
+      continue;
+    }
+
+    Media   = &Partition->Media;
+    MediaId = Media->MediaId;
+    if (Present) {
+      CopyMem (Media, MmcHostInstance->BlockIo.Media, sizeof (EFI_BLOCK_IO_MEDIA));
+      Media->MediaId   = MediaId + 1;
+      Media->LastBlock = MmcHostInstance->BootPartitionBlocks - 1;
+      Media->ReadOnly  = Media->ReadOnly || (BOOT_WP_STATUS_BITS (Index) != 0U);
+    } else {
+      Media->MediaPresent = FALSE;
+      Media->MediaId      = MediaId + 1;
+    }
+
+    if (Partition->Handle == NULL) {
+      Status = MmcInstallBootPartition (MmcHostInstance, Index);
+    } else {
+      Status = gBS->ReinstallProtocolInterface (
+                      Partition->Handle,
+                      &gEfiBlockIoProtocolGuid,
+                      &Partition->BlockIo,
+                      &Partition->BlockIo
+                    );
+    }
+
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "%a: boot partition %d (Status=%r)\n", __FUNCTION__, Index + 1, Status));
+    }
+  }
+}
+
+/**
+  Uninstall the boot partition handles of an MMC host instance.
+
+  @param[in] MmcHostInstance   MMC host instance
+
+**/
+VOID
+MmcRemoveBootPartitions (
+  IN  MMC_HOST_INSTANCE     *MmcHostInstance
+  )
+{
+  EFI_STATUS              Status;
+  MMC_BOOT_PARTITION      *Partition;
+  UINTN                   Index;
+
+  for (Index = 0; Index < MMC_BOOT_PARTITIONS; Index++) {
+    Partition = &MmcHostInstance->BootPartitions[Index];
+    if (Partition->Handle == NULL) {
+      continue;
+    }
+
+    Status = gBS->UninstallMultipleProtocolInterfaces (
+                    Partition->Handle,
+                    &gEfiBlockIoProtocolGuid, &Partition->BlockIo,
+                    &gEfiDevicePathProtocolGuid, Partition->DevicePath,
+                    NULL
+                  );
+    ASSERT_EFI_ERROR (Status);
+
+    FreePool (Partition->DevicePath);
+    Partition->DevicePath = NULL;
+    Partition->Handle     = NULL;
+  }
+}
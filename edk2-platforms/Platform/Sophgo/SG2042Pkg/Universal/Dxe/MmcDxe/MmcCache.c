@@ -0,0 +1,635 @@
+/** @file
+  Block cache with sequential read-ahead for MMC/SD cards.
+
+  FAT and the partition driver read the same FAT sectors and GPT headers
+  over and over during boot. The cache keeps aligned runs of blocks in an
+  LRU list, looked up through a small hash table. It is write-through, so
+  the device always holds the data and a large read may bypass the cache.
+
+  The read-ahead is a deferred prefetch, not an asynchronous one. The MMC
+  host protocol has no way to start a transfer and return, SendCommand ()
+  moves the data before it comes back, so every transfer keeps the boot
+  CPU busy for as long as it runs. The prefetch therefore runs from a timer
+  once the read that started the stream has returned, in the time the
+  consumer spends on the data, and a line at a time so a consumer coming
+  back early waits for one line at most.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PcdLib.h>
+
+#include "Mmc.h"
+
+/**
+  Return the hash bucket of the cache line starting at Lba.
+
+  @param[in] Cache  The block cache.
+  @param[in] Lba    First block of the cache line.
+
+  @return The hash bucket list head.
+
+**/
+STATIC
+LIST_ENTRY *
+MmcCacheBucket (
+  IN MMC_CACHE  *Cache,
+  IN EFI_LBA    Lba
+  )
+{
+  return &Cache->Hash[DivU64x32 (Lba, (UINT32)Cache->LineBlocks) % MMC_CACHE_HASH_BUCKETS];
+}
+
+/**
+  Find the cache line starting at Lba.
+
+  @param[in] Cache  The block cache.
+  @param[in] Lba    First block of the cache line, line aligned.
+
+  @return The cache line, or NULL if the blocks are not cached.
+
+**/
+STATIC
+MMC_CACHE_LINE *
+MmcCacheLookup (
+  IN MMC_CACHE  *Cache,
+  IN EFI_LBA    Lba
+  )
+{
+  LIST_ENTRY      *Bucket;
+  LIST_ENTRY      *Link;
+  MMC_CACHE_LINE  *Line;
+
+  Bucket = MmcCacheBucket (Cache, Lba);
+  for (Link = GetFirstNode (Bucket); !IsNull (Bucket, Link); Link = GetNextNode (Bucket, Link)) {
+    Line = BASE_CR (Link, MMC_CACHE_LINE, HashLink);
+    if (Line->Lba == Lba) {
+      return Line;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Drop the data of a cache line and make it the first one to be reused.
+
+  @param[in] Cache  The block cache.
+  @param[in] Line   The cache line.
+
+**/
+STATIC
+VOID
+MmcCacheDropLine (
+  IN MMC_CACHE       *Cache,
+  IN MMC_CACHE_LINE  *Line
+  )
+{
+  if (!IsListEmpty (&Line->HashLink)) {
+    RemoveEntryList (&Line->HashLink);
+    InitializeListHead (&Line->HashLink);
+  }
+
+  Line->Blocks    = 0;
+  Line->ReadAhead = FALSE;
+
+  RemoveEntryList (&Line->LruLink);
+  InsertTailList (&Cache->Lru, &Line->LruLink);
+}
+
+/**
+  Read the cache line starting at Lba from the device.
+
+  The least recently used line is reused. On success the line is cached
+  and the most recently used one.
+
+  @param[in]  MmcHostInstance  MMC host instance.
+  @param[in]  MediaId          Media ID of the MMC device.
+  @param[in]  Lba              First block of the cache line, line aligned.
+  @param[out] FilledLine       The cache line holding the blocks.
+
+  @retval EFI_SUCCESS          The blocks are cached.
+  @retval Other                The data transfer failed.
+
+**/
+STATIC
+EFI_STATUS
+MmcCacheFill (
+  IN  MMC_HOST_INSTANCE   *MmcHostInstance,
+  IN  UINT32              MediaId,
+  IN  EFI_LBA             Lba,
+  OUT MMC_CACHE_LINE      **FilledLine
+  )
+{
+  EFI_STATUS          Status;
+  MMC_CACHE           *Cache;
+  MMC_CACHE_LINE      *Line;
+  EFI_BLOCK_IO_MEDIA  *Media;
+  UINTN               Blocks;
+
+  Cache = &MmcHostInstance->Cache;
+  Media = MmcHostInstance->BlockIo.Media;
+
+  Blocks = (UINTN)MIN ((UINT64)Cache->LineBlocks, Media->LastBlock + 1 - Lba);
+
+  Line = BASE_CR (GetPreviousNode (&Cache->Lru, &Cache->Lru), MMC_CACHE_LINE, LruLink);
+  if (Line->Blocks != 0) {
+    Cache->Stats.Evictions++;
+  }
+
+  MmcCacheDropLine (Cache, Line);
+
+  Status = MmcIoBlocks (&MmcHostInstance->BlockIo, MMC_IOBLOCKS_READ, MediaId, Lba,
+             Blocks * Media->BlockSize, Line->Data);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Line->Lba    = Lba;
+  Line->Blocks = Blocks;
+  InsertHeadList (MmcCacheBucket (Cache, Lba), &Line->HashLink);
+
+  RemoveEntryList (&Line->LruLink);
+  InsertHeadList (&Cache->Lru, &Line->LruLink);
+
+  *FilledLine = Line;
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Timer callback prefetching ahead of a sequential stream.
+
+  The lines are read synchronously, the timer only defers the work to when
+  the consumer is busy elsewhere. The prefetch yields to queued BlockIo2
+  requests and moves one cache line per run, so it never delays a consumer
+  by more than one line.
+
+  @param[in] Event    The event that is being triggered
+  @param[in] Context  The MMC_HOST_INSTANCE the event belongs to
+
+**/
+STATIC
+VOID
+EFIAPI
+MmcCachePrefetchCallback (
+  IN  EFI_EVENT   Event,
+  IN  VOID        *Context
+  )
+{
+  MMC_HOST_INSTANCE   *MmcHostInstance;
+  MMC_CACHE           *Cache;
+  MMC_CACHE_LINE      *Line;
+  EFI_BLOCK_IO_MEDIA  *Media;
+  BOOLEAN             Filled;
+
+  MmcHostInstance = (MMC_HOST_INSTANCE *)Context;
+  Cache           = &MmcHostInstance->Cache;
+  Media           = MmcHostInstance->BlockIo.Media;
+
+  if (!IsListEmpty (&MmcHostInstance->AsyncQueue)) {
+    gBS->SetTimer (Event, TimerRelative, MMC_ASYNC_POLL_INTERVAL);
+    return;
+  }
+
+  while ((Cache->ReadAheadBlocks > 0) && Media->MediaPresent &&
+         (Cache->ReadAheadLba <= Media->LastBlock)) {
+    Filled = FALSE;
+    if (MmcCacheLookup (Cache, Cache->ReadAheadLba) == NULL) {
+      if (EFI_ERROR (MmcCacheFill (MmcHostInstance, Media->MediaId, Cache->ReadAheadLba, &Line))) {
+        break;
+      }
+
+      Line->ReadAhead = TRUE;
+      Cache->Stats.ReadAheadLines++;
+      Filled = TRUE;
+    }
+
+    Cache->ReadAheadLba    += Cache->LineBlocks;
+    Cache->ReadAheadBlocks -= MIN (Cache->ReadAheadBlocks, Cache->LineBlocks);
+
+    if (Filled) {
+      // One line from the device per run
+      gBS->SetTimer (Event, TimerRelative, 0);
+      return;
+    }
+  }
+
+  Cache->ReadAheadBlocks = 0;
+}
+
+/**
+  Track sequential reads and start reading ahead of a stream.
+
+  @param[in] MmcHostInstance  MMC host instance.
+  @param[in] Lba              First block of the read.
+  @param[in] Blocks           Number of blocks read.
+
+**/
+STATIC
+VOID
+MmcCacheTrackStream (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance,
+  IN EFI_LBA            Lba,
+  IN UINTN              Blocks
+  )
+{
+  MMC_CACHE   *Cache;
+  EFI_LBA     NextLine;
+  UINTN       ReadAheadBlocks;
+
+  Cache = &MmcHostInstance->Cache;
+
+  if (Lba == Cache->StreamNextLba) {
+    Cache->StreamLength++;
+  } else {
+    Cache->StreamLength = 1;
+  }
+
+  Cache->StreamNextLba = Lba + Blocks;
+
+  ReadAheadBlocks = PcdGet32 (PcdSG2042MmcReadAheadSize) / MmcHostInstance->BlockIo.Media->BlockSize;
+  if ((Cache->StreamLength < MMC_CACHE_STREAM_MIN) || (ReadAheadBlocks == 0)) {
+    return;
+  }
+
+  // Read ahead from the first line the stream has not reached yet
+  NextLine = Cache->StreamNextLba + Cache->LineBlocks - 1;
+  NextLine = NextLine - ModU64x32 (NextLine, (UINT32)Cache->LineBlocks);
+  if ((Cache->ReadAheadBlocks > 0) && (Cache->ReadAheadLba > NextLine)) {
+    // Still ahead of the stream, only extend the window
+    ReadAheadBlocks -= MIN (ReadAheadBlocks, (UINTN)(Cache->ReadAheadLba - NextLine));
+    Cache->ReadAheadBlocks = MAX (Cache->ReadAheadBlocks, ReadAheadBlocks);
+  } else {
+    Cache->ReadAheadLba    = NextLine;
+    Cache->ReadAheadBlocks = ReadAheadBlocks;
+  }
+
+  gBS->SetTimer (Cache->PrefetchEvent, TimerRelative, 0);
+}
+
+/**
+  Read blocks through the block cache.
+
+  The request must have been checked against the media already.
+  Must be called at TPL_CALLBACK.
+
+  @param[in]     MmcHostInstance         MMC host instance.
+  @param[in]     MediaId                 Media ID of the MMC device.
+  @param[in]     Lba                     Logical Block Address.
+  @param[in]     BufferSize              Size of the data buffer.
+  @param[out]    Buffer                  Pointer to the data buffer.
+
+  @retval EFI_SUCCESS                    The data was read.
+  @retval Other                          The data transfer failed.
+
+**/
+EFI_STATUS
+MmcCacheRead (
+  IN  MMC_HOST_INSTANCE   *MmcHostInstance,
+  IN  UINT32              MediaId,
+  IN  EFI_LBA             Lba,
+  IN  UINTN               BufferSize,
+  OUT VOID                *Buffer
+  )
+{
+  EFI_STATUS      Status;
+  MMC_CACHE       *Cache;
+  MMC_CACHE_LINE  *Line;
+  UINTN           BlockSize;
+  UINTN           Blocks;
+  UINTN           Offset;
+  UINTN           Count;
+  EFI_LBA         LineLba;
+  UINT8           *Dest;
+
+  Cache     = &MmcHostInstance->Cache;
+  BlockSize = MmcHostInstance->BlockIo.Media->BlockSize;
+
+  if ((Cache->LineCount == 0) || (BufferSize == 0)) {
+    return MmcIoBlocks (&MmcHostInstance->BlockIo, MMC_IOBLOCKS_READ, MediaId, Lba, BufferSize, Buffer);
+  }
+
+  Blocks = BufferSize / BlockSize;
+  MmcCacheTrackStream (MmcHostInstance, Lba, Blocks);
+
+  if (BufferSize >= MMC_CACHE_BYPASS_SIZE) {
+    Cache->Stats.Bypassed++;
+    return MmcIoBlocks (&MmcHostInstance->BlockIo, MMC_IOBLOCKS_READ, MediaId, Lba, BufferSize, Buffer);
+  }
+
+  Dest = Buffer;
+  while (Blocks > 0) {
+    Offset  = (UINTN)ModU64x32 (Lba, (UINT32)Cache->LineBlocks);
+    LineLba = Lba - Offset;
+
+    Line = MmcCacheLookup (Cache, LineLba);
+    if (Line == NULL) {
+      Status = MmcCacheFill (MmcHostInstance, MediaId, LineLba, &Line);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+
+      Cache->Stats.Misses++;
+    } else {
+      if (Line->ReadAhead) {
+        Line->ReadAhead = FALSE;
+        Cache->Stats.ReadAheadHits++;
+      }
+
+      Cache->Stats.Hits++;
+      RemoveEntryList (&Line->LruLink);
+      InsertHeadList (&Cache->Lru, &Line->LruLink);
+    }
+
+    Count = MIN (Blocks, Line->Blocks - Offset);
+    CopyMem (Dest, Line->Data + Offset * BlockSize, Count * BlockSize);
+
+    Dest   += Count * BlockSize;
+    Lba    += Count;
+    Blocks -= Count;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Write blocks to the device and keep the block cache in sync.
+
+  The request must have been checked against the media already.
+  Must be called at TPL_CALLBACK.
+
+  @param[in]     MmcHostInstance         MMC host instance.
+  @param[in]     MediaId                 Media ID of the MMC device.
+  @param[in]     Lba                     Logical Block Address.
+  @param[in]     BufferSize              Size of the data buffer.
+  @param[in]     Buffer                  Pointer to the data buffer.
+
+  @retval EFI_SUCCESS                    The data was written.
+  @retval Other                          The data transfer failed.
+
+**/
+EFI_STATUS
+MmcCacheWrite (
+  IN MMC_HOST_INSTANCE    *MmcHostInstance,
+  IN UINT32               MediaId,
+  IN EFI_LBA              Lba,
+  IN UINTN                BufferSize,
+  IN VOID                 *Buffer
+  )
+{
+  EFI_STATUS      Status;
+  MMC_CACHE       *Cache;
+  MMC_CACHE_LINE  *Line;
+  UINTN           BlockSize;
+  UINTN           Blocks;
+  UINTN           Offset;
+  UINTN           Count;
+  EFI_LBA         LineLba;
+  UINT8           *Src;
+
+  Cache     = &MmcHostInstance->Cache;
+  BlockSize = MmcHostInstance->BlockIo.Media->BlockSize;
+
+  Status = MmcIoBlocks (&MmcHostInstance->BlockIo, MMC_IOBLOCKS_WRITE, MediaId, Lba, BufferSize, Buffer);
+  if (Cache->LineCount == 0) {
+    return Status;
+  }
+
+  // Update the cached copies, or drop them if the device may hold anything now
+  Src    = Buffer;
+  Blocks = BufferSize / BlockSize;
+  while (Blocks > 0) {
+    Offset  = (UINTN)ModU64x32 (Lba, (UINT32)Cache->LineBlocks);
+    LineLba = Lba - Offset;
+    Count   = MIN (Blocks, Cache->LineBlocks - Offset);
+
+    Line = MmcCacheLookup (Cache, LineLba);
+    if (Line != NULL) {
+      if (EFI_ERROR (Status)) {
+        MmcCacheDropLine (Cache, Line);
+      } else {
+        CopyMem (Line->Data + Offset * BlockSize, Src, MIN (Count, Line->Blocks - Offset) * BlockSize);
+      }
+    }
+
+    Src    += Count * BlockSize;
+    Lba    += Count;
+    Blocks -= Count;
+  }
+
+  return Status;
+}
+
+/**
+  Drop every cached block, for a new card or a re-identified one.
+
+  @param[in] MmcHostInstance  MMC host instance.
+
+**/
+VOID
+MmcCacheInvalidate (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  )
+{
+  MMC_CACHE   *Cache;
+  UINTN       Index;
+
+  Cache = &MmcHostInstance->Cache;
+  if (Cache->LineCount == 0) {
+    return;
+  }
+
+  for (Index = 0; Index < Cache->LineCount; Index++) {
+    MmcCacheDropLine (Cache, &Cache->Lines[Index]);
+  }
+
+  // The block size may have changed with the card
+  Cache->LineBlocks      = MMC_CACHE_LINE_SIZE / MmcHostInstance->BlockIo.Media->BlockSize;
+  Cache->StreamNextLba   = 0;
+  Cache->StreamLength    = 0;
+  Cache->ReadAheadBlocks = 0;
+}
+
+/**
+  Return the counters of the block cache.
+
+  @param[in]  This        Pointer to the MMC_CACHE_STATS_PROTOCOL instance.
+  @param[out] Stats       The counters since the last reset.
+
+  @retval EFI_SUCCESS             The counters were returned.
+  @retval EFI_INVALID_PARAMETER   Stats is NULL.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+MmcCacheGetStats (
+  IN  MMC_CACHE_STATS_PROTOCOL  *This,
+  OUT MMC_CACHE_STATS           *Stats
+  )
+{
+  MMC_HOST_INSTANCE   *MmcHostInstance;
+  EFI_TPL             OldTpl;
+
+  if (Stats == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_CACHE_STATS (This);
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  CopyMem (Stats, &MmcHostInstance->Cache.Stats, sizeof (MMC_CACHE_STATS));
+  gBS->RestoreTPL (OldTpl);
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Clear the counters of the block cache. The cached data is kept.
+
+  @param[in]  This        Pointer to the MMC_CACHE_STATS_PROTOCOL instance.
+
+  @retval EFI_SUCCESS             The counters were cleared.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+MmcCacheResetStats (
+  IN  MMC_CACHE_STATS_PROTOCOL  *This
+  )
+{
+  MMC_HOST_INSTANCE   *MmcHostInstance;
+  EFI_TPL             OldTpl;
+
+  MmcHostInstance = MMC_HOST_INSTANCE_FROM_CACHE_STATS (This);
+
+  OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  ZeroMem (&MmcHostInstance->Cache.Stats, sizeof (MMC_CACHE_STATS));
+  gBS->RestoreTPL (OldTpl);
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Set up the block cache of an MMC host instance and publish its statistics.
+
+  Does nothing if PcdSG2042MmcCacheSize is 0 or the memory is not available,
+  the instance then works uncached.
+
+  @param[in] MmcHostInstance  MMC host instance, with its handle installed.
+
+**/
+VOID
+MmcCacheInit (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  )
+{
+  EFI_STATUS  Status;
+  MMC_CACHE   *Cache;
+  UINTN       LineCount;
+  UINTN       Index;
+
+  Cache     = &MmcHostInstance->Cache;
+  LineCount = PcdGet32 (PcdSG2042MmcCacheSize) / MMC_CACHE_LINE_SIZE;
+  if (LineCount == 0) {
+    return;
+  }
+
+  Cache->Lines = AllocateZeroPool (LineCount * sizeof (MMC_CACHE_LINE));
+  Cache->Data  = AllocatePages (EFI_SIZE_TO_PAGES (LineCount * MMC_CACHE_LINE_SIZE));
+  if ((Cache->Lines == NULL) || (Cache->Data == NULL)) {
+    DEBUG ((DEBUG_WARN, "%a: no memory for a %u byte block cache\n", __FUNCTION__,
+      LineCount * MMC_CACHE_LINE_SIZE));
+    goto FREE_CACHE;
+  }
+
+  Status = gBS->CreateEvent (
+                  EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                  TPL_CALLBACK,
+                  MmcCachePrefetchCallback,
+                  MmcHostInstance,
+                  &Cache->PrefetchEvent
+                );
+  if (EFI_ERROR (Status)) {
+    goto FREE_CACHE;
+  }
+
+  InitializeListHead (&Cache->Lru);
+  for (Index = 0; Index < MMC_CACHE_HASH_BUCKETS; Index++) {
+    InitializeListHead (&Cache->Hash[Index]);
+  }
+
+  for (Index = 0; Index < LineCount; Index++) {
+    Cache->Lines[Index].Data = Cache->Data + Index * MMC_CACHE_LINE_SIZE;
+    InitializeListHead (&Cache->Lines[Index].HashLink);
+    InsertTailList (&Cache->Lru, &Cache->Lines[Index].LruLink);
+  }
+
+  Cache->LineCount  = LineCount;
+  Cache->LineBlocks = MMC_CACHE_LINE_SIZE / MmcHostInstance->BlockIo.Media->BlockSize;
+
+  Cache->StatsProtocol.Revision      = MMC_CACHE_STATS_PROTOCOL_REVISION;
+  Cache->StatsProtocol.CacheSize     = (UINT32)(LineCount * MMC_CACHE_LINE_SIZE);
+  Cache->StatsProtocol.ReadAheadSize = PcdGet32 (PcdSG2042MmcReadAheadSize);
+  Cache->StatsProtocol.GetStats      = MmcCacheGetStats;
+  Cache->StatsProtocol.ResetStats    = MmcCacheResetStats;
+
+  Status = gBS->InstallMultipleProtocolInterfaces (
+                  &MmcHostInstance->MmcHandle,
+                  &gSophgoMmcCacheStatsProtocolGuid, &Cache->StatsProtocol,
+                  NULL
+                );
+  ASSERT_EFI_ERROR (Status);
+
+  return;
+
+FREE_CACHE:
+  if (Cache->Data != NULL) {
+    FreePages (Cache->Data, EFI_SIZE_TO_PAGES (LineCount * MMC_CACHE_LINE_SIZE));
+  }
+
+  if (Cache->Lines != NULL) {
+    FreePool (Cache->Lines);
+  }
+
+  ZeroMem (Cache, sizeof (MMC_CACHE));
+}
+
+/**
+  Tear down the block cache of an MMC host instance.
+
+  @param[in] MmcHostInstance  MMC host instance.
+
+**/
+VOID
+MmcCacheFree (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  )
+{
+  MMC_CACHE   *Cache;
+
+  Cache = &MmcHostInstance->Cache;
+  if (Cache->LineCount == 0) {
+    return;
+  }
+
+  gBS->UninstallMultipleProtocolInterfaces (
+         MmcHostInstance->MmcHandle,
+         &gSophgoMmcCacheStatsProtocolGuid, &Cache->StatsProtocol,
+         NULL
+         );
+
+  gBS->CloseEvent (Cache->PrefetchEvent);
+  FreePages (Cache->Data, EFI_SIZE_TO_PAGES (Cache->LineCount * MMC_CACHE_LINE_SIZE));
+  FreePool (Cache->Lines);
+
+  ZeroMem (Cache, sizeof (MMC_CACHE));
+}
@@ -7,6 +7,8 @@
 
 **/
 
+#include <Library/TimerLib.h>
+
 #include "Mmc.h"
 
 #if !defined(MDEPKG_NDEBUG)
@@ -15,6 +17,9 @@ CONST CHAR8* mStrUnit[] = { "100kbit/s", "1Mbit/s", "10Mbit/s", "100MBit/s",
 CONST CHAR8* mStrValue[] = { "1.0", "1.2", "1.3", "1.5", "2.0", "2.5",
                              "3.0", "3.5", "4.0", "4.5", "5.0", "5.5",
                              "6.0", "7.0", "8.0" };
+CONST CHAR8* mStrTiming[] = { "Legacy", "HS", "SDR12", "SDR25", "SDR50",
+                              "SDR104", "DDR50", "MMC HS", "DDR52", "HS200",
+                              "HS400", "HS400ES" };
 #endif
 
 /**
@@ -192,3 +197,114 @@ PrintResponseR1 (
     break;
   }
 }
+
+/**
+  Account a block transfer to the bus timing in use.
+
+  @param[in] MmcHostInstance  MMC host instance.
+  @param[in] Transfer         MMC_IOBLOCKS_READ or MMC_IOBLOCKS_WRITE.
+  @param[in] Bytes            Number of bytes transferred, 0 if the transfer failed.
+  @param[in] StartTick        Performance counter value when the transfer started.
+
+**/
+VOID
+MmcAccountTransfer (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance,
+  IN UINTN              Transfer,
+  IN UINTN              Bytes,
+  IN UINT64             StartTick
+  )
+{
+  MMC_TIMING_STATS  *Stats;
+  UINT64            EndTick;
+  UINT64            Ticks;
+  UINT64            CounterStart;
+  UINT64            CounterEnd;
+
+  ASSERT (MmcHostInstance->Timing < MmcTimingMax);
+  Stats = &MmcHostInstance->TimingStats[MmcHostInstance->Timing];
+
+  if (Bytes == 0) {
+    Stats->Errors++;
+    return;
+  }
+
+  EndTick = GetPerformanceCounter ();
+  GetPerformanceCounterProperties (&CounterStart, &CounterEnd);
+  if (CounterStart < CounterEnd) {
+    Ticks = EndTick - StartTick;
+  } else {
+    Ticks = StartTick - EndTick;
+  }
+
+  if (Transfer == MMC_IOBLOCKS_READ) {
+    Stats->ReadBytes += Bytes;
+    Stats->ReadTicks += Ticks;
+  } else {
+    Stats->WriteBytes += Bytes;
+    Stats->WriteTicks += Ticks;
+  }
+}
+
+/**
+  Print the read and write throughput seen at each bus timing.
+
+  @param[in] MmcHostInstance  MMC host instance.
+
+**/
+VOID
+PrintThroughput (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  )
+{
+  DEBUG_CODE_BEGIN ();
+  MMC_TIMING_STATS  *Stats;
+  UINT64            ReadUs;
+  UINT64            WriteUs;
+  UINTN             Timing;
+
+  DEBUG ((DEBUG_INFO, "- PrintThroughput\n"));
+
+  for (Timing = 0; Timing < MmcTimingMax; Timing++) {
+    Stats = &MmcHostInstance->TimingStats[Timing];
+    if ((Stats->ReadBytes == 0) && (Stats->WriteBytes == 0) && (Stats->Errors == 0)) {
+      continue;
+    }
+
+    ReadUs  = DivU64x32 (GetTimeInNanoSecond (Stats->ReadTicks), 1000);
+    WriteUs = DivU64x32 (GetTimeInNanoSecond (Stats->WriteTicks), 1000);
+
+    DEBUG ((DEBUG_INFO, "\t- %a: read %Lu KiB in %Lu ms (%Lu KiB/s), write %Lu KiB in %Lu ms (%Lu KiB/s), %u errors\n",
+      mStrTiming[Timing],
+      RShiftU64 (Stats->ReadBytes, 10), DivU64x32 (ReadUs, 1000),
+      (ReadUs == 0) ? 0 : DivU64x64Remainder (MultU64x32 (Stats->ReadBytes, 1000000), MultU64x32 (ReadUs, 1024), NULL),
+      RShiftU64 (Stats->WriteBytes, 10), DivU64x32 (WriteUs, 1000),
+      (WriteUs == 0) ? 0 : DivU64x64Remainder (MultU64x32 (Stats->WriteBytes, 1000000), MultU64x32 (WriteUs, 1024), NULL),
+      Stats->Errors));
+  }
+  DEBUG_CODE_END ();
+}
+
+/**
+  Print the counters of the block cache.
+
+  @param[in] MmcHostInstance  MMC host instance.
+
+**/
+VOID
+PrintCacheStats (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  )
+{
+  MMC_CACHE_STATS  *Stats;
+
+  if (MmcHostInstance->Cache.LineCount == 0) {
+    return;
+  }
+
+  Stats = &MmcHostInstance->Cache.Stats;
+  DEBUG ((DEBUG_INFO, "- PrintCacheStats\n"));
+  DEBUG ((DEBUG_INFO, "\t- %Lu hits, %Lu misses, %Lu bypassed, %Lu evictions\n",
+    Stats->Hits, Stats->Misses, Stats->Bypassed, Stats->Evictions));
+  DEBUG ((DEBUG_INFO, "\t- %Lu lines read ahead, %Lu used\n", Stats->ReadAheadLines, Stats->ReadAheadHits));
+}
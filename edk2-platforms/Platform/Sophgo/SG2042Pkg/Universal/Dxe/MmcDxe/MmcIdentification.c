@@ -28,6 +28,7 @@ STATIC CSD     MmcCsd;
 STATIC UINT8   MmcExtCsd[512] __attribute__ ((aligned(16)));
 STATIC UINT32  MmcRCA;
 STATIC UINT32  MmcSCR[2] __attribute__ ((aligned(16))) = { 0 };
+STATIC UINT8   MmcSwitchStatus[SWITCH_CMD_DATA_LENGTH] __attribute__ ((aligned(16)));
 
 typedef enum _MMC_DEVICE_TYPE {
   MMC_IS_EMMC,
@@ -41,6 +42,8 @@ typedef struct {
   UINT32		     MaxBusFreq;	/* Max bus freq in Hz */
   UINT32		     OCRVoltage;	/* OCR voltage */
   MMC_DEVICE_TYPE	 MmcDevType;	/* Type of MMC */
+  UINT32           BusWidth;    /* Bus width in use */
+  BOOLEAN          Signal1V8;   /* Card switched to 1.8V signaling */
 } MMC_DEVICE_INFO;
 
 STATIC MMC_DEVICE_INFO MmcDevInfo = {
@@ -56,6 +59,46 @@ STATIC CONST UINT8 SdTranSpeedBase[16] = {
   0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80
 };
 
+typedef struct {
+  MMC_BUS_TIMING   Timing;
+  UINT32           AccessMode;  /* CMD6 function group 1 function */
+  UINT32           HostCaps;    /* MMC_HOST_CAP_* the host needs */
+  UINT32           Clk;         /* Max bus freq in Hz */
+  BOOLEAN          Signal1V8;   /* Timing is only defined at 1.8V */
+} SD_TIMING_MODE;
+
+//
+// SD bus timings, fastest first
+//
+STATIC CONST SD_TIMING_MODE SdTimingModes[] = {
+  { MmcTimingUhsSdr104, SD_ACCESS_MODE_SDR104, MMC_HOST_CAP_SDR104,         SD_UHS_SDR104_SPEED, TRUE  },
+  { MmcTimingUhsSdr50,  SD_ACCESS_MODE_SDR50,  MMC_HOST_CAP_SDR50,          SD_UHS_SDR50_SPEED,  TRUE  },
+  { MmcTimingUhsDdr50,  SD_ACCESS_MODE_DDR50,  MMC_HOST_CAP_DDR50,          SD_HIGH_SPEED,       TRUE  },
+  { MmcTimingUhsSdr25,  SD_ACCESS_MODE_SDR25,  MMC_HOST_CAP_1V8_SIGNALING,  SD_HIGH_SPEED,       TRUE  },
+  { MmcTimingUhsSdr12,  SD_ACCESS_MODE_SDR12,  MMC_HOST_CAP_1V8_SIGNALING,  SD_DEFAULT_SPEED,    TRUE  },
+  { MmcTimingSdHs,      SD_ACCESS_MODE_SDR25,  MMC_HOST_CAP_HIGHSPEED,      SD_HIGH_SPEED,       FALSE },
+  { MmcTimingLegacy,    SD_ACCESS_MODE_SDR12,  0,                           SD_DEFAULT_SPEED,    FALSE },
+};
+
+typedef struct {
+  MMC_BUS_TIMING   Timing;
+  UINT8            DeviceType;  /* EXT_CSD DEVICE_TYPE bit of the timing */
+  UINT32           HostCaps;    /* MMC_HOST_CAP_* the host needs */
+  UINT32           Clk;         /* Max bus freq in Hz */
+} EMMC_TIMING_MODE;
+
+//
+// eMMC bus timings, fastest first. The identification timing is the fallback.
+//
+STATIC CONST EMMC_TIMING_MODE EmmcTimingModes[] = {
+  { MmcTimingMmcHs400Es, EMMCHS400DDR1V8,  MMC_HOST_CAP_HS400_ES,   EMMC_HS200_SPEED },
+  { MmcTimingMmcHs400,   EMMCHS400DDR1V8,  MMC_HOST_CAP_HS400,      EMMC_HS200_SPEED },
+  { MmcTimingMmcHs200,   EMMCHS200SDR1V8,  MMC_HOST_CAP_HS200,      EMMC_HS200_SPEED },
+  { MmcTimingMmcDdr52,   EMMCHS52DDR1V8,   MMC_HOST_CAP_DDR52,      EMMC_HS52_SPEED  },
+  { MmcTimingMmcHs,      EMMCHS52,         MMC_HOST_CAP_HIGHSPEED,  EMMC_HS52_SPEED  },
+  { MmcTimingMmcHs,      EMMCHS26,         MMC_HOST_CAP_HIGHSPEED,  EMMC_HS26_SPEED  },
+};
+
 /**
   Get the current state of the MMC device.
 
@@ -268,9 +311,517 @@ MmcSetIos (
     DEBUG ((DEBUG_INFO, "%a: Wrong MMC type or spec version\n", __FUNCTION__));
   }
 
+  MmcDevInfo.BusWidth = Width;
+
   return MmcHostInstance->MmcHost->SetIos (MmcHostInstance->MmcHost, Clk, Width);
 }
 
+/**
+  Send CMD6 SWITCH_FUNC to an SD card and read back its 64-byte switch status.
+
+  @param[in]     MmcHostInstance       Pointer to the MMC_HOST_INSTANCE structure.
+  @param[in]     Arg                   CMD6 argument.
+
+  @retval EFI_SUCCESS                   The switch status was read into MmcSwitchStatus.
+  @retval Other                         An error occurred while sending CMD6 or reading the status.
+
+**/
+STATIC
+EFI_STATUS
+MmcSdSwitchFunc (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance,
+  IN UINT32             Arg
+  )
+{
+  EFI_STATUS  Status;
+
+  Status = MmcHostInstance->MmcHost->Prepare (MmcHostInstance->MmcHost, 0, sizeof(MmcSwitchStatus),
+             (UINTN)&MmcSwitchStatus);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  // CMD6: SWITCH_FUNC
+  Status = MmcHostInstance->MmcHost->SendCommand (MmcHostInstance->MmcHost, MMC_CMD6_SWITCH_FUNC, Arg,
+             MMC_RESPONSE_R1, NULL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return MmcHostInstance->MmcHost->ReadBlockData (MmcHostInstance->MmcHost, 0, sizeof(MmcSwitchStatus),
+           (UINT32*)MmcSwitchStatus);
+}
+
+/**
+  Switch an SD card and the host to the given bus timing.
+
+  @param[in]     MmcHostInstance       Pointer to the MMC_HOST_INSTANCE structure.
+  @param[in]     Mode                  The bus timing to switch to.
+  @param[in]     HostCaps              Capabilities of the MMC host.
+
+  @retval EFI_SUCCESS                   The card and the host run at the new timing.
+  @retval EFI_UNSUPPORTED               The card refused the timing, it still runs at the old one.
+  @retval EFI_DEVICE_ERROR              The bus does not work at the new timing.
+
+**/
+STATIC
+EFI_STATUS
+MmcSdSetTiming (
+  IN MMC_HOST_INSTANCE      *MmcHostInstance,
+  IN CONST SD_TIMING_MODE   *Mode,
+  IN UINT32                 HostCaps
+  )
+{
+  EFI_STATUS              Status;
+  EFI_MMC_HOST_PROTOCOL   *MmcHost;
+
+  MmcHost = MmcHostInstance->MmcHost;
+
+  Status = MmcSdSwitchFunc (MmcHostInstance, SD_SWITCH_MODE_SET | Mode->AccessMode);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (SD_SWITCH_ACCESS_MODE (MmcSwitchStatus) != Mode->AccessMode) {
+    DEBUG ((DEBUG_INFO, "%a: card refused access mode %d\n", __FUNCTION__, Mode->AccessMode));
+    return EFI_UNSUPPORTED;
+  }
+
+  // The card switches 8 clocks after the end of the status block
+  Status = MmcHost->SetTiming (MmcHost, Mode->Timing);
+  if (EFI_ERROR (Status)) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  Status = MmcHost->SetIos (MmcHost, Mode->Clk, MmcDevInfo.BusWidth);
+  if (EFI_ERROR (Status)) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  if ((Mode->Timing == MmcTimingUhsSdr104) ||
+      ((Mode->Timing == MmcTimingUhsSdr50) && ((HostCaps & MMC_HOST_CAP_SDR50_TUNING) != 0U))) {
+    if (MmcHost->ExecuteTuning == NULL) {
+      return EFI_DEVICE_ERROR;
+    }
+
+    // CMD19: SEND_TUNING_BLOCK
+    Status = MmcHost->ExecuteTuning (MmcHost, MMC_CMD19);
+    if (EFI_ERROR (Status)) {
+      return EFI_DEVICE_ERROR;
+    }
+  }
+
+  // Read the switch status back at the new timing, a marginal bus fails the CRC here
+  Status = MmcSdSwitchFunc (MmcHostInstance, SD_SWITCH_MODE_CHECK | SD_SWITCH_KEEP_ACCESS_MODE);
+  if (EFI_ERROR (Status) || (SD_SWITCH_ACCESS_MODE (MmcSwitchStatus) != Mode->AccessMode)) {
+    DEBUG ((DEBUG_ERROR, "%a: timing %d failed verification (Status=%r)\n", __FUNCTION__, Mode->Timing, Status));
+    return EFI_DEVICE_ERROR;
+  }
+
+  MmcHostInstance->Timing = Mode->Timing;
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Select the fastest bus timing the SD card, the host and the allowed
+  timings of the MMC host instance have in common.
+
+  A timing that does not work is dropped from the allowed timings, the
+  caller then identifies the card again to start from a known bus state.
+
+  @param[in]     MmcHostInstance       Pointer to the MMC_HOST_INSTANCE structure.
+
+  @retval EFI_SUCCESS                   The card runs at the selected timing.
+  @retval Other                         An error occurred, the card must be identified again.
+
+**/
+STATIC
+EFI_STATUS
+MmcSdSelectTiming (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  )
+{
+  EFI_STATUS              Status;
+  EFI_MMC_HOST_PROTOCOL   *MmcHost;
+  CONST SD_TIMING_MODE    *Mode;
+  UINT32                  HostCaps;
+  UINT8                   CardModes;
+  UINTN                   Index;
+
+  MmcHost = MmcHostInstance->MmcHost;
+
+  MmcHostInstance->Timing = MmcTimingLegacy;
+
+  // CMD6 is a class 10 command, supported from SD 1.10 on
+  if (!MMC_HOST_HAS_SETTIMING (MmcHost) ||
+      ((MmcSCR[0] & SD_SCR_SD_SPEC_MASK) == 0U) ||
+      ((MmcCsd.CCC & SD_CCC_SWITCH) == 0U)) {
+    return EFI_SUCCESS;
+  }
+
+  HostCaps = MmcHost->GetCapabilities (MmcHost);
+
+  Status = MmcSdSwitchFunc (MmcHostInstance, SD_SWITCH_MODE_CHECK | SD_SWITCH_KEEP_ACCESS_MODE);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  CardModes = SD_SWITCH_ACCESS_MODE_SUPPORT (MmcSwitchStatus);
+
+  for (Index = 0; Index < ARRAY_SIZE (SdTimingModes); Index++) {
+    Mode = &SdTimingModes[Index];
+
+    if ((Mode->Signal1V8 != MmcDevInfo.Signal1V8) ||
+        ((HostCaps & Mode->HostCaps) != Mode->HostCaps) ||
+        ((CardModes & BIT_32 (Mode->AccessMode)) == 0U) ||
+        ((MmcHostInstance->TimingMask & MMC_TIMING_BIT (Mode->Timing)) == 0U)) {
+      continue;
+    }
+
+    Status = MmcSdSetTiming (MmcHostInstance, Mode, HostCaps);
+    if (!EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_INFO, "%a: SD card runs at timing %d, %dHz\n", __FUNCTION__, Mode->Timing, Mode->Clk));
+      return EFI_SUCCESS;
+    }
+
+    MmcHostInstance->TimingMask &= ~MMC_TIMING_BIT (Mode->Timing);
+    if (Status != EFI_UNSUPPORTED) {
+      return Status;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Read the EXT_CSD register of an eMMC device into MmcExtCsd.
+
+  @param[in]     MmcHostInstance       Pointer to the MMC_HOST_INSTANCE structure.
+
+  @retval EFI_SUCCESS                   The register was read, the device is back in transfer state.
+  @retval Other                         An error occurred while reading the register.
+
+**/
+STATIC
+EFI_STATUS
+MmcEmmcReadExtCsd (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      State;
+
+  Status = MmcHostInstance->MmcHost->Prepare (MmcHostInstance->MmcHost, 0, sizeof(MmcExtCsd), (UINTN)&MmcExtCsd);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  /* MMC CMD8: SEND_EXT_CSD */
+  Status = MmcHostInstance->MmcHost->SendCommand (MmcHostInstance->MmcHost, MMC_CMD8_SEND_EXT_CSD, 0,
+             MMC_RESPONSE_R1, NULL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = MmcHostInstance->MmcHost->ReadBlockData (MmcHostInstance->MmcHost, 0, sizeof(MmcExtCsd), (UINT32*)MmcExtCsd);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  do {
+    Status = MmcDeviceState (MmcHostInstance, &State);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  } while (State != MMC_R0_STATE_TRAN);
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Write an EXT_CSD byte of an eMMC device and move the host to the bus
+  settings that go with it.
+
+  The host is switched before the busy phase is polled, so that the status
+  is read at the new settings. A bus that does not work fails here.
+
+  @param[in]     MmcHostInstance       Pointer to the MMC_HOST_INSTANCE structure.
+  @param[in]     ExtCmd                The EXT_CSD byte to write.
+  @param[in]     Value                 The value to write.
+  @param[in]     Timing                The host bus timing after the switch.
+  @param[in]     Clk                   The bus clock after the switch.
+  @param[in]     BusWidth              The host bus width after the switch.
+
+  @retval EFI_SUCCESS                   The device and the host run at the new settings.
+  @retval EFI_DEVICE_ERROR              The switch failed.
+
+**/
+STATIC
+EFI_STATUS
+MmcEmmcSwitch (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance,
+  IN UINT32             ExtCmd,
+  IN UINT32             Value,
+  IN MMC_BUS_TIMING     Timing,
+  IN UINT32             Clk,
+  IN UINT32             BusWidth
+  )
+{
+  EFI_STATUS              Status;
+  EFI_MMC_HOST_PROTOCOL   *MmcHost;
+  UINT32                  State;
+
+  MmcHost = MmcHostInstance->MmcHost;
+
+  // CMD6: SWITCH
+  Status = MmcHost->SendCommand (MmcHost, MMC_CMD6,
+             EXTCSD_WRITE_BYTES | EXTCSD_CMD(ExtCmd) |
+             EXTCSD_VALUE(Value) | EXTCSD_CMD_SET_NORMAL,
+             MMC_RESPONSE_R1B, NULL);
+  if (!EFI_ERROR (Status)) {
+    Status = MmcHost->SetTiming (MmcHost, Timing);
+  }
+
+  if (!EFI_ERROR (Status)) {
+    Status = MmcHost->SetIos (MmcHost, Clk, BusWidth);
+  }
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: EXT_CSD[%d]=0x%x failed (Status=%r)\n", __FUNCTION__, ExtCmd, Value, Status));
+    return EFI_DEVICE_ERROR;
+  }
+
+  MmcDevInfo.BusWidth = BusWidth;
+
+  do {
+    Status = MmcDeviceState (MmcHostInstance, &State);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "%a: EXT_CSD[%d]=0x%x not taken (Status=%r)\n", __FUNCTION__, ExtCmd, Value, Status));
+      return EFI_DEVICE_ERROR;
+    }
+  } while (State == MMC_R0_STATE_PROG);
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Tune the sampling point of the host with CMD21 SEND_TUNING_BLOCK.
+
+  @param[in]     MmcHostInstance       Pointer to the MMC_HOST_INSTANCE structure.
+
+  @retval EFI_SUCCESS                   The host found a working sampling point.
+  @retval EFI_DEVICE_ERROR              Tuning failed or is not supported by the host.
+
+**/
+STATIC
+EFI_STATUS
+MmcEmmcExecuteTuning (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  )
+{
+  EFI_MMC_HOST_PROTOCOL   *MmcHost;
+
+  MmcHost = MmcHostInstance->MmcHost;
+
+  if ((MmcHost->ExecuteTuning == NULL) ||
+      EFI_ERROR (MmcHost->ExecuteTuning (MmcHost, MMC_CMD21))) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Switch an eMMC device and the host from the identification timing to the
+  given bus timing.
+
+  The HS400 modes can only be entered through High Speed, HS400 also needs
+  the sampling point tuned at HS200 first.
+
+  @param[in]     MmcHostInstance       Pointer to the MMC_HOST_INSTANCE structure.
+  @param[in]     Mode                  The bus timing to switch to.
+
+  @retval EFI_SUCCESS                   The device and the host run at the new timing.
+  @retval EFI_DEVICE_ERROR              The bus does not work at the new timing.
+
+**/
+STATIC
+EFI_STATUS
+MmcEmmcSetTiming (
+  IN MMC_HOST_INSTANCE        *MmcHostInstance,
+  IN CONST EMMC_TIMING_MODE   *Mode
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      BusWidth;
+  UINT32      DdrBusWidth;
+  UINT8       HsTiming;
+
+  if ((MmcHostInstance->HostCaps & MMC_HOST_CAP_8BIT) != 0U) {
+    BusWidth    = MMC_BUS_WIDTH_8;
+    DdrBusWidth = MMC_BUS_WIDTH_DDR_8;
+  } else {
+    BusWidth    = MMC_BUS_WIDTH_4;
+    DdrBusWidth = MMC_BUS_WIDTH_DDR_4;
+  }
+
+  // The bus width is switched at the identification timing
+  Status = MmcEmmcSwitch (MmcHostInstance, CMD_EXTCSD_BUS_WIDTH, BusWidth,
+             MmcTimingLegacy, SD_DEFAULT_SPEED, BusWidth);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  switch (Mode->Timing) {
+    case MmcTimingMmcHs400Es:
+      Status = MmcEmmcSwitch (MmcHostInstance, CMD_EXTCSD_HS_TIMING, EXTCSD_HS_TIMING_HS,
+                 MmcTimingMmcHs, EMMC_HS52_SPEED, BusWidth);
+      if (!EFI_ERROR (Status)) {
+        Status = MmcEmmcSwitch (MmcHostInstance, CMD_EXTCSD_BUS_WIDTH, DdrBusWidth | EXTCSD_BUS_WIDTH_STROBE,
+                   MmcTimingMmcHs, EMMC_HS52_SPEED, DdrBusWidth);
+      }
+
+      if (!EFI_ERROR (Status)) {
+        Status = MmcEmmcSwitch (MmcHostInstance, CMD_EXTCSD_HS_TIMING, EXTCSD_HS_TIMING_HS400,
+                   MmcTimingMmcHs400Es, Mode->Clk, DdrBusWidth);
+      }
+
+      HsTiming = EXTCSD_HS_TIMING_HS400;
+      break;
+
+    case MmcTimingMmcHs400:
+      Status = MmcEmmcSwitch (MmcHostInstance, CMD_EXTCSD_HS_TIMING, EXTCSD_HS_TIMING_HS200,
+                 MmcTimingMmcHs200, Mode->Clk, BusWidth);
+      if (!EFI_ERROR (Status)) {
+        Status = MmcEmmcExecuteTuning (MmcHostInstance);
+      }
+
+      // Back to High Speed at 52MHz, the HS400 switch keeps the tuned sampling point
+      if (!EFI_ERROR (Status)) {
+        Status = MmcEmmcSwitch (MmcHostInstance, CMD_EXTCSD_HS_TIMING, EXTCSD_HS_TIMING_HS,
+                   MmcTimingMmcHs, EMMC_HS52_SPEED, BusWidth);
+      }
+
+      if (!EFI_ERROR (Status)) {
+        Status = MmcEmmcSwitch (MmcHostInstance, CMD_EXTCSD_BUS_WIDTH, DdrBusWidth,
+                   MmcTimingMmcHs, EMMC_HS52_SPEED, DdrBusWidth);
+      }
+
+      if (!EFI_ERROR (Status)) {
+        Status = MmcEmmcSwitch (MmcHostInstance, CMD_EXTCSD_HS_TIMING, EXTCSD_HS_TIMING_HS400,
+                   MmcTimingMmcHs400, Mode->Clk, DdrBusWidth);
+      }
+
+      HsTiming = EXTCSD_HS_TIMING_HS400;
+      break;
+
+    case MmcTimingMmcHs200:
+      Status = MmcEmmcSwitch (MmcHostInstance, CMD_EXTCSD_HS_TIMING, EXTCSD_HS_TIMING_HS200,
+                 MmcTimingMmcHs200, Mode->Clk, BusWidth);
+      if (!EFI_ERROR (Status)) {
+        Status = MmcEmmcExecuteTuning (MmcHostInstance);
+      }
+
+      HsTiming = EXTCSD_HS_TIMING_HS200;
+      break;
+
+    case MmcTimingMmcDdr52:
+      Status = MmcEmmcSwitch (MmcHostInstance, CMD_EXTCSD_HS_TIMING, EXTCSD_HS_TIMING_HS,
+                 MmcTimingMmcHs, Mode->Clk, BusWidth);
+      if (!EFI_ERROR (Status)) {
+        Status = MmcEmmcSwitch (MmcHostInstance, CMD_EXTCSD_BUS_WIDTH, DdrBusWidth,
+                   MmcTimingMmcDdr52, Mode->Clk, DdrBusWidth);
+      }
+
+      HsTiming = EXTCSD_HS_TIMING_HS;
+      break;
+
+    default:
+      Status = MmcEmmcSwitch (MmcHostInstance, CMD_EXTCSD_HS_TIMING, EXTCSD_HS_TIMING_HS,
+                 MmcTimingMmcHs, Mode->Clk, BusWidth);
+
+      HsTiming = EXTCSD_HS_TIMING_HS;
+      break;
+  }
+
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  // Read EXT_CSD back at the new timing, a marginal bus fails the CRC here
+  Status = MmcEmmcReadExtCsd (MmcHostInstance);
+  if (EFI_ERROR (Status) || ((MmcExtCsd[CMD_EXTCSD_HS_TIMING] & 0xF) != HsTiming)) {
+    DEBUG ((DEBUG_ERROR, "%a: timing %d failed verification (Status=%r)\n", __FUNCTION__, Mode->Timing, Status));
+    return EFI_DEVICE_ERROR;
+  }
+
+  MmcHostInstance->Timing = Mode->Timing;
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Select the fastest bus timing the eMMC device, the host and the allowed
+  timings of the MMC host instance have in common.
+
+  A timing that does not work is dropped from the allowed timings, the
+  caller then identifies the device again to start from a known bus state.
+
+  @param[in]     MmcHostInstance       Pointer to the MMC_HOST_INSTANCE structure.
+
+  @retval EFI_SUCCESS                   The device runs at the selected timing.
+  @retval Other                         An error occurred, the device must be identified again.
+
+**/
+STATIC
+EFI_STATUS
+MmcEmmcSelectTiming (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  )
+{
+  EFI_STATUS                Status;
+  CONST EMMC_TIMING_MODE    *Mode;
+  UINT32                    HostCaps;
+  UINT8                     DeviceTypes;
+  UINTN                     Index;
+
+  MmcHostInstance->Timing = MmcTimingLegacy;
+
+  // HS_TIMING is part of EXT_CSD, which came with MMC 4.0
+  if (!MMC_HOST_HAS_SETTIMING (MmcHostInstance->MmcHost) || (MmcCsd.SPEC_VERS < 4U)) {
+    return EFI_SUCCESS;
+  }
+
+  HostCaps    = MmcHostInstance->HostCaps;
+  DeviceTypes = MmcExtCsd[CMD_EXTCSD_DEVICE_TYPE];
+
+  for (Index = 0; Index < ARRAY_SIZE (EmmcTimingModes); Index++) {
+    Mode = &EmmcTimingModes[Index];
+
+    if (((DeviceTypes & Mode->DeviceType) == 0U) ||
+        ((HostCaps & Mode->HostCaps) != Mode->HostCaps) ||
+        ((MmcHostInstance->TimingMask & MMC_TIMING_BIT (Mode->Timing)) == 0U)) {
+      continue;
+    }
+
+    if ((Mode->Timing == MmcTimingMmcHs400Es) && (MmcExtCsd[CMD_EXTCSD_STROBE_SUPPORT] == 0U)) {
+      continue;
+    }
+
+    Status = MmcEmmcSetTiming (MmcHostInstance, Mode);
+    if (EFI_ERROR (Status)) {
+      MmcHostInstance->TimingMask &= ~MMC_TIMING_BIT (Mode->Timing);
+      return Status;
+    }
+
+    DEBUG ((DEBUG_INFO, "%a: eMMC runs at timing %d, %dHz\n", __FUNCTION__, Mode->Timing, Mode->Clk));
+    return EFI_SUCCESS;
+  }
+
+  return EFI_SUCCESS;
+}
+
 /**
   Fill the MMC device information.
 
@@ -292,39 +843,20 @@ MmcFillDeviceInfo (
   UINT32      SpeedIdx;
   UINT32      NumBlocks;
   UINT32      FreqUnit;
-  UINT32      State;
   ECSD        *CsdSdV2;
 
   Status = EFI_SUCCESS;
 
   switch (MmcDevInfo.MmcDevType) {
     case MMC_IS_EMMC:
+      MmcHostInstance->CardInfo.CardType = EMMC_CARD;
       MmcDevInfo.BlockSize = MMC_BLOCK_SIZE;
 
-      Status = MmcHostInstance->MmcHost->Prepare (MmcHostInstance->MmcHost, 0, sizeof(MmcExtCsd), (UINTN)&MmcExtCsd);
-      
-      if (EFI_ERROR (Status)) {
-        return Status;
-      }
-
-      /* MMC CMD8: SEND_EXT_CSD */
-      Status = MmcHostInstance->MmcHost->SendCommand (MmcHostInstance->MmcHost, MMC_CMD8, 0, MMC_RESPONSE_R1, NULL);
-      if (EFI_ERROR (Status)) {
-        return Status;
-      }
-
-      Status = MmcHostInstance->MmcHost->ReadBlockData (MmcHostInstance->MmcHost, 0, sizeof(MmcExtCsd), (UINT32*)MmcExtCsd);
+      Status = MmcEmmcReadExtCsd (MmcHostInstance);
       if (EFI_ERROR (Status)) {
         return Status;
       }
 
-      do {
-        Status = MmcDeviceState (MmcHostInstance, &State);
-        if (EFI_ERROR (Status)) {
-          return Status;
-        }
-      } while (State != MMC_R0_STATE_TRAN);
-
       NumBlocks = (MmcExtCsd[CMD_EXTCSD_SEC_CNT] << 0) |
             (MmcExtCsd[CMD_EXTCSD_SEC_CNT + 1] << 8) |
             (MmcExtCsd[CMD_EXTCSD_SEC_CNT + 2] << 16) |
@@ -333,6 +865,11 @@ MmcFillDeviceInfo (
       MmcDevInfo.DeviceSize = (unsigned long long)NumBlocks *
         MmcDevInfo.BlockSize;
 
+      MmcHostInstance->PartitionConfig     = MmcExtCsd[CMD_EXTCSD_PARTITION_CONFIG];
+      MmcHostInstance->BootWpStatus        = MmcExtCsd[CMD_EXTCSD_BOOT_WP_STATUS];
+      MmcHostInstance->BootPartitionBlocks = (MmcExtCsd[CMD_EXTCSD_BOOT_SIZE_MULT] * EXTCSD_BOOT_SIZE_UNIT) /
+                                             MmcDevInfo.BlockSize;
+
       break;
 
     case MMC_IS_SD:
@@ -414,9 +951,22 @@ SdSendOpCond (
   IN MMC_HOST_INSTANCE  *MmcHostInstance
   )
 {
-  EFI_STATUS Status;
-  INT32      I;
-  UINT32     Response[4];
+  EFI_STATUS              Status;
+  INT32                   I;
+  UINT32                  Response[4];
+  UINT32                  OpCondArg;
+  EFI_MMC_HOST_PROTOCOL   *MmcHost;
+
+  MmcHost   = MmcHostInstance->MmcHost;
+  OpCondArg = OCR_HCS | MmcDevInfo.OCRVoltage;
+
+  // Ask for 1.8V signaling while any UHS-I timing is still allowed
+  if (MMC_HOST_HAS_SETTIMING (MmcHost) &&
+      (MmcHost->SwitchSignalVoltage != NULL) &&
+      ((MmcHost->GetCapabilities (MmcHost) & MMC_HOST_CAP_1V8_SIGNALING) != 0U) &&
+      ((MmcHostInstance->TimingMask & MMC_TIMING_UHS_MASK) != 0U)) {
+    OpCondArg |= OCR_S18R;
+  }
 
   for (I = 0; I < SEND_OP_COND_MAX_RETRIES; I++) {
     // CMD55: Application Specific Command
@@ -426,8 +976,8 @@ SdSendOpCond (
     }
 
     // ACMD41: SD_SEND_OP_COND
-    Status = MmcHostInstance->MmcHost->SendCommand (MmcHostInstance->MmcHost, MMC_ACMD41, OCR_HCS |
-      MmcDevInfo.OCRVoltage, MMC_RESPONSE_R3, Response);
+    Status = MmcHostInstance->MmcHost->SendCommand (MmcHostInstance->MmcHost, MMC_ACMD41, OpCondArg,
+      MMC_RESPONSE_R3, Response);
     if (EFI_ERROR (Status)) {
       return Status;
     }
@@ -435,6 +985,11 @@ SdSendOpCond (
     if ((Response[0] & MMC_OCR_POWERUP) != 0U) {
       MmcOCR = Response[0];
 
+      // S18A is only meaningful when S18R was set
+      if ((OpCondArg & OCR_S18R) == 0U) {
+        MmcOCR &= ~OCR_S18A;
+      }
+
       if ((MmcOCR & OCR_HCS) != 0U) {
         MmcDevInfo.MmcDevType = MMC_IS_SD_HC;
         MmcHostInstance->CardInfo.OCRData.AccessMode = 0x2;
@@ -454,6 +1009,44 @@ SdSendOpCond (
   return EFI_DEVICE_ERROR;
 }
 
+/**
+  Switch the SD card and the host to 1.8V signaling.
+
+  On failure the UHS-I timings are dropped from the allowed timings, since
+  the card can only be brought back to 3.3V by a power cycle.
+
+  @param[in]     MmcHostInstance       Pointer to the MMC_HOST_INSTANCE structure.
+
+  @retval EFI_SUCCESS                   The bus runs at 1.8V.
+  @retval Other                         An error occurred, the card must be identified again.
+
+**/
+STATIC
+EFI_STATUS
+MmcSdSwitchVoltage (
+  IN MMC_HOST_INSTANCE  *MmcHostInstance
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      Response[4];
+
+  // CMD11: VOLTAGE_SWITCH
+  Status = MmcHostInstance->MmcHost->SendCommand (MmcHostInstance->MmcHost, MMC_CMD11, 0, MMC_RESPONSE_R1, Response);
+  if (!EFI_ERROR (Status)) {
+    Status = MmcHostInstance->MmcHost->SwitchSignalVoltage (MmcHostInstance->MmcHost);
+  }
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: 1.8V signaling failed (Status=%r)\n", __FUNCTION__, Status));
+    MmcHostInstance->TimingMask &= ~MMC_TIMING_UHS_MASK;
+    return EFI_DEVICE_ERROR;
+  }
+
+  MmcDevInfo.Signal1V8 = TRUE;
+
+  return EFI_SUCCESS;
+}
+
 /**
   Reset the MMC/SD card to the idle state.
 
@@ -517,6 +1110,14 @@ MmcSendOpCond (
 
     if ((Response[0] & MMC_OCR_POWERUP) != 0U) {
       MmcOCR = Response[0];
+      MmcDevInfo.MmcDevType = MMC_IS_EMMC;
+
+      if ((MmcOCR & OCR_ACCESS_MODE_MASK) == OCR_SECTOR_MODE) {
+        MmcHostInstance->CardInfo.OCRData.AccessMode = 0x2;
+      } else {
+        MmcHostInstance->CardInfo.OCRData.AccessMode = 0x0;
+      }
+
       return EFI_SUCCESS;
     }
 
@@ -551,6 +1152,11 @@ MmcEnumerte (
   UINT32      State;
   UINT32      Response[4];
 
+  MmcHostInstance->Timing        = MmcTimingLegacy;
+  MmcHostInstance->SetBlockCount = FALSE;
+  MmcDevInfo.Signal1V8           = FALSE;
+  ZeroMem (MmcSCR, sizeof (MmcSCR));
+
   Status = MmcResetToIdle (MmcHostInstance);
   if (EFI_ERROR (Status)) {
     return Status;
@@ -565,6 +1171,12 @@ MmcEnumerte (
 
     if ((Status == EFI_SUCCESS) && ((Response[0] & 0xffU) == CMD8_CHECK_PATTERN)) {
       Status = SdSendOpCond (MmcHostInstance);
+      if (!EFI_ERROR (Status) && ((MmcOCR & OCR_S18A) != 0U)) {
+        Status = MmcSdSwitchVoltage (MmcHostInstance);
+      }
+    } else {
+      // No SD interface condition, probe for an eMMC device
+      Status = MmcSendOpCond (MmcHostInstance);
     }
   }
   if (EFI_ERROR (Status)) {
@@ -623,7 +1235,22 @@ MmcEnumerte (
     return Status;
   }
 
-  return MmcFillDeviceInfo (MmcHostInstance);
+  Status = MmcFillDeviceInfo (MmcHostInstance);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  // CMD23 is mandatory for eMMC, optional for SD cards (SD 3.0 and later)
+  MmcHostInstance->SetBlockCount = (MmcDevInfo.MmcDevType == MMC_IS_EMMC) ||
+                                   ((MmcSCR[0] & SD_SCR_CMD23_SUPPORT) != 0U);
+
+  if (MmcDevInfo.MmcDevType != MMC_IS_EMMC) {
+    Status = MmcSdSelectTiming (MmcHostInstance);
+  } else {
+    Status = MmcEmmcSelectTiming (MmcHostInstance);
+  }
+
+  return Status;
 }
 
 /**
@@ -644,39 +1271,52 @@ MmcIdentificationMode (
   )
 {
   EFI_STATUS              Status;
-  UINTN                   CmdArg;
-  BOOLEAN                 IsHCS;
   EFI_MMC_HOST_PROTOCOL   *MmcHost;
+  UINT32                  TimingMask;
 
   MmcHost = MmcHostInstance->MmcHost;
-  CmdArg  = 0;
-  IsHCS   = FALSE;
 
   if (MmcHost == NULL) {
     return EFI_INVALID_PARAMETER;
   }
 
-  // We can get into this function if we restart the identification mode
-  if (MmcHostInstance->State == MmcHwInitializationState) {
-    // Initialize the MMC Host HW
-    Status = MmcNotifyState (MmcHostInstance, MmcHwInitializationState);
-    if (EFI_ERROR (Status)) {
-      DEBUG ((DEBUG_ERROR, "MmcIdentificationMode() : Error MmcHwInitializationState, Status=%r.\n", Status));
-      return Status;
+  do {
+    // We can get into this function if we restart the identification mode
+    if (MmcHostInstance->State == MmcHwInitializationState) {
+      // Initialize the MMC Host HW
+      Status = MmcNotifyState (MmcHostInstance, MmcHwInitializationState);
+      if (EFI_ERROR (Status)) {
+        DEBUG ((DEBUG_ERROR, "MmcIdentificationMode() : Error MmcHwInitializationState, Status=%r.\n", Status));
+        return Status;
+      }
     }
-  }
 
-  Status = MmcEnumerte (MmcHostInstance, 50 * 1000 * 1000, MMC_BUS_WIDTH_4);
+    MmcHostInstance->HostCaps = MMC_HOST_HAS_SETTIMING (MmcHost) ? MmcHost->GetCapabilities (MmcHost) : 0;
 
-  if (EFI_ERROR (Status)) {
+    // The bus timing is negotiated after enumeration, start at default speed
+    TimingMask = MmcHostInstance->TimingMask;
+    Status     = MmcEnumerte (MmcHostInstance, SD_DEFAULT_SPEED, MMC_BUS_WIDTH_4);
+
+    if (EFI_ERROR (Status)) {
       DEBUG ((DEBUG_ERROR, "MmcIdentificationMode() : Error MmcEnumerte, Status=%r.\n", Status));
-      return Status;
-  }
+
+      // Retry from power up while a bus timing has been given up
+      if (MmcHostInstance->TimingMask == TimingMask) {
+        return Status;
+      }
+
+      MmcHostInstance->State = MmcHwInitializationState;
+    }
+  } while (EFI_ERROR (Status));
 
   MmcHostInstance->CardInfo.RCA                = MmcRCA;
   MmcHostInstance->BlockIo.Media->LastBlock    = ((MmcDevInfo.DeviceSize >> 9) - 1);
   MmcHostInstance->BlockIo.Media->BlockSize    = MmcDevInfo.BlockSize;
   MmcHostInstance->BlockIo.Media->ReadOnly     = MmcHost->IsReadOnly (MmcHost);
+  MmcHostInstance->BlockIo.Media->RemovableMedia = (MmcDevInfo.MmcDevType != MMC_IS_EMMC);
+  // A host that maps any buffer for DMA spares DiskIo its own bounce copy
+  MmcHostInstance->BlockIo.Media->IoAlign      = ((MmcHostInstance->HostCaps & MMC_HOST_CAP_ANY_ALIGN) != 0U) ?
+                                                 0 : mMmcMediaTemplate.IoAlign;
   MmcHostInstance->BlockIo.Media->MediaPresent = TRUE;
   MmcHostInstance->BlockIo.Media->MediaId++;
 
@@ -734,5 +1374,89 @@ InitializeMmcDevice (
     }
   }
 
+  // The cache may hold blocks of a card that was swapped
+  MmcCacheInvalidate (MmcHostInstance);
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Drop the current bus timing after it produced transfer errors.
+
+  The timing is removed from the allowed timings and the card is identified
+  again, so it ends up in the fastest timing that is left.
+
+  @param[in] MmcHostInstance   MMC host instance
+
+  @retval EFI_SUCCESS          The card runs at a slower bus timing.
+  @retval EFI_UNSUPPORTED      The card already runs at the default timing.
+  @retval Other                MMC device initialization failed
+
+**/
+EFI_STATUS
+MmcDowngradeBusTiming (
+  IN  MMC_HOST_INSTANCE   *MmcHostInstance
+  )
+{
+  EFI_STATUS              Status;
+  UINT32                  MediaId;
+  UINT8                   Access;
+
+  if (MmcHostInstance->Timing == MmcTimingLegacy) {
+    return EFI_UNSUPPORTED;
+  }
+
+  DEBUG ((DEBUG_WARN, "%a: giving up bus timing %d\n", __FUNCTION__, MmcHostInstance->Timing));
+
+  MmcHostInstance->TimingMask &= ~MMC_TIMING_BIT (MmcHostInstance->Timing);
+  MmcHostInstance->State       = MmcHwInitializationState;
+
+  // Same card, keep the media of the existing BlockIo consumers valid
+  MediaId = MmcHostInstance->BlockIo.Media->MediaId;
+  Access  = MmcHostInstance->PartitionConfig & EXTCSD_PART_ACCESS_MASK;
+  Status  = InitializeMmcDevice (MmcHostInstance);
+  MmcHostInstance->BlockIo.Media->MediaId = MediaId;
+
+  // The reset selected the user area, a boot partition transfer continues where it was
+  if (!EFI_ERROR (Status) && (Access != 0U)) {
+    Status = MmcSwitchPartition (MmcHostInstance, Access);
+  }
+
+  return Status;
+}
+
+/**
+  Select the eMMC hardware partition the following transfers go to.
+
+  @param[in] MmcHostInstance   MMC host instance
+  @param[in] Access            PARTITION_ACCESS value, 0 for the user area
+
+  @retval EFI_SUCCESS          The partition is selected.
+  @retval Other                The card refused the switch.
+
+**/
+EFI_STATUS
+MmcSwitchPartition (
+  IN  MMC_HOST_INSTANCE     *MmcHostInstance,
+  IN  UINT8                 Access
+  )
+{
+  EFI_STATUS              Status;
+  UINT8                   Config;
+
+  if ((MmcHostInstance->PartitionConfig & EXTCSD_PART_ACCESS_MASK) == Access) {
+    return EFI_SUCCESS;
+  }
+
+  Config = (MmcHostInstance->PartitionConfig & ~EXTCSD_PART_ACCESS_MASK) | Access;
+
+  Status = MmcSetExtCsd (MmcHostInstance, CMD_EXTCSD_PARTITION_CONFIG, Config);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: partition %d not selected (Status=%r)\n", __FUNCTION__, Access, Status));
+    return Status;
+  }
+
+  MmcHostInstance->PartitionConfig = Config;
+
   return EFI_SUCCESS;
 }
@@ -1077,5 +1077,10 @@ FvbInitialize (
   // Module type specific hook.
   //
   InstallVirtualAddressChangeHandler ();
+
+  //
+  // Persist the variable store across boots
+  //
+  RamFlashInstallFlushHandlers ();
   return EFI_SUCCESS;
 }
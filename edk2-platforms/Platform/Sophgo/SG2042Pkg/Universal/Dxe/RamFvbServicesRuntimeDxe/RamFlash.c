@@ -8,15 +8,27 @@
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
 #include <Library/IoLib.h>
+#include <Library/MemoryAllocationLib.h>
 #include <Library/PcdLib.h>
 
 #include "RamFlash.h"
 
 VOID *mFlashBase;
 
+//
+// One bit per block written since the last flush
+//
+UINT8 *mFlashDirtyBlocks;
+
 STATIC UINTN       mFdBlockSize = 0;
 STATIC UINTN       mFdBlockCount = 0;
 
+STATIC CONST RAM_FLASH_BACKEND  *mRamFlashBackends[] = {
+  &mRamFlashFileBackend,
+};
+
+#define RAM_FLASH_BLOCK_DIRTY(Lba)  ((mFlashDirtyBlocks[(Lba) / 8] & (1U << ((Lba) % 8))) != 0)
+
 /**
   Get the pointer to a specific location in the Flash memory.
 
@@ -95,6 +107,8 @@ RamFlashWrite (
 {
   UINT8  *Ptr;
   UINTN  i;
+  UINTN  Start;
+  UINTN  End;
 
   //
   // Only write to the first 64k. We don't bother saving the FTW Spare
@@ -104,6 +118,10 @@ RamFlashWrite (
     return EFI_INVALID_PARAMETER;
   }
 
+  if (RamFlashWriteProtected ()) {
+    return EFI_WRITE_PROTECTED;
+  }
+
   //
   // Program flash
   //
@@ -113,6 +131,17 @@ RamFlashWrite (
      Ptr ++;
   }
 
+  //
+  // Remember the blocks for the next flush
+  //
+  if ((mFlashDirtyBlocks != NULL) && (*NumBytes != 0)) {
+    Start = (UINTN)Lba + Offset / mFdBlockSize;
+    End   = MIN ((UINTN)Lba + (Offset + *NumBytes - 1) / mFdBlockSize, mFdBlockCount - 1);
+    for ( ; Start <= End; Start++) {
+      mFlashDirtyBlocks[Start / 8] |= (UINT8)(1U << (Start % 8));
+    }
+  }
+
   return EFI_SUCCESS;
 }
 
@@ -128,11 +157,95 @@ RamFlashEraseBlock (
   IN   EFI_LBA      Lba
   )
 {
+  if (RamFlashWriteProtected ()) {
+    return EFI_WRITE_PROTECTED;
+  }
 
   return EFI_SUCCESS;
 }
 
 
+/**
+  Write the blocks changed since the last flush to the persistent store.
+
+  Runs of dirty blocks are written with a single request each, and all of
+  them go to the first backend that finds its store.
+
+  @retval EFI_SUCCESS           The dirty blocks were written, or there were none.
+  @retval EFI_NOT_FOUND         No persistent store is available.
+  @retval Others                The blocks could not be written.
+
+**/
+EFI_STATUS
+RamFlashFlush (
+  VOID
+  )
+{
+  EFI_STATUS               Status;
+  CONST RAM_FLASH_BACKEND  *Backend;
+  VOID                     *Context;
+  UINTN                    Index;
+  UINTN                    Lba;
+  UINTN                    Run;
+
+  if (mFlashDirtyBlocks == NULL) {
+    return EFI_SUCCESS;
+  }
+
+  for (Lba = 0; Lba < mFdBlockCount; Lba++) {
+    if (RAM_FLASH_BLOCK_DIRTY (Lba)) {
+      break;
+    }
+  }
+
+  if (Lba == mFdBlockCount) {
+    return EFI_SUCCESS;
+  }
+
+  Backend = NULL;
+  Status  = EFI_NOT_FOUND;
+  for (Index = 0; Index < ARRAY_SIZE (mRamFlashBackends); Index++) {
+    Status = mRamFlashBackends[Index]->Open (&Context);
+    if (!EFI_ERROR (Status)) {
+      Backend = mRamFlashBackends[Index];
+      break;
+    }
+  }
+
+  if (Backend == NULL) {
+    return Status;
+  }
+
+  while (Lba < mFdBlockCount) {
+    if (!RAM_FLASH_BLOCK_DIRTY (Lba)) {
+      Lba++;
+      continue;
+    }
+
+    for (Run = 1; (Lba + Run < mFdBlockCount) && RAM_FLASH_BLOCK_DIRTY (Lba + Run); Run++) {
+    }
+
+    Status = Backend->Write (Context, Lba * mFdBlockSize, RamFlashPtr (Lba, 0), Run * mFdBlockSize);
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+
+    for ( ; Run > 0; Run--, Lba++) {
+      mFlashDirtyBlocks[Lba / 8] &= (UINT8)~(1U << (Lba % 8));
+    }
+  }
+
+  if (EFI_ERROR (Status)) {
+    Backend->Close (Context);
+  } else {
+    Status = Backend->Close (Context);
+  }
+
+  DEBUG ((DEBUG_INFO, "RamFlashFlush(): %s: %r\n", Backend->Name, Status));
+  return Status;
+}
+
+
 /**
   Initializes Ram flash memory support
 
@@ -150,5 +263,8 @@ RamFlashInitialize (
   ASSERT(PcdGet32 (PcdVariableFdSize) % mFdBlockSize == 0);
   mFdBlockCount = PcdGet32 (PcdVariableFdSize) / mFdBlockSize;
 
+  mFlashDirtyBlocks = AllocateRuntimeZeroPool ((mFdBlockCount + 7) / 8);
+  ASSERT (mFlashDirtyBlocks != NULL);
+
   return EFI_SUCCESS;
 }
@@ -13,6 +13,42 @@
 #include <Protocol/FirmwareVolumeBlock.h>
 
 extern VOID *mFlashBase;
+extern UINT8 *mFlashDirtyBlocks;
+
+//
+// A persistent store for the contents of the Ram flash. The dirty blocks are
+// written to it in one session, with one Write() per run of dirty blocks.
+// Backends are only used while boot services are available.
+//
+typedef struct {
+  CONST CHAR16    *Name;
+
+  //
+  // Find the store and open a write session on it.
+  //
+  EFI_STATUS      (*Open) (
+                    OUT VOID  **Context
+                    );
+
+  //
+  // Write Length bytes at Offset from the start of the Ram flash.
+  //
+  EFI_STATUS      (*Write) (
+                    IN VOID         *Context,
+                    IN UINTN        Offset,
+                    IN CONST UINT8  *Buffer,
+                    IN UINTN        Length
+                    );
+
+  //
+  // Commit the writes and end the session.
+  //
+  EFI_STATUS      (*Close) (
+                    IN VOID  *Context
+                    );
+} RAM_FLASH_BACKEND;
+
+extern CONST RAM_FLASH_BACKEND  mRamFlashFileBackend;
 
 /**
   Read from Ram Flash
@@ -64,6 +100,43 @@ RamFlashEraseBlock (
   );
 
 
+/**
+  Write the blocks changed since the last flush to the persistent store.
+
+  @retval EFI_SUCCESS           The dirty blocks were written, or there were none.
+  @retval EFI_NOT_FOUND         No persistent store is available.
+  @retval Others                The blocks could not be written.
+
+**/
+EFI_STATUS
+RamFlashFlush (
+  VOID
+  );
+
+
+/**
+  Flush the Ram flash before ExitBootServices() and before a reset.
+
+**/
+VOID
+RamFlashInstallFlushHandlers (
+  VOID
+  );
+
+
+/**
+  Check whether writes to the Ram flash have to be refused.
+
+  @retval TRUE    The Ram flash is persistent and boot services are gone.
+  @retval FALSE   The Ram flash can be written.
+
+**/
+BOOLEAN
+RamFlashWriteProtected (
+  VOID
+  );
+
+
 /**
   Initializes Ram flash memory support
 
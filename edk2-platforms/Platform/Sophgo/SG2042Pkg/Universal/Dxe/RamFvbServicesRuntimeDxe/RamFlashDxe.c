@@ -7,10 +7,153 @@
 
 **/
 
+#include <Guid/EventGroup.h>
+#include <Library/DebugLib.h>
+#include <Library/PcdLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
 #include <Library/UefiRuntimeLib.h>
+#include <Protocol/ResetNotification.h>
 
 #include "RamFlash.h"
 
+STATIC VOID     *mResetNotificationRegistration;
+STATIC BOOLEAN  mRamFlashPersistent;
+
+/**
+  Flush the Ram flash before ExitBootServices().
+
+  @param[in] Event    The event.
+  @param[in] Context  Not used.
+
+**/
+STATIC
+VOID
+EFIAPI
+RamFlashBeforeExitBootServices (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  RamFlashFlush ();
+}
+
+/**
+  Flush the Ram flash before a reset, as long as boot services are
+  available and the caller allows file system access.
+
+  @param[in] ResetType    The type of reset to perform.
+  @param[in] ResetStatus  The status code for the reset.
+  @param[in] DataSize     The size, in bytes, of ResetData.
+  @param[in] ResetData    Optional data for the reset.
+
+**/
+STATIC
+VOID
+EFIAPI
+RamFlashResetNotify (
+  IN EFI_RESET_TYPE  ResetType,
+  IN EFI_STATUS      ResetStatus,
+  IN UINTN           DataSize,
+  IN VOID            *ResetData OPTIONAL
+  )
+{
+  if (EfiAtRuntime () || (EfiGetCurrentTpl () > TPL_CALLBACK)) {
+    return;
+  }
+
+  RamFlashFlush ();
+}
+
+/**
+  Register RamFlashResetNotify() once the reset notification protocol is
+  installed.
+
+  @param[in] Event    The event.
+  @param[in] Context  Not used.
+
+**/
+STATIC
+VOID
+EFIAPI
+RamFlashResetNotificationInstalled (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  EFI_STATUS                       Status;
+  EFI_RESET_NOTIFICATION_PROTOCOL  *ResetNotify;
+
+  Status = gBS->LocateProtocol (
+                  &gEfiResetNotificationProtocolGuid,
+                  mResetNotificationRegistration,
+                  (VOID **)&ResetNotify
+                  );
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  gBS->CloseEvent (Event);
+
+  Status = ResetNotify->RegisterResetNotify (ResetNotify, RamFlashResetNotify);
+  ASSERT_EFI_ERROR (Status);
+}
+
+/**
+  Flush the Ram flash before ExitBootServices() and before a reset, unless
+  the variable store is kept in RAM only.
+
+**/
+VOID
+RamFlashInstallFlushHandlers (
+  VOID
+  )
+{
+  EFI_STATUS  Status;
+  EFI_EVENT   Event;
+
+  if (*(CHAR16 *)PcdGetPtr (PcdSG2042VariableStoreFile) == L'\0') {
+    return;
+  }
+
+  mRamFlashPersistent = TRUE;
+
+  Status = gBS->CreateEventEx (
+                  EVT_NOTIFY_SIGNAL,
+                  TPL_CALLBACK,
+                  RamFlashBeforeExitBootServices,
+                  NULL,
+                  &gEfiEventBeforeExitBootServicesGuid,
+                  &Event
+                  );
+  ASSERT_EFI_ERROR (Status);
+
+  EfiCreateProtocolNotifyEvent (
+    &gEfiResetNotificationProtocolGuid,
+    TPL_CALLBACK,
+    RamFlashResetNotificationInstalled,
+    NULL,
+    &mResetNotificationRegistration
+    );
+}
+
+/**
+  Check whether writes to the Ram flash have to be refused. The persistent
+  store can only be written while boot services are available, so a write
+  made at OS runtime would silently be undone by the next boot.
+
+  @retval TRUE    The Ram flash is persistent and boot services are gone.
+  @retval FALSE   The Ram flash can be written.
+
+**/
+BOOLEAN
+RamFlashWriteProtected (
+  VOID
+  )
+{
+  return mRamFlashPersistent && EfiAtRuntime ();
+}
+
 /**
   Convert the pointers from RAM to Flash memory.
 
@@ -21,4 +164,5 @@ RamFlashConvertPointers (
   )
 {
   EfiConvertPointer (0x0, (VOID **) &mFlashBase);
+  EfiConvertPointer (0x0, (VOID **) &mFlashDirtyBlocks);
 }
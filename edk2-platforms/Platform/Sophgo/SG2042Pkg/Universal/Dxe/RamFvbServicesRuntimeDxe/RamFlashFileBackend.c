@@ -0,0 +1,254 @@
+/** @file
+  Ram flash backend that writes the variable store to its own file on the
+  boot volume, from which the boot loader loads it on the next boot. The
+  firmware image file is never written, so an interrupted write can only
+  lose variables.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PcdLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Pi/PiFirmwareVolume.h>
+#include <Protocol/SimpleFileSystem.h>
+
+#include "RamFlash.h"
+
+/**
+  Open the variable store file on a file system, if the file system also holds
+  the firmware image file, and so is the one the boot loader loads from.
+
+  A store file that is missing, or that does not hold the variable FV of the
+  Ram flash, is created or rewritten with the whole Ram flash.
+
+  @param[in]  Handle    Handle with the simple file system protocol.
+  @param[out] File      The open variable store file.
+
+  @retval EFI_SUCCESS   The file was opened.
+  @retval Others        The file system is not the boot volume, or the store
+                        file could not be written.
+
+**/
+STATIC
+EFI_STATUS
+RamFlashFileOpenStore (
+  IN  EFI_HANDLE          Handle,
+  OUT EFI_FILE_PROTOCOL   **File
+  )
+{
+  EFI_STATUS                       Status;
+  EFI_SIMPLE_FILE_SYSTEM_PROTOCOL  *FileSystem;
+  EFI_FILE_PROTOCOL                *Root;
+  EFI_FILE_PROTOCOL                *Image;
+  EFI_FIRMWARE_VOLUME_HEADER       FvHeader;
+  EFI_FIRMWARE_VOLUME_HEADER       *RamFvHeader;
+  UINT64                           FileSize;
+  UINTN                            Size;
+
+  Status = gBS->HandleProtocol (Handle, &gEfiSimpleFileSystemProtocolGuid, (VOID **)&FileSystem);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = FileSystem->OpenVolume (FileSystem, &Root);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // The firmware image file is only probed, and never written
+  //
+  Status = Root->Open (
+                   Root,
+                   &Image,
+                   (CHAR16 *)PcdGetPtr (PcdSG2042FirmwareImageFile),
+                   EFI_FILE_MODE_READ,
+                   0
+                   );
+  if (!EFI_ERROR (Status)) {
+    Image->Close (Image);
+    Status = Root->Open (
+                     Root,
+                     File,
+                     (CHAR16 *)PcdGetPtr (PcdSG2042VariableStoreFile),
+                     EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE,
+                     0
+                     );
+  }
+
+  Root->Close (Root);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // Only the dirty blocks are written from here on, so the file has to be
+  // large enough and hold the same variable FV already
+  //
+  RamFvHeader = (EFI_FIRMWARE_VOLUME_HEADER *)mFlashBase;
+  Size        = sizeof (FvHeader);
+
+  Status = (*File)->SetPosition (*File, MAX_UINT64);
+  if (!EFI_ERROR (Status)) {
+    Status = (*File)->GetPosition (*File, &FileSize);
+  }
+
+  if (!EFI_ERROR (Status)) {
+    Status = (*File)->SetPosition (*File, 0);
+  }
+
+  if (!EFI_ERROR (Status) && (FileSize >= PcdGet32 (PcdVariableFdSize))) {
+    Status = (*File)->Read (*File, &Size, &FvHeader);
+    if (!EFI_ERROR (Status) &&
+        (Size == sizeof (FvHeader)) &&
+        (FvHeader.Signature == EFI_FVH_SIGNATURE) &&
+        (FvHeader.FvLength == RamFvHeader->FvLength) &&
+        CompareGuid (&FvHeader.FileSystemGuid, &RamFvHeader->FileSystemGuid))
+    {
+      return EFI_SUCCESS;
+    }
+  }
+
+  if (!EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_INFO, "RamFlashFileOpenStore(): initializing %s\n", (CHAR16 *)PcdGetPtr (PcdSG2042VariableStoreFile)));
+    Status = (*File)->SetPosition (*File, 0);
+  }
+
+  if (!EFI_ERROR (Status)) {
+    Size   = PcdGet32 (PcdVariableFdSize);
+    Status = (*File)->Write (*File, &Size, mFlashBase);
+    if (!EFI_ERROR (Status) && (Size != PcdGet32 (PcdVariableFdSize))) {
+      Status = EFI_DEVICE_ERROR;
+    }
+  }
+
+  if (EFI_ERROR (Status)) {
+    (*File)->Close (*File);
+  }
+
+  return Status;
+}
+
+/**
+  Find the boot volume and open the variable store file on it for writing.
+
+  @param[out] Context   The open file.
+
+  @retval EFI_SUCCESS   The file was opened.
+  @retval EFI_NOT_FOUND The boot volume was not found.
+
+**/
+STATIC
+EFI_STATUS
+RamFlashFileOpen (
+  OUT VOID  **Context
+  )
+{
+  EFI_STATUS         Status;
+  EFI_HANDLE         *Handles;
+  UINTN              HandleCount;
+  UINTN              Index;
+  EFI_FILE_PROTOCOL  *File;
+
+  Status = gBS->LocateHandleBuffer (
+                  ByProtocol,
+                  &gEfiSimpleFileSystemProtocolGuid,
+                  NULL,
+                  &HandleCount,
+                  &Handles
+                  );
+  if (EFI_ERROR (Status)) {
+    return EFI_NOT_FOUND;
+  }
+
+  Status = EFI_NOT_FOUND;
+  for (Index = 0; Index < HandleCount; Index++) {
+    if (!EFI_ERROR (RamFlashFileOpenStore (Handles[Index], &File))) {
+      *Context = File;
+      Status   = EFI_SUCCESS;
+      break;
+    }
+  }
+
+  FreePool (Handles);
+  return Status;
+}
+
+/**
+  Write to the variable store file.
+
+  @param[in] Context    The open file.
+  @param[in] Offset     Offset from the start of the Ram flash.
+  @param[in] Buffer     The data to write.
+  @param[in] Length     The number of bytes to write.
+
+  @retval EFI_SUCCESS   The data was written.
+  @retval Others        The data could not be written.
+
+**/
+STATIC
+EFI_STATUS
+RamFlashFileWrite (
+  IN VOID         *Context,
+  IN UINTN        Offset,
+  IN CONST UINT8  *Buffer,
+  IN UINTN        Length
+  )
+{
+  EFI_STATUS         Status;
+  EFI_FILE_PROTOCOL  *File;
+  UINTN              Size;
+
+  File = Context;
+
+  Status = File->SetPosition (File, Offset);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Size   = Length;
+  Status = File->Write (File, &Size, (VOID *)Buffer);
+  if (!EFI_ERROR (Status) && (Size != Length)) {
+    Status = EFI_DEVICE_ERROR;
+  }
+
+  return Status;
+}
+
+/**
+  Flush and close the variable store file.
+
+  @param[in] Context    The open file.
+
+  @retval EFI_SUCCESS   The file was flushed.
+  @retval Others        The file could not be flushed.
+
+**/
+STATIC
+EFI_STATUS
+RamFlashFileClose (
+  IN VOID  *Context
+  )
+{
+  EFI_STATUS         Status;
+  EFI_FILE_PROTOCOL  *File;
+
+  File   = Context;
+  Status = File->Flush (File);
+  File->Close (File);
+
+  return Status;
+}
+
+CONST RAM_FLASH_BACKEND  mRamFlashFileBackend = {
+  L"variable store file",
+  RamFlashFileOpen,
+  RamFlashFileWrite,
+  RamFlashFileClose
+};
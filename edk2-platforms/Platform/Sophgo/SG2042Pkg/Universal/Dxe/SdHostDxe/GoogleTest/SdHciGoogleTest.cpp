@@ -0,0 +1,420 @@
+/** @file
+  Host test of the ADMA2 data path of SdHostDxe.
+
+  The descriptor table builder is checked against the limits of the ADMA2
+  engine: 64KB per line, no line across a 128MB boundary and the End
+  attribute on the last line. The transfers run through BmSdPrepare () and
+  BmSdSendCmd () against the register model of SdHciModel.c, which walks the
+  descriptor table the way the controller does. A transfer that hangs or
+  fails is checked to return, to leave the interrupt status clear, to reset
+  the CMD and DAT lines and to release its DMA mapping, so the next
+  transfer succeeds.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+#include <Library/GoogleTestLib.h>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+  #include <Uefi.h>
+  #include <Library/BaseLib.h>
+  #include <Library/MemoryAllocationLib.h>
+  #include <Include/MmcHost.h>
+  #include "../SdHci.h"
+  #include "SdHciModel.h"
+}
+
+using namespace testing;
+
+#define CARD_BLOCKS  (128 * 1024)
+
+//
+// The descriptor table builder
+//
+class SdAdmaDescTableTest : public Test {
+protected:
+  SDHCI_ADMA2_64_DESC_LINE  Table[64];
+  UINTN                     LineCount;
+
+  VOID
+  SetUp (
+    ) override
+  {
+    memset (Table, 0xAA, sizeof (Table));
+    LineCount = 0;
+  }
+
+  UINT64
+  LineAddress (
+    UINTN  Index
+    )
+  {
+    return ((UINT64)Table[Index].UpperAddress << 32) | Table[Index].LowerAddress;
+  }
+
+  UINT64
+  LineLength (
+    UINTN  Index
+    )
+  {
+    return (Table[Index].LowerLength == 0) ? SIZE_64KB : Table[Index].LowerLength;
+  }
+
+  //
+  // Every line is a valid TRAN line that follows the previous one, only the
+  // last one ends the table, and the lines add up to the transfer.
+  //
+  VOID
+  CheckTable (
+    UINT64  Address,
+    UINTN   Size
+    )
+  {
+    UINT64  Total;
+
+    Total = 0;
+    for (UINTN Index = 0; Index < LineCount; Index++) {
+      EXPECT_EQ (Table[Index].Valid, 1U);
+      EXPECT_EQ (Table[Index].Act, (UINT32)SDHCI_ADMA2_ACT_TRAN);
+      EXPECT_EQ (Table[Index].End, (Index == LineCount - 1) ? 1U : 0U);
+      EXPECT_EQ (Table[Index].UpperLength, 0U);
+      EXPECT_EQ (LineAddress (Index), Address + Total);
+      EXPECT_LE (LineLength (Index), (UINT64)SDHCI_ADMA2_MAX_LEN_PER_LINE);
+      EXPECT_EQ (
+        LineAddress (Index) / SDHCI_ADMA2_BOUNDARY,
+        (LineAddress (Index) + LineLength (Index) - 1) / SDHCI_ADMA2_BOUNDARY
+        );
+      Total += LineLength (Index);
+    }
+
+    EXPECT_EQ (Total, (UINT64)Size);
+  }
+};
+
+TEST_F (SdAdmaDescTableTest, SingleLine) {
+  ASSERT_EQ (SdAdmaBuildDescTable (Table, 64, 0x80001000, SIZE_4KB, &LineCount), EFI_SUCCESS);
+  EXPECT_EQ (LineCount, 1U);
+  EXPECT_EQ (Table[0].LowerLength, (UINT32)SIZE_4KB);
+  CheckTable (0x80001000, SIZE_4KB);
+}
+
+TEST_F (SdAdmaDescTableTest, SplitsAt64KB) {
+  ASSERT_EQ (SdAdmaBuildDescTable (Table, 64, 0x80000000, SIZE_1MB + 512, &LineCount), EFI_SUCCESS);
+  EXPECT_EQ (LineCount, 17U);
+
+  // a full line is encoded with a zero length
+  EXPECT_EQ (Table[0].LowerLength, 0U);
+  EXPECT_EQ (Table[16].LowerLength, 512U);
+  CheckTable (0x80000000, SIZE_1MB + 512);
+}
+
+TEST_F (SdAdmaDescTableTest, Exactly64KB) {
+  ASSERT_EQ (SdAdmaBuildDescTable (Table, 64, 0x80000000, SIZE_64KB, &LineCount), EFI_SUCCESS);
+  EXPECT_EQ (LineCount, 1U);
+  EXPECT_EQ (Table[0].LowerLength, 0U);
+  CheckTable (0x80000000, SIZE_64KB);
+}
+
+TEST_F (SdAdmaDescTableTest, StopsAt128MBBoundary) {
+  UINT64  Address;
+
+  Address = SDHCI_ADMA2_BOUNDARY - SIZE_4KB;
+  ASSERT_EQ (SdAdmaBuildDescTable (Table, 64, Address, SIZE_64KB, &LineCount), EFI_SUCCESS);
+  EXPECT_EQ (LineCount, 2U);
+  EXPECT_EQ (LineLength (0), (UINT64)SIZE_4KB);
+  EXPECT_EQ (LineAddress (1), (UINT64)SDHCI_ADMA2_BOUNDARY);
+  CheckTable (Address, SIZE_64KB);
+}
+
+TEST_F (SdAdmaDescTableTest, CrossesTo64BitAddress) {
+  UINT64  Address;
+
+  Address = BASE_4GB - 3 * 512;
+  ASSERT_EQ (SdAdmaBuildDescTable (Table, 64, Address, SIZE_128KB, &LineCount), EFI_SUCCESS);
+  EXPECT_EQ (LineCount, 3U);
+  EXPECT_EQ (Table[0].UpperAddress, 0U);
+  EXPECT_EQ (Table[1].UpperAddress, 1U);
+  EXPECT_EQ (Table[1].LowerAddress, 0U);
+  CheckTable (Address, SIZE_128KB);
+}
+
+TEST_F (SdAdmaDescTableTest, TooSmall) {
+  SDHCI_ADMA2_64_DESC_LINE  Untouched[64];
+
+  memcpy (Untouched, Table, sizeof (Table));
+  EXPECT_EQ (SdAdmaBuildDescTable (Table, 15, 0x80000000, SIZE_1MB, &LineCount), EFI_BUFFER_TOO_SMALL);
+  EXPECT_EQ (LineCount, 16U);
+  EXPECT_EQ (memcmp (Untouched, Table, sizeof (Table)), 0);
+
+  // a NULL table asks for the number of lines
+  EXPECT_EQ (SdAdmaBuildDescTable (NULL, 0, 0x80000000, SIZE_1MB + 512, &LineCount), EFI_BUFFER_TOO_SMALL);
+  EXPECT_EQ (LineCount, 17U);
+
+  ASSERT_EQ (SdAdmaBuildDescTable (Table, 16, 0x80000000, SIZE_1MB, &LineCount), EFI_SUCCESS);
+  CheckTable (0x80000000, SIZE_1MB);
+}
+
+TEST_F (SdAdmaDescTableTest, InvalidParameters) {
+  EXPECT_EQ (SdAdmaBuildDescTable (Table, 64, 0x80000000, 0, &LineCount), EFI_INVALID_PARAMETER);
+  EXPECT_EQ (SdAdmaBuildDescTable (Table, 64, 0x80000002, 512, &LineCount), EFI_INVALID_PARAMETER);
+  EXPECT_EQ (SdAdmaBuildDescTable (Table, 64, 0x80000000, 512, NULL), EFI_INVALID_PARAMETER);
+}
+
+//
+// Transfers through the register model
+//
+class SdHciTransferTest : public Test {
+protected:
+  VOID
+  SetUp (
+    ) override
+  {
+    UINT32  *Card;
+
+    SdHciModelReset (CARD_BLOCKS);
+    Card = (UINT32 *)SdHciModelCard ();
+    for (UINTN Index = 0; Index < (UINTN)CARD_BLOCKS * MMC_BLOCK_SIZE / sizeof (UINT32); Index++) {
+      Card[Index] = (UINT32)(Index * 2654435761U);
+    }
+
+    ASSERT_EQ (SdInit (0), EFI_SUCCESS);
+    mSdHciModelStatistics.StallTime = 0;
+  }
+
+  VOID
+  TearDown (
+    ) override
+  {
+    SdHciModelFree ();
+  }
+
+  EFI_STATUS
+  Transfer (
+    UINT32  Cmd,
+    UINT32  Lba,
+    VOID    *Buffer,
+    UINTN   Size
+    )
+  {
+    EFI_STATUS  Status;
+    UINT32      Response[4];
+
+    Status = BmSdPrepare (Lba, (UINTN)Buffer, Size);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    return BmSdSendCmd (Cmd, Lba, MMC_RESPONSE_R1, Response);
+  }
+
+  BOOLEAN
+  MatchesCard (
+    VOID    *Buffer,
+    UINT32  Lba,
+    UINTN   Size
+    )
+  {
+    return memcmp (Buffer, SdHciModelCard () + (UINTN)Lba * MMC_BLOCK_SIZE, Size) == 0;
+  }
+
+  UINT32
+  ExpectedLines (
+    VOID   *Buffer,
+    UINTN  Size
+    )
+  {
+    UINTN  LineCount;
+
+    SdAdmaBuildDescTable (NULL, 0, (UINTN)Buffer, Size, &LineCount);
+    return (UINT32)LineCount;
+  }
+
+  //
+  // A failed transfer leaves the host ready for the next command.
+  //
+  VOID
+  CheckRecovered (
+    UINT32  ResetsBefore
+    )
+  {
+    EXPECT_EQ (SdHciModelRegister16 (SDHCI_INT_STATUS), 0);
+    EXPECT_EQ (SdHciModelRegister16 (SDHCI_ERR_INT_STATUS), 0);
+    EXPECT_EQ (mSdHciModelStatistics.CmdDataResets, ResetsBefore + 1);
+  }
+};
+
+TEST_F (SdHciTransferTest, ReadMultipleBlocks) {
+  std::vector<UINT8>  Buffer (SIZE_256KB + 4);
+  UINT8               *Data;
+
+  Data = (UINT8 *)ALIGN_POINTER (Buffer.data (), 4);
+  ASSERT_EQ (Transfer (MMC_CMD18, 100, Data, SIZE_256KB), EFI_SUCCESS);
+  EXPECT_TRUE (MatchesCard (Data, 100, SIZE_256KB));
+  EXPECT_EQ (mSdHciModelStatistics.Lines, ExpectedLines (Data, SIZE_256KB));
+  EXPECT_EQ (mSdHciModelStatistics.BytesMoved, (UINT64)SIZE_256KB);
+  EXPECT_EQ (SdHciModelRegister16 (SDHCI_INT_STATUS), 0);
+}
+
+TEST_F (SdHciTransferTest, WriteMultipleBlocks) {
+  std::vector<UINT8>  Buffer (SIZE_128KB + 4);
+  UINT8               *Data;
+
+  Data = (UINT8 *)ALIGN_POINTER (Buffer.data (), 4);
+  for (UINTN Index = 0; Index < SIZE_128KB; Index++) {
+    Data[Index] = (UINT8)(Index ^ 0x5A);
+  }
+
+  ASSERT_EQ (Transfer (MMC_CMD25, 7, Data, SIZE_128KB), EFI_SUCCESS);
+  EXPECT_TRUE (MatchesCard (Data, 7, SIZE_128KB));
+  EXPECT_EQ (mSdHciModelStatistics.Lines, ExpectedLines (Data, SIZE_128KB));
+}
+
+//
+// A transfer longer than the initial table grows it, and is still described
+// by a single table.
+//
+TEST_F (SdHciTransferTest, GrowsDescriptorTable) {
+  UINTN  Size;
+  UINTN  Lines;
+  UINT8  *Data;
+
+  Lines = EFI_PAGES_TO_SIZE (SDHCI_ADMA2_DESC_PAGES) / sizeof (SDHCI_ADMA2_64_DESC_LINE);
+  Size  = (Lines + 8) * SIZE_64KB;
+  ASSERT_LE (Size, (UINTN)CARD_BLOCKS * MMC_BLOCK_SIZE);
+
+  Data = (UINT8 *)AllocatePages (EFI_SIZE_TO_PAGES (Size));
+  ASSERT_NE (Data, nullptr);
+  ASSERT_EQ (Transfer (MMC_CMD18, 0, Data, Size), EFI_SUCCESS);
+  EXPECT_TRUE (MatchesCard (Data, 0, Size));
+  EXPECT_GE (mSdHciModelStatistics.Lines, (UINT32)(Lines + 8));
+  EXPECT_GT (mSdHciModelStatistics.PagesAllocated, 0U);
+  FreePages (Data, EFI_SIZE_TO_PAGES (Size));
+}
+
+//
+// A short transfer may be complete by the time the driver sees the command
+// complete, its transfer complete status must not be lost.
+//
+TEST_F (SdHciTransferTest, DataCompletesWithCommand) {
+  std::vector<UINT8>  Buffer (MMC_BLOCK_SIZE + 4);
+  UINT8               *Data;
+
+  Data                 = (UINT8 *)ALIGN_POINTER (Buffer.data (), 4);
+  mSdHciModelBlockTime = 0;
+  ASSERT_EQ (Transfer (MMC_CMD17, 5, Data, MMC_BLOCK_SIZE), EFI_SUCCESS);
+  EXPECT_TRUE (MatchesCard (Data, 5, MMC_BLOCK_SIZE));
+  EXPECT_EQ (mSdHciModelStatistics.StallTime, 0U);
+}
+
+//
+// Buffers the engine cannot address go through the bounce buffer.
+//
+TEST_F (SdHciTransferTest, MisalignedBuffersBounce) {
+  std::vector<UINT8>  Buffer (SIZE_64KB + 8);
+  UINT8               *Data;
+
+  Data = (UINT8 *)ALIGN_POINTER (Buffer.data (), 4) + 1;
+  ASSERT_EQ (Transfer (MMC_CMD18, 300, Data, SIZE_64KB), EFI_SUCCESS);
+  EXPECT_TRUE (MatchesCard (Data, 300, SIZE_64KB));
+
+  for (UINTN Index = 0; Index < SIZE_64KB; Index++) {
+    Data[Index] = (UINT8)~Index;
+  }
+
+  ASSERT_EQ (Transfer (MMC_CMD25, 900, Data, SIZE_64KB), EFI_SUCCESS);
+  EXPECT_TRUE (MatchesCard (Data, 900, SIZE_64KB));
+}
+
+//
+// A transfer that never completes times out after the budget of its size.
+//
+TEST_F (SdHciTransferTest, StuckTransferTimesOut) {
+  std::vector<UINT8>  Buffer (SIZE_32KB + 4);
+  UINT8               *Data;
+  UINT32              Resets;
+  UINT64              Budget;
+
+  Data                     = (UINT8 *)ALIGN_POINTER (Buffer.data (), 4);
+  Resets                   = mSdHciModelStatistics.CmdDataResets;
+  mSdHciModelFault         = SdHciFaultXferStuck;
+  EXPECT_EQ (Transfer (MMC_CMD18, 0, Data, SIZE_32KB), EFI_TIMEOUT);
+
+  Budget = SDHCI_XFER_TIMEOUT_BASE_US + (SIZE_32KB / MMC_BLOCK_SIZE) * SDHCI_XFER_TIMEOUT_BLOCK_US;
+  EXPECT_GE (mSdHciModelStatistics.StallTime, Budget);
+  EXPECT_LE (mSdHciModelStatistics.StallTime, Budget + 1);
+  CheckRecovered (Resets);
+
+  mSdHciModelFault = SdHciFaultNone;
+  ASSERT_EQ (Transfer (MMC_CMD18, 16, Data, SIZE_32KB), EFI_SUCCESS);
+  EXPECT_TRUE (MatchesCard (Data, 16, SIZE_32KB));
+}
+
+//
+// A bounced transfer that fails releases the bounce buffer, the next bounced
+// transfers map it again and move the right data.
+//
+TEST_F (SdHciTransferTest, FailedBouncedTransferIsUnmapped) {
+  std::vector<UINT8>  Buffer (SIZE_8KB + 8);
+  UINT8               *Data;
+  UINT32              Resets;
+
+  Data = (UINT8 *)ALIGN_POINTER (Buffer.data (), 4) + 2;
+
+  Resets           = mSdHciModelStatistics.CmdDataResets;
+  mSdHciModelFault = SdHciFaultXferStuck;
+  EXPECT_EQ (Transfer (MMC_CMD25, 40, Data, SIZE_8KB), EFI_TIMEOUT);
+  CheckRecovered (Resets);
+
+  mSdHciModelFault = SdHciFaultNone;
+  memset (Data, 0xC3, SIZE_8KB);
+  ASSERT_EQ (Transfer (MMC_CMD25, 80, Data, SIZE_4KB), EFI_SUCCESS);
+  EXPECT_TRUE (MatchesCard (Data, 80, SIZE_4KB));
+
+  ASSERT_EQ (Transfer (MMC_CMD18, 120, Data, SIZE_8KB), EFI_SUCCESS);
+  EXPECT_TRUE (MatchesCard (Data, 120, SIZE_8KB));
+}
+
+TEST_F (SdHciTransferTest, CommandTimesOut) {
+  std::vector<UINT8>  Buffer (SIZE_4KB + 4);
+  UINT32              Resets;
+
+  Resets           = mSdHciModelStatistics.CmdDataResets;
+  mSdHciModelFault = SdHciFaultCmdStuck;
+  EXPECT_EQ (Transfer (MMC_CMD18, 0, ALIGN_POINTER (Buffer.data (), 4), SIZE_4KB), EFI_TIMEOUT);
+  CheckRecovered (Resets);
+}
+
+TEST_F (SdHciTransferTest, DataCrcErrorFails) {
+  std::vector<UINT8>  Buffer (SIZE_64KB + 4);
+  UINT32              Resets;
+
+  Resets           = mSdHciModelStatistics.CmdDataResets;
+  mSdHciModelFault = SdHciFaultDataCrc;
+  EXPECT_EQ (Transfer (MMC_CMD18, 0, ALIGN_POINTER (Buffer.data (), 4), SIZE_64KB), EFI_DEVICE_ERROR);
+  CheckRecovered (Resets);
+}
+
+TEST_F (SdHciTransferTest, AdmaErrorFails) {
+  std::vector<UINT8>  Buffer (SIZE_256KB + 4);
+  UINT32              Resets;
+
+  Resets           = mSdHciModelStatistics.CmdDataResets;
+  mSdHciModelFault = SdHciFaultAdma;
+  EXPECT_EQ (Transfer (MMC_CMD25, 0, ALIGN_POINTER (Buffer.data (), 4), SIZE_256KB), EFI_DEVICE_ERROR);
+  CheckRecovered (Resets);
+
+  mSdHciModelFault = SdHciFaultNone;
+  EXPECT_EQ (Transfer (MMC_CMD25, 0, ALIGN_POINTER (Buffer.data (), 4), SIZE_256KB), EFI_SUCCESS);
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
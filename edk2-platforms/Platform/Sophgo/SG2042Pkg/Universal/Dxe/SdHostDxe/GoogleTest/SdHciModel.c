@@ -0,0 +1,622 @@
+/** @file
+  A register model of the SDHCI controller of the SG2042 and of the card
+  behind it, for the host test of the ADMA2 data path of SdHostDxe.
+
+  The model stands in for IoLib, the MMIO accesses of the driver within the
+  register window at PcdSG2042SDIOBase reach the registers of the model. A
+  command completes as soon as it is written. Its data takes
+  mSdHciModelBlockTime per block on the clock of the model. Once it is due,
+  the next read of the interrupt status runs the ADMA2 engine, which walks
+  the descriptor table the way the controller does and moves the data
+  between the card image and the memory the lines point at. The interrupt
+  status registers are write one to clear and the resets clear themselves.
+  Faults let a command or a transfer hang or fail.
+
+  The delays of the driver advance a clock instead of sleeping, and DMA
+  memory comes from MemoryAllocationLib, so FreePages () of the driver
+  releases it.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/IoLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PcdLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Include/MmcHost.h>
+
+#include "../SdHci.h"
+#include "SdHciModel.h"
+
+#define MODEL_REGISTER_WINDOW  SIZE_4KB
+#define MODEL_VENDOR_AREA      0x500
+#define MODEL_MAX_LINES        (1024 * 1024)
+#define MODEL_R1_TRAN          0x900
+
+#define MODEL_ERR_INT_DATA_CRC  BIT5
+
+SD_HCI_MODEL_FAULT       mSdHciModelFault;
+UINT32                   mSdHciModelBlockTime;
+SD_HCI_MODEL_STATISTICS  mSdHciModelStatistics;
+
+STATIC UINT8               mModelRegisters[MODEL_REGISTER_WINDOW];
+STATIC UINT8               *mModelCard;
+STATIC UINT64              mModelCardSize;
+STATIC BOOLEAN             mModelXferPending;
+STATIC UINT64              mModelXferDue;
+STATIC EFI_STALL           mModelBootStall;
+STATIC EFI_ALLOCATE_PAGES  mModelBootAllocatePages;
+
+/**
+  Return the offset of an MMIO address within the register window.
+
+**/
+STATIC
+UINTN
+ModelOffset (
+  IN UINTN  Address,
+  IN UINTN  Width
+  )
+{
+  UINTN  Offset;
+
+  Offset = Address - (UINTN)FixedPcdGet64 (PcdSG2042SDIOBase);
+  ASSERT (Offset + Width <= MODEL_REGISTER_WINDOW);
+  return Offset;
+}
+
+STATIC
+UINT32
+ModelGet (
+  IN UINTN  Offset,
+  IN UINTN  Width
+  )
+{
+  UINT32  Value;
+
+  Value = 0;
+  CopyMem (&Value, &mModelRegisters[Offset], Width);
+  return Value;
+}
+
+STATIC
+VOID
+ModelSet (
+  IN UINTN   Offset,
+  IN UINTN   Width,
+  IN UINT32  Value
+  )
+{
+  CopyMem (&mModelRegisters[Offset], &Value, Width);
+}
+
+/**
+  Raise an error interrupt, the error summary bit of the normal interrupt
+  status follows the error interrupt status.
+
+**/
+STATIC
+VOID
+ModelRaiseError (
+  IN UINT16  Error
+  )
+{
+  ModelSet (SDHCI_ERR_INT_STATUS, 2, ModelGet (SDHCI_ERR_INT_STATUS, 2) | Error);
+  ModelSet (SDHCI_INT_STATUS, 2, ModelGet (SDHCI_INT_STATUS, 2) | SDHCI_INT_ERROR);
+}
+
+/**
+  Return the block count of the transfer, the 32-bit block count register
+  of version 4 mode shares its offset with the SDMA address.
+
+**/
+STATIC
+UINT32
+ModelBlockCount (
+  VOID
+  )
+{
+  if ((ModelGet (SDHCI_HOST_CONTROL2, 2) & SDHCI_HOST_VER4_ENABLE) != 0) {
+    return ModelGet (SDHCI_DMA_ADDRESS, 4);
+  }
+
+  return ModelGet (SDHCI_BLOCK_COUNT, 2);
+}
+
+/**
+  Run the ADMA2 engine over the descriptor table for the block count and the
+  block size programmed, the way the controller does.
+
+**/
+STATIC
+VOID
+ModelRunAdma (
+  IN BOOLEAN  Read,
+  IN UINT64   CardOffset
+  )
+{
+  SDHCI_ADMA2_64_DESC_LINE  *Line;
+  UINT64                    Remaining;
+  UINT64                    Stop;
+  UINT64                    Length;
+  UINT8                     *Memory;
+  UINTN                     Lines;
+  BOOLEAN                   Ended;
+
+  Remaining = MultU64x32 (ModelBlockCount (), ModelGet (SDHCI_BLOCK_SIZE, 2) & 0xFFF);
+  if ((Remaining == 0) || (CardOffset + Remaining > mModelCardSize)) {
+    ModelRaiseError (SDHCI_ERR_INT_ADMA);
+    return;
+  }
+
+  //
+  // The faults stop the transfer halfway through.
+  //
+  Stop = 0;
+  if ((mSdHciModelFault == SdHciFaultDataCrc) || (mSdHciModelFault == SdHciFaultAdma)) {
+    Stop = Remaining / 2;
+  }
+
+  Line = (SDHCI_ADMA2_64_DESC_LINE *)(UINTN)(LShiftU64 (ModelGet (SDHCI_ADMA_SA_HIGH, 4), 32) |
+                                             ModelGet (SDHCI_ADMA_SA_LOW, 4));
+  Ended = FALSE;
+  for (Lines = 0; Lines < MODEL_MAX_LINES; Lines++, Line++) {
+    if (Line->Valid == 0) {
+      break;
+    }
+
+    mSdHciModelStatistics.Lines++;
+    if (Line->Act == SDHCI_ADMA2_ACT_LINK) {
+      Line = (SDHCI_ADMA2_64_DESC_LINE *)(UINTN)(LShiftU64 (Line->UpperAddress, 32) | Line->LowerAddress) - 1;
+      continue;
+    }
+
+    if (Line->Act == SDHCI_ADMA2_ACT_TRAN) {
+      // a zero length field means 64KB
+      Length = (Line->LowerLength == 0) ? SIZE_64KB : Line->LowerLength;
+      Memory = (UINT8 *)(UINTN)(LShiftU64 (Line->UpperAddress, 32) | Line->LowerAddress);
+      if ((Length > Remaining) || (((UINTN)Memory & 0x3) != 0)) {
+        break;
+      }
+
+      if ((Stop != 0) && (Remaining - Length < Stop)) {
+        if (mSdHciModelFault == SdHciFaultDataCrc) {
+          ModelRaiseError (MODEL_ERR_INT_DATA_CRC);
+        } else {
+          ModelSet (SDHCI_ADMA_ERR_STATUS, 1, 0x1);
+          ModelRaiseError (SDHCI_ERR_INT_ADMA);
+        }
+
+        return;
+      }
+
+      if (Read) {
+        CopyMem (Memory, mModelCard + CardOffset, (UINTN)Length);
+      } else {
+        CopyMem (mModelCard + CardOffset, Memory, (UINTN)Length);
+      }
+
+      mSdHciModelStatistics.BytesMoved += Length;
+      CardOffset                       += Length;
+      Remaining                        -= Length;
+    }
+
+    if (Line->End != 0) {
+      Ended = TRUE;
+      break;
+    }
+  }
+
+  //
+  // A table that ends before or after the block count is a descriptor error.
+  //
+  if ((Remaining != 0) || !Ended) {
+    ModelSet (SDHCI_ADMA_ERR_STATUS, 1, 0x1);
+    ModelRaiseError (SDHCI_ERR_INT_ADMA);
+    return;
+  }
+
+  ModelSet (SDHCI_INT_STATUS, 2, ModelGet (SDHCI_INT_STATUS, 2) | SDHCI_INT_XFER_COMPLETE);
+}
+
+/**
+  Execute the command written to the command register.
+
+**/
+STATIC
+VOID
+ModelCommand (
+  VOID
+  )
+{
+  UINT16  Command;
+  UINT16  Mode;
+
+  Command = (UINT16)ModelGet (SDHCI_COMMAND, 2);
+  Mode    = (UINT16)ModelGet (SDHCI_TRANSFER_MODE, 2);
+
+  mSdHciModelStatistics.Commands++;
+  if (mSdHciModelFault == SdHciFaultCmdStuck) {
+    return;
+  }
+
+  ModelSet (SDHCI_RESPONSE_01, 4, MODEL_R1_TRAN);
+  ModelSet (SDHCI_INT_STATUS, 2, ModelGet (SDHCI_INT_STATUS, 2) | SDHCI_INT_CMD_COMPLETE);
+
+  if ((Command & SDHCI_CMD_DATA) == 0) {
+    return;
+  }
+
+  mSdHciModelStatistics.DataCommands++;
+  if ((mSdHciModelFault == SdHciFaultXferStuck) || ((Mode & SDHCI_TRNS_DMA) == 0)) {
+    return;
+  }
+
+  mModelXferPending = TRUE;
+  mModelXferDue     = mSdHciModelStatistics.StallTime + MultU64x32 (ModelBlockCount (), mSdHciModelBlockTime);
+}
+
+/**
+  Run the transfer of the last data command once it is due.
+
+**/
+STATIC
+VOID
+ModelPoll (
+  VOID
+  )
+{
+  UINT16  Mode;
+
+  if (!mModelXferPending || (mSdHciModelStatistics.StallTime < mModelXferDue)) {
+    return;
+  }
+
+  mModelXferPending = FALSE;
+  Mode              = (UINT16)ModelGet (SDHCI_TRANSFER_MODE, 2);
+
+  // the cards of the model use block addressing
+  ModelRunAdma (
+    (BOOLEAN)((Mode & SDHCI_TRNS_READ) != 0),
+    MultU64x32 (ModelGet (SDHCI_ARGUMENT, 4), MMC_BLOCK_SIZE)
+    );
+}
+
+/**
+  Return the value of a register read by the driver.
+
+**/
+STATIC
+UINT32
+ModelRead (
+  IN UINTN  Address,
+  IN UINTN  Width
+  )
+{
+  UINTN  Offset;
+
+  Offset = ModelOffset (Address, Width);
+  if ((Offset < SDHCI_INT_STATUS + 2) && (Offset + Width > SDHCI_INT_STATUS)) {
+    ModelPoll ();
+  }
+
+  return ModelGet (Offset, Width);
+}
+
+/**
+  Apply a write of the driver to the registers.
+
+**/
+STATIC
+VOID
+ModelWrite (
+  IN UINTN   Address,
+  IN UINTN   Width,
+  IN UINT32  Value
+  )
+{
+  UINTN  Offset;
+  UINTN  Index;
+  UINT8  Byte;
+
+  Offset = ModelOffset (Address, Width);
+  for (Index = 0; Index < Width; Index++) {
+    Byte = (UINT8)(Value >> (Index * 8));
+    switch (Offset + Index) {
+      case SDHCI_INT_STATUS:
+      case SDHCI_INT_STATUS + 1:
+      case SDHCI_ERR_INT_STATUS:
+      case SDHCI_ERR_INT_STATUS + 1:
+        mModelRegisters[Offset + Index] &= ~Byte;
+        break;
+
+      case SDHCI_SOFTWARE_RESET:
+        // the reset of the DAT line aborts the transfer
+        if ((Byte & (SDHCI_RESET_CMD | SDHCI_RESET_DATA)) == (SDHCI_RESET_CMD | SDHCI_RESET_DATA)) {
+          mSdHciModelStatistics.CmdDataResets++;
+          mModelXferPending = FALSE;
+        }
+
+        break;
+
+      case SDHCI_CLK_CTRL:
+        // the internal clock is stable as soon as it is enabled
+        mModelRegisters[Offset + Index] = (Byte & BIT0) ? (Byte | BIT1) : (UINT8)(Byte & ~BIT1);
+        break;
+
+      case SDHCI_P_PHY_CNFG:
+        mModelRegisters[Offset + Index] = Byte | (1 << PHY_CNFG_PHY_PWRGOOD);
+        break;
+
+      default:
+        mModelRegisters[Offset + Index] = Byte;
+        break;
+    }
+  }
+
+  // the command starts with the write of its upper byte
+  if ((Offset <= SDHCI_COMMAND + 1) && (Offset + Width > SDHCI_COMMAND + 1)) {
+    ModelCommand ();
+  }
+
+  // the error summary bit follows the error interrupt status
+  if (ModelGet (SDHCI_ERR_INT_STATUS, 2) == 0) {
+    ModelSet (SDHCI_INT_STATUS, 2, ModelGet (SDHCI_INT_STATUS, 2) & ~SDHCI_INT_ERROR);
+  }
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelStall (
+  IN UINTN  Microseconds
+  )
+{
+  mSdHciModelStatistics.StallTime += Microseconds;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelAllocatePages (
+  IN     EFI_ALLOCATE_TYPE     Type,
+  IN     EFI_MEMORY_TYPE       MemoryType,
+  IN     UINTN                 Pages,
+  IN OUT EFI_PHYSICAL_ADDRESS  *Memory
+  )
+{
+  VOID  *Buffer;
+
+  ASSERT (Type == AllocateMaxAddress);
+  Buffer = AllocatePages (Pages);
+  if (Buffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  if ((UINTN)Buffer + EFI_PAGES_TO_SIZE (Pages) - 1 > *Memory) {
+    FreePages (Buffer, Pages);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  mSdHciModelStatistics.PagesAllocated += (UINT32)Pages;
+  *Memory                               = (UINTN)Buffer;
+  return EFI_SUCCESS;
+}
+
+UINT8
+EFIAPI
+MmioRead8 (
+  IN UINTN  Address
+  )
+{
+  return (UINT8)ModelRead (Address, 1);
+}
+
+UINT8
+EFIAPI
+MmioWrite8 (
+  IN UINTN  Address,
+  IN UINT8  Value
+  )
+{
+  ModelWrite (Address, 1, Value);
+  return Value;
+}
+
+UINT16
+EFIAPI
+MmioRead16 (
+  IN UINTN  Address
+  )
+{
+  return (UINT16)ModelRead (Address, 2);
+}
+
+UINT16
+EFIAPI
+MmioWrite16 (
+  IN UINTN   Address,
+  IN UINT16  Value
+  )
+{
+  ModelWrite (Address, 2, Value);
+  return Value;
+}
+
+UINT32
+EFIAPI
+MmioRead32 (
+  IN UINTN  Address
+  )
+{
+  return ModelRead (Address, 4);
+}
+
+UINT32
+EFIAPI
+MmioWrite32 (
+  IN UINTN   Address,
+  IN UINT32  Value
+  )
+{
+  ModelWrite (Address, 4, Value);
+  return Value;
+}
+
+UINT8
+EFIAPI
+MmioAndThenOr8 (
+  IN UINTN  Address,
+  IN UINT8  AndData,
+  IN UINT8  OrData
+  )
+{
+  return MmioWrite8 (Address, (UINT8)((MmioRead8 (Address) & AndData) | OrData));
+}
+
+UINT8
+EFIAPI
+MmioAnd8 (
+  IN UINTN  Address,
+  IN UINT8  AndData
+  )
+{
+  return MmioAndThenOr8 (Address, AndData, 0);
+}
+
+UINT8
+EFIAPI
+MmioOr8 (
+  IN UINTN  Address,
+  IN UINT8  OrData
+  )
+{
+  return MmioAndThenOr8 (Address, MAX_UINT8, OrData);
+}
+
+UINT16
+EFIAPI
+MmioAndThenOr16 (
+  IN UINTN   Address,
+  IN UINT16  AndData,
+  IN UINT16  OrData
+  )
+{
+  return MmioWrite16 (Address, (UINT16)((MmioRead16 (Address) & AndData) | OrData));
+}
+
+UINT16
+EFIAPI
+MmioAnd16 (
+  IN UINTN   Address,
+  IN UINT16  AndData
+  )
+{
+  return MmioAndThenOr16 (Address, AndData, 0);
+}
+
+UINT16
+EFIAPI
+MmioOr16 (
+  IN UINTN   Address,
+  IN UINT16  OrData
+  )
+{
+  return MmioAndThenOr16 (Address, MAX_UINT16, OrData);
+}
+
+UINT32
+EFIAPI
+MmioAndThenOr32 (
+  IN UINTN   Address,
+  IN UINT32  AndData,
+  IN UINT32  OrData
+  )
+{
+  return MmioWrite32 (Address, (MmioRead32 (Address) & AndData) | OrData);
+}
+
+UINT32
+EFIAPI
+MmioAnd32 (
+  IN UINTN   Address,
+  IN UINT32  AndData
+  )
+{
+  return MmioAndThenOr32 (Address, AndData, 0);
+}
+
+UINT32
+EFIAPI
+MmioOr32 (
+  IN UINTN   Address,
+  IN UINT32  OrData
+  )
+{
+  return MmioAndThenOr32 (Address, MAX_UINT32, OrData);
+}
+
+VOID
+SdHciModelReset (
+  IN UINTN  CardBlocks
+  )
+{
+  SdHciModelFree ();
+
+  ZeroMem (mModelRegisters, sizeof (mModelRegisters));
+  ModelSet (SDHCI_PSTATE, 4, SDHCI_CARD_INSERTED);
+  ModelSet (SDHCI_CAPABILITIES1, 4, SDHCI_CAP_SYS_BUS_64_V4);
+  ModelSet (P_VENDOR_SPECIFIC_AREA, 2, MODEL_VENDOR_AREA);
+  ModelSet (SDHCI_P_PHY_CNFG, 4, 1 << PHY_CNFG_PHY_PWRGOOD);
+
+  mModelCardSize = MultU64x32 (CardBlocks, MMC_BLOCK_SIZE);
+  mModelCard     = AllocateZeroPool ((UINTN)mModelCardSize);
+  ASSERT (mModelCard != NULL);
+
+  mSdHciModelFault     = SdHciFaultNone;
+  mSdHciModelBlockTime = 1;
+  mModelXferPending    = FALSE;
+  ZeroMem (&mSdHciModelStatistics, sizeof (mSdHciModelStatistics));
+
+  mModelBootStall         = gBS->Stall;
+  mModelBootAllocatePages = gBS->AllocatePages;
+  gBS->Stall              = ModelStall;
+  gBS->AllocatePages      = ModelAllocatePages;
+}
+
+VOID
+SdHciModelFree (
+  VOID
+  )
+{
+  if (mModelCard == NULL) {
+    return;
+  }
+
+  FreePool (mModelCard);
+  mModelCard         = NULL;
+  gBS->Stall         = mModelBootStall;
+  gBS->AllocatePages = mModelBootAllocatePages;
+}
+
+UINT8 *
+SdHciModelCard (
+  VOID
+  )
+{
+  return mModelCard;
+}
+
+UINT16
+SdHciModelRegister16 (
+  IN UINTN  Offset
+  )
+{
+  return (UINT16)ModelGet (Offset, 2);
+}
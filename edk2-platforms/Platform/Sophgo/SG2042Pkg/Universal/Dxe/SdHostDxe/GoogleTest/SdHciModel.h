@@ -0,0 +1,80 @@
+/** @file
+  Interface of the SDHCI register model to the host test of the ADMA2 data
+  path of SdHostDxe.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#ifndef SD_HCI_MODEL_H_
+#define SD_HCI_MODEL_H_
+
+//
+// The ways the model lets a command or a transfer fail.
+//
+typedef enum {
+  SdHciFaultNone,
+  SdHciFaultCmdStuck,         // The command never completes
+  SdHciFaultXferStuck,        // The data transfer never completes
+  SdHciFaultDataCrc,          // The card reports a data CRC error halfway
+  SdHciFaultAdma              // The ADMA2 engine stops halfway
+} SD_HCI_MODEL_FAULT;
+
+typedef struct {
+  UINT32    Commands;
+  UINT32    DataCommands;
+  UINT32    Lines;            // Descriptor lines the ADMA2 engine walked
+  UINT64    BytesMoved;
+  UINT32    CmdDataResets;    // Resets of the CMD and DAT lines
+  UINT64    StallTime;        // Microseconds the driver stalled
+  UINT32    PagesAllocated;   // Pages the driver allocated for DMA
+} SD_HCI_MODEL_STATISTICS;
+
+extern SD_HCI_MODEL_FAULT       mSdHciModelFault;
+extern UINT32                   mSdHciModelBlockTime;   // Microseconds per block, 1 by default
+extern SD_HCI_MODEL_STATISTICS  mSdHciModelStatistics;
+
+/**
+  Reset the registers of the model to their power-on state, replace the
+  card with a zeroed one of the given size, clear the fault, reset the
+  statistics and take over the boot services the driver uses for delays
+  and DMA memory.
+
+  @param  CardBlocks             The size of the card in 512 byte blocks.
+
+**/
+VOID
+SdHciModelReset (
+  IN UINTN  CardBlocks
+  );
+
+/**
+  Free the card and give the boot services back.
+
+**/
+VOID
+SdHciModelFree (
+  VOID
+  );
+
+/**
+  Return the image of the card.
+
+**/
+UINT8 *
+SdHciModelCard (
+  VOID
+  );
+
+/**
+  Return the value of a 16-bit register of the controller.
+
+  @param  Offset                 The offset of the register.
+
+**/
+UINT16
+SdHciModelRegister16 (
+  IN UINTN  Offset
+  );
+
+#endif
@@ -21,7 +21,6 @@
 #include "SdHci.h"
 
 #define SDCARD_INIT_FREQ	(200 * 1000)
-#define SDCARD_TRAN_FREQ	(6 * 1000 * 1000)
 
 
 STATIC BM_SD_PARAMS BmParams = {
@@ -46,6 +45,137 @@ BmGetSdClk (
   return 100*1000*1000;
 }
 
+/**
+  Reset the command and data lines of the host controller.
+
+**/
+STATIC
+VOID
+SdResetCmdData (
+  VOID
+  )
+{
+  UINTN  Base;
+  INT32  RetryCount;
+
+  Base       = BmParams.RegBase;
+  RetryCount = 100;
+
+  MmioWrite8 (Base + SDHCI_SOFTWARE_RESET, SDHCI_RESET_CMD | SDHCI_RESET_DATA);
+  while (MmioRead8 (Base + SDHCI_SOFTWARE_RESET) & (SDHCI_RESET_CMD | SDHCI_RESET_DATA)) {
+    if (RetryCount-- > 0)
+      gBS->Stall (100);
+    else
+      break;
+  }
+}
+
+/**
+  Allocate pages the DMA engine can reach.
+
+  @param[in]  Pages     Number of pages to allocate.
+
+  @return The allocated pages, or NULL if there is no memory below the DMA limit.
+
+**/
+STATIC
+VOID *
+SdDmaAllocatePages (
+  IN UINTN  Pages
+  )
+{
+  EFI_STATUS            Status;
+  EFI_PHYSICAL_ADDRESS  Address;
+
+  Address = BmParams.DmaLimit;
+  Status  = gBS->AllocatePages (AllocateMaxAddress, EfiBootServicesData, Pages, &Address);
+  if (EFI_ERROR (Status)) {
+    return NULL;
+  }
+
+  return (VOID *)(UINTN)Address;
+}
+
+/**
+  Map a data buffer for the DMA engine.
+
+  The buffer is used in place when it is aligned and within reach of the
+  DMA engine, which is the case for nearly every transfer. Otherwise the
+  transfer goes through the bounce buffer, SdSendCmdWithData () copies the
+  data in for writes and out once a read has completed.
+
+  @param[in]  Buf            Buffer Address.
+  @param[in]  Size           Size of the transfer in bytes.
+  @param[out] DeviceAddress  Bus address to program the DMA engine with.
+
+  @retval EFI_SUCCESS             The buffer is mapped.
+  @retval EFI_OUT_OF_RESOURCES    The bounce buffer could not be grown.
+
+**/
+STATIC
+EFI_STATUS
+SdDmaMap (
+  IN  UINTN   Buf,
+  IN  UINTN   Size,
+  OUT UINTN   *DeviceAddress
+  )
+{
+  UINTN   Pages;
+  VOID    *Bounce;
+
+  BmParams.BounceHost = 0;
+
+  if (((Buf & (SDHCI_DMA_ALIGN - 1)) == 0) && ((UINT64)(Buf + Size - 1) <= BmParams.DmaLimit)) {
+    *DeviceAddress = Buf;
+    return EFI_SUCCESS;
+  }
+
+  if (Size > BmParams.BounceSize) {
+    Pages  = EFI_SIZE_TO_PAGES (Size);
+    Bounce = SdDmaAllocatePages (Pages);
+    if (Bounce == NULL) {
+      DEBUG ((DEBUG_ERROR, "%a: unable to grow the bounce buffer to %u bytes\n", __FUNCTION__, Size));
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    if (BmParams.BounceBase != 0) {
+      FreePages ((VOID *)BmParams.BounceBase, EFI_SIZE_TO_PAGES (BmParams.BounceSize));
+    }
+
+    BmParams.BounceBase = (UINTN)Bounce;
+    BmParams.BounceSize = EFI_PAGES_TO_SIZE (Pages);
+  }
+
+  BmParams.BounceHost   = Buf;
+  BmParams.BounceLength = Size;
+  *DeviceAddress        = BmParams.BounceBase;
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Release the DMA mapping of a completed transfer.
+
+  @param[in]  Read      TRUE if the transfer moved data from the card.
+
+**/
+STATIC
+VOID
+SdDmaUnmap (
+  IN BOOLEAN  Read
+  )
+{
+  if (BmParams.BounceHost == 0) {
+    return;
+  }
+
+  if (Read) {
+    CopyMem ((VOID *)BmParams.BounceHost, (VOID *)BmParams.BounceBase, BmParams.BounceLength);
+  }
+
+  BmParams.BounceHost = 0;
+}
+
 /**
   SD card sends command with response block data.
 
@@ -62,12 +192,13 @@ SdSendCmdWithData (
   IN OUT MMC_CMD *Cmd
   )
 {
-  UINTN   Base;
-  UINT32  Mode;
-  UINT32  State;
-  UINT32  DmaAddr;
-  UINT32  Flags;
-  UINT32  Timeout;
+  EFI_STATUS  Status;
+  UINTN       Base;
+  UINT32      Mode;
+  UINT32      State;
+  UINT32      ErrState;
+  UINT32      Flags;
+  UINTN       Timeout;
 
   Base  = BmParams.RegBase;
   Mode  = 0;
@@ -79,10 +210,13 @@ SdSendCmdWithData (
     break;
   }
 
-  switch (Cmd->CmdIdx) {
+  switch (Cmd->CmdIdx & ~MMC_CMD_AUTO_CMD23) {
     case MMC_CMD17:
     case MMC_CMD18:
+    case MMC_ACMD22:
     case MMC_ACMD51:
+    case MMC_CMD6_SWITCH_FUNC:
+    case MMC_CMD8_SEND_EXT_CSD:
       Mode = SDHCI_TRNS_BLK_CNT_EN | SDHCI_TRNS_MULTI | SDHCI_TRNS_READ;
       if (!(BmParams.Flags & SD_USE_PIO))
         Mode |= SDHCI_TRNS_DMA;
@@ -97,6 +231,14 @@ SdSendCmdWithData (
       ASSERT(0);
   }
 
+  // the controller takes the CMD23 argument from the block count set up by BmSdPrepare ()
+  if (Cmd->CmdIdx & MMC_CMD_AUTO_CMD23)
+    Mode |= SDHCI_TRNS_ACMD23;
+
+  // a bounced write needs its data in the bounce buffer before the engine starts
+  if ((BmParams.BounceHost != 0) && !(Mode & SDHCI_TRNS_READ))
+    CopyMem ((VOID *)BmParams.BounceBase, (VOID *)BmParams.BounceHost, BmParams.BounceLength);
+
   MmioWrite16 (Base + SDHCI_TRANSFER_MODE, Mode);
   MmioWrite32 (Base + SDHCI_ARGUMENT, Cmd->CmdArg);
 
@@ -120,6 +262,7 @@ SdSendCmdWithData (
   MmioWrite16 (Base + SDHCI_COMMAND, SDHCI_MAKE_CMD(Cmd->CmdIdx, Flags));
 
   // check Cmd complete if necessary
+  Status = EFI_SUCCESS;
   if ((MmioRead16 (Base + SDHCI_TRANSFER_MODE) & SDHCI_TRNS_RESP_INT) == 0) {
     Timeout = 100000;
     while (1) {
@@ -127,17 +270,19 @@ SdSendCmdWithData (
       if (State & SDHCI_INT_ERROR) {
         DEBUG ((DEBUG_ERROR, "%a: interrupt error: 0x%x 0x%x\n", __FUNCTION__,  MmioRead16 (Base + SDHCI_INT_STATUS),
                                 MmioRead16 (Base + SDHCI_ERR_INT_STATUS)));
-        return EFI_DEVICE_ERROR;
+        Status = EFI_DEVICE_ERROR;
+        goto Done;
       }
       if (State & SDHCI_INT_CMD_COMPLETE) {
-        MmioWrite16 (Base + SDHCI_INT_STATUS, State | SDHCI_INT_CMD_COMPLETE);
+        MmioWrite16 (Base + SDHCI_INT_STATUS, SDHCI_INT_CMD_COMPLETE);
         break;
       }
 
       gBS->Stall (1);
       if (!Timeout--) {
         DEBUG ((DEBUG_ERROR, "%a: Timeout!\n", __FUNCTION__));
-        return EFI_TIMEOUT;
+        Status = EFI_TIMEOUT;
+        goto Done;
       }
     }
 
@@ -151,14 +296,23 @@ SdSendCmdWithData (
     }
   }
 
-  // check dma/transfer complete
+  // check dma/transfer complete, the ADMA2 engine walks the whole descriptor table by itself
   if (!(BmParams.Flags & SD_USE_PIO)) {
+    Timeout = SDHCI_XFER_TIMEOUT_BASE_US +
+              (BmParams.XferLength / MMC_BLOCK_SIZE) * SDHCI_XFER_TIMEOUT_BLOCK_US;
     while (1) {
       State = MmioRead16 (Base + SDHCI_INT_STATUS);
       if (State & SDHCI_INT_ERROR) {
-        DEBUG ((DEBUG_ERROR, "%a: interrupt error: 0x%x 0x%x\n", __FUNCTION__,  MmioRead16 (Base + SDHCI_INT_STATUS),
-                                MmioRead16 (Base + SDHCI_ERR_INT_STATUS)));
-        return EFI_DEVICE_ERROR;
+        ErrState = MmioRead16 (Base + SDHCI_ERR_INT_STATUS);
+        DEBUG ((DEBUG_ERROR, "%a: interrupt error: 0x%x 0x%x\n", __FUNCTION__, State, ErrState));
+        if (ErrState & SDHCI_ERR_INT_ADMA) {
+          DEBUG ((DEBUG_ERROR, "%a: ADMA error: 0x%x at 0x%x%08x\n", __FUNCTION__,
+                                  MmioRead8 (Base + SDHCI_ADMA_ERR_STATUS),
+                                  MmioRead32 (Base + SDHCI_ADMA_SA_HIGH),
+                                  MmioRead32 (Base + SDHCI_ADMA_SA_LOW)));
+        }
+        Status = EFI_DEVICE_ERROR;
+        break;
       }
 
       if (State & SDHCI_INT_XFER_COMPLETE) {
@@ -166,22 +320,27 @@ SdSendCmdWithData (
         break;
       }
 
-      if (State & SDHCI_INT_DMA_END) {
-        MmioWrite16 (Base + SDHCI_INT_STATUS, State);
-        if (MmioRead16 (Base + SDHCI_HOST_CONTROL2) & SDHCI_HOST_VER4_ENABLE) {
-          DmaAddr = MmioRead32 (Base + SDHCI_ADMA_SA_LOW);
-          MmioWrite32 (Base + SDHCI_ADMA_SA_LOW, DmaAddr);
-          MmioWrite32 (Base + SDHCI_ADMA_SA_HIGH, 0);
-        } else {
-          DmaAddr = MmioRead32 (Base + SDHCI_DMA_ADDRESS);
-          MmioWrite32 (Base + SDHCI_DMA_ADDRESS, DmaAddr);
-        }
+      gBS->Stall (1);
+      if (!Timeout--) {
+        DEBUG ((DEBUG_ERROR, "%a: DMA Timeout, %lu bytes\n", __FUNCTION__, (UINT64)BmParams.XferLength));
+        Status = EFI_TIMEOUT;
+        break;
       }
-
     }
   }
 
-  return EFI_SUCCESS;
+Done:
+  // a failed transfer leaves the engine stopped within the table, make the host usable again
+  if (EFI_ERROR (Status)) {
+    MmioWrite16 (Base + SDHCI_ERR_INT_STATUS, MmioRead16 (Base + SDHCI_ERR_INT_STATUS));
+    MmioWrite16 (Base + SDHCI_INT_STATUS, MmioRead16 (Base + SDHCI_INT_STATUS));
+    SdResetCmdData ();
+  }
+
+  if (!(BmParams.Flags & SD_USE_PIO))
+    SdDmaUnmap (Mode & SDHCI_TRNS_READ);
+
+  return Status;
 }
 
 /**
@@ -252,6 +411,10 @@ SdSendCmdWithoutData (
     if (State & SDHCI_INT_ERROR) {
       DEBUG ((DEBUG_ERROR, "%a: interrupt error: 0x%x 0x%x\n", __FUNCTION__,  MmioRead16 (Base + SDHCI_INT_STATUS),
                               MmioRead16 (Base + SDHCI_ERR_INT_STATUS)));
+      // a card probed with a command of the other family does not answer, leave the host usable
+      MmioWrite16 (Base + SDHCI_ERR_INT_STATUS, MmioRead16 (Base + SDHCI_ERR_INT_STATUS));
+      MmioWrite16 (Base + SDHCI_INT_STATUS, State);
+      SdResetCmdData ();
       return EFI_DEVICE_ERROR;
     }
     if (State & SDHCI_INT_CMD_COMPLETE) {
@@ -311,12 +474,15 @@ BmSdSendCmd (
   Cmd.CmdArg       = Arg;
   Cmd.ResponseType = RespType;
 
-  switch (Cmd.CmdIdx) {
+  switch (Cmd.CmdIdx & ~MMC_CMD_AUTO_CMD23) {
     case MMC_CMD17:
     case MMC_CMD18:
     case MMC_CMD24:
     case MMC_CMD25:
+    case MMC_ACMD22:
     case MMC_ACMD51:
+    case MMC_CMD6_SWITCH_FUNC:
+    case MMC_CMD8_SEND_EXT_CSD:
       Status = SdSendCmdWithData(&Cmd);
       break;
     default:
@@ -324,7 +490,8 @@ BmSdSendCmd (
   }
 
   if ((Status == EFI_SUCCESS) && (Response != NULL)) {
-    for (INT32 I = 0; I < 4; I++) {
+    // short responses may be stored in a single word by the caller
+    for (INT32 I = 0; I < ((RespType & MMC_RSP_136) ? 4 : 1); I++) {
       *Response = Cmd.Response[I];
       Response++;
     }
@@ -511,17 +678,24 @@ SdHwInit (
   MmioWrite8 (Base + SDHCI_PWR_CONTROL, (0x7 << 1));
   MmioWrite8 (Base + SDHCI_TOUT_CTRL, 0xe);  // for TMCLK 50Khz
   MmioWrite16 (Base + SDHCI_HOST_CONTROL2,
-          MmioRead16 (Base + SDHCI_HOST_CONTROL2) | 1 << 11);  // set cmd23 support
+          MmioRead16 (Base + SDHCI_HOST_CONTROL2) | SDHCI_CMD23_ENABLE);  // set cmd23 support
   MmioWrite16 (Base + SDHCI_CLK_CTRL, MmioRead16 (Base + SDHCI_CLK_CTRL) & ~(0x1 << 5));  // divided clock Mode
 
   // set host version 4 parameters
   MmioWrite16 (Base + SDHCI_HOST_CONTROL2,
           MmioRead16 (Base + SDHCI_HOST_CONTROL2) | (1 << 12)); // set HOST_VER4_ENABLE
-  if (MmioRead32 (Base + SDHCI_CAPABILITIES1) & (0x1 << 27)) {
+  if (MmioRead32 (Base + SDHCI_CAPABILITIES1) & SDHCI_CAP_SYS_BUS_64_V4) {
     MmioWrite16 (Base + SDHCI_HOST_CONTROL2,
-            MmioRead16 (Base + SDHCI_HOST_CONTROL2) | 0x1 << 13); // set 64bit addressing
+            MmioRead16 (Base + SDHCI_HOST_CONTROL2) | SDHCI_HOST_ADDRESSING_64); // set 64bit addressing
+  } else if (!(BmParams.Flags & SD_USE_PIO)) {
+    // the descriptor table layout below relies on 64-bit addressing
+    DEBUG ((DEBUG_INFO, "%a: no 64-bit v4 addressing, fall back to PIO\n", __FUNCTION__));
+    BmParams.Flags |= SD_USE_PIO;
   }
 
+  // auto-tuning is only armed by BmSdExecuteTuning
+  MmioAnd32 (BmParams.VendorBase + VENDOR_AT_CTRL, ~AT_CTRL_AT_EN);
+
   // if support asynchronous int
   if (MmioRead32 (Base + SDHCI_CAPABILITIES1) & (0x1 << 29))
     MmioWrite16 (Base + SDHCI_HOST_CONTROL2,
@@ -551,14 +725,61 @@ SdHwInit (
   //verbose("SD init done\n");
 }
 
+/**
+  Lock the DLL of the PHY that delays the data strobe in HS400.
+
+  The DLL follows the SD clock, it must be locked again after every
+  clock change.
+
+  @retval EFI_SUCCESS             The DLL is locked.
+  @retval EFI_DEVICE_ERROR        The DLL did not lock.
+
+**/
+STATIC
+EFI_STATUS
+SdPhyDllEnable (
+  VOID
+  )
+{
+  UINTN  Base;
+  UINT8  DllStatus;
+  INT32  I;
+
+  Base = BmParams.RegBase;
+
+  MmioWrite8 (Base + SDHCI_P_DLL_CTRL, 0);
+  MmioWrite8 (Base + SDHCI_P_DLL_CNFG1, DLL_CNFG1_SLVDLY (2));
+  MmioWrite8 (Base + SDHCI_P_DLL_CNFG2, 0);
+  MmioWrite8 (Base + SDHCI_P_DLLDL_CNFG, DLLDL_CNFG_SLV_INPSEL (3));
+  MmioWrite8 (Base + SDHCI_P_DLL_CTRL, DLL_CTRL_DLL_EN);
+
+  for (I = 0; I <= 150000; I += 100) {
+    DllStatus = MmioRead8 (Base + SDHCI_P_DLL_STATUS);
+    if (DllStatus & DLL_STATUS_ERROR_STS)
+      break;
+    if (DllStatus & DLL_STATUS_LOCK_STS)
+      return EFI_SUCCESS;
+    gBS->Stall (100);
+  }
+
+  DEBUG ((DEBUG_ERROR, "%a: DLL lock FAILED, status 0x%x\n", __FUNCTION__, MmioRead8 (Base + SDHCI_P_DLL_STATUS)));
+  MmioWrite8 (Base + SDHCI_P_DLL_CTRL, 0);
+
+  return EFI_DEVICE_ERROR;
+}
+
 /**
   Set the input/output settings for the SD card.
 
+  The data strobe DLL of the PHY is locked to the new clock when the
+  HS400 timing is selected.
+
   @param[in] Clk     The clock frequency for the SD card.
   @param[in] Width   The bus width for data transfer.
 
   @retval EFI_SUCCESS             The input/output settings were set successfully.
   @retval EFI_UNSUPPORTED         The specified bus width is not supported.
+  @retval EFI_DEVICE_ERROR        The DLL did not lock.
 
 **/
 EFI_STATUS 
@@ -567,26 +788,539 @@ BmSdSetIos (
   IN UINT32 Width
   )
 {
+  UINTN  Base;
+
+  Base = BmParams.RegBase;
+
   switch (Width) {
     case MMC_BUS_WIDTH_1:
-      MmioWrite8 (BmParams.RegBase + SDHCI_HOST_CONTROL,
-              MmioRead8 (BmParams.RegBase + SDHCI_HOST_CONTROL) &
-              ~SDHCI_DAT_XFER_WIDTH);
+      MmioAnd8 (Base + SDHCI_HOST_CONTROL, (UINT8)~(SDHCI_DAT_XFER_WIDTH | SDHCI_EXT_DAT_XFER));
       break;
     case MMC_BUS_WIDTH_4:
-      MmioWrite8 (BmParams.RegBase + SDHCI_HOST_CONTROL, 
-              MmioRead8 (BmParams.RegBase + SDHCI_HOST_CONTROL) |
-              SDHCI_DAT_XFER_WIDTH);
+    case MMC_BUS_WIDTH_DDR_4:
+      MmioAndThenOr8 (Base + SDHCI_HOST_CONTROL, (UINT8)~SDHCI_EXT_DAT_XFER, SDHCI_DAT_XFER_WIDTH);
+      break;
+    case MMC_BUS_WIDTH_8:
+    case MMC_BUS_WIDTH_DDR_8:
+      if (!(MmioRead32 (Base + SDHCI_CAPABILITIES1) & SDHCI_CAP_8BIT))
+        return EFI_UNSUPPORTED;
+      MmioAndThenOr8 (Base + SDHCI_HOST_CONTROL, (UINT8)~SDHCI_DAT_XFER_WIDTH, SDHCI_EXT_DAT_XFER);
       break;
     default:
       ASSERT (0);
+      return EFI_UNSUPPORTED;
   }
 
   SdChangeClk (Clk);
 
+  if ((MmioRead16 (Base + SDHCI_HOST_CONTROL2) & SDHCI_CTRL_UHS_MASK) == SDHCI_CTRL_HS400)
+    return SdPhyDllEnable ();
+
+  MmioWrite8 (Base + SDHCI_P_DLL_CTRL, 0);
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Set the receiver type of the PHY pads that are used by the SD bus.
+
+  @param[in] RxSel     PAD_CNFG_RXSEL_1V8 or PAD_CNFG_RXSEL_3V3.
+
+**/
+STATIC
+VOID
+SdPhySetPadRxSel (
+  IN UINT16 RxSel
+  )
+{
+  STATIC CONST UINT32 PadCnfg[] = {
+    SDHCI_P_CMDPAD_CNFG,
+    SDHCI_P_DATPAD_CNFG,
+    SDHCI_P_CLKPAD_CNFG,
+    SDHCI_P_STBPAD_CNFG,
+    SDHCI_P_RSTNPAD_CNFG
+  };
+  UINTN  Base;
+  UINTN  Index;
+
+  Base = BmParams.RegBase;
+
+  for (Index = 0; Index < ARRAY_SIZE (PadCnfg); Index++) {
+    MmioAndThenOr16 (Base + PadCnfg[Index],
+            ~(PAD_CNFG_RXSEL_MSK << PAD_CNFG_RXSEL),
+            RxSel << PAD_CNFG_RXSEL);
+  }
+}
+
+/**
+  Return the bus capabilities of the host controller.
+
+  @return A bit mask of MMC_HOST_CAP_* values.
+
+**/
+UINT32
+BmSdGetCaps (
+  VOID
+  )
+{
+  UINT32  Caps1;
+  UINT32  Caps2;
+  UINT32  Caps;
+  UINT16  Ctrl2;
+
+  Caps1 = MmioRead32 (BmParams.RegBase + SDHCI_CAPABILITIES1);
+  Caps2 = MmioRead32 (BmParams.RegBase + SDHCI_CAPABILITIES2);
+  Caps  = 0;
+
+  if (Caps1 & SDHCI_CAP_HISPD)
+    Caps |= MMC_HOST_CAP_HIGHSPEED;
+  if (Caps1 & SDHCI_CAP_8BIT)
+    Caps |= MMC_HOST_CAP_8BIT;
+
+  // any UHS-I mode implies 1.8V signaling
+  if (Caps2 & SDHCI_CAP2_SDR50)
+    Caps |= MMC_HOST_CAP_SDR50 | MMC_HOST_CAP_1V8_SIGNALING;
+  if (Caps2 & SDHCI_CAP2_SDR104)
+    Caps |= MMC_HOST_CAP_SDR104 | MMC_HOST_CAP_1V8_SIGNALING;
+  if (Caps2 & SDHCI_CAP2_DDR50)
+    Caps |= MMC_HOST_CAP_DDR50 | MMC_HOST_CAP_1V8_SIGNALING;
+  if (Caps2 & SDHCI_CAP2_SDR50_TUNING)
+    Caps |= MMC_HOST_CAP_SDR50_TUNING;
+
+  // eMMC timings, the PHY has the data strobe input and DLL needed by HS400
+  if (Caps2 & SDHCI_CAP2_DDR50)
+    Caps |= MMC_HOST_CAP_DDR52;
+  if (Caps2 & SDHCI_CAP2_SDR104)
+    Caps |= MMC_HOST_CAP_HS200;
+  if ((Caps2 & SDHCI_CAP2_SDR104) && (Caps1 & SDHCI_CAP_8BIT))
+    Caps |= MMC_HOST_CAP_HS400 | MMC_HOST_CAP_HS400_ES;
+
+  // BmSdPrepare () only sets up the 32-bit block count of version 4 mode for ADMA2,
+  // Auto CMD23 takes its argument from there too
+  Ctrl2 = MmioRead16 (BmParams.RegBase + SDHCI_HOST_CONTROL2);
+  if (!(BmParams.Flags & SD_USE_PIO) && (Ctrl2 & SDHCI_HOST_VER4_ENABLE)) {
+    Caps |= MMC_HOST_CAP_BLKCNT_32BIT | MMC_HOST_CAP_ANY_ALIGN;
+    if (Ctrl2 & SDHCI_CMD23_ENABLE)
+      Caps |= MMC_HOST_CAP_AUTO_CMD23;
+  }
+
+  return Caps;
+}
+
+/**
+  Select the bus timing of the host controller.
+
+  The SD clock is not changed, the caller sets it with BmSdSetIos ()
+  after the card has been switched to the new timing. The eMMC HS200 and
+  HS400 timings move the host to 1.8V signaling by themselves, eMMC has
+  no voltage switch handshake.
+
+  @param[in] Timing  The bus timing to select.
+
+  @retval EFI_SUCCESS             The bus timing was selected.
+  @retval EFI_UNSUPPORTED         The host controller does not support the timing.
+
+**/
+EFI_STATUS
+BmSdSetTiming (
+  IN MMC_BUS_TIMING  Timing
+  )
+{
+  UINTN    Base;
+  UINT8    Ctrl;
+  UINT16   Ctrl2;
+  UINT16   EmmcCtrl;
+  BOOLEAN  Switch1V8;
+
+  Base     = BmParams.RegBase;
+  Ctrl     = MmioRead8 (Base + SDHCI_HOST_CONTROL) & ~SDHCI_CTRL_HISPD;
+  Ctrl2    = MmioRead16 (Base + SDHCI_HOST_CONTROL2) & ~SDHCI_CTRL_UHS_MASK;
+  EmmcCtrl = MmioRead16 (BmParams.VendorBase + VENDOR_SD_CTRL) &
+             ~(VENDOR_SD_CTRL_CARD_IS_EMMC | VENDOR_SD_CTRL_ENH_STROBE_EN);
+
+  switch (Timing) {
+    case MmcTimingLegacy:
+      break;
+    case MmcTimingSdHs:
+      Ctrl |= SDHCI_CTRL_HISPD;
+      break;
+    case MmcTimingUhsSdr12:
+      Ctrl2 |= SDHCI_CTRL_UHS_SDR12;
+      break;
+    case MmcTimingUhsSdr25:
+      Ctrl  |= SDHCI_CTRL_HISPD;
+      Ctrl2 |= SDHCI_CTRL_UHS_SDR25;
+      break;
+    case MmcTimingUhsSdr50:
+      Ctrl  |= SDHCI_CTRL_HISPD;
+      Ctrl2 |= SDHCI_CTRL_UHS_SDR50;
+      break;
+    case MmcTimingUhsSdr104:
+      Ctrl  |= SDHCI_CTRL_HISPD;
+      Ctrl2 |= SDHCI_CTRL_UHS_SDR104;
+      break;
+    case MmcTimingUhsDdr50:
+      Ctrl  |= SDHCI_CTRL_HISPD;
+      Ctrl2 |= SDHCI_CTRL_UHS_DDR50;
+      break;
+    case MmcTimingMmcHs:
+      Ctrl     |= SDHCI_CTRL_HISPD;
+      EmmcCtrl |= VENDOR_SD_CTRL_CARD_IS_EMMC;
+      break;
+    case MmcTimingMmcDdr52:
+      Ctrl     |= SDHCI_CTRL_HISPD;
+      Ctrl2    |= SDHCI_CTRL_UHS_DDR50;
+      EmmcCtrl |= VENDOR_SD_CTRL_CARD_IS_EMMC;
+      break;
+    case MmcTimingMmcHs200:
+      Ctrl     |= SDHCI_CTRL_HISPD;
+      Ctrl2    |= SDHCI_CTRL_UHS_SDR104 | SDHCI_CTRL_VDD_180;
+      EmmcCtrl |= VENDOR_SD_CTRL_CARD_IS_EMMC;
+      break;
+    case MmcTimingMmcHs400:
+      Ctrl     |= SDHCI_CTRL_HISPD;
+      Ctrl2    |= SDHCI_CTRL_HS400 | SDHCI_CTRL_VDD_180;
+      EmmcCtrl |= VENDOR_SD_CTRL_CARD_IS_EMMC;
+      break;
+    case MmcTimingMmcHs400Es:
+      Ctrl     |= SDHCI_CTRL_HISPD;
+      Ctrl2    |= SDHCI_CTRL_HS400 | SDHCI_CTRL_VDD_180;
+      EmmcCtrl |= VENDOR_SD_CTRL_CARD_IS_EMMC | VENDOR_SD_CTRL_ENH_STROBE_EN;
+      break;
+    default:
+      return EFI_UNSUPPORTED;
+  }
+
+  // UHS-I timings are only defined for 1.8V signaling
+  if ((Timing >= MmcTimingUhsSdr12) && (Timing <= MmcTimingUhsDdr50) && !(Ctrl2 & SDHCI_CTRL_VDD_180)) {
+    DEBUG ((DEBUG_ERROR, "%a: timing %d needs 1.8V signaling\n", __FUNCTION__, Timing));
+    return EFI_UNSUPPORTED;
+  }
+
+  if ((Timing >= MmcTimingMmcHs200) && !(BmSdGetCaps () & MMC_HOST_CAP_1V8_SIGNALING)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Switch1V8 = (Ctrl2 & SDHCI_CTRL_VDD_180) &&
+              !(MmioRead16 (Base + SDHCI_HOST_CONTROL2) & SDHCI_CTRL_VDD_180);
+
+  // the timing must not change while the SD clock is running
+  MmioAnd16 (Base + SDHCI_CLK_CTRL, ~SDHCI_CLK_SD_EN);
+  MmioWrite8 (Base + SDHCI_HOST_CONTROL, Ctrl);
+  MmioWrite16 (Base + SDHCI_HOST_CONTROL2, Ctrl2);
+  MmioWrite16 (BmParams.VendorBase + VENDOR_SD_CTRL, EmmcCtrl);
+  if (Switch1V8) {
+    SdPhySetPadRxSel (PAD_CNFG_RXSEL_1V8);
+    // the signal voltage regulator has 5ms to settle
+    gBS->Stall (5000);
+  }
+  MmioOr16 (Base + SDHCI_CLK_CTRL, SDHCI_CLK_SD_EN);
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Switch the signal voltage of the host controller to 1.8V.
+
+  This follows the host side of the voltage switch sequence, it must be
+  called right after the card accepted CMD11.
+
+  @retval EFI_SUCCESS             The signal voltage was switched to 1.8V.
+  @retval EFI_UNSUPPORTED         The host controller cannot signal at 1.8V.
+  @retval EFI_DEVICE_ERROR        The card did not complete the voltage switch.
+
+**/
+EFI_STATUS
+BmSdSwitchVoltage (
+  VOID
+  )
+{
+  UINTN  Base;
+
+  Base = BmParams.RegBase;
+
+  if (!(BmSdGetCaps () & MMC_HOST_CAP_1V8_SIGNALING)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  // stop SD clock, the card holds DAT[3:0] low while it switches
+  MmioAnd16 (Base + SDHCI_CLK_CTRL, ~SDHCI_CLK_SD_EN);
+  if (MmioRead32 (Base + SDHCI_PSTATE) & SDHCI_DATA_LVL_MASK) {
+    DEBUG ((DEBUG_ERROR, "%a: DAT[3:0] not low after CMD11\n", __FUNCTION__));
+    return EFI_DEVICE_ERROR;
+  }
+
+  MmioOr16 (Base + SDHCI_HOST_CONTROL2, SDHCI_CTRL_VDD_180);
+  SdPhySetPadRxSel (PAD_CNFG_RXSEL_1V8);
+
+  // the signal voltage regulator has 5ms to settle
+  gBS->Stall (5000);
+
+  if (!(MmioRead16 (Base + SDHCI_HOST_CONTROL2) & SDHCI_CTRL_VDD_180)) {
+    DEBUG ((DEBUG_ERROR, "%a: 1.8V signaling not enabled\n", __FUNCTION__));
+    SdPhySetPadRxSel (PAD_CNFG_RXSEL_3V3);
+    return EFI_DEVICE_ERROR;
+  }
+
+  // supply SD clock, the card releases DAT[3:0] within 1ms
+  MmioOr16 (Base + SDHCI_CLK_CTRL, SDHCI_CLK_SD_EN);
+  gBS->Stall (1000);
+
+  if ((MmioRead32 (Base + SDHCI_PSTATE) & SDHCI_DATA_LVL_MASK) != SDHCI_DATA_LVL_MASK) {
+    DEBUG ((DEBUG_ERROR, "%a: DAT[3:0] not high after voltage switch\n", __FUNCTION__));
+    return EFI_DEVICE_ERROR;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Tune the sampling clock for the current bus timing.
+
+  The DWC MSHC auto-tuning engine moves the sampling point itself, software
+  keeps issuing the tuning command until the engine clears EXEC_TUNING.
+
+  @param[in] CmdIdx  The tuning command, CMD19 for SD cards, CMD21 for eMMC.
+
+  @retval EFI_SUCCESS             The sampling clock was tuned.
+  @retval EFI_DEVICE_ERROR        The tuning procedure did not find a sampling point.
+  @retval EFI_TIMEOUT             The card did not answer the tuning command.
+
+**/
+EFI_STATUS
+BmSdExecuteTuning (
+  IN UINT32  CmdIdx
+  )
+{
+  UINTN   Base;
+  UINT32  AtCtrl;
+  UINT16  Ctrl2;
+  UINT16  State;
+  UINT32  Timeout;
+  UINT32  BlockSize;
+  INT32   I;
+
+  Base = BmParams.RegBase;
+
+  // the eMMC tuning block is twice as long on an 8-bit bus
+  if ((CmdIdx == MMC_CMD21) && (MmioRead8 (Base + SDHCI_HOST_CONTROL) & SDHCI_EXT_DAT_XFER))
+    BlockSize = SDHCI_TUNING_BLOCK_SIZE_8BIT;
+  else
+    BlockSize = SDHCI_TUNING_BLOCK_SIZE;
+
+  // take the sampling clock from the auto-tuning delay line
+  MmioWrite8 (Base + SDHCI_P_ATDL_CNFG, (3 << ATDL_CNFG_INPSEL_CNFG));
+
+  AtCtrl  = MmioRead32 (BmParams.VendorBase + VENDOR_AT_CTRL);
+  AtCtrl &= ~(AT_CTRL_CI_SEL | AT_CTRL_RPT_TUNE_ERR | AT_CTRL_SW_TUNE_EN |
+              AT_CTRL_WIN_EDGE_SEL_MASK | AT_CTRL_PRE_CHANGE_DLY (0x3) |
+              AT_CTRL_POST_CHANGE_DLY (0x3) | AT_CTRL_SWIN_TH_VAL (0xFF));
+  AtCtrl |= AT_CTRL_AT_EN | AT_CTRL_SWIN_TH_EN | AT_CTRL_TUNE_CLK_STOP_EN |
+            AT_CTRL_PRE_CHANGE_DLY (1) | AT_CTRL_POST_CHANGE_DLY (3) |
+            AT_CTRL_SWIN_TH_VAL (9);
+  MmioWrite32 (BmParams.VendorBase + VENDOR_AT_CTRL, AtCtrl);
+
+  MmioAnd16 (Base + SDHCI_HOST_CONTROL2, ~SDHCI_CTRL_TUNED_CLK);
+  MmioOr16 (Base + SDHCI_HOST_CONTROL2, SDHCI_CTRL_EXEC_TUNING);
+
+  Ctrl2 = MmioRead16 (Base + SDHCI_HOST_CONTROL2);
+  for (I = 0; I < SDHCI_TUNING_MAX_LOOP; I++) {
+    // make sure Cmd and dat lines are clear
+    for (Timeout = 10000; Timeout > 0; Timeout--) {
+      if (!(MmioRead32 (Base + SDHCI_PSTATE) & (SDHCI_CMD_INHIBIT | SDHCI_CMD_INHIBIT_DAT)))
+        break;
+      gBS->Stall (1);
+    }
+
+    MmioWrite16 (Base + SDHCI_BLOCK_SIZE, SDHCI_MAKE_BLKSZ (0, BlockSize));
+    MmioWrite16 (Base + SDHCI_TRANSFER_MODE, SDHCI_TRNS_READ);
+    MmioWrite32 (Base + SDHCI_ARGUMENT, 0);
+    MmioWrite16 (Base + SDHCI_COMMAND, SDHCI_MAKE_CMD (CmdIdx,
+            SDHCI_CMD_RESP_SHORT | SDHCI_CMD_CRC | SDHCI_CMD_INDEX | SDHCI_CMD_DATA));
+
+    // the tuning block is consumed by the controller, only wait for it
+    for (Timeout = 15000; Timeout > 0; Timeout--) {
+      State = MmioRead16 (Base + SDHCI_INT_STATUS);
+      if (State & (SDHCI_INT_BUF_RD_READY | SDHCI_INT_ERROR))
+        break;
+      gBS->Stall (10);
+    }
+
+    if (Timeout == 0) {
+      DEBUG ((DEBUG_ERROR, "%a: CMD%d Timeout!\n", __FUNCTION__, CmdIdx));
+      MmioAnd16 (Base + SDHCI_HOST_CONTROL2, ~SDHCI_CTRL_EXEC_TUNING);
+      SdResetCmdData ();
+      return EFI_TIMEOUT;
+    }
+
+    // a sampling point that fails the CRC is expected while tuning
+    if (State & SDHCI_INT_ERROR) {
+      MmioWrite16 (Base + SDHCI_ERR_INT_STATUS, MmioRead16 (Base + SDHCI_ERR_INT_STATUS));
+      SdResetCmdData ();
+    }
+    MmioWrite16 (Base + SDHCI_INT_STATUS, State);
+
+    Ctrl2 = MmioRead16 (Base + SDHCI_HOST_CONTROL2);
+    if (!(Ctrl2 & SDHCI_CTRL_EXEC_TUNING))
+      break;
+  }
+
+  if ((Ctrl2 & SDHCI_CTRL_EXEC_TUNING) || !(Ctrl2 & SDHCI_CTRL_TUNED_CLK)) {
+    DEBUG ((DEBUG_ERROR, "%a: tuning failed after %d loops, Ctrl2=0x%x\n", __FUNCTION__, I, Ctrl2));
+    MmioAnd16 (Base + SDHCI_HOST_CONTROL2, ~(SDHCI_CTRL_EXEC_TUNING | SDHCI_CTRL_TUNED_CLK));
+    MmioAnd32 (BmParams.VendorBase + VENDOR_AT_CTRL, ~AT_CTRL_AT_EN);
+    SdResetCmdData ();
+    return EFI_DEVICE_ERROR;
+  }
+
+  DEBUG ((DEBUG_INFO, "%a: tuned after %d loops, AT_STAT=0x%x\n", __FUNCTION__, I,
+                          MmioRead32 (BmParams.VendorBase + VENDOR_AT_STAT)));
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Build an ADMA2 descriptor table that describes a whole data transfer.
+
+  The table is laid out as a sequence of TRAN lines, each covering at most
+  SDHCI_ADMA2_MAX_LEN_PER_LINE bytes and never crossing an
+  SDHCI_ADMA2_BOUNDARY. The last line is marked with the End attribute.
+  This routine does not touch the host controller registers.
+
+  @param[out] Desc        Pointer to the descriptor table.
+  @param[in]  DescCount   Number of lines available in the descriptor table.
+  @param[in]  Address     Bus address of the data buffer.
+  @param[in]  Size        Size of the data buffer in bytes.
+  @param[out] LineCount   Number of lines used to describe the transfer.
+
+  @retval EFI_SUCCESS             The descriptor table was built successfully.
+  @retval EFI_INVALID_PARAMETER   Size is zero or Address is not 4-byte aligned.
+  @retval EFI_BUFFER_TOO_SMALL    DescCount is too small, LineCount holds the
+                                  number of lines that is required.
+
+**/
+EFI_STATUS
+SdAdmaBuildDescTable (
+  OUT SDHCI_ADMA2_64_DESC_LINE  *Desc,
+  IN  UINTN                     DescCount,
+  IN  UINT64                    Address,
+  IN  UINTN                     Size,
+  OUT UINTN                     *LineCount
+  )
+{
+  UINT64  Cursor;
+  UINT64  Remaining;
+  UINT64  Length;
+  UINTN   Index;
+
+  if ((Size == 0) || ((Address & 0x3) != 0) || (LineCount == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  //
+  // Count the lines first, so the table is never partially written.
+  //
+  Index     = 0;
+  Cursor    = Address;
+  Remaining = Size;
+  while (Remaining > 0) {
+    Length     = MIN (Remaining, SDHCI_ADMA2_MAX_LEN_PER_LINE);
+    Length     = MIN (Length, SDHCI_ADMA2_BOUNDARY - (Cursor & (SDHCI_ADMA2_BOUNDARY - 1)));
+    Cursor    += Length;
+    Remaining -= Length;
+    Index++;
+  }
+
+  *LineCount = Index;
+  if ((Desc == NULL) || (Index > DescCount)) {
+    return EFI_BUFFER_TOO_SMALL;
+  }
+
+  ZeroMem (Desc, Index * sizeof (SDHCI_ADMA2_64_DESC_LINE));
+
+  Index     = 0;
+  Remaining = Size;
+  while (Remaining > 0) {
+    Length = MIN (Remaining, SDHCI_ADMA2_MAX_LEN_PER_LINE);
+    Length = MIN (Length, SDHCI_ADMA2_BOUNDARY - (Address & (SDHCI_ADMA2_BOUNDARY - 1)));
+
+    Desc[Index].Valid        = 1;
+    Desc[Index].Act          = SDHCI_ADMA2_ACT_TRAN;
+    // a zero length field means 64KB
+    Desc[Index].LowerLength  = (UINT16)Length;
+    Desc[Index].LowerAddress = (UINT32)Address;
+    Desc[Index].UpperAddress = (UINT32)RShiftU64 (Address, 32);
+
+    Address   += Length;
+    Remaining -= Length;
+    Index++;
+  }
+
+  Desc[Index - 1].End = 1;
+
   return EFI_SUCCESS;
 }
 
+/**
+  Make sure the ADMA2 descriptor table can describe the transfer and build it.
+
+  The table grows on demand, so a whole MmcIoBlocks request is always
+  described by a single table.
+
+  @param[in]  Buf       Buffer Address.
+  @param[in]  Size      Size of the transfer in bytes.
+
+  @retval EFI_SUCCESS             The descriptor table was built successfully.
+  @retval EFI_OUT_OF_RESOURCES    The descriptor table could not be grown.
+  @retval Other                   The transfer cannot be described by ADMA2.
+
+**/
+STATIC
+EFI_STATUS
+SdAdmaPrepare (
+  IN UINTN  Buf,
+  IN UINTN  Size
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       LineCount;
+  UINTN       Pages;
+  VOID        *Table;
+
+  Status = SdAdmaBuildDescTable (
+             (SDHCI_ADMA2_64_DESC_LINE *)BmParams.DescBase,
+             BmParams.DescSize / sizeof (SDHCI_ADMA2_64_DESC_LINE),
+             Buf,
+             Size,
+             &LineCount
+             );
+  if (Status != EFI_BUFFER_TOO_SMALL) {
+    return Status;
+  }
+
+  Pages = EFI_SIZE_TO_PAGES (LineCount * sizeof (SDHCI_ADMA2_64_DESC_LINE));
+  Table = SdDmaAllocatePages (Pages);
+  if (Table == NULL) {
+    DEBUG ((DEBUG_ERROR, "%a: unable to grow ADMA2 table to %u lines\n", __FUNCTION__, LineCount));
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  if (BmParams.DescBase != 0) {
+    FreePages ((VOID *)BmParams.DescBase, EFI_SIZE_TO_PAGES (BmParams.DescSize));
+  }
+
+  BmParams.DescBase = (UINTN)Table;
+  BmParams.DescSize = EFI_PAGES_TO_SIZE (Pages);
+
+  return SdAdmaBuildDescTable (
+           (SDHCI_ADMA2_64_DESC_LINE *)BmParams.DescBase,
+           BmParams.DescSize / sizeof (SDHCI_ADMA2_64_DESC_LINE),
+           Buf,
+           Size,
+           &LineCount
+           );
+}
+
 /**
   Prepare the SD card for data transfer. 
   Set the number and size of data blocks before sending IO commands to the SD card.
@@ -606,11 +1340,13 @@ BmSdPrepare (
   IN UINTN Size
   )
 {
-  UINTN   LoadAddr;
-  UINTN   Base;
-  UINT32  BlockCnt;
-  UINT32  BlockSize;
-  UINT8   Tmp;
+  EFI_STATUS  Status;
+  UINTN       LoadAddr;
+  UINTN       DeviceAddr;
+  UINTN       Base;
+  UINT32      BlockCnt;
+  UINT32      BlockSize;
+  UINT8       Tmp;
 
   LoadAddr = Buf;
 
@@ -622,33 +1358,46 @@ BmSdPrepare (
     BlockSize = MMC_BLOCK_SIZE;
     BlockCnt  = Size / MMC_BLOCK_SIZE;
   } else {
-    // ACMD51
-    ASSERT (((LoadAddr & 8) == 0) && ((Size % 8) == 0));
-    BlockSize = 8;
-    BlockCnt  = Size / 8;
+    // ACMD51, ACMD22
+    ASSERT (((LoadAddr & 0x3) == 0) && ((Size % 4) == 0));
+    BlockSize = Size;
+    BlockCnt  = 1;
   }
 
   Base = BmParams.RegBase;
 
   if (!(BmParams.Flags & SD_USE_PIO)) {
+    BmParams.XferLength = BlockCnt * BlockSize;
+
+    Status = SdDmaMap (LoadAddr, BlockCnt * BlockSize, &DeviceAddr);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    Status = SdAdmaPrepare (DeviceAddr, BlockCnt * BlockSize);
+    if (EFI_ERROR (Status)) {
+      BmParams.BounceHost = 0;
+      return Status;
+    }
+
     if (MmioRead16 (Base + SDHCI_HOST_CONTROL2) & SDHCI_HOST_VER4_ENABLE) {
-      MmioWrite32 (Base + SDHCI_ADMA_SA_LOW, LoadAddr);
-      MmioWrite32 (Base + SDHCI_ADMA_SA_HIGH, (LoadAddr >> 32));
+      // 32-bit block count register in version 4 mode
       MmioWrite32 (Base + SDHCI_DMA_ADDRESS, BlockCnt);
       MmioWrite16 (Base + SDHCI_BLOCK_COUNT, 0);
     } else {
-      ASSERT((LoadAddr >> 32) == 0);
-      MmioWrite32 (Base + SDHCI_DMA_ADDRESS, LoadAddr);
+      ASSERT (BlockCnt <= MAX_UINT16);
       MmioWrite16 (Base + SDHCI_BLOCK_COUNT, BlockCnt);
     }
 
-    // 512K bytes SDMA buffer boundary
-    MmioWrite16 (Base + SDHCI_BLOCK_SIZE, SDHCI_MAKE_BLKSZ(7, BlockSize));
+    MmioWrite32 (Base + SDHCI_ADMA_SA_LOW, (UINT32)BmParams.DescBase);
+    MmioWrite32 (Base + SDHCI_ADMA_SA_HIGH, (UINT32)((UINT64)BmParams.DescBase >> 32));
 
-    // select SDMA
+    MmioWrite16 (Base + SDHCI_BLOCK_SIZE, SDHCI_MAKE_BLKSZ(0, BlockSize));
+
+    // select ADMA2
     Tmp = MmioRead8 (Base + SDHCI_HOST_CONTROL);
     Tmp &= ~SDHCI_CTRL_DMA_MASK;
-    Tmp |= SDHCI_CTRL_SDMA;
+    Tmp |= SDHCI_CTRL_ADMA2;
     MmioWrite8 (Base + SDHCI_HOST_CONTROL, Tmp);
   } else {
     MmioWrite16 (Base + SDHCI_BLOCK_SIZE, BlockSize);
@@ -929,7 +1678,16 @@ SdInit (
 
   DEBUG ((DEBUG_INFO, "SD initializing %dHz\n", BmParams.ClkRate));
 
-  BmParams.Flags = Flags;
+  BmParams.Flags    = Flags;
+  BmParams.DmaLimit = FixedPcdGet64 (PcdSG2042SDIODmaLimit);
+
+  if (!(BmParams.Flags & SD_USE_PIO) && (BmParams.DescBase == 0)) {
+    BmParams.DescBase = (UINTN)SdDmaAllocatePages (SDHCI_ADMA2_DESC_PAGES);
+    if (BmParams.DescBase == 0) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    BmParams.DescSize = EFI_PAGES_TO_SIZE (SDHCI_ADMA2_DESC_PAGES);
+  }
 
   SdPhyInit ();
 
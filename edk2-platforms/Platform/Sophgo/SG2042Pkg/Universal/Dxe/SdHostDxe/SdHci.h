@@ -21,6 +21,7 @@
 #define SDHCI_TRNS_DMA                  BIT0
 #define SDHCI_TRNS_BLK_CNT_EN           BIT1
 #define SDHCI_TRNS_ACMD12               BIT2
+#define SDHCI_TRNS_ACMD23               BIT3
 #define SDHCI_TRNS_READ                 BIT4
 #define SDHCI_TRNS_MULTI                BIT5
 #define SDHCI_TRNS_RESP_INT             BIT8
@@ -45,17 +46,21 @@
 #define SDHCI_BUF_WR_ENABLE             BIT10
 #define SDHCI_BUF_RD_ENABLE             BIT11
 #define SDHCI_CARD_INSERTED             BIT16
+#define SDHCI_DATA_LVL_MASK             0x00F00000
 #define SDHCI_HOST_CONTROL              0x28
 #define SDHCI_DAT_XFER_WIDTH            BIT1
+#define SDHCI_CTRL_HISPD                BIT2
 #define SDHCI_EXT_DAT_XFER              BIT5
 #define SDHCI_CTRL_DMA_MASK             0x18
 #define SDHCI_CTRL_SDMA                 0x00
+#define SDHCI_CTRL_ADMA2                0x10
 #define SDHCI_PWR_CONTROL               0x29
 #define SDHCI_BUS_VOL_VDD1_1_8V         0xC
 #define SDHCI_BUS_VOL_VDD1_3_0V         0xE
 #define SDHCI_BUF_DATA_R                0x20
 #define SDHCI_BLOCK_GAP_CONTROL         0x2A
 #define SDHCI_CLK_CTRL                  0x2C
+#define SDHCI_CLK_SD_EN                 BIT2
 #define SDHCI_TOUT_CTRL                 0x2E
 #define SDHCI_SOFTWARE_RESET            0x2F
 #define SDHCI_RESET_CMD                 0x02
@@ -68,6 +73,7 @@
 #define SDHCI_INT_BUF_WR_READY          BIT4
 #define SDHCI_INT_BUF_RD_READY          BIT5
 #define SDHCI_INT_ERROR                 BIT15
+#define SDHCI_ERR_INT_ADMA              BIT9
 #define SDHCI_INT_STATUS_EN             0x34
 #define SDHCI_ERR_INT_STATUS_EN         0x36
 #define SDHCI_INT_CMD_COMPLETE_EN       BIT0
@@ -77,9 +83,30 @@
 #define SDHCI_INT_ERROR_EN              BIT15
 #define SDHCI_SIGNAL_ENABLE             0x38
 #define SDHCI_HOST_CONTROL2             0x3E
+#define SDHCI_CTRL_UHS_MASK             0x7
+#define SDHCI_CTRL_UHS_SDR12            0x0
+#define SDHCI_CTRL_UHS_SDR25            0x1
+#define SDHCI_CTRL_UHS_SDR50            0x2
+#define SDHCI_CTRL_UHS_SDR104           0x3
+#define SDHCI_CTRL_UHS_DDR50            0x4
+#define SDHCI_CTRL_HS400                0x7     // DWC MSHC, eMMC only
+#define SDHCI_CTRL_VDD_180              BIT3
+#define SDHCI_CTRL_EXEC_TUNING          BIT6
+#define SDHCI_CTRL_TUNED_CLK            BIT7
+#define SDHCI_CMD23_ENABLE              BIT11
 #define SDHCI_HOST_VER4_ENABLE          BIT12
+#define SDHCI_HOST_ADDRESSING_64        BIT13
+#define SDHCI_CTRL_PRESET_VAL_ENABLE    BIT15
 #define SDHCI_CAPABILITIES1             0x40
+#define SDHCI_CAP_8BIT                  BIT18
+#define SDHCI_CAP_HISPD                 BIT21
+#define SDHCI_CAP_SYS_BUS_64_V4         BIT27
 #define SDHCI_CAPABILITIES2             0x44
+#define SDHCI_CAP2_SDR50                BIT0
+#define SDHCI_CAP2_SDR104               BIT1
+#define SDHCI_CAP2_DDR50                BIT2
+#define SDHCI_CAP2_SDR50_TUNING         BIT13
+#define SDHCI_ADMA_ERR_STATUS           0x54
 #define SDHCI_ADMA_SA_LOW               0x58
 #define SDHCI_ADMA_SA_HIGH              0x5C
 #define SDHCI_HOST_CNTRL_VERS           0xFE
@@ -88,6 +115,21 @@
 #define P_VENDOR_SPECIFIC_AREA          0xE8
 #define P_VENDOR2_SPECIFIC_AREA         0xEA
 #define VENDOR_SD_CTRL                  0x2C
+#define VENDOR_SD_CTRL_CARD_IS_EMMC     BIT0
+#define VENDOR_SD_CTRL_ENH_STROBE_EN    BIT8
+#define VENDOR_AT_CTRL                  0x40
+#define VENDOR_AT_STAT                  0x44
+
+#define AT_CTRL_AT_EN                   BIT0
+#define AT_CTRL_CI_SEL                  BIT1
+#define AT_CTRL_SWIN_TH_EN              BIT2
+#define AT_CTRL_RPT_TUNE_ERR            BIT3
+#define AT_CTRL_SW_TUNE_EN              BIT4
+#define AT_CTRL_WIN_EDGE_SEL_MASK       (0xF << 8)
+#define AT_CTRL_TUNE_CLK_STOP_EN        BIT16
+#define AT_CTRL_PRE_CHANGE_DLY(x)       (((x) & 0x3) << 17)
+#define AT_CTRL_POST_CHANGE_DLY(x)      (((x) & 0x3) << 19)
+#define AT_CTRL_SWIN_TH_VAL(x)          (((x) & 0xFF) << 24)
 
 #define SDHCI_PHY_R_OFFSET              0x300
 
@@ -125,6 +167,8 @@
 
 #define PAD_CNFG_RXSEL                0
 #define PAD_CNFG_RXSEL_MSK            0x7
+#define PAD_CNFG_RXSEL_1V8            0x1
+#define PAD_CNFG_RXSEL_3V3            0x2
 #define PAD_CNFG_WEAKPULL_EN          3
 #define PAD_CNFG_WEAKPULL_EN_MSK      0x3
 #define PAD_CNFG_TXSLEW_CTRL_P        5
@@ -152,8 +196,49 @@
 #define ATDL_CNFG_INPSEL_CNFG         2
 #define ATDL_CNFG_INPSEL_CNFG_MSK     0x3
 
+#define DLL_CTRL_DLL_EN               BIT0
+#define DLL_CNFG1_SLVDLY(x)           (((x) & 0x3) << 4)
+#define DLLDL_CNFG_SLV_INPSEL(x)      (((x) & 0x3) << 5)
+#define DLL_STATUS_LOCK_STS           BIT0
+#define DLL_STATUS_ERROR_STS          BIT1
+
 #define SD_USE_PIO                    0x1
 
+//
+// Tuning is done by the DWC MSHC auto-tuning engine, software only issues
+// the tuning command until the engine clears EXEC_TUNING.
+//
+#define SDHCI_TUNING_BLOCK_SIZE       64
+#define SDHCI_TUNING_BLOCK_SIZE_8BIT  128     // eMMC CMD21 on an 8-bit bus
+#define SDHCI_TUNING_MAX_LOOP         128
+
+//
+// ADMA2 descriptor attributes and limits. Each line of the table moves at
+// most 64KB, and the DWC MSHC additionally requires that the data buffer
+// described by a single line does not cross a 128MB boundary.
+//
+#define SDHCI_ADMA2_ACT_NOP           0x0
+#define SDHCI_ADMA2_ACT_TRAN          0x2
+#define SDHCI_ADMA2_ACT_LINK          0x3
+#define SDHCI_ADMA2_MAX_LEN_PER_LINE  SIZE_64KB
+#define SDHCI_ADMA2_BOUNDARY          SIZE_128MB
+#define SDHCI_ADMA2_DESC_PAGES        2
+
+//
+// ADMA2 moves data to and from 32-bit aligned addresses only. Buffers that
+// are misaligned or out of reach of the DMA engine go through a bounce
+// buffer, which is kept and grown on demand like the descriptor table.
+//
+#define SDHCI_DMA_ALIGN               4
+
+//
+// The data timeout counter of the controller only bounds the time between
+// two blocks. The wait for a whole ADMA2 transfer gives up when it takes
+// longer than a card moving 512KB/s would.
+//
+#define SDHCI_XFER_TIMEOUT_BASE_US    1000000
+#define SDHCI_XFER_TIMEOUT_BLOCK_US   1000
+
 /**
   card detect status
   -1: haven't check the card detect register
@@ -171,17 +256,68 @@ typedef struct {
   UINT32	Response[4];
 }MMC_CMD;
 
+//
+// ADMA2 descriptor line for 64-bit addressing in host version 4 mode.
+//
+typedef struct {
+  UINT32  Valid       : 1;
+  UINT32  End         : 1;
+  UINT32  Int         : 1;
+  UINT32  Reserved    : 1;
+  UINT32  Act         : 2;
+  UINT32  UpperLength : 10;
+  UINT32  LowerLength : 16;
+  UINT32  LowerAddress;
+  UINT32  UpperAddress;
+  UINT32  Reserved1;
+} SDHCI_ADMA2_64_DESC_LINE;
+
 typedef struct {
   UINTN	RegBase;
   UINTN	VendorBase;
   UINTN	DescBase;
   UINTN   DescSize;
+  UINT64  DmaLimit;       // highest bus address the DMA engine reaches
+  UINTN   BounceBase;
+  UINTN   BounceSize;
+  UINTN   BounceHost;     // caller buffer of the mapped transfer, 0 if it is not bounced
+  UINTN   BounceLength;
+  UINTN   XferLength;     // bytes of the transfer BmSdPrepare () set up
   INT32	ClkRate;
   INT32	BusWidth;
   UINT32	Flags;
   INT32	CardIn;
 } BM_SD_PARAMS;
 
+/**
+  Build an ADMA2 descriptor table that describes a whole data transfer.
+
+  The table is laid out as a sequence of TRAN lines, each covering at most
+  SDHCI_ADMA2_MAX_LEN_PER_LINE bytes and never crossing an
+  SDHCI_ADMA2_BOUNDARY. The last line is marked with the End attribute.
+  This routine does not touch the host controller registers.
+
+  @param[out] Desc        Pointer to the descriptor table.
+  @param[in]  DescCount   Number of lines available in the descriptor table.
+  @param[in]  Address     Bus address of the data buffer.
+  @param[in]  Size        Size of the data buffer in bytes.
+  @param[out] LineCount   Number of lines used to describe the transfer.
+
+  @retval EFI_SUCCESS             The descriptor table was built successfully.
+  @retval EFI_INVALID_PARAMETER   Size is zero or Address is not 4-byte aligned.
+  @retval EFI_BUFFER_TOO_SMALL    DescCount is too small, LineCount holds the
+                                  number of lines that is required.
+
+**/
+EFI_STATUS
+SdAdmaBuildDescTable (
+  OUT SDHCI_ADMA2_64_DESC_LINE  *Desc,
+  IN  UINTN                     DescCount,
+  IN  UINT64                    Address,
+  IN  UINTN                     Size,
+  OUT UINTN                     *LineCount
+  );
+
 /**
   SD card sends command.
 
@@ -222,11 +358,15 @@ BmSdCardDetect (
 /**
   Set the input/output settings for the SD card.
 
+  The data strobe DLL of the PHY is locked to the new clock when the
+  HS400 timing is selected.
+
   @param[in] Clk     The clock frequency for the SD card.
   @param[in] Width   The bus width for data transfer.
 
   @retval EFI_SUCCESS             The input/output settings were set successfully.
   @retval EFI_UNSUPPORTED         The specified bus width is not supported.
+  @retval EFI_DEVICE_ERROR        The DLL did not lock.
 
 **/
 EFI_STATUS 
@@ -290,6 +430,67 @@ BmSdWrite (
   IN UINTN   Size
   );
 
+/**
+  Return the bus capabilities of the host controller.
+
+  @return A bit mask of MMC_HOST_CAP_* values.
+
+**/
+UINT32
+BmSdGetCaps (
+  VOID
+  );
+
+/**
+  Select the bus timing of the host controller.
+
+  The SD clock is not changed, the caller sets it with BmSdSetIos ()
+  after the card has been switched to the new timing. The eMMC HS200 and
+  HS400 timings move the host to 1.8V signaling by themselves, eMMC has
+  no voltage switch handshake.
+
+  @param[in] Timing  The bus timing to select.
+
+  @retval EFI_SUCCESS             The bus timing was selected.
+  @retval EFI_UNSUPPORTED         The host controller does not support the timing.
+
+**/
+EFI_STATUS
+BmSdSetTiming (
+  IN MMC_BUS_TIMING  Timing
+  );
+
+/**
+  Switch the signal voltage of the host controller to 1.8V.
+
+  This follows the host side of the voltage switch sequence, it must be
+  called right after the card accepted CMD11.
+
+  @retval EFI_SUCCESS             The signal voltage was switched to 1.8V.
+  @retval EFI_UNSUPPORTED         The host controller cannot signal at 1.8V.
+  @retval EFI_DEVICE_ERROR        The card did not complete the voltage switch.
+
+**/
+EFI_STATUS
+BmSdSwitchVoltage (
+  VOID
+  );
+
+/**
+  Tune the sampling clock for the current bus timing.
+
+  @param[in] CmdIdx  The tuning command, CMD19 for SD cards, CMD21 for eMMC.
+
+  @retval EFI_SUCCESS             The sampling clock was tuned.
+  @retval EFI_DEVICE_ERROR        The tuning procedure did not find a sampling point.
+  @retval EFI_TIMEOUT             The card did not answer the tuning command.
+
+**/
+EFI_STATUS
+BmSdExecuteTuning (
+  IN UINT32  CmdIdx
+  );
+
 /**
   Initialize the SD card.
 
@@ -289,7 +289,7 @@ SdNotifyState (
     case MmcHwInitializationState:
       DEBUG ((DEBUG_MMCHOST_SD, "MmcHwInitializationState\n", State));
 
-      EFI_STATUS Status = SdInit (SD_USE_PIO);
+      EFI_STATUS Status = SdInit (FeaturePcdGet (PcdSG2042SDIOUseAdma) ? 0 : SD_USE_PIO);
       if (EFI_ERROR (Status)) {
         DEBUG ((DEBUG_MMCHOST_SD_ERROR,"SdHost: SdNotifyState(): Fail to initialize!\n"));
         return Status;
@@ -388,6 +388,131 @@ SdIsMultiBlock (
   return TRUE;
 }
 
+/**
+  Get the bus capabilities of the SD host.
+
+  UHS-I, HS200 and HS400 timings are hidden when the board cannot switch
+  the SD I/O rail to 1.8V, the 8-bit bus when DAT[7:4] are not wired.
+
+  @param[in]  This     Pointer to the EFI_MMC_HOST_PROTOCOL instance.
+
+  @return A bit mask of MMC_HOST_CAP_* values.
+
+**/
+STATIC
+UINT32
+SdGetCapabilities (
+  IN EFI_MMC_HOST_PROTOCOL *This
+  )
+{
+  UINT32 Caps;
+
+  Caps = BmSdGetCaps ();
+
+  if (!FeaturePcdGet (PcdSG2042SDIO1V8Signaling)) {
+    Caps &= ~(MMC_HOST_CAP_1V8_SIGNALING | MMC_HOST_CAP_SDR50 | MMC_HOST_CAP_SDR104 |
+              MMC_HOST_CAP_DDR50 | MMC_HOST_CAP_SDR50_TUNING | MMC_HOST_CAP_HS200 |
+              MMC_HOST_CAP_HS400 | MMC_HOST_CAP_HS400_ES);
+  }
+
+  if (!FeaturePcdGet (PcdSG2042SDIO8BitBus)) {
+    Caps &= ~(MMC_HOST_CAP_8BIT | MMC_HOST_CAP_HS400 | MMC_HOST_CAP_HS400_ES);
+  }
+
+  return Caps;
+}
+
+/**
+  Select the bus timing of the SD host.
+
+  @param[in]  This     Pointer to the EFI_MMC_HOST_PROTOCOL instance.
+  @param[in]  Timing   The bus timing to select.
+
+  @retval EFI_SUCCESS  The operation completed successfully.
+  @retval Other        The operation failed.
+
+**/
+STATIC
+EFI_STATUS
+SdSetTiming (
+  IN EFI_MMC_HOST_PROTOCOL    *This,
+  IN MMC_BUS_TIMING           Timing
+  )
+{
+  EFI_STATUS Status;
+
+  DEBUG ((DEBUG_MMCHOST_SD_INFO, "%a: Setting Timing %d\n", __FUNCTION__, Timing));
+
+  Status = BmSdSetTiming (Timing);
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_MMCHOST_SD_ERROR, "SdSetTiming Error, Status=%r.\n", Status));
+    return Status;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Switch the SD host to 1.8V signaling after the card accepted CMD11.
+
+  @param[in]  This     Pointer to the EFI_MMC_HOST_PROTOCOL instance.
+
+  @retval EFI_SUCCESS  The operation completed successfully.
+  @retval Other        The operation failed.
+
+**/
+STATIC
+EFI_STATUS
+SdSwitchSignalVoltage (
+  IN EFI_MMC_HOST_PROTOCOL    *This
+  )
+{
+  EFI_STATUS Status;
+
+  if (!FeaturePcdGet (PcdSG2042SDIO1V8Signaling)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = BmSdSwitchVoltage ();
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_MMCHOST_SD_ERROR, "SdSwitchSignalVoltage Error, Status=%r.\n", Status));
+    return Status;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Tune the sampling clock of the SD host for the current bus timing.
+
+  @param[in]  This        Pointer to the EFI_MMC_HOST_PROTOCOL instance.
+  @param[in]  TuningCmd   The tuning command to send to the card.
+
+  @retval EFI_SUCCESS     The operation completed successfully.
+  @retval Other           The operation failed.
+
+**/
+STATIC
+EFI_STATUS
+SdExecuteTuning (
+  IN EFI_MMC_HOST_PROTOCOL    *This,
+  IN MMC_IDX                  TuningCmd
+  )
+{
+  EFI_STATUS Status;
+
+  Status = BmSdExecuteTuning (MMC_GET_INDX (TuningCmd));
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_MMCHOST_SD_ERROR, "SdExecuteTuning Error, Status=%r.\n", Status));
+    return Status;
+  }
+
+  return EFI_SUCCESS;
+}
+
 EFI_MMC_HOST_PROTOCOL gMmcHost = {
   MMC_HOST_PROTOCOL_REVISION,
   SdIsCardPresent,
@@ -399,7 +524,11 @@ EFI_MMC_HOST_PROTOCOL gMmcHost = {
   SdWriteBlockData,
   SdSetIos,
   SdPrepare,
-  SdIsMultiBlock
+  SdIsMultiBlock,
+  SdGetCapabilities,
+  SdSetTiming,
+  SdSwitchSignalVoltage,
+  SdExecuteTuning
 };
 
 /**
@@ -2,12 +2,233 @@
   Cache implementation for EFI FAT File system driver.
 
 Copyright (c) 2005 - 2013, Intel Corporation. All rights reserved.<BR>
+Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
 SPDX-License-Identifier: BSD-2-Clause-Patent
 
 **/
 
 #include "Fat.h"
 
+/**
+
+  Wait for the readahead of the data cache in flight, if any, and copy the
+  pages it loaded to their cache groups.
+
+  The volume lock holds off the callbacks at TPL_CALLBACK, and the disk may
+  need one of them to complete the read. So the wait is bounded: if the read
+  is still in flight after FAT_READ_AHEAD_TIMEOUT, it is given up on. Its
+  pages stay invalid, so that an access reads them from the disk itself, and
+  the data cache is not read ahead in the background any more.
+
+  @param  Volume                - FAT file system volume.
+
+**/
+STATIC
+VOID
+FatWaitReadAhead (
+  IN FAT_VOLUME  *Volume
+  )
+{
+  DISK_CACHE  *DiskCache;
+  CACHE_TAG   *CacheTag;
+  UINTN       PageNo;
+  UINTN       PageSize;
+  UINTN       Waited;
+  UINT64      EntryPos;
+
+  DiskCache = &Volume->DiskCache[CacheData];
+  if (DiskCache->PendingPageCount == 0) {
+    return;
+  }
+
+  for (Waited = 0; gBS->CheckEvent (DiskCache->ReadAheadToken.Event) == EFI_NOT_READY; Waited += FAT_READ_AHEAD_POLL_INTERVAL) {
+    if (Waited >= FAT_READ_AHEAD_TIMEOUT) {
+      DEBUG ((DEBUG_WARN, "FatWaitReadAhead: Readahead timed out, reading synchronously\n"));
+      DiskCache->ReadAheadAbandoned = TRUE;
+      DiskCache->PendingPageCount   = 0;
+      return;
+    }
+
+    gBS->Stall (FAT_READ_AHEAD_POLL_INTERVAL);
+  }
+
+  if (!EFI_ERROR (DiskCache->ReadAheadToken.TransactionStatus)) {
+    PageSize = (UINTN)1 << DiskCache->PageAlignment;
+    for (PageNo = DiskCache->PendingPageNo; PageNo < DiskCache->PendingPageNo + DiskCache->PendingPageCount; PageNo++) {
+      CacheTag = &DiskCache->CacheTag[PageNo & DiskCache->GroupMask];
+      EntryPos = DiskCache->BaseAddress + LShiftU64 (PageNo, DiskCache->PageAlignment);
+      ASSERT (CacheTag->PageNo == PageNo && CacheTag->RealSize == 0);
+      CacheTag->RealSize = (UINTN)MIN (PageSize, DiskCache->LimitAddress - EntryPos);
+      CopyMem (
+        DiskCache->CacheBase + ((PageNo & DiskCache->GroupMask) << DiskCache->PageAlignment),
+        DiskCache->ReadAheadBuffer + ((PageNo - DiskCache->PendingPageNo) << DiskCache->PageAlignment),
+        CacheTag->RealSize
+        );
+    }
+  }
+
+  DiskCache->PendingPageCount = 0;
+}
+
+/**
+
+  Check whether the pages of the data cache from StartPageNo to EndPageNo
+  share a cache group with the readahead in flight.
+
+  @param  DiskCache             - The data cache.
+  @param  StartPageNo           - First PageNo to be checked.
+  @param  EndPageNo             - The PageNo that follows the last one to be checked.
+
+  @retval TRUE                  - The pages share a group with the readahead.
+  @retval FALSE                 - They do not, or there is no readahead in flight.
+
+**/
+STATIC
+BOOLEAN
+FatReadAheadOverlaps (
+  IN DISK_CACHE  *DiskCache,
+  IN UINTN       StartPageNo,
+  IN UINTN       EndPageNo
+  )
+{
+  UINTN  PageNo;
+  UINTN  PendingGroupNo;
+
+  if (DiskCache->PendingPageCount == 0) {
+    return FALSE;
+  }
+
+  if (EndPageNo - StartPageNo > DiskCache->GroupMask) {
+    return TRUE;
+  }
+
+  //
+  // The groups of the readahead do not wrap around.
+  //
+  PendingGroupNo = DiskCache->PendingPageNo & DiskCache->GroupMask;
+  for (PageNo = StartPageNo; PageNo < EndPageNo; PageNo++) {
+    if (((PageNo & DiskCache->GroupMask) - PendingGroupNo) < DiskCache->PendingPageCount) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**
+
+  Load consecutive pages of the data cache from the disk with a single read.
+
+  The pages go to consecutive cache groups, so the run stops where the groups
+  wrap around, before a group that holds dirty data or is being read ahead,
+  and at the end of the volume. The pages at the start of the run that are cached already are
+  skipped, and the run stops at the next one that is.
+
+  When Async is TRUE, the pages are read through DiskIo2 into the readahead
+  buffer, and remain invalid until FatWaitReadAhead () finds the read complete
+  and copies them to their groups.
+
+  @param  Volume                - FAT file system volume.
+  @param  PageNo                - First PageNo to load.
+  @param  PageCount             - The maximum number of pages to load.
+  @param  Async                 - Whether to read the pages asynchronously.
+
+  @retval EFI_SUCCESS           - The pages were loaded, or the read started.
+  @return Others                - An error occurred when reading the disk.
+
+**/
+STATIC
+EFI_STATUS
+FatReadAheadDataCache (
+  IN FAT_VOLUME  *Volume,
+  IN UINTN       PageNo,
+  IN UINTN       PageCount,
+  IN BOOLEAN     Async
+  )
+{
+  EFI_STATUS  Status;
+  DISK_CACHE  *DiskCache;
+  CACHE_TAG   *CacheTag;
+  UINTN       GroupNo;
+  UINTN       Index;
+  UINTN       Count;
+  UINTN       PageSize;
+  UINTN       ReadSize;
+  UINT64      EntryPos;
+  UINT8       PageAlignment;
+
+  DiskCache     = &Volume->DiskCache[CacheData];
+  PageAlignment = DiskCache->PageAlignment;
+  PageSize      = (UINTN)1 << PageAlignment;
+  ASSERT (!Async || DiskCache->PendingPageCount == 0);
+
+  for (Index = 0; Index < PageCount; Index++, PageNo++) {
+    CacheTag = &DiskCache->CacheTag[PageNo & DiskCache->GroupMask];
+    if ((CacheTag->RealSize == 0) || (CacheTag->PageNo != PageNo)) {
+      break;
+    }
+  }
+
+  PageCount -= Index;
+  GroupNo    = PageNo & DiskCache->GroupMask;
+  EntryPos   = DiskCache->BaseAddress + LShiftU64 (PageNo, PageAlignment);
+  PageCount  = MIN (PageCount, DiskCache->GroupMask + 1 - GroupNo);
+  for (Count = 0; Count < PageCount; Count++) {
+    CacheTag = &DiskCache->CacheTag[GroupNo + Count];
+    if ((CacheTag->RealSize > 0) && (CacheTag->Dirty || (CacheTag->PageNo == PageNo + Count))) {
+      break;
+    }
+
+    if (FatReadAheadOverlaps (DiskCache, PageNo + Count, PageNo + Count + 1)) {
+      break;
+    }
+
+    if (EntryPos + LShiftU64 (Count, PageAlignment) >= DiskCache->LimitAddress) {
+      break;
+    }
+  }
+
+  DiskCache->ReadAheadEndPageNo = PageNo + Count;
+  if (Count == 0) {
+    return EFI_SUCCESS;
+  }
+
+  ReadSize = (UINTN)MIN (LShiftU64 (Count, PageAlignment), DiskCache->LimitAddress - EntryPos);
+  for (Index = 0; Index < Count; Index++) {
+    CacheTag           = &DiskCache->CacheTag[GroupNo + Index];
+    CacheTag->PageNo   = PageNo + Index;
+    CacheTag->RealSize = 0;
+  }
+
+  if (Async) {
+    Status = Volume->DiskIo2->ReadDiskEx (
+                                Volume->DiskIo2,
+                                Volume->MediaId,
+                                EntryPos,
+                                &DiskCache->ReadAheadToken,
+                                ReadSize,
+                                DiskCache->ReadAheadBuffer
+                                );
+    if (!EFI_ERROR (Status)) {
+      DiskCache->PendingPageNo    = PageNo;
+      DiskCache->PendingPageCount = Count;
+    }
+
+    return Status;
+  }
+
+  Status = FatDiskIo (Volume, ReadDisk, EntryPos, ReadSize, DiskCache->CacheBase + (GroupNo << PageAlignment), NULL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  for (Index = 0; Index < Count; Index++) {
+    DiskCache->CacheTag[GroupNo + Index].RealSize = MIN (PageSize, ReadSize - (Index << PageAlignment));
+  }
+
+  return EFI_SUCCESS;
+}
+
 /**
 
   This function is used by the Data Cache.
@@ -156,10 +377,15 @@ FatExchangeCachePage (
 
   Get one cache page by specified PageNo.
 
+  On a miss of a sequential read of the data cache, the following pages are
+  loaded along with the page.
+
   @param  Volume                - FAT file system volume.
   @param  CacheDataType         - The cache type: CACHE_FAT or CACHE_DATA.
   @param  PageNo                - PageNo to match with the cache.
   @param  CacheTag              - The Cache Tag for the current cache page.
+  @param  ReadAheadPageCount    - The number of pages to load on a miss, 0 or 1 for
+                                  the page alone.
 
   @retval EFI_SUCCESS           - Get the cache page successfully.
   @return other                 - An error occurred when accessing data.
@@ -171,7 +397,8 @@ FatGetCachePage (
   IN FAT_VOLUME       *Volume,
   IN CACHE_DATA_TYPE  CacheDataType,
   IN UINTN            PageNo,
-  IN CACHE_TAG        *CacheTag
+  IN CACHE_TAG        *CacheTag,
+  IN UINTN            ReadAheadPageCount
   )
 {
   EFI_STATUS  Status;
@@ -198,6 +425,11 @@ FatGetCachePage (
   //
   // Load new data from disk;
   //
+  if (ReadAheadPageCount > 1) {
+    ASSERT (CacheDataType == CacheData);
+    return FatReadAheadDataCache (Volume, PageNo, ReadAheadPageCount, FALSE);
+  }
+
   CacheTag->PageNo = PageNo;
   Status           = FatExchangeCachePage (Volume, CacheDataType, ReadDisk, CacheTag, NULL);
 
@@ -216,6 +448,7 @@ FatGetCachePage (
   @param  Offset                - The starting byte of cache page.
   @param  Length                - The number of bytes that is read or written
   @param  Buffer                - Buffer containing cache data.
+  @param  ReadAheadPageCount    - The number of pages to load on a miss.
 
   @retval EFI_SUCCESS           - The data was accessed correctly.
   @return Others                - An error occurred when accessing unaligned cache page.
@@ -230,7 +463,8 @@ FatAccessUnalignedCachePage (
   IN     UINTN            PageNo,
   IN     UINTN            Offset,
   IN     UINTN            Length,
-  IN OUT VOID             *Buffer
+  IN OUT VOID             *Buffer,
+  IN     UINTN            ReadAheadPageCount
   )
 {
   EFI_STATUS  Status;
@@ -243,7 +477,7 @@ FatAccessUnalignedCachePage (
   DiskCache = &Volume->DiskCache[CacheDataType];
   GroupNo   = PageNo & DiskCache->GroupMask;
   CacheTag  = &DiskCache->CacheTag[GroupNo];
-  Status    = FatGetCachePage (Volume, CacheDataType, PageNo, CacheTag);
+  Status    = FatGetCachePage (Volume, CacheDataType, PageNo, CacheTag, ReadAheadPageCount);
   if (!EFI_ERROR (Status)) {
     Source      = DiskCache->CacheBase + (GroupNo << DiskCache->PageAlignment) + Offset;
     Destination = Buffer;
@@ -275,6 +509,10 @@ FatAccessUnalignedCachePage (
      The access data will be divided into UnderRun data, Aligned data and OverRun data;
      The UnderRun data and OverRun data will be accessed by the Data cache,
      but the Aligned data will be accessed with disk directly.
+     A read that starts where the previous one ended is sequential. When it is
+     served by the cache, the pages that follow it are read ahead: on a miss
+     together with the missing page, and otherwise through DiskIo2 while the
+     caller consumes the pages read before.
 
   @param  Volume                - FAT file system volume.
   @param  CacheDataType         - The type of cache: CACHE_DATA or CACHE_FAT.
@@ -312,6 +550,7 @@ FatAccessCache (
   DISK_CACHE  *DiskCache;
   UINT64      EntryPos;
   UINT8       PageAlignment;
+  UINTN       ReadAheadPageCount;
 
   ASSERT (Volume->CacheBuffer != NULL);
 
@@ -323,13 +562,29 @@ FatAccessCache (
   PageNo        = (UINTN)RShiftU64 (EntryPos, PageAlignment);
   UnderRun      = ((UINTN)EntryPos) & (PageSize - 1);
 
+  ReadAheadPageCount = 0;
+  if (CacheDataType == CacheData) {
+    //
+    // The pages in flight must not be used or replaced before they arrive.
+    //
+    if (FatReadAheadOverlaps (DiskCache, PageNo, (UINTN)RShiftU64 (EntryPos + BufferSize + PageSize - 1, PageAlignment))) {
+      FatWaitReadAhead (Volume);
+    }
+
+    if ((IoMode == ReadDisk) && (PageNo == DiskCache->NextPageNo)) {
+      ReadAheadPageCount = DiskCache->ReadAheadPageCount;
+    }
+
+    DiskCache->NextPageNo = (UINTN)RShiftU64 (EntryPos + BufferSize, PageAlignment);
+  }
+
   if (UnderRun > 0) {
     Length = PageSize - UnderRun;
     if (Length > BufferSize) {
       Length = BufferSize;
     }
 
-    Status = FatAccessUnalignedCachePage (Volume, CacheDataType, IoMode, PageNo, UnderRun, Length, Buffer);
+    Status = FatAccessUnalignedCachePage (Volume, CacheDataType, IoMode, PageNo, UnderRun, Length, Buffer, ReadAheadPageCount);
     if (EFI_ERROR (Status)) {
       return Status;
     }
@@ -364,6 +619,11 @@ FatAccessCache (
     FatFlushDataCacheRange (Volume, IoMode, PageNo, OverRunPageNo, Buffer);
     Buffer     += AlignedSize;
     BufferSize -= AlignedSize;
+
+    //
+    // Large reads go to the disk directly, and need no readahead.
+    //
+    ReadAheadPageCount = 0;
   }
 
   //
@@ -374,7 +634,21 @@ FatAccessCache (
     //
     // Last read is not a complete page
     //
-    Status = FatAccessUnalignedCachePage (Volume, CacheDataType, IoMode, OverRunPageNo, 0, OverRun, Buffer);
+    Status = FatAccessUnalignedCachePage (Volume, CacheDataType, IoMode, OverRunPageNo, 0, OverRun, Buffer, ReadAheadPageCount);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  //
+  // Keep a window of pages read ahead of the reader, reading the next ones in
+  // the background as it consumes them.
+  //
+  if ((ReadAheadPageCount > 0) && (DiskCache->ReadAheadToken.Event != NULL) &&
+      !DiskCache->ReadAheadAbandoned && (DiskCache->PendingPageCount == 0) &&
+      (DiskCache->NextPageNo + ReadAheadPageCount >= DiskCache->ReadAheadEndPageNo))
+  {
+    FatReadAheadDataCache (Volume, MAX (DiskCache->NextPageNo, DiskCache->ReadAheadEndPageNo), ReadAheadPageCount, TRUE);
   }
 
   return Status;
@@ -435,10 +709,74 @@ FatVolumeFlushCache (
   return Status;
 }
 
+/**
+
+  Get the size of the free memory of the system.
+
+  @return The number of bytes of conventional memory that are not allocated.
+
+**/
+STATIC
+UINT64
+FatGetFreeMemorySize (
+  VOID
+  )
+{
+  EFI_STATUS             Status;
+  EFI_MEMORY_DESCRIPTOR  *MemoryMap;
+  EFI_MEMORY_DESCRIPTOR  *Entry;
+  UINTN                  MemoryMapSize;
+  UINTN                  MapKey;
+  UINTN                  DescriptorSize;
+  UINT32                 DescriptorVersion;
+  UINT64                 FreePages;
+
+  MemoryMap     = NULL;
+  MemoryMapSize = 0;
+  do {
+    Status = gBS->GetMemoryMap (&MemoryMapSize, MemoryMap, &MapKey, &DescriptorSize, &DescriptorVersion);
+    if (Status == EFI_BUFFER_TOO_SMALL) {
+      if (MemoryMap != NULL) {
+        FreePool (MemoryMap);
+      }
+
+      //
+      // Allocating the buffer may add descriptors to the map.
+      //
+      MemoryMapSize += 4 * DescriptorSize;
+      MemoryMap      = AllocatePool (MemoryMapSize);
+      if (MemoryMap == NULL) {
+        return 0;
+      }
+    }
+  } while (Status == EFI_BUFFER_TOO_SMALL);
+
+  FreePages = 0;
+  if (!EFI_ERROR (Status)) {
+    for (Entry = MemoryMap;
+         (UINT8 *)Entry < (UINT8 *)MemoryMap + MemoryMapSize;
+         Entry = NEXT_MEMORY_DESCRIPTOR (Entry, DescriptorSize))
+    {
+      if (Entry->Type == EfiConventionalMemory) {
+        FreePages += Entry->NumberOfPages;
+      }
+    }
+  }
+
+  if (MemoryMap != NULL) {
+    FreePool (MemoryMap);
+  }
+
+  return EFI_PAGES_TO_SIZE (FreePages);
+}
+
 /**
 
   Initialize the disk cache according to Volume's FatType.
 
+  The data cache takes a share of the free memory, within bounds, so that
+  systems with plenty of memory cache more of the files they read.
+
   @param  Volume                - FAT file system volume.
 
   @retval EFI_SUCCESS           - The disk cache is successfully initialized.
@@ -450,11 +788,14 @@ FatInitializeDiskCache (
   IN FAT_VOLUME  *Volume
   )
 {
+  EFI_STATUS  Status;
   DISK_CACHE  *DiskCache;
   UINTN       FatCacheGroupCount;
+  UINTN       DataCacheGroupCount;
   UINTN       DataCacheSize;
   UINTN       FatCacheSize;
   UINT8       *CacheBuffer;
+  UINT64      CacheMemory;
 
   DiskCache = Volume->DiskCache;
   //
@@ -470,18 +811,33 @@ FatInitializeDiskCache (
     DiskCache[CacheData].PageAlignment = FAT_DATACACHE_PAGE_MAX_ALIGNMENT;
   }
 
-  DiskCache[CacheData].GroupMask    = FAT_DATACACHE_GROUP_COUNT - 1;
-  DiskCache[CacheData].BaseAddress  = Volume->RootPos;
-  DiskCache[CacheData].LimitAddress = Volume->VolumeSize;
-  DiskCache[CacheFat].GroupMask     = FatCacheGroupCount - 1;
-  DiskCache[CacheFat].BaseAddress   = Volume->FatPos;
-  DiskCache[CacheFat].LimitAddress  = Volume->FatPos + Volume->FatSize;
-  FatCacheSize                      = FatCacheGroupCount << DiskCache[CacheFat].PageAlignment;
-  DataCacheSize                     = FAT_DATACACHE_GROUP_COUNT << DiskCache[CacheData].PageAlignment;
   //
-  // Allocate the Fat Cache buffer
+  // The number of data cache groups is a power of 2.
   //
-  CacheBuffer = AllocateZeroPool (FatCacheSize + DataCacheSize);
+  CacheMemory         = DivU64x32 (FatGetFreeMemorySize (), FAT_DATACACHE_MEMORY_SHARE);
+  DataCacheGroupCount = FAT_DATACACHE_GROUP_MIN_COUNT;
+  while ((DataCacheGroupCount < FAT_DATACACHE_GROUP_MAX_COUNT) &&
+         (LShiftU64 (DataCacheGroupCount * 2, DiskCache[CacheData].PageAlignment) <= CacheMemory))
+  {
+    DataCacheGroupCount *= 2;
+  }
+
+  DiskCache[CacheData].GroupMask          = DataCacheGroupCount - 1;
+  DiskCache[CacheData].BaseAddress        = Volume->RootPos;
+  DiskCache[CacheData].LimitAddress       = Volume->VolumeSize;
+  DiskCache[CacheData].ReadAheadPageCount = MIN (
+                                              FAT_DATACACHE_READ_AHEAD_SIZE >> DiskCache[CacheData].PageAlignment,
+                                              DataCacheGroupCount / 4
+                                              );
+  DiskCache[CacheFat].GroupMask    = FatCacheGroupCount - 1;
+  DiskCache[CacheFat].BaseAddress  = Volume->FatPos;
+  DiskCache[CacheFat].LimitAddress = Volume->FatPos + Volume->FatSize;
+  FatCacheSize                     = FatCacheGroupCount << DiskCache[CacheFat].PageAlignment;
+  DataCacheSize                    = DataCacheGroupCount << DiskCache[CacheData].PageAlignment;
+  //
+  // Allocate the Fat Cache buffer, followed by the cache tags
+  //
+  CacheBuffer = AllocatePool (FatCacheSize + DataCacheSize + (FatCacheGroupCount + DataCacheGroupCount) * sizeof (CACHE_TAG));
   if (CacheBuffer == NULL) {
     return EFI_OUT_OF_RESOURCES;
   }
@@ -489,5 +845,65 @@ FatInitializeDiskCache (
   Volume->CacheBuffer            = CacheBuffer;
   DiskCache[CacheFat].CacheBase  = CacheBuffer;
   DiskCache[CacheData].CacheBase = CacheBuffer + FatCacheSize;
+  DiskCache[CacheFat].CacheTag   = (CACHE_TAG *)(CacheBuffer + FatCacheSize + DataCacheSize);
+  DiskCache[CacheData].CacheTag  = DiskCache[CacheFat].CacheTag + FatCacheGroupCount;
+  ZeroMem (DiskCache[CacheFat].CacheTag, (FatCacheGroupCount + DataCacheGroupCount) * sizeof (CACHE_TAG));
+
+  //
+  // Read ahead in the background if the disk can.
+  //
+  if (Volume->DiskIo2 != NULL) {
+    DiskCache[CacheData].ReadAheadBuffer = AllocatePool (DiskCache[CacheData].ReadAheadPageCount << DiskCache[CacheData].PageAlignment);
+    if (DiskCache[CacheData].ReadAheadBuffer != NULL) {
+      Status = gBS->CreateEvent (0, 0, NULL, NULL, &DiskCache[CacheData].ReadAheadToken.Event);
+      if (EFI_ERROR (Status)) {
+        DiskCache[CacheData].ReadAheadToken.Event = NULL;
+        FreePool (DiskCache[CacheData].ReadAheadBuffer);
+        DiskCache[CacheData].ReadAheadBuffer = NULL;
+      }
+    }
+  }
+
   return EFI_SUCCESS;
 }
+
+/**
+
+  Free the disk cache, once the data cache is no longer read ahead.
+
+  @param  Volume                - FAT file system volume.
+
+**/
+VOID
+FatFreeDiskCache (
+  IN FAT_VOLUME  *Volume
+  )
+{
+  DISK_CACHE  *DiskCache;
+
+  DiskCache = &Volume->DiskCache[CacheData];
+  FatWaitReadAhead (Volume);
+  if (DiskCache->ReadAheadToken.Event != NULL) {
+    if (DiskCache->ReadAheadAbandoned && (gBS->CheckEvent (DiskCache->ReadAheadToken.Event) == EFI_NOT_READY)) {
+      //
+      // Stop the disk from signaling the token once the event is closed. The
+      // disk may still write to the buffer, so it is left allocated.
+      //
+      Volume->DiskIo2->Cancel (Volume->DiskIo2);
+      DiskCache->ReadAheadBuffer = NULL;
+    }
+
+    gBS->CloseEvent (DiskCache->ReadAheadToken.Event);
+    DiskCache->ReadAheadToken.Event = NULL;
+  }
+
+  if (DiskCache->ReadAheadBuffer != NULL) {
+    FreePool (DiskCache->ReadAheadBuffer);
+    DiskCache->ReadAheadBuffer = NULL;
+  }
+
+  if (Volume->CacheBuffer != NULL) {
+    FreePool (Volume->CacheBuffer);
+    Volume->CacheBuffer = NULL;
+  }
+}
@@ -80,10 +80,39 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #define FAT_FATCACHE_PAGE_MAX_ALIGNMENT   15
 #define FAT_DATACACHE_PAGE_MIN_ALIGNMENT  13
 #define FAT_DATACACHE_PAGE_MAX_ALIGNMENT  16
-#define FAT_DATACACHE_GROUP_COUNT         64
 #define FAT_FATCACHE_GROUP_MIN_COUNT      1
 #define FAT_FATCACHE_GROUP_MAX_COUNT      16
 
+//
+// The data cache takes 1/FAT_DATACACHE_MEMORY_SHARE of the free memory, and
+// has from FAT_DATACACHE_GROUP_MIN_COUNT to FAT_DATACACHE_GROUP_MAX_COUNT pages
+//
+#define FAT_DATACACHE_MEMORY_SHARE     256
+#define FAT_DATACACHE_GROUP_MIN_COUNT  64
+#define FAT_DATACACHE_GROUP_MAX_COUNT  512
+
+//
+// Sequential reads through the data cache load up to this many bytes at once
+// ahead of the reader, and no more than a quarter of the data cache
+//
+#define FAT_DATACACHE_READ_AHEAD_SIZE  SIZE_1MB
+
+//
+// An access that needs the pages read ahead in the background polls for them
+// for up to FAT_READ_AHEAD_TIMEOUT microseconds. A disk that has not completed
+// the read by then is taken not to complete it while the volume is locked, and
+// is not read ahead in the background any more.
+//
+#define FAT_READ_AHEAD_TIMEOUT        1000000
+#define FAT_READ_AHEAD_POLL_INTERVAL  10
+
+//
+// The extent list of an open file grows from FAT_EXTENT_MIN_COUNT entries,
+// and stops growing at FAT_EXTENT_MAX_COUNT
+//
+#define FAT_EXTENT_MIN_COUNT  16
+#define FAT_EXTENT_MAX_COUNT  4096
+
 //
 // Used in 8.3 generation algorithm
 //
@@ -149,13 +178,30 @@ typedef struct {
 } CACHE_TAG;
 
 typedef struct {
-  UINT64       BaseAddress;
-  UINT64       LimitAddress;
-  UINT8        *CacheBase;
-  BOOLEAN      Dirty;
-  UINT8        PageAlignment;
-  UINTN        GroupMask;
-  CACHE_TAG    CacheTag[FAT_DATACACHE_GROUP_COUNT];
+  UINT64                BaseAddress;
+  UINT64                LimitAddress;
+  UINT8                 *CacheBase;
+  BOOLEAN               Dirty;
+  UINT8                 PageAlignment;
+  UINTN                 GroupMask;
+  CACHE_TAG             *CacheTag;
+  //
+  // Readahead of the data cache. NextPageNo is the page of the byte that
+  // follows the last read, so a read that starts there is sequential, and
+  // ReadAheadEndPageNo the page that follows the last one read ahead. The
+  // pages from PendingPageNo on are being read through ReadAheadToken into
+  // ReadAheadBuffer, and their groups are kept for them. ReadAheadAbandoned
+  // is set once a read was given up on; the disk may still write to the
+  // buffer until the token is signaled.
+  //
+  UINTN                 ReadAheadPageCount;
+  UINTN                 NextPageNo;
+  UINTN                 ReadAheadEndPageNo;
+  UINTN                 PendingPageNo;
+  UINTN                 PendingPageCount;
+  EFI_DISK_IO2_TOKEN    ReadAheadToken;
+  UINT8                 *ReadAheadBuffer;
+  BOOLEAN               ReadAheadAbandoned;
 } DISK_CACHE;
 
 //
@@ -228,6 +274,15 @@ typedef struct {
   LIST_ENTRY            Link;
 } FAT_SUBTASK;
 
+//
+// FAT_EXTENT - A run of clusters that are consecutive in the file and on the disk
+//
+typedef struct {
+  UINTN    FileCluster;         // The index of the first cluster within the file
+  UINTN    Cluster;             // The first cluster on the disk
+  UINTN    ClusterCount;
+} FAT_EXTENT;
+
 //
 // FAT_OFILE - Each opened file
 //
@@ -251,6 +306,14 @@ struct _FAT_OFILE {
   UINTN         FileCluster;
   UINTN         FileCurrentCluster;
   UINTN         FileLastCluster;
+  //
+  // The extents of the cluster chain, sorted by FileCluster. They are found
+  // as the file is accessed and cover its first ExtentClusterCount clusters.
+  //
+  FAT_EXTENT    *Extents;
+  UINTN         ExtentCount;
+  UINTN         ExtentMaxCount;
+  UINTN         ExtentClusterCount;
 
   //
   // Dirty is set if there have been any updates to the
@@ -711,6 +774,18 @@ FatInitializeDiskCache (
   IN FAT_VOLUME  *Volume
   );
 
+/**
+
+  Free the disk cache, once the data cache is no longer read ahead.
+
+  @param  Volume                - FAT file system volume.
+
+**/
+VOID
+FatFreeDiskCache (
+  IN FAT_VOLUME  *Volume
+  );
+
 /**
 
   Read BufferSize bytes from the position of Offset into Buffer,
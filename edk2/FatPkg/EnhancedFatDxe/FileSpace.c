@@ -2,6 +2,7 @@
   Routines dealing with disk spaces and FAT table entries.
 
 Copyright (c) 2005 - 2013, Intel Corporation. All rights reserved.<BR>
+Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
 SPDX-License-Identifier: BSD-2-Clause-Patent
 
 
@@ -341,6 +342,110 @@ FatSizeToClusters (
   return Clusters;
 }
 
+/**
+
+  Follow the cluster chain of the open file past the extents found so far,
+  until they cover the cluster of the file at ClusterIndex.
+
+  The walk stops early at the end of the chain, at a cluster that is not
+  valid, and when the extent list cannot grow any further.
+
+  @param  OFile                 - The open file.
+  @param  ClusterIndex          - The index within the file of the cluster to cover.
+
+**/
+STATIC
+VOID
+FatExtendExtents (
+  IN FAT_OFILE  *OFile,
+  IN UINTN      ClusterIndex
+  )
+{
+  FAT_VOLUME  *Volume;
+  FAT_EXTENT  *Extent;
+  FAT_EXTENT  *Extents;
+  UINTN       Cluster;
+  UINTN       MaxCount;
+
+  Volume = OFile->Volume;
+  Extent = NULL;
+  if (OFile->ExtentCount > 0) {
+    Extent = &OFile->Extents[OFile->ExtentCount - 1];
+  }
+
+  while (OFile->ExtentClusterCount <= ClusterIndex) {
+    if (Extent == NULL) {
+      Cluster = OFile->FileCluster;
+    } else {
+      Cluster = FatGetFatEntry (Volume, Extent->Cluster + Extent->ClusterCount - 1);
+    }
+
+    if ((Cluster < FAT_MIN_CLUSTER) || (Cluster > Volume->MaxCluster + 1)) {
+      break;
+    }
+
+    if ((Extent != NULL) && (Extent->Cluster + Extent->ClusterCount == Cluster)) {
+      Extent->ClusterCount++;
+    } else {
+      if (OFile->ExtentCount == OFile->ExtentMaxCount) {
+        if (OFile->ExtentMaxCount == FAT_EXTENT_MAX_COUNT) {
+          break;
+        }
+
+        MaxCount = MAX (OFile->ExtentMaxCount * 2, FAT_EXTENT_MIN_COUNT);
+        Extents  = ReallocatePool (
+                     OFile->ExtentMaxCount * sizeof (FAT_EXTENT),
+                     MaxCount * sizeof (FAT_EXTENT),
+                     OFile->Extents
+                     );
+        if (Extents == NULL) {
+          break;
+        }
+
+        OFile->Extents        = Extents;
+        OFile->ExtentMaxCount = MaxCount;
+      }
+
+      Extent               = &OFile->Extents[OFile->ExtentCount++];
+      Extent->FileCluster  = OFile->ExtentClusterCount;
+      Extent->Cluster      = Cluster;
+      Extent->ClusterCount = 1;
+    }
+
+    OFile->ExtentClusterCount++;
+  }
+}
+
+/**
+
+  Drop the extents of the open file past its first ClusterCount clusters,
+  after the cluster chain has been cut there.
+
+  @param  OFile                 - The open file.
+  @param  ClusterCount          - The number of clusters left in the file.
+
+**/
+STATIC
+VOID
+FatTrimExtents (
+  IN FAT_OFILE  *OFile,
+  IN UINTN      ClusterCount
+  )
+{
+  FAT_EXTENT  *Extent;
+
+  while (OFile->ExtentClusterCount > ClusterCount) {
+    Extent = &OFile->Extents[OFile->ExtentCount - 1];
+    if (Extent->FileCluster >= ClusterCount) {
+      OFile->ExtentClusterCount = Extent->FileCluster;
+      OFile->ExtentCount--;
+    } else {
+      Extent->ClusterCount      = ClusterCount - Extent->FileCluster;
+      OFile->ExtentClusterCount = ClusterCount;
+    }
+  }
+}
+
 /**
 
   Shrink the end of the open file base on the file size.
@@ -403,6 +508,7 @@ FatShrinkEof (
   // Set CurrentCluster == FileCluster
   // to force a recalculation of Position related stuffs
   //
+  FatTrimExtents (OFile, NewSize);
   OFile->FileCurrentCluster = OFile->FileCluster;
   OFile->FileLastCluster    = LastCluster;
   OFile->Dirty              = TRUE;
@@ -550,6 +656,10 @@ Done:
   Seek OFile to requested position, and calculate the number of
   consecutive clusters from the position in the file
 
+  The clusters are looked up in the extents of the file, which are found as
+  the file is accessed, so that a seek costs a binary search once the chain
+  up to the position has been followed.
+
   @param  OFile                 - The open file.
   @param  Position              - The file's position which will be accessed.
   @param  PosLimit              - The maximum length current reading/writing may access
@@ -566,8 +676,16 @@ FatOFilePosition (
   )
 {
   FAT_VOLUME  *Volume;
+  FAT_EXTENT  *Extent;
   UINTN       ClusterSize;
   UINTN       Cluster;
+  UINTN       ClusterIndex;
+  UINTN       LastIndex;
+  UINTN       Index;
+  UINTN       Count;
+  UINTN       Low;
+  UINTN       High;
+  UINTN       Middle;
   UINTN       StartPos;
   UINTN       Run;
 
@@ -585,38 +703,82 @@ FatOFilePosition (
     Run            = OFile->FileSize - Position;
   } else {
     //
-    // Run the file's cluster chain to find the current position
-    // If possible, run from the current cluster rather than
-    // start from beginning
-    // Assumption: OFile->Position is always consistent with
-    // OFile->FileCurrentCluster.
-    // OFile->Position is not modified outside this function;
-    // OFile->FileCurrentCluster is modified outside this function
-    // to be the same as OFile->FileCluster
-    // when OFile->FileCluster is updated, so make a check of this
-    // and invalidate the original OFile->Position in this case
+    // Find the extents of the clusters to be accessed, from the one at
+    // the position to the one at the access limit
     //
-    Cluster  = OFile->FileCurrentCluster;
-    StartPos = OFile->Position;
-    if ((Position < StartPos) || (OFile->FileCluster == Cluster)) {
-      StartPos = 0;
-      Cluster  = OFile->FileCluster;
-    }
+    ClusterIndex = Position >> Volume->ClusterAlignment;
+    LastIndex    = ClusterIndex + (((Position & (ClusterSize - 1)) + MAX (PosLimit, 1) - 1) >> Volume->ClusterAlignment);
+    FatExtendExtents (OFile, LastIndex);
+
+    if (ClusterIndex < OFile->ExtentClusterCount) {
+      Low  = 0;
+      High = OFile->ExtentCount - 1;
+      while (Low < High) {
+        Middle = (Low + High + 1) / 2;
+        if (OFile->Extents[Middle].FileCluster <= ClusterIndex) {
+          Low = Middle;
+        } else {
+          High = Middle - 1;
+        }
+      }
 
-    while (StartPos + ClusterSize <= Position) {
-      StartPos += ClusterSize;
-      if ((Cluster == FAT_CLUSTER_FREE) || (Cluster >= FAT_CLUSTER_SPECIAL)) {
-        DEBUG ((DEBUG_INIT | DEBUG_ERROR, "FatOFilePosition:" " cluster chain corrupt\n"));
-        return EFI_VOLUME_CORRUPTED;
+      Extent  = &OFile->Extents[Low];
+      Cluster = Extent->Cluster + ClusterIndex - Extent->FileCluster;
+      Count   = Extent->FileCluster + Extent->ClusterCount - ClusterIndex;
+    } else {
+      //
+      // The extents stop short of the position, because the extent list is
+      // full or the chain is corrupt. Run the rest of the file's cluster
+      // chain, from the current cluster if possible.
+      // Assumption: OFile->Position is always consistent with
+      // OFile->FileCurrentCluster.
+      // OFile->Position is not modified outside this function;
+      // OFile->FileCurrentCluster is modified outside this function
+      // to be the same as OFile->FileCluster
+      // when OFile->FileCluster is updated, so make a check of this
+      // and invalidate the original OFile->Position in this case
+      //
+      Index   = 0;
+      Cluster = OFile->FileCluster;
+      if (OFile->ExtentCount > 0) {
+        Extent  = &OFile->Extents[OFile->ExtentCount - 1];
+        Index   = OFile->ExtentClusterCount - 1;
+        Cluster = Extent->Cluster + Extent->ClusterCount - 1;
       }
 
-      Cluster = FatGetFatEntry (Volume, Cluster);
+      if ((OFile->FileCluster != OFile->FileCurrentCluster) &&
+          ((OFile->Position >> Volume->ClusterAlignment) > Index) &&
+          (OFile->Position <= Position))
+      {
+        Index   = OFile->Position >> Volume->ClusterAlignment;
+        Cluster = OFile->FileCurrentCluster;
+      }
+
+      for ( ; Index < ClusterIndex; Index++) {
+        if ((Cluster == FAT_CLUSTER_FREE) || (Cluster >= FAT_CLUSTER_SPECIAL)) {
+          DEBUG ((DEBUG_INIT | DEBUG_ERROR, "FatOFilePosition:" " cluster chain corrupt\n"));
+          return EFI_VOLUME_CORRUPTED;
+        }
+
+        Cluster = FatGetFatEntry (Volume, Cluster);
+      }
+
+      //
+      // Compute the number of consecutive clusters in the file
+      //
+      Count = 1;
+      if (!FAT_END_OF_FAT_CHAIN (Cluster)) {
+        while ((ClusterIndex + Count <= LastIndex) && (FatGetFatEntry (Volume, Cluster + Count - 1) == Cluster + Count)) {
+          Count++;
+        }
+      }
     }
 
     if ((Cluster < FAT_MIN_CLUSTER) || (Cluster > Volume->MaxCluster + 1)) {
       return EFI_VOLUME_CORRUPTED;
     }
 
+    StartPos       = ClusterIndex << Volume->ClusterAlignment;
     OFile->PosDisk = Volume->FirstClusterPos +
                      LShiftU64 (Cluster - FAT_MIN_CLUSTER, Volume->ClusterAlignment) +
                      Position - StartPos;
@@ -624,15 +786,10 @@ FatOFilePosition (
     OFile->Position           = StartPos;
 
     //
-    // Compute the number of consecutive clusters in the file
+    // The run ends with the extent, or past the access limit
     //
-    Run = StartPos + ClusterSize - Position;
-    if (!FAT_END_OF_FAT_CHAIN (Cluster)) {
-      while ((FatGetFatEntry (Volume, Cluster) == Cluster + 1) && Run < PosLimit) {
-        Run     += ClusterSize;
-        Cluster += 1;
-      }
-    }
+    Count = MIN (Count, LastIndex - ClusterIndex + 1);
+    Run   = StartPos + (Count << Volume->ClusterAlignment) - Position;
   }
 
   OFile->PosRem = Run;
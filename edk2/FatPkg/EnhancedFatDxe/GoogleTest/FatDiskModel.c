@@ -0,0 +1,941 @@
+/** @file
+  A model of a disk and of the services around it, for the host tests of
+  EnhancedFatDxe.
+
+  The disk is an image in memory behind EFI_BLOCK_IO_PROTOCOL,
+  EFI_DISK_IO_PROTOCOL and EFI_DISK_IO2_PROTOCOL. It works one request at a
+  time, in the order they come, each taking a fixed latency and then the
+  time to move its data. ReadDiskEx () and WriteDiskEx () requests with an
+  event move their data and signal the event when they complete, which is
+  only while the TPL is below mFatDiskModelCompletionTpl: a disk that
+  completes its requests from a timer at TPL_CALLBACK cannot complete them
+  while the volume is locked. Cancel () behaves as DiskIoDxe does, the
+  requests move their data but no longer signal their events.
+
+  The model keeps a clock. Requests and the delays of the driver advance it
+  instead of sleeping. Events and the TPL are modelled as well, and so are
+  the time of day, the memory map the driver sizes its cache from and the
+  Unicode collation it compares and converts names with, in ASCII.
+
+  The model owns the handle of the disk and the protocols on it, instead of
+  the protocol database of UnitTestUefiBootServicesTableLib: installing a
+  protocol there logs through UnitTestLib, which needs a running framework
+  a GoogleTest main does not have.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "../Fat.h"
+#include "FatDiskModel.h"
+
+#define MODEL_MEDIA_ID   1
+#define MODEL_LATENCY    100000     // Nanoseconds before the data of a request moves
+#define MODEL_BANDWIDTH  400        // Bytes per microsecond
+
+typedef struct {
+  LIST_ENTRY          Link;
+  UINT32              Type;
+  EFI_TPL             NotifyTpl;
+  EFI_EVENT_NOTIFY    Notify;
+  VOID                *Context;
+  BOOLEAN             Signaled;
+} MODEL_EVENT;
+
+typedef struct {
+  LIST_ENTRY            Link;
+  EFI_DISK_IO2_TOKEN    *Token;             // NULL once canceled
+  BOOLEAN               Write;
+  UINT64                Offset;
+  UINTN                 Size;
+  VOID                  *Buffer;
+  UINT64                CompletionTime;
+} MODEL_REQUEST;
+
+STATIC UINT8                 *mModelDisk;
+STATIC UINTN                 mModelDiskSize;
+STATIC UINT64                mModelFreeMemory;
+STATIC UINT64                mModelTime;
+STATIC UINT64                mModelBusyTime;   // When the disk is done with the requests it has
+STATIC EFI_TPL               mModelTpl = TPL_APPLICATION;
+STATIC LIST_ENTRY            mModelEvents   = INITIALIZE_LIST_HEAD_VARIABLE (mModelEvents);
+STATIC LIST_ENTRY            mModelRequests = INITIALIZE_LIST_HEAD_VARIABLE (mModelRequests);
+STATIC EFI_BOOT_SERVICES     mModelBootServices;
+STATIC EFI_RUNTIME_SERVICES  mModelRuntimeServices;
+STATIC EFI_RUNTIME_SERVICES  *mModelSavedRuntimeServices;
+STATIC BOOLEAN               mModelActive;
+STATIC UINT8                 mModelHandle;
+STATIC VOID                  *mModelFileSystem;
+
+EFI_HANDLE                 mFatDiskModelHandle = &mModelHandle;
+
+EFI_TPL                    mFatDiskModelCompletionTpl;
+FAT_DISK_MODEL_STATISTICS  mFatDiskModelStatistics;
+
+/**
+  Run the notification functions of the signaled events the TPL allows,
+  highest TPL first.
+
+**/
+STATIC
+VOID
+ModelDispatch (
+  VOID
+  )
+{
+  LIST_ENTRY   *Link;
+  MODEL_EVENT  *Event;
+  MODEL_EVENT  *Next;
+  EFI_TPL      OldTpl;
+
+  for ( ; ;) {
+    Next = NULL;
+    for (Link = GetFirstNode (&mModelEvents); !IsNull (&mModelEvents, Link); Link = GetNextNode (&mModelEvents, Link)) {
+      Event = BASE_CR (Link, MODEL_EVENT, Link);
+      if (Event->Signaled && ((Event->Type & EVT_NOTIFY_SIGNAL) != 0U) && (Event->NotifyTpl > mModelTpl) &&
+          ((Next == NULL) || (Event->NotifyTpl > Next->NotifyTpl))) {
+        Next = Event;
+      }
+    }
+
+    if (Next == NULL) {
+      return;
+    }
+
+    Next->Signaled = FALSE;
+    OldTpl         = mModelTpl;
+    mModelTpl      = Next->NotifyTpl;
+    Next->Notify ((EFI_EVENT)Next, Next->Context);
+    mModelTpl = OldTpl;
+  }
+}
+
+/**
+  Move the data of the requests that completed by now, and signal their
+  events, if the TPL lets the disk complete them.
+
+**/
+STATIC
+VOID
+ModelComplete (
+  VOID
+  )
+{
+  MODEL_REQUEST  *Request;
+
+  while (!IsListEmpty (&mModelRequests) && (mModelTpl < mFatDiskModelCompletionTpl)) {
+    Request = BASE_CR (GetFirstNode (&mModelRequests), MODEL_REQUEST, Link);
+    if (Request->CompletionTime > mModelTime) {
+      return;
+    }
+
+    if (Request->Write) {
+      CopyMem (mModelDisk + Request->Offset, Request->Buffer, Request->Size);
+    } else {
+      CopyMem (Request->Buffer, mModelDisk + Request->Offset, Request->Size);
+    }
+
+    RemoveEntryList (&Request->Link);
+    if (Request->Token != NULL) {
+      Request->Token->TransactionStatus = EFI_SUCCESS;
+      gBS->SignalEvent (Request->Token->Event);
+    }
+
+    FreePool (Request);
+  }
+}
+
+/**
+  Let time pass, completing the requests that come due.
+
+**/
+STATIC
+VOID
+ModelAdvance (
+  IN UINT64  Nanoseconds
+  )
+{
+  mModelTime += Nanoseconds;
+  ModelComplete ();
+}
+
+/**
+  Queue a request on the disk and return the time it completes at.
+
+**/
+STATIC
+UINT64
+ModelSchedule (
+  IN BOOLEAN  Write,
+  IN UINTN    Size
+  )
+{
+  mModelBusyTime = MAX (mModelBusyTime, mModelTime) + MODEL_LATENCY + DivU64x32 (MultU64x32 (Size, 1000), MODEL_BANDWIDTH);
+  if (Write) {
+    mFatDiskModelStatistics.Writes++;
+    mFatDiskModelStatistics.BytesWritten += Size;
+  } else {
+    mFatDiskModelStatistics.Reads++;
+    mFatDiskModelStatistics.BytesRead += Size;
+  }
+
+  return mModelBusyTime;
+}
+
+/**
+  Work a request of the caller, after the requests queued before it.
+
+**/
+STATIC
+EFI_STATUS
+ModelTransfer (
+  IN     UINT32   MediaId,
+  IN     BOOLEAN  Write,
+  IN     UINT64   Offset,
+  IN     UINTN    Size,
+  IN OUT VOID     *Buffer
+  )
+{
+  if (MediaId != MODEL_MEDIA_ID) {
+    return EFI_MEDIA_CHANGED;
+  }
+
+  if ((Offset > mModelDiskSize) || (Size > mModelDiskSize - Offset)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  ModelAdvance (ModelSchedule (Write, Size) - mModelTime);
+  if (Write) {
+    CopyMem (mModelDisk + Offset, Buffer, Size);
+  } else {
+    CopyMem (Buffer, mModelDisk + Offset, Size);
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Queue a request whose token is signaled when it completes.
+
+**/
+STATIC
+EFI_STATUS
+ModelTransferEx (
+  IN     UINT32              MediaId,
+  IN     BOOLEAN             Write,
+  IN     UINT64              Offset,
+  IN OUT EFI_DISK_IO2_TOKEN  *Token,
+  IN     UINTN               Size,
+  IN OUT VOID                *Buffer
+  )
+{
+  MODEL_REQUEST  *Request;
+
+  if ((Token == NULL) || (Token->Event == NULL)) {
+    return ModelTransfer (MediaId, Write, Offset, Size, Buffer);
+  }
+
+  if (MediaId != MODEL_MEDIA_ID) {
+    return EFI_MEDIA_CHANGED;
+  }
+
+  if ((Offset > mModelDiskSize) || (Size > mModelDiskSize - Offset)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Request = AllocateZeroPool (sizeof (MODEL_REQUEST));
+  if (Request == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Request->Token          = Token;
+  Request->Write          = Write;
+  Request->Offset         = Offset;
+  Request->Size           = Size;
+  Request->Buffer         = Buffer;
+  Request->CompletionTime = ModelSchedule (Write, Size);
+  InsertTailList (&mModelRequests, &Request->Link);
+  if (!Write) {
+    mFatDiskModelStatistics.AsyncReads++;
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelBlockIoReset (
+  IN EFI_BLOCK_IO_PROTOCOL  *This,
+  IN BOOLEAN                ExtendedVerification
+  )
+{
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelReadBlocks (
+  IN  EFI_BLOCK_IO_PROTOCOL  *This,
+  IN  UINT32                 MediaId,
+  IN  EFI_LBA                Lba,
+  IN  UINTN                  BufferSize,
+  OUT VOID                   *Buffer
+  )
+{
+  return ModelTransfer (MediaId, FALSE, MultU64x32 (Lba, FAT_DISK_MODEL_BLOCK_SIZE), BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelWriteBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL  *This,
+  IN UINT32                 MediaId,
+  IN EFI_LBA                Lba,
+  IN UINTN                  BufferSize,
+  IN VOID                   *Buffer
+  )
+{
+  return ModelTransfer (MediaId, TRUE, MultU64x32 (Lba, FAT_DISK_MODEL_BLOCK_SIZE), BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelFlushBlocks (
+  IN EFI_BLOCK_IO_PROTOCOL  *This
+  )
+{
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelReadDisk (
+  IN  EFI_DISK_IO_PROTOCOL  *This,
+  IN  UINT32                MediaId,
+  IN  UINT64                Offset,
+  IN  UINTN                 BufferSize,
+  OUT VOID                  *Buffer
+  )
+{
+  return ModelTransfer (MediaId, FALSE, Offset, BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelWriteDisk (
+  IN EFI_DISK_IO_PROTOCOL  *This,
+  IN UINT32                MediaId,
+  IN UINT64                Offset,
+  IN UINTN                 BufferSize,
+  IN VOID                  *Buffer
+  )
+{
+  return ModelTransfer (MediaId, TRUE, Offset, BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCancel (
+  IN EFI_DISK_IO2_PROTOCOL  *This
+  )
+{
+  LIST_ENTRY  *Link;
+
+  for (Link = GetFirstNode (&mModelRequests); !IsNull (&mModelRequests, Link); Link = GetNextNode (&mModelRequests, Link)) {
+    BASE_CR (Link, MODEL_REQUEST, Link)->Token = NULL;
+  }
+
+  mFatDiskModelStatistics.Cancels++;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelReadDiskEx (
+  IN     EFI_DISK_IO2_PROTOCOL  *This,
+  IN     UINT32                 MediaId,
+  IN     UINT64                 Offset,
+  IN OUT EFI_DISK_IO2_TOKEN     *Token,
+  IN     UINTN                  BufferSize,
+  OUT    VOID                   *Buffer
+  )
+{
+  return ModelTransferEx (MediaId, FALSE, Offset, Token, BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelWriteDiskEx (
+  IN     EFI_DISK_IO2_PROTOCOL  *This,
+  IN     UINT32                 MediaId,
+  IN     UINT64                 Offset,
+  IN OUT EFI_DISK_IO2_TOKEN     *Token,
+  IN     UINTN                  BufferSize,
+  IN     VOID                   *Buffer
+  )
+{
+  return ModelTransferEx (MediaId, TRUE, Offset, Token, BufferSize, Buffer);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelFlushDiskEx (
+  IN     EFI_DISK_IO2_PROTOCOL  *This,
+  IN OUT EFI_DISK_IO2_TOKEN     *Token
+  )
+{
+  if ((Token != NULL) && (Token->Event != NULL)) {
+    Token->TransactionStatus = EFI_SUCCESS;
+    gBS->SignalEvent (Token->Event);
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_BLOCK_IO_MEDIA  mModelMedia = {
+  MODEL_MEDIA_ID,                 // MediaId
+  FALSE,                          // RemovableMedia
+  TRUE,                           // MediaPresent
+  TRUE,                           // LogicalPartition
+  FALSE,                          // ReadOnly
+  FALSE,                          // WriteCaching
+  FAT_DISK_MODEL_BLOCK_SIZE,      // BlockSize
+  0,                              // IoAlign
+  0                               // LastBlock
+};
+
+EFI_BLOCK_IO_PROTOCOL  mFatDiskModelBlockIo = {
+  EFI_BLOCK_IO_PROTOCOL_REVISION,
+  &mModelMedia,
+  ModelBlockIoReset,
+  ModelReadBlocks,
+  ModelWriteBlocks,
+  ModelFlushBlocks
+};
+
+EFI_DISK_IO_PROTOCOL  mFatDiskModelDiskIo = {
+  EFI_DISK_IO_PROTOCOL_REVISION,
+  ModelReadDisk,
+  ModelWriteDisk
+};
+
+EFI_DISK_IO2_PROTOCOL  mFatDiskModelDiskIo2 = {
+  EFI_DISK_IO2_PROTOCOL_REVISION,
+  ModelCancel,
+  ModelReadDiskEx,
+  ModelWriteDiskEx,
+  ModelFlushDiskEx
+};
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelStall (
+  IN UINTN  Microseconds
+  )
+{
+  ModelAdvance (MultU64x32 (Microseconds, 1000));
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_TPL
+EFIAPI
+ModelRaiseTpl (
+  IN EFI_TPL  NewTpl
+  )
+{
+  EFI_TPL  OldTpl;
+
+  OldTpl = mModelTpl;
+  ASSERT (NewTpl >= OldTpl);
+  mModelTpl = NewTpl;
+  return OldTpl;
+}
+
+STATIC
+VOID
+EFIAPI
+ModelRestoreTpl (
+  IN EFI_TPL  OldTpl
+  )
+{
+  ASSERT (OldTpl <= mModelTpl);
+  mModelTpl = OldTpl;
+  ModelComplete ();
+  ModelDispatch ();
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction OPTIONAL,
+  IN  VOID              *NotifyContext OPTIONAL,
+  OUT EFI_EVENT         *Event
+  )
+{
+  MODEL_EVENT  *ModelEvent;
+
+  if ((Event == NULL) || (((Type & (EVT_NOTIFY_SIGNAL | EVT_NOTIFY_WAIT)) != 0U) && (NotifyFunction == NULL))) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  ModelEvent = AllocateZeroPool (sizeof (MODEL_EVENT));
+  if (ModelEvent == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  ModelEvent->Type      = Type;
+  ModelEvent->NotifyTpl = NotifyTpl;
+  ModelEvent->Notify    = NotifyFunction;
+  ModelEvent->Context   = NotifyContext;
+  InsertTailList (&mModelEvents, &ModelEvent->Link);
+
+  *Event = (EFI_EVENT)ModelEvent;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  MODEL_EVENT    *ModelEvent;
+  LIST_ENTRY     *Link;
+  MODEL_REQUEST  *Request;
+
+  //
+  // A request must not signal an event once it is closed.
+  //
+  for (Link = GetFirstNode (&mModelRequests); !IsNull (&mModelRequests, Link); Link = GetNextNode (&mModelRequests, Link)) {
+    Request = BASE_CR (Link, MODEL_REQUEST, Link);
+    ASSERT ((Request->Token == NULL) || (Request->Token->Event != Event));
+  }
+
+  ModelEvent = (MODEL_EVENT *)Event;
+  RemoveEntryList (&ModelEvent->Link);
+  FreePool (ModelEvent);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelSignalEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ((MODEL_EVENT *)Event)->Signaled = TRUE;
+  ModelDispatch ();
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCheckEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  MODEL_EVENT  *ModelEvent;
+
+  ModelEvent = (MODEL_EVENT *)Event;
+  if ((ModelEvent->Type & EVT_NOTIFY_SIGNAL) != 0U) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (!ModelEvent->Signaled && ((ModelEvent->Type & EVT_NOTIFY_WAIT) != 0U)) {
+    ModelEvent->Notify (Event, ModelEvent->Context);
+  }
+
+  if (!ModelEvent->Signaled) {
+    return EFI_NOT_READY;
+  }
+
+  ModelEvent->Signaled = FALSE;
+  return EFI_SUCCESS;
+}
+
+//
+// The memory map is a single range of free memory.
+//
+STATIC
+EFI_STATUS
+EFIAPI
+ModelGetMemoryMap (
+  IN OUT UINTN                  *MemoryMapSize,
+  IN OUT EFI_MEMORY_DESCRIPTOR  *MemoryMap,
+  OUT UINTN                     *MapKey,
+  OUT UINTN                     *DescriptorSize,
+  OUT UINT32                    *DescriptorVersion
+  )
+{
+  *DescriptorSize    = sizeof (EFI_MEMORY_DESCRIPTOR);
+  *DescriptorVersion = EFI_MEMORY_DESCRIPTOR_VERSION;
+  if ((*MemoryMapSize < sizeof (EFI_MEMORY_DESCRIPTOR)) || (MemoryMap == NULL)) {
+    *MemoryMapSize = sizeof (EFI_MEMORY_DESCRIPTOR);
+    return EFI_BUFFER_TOO_SMALL;
+  }
+
+  ZeroMem (MemoryMap, sizeof (EFI_MEMORY_DESCRIPTOR));
+  MemoryMap->Type          = EfiConventionalMemory;
+  MemoryMap->NumberOfPages = EFI_SIZE_TO_PAGES (mModelFreeMemory);
+  *MemoryMapSize           = sizeof (EFI_MEMORY_DESCRIPTOR);
+  *MapKey                  = 0;
+  return EFI_SUCCESS;
+}
+
+//
+// The driver publishes the file system on the handle of the disk, and
+// withdraws it, with these.
+//
+STATIC
+EFI_STATUS
+EFIAPI
+ModelInstallMultipleProtocolInterfaces (
+  IN OUT EFI_HANDLE  *Handle,
+  ...
+  )
+{
+  VA_LIST   Args;
+  EFI_GUID  *Protocol;
+  VOID      *Interface;
+
+  VA_START (Args, Handle);
+  Protocol  = VA_ARG (Args, EFI_GUID *);
+  Interface = VA_ARG (Args, VOID *);
+  VA_END (Args);
+
+  if ((*Handle != mFatDiskModelHandle) || !CompareGuid (Protocol, &gEfiSimpleFileSystemProtocolGuid)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (mModelFileSystem != NULL) {
+    return EFI_ALREADY_STARTED;
+  }
+
+  mModelFileSystem = Interface;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelUninstallMultipleProtocolInterfaces (
+  IN EFI_HANDLE  Handle,
+  ...
+  )
+{
+  VA_LIST   Args;
+  EFI_GUID  *Protocol;
+  VOID      *Interface;
+
+  VA_START (Args, Handle);
+  Protocol  = VA_ARG (Args, EFI_GUID *);
+  Interface = VA_ARG (Args, VOID *);
+  VA_END (Args);
+
+  if ((Handle != mFatDiskModelHandle) || !CompareGuid (Protocol, &gEfiSimpleFileSystemProtocolGuid) ||
+      (Interface != mModelFileSystem))
+  {
+    return EFI_NOT_FOUND;
+  }
+
+  mModelFileSystem = NULL;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelHandleProtocol (
+  IN  EFI_HANDLE  Handle,
+  IN  EFI_GUID    *Protocol,
+  OUT VOID        **Interface
+  )
+{
+  if (Handle != mFatDiskModelHandle) {
+    return mModelBootServices.HandleProtocol (Handle, Protocol, Interface);
+  }
+
+  if (CompareGuid (Protocol, &gEfiBlockIoProtocolGuid)) {
+    *Interface = &mFatDiskModelBlockIo;
+  } else if (CompareGuid (Protocol, &gEfiDiskIoProtocolGuid)) {
+    *Interface = &mFatDiskModelDiskIo;
+  } else if (CompareGuid (Protocol, &gEfiDiskIo2ProtocolGuid)) {
+    *Interface = &mFatDiskModelDiskIo2;
+  } else if (CompareGuid (Protocol, &gEfiSimpleFileSystemProtocolGuid) && (mModelFileSystem != NULL)) {
+    *Interface = mModelFileSystem;
+  } else {
+    return EFI_UNSUPPORTED;
+  }
+
+  return EFI_SUCCESS;
+}
+
+//
+// The clock of the model counts from the start of 2023.
+//
+STATIC
+EFI_STATUS
+EFIAPI
+ModelGetTime (
+  OUT EFI_TIME               *Time,
+  OUT EFI_TIME_CAPABILITIES  *Capabilities OPTIONAL
+  )
+{
+  UINT64  Seconds;
+
+  Seconds = DivU64x32 (mModelTime, 1000000000);
+  ZeroMem (Time, sizeof (EFI_TIME));
+  Time->Year     = 2023;
+  Time->Month    = 1;
+  Time->Day      = (UINT8)(1 + DivU64x32 (Seconds, 86400) % 28);
+  Time->Hour     = (UINT8)(DivU64x32 (Seconds, 3600) % 24);
+  Time->Minute   = (UINT8)(DivU64x32 (Seconds, 60) % 60);
+  Time->Second   = (UINT8)(Seconds % 60);
+  Time->TimeZone = EFI_UNSPECIFIED_TIMEZONE;
+  return EFI_SUCCESS;
+}
+
+/**
+  Return the upper case of an ASCII character.
+
+**/
+STATIC
+CHAR16
+ModelToUpper (
+  IN CHAR16  Char
+  )
+{
+  return ((Char >= L'a') && (Char <= L'z')) ? (CHAR16)(Char - L'a' + L'A') : Char;
+}
+
+/**
+  Check whether an upper case character is valid in a short name.
+
+**/
+STATIC
+BOOLEAN
+ModelIsFatChar (
+  IN CHAR16  Char
+  )
+{
+  CONST CHAR16  *Other;
+
+  if (((Char >= L'A') && (Char <= L'Z')) || ((Char >= L'0') && (Char <= L'9'))) {
+    return TRUE;
+  }
+
+  for (Other = L"$%'-_@~`!(){}^#&"; *Other != 0; Other++) {
+    if (Char == *Other) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+INTN
+FatStriCmp (
+  IN CHAR16  *S1,
+  IN CHAR16  *S2
+  )
+{
+  while ((*S1 != 0) && (ModelToUpper (*S1) == ModelToUpper (*S2))) {
+    S1++;
+    S2++;
+  }
+
+  return (INTN)ModelToUpper (*S1) - (INTN)ModelToUpper (*S2);
+}
+
+VOID
+FatStrUpr (
+  IN OUT CHAR16  *String
+  )
+{
+  for ( ; *String != 0; String++) {
+    *String = ModelToUpper (*String);
+  }
+}
+
+VOID
+FatStrLwr (
+  IN OUT CHAR16  *String
+  )
+{
+  for ( ; *String != 0; String++) {
+    if ((*String >= L'A') && (*String <= L'Z')) {
+      *String = (CHAR16)(*String - L'A' + L'a');
+    }
+  }
+}
+
+VOID
+FatFatToStr (
+  IN  UINTN   FatSize,
+  IN  CHAR8   *Fat,
+  OUT CHAR16  *String
+  )
+{
+  while ((*Fat != 0) && (FatSize != 0)) {
+    *String++ = *Fat++;
+    FatSize--;
+  }
+
+  *String = 0;
+}
+
+//
+// As the English collation does, spaces and dots are dropped, and the
+// characters that are not valid in a short name become '_'.
+//
+BOOLEAN
+FatStrToFat (
+  IN  CHAR16  *String,
+  IN  UINTN   FatSize,
+  OUT CHAR8   *Fat
+  )
+{
+  BOOLEAN  SpecialCharExist;
+  CHAR16   Char;
+
+  SpecialCharExist = FALSE;
+  for ( ; (*String != 0) && (FatSize != 0); String++) {
+    if ((*String == L'.') || (*String == L' ')) {
+      continue;
+    }
+
+    Char = ModelToUpper (*String);
+    if (ModelIsFatChar (Char)) {
+      *Fat = (CHAR8)Char;
+    } else {
+      *Fat             = '_';
+      SpecialCharExist = TRUE;
+    }
+
+    Fat++;
+    FatSize--;
+  }
+
+  return SpecialCharExist;
+}
+
+VOID
+FatDiskModelReset (
+  IN UINTN   DiskSize,
+  IN UINT64  FreeMemory
+  )
+{
+  ASSERT ((DiskSize != 0) && ((DiskSize % FAT_DISK_MODEL_BLOCK_SIZE) == 0));
+
+  FatDiskModelFree ();
+
+  mModelDisk = AllocateZeroPool (DiskSize);
+  ASSERT (mModelDisk != NULL);
+  mModelDiskSize        = DiskSize;
+  mModelMedia.LastBlock = DiskSize / FAT_DISK_MODEL_BLOCK_SIZE - 1;
+  mModelFreeMemory      = FreeMemory;
+
+  mFatDiskModelCompletionTpl = TPL_HIGH_LEVEL + 1;
+  ZeroMem (&mFatDiskModelStatistics, sizeof (mFatDiskModelStatistics));
+
+  mModelTime     = 0;
+  mModelBusyTime = 0;
+  mModelTpl      = TPL_APPLICATION;
+
+  CopyMem (&mModelBootServices, gBS, sizeof (EFI_BOOT_SERVICES));
+  gBS->Stall        = ModelStall;
+  gBS->RaiseTPL     = ModelRaiseTpl;
+  gBS->RestoreTPL   = ModelRestoreTpl;
+  gBS->CreateEvent  = ModelCreateEvent;
+  gBS->CloseEvent   = ModelCloseEvent;
+  gBS->SignalEvent  = ModelSignalEvent;
+  gBS->CheckEvent   = ModelCheckEvent;
+  gBS->GetMemoryMap = ModelGetMemoryMap;
+
+  gBS->HandleProtocol                      = ModelHandleProtocol;
+  gBS->InstallMultipleProtocolInterfaces   = ModelInstallMultipleProtocolInterfaces;
+  gBS->UninstallMultipleProtocolInterfaces = ModelUninstallMultipleProtocolInterfaces;
+
+  //
+  // The runtime services table of the host test library is a mock without
+  // GetTime (), read the time from a table of the model instead
+  //
+  mModelSavedRuntimeServices    = gRT;
+  mModelRuntimeServices.GetTime = ModelGetTime;
+  gRT                           = &mModelRuntimeServices;
+  mModelActive                  = TRUE;
+}
+
+VOID
+FatDiskModelFree (
+  VOID
+  )
+{
+  MODEL_REQUEST  *Request;
+  MODEL_EVENT    *Event;
+
+  if (!mModelActive) {
+    return;
+  }
+
+  while (!IsListEmpty (&mModelRequests)) {
+    Request = BASE_CR (GetFirstNode (&mModelRequests), MODEL_REQUEST, Link);
+    RemoveEntryList (&Request->Link);
+    FreePool (Request);
+  }
+
+  while (!IsListEmpty (&mModelEvents)) {
+    Event = BASE_CR (GetFirstNode (&mModelEvents), MODEL_EVENT, Link);
+    RemoveEntryList (&Event->Link);
+    FreePool (Event);
+  }
+
+  CopyMem (gBS, &mModelBootServices, sizeof (EFI_BOOT_SERVICES));
+  gRT = mModelSavedRuntimeServices;
+  FreePool (mModelDisk);
+  mModelDisk       = NULL;
+  mModelFileSystem = NULL;
+  mModelActive     = FALSE;
+}
+
+UINT8 *
+FatDiskModelImage (
+  VOID
+  )
+{
+  return mModelDisk;
+}
+
+UINT64
+FatDiskModelTime (
+  VOID
+  )
+{
+  return mModelTime;
+}
+
+VOID
+FatDiskModelRun (
+  IN UINT64  Nanoseconds
+  )
+{
+  ModelAdvance (Nanoseconds);
+}
@@ -0,0 +1,101 @@
+/** @file
+  Interface of the disk model to the host tests of EnhancedFatDxe.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#ifndef FAT_DISK_MODEL_H_
+#define FAT_DISK_MODEL_H_
+
+#include <Protocol/BlockIo.h>
+#include <Protocol/DiskIo.h>
+#include <Protocol/DiskIo2.h>
+
+#define FAT_DISK_MODEL_BLOCK_SIZE  512
+
+typedef struct {
+  UINT32    Reads;            // ReadDisk () and ReadDiskEx () requests
+  UINT32    AsyncReads;       // ReadDiskEx () requests with an event to signal
+  UINT32    Writes;
+  UINT32    Cancels;
+  UINT64    BytesRead;
+  UINT64    BytesWritten;
+} FAT_DISK_MODEL_STATISTICS;
+
+//
+// The handle of the disk, with its block I/O, disk I/O and disk I/O 2
+// protocols, and the file system the driver installs on it
+//
+extern EFI_HANDLE                 mFatDiskModelHandle;
+extern EFI_BLOCK_IO_PROTOCOL      mFatDiskModelBlockIo;
+extern EFI_DISK_IO_PROTOCOL       mFatDiskModelDiskIo;
+extern EFI_DISK_IO2_PROTOCOL      mFatDiskModelDiskIo2;
+extern EFI_TPL                    mFatDiskModelCompletionTpl; // Requests complete only below this TPL
+extern FAT_DISK_MODEL_STATISTICS  mFatDiskModelStatistics;
+
+/**
+  Replace the disk with a zeroed one of the given size, clear the statistics
+  and take over the boot services the driver uses for delays, events, the
+  TPL, the memory map and the protocols of the handle of the disk, and the
+  runtime services it reads the time from.
+
+  The requests of the disk complete at any TPL, as they do when the disk
+  signals them from its interrupt.
+
+  @param  DiskSize               The size of the disk in bytes, a multiple of
+                                 FAT_DISK_MODEL_BLOCK_SIZE.
+  @param  FreeMemory             The number of bytes the memory map reports
+                                 free.
+
+**/
+VOID
+FatDiskModelReset (
+  IN UINTN   DiskSize,
+  IN UINT64  FreeMemory
+  );
+
+/**
+  Free the disk, close the events left open and give the boot services back.
+
+  The requests still in flight are dropped, their buffers are not written.
+
+**/
+VOID
+FatDiskModelFree (
+  VOID
+  );
+
+/**
+  Return the image of the disk.
+
+**/
+UINT8 *
+FatDiskModelImage (
+  VOID
+  );
+
+/**
+  Return the time of the clock of the model in nanoseconds. Requests and the
+  delays of the driver advance it.
+
+**/
+UINT64
+FatDiskModelTime (
+  VOID
+  );
+
+/**
+  Let time pass at the TPL of the caller, as the consumer of the files does
+  when it works on the data it read. The requests that complete meanwhile
+  move their data and signal their events.
+
+  @param  Nanoseconds            How long to let time pass.
+
+**/
+VOID
+FatDiskModelRun (
+  IN UINT64  Nanoseconds
+  );
+
+#endif
@@ -0,0 +1,807 @@
+/** @file
+  Host tests of the data cache of EnhancedFatDxe.
+
+  The driver mounts a FAT32 image the test formats on a model of a disk, and
+  the files it reads through EFI_FILE_PROTOCOL have to match the image,
+  whether the data cache reads ahead in the background through DiskIo2 or
+  only through DiskIo.
+
+  A disk that completes its requests from a timer at TPL_CALLBACK cannot
+  complete the readahead while the volume is locked. An access that needs
+  the pages read ahead has to give up on them after FAT_READ_AHEAD_TIMEOUT,
+  read them from the disk itself and stop reading ahead in the background,
+  and unmounting the volume has to cancel the readahead in flight without
+  freeing the buffer the disk still writes to.
+
+  On a fragmented volume, the extent lists of the open files have to map
+  every position to the cluster the FAT chain has there: at random
+  positions, near the end of the files, past FAT_EXTENT_MAX_COUNT extents,
+  and after the chain was cut and grown again.
+
+  The benchmarks read a large file the way a loader that hashes it does, and
+  report the throughput without readahead, with readahead on misses and
+  with readahead in the background; and seek to random positions and to the
+  tail of contiguous and fragmented files, and report the time per read.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <Library/GoogleTestLib.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+extern "C" {
+  #include "../Fat.h"
+  #include "FatDiskModel.h"
+}
+
+using namespace testing;
+
+//
+// The test image is a 128 MB FAT32 volume with 1 KB clusters. The root
+// directory takes the first clusters, the files follow it.
+//
+#define DISK_SIZE            SIZE_128MB
+#define SECTOR_SIZE          FAT_DISK_MODEL_BLOCK_SIZE
+#define SECTORS_PER_CLUSTER  2
+#define CLUSTER_SIZE         (SECTOR_SIZE * SECTORS_PER_CLUSTER)
+#define RESERVED_SECTORS     32
+#define ROOT_CLUSTERS        4
+#define FREE_MEMORY          SIZE_4GB
+
+//
+// A loader that hashes the file as it reads it works on the data at 1 GB/s.
+//
+#define CHUNK_SIZE      SIZE_16KB
+#define THINK_PER_BYTE  1
+
+class FatHostTest : public Test {
+protected:
+  UINT32                      *Fat;
+  UINT32                      FatSectors;
+  UINT32                      FirstDataSector;
+  UINT32                      ClusterCount;
+  UINT32                      NextCluster;
+  UINT32                      RootEntries;
+  std::vector<UINT8>          Kernel;
+  std::vector<UINT8>          Initrd;
+  std::vector<UINT8>          Config;
+  FAT_VOLUME                  *Volume;
+  EFI_FILE_PROTOCOL           *Root;
+  std::vector<EFI_FILE_PROTOCOL *>  Files;
+
+  void
+  SetUp (
+    ) override
+  {
+    Volume = NULL;
+    Root   = NULL;
+    FatDiskModelReset (DISK_SIZE, FREE_MEMORY);
+    Format ();
+
+    Fill (Kernel, SIZE_16MB + 12345, 1);
+    Fill (Initrd, SIZE_32MB + 777, 2);
+    Fill (Config, 3000, 3);
+    AddFile ("CONFIG  TXT", Config, Contiguous (Config.size ()));
+    AddFile ("KERNEL  IMG", Kernel, Contiguous (Kernel.size ()));
+    AddFile ("INITRD  IMG", Initrd, Contiguous (Initrd.size ()));
+  }
+
+  void
+  TearDown (
+    ) override
+  {
+    if (Volume != NULL) {
+      Unmount ();
+    }
+
+    FatDiskModelFree ();
+  }
+
+  //
+  // Fill a file with a pattern that differs from cluster to cluster and
+  // from file to file.
+  //
+  static void
+  Fill (
+    std::vector<UINT8>  &Data,
+    UINTN               Size,
+    UINTN               Seed
+    )
+  {
+    UINTN  Index;
+
+    Data.resize (Size);
+    for (Index = 0; Index < Size; Index++) {
+      Data[Index] = (UINT8)(Index * 7 + (Index >> 10) * 13 + (Index >> 20) + Seed * 101);
+    }
+  }
+
+  UINT8 *
+  ClusterData (
+    UINT32  Cluster
+    )
+  {
+    return FatDiskModelImage () + (UINTN)(FirstDataSector + (Cluster - FAT_MIN_CLUSTER) * SECTORS_PER_CLUSTER) * SECTOR_SIZE;
+  }
+
+  //
+  // Format the disk: the boot sector, the FS info sector, the FATs and a
+  // root directory of ROOT_CLUSTERS clusters.
+  //
+  void
+  Format (
+    )
+  {
+    FAT_BOOT_SECTOR  *Bs;
+    FAT_INFO_SECTOR  *Info;
+    UINT8            *Disk;
+    UINT32           Sectors;
+    UINT32           Cluster;
+
+    Disk            = FatDiskModelImage ();
+    Sectors         = DISK_SIZE / SECTOR_SIZE;
+    FatSectors      = ((Sectors - RESERVED_SECTORS) / SECTORS_PER_CLUSTER + FAT_MIN_CLUSTER) * sizeof (UINT32);
+    FatSectors      = (FatSectors + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    FirstDataSector = RESERVED_SECTORS + 2 * FatSectors;
+    ClusterCount    = (Sectors - FirstDataSector) / SECTORS_PER_CLUSTER;
+    ASSERT_GE (ClusterCount, (UINT32)FAT_MAX_FAT16_CLUSTER);
+
+    Bs = (FAT_BOOT_SECTOR *)Disk;
+    CopyMem (Bs->FatBsb.Ia32Jump, "\xEB\x58\x90", 3);
+    CopyMem (Bs->FatBsb.OemId, "MSWIN4.1", 8);
+    Bs->FatBsb.SectorSize                   = SECTOR_SIZE;
+    Bs->FatBsb.SectorsPerCluster            = SECTORS_PER_CLUSTER;
+    Bs->FatBsb.ReservedSectors              = RESERVED_SECTORS;
+    Bs->FatBsb.NumFats                      = 2;
+    Bs->FatBsb.Media                        = 0xF8;
+    Bs->FatBsb.LargeSectors                 = Sectors;
+    Bs->FatBse.Fat32Bse.LargeSectorsPerFat  = FatSectors;
+    Bs->FatBse.Fat32Bse.RootDirFirstCluster = FAT_MIN_CLUSTER;
+    Bs->FatBse.Fat32Bse.FsInfoSector        = 1;
+    Bs->FatBse.Fat32Bse.BackupBootSector    = 6;
+    Bs->FatBse.Fat32Bse.Signature           = 0x29;
+    CopyMem (Bs->FatBse.Fat32Bse.FatLabel, "FATTEST    ", 11);
+    CopyMem (Bs->FatBse.Fat32Bse.SystemId, "FAT32   ", 8);
+    Disk[510] = 0x55;
+    Disk[511] = 0xAA;
+
+    Info                         = (FAT_INFO_SECTOR *)(Disk + SECTOR_SIZE);
+    Info->Signature              = FAT_INFO_SIGNATURE;
+    Info->InfoBeginSignature     = FAT_INFO_BEGIN_SIGNATURE;
+    Info->FreeInfo.ClusterCount  = MAX_UINT32;
+    Info->FreeInfo.NextCluster   = MAX_UINT32;
+    Info->InfoEndSignature       = FAT_INFO_END_SIGNATURE;
+
+    //
+    // The second entry has the clean shutdown bit set.
+    //
+    Fat         = (UINT32 *)(Disk + RESERVED_SECTORS * SECTOR_SIZE);
+    Fat[0]      = 0x0FFFFFF8;
+    Fat[1]      = 0x0FFFFFFF;
+    NextCluster = FAT_MIN_CLUSTER;
+    for (Cluster = 0; Cluster < ROOT_CLUSTERS; Cluster++) {
+      Fat[NextCluster] = (Cluster + 1 < ROOT_CLUSTERS) ? NextCluster + 1 : 0x0FFFFFFF;
+      NextCluster++;
+    }
+
+    RootEntries = 0;
+  }
+
+  //
+  // Take the next free clusters for a file of Size bytes, in order.
+  //
+  std::vector<UINT32>
+  Contiguous (
+    UINTN  Size
+    )
+  {
+    std::vector<UINT32>  Clusters;
+
+    while (Clusters.size () * CLUSTER_SIZE < Size) {
+      Clusters.push_back (NextCluster++);
+    }
+
+    return Clusters;
+  }
+
+  //
+  // Take the next free clusters for a file of Size bytes, in runs of 1 to
+  // MaxRun clusters that follow each other in a random order.
+  //
+  std::vector<UINT32>
+  Fragmented (
+    UINTN   Size,
+    UINTN   MaxRun,
+    UINT32  Seed
+    )
+  {
+    std::mt19937                      Random (Seed);
+    std::vector<std::vector<UINT32> > Runs;
+    std::vector<UINT32>               Clusters;
+    UINTN                             Count;
+
+    Count = (Size + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    while (Count > 0) {
+      Runs.push_back (Contiguous (MIN (Random () % MaxRun + 1, Count) * CLUSTER_SIZE));
+      Count -= Runs.back ().size ();
+    }
+
+    std::shuffle (Runs.begin (), Runs.end (), Random);
+    for (CONST std::vector<UINT32> &Run : Runs) {
+      Clusters.insert (Clusters.end (), Run.begin (), Run.end ());
+    }
+
+    return Clusters;
+  }
+
+  //
+  // Count the runs of clusters that follow each other on the disk.
+  //
+  static UINTN
+  CountExtents (
+    CONST std::vector<UINT32>  &Clusters
+    )
+  {
+    UINTN  Count;
+    UINTN  Index;
+
+    Count = 0;
+    for (Index = 0; Index < Clusters.size (); Index++) {
+      if ((Index == 0) || (Clusters[Index] != Clusters[Index - 1] + 1)) {
+        Count++;
+      }
+    }
+
+    return Count;
+  }
+
+  //
+  // Add a file with an 8.3 name to the root directory, its data in the
+  // clusters given.
+  //
+  void
+  AddFile (
+    CONST CHAR8                      *Name,
+    CONST std::vector<UINT8>         &Data,
+    CONST std::vector<UINT32>        &Clusters
+    )
+  {
+    FAT_DIRECTORY_ENTRY  *Entry;
+    UINTN                Index;
+    UINT32               First;
+
+    ASSERT_LT (RootEntries, ROOT_CLUSTERS * CLUSTER_SIZE / sizeof (FAT_DIRECTORY_ENTRY));
+    ASSERT_GE (Clusters.size () * CLUSTER_SIZE, Data.size ());
+    for (Index = 0; Index < Clusters.size (); Index++) {
+      ASSERT_LT (Clusters[Index], ClusterCount + FAT_MIN_CLUSTER);
+      Fat[Clusters[Index]] = (Index + 1 < Clusters.size ()) ? Clusters[Index + 1] : 0x0FFFFFFF;
+      CopyMem (
+        ClusterData (Clusters[Index]),
+        Data.data () + Index * CLUSTER_SIZE,
+        MIN (CLUSTER_SIZE, Data.size () - Index * CLUSTER_SIZE)
+        );
+    }
+
+    First = Clusters.empty () ? 0 : Clusters[0];
+    Entry = (FAT_DIRECTORY_ENTRY *)ClusterData (FAT_MIN_CLUSTER) + RootEntries++;
+    CopyMem (Entry->FileName, Name, FAT_NAME_LEN);
+    Entry->Attributes                = FAT_ATTRIBUTE_ARCHIVE;
+    Entry->FileClusterHigh           = (UINT16)(First >> 16);
+    Entry->FileCluster               = (UINT16)First;
+    Entry->FileSize                  = (UINT32)Data.size ();
+    Entry->FileCreateTime.Date.Year  = 2023 - 1980;
+    Entry->FileCreateTime.Date.Month = 1;
+    Entry->FileCreateTime.Date.Day   = 1;
+    Entry->FileModificationTime      = Entry->FileCreateTime;
+    Entry->FileLastAccess            = Entry->FileCreateTime.Date;
+  }
+
+  //
+  // Mount the image the way FatDriverBindingStart () does.
+  //
+  void
+  Mount (
+    BOOLEAN  WithDiskIo2
+    )
+  {
+    EFI_SIMPLE_FILE_SYSTEM_PROTOCOL  *FileSystem;
+
+    CopyMem (Fat + FatSectors * SECTOR_SIZE / sizeof (UINT32), Fat, FatSectors * SECTOR_SIZE);
+
+    ASSERT_EQ (
+      FatAllocateVolume (mFatDiskModelHandle, &mFatDiskModelDiskIo, WithDiskIo2 ? &mFatDiskModelDiskIo2 : NULL, &mFatDiskModelBlockIo),
+      EFI_SUCCESS
+      );
+    ASSERT_EQ (gBS->HandleProtocol (mFatDiskModelHandle, &gEfiSimpleFileSystemProtocolGuid, (VOID **)&FileSystem), EFI_SUCCESS);
+    Volume = VOLUME_FROM_VOL_INTERFACE (FileSystem);
+    ASSERT_EQ (Volume->FatType, Fat32);
+    ASSERT_EQ (FileSystem->OpenVolume (FileSystem, &Root), EFI_SUCCESS);
+  }
+
+  //
+  // Close the files and unmount the volume the way FatDriverBindingStop ()
+  // does.
+  //
+  void
+  Unmount (
+    )
+  {
+    while (!Files.empty ()) {
+      EXPECT_EQ (Files.back ()->Close (Files.back ()), EFI_SUCCESS);
+      Files.pop_back ();
+    }
+
+    if (Root != NULL) {
+      EXPECT_EQ (Root->Close (Root), EFI_SUCCESS);
+      Root = NULL;
+    }
+
+    EXPECT_EQ (FatAbandonVolume (Volume), EFI_SUCCESS);
+    Volume = NULL;
+  }
+
+  EFI_FILE_PROTOCOL *
+  Open (
+    CONST CHAR8  *Name,
+    UINT64       Mode = EFI_FILE_MODE_READ
+    )
+  {
+    EFI_FILE_PROTOCOL  *File;
+    CHAR16             FileName[FAT_NAME_LEN + 2];
+
+    File = NULL;
+    EXPECT_EQ (AsciiStrToUnicodeStrS (Name, FileName, ARRAY_SIZE (FileName)), RETURN_SUCCESS);
+    EXPECT_EQ (Root->Open (Root, &File, FileName, Mode, 0), EFI_SUCCESS);
+    if (File != NULL) {
+      Files.push_back (File);
+    }
+
+    return File;
+  }
+
+  //
+  // Read a file from its start in chunks of ChunkSize bytes, comparing them
+  // with the image, and working on each for ThinkPerByte nanoseconds a byte.
+  //
+  void
+  ReadAll (
+    EFI_FILE_PROTOCOL         *File,
+    CONST std::vector<UINT8>  &Data,
+    UINTN                     ChunkSize,
+    UINTN                     ThinkPerByte
+    )
+  {
+    std::vector<UINT8>  Buffer (ChunkSize);
+    UINTN               Offset;
+    UINTN               Size;
+
+    ASSERT_EQ (File->SetPosition (File, 0), EFI_SUCCESS);
+    for (Offset = 0; Offset < Data.size (); Offset += Size) {
+      Size = ChunkSize;
+      ASSERT_EQ (File->Read (File, &Size, Buffer.data ()), EFI_SUCCESS);
+      ASSERT_EQ (Size, MIN (ChunkSize, Data.size () - Offset));
+      ASSERT_EQ (CompareMem (Buffer.data (), Data.data () + Offset, Size), 0) << "at " << Offset;
+      FatDiskModelRun ((UINT64)Size * ThinkPerByte);
+    }
+
+    Size = ChunkSize;
+    ASSERT_EQ (File->Read (File, &Size, Buffer.data ()), EFI_SUCCESS);
+    ASSERT_EQ (Size, 0U);
+  }
+
+  //
+  // Read a file at random positions from its start, half of the reads
+  // following the one before, comparing them with the image.
+  //
+  void
+  ReadRandom (
+    EFI_FILE_PROTOCOL         *File,
+    CONST std::vector<UINT8>  &Data,
+    UINTN                     Count
+    )
+  {
+    std::mt19937        Random (42);
+    std::vector<UINT8>  Buffer (SIZE_256KB);
+    UINT64              Position;
+    UINTN               Requested;
+    UINTN               Size;
+    UINTN               Index;
+
+    Position = 0;
+    ASSERT_EQ (File->SetPosition (File, Position), EFI_SUCCESS);
+    for (Index = 0; Index < Count; Index++) {
+      if ((Random () & 1) != 0) {
+        Position = Random () % Data.size ();
+        ASSERT_EQ (File->SetPosition (File, Position), EFI_SUCCESS);
+      }
+
+      Requested = (Random () % 4 == 0) ? Random () % SIZE_256KB : Random () % SIZE_8KB;
+      Size      = Requested;
+      ASSERT_EQ (File->Read (File, &Size, Buffer.data ()), EFI_SUCCESS);
+      ASSERT_EQ (Size, MIN (Requested, Data.size () - Position));
+      ASSERT_EQ (CompareMem (Buffer.data (), Data.data () + Position, Size), 0) << "at " << Position;
+      Position += Size;
+      FatDiskModelRun (Random () % 2000000);
+    }
+  }
+};
+
+//
+// Without DiskIo2 the data cache reads ahead only on misses.
+//
+TEST_F (FatHostTest, ReadsFilesThroughDiskIo) {
+  Mount (FALSE);
+  EXPECT_EQ (Volume->DiskCache[CacheData].ReadAheadToken.Event, nullptr);
+  ReadAll (Open ("CONFIG.TXT"), Config, 100, 0);
+  ReadAll (Open ("KERNEL.IMG"), Kernel, 4097, 0);
+  ReadAll (Open ("initrd.img"), Initrd, CHUNK_SIZE, THINK_PER_BYTE);
+  EXPECT_EQ (mFatDiskModelStatistics.AsyncReads, 0U);
+}
+
+TEST_F (FatHostTest, ReadsFilesThroughDiskIo2) {
+  Mount (TRUE);
+  ASSERT_NE (Volume->DiskCache[CacheData].ReadAheadToken.Event, nullptr);
+  ReadAll (Open ("CONFIG.TXT"), Config, 100, 0);
+  ReadAll (Open ("KERNEL.IMG"), Kernel, 4097, 0);
+  ReadAll (Open ("INITRD.IMG"), Initrd, CHUNK_SIZE, THINK_PER_BYTE);
+  EXPECT_GT (mFatDiskModelStatistics.AsyncReads, 0U);
+  EXPECT_FALSE (Volume->DiskCache[CacheData].ReadAheadAbandoned);
+}
+
+TEST_F (FatHostTest, RandomReadsMatchTheImage) {
+  EFI_FILE_PROTOCOL  *Kernel1;
+  EFI_FILE_PROTOCOL  *Initrd1;
+
+  Mount (TRUE);
+  Kernel1 = Open ("KERNEL.IMG");
+  Initrd1 = Open ("INITRD.IMG");
+  ReadRandom (Kernel1, Kernel, 500);
+  ReadRandom (Initrd1, Initrd, 500);
+  ReadAll (Kernel1, Kernel, CHUNK_SIZE, 0);
+  EXPECT_GT (mFatDiskModelStatistics.AsyncReads, 0U);
+}
+
+//
+// A disk that completes the readahead only at TPL_CALLBACK does not while
+// the reader holds the volume lock. The reader gives up on the readahead
+// and reads on without it.
+//
+TEST_F (FatHostTest, ReadAheadTimesOutAtCallback) {
+  UINT64  Start;
+
+  mFatDiskModelCompletionTpl = TPL_CALLBACK;
+  Mount (TRUE);
+  Start = FatDiskModelTime ();
+  ReadAll (Open ("KERNEL.IMG"), Kernel, CHUNK_SIZE, 0);
+  EXPECT_TRUE (Volume->DiskCache[CacheData].ReadAheadAbandoned);
+  EXPECT_EQ (mFatDiskModelStatistics.AsyncReads, 1U);
+  EXPECT_GE (FatDiskModelTime () - Start, (UINT64)FAT_READ_AHEAD_TIMEOUT * 1000);
+  EXPECT_LT (FatDiskModelTime () - Start, (UINT64)FAT_READ_AHEAD_TIMEOUT * 1000 * 2);
+
+  ReadAll (Open ("INITRD.IMG"), Initrd, CHUNK_SIZE, 0);
+  EXPECT_EQ (mFatDiskModelStatistics.AsyncReads, 1U);
+}
+
+//
+// Unmounting with the readahead in flight on such a disk cancels it. The
+// disk still moves its data, to a buffer the driver has to leave allocated.
+//
+TEST_F (FatHostTest, UnmountCancelsReadAhead) {
+  EFI_FILE_PROTOCOL  *File;
+  std::vector<UINT8>  Buffer (CHUNK_SIZE);
+  UINTN               Size;
+
+  mFatDiskModelCompletionTpl = TPL_CALLBACK;
+  Mount (TRUE);
+  File = Open ("KERNEL.IMG");
+  Size = CHUNK_SIZE;
+  ASSERT_EQ (File->Read (File, &Size, Buffer.data ()), EFI_SUCCESS);
+  ASSERT_EQ (mFatDiskModelStatistics.AsyncReads, 1U);
+  ASSERT_NE (Volume->DiskCache[CacheData].PendingPageCount, 0U);
+
+  Unmount ();
+  EXPECT_EQ (mFatDiskModelStatistics.Cancels, 1U);
+  FatDiskModelRun ((UINT64)FAT_READ_AHEAD_TIMEOUT * 1000);
+}
+
+//
+// The test image with two more files: FRAG.IMG in runs of up to 64
+// clusters, which its extent list covers, and SHRED.IMG in runs of single
+// clusters, more than FAT_EXTENT_MAX_COUNT of them.
+//
+class FatFragmentedTest : public FatHostTest {
+protected:
+  std::vector<UINT8>   Frag;
+  std::vector<UINT8>   Shred;
+  std::vector<UINT32>  FragClusters;
+  std::vector<UINT32>  ShredClusters;
+
+  void
+  SetUp (
+    ) override
+  {
+    FatHostTest::SetUp ();
+
+    Fill (Frag, SIZE_8MB + 4321, 4);
+    Fill (Shred, SIZE_8MB + 99, 5);
+    FragClusters  = Fragmented (Frag.size (), 64, 1);
+    ShredClusters = Fragmented (Shred.size (), 1, 2);
+    AddFile ("FRAG    IMG", Frag, FragClusters);
+    AddFile ("SHRED   IMG", Shred, ShredClusters);
+    ASSERT_LT (CountExtents (FragClusters), (UINTN)FAT_EXTENT_MAX_COUNT);
+    ASSERT_GT (CountExtents (ShredClusters), (UINTN)FAT_EXTENT_MAX_COUNT);
+  }
+
+  static FAT_OFILE *
+  OFileOf (
+    EFI_FILE_PROTOCOL  *File
+    )
+  {
+    FAT_IFILE  *IFile;
+
+    IFile = IFILE_FROM_FHAND (File);
+    return IFile->OFile;
+  }
+
+  //
+  // Read Size bytes at Position and compare them with the image.
+  //
+  void
+  ReadAt (
+    EFI_FILE_PROTOCOL         *File,
+    CONST std::vector<UINT8>  &Data,
+    UINT64                    Position,
+    UINTN                     Size
+    )
+  {
+    std::vector<UINT8>  Buffer (Size);
+    UINTN               Requested;
+
+    Requested = Size;
+    ASSERT_EQ (File->SetPosition (File, Position), EFI_SUCCESS);
+    ASSERT_EQ (File->Read (File, &Size, Buffer.data ()), EFI_SUCCESS);
+    ASSERT_EQ (Size, MIN (Requested, Data.size () - Position));
+    ASSERT_EQ (CompareMem (Buffer.data (), Data.data () + Position, Size), 0) << "at " << Position;
+  }
+
+  //
+  // Read near the end of the file, going back and forth.
+  //
+  void
+  ReadTail (
+    EFI_FILE_PROTOCOL         *File,
+    CONST std::vector<UINT8>  &Data,
+    UINTN                     Count
+    )
+  {
+    std::mt19937  Random (7);
+    UINTN         Index;
+
+    for (Index = 0; Index < Count; Index++) {
+      ReadAt (File, Data, Data.size () - 1 - Random () % SIZE_64KB, Random () % SIZE_4KB + 1);
+    }
+  }
+};
+
+TEST_F (FatFragmentedTest, ReadsFragmentedFiles) {
+  EFI_FILE_PROTOCOL  *FragFile;
+  EFI_FILE_PROTOCOL  *ShredFile;
+
+  Mount (TRUE);
+  FragFile  = Open ("FRAG.IMG");
+  ShredFile = Open ("SHRED.IMG");
+  ReadTail (FragFile, Frag, 200);
+  ReadTail (ShredFile, Shred, 200);
+  ReadRandom (FragFile, Frag, 500);
+  ReadRandom (ShredFile, Shred, 500);
+  ReadAll (FragFile, Frag, 4097, 0);
+  ReadAll (ShredFile, Shred, CHUNK_SIZE, 0);
+
+  EXPECT_EQ (OFileOf (FragFile)->ExtentCount, CountExtents (FragClusters));
+  EXPECT_EQ (OFileOf (FragFile)->ExtentClusterCount, FragClusters.size ());
+  EXPECT_EQ (OFileOf (ShredFile)->ExtentCount, (UINTN)FAT_EXTENT_MAX_COUNT);
+  EXPECT_LT (OFileOf (ShredFile)->ExtentClusterCount, ShredClusters.size ());
+}
+
+//
+// Cutting the file drops the extents past the new end. The clusters it
+// grows by afterwards come from the ones freed all over the volume, and
+// their extents have to be found again.
+//
+TEST_F (FatFragmentedTest, ShrinkAndGrowFragmentedFile) {
+  EFI_FILE_PROTOCOL   *File;
+  EFI_FILE_INFO       *Info;
+  std::vector<UINT8>  InfoBuffer (SIZE_1KB);
+  std::vector<UINT8>  Expected;
+  std::vector<UINT8>  Tail;
+  UINTN               Size;
+
+  Mount (TRUE);
+  File = Open ("FRAG.IMG", EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE);
+  ReadAll (File, Frag, CHUNK_SIZE, 0);
+  ASSERT_EQ (OFileOf (File)->ExtentClusterCount, FragClusters.size ());
+
+  Size = InfoBuffer.size ();
+  Info = (EFI_FILE_INFO *)InfoBuffer.data ();
+  ASSERT_EQ (File->GetInfo (File, &gEfiFileInfoGuid, &Size, Info), EFI_SUCCESS);
+  Info->FileSize = Frag.size () / 3;
+  ASSERT_EQ (File->SetInfo (File, &gEfiFileInfoGuid, Size, Info), EFI_SUCCESS);
+  ASSERT_EQ (File->Flush (File), EFI_SUCCESS);
+  EXPECT_LE (OFileOf (File)->ExtentClusterCount, (Frag.size () / 3 + CLUSTER_SIZE - 1) / CLUSTER_SIZE);
+
+  Expected.assign (Frag.begin (), Frag.begin () + Frag.size () / 3);
+  Fill (Tail, SIZE_4MB + 555, 6);
+  Expected.insert (Expected.end (), Tail.begin (), Tail.end ());
+  Size = Tail.size ();
+  ASSERT_EQ (File->SetPosition (File, MAX_UINT64), EFI_SUCCESS);
+  ASSERT_EQ (File->Write (File, &Size, Tail.data ()), EFI_SUCCESS);
+  ASSERT_EQ (Size, Tail.size ());
+  ASSERT_EQ (File->Flush (File), EFI_SUCCESS);
+
+  ReadTail (File, Expected, 200);
+  ReadRandom (File, Expected, 500);
+  ReadAll (File, Expected, CHUNK_SIZE, 0);
+
+  //
+  // The data is on the disk as well, not only in the cache of the volume.
+  //
+  Unmount ();
+  Mount (TRUE);
+  ReadAll (Open ("FRAG.IMG"), Expected, CHUNK_SIZE, 0);
+}
+
+class FatSeekBenchmark : public FatFragmentedTest {
+protected:
+  //
+  // Read Count times at random positions of the file, or near its end, with
+  // its data cached, and return the time per read in nanoseconds.
+  //
+  UINT64
+  Measure (
+    CONST CHAR8               *Name,
+    CONST std::vector<UINT8>  &Data,
+    BOOLEAN                   Tail,
+    UINTN                     Count,
+    UINTN                     *Extents
+    )
+  {
+    EFI_FILE_PROTOCOL                      *File;
+    std::mt19937                           Random (11);
+    UINT8                                  Buffer[SIZE_1KB];
+    std::chrono::steady_clock::time_point  Start;
+    UINT64                                 Time;
+    UINT64                                 Position;
+    UINTN                                  Size;
+    UINTN                                  Index;
+
+    File = Open (Name);
+    ReadAll (File, Data, CHUNK_SIZE, 0);
+
+    Start = std::chrono::steady_clock::now ();
+    for (Index = 0; Index < Count; Index++) {
+      Position = Tail ? Data.size () - 1 - Random () % SIZE_64KB : Random () % Data.size ();
+      Size     = sizeof (Buffer);
+      File->SetPosition (File, Position);
+      File->Read (File, &Size, Buffer);
+    }
+
+    Time     = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now () - Start).count ();
+    *Extents = OFileOf (File)->ExtentCount;
+    return Time / Count;
+  }
+};
+
+//
+// Past the extent list, a read has to follow the FAT chain from the last
+// extent, which a read of a file the list covers does not.
+//
+TEST_F (FatSeekBenchmark, FragmentedFileSeeks) {
+  CONST CHAR8  *Names[] = { "KERNEL.IMG", "FRAG.IMG", "SHRED.IMG" };
+  UINT64       Random[ARRAY_SIZE (Names)];
+  UINT64       Tail[ARRAY_SIZE (Names)];
+  UINTN        Extents[ARRAY_SIZE (Names)];
+  UINTN        Index;
+
+  Mount (FALSE);
+  Random[0] = Measure (Names[0], Kernel, FALSE, 2000, &Extents[0]);
+  Tail[0]   = Measure (Names[0], Kernel, TRUE, 2000, &Extents[0]);
+  Random[1] = Measure (Names[1], Frag, FALSE, 2000, &Extents[1]);
+  Tail[1]   = Measure (Names[1], Frag, TRUE, 2000, &Extents[1]);
+  Random[2] = Measure (Names[2], Shred, FALSE, 2000, &Extents[2]);
+  Tail[2]   = Measure (Names[2], Shred, TRUE, 2000, &Extents[2]);
+
+  printf ("  1 KB reads of cached data, 1 KB clusters\n");
+  for (Index = 0; Index < ARRAY_SIZE (Names); Index++) {
+    printf (
+      "  %-10s %5u extents: %6llu ns at random, %6llu ns near the tail\n",
+      Names[Index],
+      (unsigned)Extents[Index],
+      (unsigned long long)Random[Index],
+      (unsigned long long)Tail[Index]
+      );
+  }
+
+  EXPECT_LT (Tail[1], Tail[2]);
+}
+
+class FatReadBenchmark : public FatHostTest {
+protected:
+  //
+  // Read the initrd from a cold cache and return the throughput in MB/s.
+  //
+  UINT64
+  Measure (
+    BOOLEAN  WithDiskIo2,
+    BOOLEAN  ReadAhead,
+    UINT32   *Reads
+    )
+  {
+    UINT64  Start;
+    UINT64  Time;
+
+    Mount (WithDiskIo2);
+    if (!ReadAhead) {
+      Volume->DiskCache[CacheData].ReadAheadPageCount = 0;
+    }
+
+    ZeroMem (&mFatDiskModelStatistics, sizeof (mFatDiskModelStatistics));
+    Start = FatDiskModelTime ();
+    ReadAll (Open ("INITRD.IMG"), Initrd, CHUNK_SIZE, THINK_PER_BYTE);
+    Time   = FatDiskModelTime () - Start;
+    *Reads = mFatDiskModelStatistics.Reads;
+    Unmount ();
+
+    // Bytes per microsecond
+    return DivU64x64Remainder (MultU64x32 (Initrd.size (), 1000), Time, NULL);
+  }
+};
+
+//
+// Readahead on misses has to beat reading page by page, and readahead in
+// the background has to beat both.
+//
+TEST_F (FatReadBenchmark, LargeFileThroughput) {
+  UINT64  None;
+  UINT64  OnMiss;
+  UINT64  Background;
+  UINT32  NoneReads;
+  UINT32  OnMissReads;
+  UINT32  BackgroundReads;
+
+  None       = Measure (FALSE, FALSE, &NoneReads);
+  OnMiss     = Measure (FALSE, TRUE, &OnMissReads);
+  Background = Measure (TRUE, TRUE, &BackgroundReads);
+
+  printf (
+    "  %llu MB in %u KB reads, consumer at %u MB/s\n"
+    "  no readahead:         %llu MB/s, %u disk reads\n"
+    "  readahead on misses:  %llu MB/s, %u disk reads\n"
+    "  background readahead: %llu MB/s, %u disk reads\n",
+    (unsigned long long)(Initrd.size () / SIZE_1MB),
+    (unsigned)(CHUNK_SIZE / SIZE_1KB),
+    (unsigned)(1000 / THINK_PER_BYTE),
+    (unsigned long long)None,
+    NoneReads,
+    (unsigned long long)OnMiss,
+    OnMissReads,
+    (unsigned long long)Background,
+    BackgroundReads
+    );
+
+  EXPECT_GT (OnMiss, None);
+  EXPECT_GT (Background, OnMiss);
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
@@ -0,0 +1,250 @@
+/** @file
+  Host test of the block I/O queue of NvmExpressDxe.
+
+  The driver runs against the software NVMe controller of NvmExpressModel.c.
+  Reads and writes go through the block I/O queue and through the single
+  command path, with SGLs and with PRP lists, and are compared with the
+  media. The failures of a command and of the controller are checked to
+  leave no buffer mapped and the driver able to go on. The benchmark reports
+  the throughput of both paths on the clock of the model.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+#include <Library/GoogleTestLib.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+  #include <Uefi.h>
+  #include <Protocol/PciIo.h>
+  #include "NvmExpressModel.h"
+}
+
+using namespace testing;
+
+#define MEDIA_BLOCK_SIZE  512
+#define MEDIA_BLOCKS      (64 * 1024)
+
+class NvmeBlockIoQueueTest : public Test {
+protected:
+  VOID                    *Device;
+  std::vector<UINT8>      Buffer;
+
+  VOID
+  SetUp (
+    ) override
+  {
+    Device = NULL;
+    NvmeModelDefaultConfig ();
+  }
+
+  VOID
+  TearDown (
+    ) override
+  {
+    if (Device != NULL) {
+      NvmeModelStopDriver (Device);
+    }
+
+    NvmeModelFree ();
+  }
+
+  VOID
+  Start (
+    UINT16  QueueDepth
+    )
+  {
+    NvmeModelCreate (MEDIA_BLOCK_SIZE, MEDIA_BLOCKS);
+    Device = NvmeModelStartDriver (QueueDepth);
+    ASSERT_NE (Device, nullptr);
+  }
+
+  //
+  // Read the blocks at a byte offset in the buffer and compare them with the
+  // media.
+  //
+  VOID
+  CheckRead (
+    UINT64  Lba,
+    UINTN   Blocks,
+    UINTN   Offset
+    )
+  {
+    Buffer.assign (Blocks * MEDIA_BLOCK_SIZE + Offset, 0);
+    ASSERT_EQ (NvmeModelTransfer (Device, FALSE, &Buffer[Offset], Lba, Blocks), EFI_SUCCESS);
+    ASSERT_EQ (memcmp (&Buffer[Offset], NvmeModelMedia () + Lba * MEDIA_BLOCK_SIZE, Blocks * MEDIA_BLOCK_SIZE), 0);
+    ASSERT_EQ (NvmeModelMappedBuffers (), 0U);
+  }
+
+  VOID
+  CheckWrite (
+    UINT64  Lba,
+    UINTN   Blocks,
+    UINTN   Offset
+    )
+  {
+    UINTN  Index;
+
+    Buffer.resize (Blocks * MEDIA_BLOCK_SIZE + Offset);
+    for (Index = 0; Index < Buffer.size (); Index++) {
+      Buffer[Index] = (UINT8)(Index * 13 + Lba);
+    }
+
+    ASSERT_EQ (NvmeModelTransfer (Device, TRUE, &Buffer[Offset], Lba, Blocks), EFI_SUCCESS);
+    ASSERT_EQ (memcmp (&Buffer[Offset], NvmeModelMedia () + Lba * MEDIA_BLOCK_SIZE, Blocks * MEDIA_BLOCK_SIZE), 0);
+    ASSERT_EQ (NvmeModelMappedBuffers (), 0U);
+  }
+
+  //
+  // The throughput of sequential reads of the given size, in MB/s of the
+  // clock of the model.
+  //
+  UINT64
+  ReadThroughput (
+    UINTN  Blocks
+    )
+  {
+    UINT64  Lba;
+    UINT64  Start;
+
+    Buffer.resize (Blocks * MEDIA_BLOCK_SIZE);
+    Start = NvmeModelNow ();
+    for (Lba = 0; Lba + Blocks <= MEDIA_BLOCKS; Lba += Blocks) {
+      EXPECT_EQ (NvmeModelTransfer (Device, FALSE, &Buffer[0], Lba, Blocks), EFI_SUCCESS);
+    }
+
+    return (UINT64)MEDIA_BLOCKS * MEDIA_BLOCK_SIZE * 1000 / (NvmeModelNow () - Start);
+  }
+};
+
+TEST_F (NvmeBlockIoQueueTest, QueueSize) {
+  Start (64);
+  EXPECT_EQ (NvmeModelQueueSize (Device), 64);
+  NvmeModelStopDriver (Device);
+
+  //
+  // The controller caps the depth with CAP.MQES
+  //
+  mNvmeModelConfig.Mqes = 15;
+  Start (64);
+  EXPECT_EQ (NvmeModelQueueSize (Device), 16);
+  NvmeModelStopDriver (Device);
+
+  //
+  // Without a third I/O queue pair, the driver keeps the single command path
+  //
+  mNvmeModelConfig.Mqes         = 1023;
+  mNvmeModelConfig.IoQueuePairs = 2;
+  Start (64);
+  EXPECT_EQ (NvmeModelQueueSize (Device), 0);
+  CheckRead (100, 300, 0);
+  NvmeModelStopDriver (Device);
+
+  mNvmeModelConfig.IoQueuePairs = 8;
+  Start (0);
+  EXPECT_EQ (NvmeModelQueueSize (Device), 0);
+  CheckRead (100, 300, 0);
+}
+
+TEST_F (NvmeBlockIoQueueTest, ReadWriteSgl) {
+  Start (64);
+  CheckRead (0, 1, 0);
+  CheckRead (7, 4096, 0);
+  CheckRead (MEDIA_BLOCKS - 9000, 9000, 8);
+  CheckWrite (3, 1000, 0);
+  CheckWrite (5000, 5000, 4);
+  CheckRead (0, 12000, 0);
+  EXPECT_GT (mNvmeModelStatistics.SglCommands, 0U);
+  EXPECT_EQ (mNvmeModelStatistics.PrpListCommands, 0U);
+  EXPECT_GT (mNvmeModelStatistics.MaxInFlight, 32U);
+}
+
+TEST_F (NvmeBlockIoQueueTest, ReadWritePrp) {
+  mNvmeModelConfig.Sgls = 0;
+  Start (64);
+  CheckRead (0, 1, 0);
+  CheckRead (7, 4096, 0);
+  CheckRead (MEDIA_BLOCKS - 9000, 9000, 8);
+  CheckWrite (3, 1000, 0);
+  CheckWrite (5000, 5000, 4);
+  CheckRead (0, 12000, 0);
+  EXPECT_EQ (mNvmeModelStatistics.SglCommands, 0U);
+  EXPECT_GT (mNvmeModelStatistics.PrpListCommands, 0U);
+
+  //
+  // Without MDTS the transfers go up to 2 MB, and an unaligned one fills the
+  // whole PRP list of its slot
+  //
+  NvmeModelStopDriver (Device);
+  mNvmeModelConfig.Mdts = 0;
+  Start (4);
+  CheckRead (1, 3 * 4096 + 5, 0);
+  CheckWrite (2, 4096 + 100, 16);
+}
+
+TEST_F (NvmeBlockIoQueueTest, CommandError) {
+  mNvmeModelConfig.FailLba = 2000;
+  Start (64);
+  Buffer.resize (4096 * MEDIA_BLOCK_SIZE);
+  EXPECT_EQ (NvmeModelTransfer (Device, FALSE, &Buffer[0], 0, 4096), EFI_DEVICE_ERROR);
+  EXPECT_EQ (NvmeModelMappedBuffers (), 0U);
+  EXPECT_EQ (mNvmeModelStatistics.Resets, 0U);
+
+  mNvmeModelConfig.FailLba = MAX_UINT64;
+  CheckRead (0, 4096, 0);
+}
+
+TEST_F (NvmeBlockIoQueueTest, ControllerHang) {
+  Start (64);
+  mNvmeModelConfig.Hang = TRUE;
+  Buffer.resize (1024 * MEDIA_BLOCK_SIZE);
+  EXPECT_EQ (NvmeModelTransfer (Device, FALSE, &Buffer[0], 0, 1024), EFI_TIMEOUT);
+  EXPECT_EQ (NvmeModelMappedBuffers (), 0U);
+  EXPECT_EQ (mNvmeModelStatistics.Resets, 1U);
+
+  //
+  // The reset controller takes the queue again
+  //
+  mNvmeModelConfig.Hang = FALSE;
+  EXPECT_EQ (NvmeModelQueueSize (Device), 64);
+  CheckRead (0, 4096, 0);
+}
+
+TEST_F (NvmeBlockIoQueueTest, ThroughputBenchmark) {
+  UINT64  Single;
+  UINT64  Queued;
+  UINTN   Blocks;
+
+  for (Blocks = 8; Blocks <= 8192; Blocks *= 16) {
+    Start (0);
+    Single = ReadThroughput (Blocks);
+    NvmeModelStopDriver (Device);
+
+    Start (64);
+    Queued = ReadThroughput (Blocks);
+    NvmeModelStopDriver (Device);
+    Device = NULL;
+
+    printf (
+      "  %5u KB reads: %5llu MB/s single command, %5llu MB/s queued\n",
+      (unsigned)(Blocks * MEDIA_BLOCK_SIZE / 1024),
+      (unsigned long long)Single,
+      (unsigned long long)Queued
+      );
+    if (Blocks * MEDIA_BLOCK_SIZE >= SIZE_1MB) {
+      EXPECT_GT (Queued, 2 * Single);
+    }
+  }
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
@@ -0,0 +1,981 @@
+/** @file
+  A software NVMe controller behind a PCI I/O protocol, for the host test of
+  the block I/O queue of NvmExpressDxe.
+
+  The controller fetches the commands when the submission queue doorbell is
+  written, and moves the data at once. Its completions are posted on a
+  simulated clock: a command waits for one of the parallel units of the
+  media, takes the media latency there, then its data crosses the link, one
+  command at a time, at the link bandwidth. The clock advances by the time
+  the host takes for the register writes, and jumps to the next completion
+  when the driver polls a timer event. The model takes over the event, timer
+  and stall services of UnitTestUefiBootServicesTableLib for that.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "../NvmExpress.h"
+#include "NvmExpressModel.h"
+
+#define MODEL_MAX_QUEUES       8
+#define MODEL_MAX_COMPLETIONS  4096
+#define MODEL_MAX_UNITS        64
+#define MODEL_MAX_EVENTS       16
+#define MODEL_ADMIN_TIME       1000
+
+typedef struct {
+  UINT64     Base;
+  UINT32     Size;
+  UINT32     Head;
+  UINT32     Tail;
+  UINT16     Cqid;
+  BOOLEAN    Phase;
+  BOOLEAN    Valid;
+} MODEL_QUEUE;
+
+typedef struct {
+  UINT64    Time;
+  UINT32    Dword0;
+  UINT16    Sqid;
+  UINT16    Cid;
+  UINT8     Sct;
+  UINT8     Sc;
+} MODEL_COMPLETION;
+
+typedef struct {
+  BOOLEAN    Used;
+  BOOLEAN    Armed;
+  UINT64     Deadline;
+} MODEL_EVENT;
+
+NVME_MODEL_CONFIG      mNvmeModelConfig;
+NVME_MODEL_STATISTICS  mNvmeModelStatistics;
+
+//
+// The block I/O transfers of NvmExpressBlockIo.c
+//
+EFI_STATUS
+NvmeRead (
+  IN     NVME_DEVICE_PRIVATE_DATA  *Device,
+  OUT VOID                         *Buffer,
+  IN     UINT64                    Lba,
+  IN     UINTN                     Blocks
+  );
+
+EFI_STATUS
+NvmeWrite (
+  IN NVME_DEVICE_PRIVATE_DATA  *Device,
+  IN VOID                      *Buffer,
+  IN UINT64                    Lba,
+  IN UINTN                     Blocks
+  );
+
+STATIC EFI_PCI_IO_PROTOCOL  mModelPciIo;
+STATIC EFI_BOOT_SERVICES    mModelBootServices;
+STATIC MODEL_EVENT          mModelEvents[MODEL_MAX_EVENTS];
+
+STATIC UINT8             *mModelMedia;
+STATIC UINT32            mModelBlockSize;
+STATIC UINTN             mModelBlocks;
+STATIC UINT64            mModelNow;
+STATIC UINTN             mModelMaps;
+STATIC UINT32            mModelCc;
+STATIC UINT32            mModelCsts;
+STATIC UINT32            mModelAqa;
+STATIC UINT64            mModelAsq;
+STATIC UINT64            mModelAcq;
+STATIC MODEL_QUEUE       mModelSq[MODEL_MAX_QUEUES];
+STATIC MODEL_QUEUE       mModelCq[MODEL_MAX_QUEUES];
+STATIC MODEL_COMPLETION  mModelCompletions[MODEL_MAX_COMPLETIONS];
+STATIC UINTN             mModelCompletionCount;
+STATIC UINT32            mModelInFlight;
+STATIC UINT64            mModelUnitFree[MODEL_MAX_UNITS];
+STATIC UINT64            mModelLinkFree;
+
+/**
+  Post the completions that are due and fit in their completion queues, in
+  the order they are due.
+
+**/
+STATIC
+VOID
+ModelAdvance (
+  VOID
+  )
+{
+  UINTN        Index;
+  UINTN        First;
+  MODEL_QUEUE  *Cq;
+  NVME_CQ      *Entry;
+
+  while (TRUE) {
+    First = MODEL_MAX_COMPLETIONS;
+    for (Index = 0; Index < mModelCompletionCount; Index++) {
+      if ((mModelCompletions[Index].Time <= mModelNow) &&
+          ((First == MODEL_MAX_COMPLETIONS) || (mModelCompletions[Index].Time < mModelCompletions[First].Time)))
+      {
+        First = Index;
+      }
+    }
+
+    if (First == MODEL_MAX_COMPLETIONS) {
+      return;
+    }
+
+    Cq = &mModelCq[mModelSq[mModelCompletions[First].Sqid].Cqid];
+    if ((Cq->Tail + 1) % Cq->Size == Cq->Head) {
+      return;
+    }
+
+    Entry         = (NVME_CQ *)(UINTN)(Cq->Base + Cq->Tail * sizeof (NVME_CQ));
+    Entry->Dword0 = mModelCompletions[First].Dword0;
+    Entry->Sqhd   = (UINT16)mModelSq[mModelCompletions[First].Sqid].Head;
+    Entry->Sqid   = mModelCompletions[First].Sqid;
+    Entry->Cid    = mModelCompletions[First].Cid;
+    Entry->Sct    = mModelCompletions[First].Sct;
+    Entry->Sc     = mModelCompletions[First].Sc;
+    Entry->Pt     = Cq->Phase;
+    if (++Cq->Tail == Cq->Size) {
+      Cq->Tail  = 0;
+      Cq->Phase = !Cq->Phase;
+    }
+
+    if (mModelCompletions[First].Sqid != 0) {
+      mModelInFlight--;
+    }
+
+    mModelCompletions[First] = mModelCompletions[--mModelCompletionCount];
+  }
+}
+
+/**
+  Return the time of the next completion, or MAX_UINT64 if none is pending.
+
+**/
+STATIC
+UINT64
+ModelNextCompletion (
+  VOID
+  )
+{
+  UINTN   Index;
+  UINT64  Next;
+
+  Next = MAX_UINT64;
+  for (Index = 0; Index < mModelCompletionCount; Index++) {
+    Next = MIN (Next, mModelCompletions[Index].Time);
+  }
+
+  return Next;
+}
+
+STATIC
+VOID
+ModelComplete (
+  IN UINT64  Time,
+  IN UINT16  Sqid,
+  IN UINT16  Cid,
+  IN UINT8   Sct,
+  IN UINT8   Sc,
+  IN UINT32  Dword0
+  )
+{
+  ASSERT (mModelCompletionCount < MODEL_MAX_COMPLETIONS);
+  mModelCompletions[mModelCompletionCount].Time   = Time;
+  mModelCompletions[mModelCompletionCount].Sqid   = Sqid;
+  mModelCompletions[mModelCompletionCount].Cid    = Cid;
+  mModelCompletions[mModelCompletionCount].Sct    = Sct;
+  mModelCompletions[mModelCompletionCount].Sc     = Sc;
+  mModelCompletions[mModelCompletionCount].Dword0 = Dword0;
+  mModelCompletionCount++;
+}
+
+/**
+  Copy between the media and the host buffers described by the data pointer
+  of a command.
+
+  @retval 0                      The data is moved.
+  @return The status code of the failure, with Invalid Field (2) for a bad
+          data pointer.
+
+**/
+STATIC
+UINT8
+ModelMoveData (
+  IN NVME_SQ  *Sq,
+  IN UINT8    *Media,
+  IN UINT32   Bytes,
+  IN BOOLEAN  ToHost
+  )
+{
+  UINT64  Address;
+  UINT64  *PrpList;
+  UINT32  Length;
+  UINT32  Done;
+  UINTN   Entry;
+
+  if (Sq->Psdt != 0) {
+    //
+    // A single SGL Data Block descriptor
+    //
+    if (mNvmeModelConfig.Sgls == 0) {
+      return 0x2;
+    }
+
+    if ((RShiftU64 (Sq->Prp[1], 56) >> 4) != 0) {
+      return 0x11;
+    }
+
+    if ((UINT32)Sq->Prp[1] != Bytes) {
+      return 0xF;
+    }
+
+    if ((mNvmeModelConfig.Sgls == BIT1) && ((Sq->Prp[0] & 3) != 0)) {
+      return 0x2;
+    }
+
+    mNvmeModelStatistics.SglCommands++;
+    if (ToHost) {
+      CopyMem ((VOID *)(UINTN)Sq->Prp[0], Media, Bytes);
+    } else {
+      CopyMem (Media, (VOID *)(UINTN)Sq->Prp[0], Bytes);
+    }
+
+    return 0;
+  }
+
+  //
+  // PRP entries. The second one is a PRP list pointer if the data spans more
+  // than two pages.
+  //
+  Address = Sq->Prp[0];
+  PrpList = NULL;
+  Entry   = 0;
+  if (((Address & (EFI_PAGE_SIZE - 1)) + Bytes) > 2 * EFI_PAGE_SIZE) {
+    if ((Sq->Prp[1] & 7) != 0) {
+      return 0x2;
+    }
+
+    PrpList = (UINT64 *)(UINTN)Sq->Prp[1];
+    mNvmeModelStatistics.PrpListCommands++;
+  }
+
+  for (Done = 0; Done < Bytes; Done += Length) {
+    if (Done != 0) {
+      if (PrpList == NULL) {
+        Address = Sq->Prp[1];
+      } else {
+        if ((Entry == EFI_PAGE_SIZE / sizeof (UINT64) - 1) && (Bytes - Done > EFI_PAGE_SIZE)) {
+          PrpList = (UINT64 *)(UINTN)PrpList[Entry];
+          Entry   = 0;
+        }
+
+        Address = PrpList[Entry++];
+      }
+
+      if ((Address & (EFI_PAGE_SIZE - 1)) != 0) {
+        return 0x2;
+      }
+    }
+
+    Length = MIN (Bytes - Done, EFI_PAGE_SIZE - (UINT32)(Address & (EFI_PAGE_SIZE - 1)));
+    if (ToHost) {
+      CopyMem ((VOID *)(UINTN)Address, Media + Done, Length);
+    } else {
+      CopyMem (Media + Done, (VOID *)(UINTN)Address, Length);
+    }
+  }
+
+  return 0;
+}
+
+STATIC
+VOID
+ModelAdminCommand (
+  IN NVME_SQ  *Sq
+  )
+{
+  NVME_ADMIN_CONTROLLER_DATA  *ControllerData;
+  UINT16                      Qid;
+  UINT32                      Size;
+  UINT32                      Dword0;
+  UINT8                       Sct;
+  UINT8                       Sc;
+
+  Dword0 = 0;
+  Sct    = 0;
+  Sc     = 0;
+  Qid    = (UINT16)Sq->Payload.Raw.Cdw10;
+  Size   = (Sq->Payload.Raw.Cdw10 >> 16) + 1;
+  switch (Sq->Opc) {
+    case NVME_ADMIN_IDENTIFY_CMD:
+      if ((Sq->Payload.Raw.Cdw10 & 0xFF) != 1) {
+        Sc = 0x2;
+        break;
+      }
+
+      ControllerData = (NVME_ADMIN_CONTROLLER_DATA *)(UINTN)Sq->Prp[0];
+      ZeroMem (ControllerData, sizeof (NVME_ADMIN_CONTROLLER_DATA));
+      ControllerData->Vid  = 0x1B36;
+      ControllerData->Nn   = 1;
+      ControllerData->Mdts = mNvmeModelConfig.Mdts;
+      ControllerData->Sgls = mNvmeModelConfig.Sgls;
+      ControllerData->Sqes = 0x66;
+      ControllerData->Cqes = 0x44;
+      break;
+
+    case NVME_ADMIN_SET_FEATURES_CMD:
+      if ((Sq->Payload.Raw.Cdw10 & 0xFF) != NVME_FEATURE_NUMBER_OF_QUEUES) {
+        Sc = 0x2;
+        break;
+      }
+
+      Dword0 = (mNvmeModelConfig.IoQueuePairs - 1) | ((mNvmeModelConfig.IoQueuePairs - 1) << 16);
+      break;
+
+    case NVME_ADMIN_CRIOCQ_CMD:
+    case NVME_ADMIN_CRIOSQ_CMD:
+      if ((Qid == 0) || (Qid > mNvmeModelConfig.IoQueuePairs) || (Qid >= MODEL_MAX_QUEUES)) {
+        Sct = 1;
+        Sc  = 0x1;
+        break;
+      }
+
+      if ((Size < 2) || (Size > mNvmeModelConfig.Mqes + 1U)) {
+        Sct = 1;
+        Sc  = 0x2;
+        break;
+      }
+
+      if (Sq->Opc == NVME_ADMIN_CRIOCQ_CMD) {
+        ZeroMem (&mModelCq[Qid], sizeof (MODEL_QUEUE));
+        mModelCq[Qid].Phase = TRUE;
+        mModelCq[Qid].Base  = Sq->Prp[0];
+        mModelCq[Qid].Size  = Size;
+        mModelCq[Qid].Valid = TRUE;
+      } else {
+        if (!mModelCq[Sq->Payload.Raw.Cdw11 >> 16].Valid) {
+          Sct = 1;
+          Sc  = 0x0;
+          break;
+        }
+
+        ZeroMem (&mModelSq[Qid], sizeof (MODEL_QUEUE));
+        mModelSq[Qid].Base  = Sq->Prp[0];
+        mModelSq[Qid].Size  = Size;
+        mModelSq[Qid].Cqid  = (UINT16)(Sq->Payload.Raw.Cdw11 >> 16);
+        mModelSq[Qid].Valid = TRUE;
+      }
+
+      break;
+
+    default:
+      Sc = 0x1;
+      break;
+  }
+
+  ModelComplete (mModelNow + MODEL_ADMIN_TIME, 0, Sq->Cid, Sct, Sc, Dword0);
+}
+
+STATIC
+VOID
+ModelIoCommand (
+  IN UINT16   Sqid,
+  IN NVME_SQ  *Sq
+  )
+{
+  UINT64  Lba;
+  UINT32  Blocks;
+  UINT32  Bytes;
+  UINT64  Start;
+  UINTN   Unit;
+  UINTN   Index;
+  UINT8   Sct;
+  UINT8   Sc;
+
+  Lba    = Sq->Payload.Raw.Cdw10 | LShiftU64 (Sq->Payload.Raw.Cdw11, 32);
+  Blocks = (Sq->Payload.Raw.Cdw12 & 0xFFFF) + 1;
+  Bytes  = Blocks * mModelBlockSize;
+  Sct    = 0;
+  Sc     = 0;
+
+  mNvmeModelStatistics.IoCommands++;
+  mModelInFlight++;
+  mNvmeModelStatistics.MaxInFlight = MAX (mNvmeModelStatistics.MaxInFlight, mModelInFlight);
+
+  if ((Sq->Opc != NVME_IO_READ_OPC) && (Sq->Opc != NVME_IO_WRITE_OPC)) {
+    Sc = 0x1;
+  } else if ((Sq->Nsid != 1) || (Lba + Blocks > mModelBlocks)) {
+    Sc = 0x80;
+  } else if ((mNvmeModelConfig.Mdts != 0) && (Bytes > (EFI_PAGE_SIZE << mNvmeModelConfig.Mdts))) {
+    Sc = 0x2;
+  } else if ((mNvmeModelConfig.FailLba >= Lba) && (mNvmeModelConfig.FailLba < Lba + Blocks)) {
+    Sct = 2;
+    Sc  = 0x81;
+  } else {
+    Sc = ModelMoveData (Sq, mModelMedia + Lba * mModelBlockSize, Bytes, (BOOLEAN)(Sq->Opc == NVME_IO_READ_OPC));
+  }
+
+  if (mNvmeModelConfig.Hang) {
+    return;
+  }
+
+  //
+  // The command takes the unit that frees first, then the link.
+  //
+  Unit = 0;
+  for (Index = 1; Index < mNvmeModelConfig.ParallelUnits; Index++) {
+    if (mModelUnitFree[Index] < mModelUnitFree[Unit]) {
+      Unit = Index;
+    }
+  }
+
+  Start                = MAX (mModelNow, mModelUnitFree[Unit]) + mNvmeModelConfig.MediaLatency;
+  mModelUnitFree[Unit] = Start;
+  Start                = MAX (Start, mModelLinkFree);
+  mModelLinkFree       = Start + DivU64x64Remainder (MultU64x32 (1000000000, Bytes), mNvmeModelConfig.LinkBandwidth, NULL);
+  ModelComplete (mModelLinkFree, Sqid, Sq->Cid, Sct, Sc, 0);
+}
+
+STATIC
+VOID
+ModelFetch (
+  IN UINT16  Sqid
+  )
+{
+  MODEL_QUEUE  *Queue;
+  NVME_SQ      *Sq;
+
+  Queue = &mModelSq[Sqid];
+  while (Queue->Head != Queue->Tail) {
+    Sq          = (NVME_SQ *)(UINTN)(Queue->Base + Queue->Head * sizeof (NVME_SQ));
+    Queue->Head = (Queue->Head + 1) % Queue->Size;
+    if (Sqid == 0) {
+      ModelAdminCommand (Sq);
+    } else {
+      ModelIoCommand (Sqid, Sq);
+    }
+  }
+}
+
+STATIC
+VOID
+ModelReset (
+  VOID
+  )
+{
+  ZeroMem (mModelSq, sizeof (mModelSq));
+  ZeroMem (mModelCq, sizeof (mModelCq));
+  ZeroMem (mModelUnitFree, sizeof (mModelUnitFree));
+  mModelCompletionCount = 0;
+  mModelInFlight        = 0;
+  mModelLinkFree        = 0;
+  mModelCsts            = 0;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelMemRead (
+  IN     EFI_PCI_IO_PROTOCOL        *This,
+  IN     EFI_PCI_IO_PROTOCOL_WIDTH  Width,
+  IN     UINT8                      BarIndex,
+  IN     UINT64                     Offset,
+  IN     UINTN                      Count,
+  IN OUT VOID                       *Buffer
+  )
+{
+  NVME_CAP  Cap;
+  UINT64    Value;
+
+  ASSERT (Width == EfiPciIoWidthUint32);
+  switch (Offset) {
+    case NVME_CAP_OFFSET:
+      ZeroMem (&Cap, sizeof (Cap));
+      Cap.Mqes = mNvmeModelConfig.Mqes;
+      Cap.Cqr  = 1;
+      Cap.To   = 1;
+      Cap.Css  = BIT0;
+      CopyMem (&Value, &Cap, sizeof (Value));
+      break;
+
+    case NVME_CC_OFFSET:
+      Value = mModelCc;
+      break;
+
+    case NVME_CSTS_OFFSET:
+      Value = mModelCsts;
+      break;
+
+    default:
+      Value = 0;
+      break;
+  }
+
+  CopyMem (Buffer, &Value, Count * sizeof (UINT32));
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelMemWrite (
+  IN     EFI_PCI_IO_PROTOCOL        *This,
+  IN     EFI_PCI_IO_PROTOCOL_WIDTH  Width,
+  IN     UINT8                      BarIndex,
+  IN     UINT64                     Offset,
+  IN     UINTN                      Count,
+  IN OUT VOID                       *Buffer
+  )
+{
+  UINT64  Value;
+  UINT16  Qid;
+
+  ASSERT (Width == EfiPciIoWidthUint32);
+  Value = 0;
+  CopyMem (&Value, Buffer, Count * sizeof (UINT32));
+  mModelNow += mNvmeModelConfig.MmioWriteTime;
+  ModelAdvance ();
+
+  if (Offset >= NVME_SQ0_OFFSET) {
+    Qid = (UINT16)((Offset - NVME_SQ0_OFFSET) / 8);
+    if (Qid >= MODEL_MAX_QUEUES) {
+      return EFI_SUCCESS;
+    }
+
+    if (((Offset - NVME_SQ0_OFFSET) % 8) == 0) {
+      ASSERT (mModelSq[Qid].Valid && (Value < mModelSq[Qid].Size));
+      mModelSq[Qid].Tail = (UINT32)Value;
+      mNvmeModelStatistics.SqDoorbells++;
+      ModelFetch (Qid);
+    } else {
+      ASSERT (mModelCq[Qid].Valid && (Value < mModelCq[Qid].Size));
+      mModelCq[Qid].Head = (UINT32)Value;
+      mNvmeModelStatistics.CqDoorbells++;
+    }
+
+    ModelAdvance ();
+    return EFI_SUCCESS;
+  }
+
+  switch (Offset) {
+    case NVME_CC_OFFSET:
+      if (((mModelCc & BIT0) != 0) && ((Value & BIT0) == 0)) {
+        ModelReset ();
+        mNvmeModelStatistics.Resets++;
+      } else if (((mModelCc & BIT0) == 0) && ((Value & BIT0) != 0)) {
+        mModelSq[0].Base  = mModelAsq;
+        mModelSq[0].Size  = (mModelAqa & 0xFFF) + 1;
+        mModelSq[0].Valid = TRUE;
+        mModelCq[0].Base  = mModelAcq;
+        mModelCq[0].Size  = ((mModelAqa >> 16) & 0xFFF) + 1;
+        mModelCq[0].Phase = TRUE;
+        mModelCq[0].Valid = TRUE;
+        mModelCsts        = BIT0;
+      }
+
+      mModelCc = (UINT32)Value;
+      break;
+
+    case NVME_AQA_OFFSET:
+      mModelAqa = (UINT32)Value;
+      break;
+
+    case NVME_ASQ_OFFSET:
+      mModelAsq = Value;
+      break;
+
+    case NVME_ACQ_OFFSET:
+      mModelAcq = Value;
+      break;
+
+    default:
+      break;
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelMap (
+  IN     EFI_PCI_IO_PROTOCOL            *This,
+  IN     EFI_PCI_IO_PROTOCOL_OPERATION  Operation,
+  IN     VOID                           *HostAddress,
+  IN OUT UINTN                          *NumberOfBytes,
+  OUT    EFI_PHYSICAL_ADDRESS           *DeviceAddress,
+  OUT    VOID                           **Mapping
+  )
+{
+  *DeviceAddress = (EFI_PHYSICAL_ADDRESS)(UINTN)HostAddress;
+  *Mapping       = HostAddress;
+  mModelMaps++;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelUnmap (
+  IN EFI_PCI_IO_PROTOCOL  *This,
+  IN VOID                 *Mapping
+  )
+{
+  ASSERT (mModelMaps != 0);
+  mModelMaps--;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelAllocateBuffer (
+  IN  EFI_PCI_IO_PROTOCOL  *This,
+  IN  EFI_ALLOCATE_TYPE    Type,
+  IN  EFI_MEMORY_TYPE      MemoryType,
+  IN  UINTN                Pages,
+  OUT VOID                 **HostAddress,
+  IN  UINT64               Attributes
+  )
+{
+  *HostAddress = AllocatePages (Pages);
+  return (*HostAddress == NULL) ? EFI_OUT_OF_RESOURCES : EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelFreeBuffer (
+  IN  EFI_PCI_IO_PROTOCOL  *This,
+  IN  UINTN                Pages,
+  IN  VOID                 *HostAddress
+  )
+{
+  FreePages (HostAddress, Pages);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelAttributes (
+  IN  EFI_PCI_IO_PROTOCOL                      *This,
+  IN  EFI_PCI_IO_PROTOCOL_ATTRIBUTE_OPERATION  Operation,
+  IN  UINT64                                   Attributes,
+  OUT UINT64                                   *Result OPTIONAL
+  )
+{
+  if (Result != NULL) {
+    *Result = EFI_PCI_DEVICE_ENABLE;
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction OPTIONAL,
+  IN  VOID              *NotifyContext OPTIONAL,
+  OUT EFI_EVENT         *Event
+  )
+{
+  UINTN  Index;
+
+  ASSERT (NotifyFunction == NULL);
+  for (Index = 0; Index < MODEL_MAX_EVENTS; Index++) {
+    if (!mModelEvents[Index].Used) {
+      ZeroMem (&mModelEvents[Index], sizeof (MODEL_EVENT));
+      mModelEvents[Index].Used = TRUE;
+      *Event                   = &mModelEvents[Index];
+      return EFI_SUCCESS;
+    }
+  }
+
+  return EFI_OUT_OF_RESOURCES;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ((MODEL_EVENT *)Event)->Used = FALSE;
+  return EFI_SUCCESS;
+}
+
+//
+// The trigger time of the timers is in 100 ns units.
+//
+STATIC
+EFI_STATUS
+EFIAPI
+ModelSetTimer (
+  IN EFI_EVENT        Event,
+  IN EFI_TIMER_DELAY  Type,
+  IN UINT64           TriggerTime
+  )
+{
+  MODEL_EVENT  *ModelEvent;
+
+  ModelEvent           = (MODEL_EVENT *)Event;
+  ModelEvent->Armed    = (BOOLEAN)(Type != TimerCancel);
+  ModelEvent->Deadline = mModelNow + MultU64x32 (TriggerTime, 100);
+  return EFI_SUCCESS;
+}
+
+/**
+  The driver polls a timer while it waits for the controller, so the clock
+  jumps to the next completion, or to the expiry of the timer if it comes
+  first.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCheckEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  MODEL_EVENT  *ModelEvent;
+
+  ModelEvent = (MODEL_EVENT *)Event;
+  ASSERT (ModelEvent->Armed);
+  if (mModelNow >= ModelEvent->Deadline) {
+    return EFI_SUCCESS;
+  }
+
+  mModelNow = MAX (mModelNow + 1, MIN (ModelNextCompletion (), ModelEvent->Deadline));
+  ModelAdvance ();
+  return (mModelNow >= ModelEvent->Deadline) ? EFI_SUCCESS : EFI_NOT_READY;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelSignalEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelStall (
+  IN UINTN  Microseconds
+  )
+{
+  mModelNow += MultU64x32 (Microseconds, 1000);
+  ModelAdvance ();
+  return EFI_SUCCESS;
+}
+
+VOID
+NvmeModelDefaultConfig (
+  VOID
+  )
+{
+  ZeroMem (&mNvmeModelConfig, sizeof (mNvmeModelConfig));
+  mNvmeModelConfig.Mdts          = 5;
+  mNvmeModelConfig.Sgls          = BIT0;
+  mNvmeModelConfig.Mqes          = 1023;
+  mNvmeModelConfig.IoQueuePairs  = 8;
+  mNvmeModelConfig.ParallelUnits = 8;
+  mNvmeModelConfig.MediaLatency  = 80 * 1000;
+  mNvmeModelConfig.LinkBandwidth = 3000000000ULL;
+  mNvmeModelConfig.MmioWriteTime = 200;
+  mNvmeModelConfig.FailLba       = MAX_UINT64;
+}
+
+EFI_PCI_IO_PROTOCOL *
+NvmeModelCreate (
+  IN UINT32  BlockSize,
+  IN UINTN   Blocks
+  )
+{
+  UINTN  Index;
+
+  ASSERT (mNvmeModelConfig.ParallelUnits <= MODEL_MAX_UNITS);
+  NvmeModelFree ();
+
+  mModelBlockSize = BlockSize;
+  mModelBlocks    = Blocks;
+  mModelMedia     = AllocatePool (BlockSize * Blocks);
+  ASSERT (mModelMedia != NULL);
+  for (Index = 0; Index < BlockSize * Blocks; Index++) {
+    mModelMedia[Index] = (UINT8)(Index * 7 + Index / 4093);
+  }
+
+  ModelReset ();
+  ZeroMem (&mNvmeModelStatistics, sizeof (mNvmeModelStatistics));
+  ZeroMem (mModelEvents, sizeof (mModelEvents));
+  mModelNow  = 0;
+  mModelMaps = 0;
+  mModelCc   = 0;
+
+  ZeroMem (&mModelPciIo, sizeof (mModelPciIo));
+  mModelPciIo.Mem.Read       = ModelMemRead;
+  mModelPciIo.Mem.Write      = ModelMemWrite;
+  mModelPciIo.Map            = ModelMap;
+  mModelPciIo.Unmap          = ModelUnmap;
+  mModelPciIo.AllocateBuffer = ModelAllocateBuffer;
+  mModelPciIo.FreeBuffer     = ModelFreeBuffer;
+  mModelPciIo.Attributes     = ModelAttributes;
+
+  CopyMem (&mModelBootServices, gBS, sizeof (EFI_BOOT_SERVICES));
+  gBS->CreateEvent = ModelCreateEvent;
+  gBS->CloseEvent  = ModelCloseEvent;
+  gBS->SetTimer    = ModelSetTimer;
+  gBS->CheckEvent  = ModelCheckEvent;
+  gBS->SignalEvent = ModelSignalEvent;
+  gBS->Stall       = ModelStall;
+
+  return &mModelPciIo;
+}
+
+VOID
+NvmeModelFree (
+  VOID
+  )
+{
+  if (mModelMedia == NULL) {
+    return;
+  }
+
+  CopyMem (gBS, &mModelBootServices, sizeof (EFI_BOOT_SERVICES));
+  FreePool (mModelMedia);
+  mModelMedia = NULL;
+}
+
+UINT8 *
+NvmeModelMedia (
+  VOID
+  )
+{
+  return mModelMedia;
+}
+
+UINT64
+NvmeModelNow (
+  VOID
+  )
+{
+  return mModelNow;
+}
+
+UINTN
+NvmeModelMappedBuffers (
+  VOID
+  )
+{
+  return mModelMaps;
+}
+
+VOID *
+NvmeModelStartDriver (
+  IN UINT16  QueueDepth
+  )
+{
+  NVME_CONTROLLER_PRIVATE_DATA  *Private;
+  NVME_DEVICE_PRIVATE_DATA      *Device;
+  EFI_STATUS                    Status;
+
+  Private = AllocateZeroPool (sizeof (NVME_CONTROLLER_PRIVATE_DATA));
+  Device  = AllocateZeroPool (sizeof (NVME_DEVICE_PRIVATE_DATA));
+  ASSERT (Private != NULL && Device != NULL);
+
+  Private->Signature       = NVME_CONTROLLER_PRIVATE_DATA_SIGNATURE;
+  Private->PciIo           = &mModelPciIo;
+  Private->BlkIoQueueDepth = QueueDepth;
+  if (QueueDepth != 0) {
+    Private->BlkIoSlots = AllocateZeroPool (QueueDepth * sizeof (NVME_BLKIO_SLOT));
+  }
+
+  Private->BufferPages = NVME_BUFFER_PAGES (QueueDepth);
+  Status               = mModelPciIo.AllocateBuffer (&mModelPciIo, AllocateAnyPages, EfiBootServicesData, Private->BufferPages, (VOID **)&Private->Buffer, 0);
+  ASSERT_EFI_ERROR (Status);
+  Private->BufferPciAddr           = Private->Buffer;
+  Private->Passthru.Mode           = &Private->PassThruMode;
+  Private->Passthru.PassThru       = NvmExpressPassThru;
+  Private->PassThruMode.Attributes = EFI_NVM_EXPRESS_PASS_THRU_ATTRIBUTES_PHYSICAL |
+                                     EFI_NVM_EXPRESS_PASS_THRU_ATTRIBUTES_LOGICAL |
+                                     EFI_NVM_EXPRESS_PASS_THRU_ATTRIBUTES_NONBLOCKIO |
+                                     EFI_NVM_EXPRESS_PASS_THRU_ATTRIBUTES_CMD_SET_NVM;
+  Private->PassThruMode.IoAlign = sizeof (UINTN);
+  InitializeListHead (&Private->AsyncPassThruQueue);
+  InitializeListHead (&Private->UnsubmittedSubtasks);
+  gBS->CreateEvent (EVT_TIMER, TPL_NOTIFY, NULL, NULL, &Private->TimerEvent);
+
+  Status = NvmeControllerInit (Private);
+  if (EFI_ERROR (Status)) {
+    Device->Controller = Private;
+    NvmeModelStopDriver (Device);
+    return NULL;
+  }
+
+  Device->Signature          = NVME_DEVICE_PRIVATE_DATA_SIGNATURE;
+  Device->NamespaceId        = 1;
+  Device->Controller         = Private;
+  Device->Media.MediaPresent = TRUE;
+  Device->Media.BlockSize    = mModelBlockSize;
+  Device->Media.LastBlock    = mModelBlocks - 1;
+  Device->Media.IoAlign      = Private->PassThruMode.IoAlign;
+  Device->BlockIo.Media      = &Device->Media;
+  InitializeListHead (&Device->AsyncQueue);
+  return Device;
+}
+
+VOID
+NvmeModelStopDriver (
+  IN VOID  *Device
+  )
+{
+  NVME_CONTROLLER_PRIVATE_DATA  *Private;
+
+  Private = ((NVME_DEVICE_PRIVATE_DATA *)Device)->Controller;
+  gBS->CloseEvent (Private->TimerEvent);
+  mModelPciIo.FreeBuffer (&mModelPciIo, Private->BufferPages, Private->Buffer);
+  if (Private->BlkIoSlots != NULL) {
+    FreePool (Private->BlkIoSlots);
+  }
+
+  if (Private->ControllerData != NULL) {
+    FreePool (Private->ControllerData);
+  }
+
+  FreePool (Private);
+  FreePool (Device);
+}
+
+UINT16
+NvmeModelQueueSize (
+  IN VOID  *Device
+  )
+{
+  return ((NVME_DEVICE_PRIVATE_DATA *)Device)->Controller->BlkIoQueueSize;
+}
+
+EFI_STATUS
+NvmeModelTransfer (
+  IN     VOID     *Device,
+  IN     BOOLEAN  Write,
+  IN OUT VOID     *Buffer,
+  IN     UINT64   Lba,
+  IN     UINTN    Blocks
+  )
+{
+  if (Write) {
+    return NvmeWrite (Device, Buffer, Lba, Blocks);
+  }
+
+  return NvmeRead (Device, Buffer, Lba, Blocks);
+}
@@ -0,0 +1,152 @@
+/** @file
+  Interface of the software NVMe controller model to the host test of the
+  block I/O queue of NvmExpressDxe.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#ifndef NVM_EXPRESS_MODEL_H_
+#define NVM_EXPRESS_MODEL_H_
+
+//
+// The controller model. Times are in nanoseconds.
+//
+typedef struct {
+  UINT8      Mdts;            // MDTS reported by Identify Controller
+  UINT32     Sgls;            // SGLS reported by Identify Controller
+  UINT16     Mqes;            // CAP.MQES, 0-based
+  UINT16     IoQueuePairs;    // I/O queue pairs granted by Set Features
+  UINT32     ParallelUnits;   // Commands the media works on at once
+  UINT64     MediaLatency;    // Time the media takes for a command
+  UINT64     LinkBandwidth;   // Bytes per second of the link
+  UINT64     MmioWriteTime;   // Time the host takes for a register write
+  UINT64     FailLba;         // A command covering this block fails
+  BOOLEAN    Hang;            // The I/O commands never complete
+} NVME_MODEL_CONFIG;
+
+typedef struct {
+  UINT64    IoCommands;
+  UINT64    SglCommands;
+  UINT64    PrpListCommands;
+  UINT64    SqDoorbells;
+  UINT64    CqDoorbells;
+  UINT32    MaxInFlight;
+  UINT32    Resets;
+} NVME_MODEL_STATISTICS;
+
+extern NVME_MODEL_CONFIG      mNvmeModelConfig;
+extern NVME_MODEL_STATISTICS  mNvmeModelStatistics;
+
+/**
+  Set the model to its default configuration: a controller with a 128 KB
+  maximum data transfer size, SGL support, 8 parallel units of 80 us and a
+  3 GB/s link.
+
+**/
+VOID
+NvmeModelDefaultConfig (
+  VOID
+  );
+
+/**
+  Power on the controller model with a media of the given size, filled with a
+  pattern, reset the clock and the statistics, and take over the boot
+  services the driver waits for the controller with.
+
+  @param  BlockSize              The size of the blocks of the media.
+  @param  Blocks                 The number of blocks of the media.
+
+  @return The PCI I/O protocol of the controller.
+
+**/
+EFI_PCI_IO_PROTOCOL *
+NvmeModelCreate (
+  IN UINT32  BlockSize,
+  IN UINTN   Blocks
+  );
+
+/**
+  Free the media and give the boot services back.
+
+**/
+VOID
+NvmeModelFree (
+  VOID
+  );
+
+/**
+  Return the media of the controller model.
+
+**/
+UINT8 *
+NvmeModelMedia (
+  VOID
+  );
+
+/**
+  Return the time of the clock, in nanoseconds.
+
+**/
+UINT64
+NvmeModelNow (
+  VOID
+  );
+
+/**
+  Return the number of buffers mapped and not unmapped.
+
+**/
+UINTN
+NvmeModelMappedBuffers (
+  VOID
+  );
+
+/**
+  Start the driver on the controller model the way its driver binding does,
+  with the given depth of the block I/O queue, and build the device of
+  namespace 1.
+
+  @param  QueueDepth             The depth of the block I/O queue.
+
+  @return The device, or NULL if the controller fails to initialize.
+
+**/
+VOID *
+NvmeModelStartDriver (
+  IN UINT16  QueueDepth
+  );
+
+/**
+  Free the device and the controller data of the driver.
+
+**/
+VOID
+NvmeModelStopDriver (
+  IN VOID  *Device
+  );
+
+/**
+  Return the number of entries of the block I/O queue the driver uses, or 0
+  if it uses the single command path.
+
+**/
+UINT16
+NvmeModelQueueSize (
+  IN VOID  *Device
+  );
+
+/**
+  Read or write blocks through the driver.
+
+**/
+EFI_STATUS
+NvmeModelTransfer (
+  IN     VOID     *Device,
+  IN     BOOLEAN  Write,
+  IN OUT VOID     *Buffer,
+  IN     UINT64   Lba,
+  IN     UINTN    Blocks
+  );
+
+#endif
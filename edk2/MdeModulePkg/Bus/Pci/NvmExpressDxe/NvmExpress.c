@@ -1002,29 +1002,47 @@ NvmExpressDriverBindingStart (
     }
 
     //
-    // 6 x 4kB aligned buffers will be carved out of this buffer.
+    // Size the block I/O queue pair. A depth below the minimum leaves it out.
+    //
+    Private->BlkIoQueueDepth = (UINT16)MIN (PcdGet16 (PcdNvmeBlockIoQueueDepth), NVME_BLKIO_QUEUE_MAX_DEPTH);
+    if (Private->BlkIoQueueDepth < NVME_BLKIO_QUEUE_MIN_DEPTH) {
+      Private->BlkIoQueueDepth = 0;
+    }
+
+    if (Private->BlkIoQueueDepth != 0) {
+      Private->BlkIoSlots = AllocateZeroPool (Private->BlkIoQueueDepth * sizeof (NVME_BLKIO_SLOT));
+      if (Private->BlkIoSlots == NULL) {
+        Status = EFI_OUT_OF_RESOURCES;
+        goto Exit;
+      }
+    }
+
+    //
+    // BufferPages x 4kB aligned buffers will be carved out of this buffer.
     // 1st 4kB boundary is the start of the admin submission queue.
     // 2nd 4kB boundary is the start of the admin completion queue.
     // 3rd 4kB boundary is the start of I/O submission queue #1.
     // 4th 4kB boundary is the start of I/O completion queue #1.
     // 5th 4kB boundary is the start of I/O submission queue #2.
     // 6th 4kB boundary is the start of I/O completion queue #2.
+    // The block I/O submission queue, completion queue and PRP lists follow.
     //
-    // Allocate 6 pages of memory, then map it for bus master read and write.
+    // Allocate the pages, then map them for bus master read and write.
     //
-    Status = PciIo->AllocateBuffer (
-                      PciIo,
-                      AllocateAnyPages,
-                      EfiBootServicesData,
-                      6,
-                      (VOID **)&Private->Buffer,
-                      0
-                      );
+    Private->BufferPages = NVME_BUFFER_PAGES (Private->BlkIoQueueDepth);
+    Status               = PciIo->AllocateBuffer (
+                                    PciIo,
+                                    AllocateAnyPages,
+                                    EfiBootServicesData,
+                                    Private->BufferPages,
+                                    (VOID **)&Private->Buffer,
+                                    0
+                                    );
     if (EFI_ERROR (Status)) {
       goto Exit;
     }
 
-    Bytes  = EFI_PAGES_TO_SIZE (6);
+    Bytes  = EFI_PAGES_TO_SIZE (Private->BufferPages);
     Status = PciIo->Map (
                       PciIo,
                       EfiPciIoOperationBusMasterCommonBuffer,
@@ -1034,7 +1052,7 @@ NvmExpressDriverBindingStart (
                       &Private->Mapping
                       );
 
-    if (EFI_ERROR (Status) || (Bytes != EFI_PAGES_TO_SIZE (6))) {
+    if (EFI_ERROR (Status) || (Bytes != EFI_PAGES_TO_SIZE (Private->BufferPages))) {
       goto Exit;
     }
 
@@ -1144,7 +1162,11 @@ Exit:
   }
 
   if ((Private != NULL) && (Private->Buffer != NULL)) {
-    PciIo->FreeBuffer (PciIo, 6, Private->Buffer);
+    PciIo->FreeBuffer (PciIo, Private->BufferPages, Private->Buffer);
+  }
+
+  if ((Private != NULL) && (Private->BlkIoSlots != NULL)) {
+    FreePool (Private->BlkIoSlots);
   }
 
   if ((Private != NULL) && (Private->ControllerData != NULL)) {
@@ -1266,7 +1288,11 @@ NvmExpressDriverBindingStop (
       }
 
       if (Private->Buffer != NULL) {
-        Private->PciIo->FreeBuffer (Private->PciIo, 6, Private->Buffer);
+        Private->PciIo->FreeBuffer (Private->PciIo, Private->BufferPages, Private->Buffer);
+      }
+
+      if (Private->BlkIoSlots != NULL) {
+        FreePool (Private->BlkIoSlots);
       }
 
       FreePool (Private->ControllerData);
@@ -40,6 +40,7 @@
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiDriverEntryPoint.h>
 #include <Library/ReportStatusCodeLib.h>
+#include <Library/PcdLib.h>
 
 typedef struct _NVME_CONTROLLER_PRIVATE_DATA  NVME_CONTROLLER_PRIVATE_DATA;
 typedef struct _NVME_DEVICE_PRIVATE_DATA      NVME_DEVICE_PRIVATE_DATA;
@@ -73,7 +74,31 @@ extern EFI_DRIVER_SUPPORTED_EFI_VERSION_PROTOCOL  gNvmExpressDriverSupportedEfiV
 //
 #define NVME_ASYNC_CCQ_SIZE  255
 
-#define NVME_MAX_QUEUES  3                              // Number of queues supported by the driver
+//
+// The I/O queue pair that carries the block I/O reads and writes. Its number
+// of entries comes from PcdNvmeBlockIoQueueDepth, within the bounds below.
+//
+#define NVME_BLKIO_QUEUE            3
+#define NVME_BLKIO_QUEUE_MIN_DEPTH  2
+#define NVME_BLKIO_QUEUE_MAX_DEPTH  256
+
+//
+// Largest transfer of a command on the block I/O queue. Its PRP list then fits
+// in the one page each command slot owns.
+//
+#define NVME_BLKIO_MAX_TRANSFER_SIZE  SIZE_2MB
+
+#define NVME_MAX_QUEUES  4                              // Number of queues supported by the driver
+
+//
+// Number of pages of the queue buffer for a block I/O queue of the given depth:
+// the admin queue pair and the first two I/O queue pairs take one page each,
+// then come the block I/O submission and completion queues and one PRP list
+// page for each of its command slots.
+//
+#define NVME_BUFFER_PAGES(Depth)                    \
+  (6 + EFI_SIZE_TO_PAGES ((Depth) * sizeof (NVME_SQ)) + \
+   EFI_SIZE_TO_PAGES ((Depth) * sizeof (NVME_CQ)) + (Depth))
 
 #define NVME_CONTROLLER_ID  0
 
@@ -92,6 +117,15 @@ extern EFI_DRIVER_SUPPORTED_EFI_VERSION_PROTOCOL  gNvmExpressDriverSupportedEfiV
 //
 #define NVME_CONTROLLER_PRIVATE_DATA_SIGNATURE  SIGNATURE_32 ('N','V','M','E')
 
+//
+// A command slot of the block I/O queue. The slot index is the command
+// identifier of the command that holds it.
+//
+typedef struct {
+  BOOLEAN    Busy;
+  VOID       *MapData;
+} NVME_BLKIO_SLOT;
+
 //
 // Nvme private data structure.
 //
@@ -116,16 +150,18 @@ struct _NVME_CONTROLLER_PRIVATE_DATA {
   NVME_ADMIN_CONTROLLER_DATA            *ControllerData;
 
   //
-  // 6 x 4kB aligned buffers will be carved out of this buffer.
+  // BufferPages x 4kB aligned buffers will be carved out of this buffer.
   // 1st 4kB boundary is the start of the admin submission queue.
   // 2nd 4kB boundary is the start of the admin completion queue.
   // 3rd 4kB boundary is the start of I/O submission queue #1.
   // 4th 4kB boundary is the start of I/O completion queue #1.
   // 5th 4kB boundary is the start of I/O submission queue #2.
   // 6th 4kB boundary is the start of I/O completion queue #2.
+  // The block I/O submission queue, completion queue and PRP lists follow.
   //
   UINT8          *Buffer;
   UINT8          *BufferPciAddr;
+  UINTN          BufferPages;
 
   //
   // Pointers to 4kB aligned submission & completion queues.
@@ -150,6 +186,18 @@ struct _NVME_CONTROLLER_PRIVATE_DATA {
   UINT8          Pt[NVME_MAX_QUEUES];
   UINT16         Cid[NVME_MAX_QUEUES];
 
+  //
+  // The block I/O queue pair. BlkIoQueueDepth is the number of entries the
+  // buffer holds, BlkIoQueueSize the number in use, or 0 if the controller
+  // did not grant the queue pair and the reads and writes go through the
+  // blocking I/O queue one command at a time.
+  //
+  UINT16            BlkIoQueueDepth;
+  UINT16            BlkIoQueueSize;
+  NVME_BLKIO_SLOT   *BlkIoSlots;
+  UINT64            *BlkIoPrpList;
+  UINT64            BlkIoPrpListPciAddr;
+
   //
   // Nvme controller capabilities
   //
@@ -710,6 +758,24 @@ NvmExpressBuildDevicePath (
   IN OUT EFI_DEVICE_PATH_PROTOCOL            **DevicePath
   );
 
+/**
+  Reset the controller after a command timed out, which aborts the commands
+  outstanding on all the queues, and abort the asynchronous PassThru requests.
+
+  @param[in] Private        The pointer to the NVME_CONTROLLER_PRIVATE_DATA
+                            data structure.
+
+  @retval EFI_TIMEOUT       The controller has been reset, and the timed out
+                            command is to be reported with this status.
+  @retval EFI_DEVICE_ERROR  Fail to reset the controller.
+  @retval Others            Fail to abort the asynchronous PassThru requests.
+
+**/
+EFI_STATUS
+NvmeResetAfterTimeout (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  );
+
 /**
   Dump the execution status from a given completion queue entry.
 
@@ -141,6 +141,331 @@ WriteSectors (
   return Status;
 }
 
+/**
+  Map the data buffer of a command of the block I/O queue, and describe it in
+  the command. Where the controller supports SGLs for the buffer, a single SGL
+  data block descriptor covers it. Otherwise it is described by PRP entries,
+  using the PRP list page of the command slot when it spans more than two
+  pages.
+
+  @param  Private                The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
+  @param  Sq                     The command, whose identifier is its slot.
+  @param  Flag                   The bus master operation of the command.
+  @param  Buffer                 The data buffer.
+  @param  Bytes                  The size of the data buffer, at most NVME_BLKIO_MAX_TRANSFER_SIZE.
+
+  @retval EFI_SUCCESS            The buffer is mapped and described in the command.
+  @retval EFI_OUT_OF_RESOURCES   The buffer could not be mapped.
+
+**/
+EFI_STATUS
+NvmeBlockIoMapData (
+  IN     NVME_CONTROLLER_PRIVATE_DATA   *Private,
+  IN OUT NVME_SQ                        *Sq,
+  IN     EFI_PCI_IO_PROTOCOL_OPERATION  Flag,
+  IN     VOID                           *Buffer,
+  IN     UINT32                         Bytes
+  )
+{
+  EFI_PCI_IO_PROTOCOL   *PciIo;
+  NVME_BLKIO_SLOT       *Slot;
+  EFI_PHYSICAL_ADDRESS  PhyAddr;
+  UINTN                 MapLength;
+  UINT64                *PrpList;
+  UINTN                 Pages;
+  UINTN                 Index;
+  UINT32                Sgls;
+  EFI_STATUS            Status;
+
+  ASSERT (Bytes <= NVME_BLKIO_MAX_TRANSFER_SIZE);
+
+  PciIo     = Private->PciIo;
+  Slot      = &Private->BlkIoSlots[Sq->Cid];
+  MapLength = Bytes;
+  Status    = PciIo->Map (
+                       PciIo,
+                       Flag,
+                       Buffer,
+                       &MapLength,
+                       &PhyAddr,
+                       &Slot->MapData
+                       );
+  if (EFI_ERROR (Status) || (MapLength != Bytes)) {
+    if (!EFI_ERROR (Status)) {
+      PciIo->Unmap (PciIo, Slot->MapData);
+    }
+
+    Slot->MapData = NULL;
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // SGLS is 01b if the controller supports SGLs, and 10b if it supports them
+  // for dword aligned data blocks only.
+  //
+  Sgls = Private->ControllerData->Sgls & (BIT0 | BIT1);
+  if ((Sgls == BIT0) || ((Sgls == BIT1) && ((PhyAddr & (BIT0 | BIT1)) == 0))) {
+    //
+    // SGL Data Block descriptor: address, length, and the descriptor type in
+    // the last byte, which is 0.
+    //
+    Sq->Psdt   = 1;
+    Sq->Prp[0] = PhyAddr;
+    Sq->Prp[1] = Bytes;
+    return EFI_SUCCESS;
+  }
+
+  Sq->Prp[0] = PhyAddr;
+  Pages      = EFI_SIZE_TO_PAGES (((UINTN)PhyAddr & (EFI_PAGE_SIZE - 1)) + Bytes);
+  PhyAddr   &= ~(EFI_PHYSICAL_ADDRESS)(EFI_PAGE_SIZE - 1);
+  if (Pages == 2) {
+    Sq->Prp[1] = PhyAddr + EFI_PAGE_SIZE;
+  } else if (Pages > 2) {
+    ASSERT (Pages - 1 <= EFI_PAGE_SIZE / sizeof (UINT64));
+    PrpList = Private->BlkIoPrpList + Sq->Cid * (EFI_PAGE_SIZE / sizeof (UINT64));
+    for (Index = 1; Index < Pages; Index++) {
+      PrpList[Index - 1] = PhyAddr + Index * EFI_PAGE_SIZE;
+    }
+
+    Sq->Prp[1] = Private->BlkIoPrpListPciAddr + Sq->Cid * EFI_PAGE_SIZE;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Read or write blocks through the block I/O queue.
+
+  The request is split in commands of at most the maximum data transfer size,
+  and the queue is kept filled with them. The submission queue doorbell is
+  rung once for all the commands placed since the last ring, and the
+  completion queue doorbell once for all the completions reaped together.
+
+  @param  Device                 The pointer to the NVME_DEVICE_PRIVATE_DATA data structure.
+  @param  Opcode                 NVME_IO_READ_OPC or NVME_IO_WRITE_OPC.
+  @param  Buffer                 The buffer to read the blocks into, or to write them from.
+  @param  Lba                    The start block number.
+  @param  Blocks                 Total block number to be transferred.
+
+  @retval EFI_SUCCESS            All the blocks are transferred.
+  @retval EFI_DEVICE_ERROR       A command failed. No more commands are sent, and the
+                                 ones in flight are completed before returning.
+  @retval EFI_TIMEOUT            No command completed in NVME_GENERIC_TIMEOUT, and the
+                                 controller has been reset.
+  @retval Others                 Fail to transfer all the blocks.
+
+**/
+EFI_STATUS
+NvmeBlockIoQueueTransfer (
+  IN NVME_DEVICE_PRIVATE_DATA  *Device,
+  IN UINT8                     Opcode,
+  IN UINT8                     *Buffer,
+  IN UINT64                    Lba,
+  IN UINTN                     Blocks
+  )
+{
+  NVME_CONTROLLER_PRIVATE_DATA   *Private;
+  EFI_PCI_IO_PROTOCOL            *PciIo;
+  EFI_PCI_IO_PROTOCOL_OPERATION  Flag;
+  NVME_BLKIO_SLOT                *Slots;
+  NVME_SQ                        *Sq;
+  volatile NVME_CQ               *Cq;
+  EFI_EVENT                      TimerEvent;
+  EFI_STATUS                     Status;
+  EFI_STATUS                     IoStatus;
+  UINT32                         BlockSize;
+  UINT32                         MaxTransferBlocks;
+  UINT32                         Count;
+  UINT32                         Data;
+  UINT16                         QueueSize;
+  UINT16                         Cid;
+  UINT16                         NextCid;
+  UINTN                          Outstanding;
+  UINTN                          Submitted;
+  UINTN                          Reaped;
+  UINTN                          Shift;
+
+  Private   = Device->Controller;
+  PciIo     = Private->PciIo;
+  Slots     = Private->BlkIoSlots;
+  BlockSize = Device->Media.BlockSize;
+  QueueSize = Private->BlkIoQueueSize;
+
+  MaxTransferBlocks = NVME_BLKIO_MAX_TRANSFER_SIZE / BlockSize;
+  Shift             = Private->ControllerData->Mdts + Private->Cap.Mpsmin + 12;
+  if ((Private->ControllerData->Mdts != 0) && (LShiftU64 (1, Shift) < NVME_BLKIO_MAX_TRANSFER_SIZE)) {
+    MaxTransferBlocks = ((UINT32)1 << Shift) / BlockSize;
+  }
+
+  if (Opcode == NVME_IO_READ_OPC) {
+    Flag = EfiPciIoOperationBusMasterWrite;
+  } else {
+    Flag = EfiPciIoOperationBusMasterRead;
+  }
+
+  Status = gBS->CreateEvent (
+                  EVT_TIMER,
+                  TPL_CALLBACK,
+                  NULL,
+                  NULL,
+                  &TimerEvent
+                  );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = gBS->SetTimer (TimerEvent, TimerRelative, NVME_GENERIC_TIMEOUT);
+  if (EFI_ERROR (Status)) {
+    gBS->CloseEvent (TimerEvent);
+    return Status;
+  }
+
+  IoStatus    = EFI_SUCCESS;
+  Outstanding = 0;
+  NextCid     = 0;
+  while ((Outstanding != 0) || ((Blocks != 0) && !EFI_ERROR (IoStatus))) {
+    //
+    // Fill the submission queue. One entry stays free, so that the queue never
+    // looks empty to the controller when it is full.
+    //
+    Submitted = 0;
+    while ((Blocks != 0) && !EFI_ERROR (IoStatus) && (Outstanding < QueueSize - 1U)) {
+      while (Slots[NextCid].Busy) {
+        NextCid = (NextCid + 1) % QueueSize;
+      }
+
+      Cid     = NextCid;
+      NextCid = (NextCid + 1) % QueueSize;
+      Count   = (UINT32)MIN (Blocks, MaxTransferBlocks);
+
+      Sq = Private->SqBuffer[NVME_BLKIO_QUEUE] + Private->SqTdbl[NVME_BLKIO_QUEUE].Sqt;
+      ZeroMem (Sq, sizeof (NVME_SQ));
+      Sq->Opc               = Opcode;
+      Sq->Cid               = Cid;
+      Sq->Nsid              = Device->NamespaceId;
+      Sq->Payload.Raw.Cdw10 = (UINT32)Lba;
+      Sq->Payload.Raw.Cdw11 = (UINT32)RShiftU64 (Lba, 32);
+      Sq->Payload.Raw.Cdw12 = (Count - 1) & 0xFFFF;
+      if (Opcode == NVME_IO_WRITE_OPC) {
+        //
+        // Set Force Unit Access bit (bit 30) to use write-through behaviour
+        //
+        Sq->Payload.Raw.Cdw12 |= BIT30;
+      }
+
+      IoStatus = NvmeBlockIoMapData (Private, Sq, Flag, Buffer, Count * BlockSize);
+      if (EFI_ERROR (IoStatus)) {
+        break;
+      }
+
+      Slots[Cid].Busy                       = TRUE;
+      Private->SqTdbl[NVME_BLKIO_QUEUE].Sqt = (Private->SqTdbl[NVME_BLKIO_QUEUE].Sqt + 1) % QueueSize;
+      Outstanding++;
+      Submitted++;
+
+      Buffer += Count * BlockSize;
+      Lba    += Count;
+      Blocks -= Count;
+    }
+
+    //
+    // Ring the submission queue doorbell.
+    //
+    if (Submitted != 0) {
+      Data   = ReadUnaligned32 ((UINT32 *)&Private->SqTdbl[NVME_BLKIO_QUEUE]);
+      Status = PciIo->Mem.Write (
+                            PciIo,
+                            EfiPciIoWidthUint32,
+                            NVME_BAR,
+                            NVME_SQTDBL_OFFSET (NVME_BLKIO_QUEUE, Private->Cap.Dstrd),
+                            1,
+                            &Data
+                            );
+      if (EFI_ERROR (Status)) {
+        IoStatus = Status;
+      }
+    }
+
+    //
+    // Reap the completions posted so far.
+    //
+    Reaped = 0;
+    while (Outstanding != 0) {
+      Cq = Private->CqBuffer[NVME_BLKIO_QUEUE] + Private->CqHdbl[NVME_BLKIO_QUEUE].Cqh;
+      if (Cq->Pt == Private->Pt[NVME_BLKIO_QUEUE]) {
+        break;
+      }
+
+      Cid = Cq->Cid;
+      if ((Cid >= QueueSize) || !Slots[Cid].Busy) {
+        DEBUG ((DEBUG_ERROR, "%a: unexpected completion of command 0x%x\n", __func__, Cid));
+        IoStatus = EFI_DEVICE_ERROR;
+      } else {
+        if ((Cq->Sct != 0) || (Cq->Sc != 0)) {
+          IoStatus = EFI_DEVICE_ERROR;
+          //
+          // Dump completion entry status for debugging.
+          //
+          DEBUG_CODE_BEGIN ();
+          NvmeDumpStatus ((NVME_CQ *)Cq);
+          DEBUG_CODE_END ();
+        }
+
+        PciIo->Unmap (PciIo, Slots[Cid].MapData);
+        Slots[Cid].MapData = NULL;
+        Slots[Cid].Busy    = FALSE;
+        Outstanding--;
+      }
+
+      if (++Private->CqHdbl[NVME_BLKIO_QUEUE].Cqh == QueueSize) {
+        Private->CqHdbl[NVME_BLKIO_QUEUE].Cqh = 0;
+        Private->Pt[NVME_BLKIO_QUEUE]        ^= 1;
+      }
+
+      Reaped++;
+    }
+
+    if (Reaped != 0) {
+      Data   = ReadUnaligned32 ((UINT32 *)&Private->CqHdbl[NVME_BLKIO_QUEUE]);
+      Status = PciIo->Mem.Write (
+                            PciIo,
+                            EfiPciIoWidthUint32,
+                            NVME_BAR,
+                            NVME_CQHDBL_OFFSET (NVME_BLKIO_QUEUE, Private->Cap.Dstrd),
+                            1,
+                            &Data
+                            );
+      if (EFI_ERROR (Status)) {
+        IoStatus = Status;
+      }
+
+      //
+      // The timeout runs from the last completion.
+      //
+      gBS->SetTimer (TimerEvent, TimerRelative, NVME_GENERIC_TIMEOUT);
+    } else if ((Outstanding != 0) && !EFI_ERROR (gBS->CheckEvent (TimerEvent))) {
+      //
+      // Timeout occurs for the NVMe commands in flight. Reset the controller
+      // to abort them, then release their slots.
+      //
+      DEBUG ((DEBUG_ERROR, "%a: Timeout occurs for %d NVMe commands.\n", __func__, Outstanding));
+      IoStatus = NvmeResetAfterTimeout (Private);
+      for (Cid = 0; Cid < QueueSize; Cid++) {
+        if (Slots[Cid].Busy) {
+          PciIo->Unmap (PciIo, Slots[Cid].MapData);
+          Slots[Cid].MapData = NULL;
+          Slots[Cid].Busy    = FALSE;
+        }
+      }
+
+      break;
+    }
+  }
+
+  gBS->CloseEvent (TimerEvent);
+  return IoStatus;
+}
+
 /**
   Read some blocks from the device.
 
@@ -189,26 +514,37 @@ NvmeRead (
   BlockSize     = Device->Media.BlockSize;
   OrginalBlocks = Blocks;
 
-  if (Private->ControllerData->Mdts != 0) {
-    MaxTransferBlocks = (1 << (Private->ControllerData->Mdts)) * (1 << (Private->Cap.Mpsmin + 12)) / BlockSize;
+  //
+  // Keep the commands in flight on the block I/O queue if the controller
+  // granted it, or send them one by one on the synchronous I/O queue.
+  //
+  if (Private->BlkIoQueueSize != 0) {
+    Status = NvmeBlockIoQueueTransfer (Device, NVME_IO_READ_OPC, Buffer, Lba, Blocks);
+    if (!EFI_ERROR (Status)) {
+      Blocks = 0;
+    }
   } else {
-    MaxTransferBlocks = 1024;
-  }
-
-  while (Blocks > 0) {
-    if (Blocks > MaxTransferBlocks) {
-      Status = ReadSectors (Device, (UINT64)(UINTN)Buffer, Lba, MaxTransferBlocks);
-
-      Blocks -= MaxTransferBlocks;
-      Buffer  = (VOID *)(UINTN)((UINT64)(UINTN)Buffer + MaxTransferBlocks * BlockSize);
-      Lba    += MaxTransferBlocks;
+    if (Private->ControllerData->Mdts != 0) {
+      MaxTransferBlocks = (1 << (Private->ControllerData->Mdts)) * (1 << (Private->Cap.Mpsmin + 12)) / BlockSize;
     } else {
-      Status = ReadSectors (Device, (UINT64)(UINTN)Buffer, Lba, (UINT32)Blocks);
-      Blocks = 0;
+      MaxTransferBlocks = 1024;
     }
 
-    if (EFI_ERROR (Status)) {
-      break;
+    while (Blocks > 0) {
+      if (Blocks > MaxTransferBlocks) {
+        Status = ReadSectors (Device, (UINT64)(UINTN)Buffer, Lba, MaxTransferBlocks);
+
+        Blocks -= MaxTransferBlocks;
+        Buffer  = (VOID *)(UINTN)((UINT64)(UINTN)Buffer + MaxTransferBlocks * BlockSize);
+        Lba    += MaxTransferBlocks;
+      } else {
+        Status = ReadSectors (Device, (UINT64)(UINTN)Buffer, Lba, (UINT32)Blocks);
+        Blocks = 0;
+      }
+
+      if (EFI_ERROR (Status)) {
+        break;
+      }
     }
   }
 
@@ -275,26 +611,33 @@ NvmeWrite (
   BlockSize     = Device->Media.BlockSize;
   OrginalBlocks = Blocks;
 
-  if (Private->ControllerData->Mdts != 0) {
-    MaxTransferBlocks = (1 << (Private->ControllerData->Mdts)) * (1 << (Private->Cap.Mpsmin + 12)) / BlockSize;
+  if (Private->BlkIoQueueSize != 0) {
+    Status = NvmeBlockIoQueueTransfer (Device, NVME_IO_WRITE_OPC, Buffer, Lba, Blocks);
+    if (!EFI_ERROR (Status)) {
+      Blocks = 0;
+    }
   } else {
-    MaxTransferBlocks = 1024;
-  }
-
-  while (Blocks > 0) {
-    if (Blocks > MaxTransferBlocks) {
-      Status = WriteSectors (Device, (UINT64)(UINTN)Buffer, Lba, MaxTransferBlocks);
-
-      Blocks -= MaxTransferBlocks;
-      Buffer  = (VOID *)(UINTN)((UINT64)(UINTN)Buffer + MaxTransferBlocks * BlockSize);
-      Lba    += MaxTransferBlocks;
+    if (Private->ControllerData->Mdts != 0) {
+      MaxTransferBlocks = (1 << (Private->ControllerData->Mdts)) * (1 << (Private->Cap.Mpsmin + 12)) / BlockSize;
     } else {
-      Status = WriteSectors (Device, (UINT64)(UINTN)Buffer, Lba, (UINT32)Blocks);
-      Blocks = 0;
+      MaxTransferBlocks = 1024;
     }
 
-    if (EFI_ERROR (Status)) {
-      break;
+    while (Blocks > 0) {
+      if (Blocks > MaxTransferBlocks) {
+        Status = WriteSectors (Device, (UINT64)(UINTN)Buffer, Lba, MaxTransferBlocks);
+
+        Blocks -= MaxTransferBlocks;
+        Buffer  = (VOID *)(UINTN)((UINT64)(UINTN)Buffer + MaxTransferBlocks * BlockSize);
+        Lba    += MaxTransferBlocks;
+      } else {
+        Status = WriteSectors (Device, (UINT64)(UINTN)Buffer, Lba, (UINT32)Blocks);
+        Blocks = 0;
+      }
+
+      if (EFI_ERROR (Status)) {
+        break;
+      }
     }
   }
 
@@ -558,6 +558,67 @@ NvmeIdentifyNamespace (
   return Status;
 }
 
+/**
+  Request from the controller the I/O queues the driver creates. If it grants
+  fewer, the block I/O queue pair is not created.
+
+  @param  Private          The pointer to the NVME_CONTROLLER_PRIVATE_DATA data structure.
+
+  @return EFI_SUCCESS      Successfully set the number of queues.
+  @return Others           The controller failed the Set Features command.
+
+**/
+EFI_STATUS
+NvmeSetNumberOfQueues (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  )
+{
+  EFI_NVM_EXPRESS_PASS_THRU_COMMAND_PACKET  CommandPacket;
+  EFI_NVM_EXPRESS_COMMAND                   Command;
+  EFI_NVM_EXPRESS_COMPLETION                Completion;
+  EFI_STATUS                                Status;
+  NVME_ADMIN_SET_FEATURES                   SetFeatures;
+  UINT32                                    Granted;
+
+  ZeroMem (&CommandPacket, sizeof (EFI_NVM_EXPRESS_PASS_THRU_COMMAND_PACKET));
+  ZeroMem (&Command, sizeof (EFI_NVM_EXPRESS_COMMAND));
+  ZeroMem (&Completion, sizeof (EFI_NVM_EXPRESS_COMPLETION));
+  ZeroMem (&SetFeatures, sizeof (NVME_ADMIN_SET_FEATURES));
+
+  CommandPacket.NvmeCmd        = &Command;
+  CommandPacket.NvmeCompletion = &Completion;
+
+  Command.Cdw0.Opcode          = NVME_ADMIN_SET_FEATURES_CMD;
+  CommandPacket.CommandTimeout = NVME_GENERIC_TIMEOUT;
+  CommandPacket.QueueType      = NVME_ADMIN_QUEUE;
+
+  //
+  // The numbers of submission and completion queues requested are 0-based.
+  //
+  SetFeatures.Fid = NVME_FEATURE_NUMBER_OF_QUEUES;
+  CopyMem (&CommandPacket.NvmeCmd->Cdw10, &SetFeatures, sizeof (NVME_ADMIN_SET_FEATURES));
+  CommandPacket.NvmeCmd->Cdw11 = (NVME_MAX_QUEUES - 2) | ((NVME_MAX_QUEUES - 2) << 16);
+  CommandPacket.NvmeCmd->Flags = CDW10_VALID | CDW11_VALID;
+
+  Status = Private->Passthru.PassThru (
+                               &Private->Passthru,
+                               0,
+                               &CommandPacket,
+                               NULL
+                               );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Granted = MIN (Completion.DW0 & 0xFFFF, Completion.DW0 >> 16) + 1;
+  DEBUG ((DEBUG_INFO, "NvmeSetNumberOfQueues: %d I/O queue pairs granted\n", Granted));
+  if (Granted < NVME_MAX_QUEUES - 1) {
+    Private->BlkIoQueueSize = 0;
+  }
+
+  return EFI_SUCCESS;
+}
+
 /**
   Create io completion queue.
 
@@ -600,6 +661,12 @@ NvmeCreateIoCompletionQueue (
 
     if (Index == 1) {
       QueueSize = NVME_CCQ_SIZE;
+    } else if (Index == NVME_BLKIO_QUEUE) {
+      if (Private->BlkIoQueueSize == 0) {
+        continue;
+      }
+
+      QueueSize = Private->BlkIoQueueSize - 1;
     } else {
       if (Private->Cap.Mqes > NVME_ASYNC_CCQ_SIZE) {
         QueueSize = NVME_ASYNC_CCQ_SIZE;
@@ -672,6 +739,12 @@ NvmeCreateIoSubmissionQueue (
 
     if (Index == 1) {
       QueueSize = NVME_CSQ_SIZE;
+    } else if (Index == NVME_BLKIO_QUEUE) {
+      if (Private->BlkIoQueueSize == 0) {
+        continue;
+      }
+
+      QueueSize = Private->BlkIoQueueSize - 1;
     } else {
       if (Private->Cap.Mqes > NVME_ASYNC_CSQ_SIZE) {
         QueueSize = NVME_ASYNC_CSQ_SIZE;
@@ -726,6 +799,8 @@ NvmeControllerInit (
   NVME_ACQ             Acq;
   UINT8                Sn[21];
   UINT8                Mn[41];
+  UINTN                Index;
+  UINTN                Offset;
 
   //
   // Enable this controller.
@@ -771,19 +846,22 @@ NvmeControllerInit (
   //
   ASSERT ((Private->Cap.Mpsmin + 12) <= EFI_PAGE_SHIFT);
 
-  Private->Cid[0]        = 0;
-  Private->Cid[1]        = 0;
-  Private->Cid[2]        = 0;
-  Private->Pt[0]         = 0;
-  Private->Pt[1]         = 0;
-  Private->Pt[2]         = 0;
-  Private->SqTdbl[0].Sqt = 0;
-  Private->SqTdbl[1].Sqt = 0;
-  Private->SqTdbl[2].Sqt = 0;
-  Private->CqHdbl[0].Cqh = 0;
-  Private->CqHdbl[1].Cqh = 0;
-  Private->CqHdbl[2].Cqh = 0;
-  Private->AsyncSqHead   = 0;
+  for (Index = 0; Index < NVME_MAX_QUEUES; Index++) {
+    Private->Cid[Index]        = 0;
+    Private->Pt[Index]         = 0;
+    Private->SqTdbl[Index].Sqt = 0;
+    Private->CqHdbl[Index].Cqh = 0;
+  }
+
+  Private->AsyncSqHead = 0;
+
+  //
+  // The block I/O queue takes as many of its entries as the controller supports.
+  //
+  Private->BlkIoQueueSize = (UINT16)MIN (Private->BlkIoQueueDepth, (UINT32)Private->Cap.Mqes + 1);
+  if (Private->BlkIoQueueSize < NVME_BLKIO_QUEUE_MIN_DEPTH) {
+    Private->BlkIoQueueSize = 0;
+  }
 
   Status = NvmeDisableController (Private);
 
@@ -812,7 +890,7 @@ NvmeControllerInit (
   //
   // Address of I/O submission & completion queue.
   //
-  ZeroMem (Private->Buffer, EFI_PAGES_TO_SIZE (6));
+  ZeroMem (Private->Buffer, EFI_PAGES_TO_SIZE (Private->BufferPages));
   Private->SqBuffer[0]        = (NVME_SQ *)(UINTN)(Private->Buffer);
   Private->SqBufferPciAddr[0] = (NVME_SQ *)(UINTN)(Private->BufferPciAddr);
   Private->CqBuffer[0]        = (NVME_CQ *)(UINTN)(Private->Buffer + 1 * EFI_PAGE_SIZE);
@@ -826,6 +904,16 @@ NvmeControllerInit (
   Private->CqBuffer[2]        = (NVME_CQ *)(UINTN)(Private->Buffer + 5 * EFI_PAGE_SIZE);
   Private->CqBufferPciAddr[2] = (NVME_CQ *)(UINTN)(Private->BufferPciAddr + 5 * EFI_PAGE_SIZE);
 
+  Offset                                     = 6 * EFI_PAGE_SIZE;
+  Private->SqBuffer[NVME_BLKIO_QUEUE]        = (NVME_SQ *)(UINTN)(Private->Buffer + Offset);
+  Private->SqBufferPciAddr[NVME_BLKIO_QUEUE] = (NVME_SQ *)(UINTN)(Private->BufferPciAddr + Offset);
+  Offset                                    += EFI_PAGES_TO_SIZE (EFI_SIZE_TO_PAGES (Private->BlkIoQueueDepth * sizeof (NVME_SQ)));
+  Private->CqBuffer[NVME_BLKIO_QUEUE]        = (NVME_CQ *)(UINTN)(Private->Buffer + Offset);
+  Private->CqBufferPciAddr[NVME_BLKIO_QUEUE] = (NVME_CQ *)(UINTN)(Private->BufferPciAddr + Offset);
+  Offset                                    += EFI_PAGES_TO_SIZE (EFI_SIZE_TO_PAGES (Private->BlkIoQueueDepth * sizeof (NVME_CQ)));
+  Private->BlkIoPrpList                      = (UINT64 *)(UINTN)(Private->Buffer + Offset);
+  Private->BlkIoPrpListPciAddr               = (UINT64)(UINTN)(Private->BufferPciAddr + Offset);
+
   DEBUG ((DEBUG_INFO, "Private->Buffer = [%016X]\n", (UINT64)(UINTN)Private->Buffer));
   DEBUG ((DEBUG_INFO, "Admin     Submission Queue size (Aqa.Asqs) = [%08X]\n", Aqa.Asqs));
   DEBUG ((DEBUG_INFO, "Admin     Completion Queue size (Aqa.Acqs) = [%08X]\n", Aqa.Acqs));
@@ -835,6 +923,8 @@ NvmeControllerInit (
   DEBUG ((DEBUG_INFO, "Sync  I/O Completion Queue (CqBuffer[1]) = [%016X]\n", Private->CqBuffer[1]));
   DEBUG ((DEBUG_INFO, "Async I/O Submission Queue (SqBuffer[2]) = [%016X]\n", Private->SqBuffer[2]));
   DEBUG ((DEBUG_INFO, "Async I/O Completion Queue (CqBuffer[2]) = [%016X]\n", Private->CqBuffer[2]));
+  DEBUG ((DEBUG_INFO, "BlkIo I/O Submission Queue (SqBuffer[3]) = [%016X]\n", Private->SqBuffer[3]));
+  DEBUG ((DEBUG_INFO, "BlkIo I/O Completion Queue (CqBuffer[3]) = [%016X]\n", Private->CqBuffer[3]));
 
   //
   // Program admin queue attributes.
@@ -913,8 +1003,24 @@ NvmeControllerInit (
   DEBUG ((DEBUG_INFO, "    NN        : 0x%x\n", Private->ControllerData->Nn));
 
   //
-  // Create two I/O completion queues.
-  // One for blocking I/O, one for non-blocking I/O.
+  // Ask for the block I/O queue pair, in addition to the blocking and
+  // non-blocking ones. Without it, the reads and writes of the block I/O
+  // protocols go through the blocking I/O queue.
+  //
+  if (Private->BlkIoQueueSize != 0) {
+    Status = NvmeSetNumberOfQueues (Private);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "NvmeControllerInit: failed to set the number of queues (%r)\n", Status));
+      Private->BlkIoQueueSize = 0;
+    }
+  }
+
+  DEBUG ((DEBUG_INFO, "Block I/O queue entries = [%d]\n", Private->BlkIoQueueSize));
+
+  //
+  // Create the I/O completion queues.
+  // One for blocking I/O, one for non-blocking I/O, one for block I/O reads
+  // and writes.
   //
   Status = NvmeCreateIoCompletionQueue (Private);
   if (EFI_ERROR (Status)) {
@@ -922,8 +1028,7 @@ NvmeControllerInit (
   }
 
   //
-  // Create two I/O Submission queues.
-  // One for blocking I/O, one for non-blocking I/O.
+  // Create the I/O Submission queues.
   //
   Status = NvmeCreateIoSubmissionQueue (Private);
 
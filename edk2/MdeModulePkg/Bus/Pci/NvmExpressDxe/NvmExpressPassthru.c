@@ -414,6 +414,58 @@ AbortAsyncPassThruTasks (
   return Status;
 }
 
+/**
+  Reset the controller after a command timed out, which aborts the commands
+  outstanding on all the queues, and abort the asynchronous PassThru requests.
+
+  @param[in] Private        The pointer to the NVME_CONTROLLER_PRIVATE_DATA
+                            data structure.
+
+  @retval EFI_TIMEOUT       The controller has been reset, and the timed out
+                            command is to be reported with this status.
+  @retval EFI_DEVICE_ERROR  Fail to reset the controller.
+  @retval Others            Fail to abort the asynchronous PassThru requests.
+
+**/
+EFI_STATUS
+NvmeResetAfterTimeout (
+  IN NVME_CONTROLLER_PRIVATE_DATA  *Private
+  )
+{
+  EFI_STATUS  Status;
+
+  //
+  // Disable the timer to trigger the process of async transfers temporarily.
+  //
+  Status = gBS->SetTimer (Private->TimerEvent, TimerCancel, 0);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // Reset the NVMe controller.
+  //
+  Status = NvmeControllerInit (Private);
+  if (EFI_ERROR (Status)) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  Status = AbortAsyncPassThruTasks (Private);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // Re-enable the timer to trigger the process of async transfers.
+  //
+  Status = gBS->SetTimer (Private->TimerEvent, TimerPeriodic, NVME_HC_ASYNC_TIMER);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return EFI_TIMEOUT;
+}
+
 /**
   Sends an NVM Express Command Packet to an NVM Express controller or namespace. This function supports
   both blocking I/O and non-blocking I/O. The blocking I/O functionality is required, and the non-blocking
@@ -829,37 +881,7 @@ NvmExpressPassThru (
     // outstanding commands.
     //
     DEBUG ((DEBUG_ERROR, "NvmExpressPassThru: Timeout occurs for an NVMe command.\n"));
-
-    //
-    // Disable the timer to trigger the process of async transfers temporarily.
-    //
-    Status = gBS->SetTimer (Private->TimerEvent, TimerCancel, 0);
-    if (EFI_ERROR (Status)) {
-      goto EXIT;
-    }
-
-    //
-    // Reset the NVMe controller.
-    //
-    Status = NvmeControllerInit (Private);
-    if (!EFI_ERROR (Status)) {
-      Status = AbortAsyncPassThruTasks (Private);
-      if (!EFI_ERROR (Status)) {
-        //
-        // Re-enable the timer to trigger the process of async transfers.
-        //
-        Status = gBS->SetTimer (Private->TimerEvent, TimerPeriodic, NVME_HC_ASYNC_TIMER);
-        if (!EFI_ERROR (Status)) {
-          //
-          // Return EFI_TIMEOUT to indicate a timeout occurs for NVMe PassThru command.
-          //
-          Status = EFI_TIMEOUT;
-        }
-      }
-    } else {
-      Status = EFI_DEVICE_ERROR;
-    }
-
+    Status = NvmeResetAfterTimeout (Private);
     goto EXIT;
   }
 
@@ -0,0 +1,243 @@
+/** @file
+  Host test of the bus enumeration of PciBusDxe.
+
+  The bus scan runs against the ECAM model of PciBusModel.c, with two root
+  ports, a switch, NVMe controllers and a network controller with ARI and
+  SR-IOV. The functions found are checked against the model: the bus numbers
+  the bridges are programmed with, the bus reserved for the VFs, the
+  capabilities and the BARs. The configuration reads of the scan are checked
+  not to read again what the scan read already, and the capabilities to be
+  searched in the capability lists read once. The benchmark reports the
+  configuration reads per function and the time of the scan on the clock of
+  the model.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+#include <Library/GoogleTestLib.h>
+#include <cstdio>
+#include <cstring>
+
+extern "C" {
+  #include <Uefi.h>
+  #include "PciBusModel.h"
+}
+
+using namespace testing;
+
+//
+// The functions of the model in the order the scan finds them
+//
+#define ROOT_PORT_A     0
+#define NVME_A          1
+#define ROOT_PORT_B     2
+#define UPSTREAM_PORT   3
+#define NIC_PORT        4
+#define NIC_PF0         5
+#define NIC_PF1         6
+#define NVME_PORT       7
+#define NVME_B          8
+#define EMPTY_PORT      9
+#define MODEL_FUNCTIONS 10
+#define MODEL_LAST_BUS  7
+
+class PciBusTest : public Test {
+protected:
+  VOID
+  SetUp (
+    ) override
+  {
+    PciBusModelDefaultConfig ();
+  }
+
+  VOID
+  TearDown (
+    ) override
+  {
+    PciBusModelFree ();
+  }
+
+  VOID
+  Enumerate (
+    )
+  {
+    UINT8  SubBusNumber;
+
+    ASSERT_EQ (PciBusModelEnumerate (&SubBusNumber), EFI_SUCCESS);
+    EXPECT_EQ (SubBusNumber, MODEL_LAST_BUS);
+    ASSERT_EQ (mPciBusModelDeviceCount, (UINTN)MODEL_FUNCTIONS);
+  }
+
+  VOID
+  CheckFunction (
+    UINTN   Index,
+    UINT8   Bus,
+    UINT8   Device,
+    UINT8   Function,
+    UINT16  DeviceId
+    )
+  {
+    PCI_BUS_MODEL_DEVICE  *Found;
+
+    Found = &mPciBusModelDevices[Index];
+    EXPECT_EQ (Found->Bus, Bus) << "function " << Index;
+    EXPECT_EQ (Found->Device, Device) << "function " << Index;
+    EXPECT_EQ (Found->Function, Function) << "function " << Index;
+    EXPECT_EQ (Found->DeviceId, DeviceId) << "function " << Index;
+  }
+
+  VOID
+  CheckBridge (
+    UINTN  Index,
+    UINT8  SecondaryBus,
+    UINT8  SubordinateBus
+    )
+  {
+    PCI_BUS_MODEL_DEVICE  *Found;
+
+    Found = &mPciBusModelDevices[Index];
+    EXPECT_TRUE (Found->Bridge) << "function " << Index;
+    EXPECT_EQ (Found->SecondaryBus, SecondaryBus) << "function " << Index;
+    EXPECT_EQ (Found->SubordinateBus, SubordinateBus) << "function " << Index;
+  }
+};
+
+TEST_F (PciBusTest, BusNumbers) {
+  Enumerate ();
+
+  CheckFunction (ROOT_PORT_A, 0, 0, 0, PCI_BUS_MODEL_ROOT_PORT_ID);
+  CheckFunction (NVME_A, 1, 0, 0, PCI_BUS_MODEL_NVME_ID);
+  CheckFunction (ROOT_PORT_B, 0, 1, 0, PCI_BUS_MODEL_ROOT_PORT_ID);
+  CheckFunction (UPSTREAM_PORT, 2, 0, 0, PCI_BUS_MODEL_UPSTREAM_ID);
+  CheckFunction (NIC_PORT, 3, 0, 0, PCI_BUS_MODEL_DOWNSTREAM_ID);
+  CheckFunction (NIC_PF0, 4, 0, 0, PCI_BUS_MODEL_NIC_ID);
+  CheckFunction (NIC_PF1, 4, 0, 1, PCI_BUS_MODEL_NIC_ID);
+  CheckFunction (NVME_PORT, 3, 1, 0, PCI_BUS_MODEL_DOWNSTREAM_ID);
+  CheckFunction (NVME_B, 6, 0, 0, PCI_BUS_MODEL_NVME_ID);
+  CheckFunction (EMPTY_PORT, 3, 2, 0, PCI_BUS_MODEL_DOWNSTREAM_ID);
+
+  //
+  // The port of the network controller covers the bus of its VFs too
+  //
+  CheckBridge (ROOT_PORT_A, 1, 1);
+  CheckBridge (ROOT_PORT_B, 2, 7);
+  CheckBridge (UPSTREAM_PORT, 3, 7);
+  CheckBridge (NIC_PORT, 4, 5);
+  CheckBridge (NVME_PORT, 6, 6);
+  CheckBridge (EMPTY_PORT, 7, 7);
+}
+
+TEST_F (PciBusTest, Capabilities) {
+  UINTN  Index;
+
+  Enumerate ();
+
+  for (Index = 0; Index < MODEL_FUNCTIONS; Index++) {
+    EXPECT_TRUE (mPciBusModelDevices[Index].IsPciExp) << "function " << Index;
+    EXPECT_EQ (mPciBusModelDevices[Index].PciExpressCapabilityOffset, 0x70U) << "function " << Index;
+  }
+
+  for (Index = NIC_PF0; Index <= NIC_PF1; Index++) {
+    EXPECT_TRUE (mPciBusModelDevices[Index].IsAriEnabled);
+    EXPECT_EQ (mPciBusModelDevices[Index].AriCapabilityOffset, 0x140U);
+    EXPECT_EQ (mPciBusModelDevices[Index].SrIovCapabilityOffset, 0x160U);
+    EXPECT_EQ (mPciBusModelDevices[Index].InitialVFs, 64);
+    EXPECT_EQ (mPciBusModelDevices[Index].ReservedBusNum, 1);
+  }
+
+  EXPECT_FALSE (mPciBusModelDevices[NVME_B].IsAriEnabled);
+  EXPECT_EQ (mPciBusModelDevices[NVME_B].AriCapabilityOffset, 0U);
+  EXPECT_EQ (mPciBusModelDevices[NVME_B].SrIovCapabilityOffset, 0U);
+  EXPECT_EQ (mPciBusModelDevices[NVME_B].ReservedBusNum, 0);
+}
+
+TEST_F (PciBusTest, Bars) {
+  Enumerate ();
+
+  EXPECT_EQ (mPciBusModelDevices[NVME_A].Bar0Length, (UINT64)SIZE_16KB);
+  EXPECT_TRUE (mPciBusModelDevices[NVME_A].Bar0Mem64);
+  EXPECT_EQ (mPciBusModelDevices[NVME_B].Bar0Length, (UINT64)SIZE_16KB);
+  EXPECT_TRUE (mPciBusModelDevices[NVME_B].Bar0Mem64);
+  EXPECT_EQ (mPciBusModelDevices[NIC_PF0].Bar0Length, (UINT64)SIZE_128KB);
+  EXPECT_EQ (mPciBusModelDevices[NIC_PF1].Bar0Length, (UINT64)SIZE_128KB);
+  EXPECT_EQ (mPciBusModelDevices[ROOT_PORT_A].Bar0Length, 0U);
+}
+
+TEST_F (PciBusTest, Rescan) {
+  //
+  // A second scan starts from the bus numbers of the first one, which are
+  // reset first, and finds the same functions
+  //
+  Enumerate ();
+  Enumerate ();
+  CheckFunction (NVME_B, 6, 0, 0, PCI_BUS_MODEL_NVME_ID);
+  CheckBridge (NIC_PORT, 4, 5);
+  CheckBridge (EMPTY_PORT, 7, 7);
+}
+
+TEST_F (PciBusTest, RepeatedReads) {
+  Enumerate ();
+
+  //
+  // The configuration header, the capabilities and the SR-IOV registers are
+  // read once. Only the command register may be read again before it is
+  // changed.
+  //
+  EXPECT_LE (mPciBusModelStatistics.RepeatedReads, (UINT32)MODEL_FUNCTIONS);
+}
+
+TEST_F (PciBusTest, CapabilityLists) {
+  UINT32  Cached;
+  UINT32  Uncached;
+
+  Enumerate ();
+
+  //
+  // Every function has three capabilities and one extended capability, the
+  // functions of the network controller two more extended capabilities
+  //
+  Cached   = PciBusModelSearchCapabilities (TRUE);
+  Uncached = PciBusModelSearchCapabilities (FALSE);
+  EXPECT_EQ (Cached, 4U * MODEL_FUNCTIONS + 2 * 2);
+  EXPECT_GT (Uncached, Cached);
+}
+
+TEST_F (PciBusTest, ScanBenchmark) {
+  UINT64  Start;
+  UINT64  Time;
+  UINT32  Cached;
+  UINT32  Uncached;
+
+  Start = PciBusModelNow ();
+  Enumerate ();
+  Time = PciBusModelNow () - Start;
+
+  printf (
+    "  %d functions: %4.1f config reads, %4.1f repeated, %4.1f calls per function, %4llu us\n",
+    MODEL_FUNCTIONS,
+    (double)mPciBusModelStatistics.Reads / MODEL_FUNCTIONS,
+    (double)mPciBusModelStatistics.RepeatedReads / MODEL_FUNCTIONS,
+    (double)mPciBusModelStatistics.Calls / MODEL_FUNCTIONS,
+    (unsigned long long)(Time / 1000)
+    );
+  EXPECT_LT (mPciBusModelStatistics.RepeatedReads, (UINT32)MODEL_FUNCTIONS);
+
+  Cached   = PciBusModelSearchCapabilities (TRUE);
+  Uncached = PciBusModelSearchCapabilities (FALSE);
+  printf (
+    "  capability searches: %3u config reads from the lists, %3u from the config space\n",
+    Cached,
+    Uncached
+    );
+  EXPECT_LT (Cached * 3, Uncached * 2);
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
@@ -0,0 +1,746 @@
+/** @file
+  An ECAM model behind a PCI root bridge I/O protocol for the host test of
+  the bus enumeration of PciBusDxe. The model owns the root bridge handle
+  and takes over OpenProtocol () and HandleProtocol () of
+  UnitTestUefiBootServicesTableLib to open it: installing a protocol there
+  logs through UnitTestLib, which needs a running framework a GoogleTest
+  main does not have. It also takes over Stall () to let the clock run.
+
+  Each function of the model has a configuration space of 4 KB, with a write
+  mask for every byte so the BARs and the windows of the bridges can be
+  sized. A bridge passes the configuration requests on to its secondary bus
+  for the buses its secondary and subordinate bus numbers cover, and a
+  function that cannot be reached reads all ones, the way the root complexes
+  of the SG2042 behave. Each read or write of the ECAM window takes its time
+  on the link, and each call of the root bridge the time the host takes to
+  decode it.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "../PciBus.h"
+#include "PciBusModel.h"
+
+#define MODEL_MAX_FUNCTIONS  16
+#define MODEL_MAX_BUSES      8
+
+//
+// The offsets of the capabilities of the functions of the model
+//
+#define MODEL_PM_OFFSET      0x40
+#define MODEL_MSI_OFFSET     0x50
+#define MODEL_PCIE_OFFSET    0x70
+#define MODEL_AER_OFFSET     0x100
+#define MODEL_ARI_OFFSET     0x140
+#define MODEL_SRIOV_OFFSET   0x160
+
+#define MODEL_EXT_CAP(Id, Next)  ((UINT32)(Id) | (1 << 16) | ((UINT32)(Next) << 20))
+
+typedef struct _MODEL_BUS MODEL_BUS;
+
+typedef struct {
+  UINT8        Config[SIZE_4KB];
+  UINT8        WriteMask[SIZE_4KB];
+  UINT8        Read[SIZE_4KB / sizeof (UINT32) / 8];   // DWORDs read since the last write
+  MODEL_BUS    *SecondaryBus;
+} MODEL_FUNCTION;
+
+struct _MODEL_BUS {
+  MODEL_FUNCTION    *Functions[PCI_MAX_DEVICE + 1][PCI_MAX_FUNC + 1];
+};
+
+#pragma pack (1)
+typedef struct {
+  ACPI_HID_DEVICE_PATH        AcpiDevicePath;
+  EFI_DEVICE_PATH_PROTOCOL    EndDevicePath;
+} MODEL_ROOT_BRIDGE_DEVICE_PATH;
+
+typedef struct {
+  EFI_ACPI_ADDRESS_SPACE_DESCRIPTOR    Bus;
+  EFI_ACPI_END_TAG_DESCRIPTOR          End;
+} MODEL_BUS_NUMBER_RANGES;
+#pragma pack ()
+
+PCI_BUS_MODEL_CONFIG      mPciBusModelConfig;
+PCI_BUS_MODEL_STATISTICS  mPciBusModelStatistics;
+PCI_BUS_MODEL_DEVICE      mPciBusModelDevices[PCI_BUS_MODEL_MAX_DEVICES];
+UINTN                     mPciBusModelDeviceCount;
+
+STATIC EFI_BOOT_SERVICES                mModelBootServices;
+STATIC EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL  mModelRootBridgeIo;
+STATIC MODEL_FUNCTION                   mModelFunctions[MODEL_MAX_FUNCTIONS];
+STATIC UINTN                            mModelFunctionCount;
+STATIC MODEL_BUS                        mModelBuses[MODEL_MAX_BUSES];
+STATIC UINTN                            mModelBusCount;
+STATIC PCI_IO_DEVICE                    *mModelRootBridge;
+STATIC UINT64                           mModelNow;
+
+//
+// The model owns both handles, they are not in the protocol database of the
+// host boot services library. The root bridge handle has a device path and a
+// root bridge I/O protocol. The host bridge handle has no resource
+// allocation protocol, so the platform is not asked to prepare the
+// controllers.
+//
+STATIC UINT8  mModelHostBridgeHandle;
+STATIC UINT8  mModelRootBridgeHandle;
+
+STATIC MODEL_ROOT_BRIDGE_DEVICE_PATH  mModelDevicePath = {
+  {
+    {
+      ACPI_DEVICE_PATH,
+      ACPI_DP,
+      {
+        (UINT8)sizeof (ACPI_HID_DEVICE_PATH),
+        (UINT8)(sizeof (ACPI_HID_DEVICE_PATH) >> 8)
+      }
+    },
+    EISA_PNP_ID (0x0A08),
+    0
+  },
+  {
+    END_DEVICE_PATH_TYPE,
+    END_ENTIRE_DEVICE_PATH_SUBTYPE,
+    { END_DEVICE_PATH_LENGTH, 0 }
+  }
+};
+
+/**
+  Set a register of a function of the model, and the bits of it the host
+  can write.
+
+**/
+STATIC
+VOID
+ModelSetRegister (
+  IN MODEL_FUNCTION  *Function,
+  IN UINT32          Offset,
+  IN UINTN           Size,
+  IN UINT32          Value,
+  IN UINT32          WriteMask
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < Size; Index++) {
+    Function->Config[Offset + Index]    = (UINT8)(Value >> (Index * 8));
+    Function->WriteMask[Offset + Index] = (UINT8)(WriteMask >> (Index * 8));
+  }
+}
+
+/**
+  Make a 64-bit memory BAR of the given size.
+
+**/
+STATIC
+VOID
+ModelSetBar64 (
+  IN MODEL_FUNCTION  *Function,
+  IN UINT32          Offset,
+  IN UINT32          Size,
+  IN BOOLEAN         Prefetchable
+  )
+{
+  ModelSetRegister (Function, Offset, 4, Prefetchable ? 0x0C : 0x04, ~(Size - 1) & 0xFFFFFFF0);
+  ModelSetRegister (Function, Offset + 4, 4, 0, MAX_UINT32);
+}
+
+/**
+  Create a function on a bus of the model, with a power management, an MSI
+  and a PCI Express capability, and an AER extended capability.
+
+  @param  Bus                    The bus of the function.
+  @param  Device                 The device number of the function.
+  @param  Function               The function number of the function.
+  @param  DeviceId               The device ID.
+  @param  ClassCode              The base class, sub-class and programming
+                                 interface.
+  @param  PortType               The device/port type of the PCI Express
+                                 capability.
+  @param  MultiFunction          TRUE if the device has several functions.
+
+  @return The function, of type 1 if the device/port type is a port.
+
+**/
+STATIC
+MODEL_FUNCTION *
+ModelCreateFunction (
+  IN MODEL_BUS  *Bus,
+  IN UINT8      Device,
+  IN UINT8      Function,
+  IN UINT16     DeviceId,
+  IN UINT32     ClassCode,
+  IN UINT8      PortType,
+  IN BOOLEAN    MultiFunction
+  )
+{
+  MODEL_FUNCTION  *ModelFunction;
+  BOOLEAN         Port;
+  BOOLEAN         DownstreamPort;
+
+  ASSERT (mModelFunctionCount < MODEL_MAX_FUNCTIONS);
+  ModelFunction                    = &mModelFunctions[mModelFunctionCount++];
+  Bus->Functions[Device][Function] = ModelFunction;
+
+  Port           = (BOOLEAN)(PortType != PCIE_DEVICE_PORT_TYPE_PCIE_ENDPOINT);
+  DownstreamPort = (BOOLEAN)((PortType == PCIE_DEVICE_PORT_TYPE_ROOT_PORT) ||
+                             (PortType == PCIE_DEVICE_PORT_TYPE_DOWNSTREAM_PORT));
+
+  ModelSetRegister (ModelFunction, PCI_VENDOR_ID_OFFSET, 2, PCI_BUS_MODEL_VENDOR_ID, 0);
+  ModelSetRegister (ModelFunction, PCI_DEVICE_ID_OFFSET, 2, DeviceId, 0);
+  ModelSetRegister (ModelFunction, PCI_COMMAND_OFFSET, 2, 0, 0x0547);
+  ModelSetRegister (ModelFunction, PCI_PRIMARY_STATUS_OFFSET, 2, EFI_PCI_STATUS_CAPABILITY, 0);
+  ModelSetRegister (ModelFunction, PCI_REVISION_ID_OFFSET, 4, (ClassCode << 8) | 0x01, 0);
+  ModelSetRegister (ModelFunction, PCI_CACHELINE_SIZE_OFFSET, 2, 0, 0xFFFF);
+  ModelSetRegister (
+    ModelFunction,
+    PCI_HEADER_TYPE_OFFSET,
+    1,
+    (Port ? HEADER_TYPE_PCI_TO_PCI_BRIDGE : HEADER_TYPE_DEVICE) | (MultiFunction ? HEADER_TYPE_MULTI_FUNCTION : 0),
+    0
+    );
+  ModelSetRegister (ModelFunction, PCI_CAPBILITY_POINTER_OFFSET, 1, MODEL_PM_OFFSET, 0);
+  ModelSetRegister (ModelFunction, PCI_INT_LINE_OFFSET, 2, 0x0100, 0x00FF);
+
+  if (Port) {
+    ModelSetRegister (ModelFunction, PCI_BRIDGE_PRIMARY_BUS_REGISTER_OFFSET, 4, 0, MAX_UINT32);
+    ModelSetRegister (ModelFunction, 0x1C, 2, 0, 0xF0F0);
+    ModelSetRegister (ModelFunction, 0x20, 4, 0, 0xFFF0FFF0);
+    ModelSetRegister (ModelFunction, 0x24, 4, 0x00010001, 0xFFF0FFF0);
+    ModelSetRegister (ModelFunction, 0x28, 4, 0, MAX_UINT32);
+    ModelSetRegister (ModelFunction, 0x2C, 4, 0, MAX_UINT32);
+    ModelSetRegister (ModelFunction, PCI_BRIDGE_CONTROL_REGISTER_OFFSET, 2, 0, 0x0FFF);
+  }
+
+  ModelSetRegister (ModelFunction, MODEL_PM_OFFSET, 4, (0x0003 << 16) | (MODEL_MSI_OFFSET << 8) | EFI_PCI_CAPABILITY_ID_PMI, 0);
+  ModelSetRegister (ModelFunction, MODEL_PM_OFFSET + 4, 2, 0, 0x0103);
+  ModelSetRegister (ModelFunction, MODEL_MSI_OFFSET, 4, (MODEL_PCIE_OFFSET << 8) | EFI_PCI_CAPABILITY_ID_MSI, 0x00710000);
+
+  ModelSetRegister (
+    ModelFunction,
+    MODEL_PCIE_OFFSET,
+    4,
+    ((0x0002 | (PortType << 4) | (DownstreamPort ? BIT8 : 0)) << 16) | EFI_PCI_CAPABILITY_ID_PCIEXP,
+    0
+    );
+  ModelSetRegister (ModelFunction, MODEL_PCIE_OFFSET + 0x08, 2, 0x2810, 0xFFFF);
+  ModelSetRegister (ModelFunction, MODEL_PCIE_OFFSET + 0x10, 2, 0, 0x0FFF);
+  ModelSetRegister (
+    ModelFunction,
+    MODEL_PCIE_OFFSET + EFI_PCIE_CAPABILITY_DEVICE_CAPABILITIES_2_OFFSET,
+    4,
+    DownstreamPort ? EFI_PCIE_CAPABILITY_DEVICE_CAPABILITIES_2_ARI_FORWARDING : 0,
+    0
+    );
+  ModelSetRegister (ModelFunction, MODEL_PCIE_OFFSET + EFI_PCIE_CAPABILITY_DEVICE_CONTROL_2_OFFSET, 2, 0, 0xFFFF);
+
+  ModelSetRegister (ModelFunction, MODEL_AER_OFFSET, 4, MODEL_EXT_CAP (PCI_EXPRESS_EXTENDED_CAPABILITY_ADVANCED_ERROR_REPORTING_ID, 0), 0);
+
+  if (Port) {
+    ASSERT (mModelBusCount < MODEL_MAX_BUSES);
+    ModelFunction->SecondaryBus = &mModelBuses[mModelBusCount++];
+  }
+
+  return ModelFunction;
+}
+
+/**
+  Create a function of a network controller with ARI and SR-IOV. Its VFs
+  follow the PF on the bus after the one of the PF, so one bus is reserved
+  for them.
+
+**/
+STATIC
+VOID
+ModelCreateNicFunction (
+  IN MODEL_BUS  *Bus,
+  IN UINT8      Function,
+  IN UINT8      NextFunction
+  )
+{
+  MODEL_FUNCTION  *ModelFunction;
+  UINT32          Sriov;
+
+  ModelFunction = ModelCreateFunction (
+                    Bus,
+                    0,
+                    Function,
+                    PCI_BUS_MODEL_NIC_ID,
+                    0x020000,
+                    PCIE_DEVICE_PORT_TYPE_PCIE_ENDPOINT,
+                    TRUE
+                    );
+  ModelSetBar64 (ModelFunction, PCI_BASE_ADDRESSREG_OFFSET, SIZE_128KB, FALSE);
+
+  ModelSetRegister (ModelFunction, MODEL_AER_OFFSET, 4, MODEL_EXT_CAP (PCI_EXPRESS_EXTENDED_CAPABILITY_ADVANCED_ERROR_REPORTING_ID, MODEL_ARI_OFFSET), 0);
+  ModelSetRegister (ModelFunction, MODEL_ARI_OFFSET, 4, MODEL_EXT_CAP (EFI_PCIE_CAPABILITY_ID_ARI, MODEL_SRIOV_OFFSET), 0);
+  ModelSetRegister (ModelFunction, MODEL_ARI_OFFSET + 4, 2, (UINT32)NextFunction << 8, 0);
+
+  Sriov = MODEL_SRIOV_OFFSET;
+  ModelSetRegister (ModelFunction, Sriov, 4, MODEL_EXT_CAP (EFI_PCIE_CAPABILITY_ID_SRIOV, 0), 0);
+  ModelSetRegister (ModelFunction, Sriov + EFI_PCIE_CAPABILITY_ID_SRIOV_CONTROL, 2, 0, 0x001F);
+  ModelSetRegister (ModelFunction, Sriov + EFI_PCIE_CAPABILITY_ID_SRIOV_INITIALVFS, 4, (64 << 16) | 64, 0);
+  ModelSetRegister (ModelFunction, Sriov + EFI_PCIE_CAPABILITY_ID_SRIOV_NUMVFS, 2, 0, 0xFFFF);
+  ModelSetRegister (
+    ModelFunction,
+    Sriov + EFI_PCIE_CAPABILITY_ID_SRIOV_FIRSTVF,
+    4,
+    (1 << 16) | (0x100 + 64 * Function - Function),
+    0
+    );
+  ModelSetRegister (ModelFunction, Sriov + EFI_PCIE_CAPABILITY_ID_SRIOV_SUPPORTED_PAGE_SIZE, 4, 0x553, 0);
+  ModelSetRegister (ModelFunction, Sriov + EFI_PCIE_CAPABILITY_ID_SRIOV_SYSTEM_PAGE_SIZE, 4, 0x1, MAX_UINT32);
+}
+
+/**
+  Find the function a configuration request reaches.
+
+  @return The function, or NULL if the request is not passed on to it.
+
+**/
+STATIC
+MODEL_FUNCTION *
+ModelFindFunction (
+  IN UINT8  Bus,
+  IN UINT8  Device,
+  IN UINT8  Function
+  )
+{
+  MODEL_BUS       *ModelBus;
+  MODEL_FUNCTION  *Bridge;
+  UINT8           BusNumber;
+  UINT8           Secondary;
+  UINT8           Subordinate;
+  UINTN           Index;
+
+  ModelBus  = &mModelBuses[0];
+  BusNumber = 0;
+  while (BusNumber != Bus) {
+    for (Index = 0; Index < ARRAY_SIZE (ModelBus->Functions) * ARRAY_SIZE (ModelBus->Functions[0]); Index++) {
+      Bridge = ModelBus->Functions[Index >> 3][Index & 0x07];
+      if ((Bridge == NULL) || (Bridge->SecondaryBus == NULL)) {
+        continue;
+      }
+
+      Secondary   = Bridge->Config[PCI_BRIDGE_SECONDARY_BUS_REGISTER_OFFSET];
+      Subordinate = Bridge->Config[PCI_BRIDGE_SUBORDINATE_BUS_REGISTER_OFFSET];
+      if ((Secondary > BusNumber) && (Bus >= Secondary) && (Bus <= Subordinate)) {
+        break;
+      }
+    }
+
+    if (Index == ARRAY_SIZE (ModelBus->Functions) * ARRAY_SIZE (ModelBus->Functions[0])) {
+      return NULL;
+    }
+
+    ModelBus  = Bridge->SecondaryBus;
+    BusNumber = Secondary;
+  }
+
+  return ModelBus->Functions[Device][Function];
+}
+
+/**
+  Read or write the configuration space through the ECAM window.
+
+**/
+STATIC
+EFI_STATUS
+ModelConfigAccess (
+  IN     EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL_WIDTH  Width,
+  IN     UINT64                                 Address,
+  IN     UINTN                                  Count,
+  IN OUT VOID                                   *Buffer,
+  IN     BOOLEAN                                Write
+  )
+{
+  MODEL_FUNCTION  *Function;
+  UINTN           Size;
+  UINT32          Register;
+  UINTN           Index;
+  UINTN           Byte;
+  UINT32          Offset;
+  UINT8           *Data;
+
+  mPciBusModelStatistics.Calls++;
+  mModelNow += mPciBusModelConfig.CallTime;
+
+  if ((UINT32)Width > EfiPciWidthUint64) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Size     = (UINTN)1 << Width;
+  Register = (UINT32)RShiftU64 (Address, 32);
+  if (Register == 0) {
+    Register = (UINT8)Address;
+  }
+
+  if ((Register & (Size - 1)) != 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (Register + Count * Size > SIZE_4KB) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Function = ModelFindFunction ((UINT8)(Address >> 24), (UINT8)(Address >> 16) & PCI_MAX_DEVICE, (UINT8)(Address >> 8) & PCI_MAX_FUNC);
+  Data     = Buffer;
+  for (Index = 0; Index < Count; Index++, Data += Size) {
+    Offset = Register + (UINT32)(Index * Size);
+    if (Write) {
+      mPciBusModelStatistics.Writes++;
+      mModelNow += mPciBusModelConfig.WriteTime;
+      if (Function == NULL) {
+        continue;
+      }
+
+      for (Byte = 0; Byte < Size; Byte++) {
+        Function->Config[Offset + Byte] = (Function->Config[Offset + Byte] & ~Function->WriteMask[Offset + Byte]) |
+                                          (Data[Byte] & Function->WriteMask[Offset + Byte]);
+      }
+
+      ZeroMem (Function->Read, sizeof (Function->Read));
+      continue;
+    }
+
+    mPciBusModelStatistics.Reads++;
+    mModelNow += mPciBusModelConfig.ReadTime;
+    if (Function == NULL) {
+      SetMem (Data, Size, 0xFF);
+      continue;
+    }
+
+    CopyMem (Data, &Function->Config[Offset], Size);
+    if ((Function->Read[Offset / 32] & (1 << ((Offset / 4) % 8))) != 0) {
+      mPciBusModelStatistics.RepeatedReads++;
+    }
+
+    for (Byte = 0; Byte < Size; Byte += 4) {
+      Function->Read[(Offset + Byte) / 32] |= (UINT8)(1 << (((Offset + Byte) / 4) % 8));
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelPciRead (
+  IN     EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL        *This,
+  IN     EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL_WIDTH  Width,
+  IN     UINT64                                 Address,
+  IN     UINTN                                  Count,
+  IN OUT VOID                                   *Buffer
+  )
+{
+  return ModelConfigAccess (Width, Address, Count, Buffer, FALSE);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelPciWrite (
+  IN     EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL        *This,
+  IN     EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL_WIDTH  Width,
+  IN     UINT64                                 Address,
+  IN     UINTN                                  Count,
+  IN OUT VOID                                   *Buffer
+  )
+{
+  return ModelConfigAccess (Width, Address, Count, Buffer, TRUE);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelStall (
+  IN UINTN  Microseconds
+  )
+{
+  mModelNow += MultU64x32 (Microseconds, 1000);
+  return EFI_SUCCESS;
+}
+
+/**
+  Open the protocols of the root bridge handle of the model, and pass the
+  other handles to the host boot services library.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+ModelOpenProtocol (
+  IN  EFI_HANDLE  Handle,
+  IN  EFI_GUID    *Protocol,
+  OUT VOID        **Interface OPTIONAL,
+  IN  EFI_HANDLE  AgentHandle,
+  IN  EFI_HANDLE  ControllerHandle,
+  IN  UINT32      Attributes
+  )
+{
+  VOID  *ModelInterface;
+
+  if (Handle != &mModelRootBridgeHandle) {
+    return mModelBootServices.OpenProtocol (Handle, Protocol, Interface, AgentHandle, ControllerHandle, Attributes);
+  }
+
+  if (CompareGuid (Protocol, &gEfiDevicePathProtocolGuid)) {
+    ModelInterface = &mModelDevicePath;
+  } else if (CompareGuid (Protocol, &gEfiPciRootBridgeIoProtocolGuid)) {
+    ModelInterface = &mModelRootBridgeIo;
+  } else {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (Interface != NULL) {
+    *Interface = ModelInterface;
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelHandleProtocol (
+  IN  EFI_HANDLE  Handle,
+  IN  EFI_GUID    *Protocol,
+  OUT VOID        **Interface
+  )
+{
+  return ModelOpenProtocol (Handle, Protocol, Interface, NULL, NULL, EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+}
+
+/**
+  Record the functions found under a bridge, each one before the functions
+  under it.
+
+**/
+STATIC
+VOID
+ModelRecordDevices (
+  IN PCI_IO_DEVICE  *Bridge
+  )
+{
+  LIST_ENTRY            *Link;
+  PCI_IO_DEVICE         *PciIoDevice;
+  PCI_BUS_MODEL_DEVICE  *Device;
+  MODEL_FUNCTION        *Function;
+
+  for (Link = GetFirstNode (&Bridge->ChildList); !IsNull (&Bridge->ChildList, Link); Link = GetNextNode (&Bridge->ChildList, Link)) {
+    PciIoDevice = PCI_IO_DEVICE_FROM_LINK (Link);
+    ASSERT (mPciBusModelDeviceCount < PCI_BUS_MODEL_MAX_DEVICES);
+    Device = &mPciBusModelDevices[mPciBusModelDeviceCount++];
+
+    Device->Bus                        = PciIoDevice->BusNumber;
+    Device->Device                     = PciIoDevice->DeviceNumber;
+    Device->Function                   = PciIoDevice->FunctionNumber;
+    Device->DeviceId                   = PciIoDevice->Pci.Hdr.DeviceId;
+    Device->Bridge                     = (BOOLEAN)IS_PCI_BRIDGE (&PciIoDevice->Pci);
+    Device->IsPciExp                   = PciIoDevice->IsPciExp;
+    Device->PciExpressCapabilityOffset = PciIoDevice->PciExpressCapabilityOffset;
+    Device->AriCapabilityOffset        = PciIoDevice->AriCapabilityOffset;
+    Device->SrIovCapabilityOffset      = PciIoDevice->SrIovCapabilityOffset;
+    Device->IsAriEnabled               = PciIoDevice->IsAriEnabled;
+    Device->InitialVFs                 = PciIoDevice->InitialVFs;
+    Device->ReservedBusNum             = PciIoDevice->ReservedBusNum;
+    Device->Bar0Length                 = PciIoDevice->PciBar[0].Length;
+    Device->Bar0Mem64                  = (BOOLEAN)(PciIoDevice->PciBar[0].BarType == PciBarTypeMem64);
+
+    Function = ModelFindFunction (Device->Bus, Device->Device, Device->Function);
+    ASSERT (Function != NULL);
+    if (Device->Bridge) {
+      Device->SecondaryBus   = Function->Config[PCI_BRIDGE_SECONDARY_BUS_REGISTER_OFFSET];
+      Device->SubordinateBus = Function->Config[PCI_BRIDGE_SUBORDINATE_BUS_REGISTER_OFFSET];
+    }
+
+    ModelRecordDevices (PciIoDevice);
+  }
+}
+
+/**
+  Search the capabilities the bus enumeration searches for in the functions
+  found under a bridge, with the default PCDs.
+
+**/
+STATIC
+VOID
+ModelSearchCapabilities (
+  IN PCI_IO_DEVICE  *Bridge,
+  IN BOOLEAN        Cached
+  )
+{
+  LIST_ENTRY     *Link;
+  PCI_IO_DEVICE  *PciIoDevice;
+  UINT8          Offset;
+  UINT32         ExpressOffset;
+
+  for (Link = GetFirstNode (&Bridge->ChildList); !IsNull (&Bridge->ChildList, Link); Link = GetNextNode (&Bridge->ChildList, Link)) {
+    PciIoDevice                              = PCI_IO_DEVICE_FROM_LINK (Link);
+    PciIoDevice->CapabilityList.State        = Cached ? PciCapabilityListUnknown : PciCapabilityListUncached;
+    PciIoDevice->ExpressCapabilityList.State = PciIoDevice->CapabilityList.State;
+
+    Offset = 0;
+    LocateCapabilityRegBlock (PciIoDevice, EFI_PCI_CAPABILITY_ID_PCIEXP, &Offset, NULL);
+    Offset = 0;
+    LocateCapabilityRegBlock (PciIoDevice, EFI_PCI_CAPABILITY_ID_PMI, &Offset, NULL);
+    if (PciIoDevice->IsPciExp) {
+      ExpressOffset = 0;
+      LocatePciExpressCapabilityRegBlock (PciIoDevice, EFI_PCIE_CAPABILITY_ID_ARI, &ExpressOffset, NULL);
+      ExpressOffset = 0;
+      LocatePciExpressCapabilityRegBlock (PciIoDevice, EFI_PCIE_CAPABILITY_ID_SRIOV, &ExpressOffset, NULL);
+    }
+
+    ModelSearchCapabilities (PciIoDevice, Cached);
+  }
+}
+
+VOID
+PciBusModelDefaultConfig (
+  VOID
+  )
+{
+  MODEL_FUNCTION  *RootPort;
+  MODEL_FUNCTION  *Switch;
+  MODEL_FUNCTION  *DownstreamPort;
+  MODEL_FUNCTION  *Nvme;
+
+  PciBusModelFree ();
+
+  ZeroMem (&mPciBusModelConfig, sizeof (mPciBusModelConfig));
+  mPciBusModelConfig.ReadTime  = 800;
+  mPciBusModelConfig.WriteTime = 200;
+  mPciBusModelConfig.CallTime  = 50;
+  ZeroMem (&mPciBusModelStatistics, sizeof (mPciBusModelStatistics));
+  mModelNow = 0;
+
+  ZeroMem (mModelFunctions, sizeof (mModelFunctions));
+  ZeroMem (mModelBuses, sizeof (mModelBuses));
+  mModelFunctionCount = 0;
+  mModelBusCount      = 1;
+
+  //
+  // The first root port leads to an NVMe controller
+  //
+  RootPort = ModelCreateFunction (&mModelBuses[0], 0, 0, PCI_BUS_MODEL_ROOT_PORT_ID, 0x060400, PCIE_DEVICE_PORT_TYPE_ROOT_PORT, FALSE);
+  Nvme     = ModelCreateFunction (RootPort->SecondaryBus, 0, 0, PCI_BUS_MODEL_NVME_ID, 0x010802, PCIE_DEVICE_PORT_TYPE_PCIE_ENDPOINT, FALSE);
+  ModelSetBar64 (Nvme, PCI_BASE_ADDRESSREG_OFFSET, SIZE_16KB, FALSE);
+
+  //
+  // The second one leads to a switch, with a network controller, an NVMe
+  // controller and an empty slot under it
+  //
+  RootPort       = ModelCreateFunction (&mModelBuses[0], 1, 0, PCI_BUS_MODEL_ROOT_PORT_ID, 0x060400, PCIE_DEVICE_PORT_TYPE_ROOT_PORT, FALSE);
+  Switch         = ModelCreateFunction (RootPort->SecondaryBus, 0, 0, PCI_BUS_MODEL_UPSTREAM_ID, 0x060400, PCIE_DEVICE_PORT_TYPE_UPSTREAM_PORT, FALSE);
+  DownstreamPort = ModelCreateFunction (Switch->SecondaryBus, 0, 0, PCI_BUS_MODEL_DOWNSTREAM_ID, 0x060400, PCIE_DEVICE_PORT_TYPE_DOWNSTREAM_PORT, FALSE);
+  ModelCreateNicFunction (DownstreamPort->SecondaryBus, 0, 1);
+  ModelCreateNicFunction (DownstreamPort->SecondaryBus, 1, 0);
+  DownstreamPort = ModelCreateFunction (Switch->SecondaryBus, 1, 0, PCI_BUS_MODEL_DOWNSTREAM_ID, 0x060400, PCIE_DEVICE_PORT_TYPE_DOWNSTREAM_PORT, FALSE);
+  Nvme           = ModelCreateFunction (DownstreamPort->SecondaryBus, 0, 0, PCI_BUS_MODEL_NVME_ID, 0x010802, PCIE_DEVICE_PORT_TYPE_PCIE_ENDPOINT, FALSE);
+  ModelSetBar64 (Nvme, PCI_BASE_ADDRESSREG_OFFSET, SIZE_16KB, FALSE);
+  ModelCreateFunction (Switch->SecondaryBus, 2, 0, PCI_BUS_MODEL_DOWNSTREAM_ID, 0x060400, PCIE_DEVICE_PORT_TYPE_DOWNSTREAM_PORT, FALSE);
+
+  ZeroMem (&mModelRootBridgeIo, sizeof (mModelRootBridgeIo));
+  mModelRootBridgeIo.ParentHandle = &mModelHostBridgeHandle;
+  mModelRootBridgeIo.Pci.Read     = ModelPciRead;
+  mModelRootBridgeIo.Pci.Write    = ModelPciWrite;
+
+  CopyMem (&mModelBootServices, gBS, sizeof (EFI_BOOT_SERVICES));
+  gBS->Stall          = ModelStall;
+  gBS->OpenProtocol   = ModelOpenProtocol;
+  gBS->HandleProtocol = ModelHandleProtocol;
+}
+
+VOID
+PciBusModelFree (
+  VOID
+  )
+{
+  PciBusModelFreeDevices ();
+  if (gBS->OpenProtocol != ModelOpenProtocol) {
+    return;
+  }
+
+  CopyMem (gBS, &mModelBootServices, sizeof (EFI_BOOT_SERVICES));
+}
+
+EFI_STATUS
+PciBusModelEnumerate (
+  OUT UINT8  *SubBusNumber
+  )
+{
+  MODEL_BUS_NUMBER_RANGES  *BusNumberRanges;
+  EFI_STATUS               Status;
+  UINT8                    PaddedBusRange;
+
+  PciBusModelFreeDevices ();
+
+  mModelRootBridge = CreateRootBridge (&mModelRootBridgeHandle);
+  if (mModelRootBridge == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  BusNumberRanges = AllocateZeroPool (sizeof (*BusNumberRanges));
+  if (BusNumberRanges == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  BusNumberRanges->Bus.Desc         = ACPI_ADDRESS_SPACE_DESCRIPTOR;
+  BusNumberRanges->Bus.Len          = (UINT16)(sizeof (EFI_ACPI_ADDRESS_SPACE_DESCRIPTOR) - 3);
+  BusNumberRanges->Bus.ResType      = ACPI_ADDRESS_SPACE_TYPE_BUS;
+  BusNumberRanges->Bus.AddrRangeMin = 0;
+  BusNumberRanges->Bus.AddrRangeMax = PCI_MAX_BUS;
+  BusNumberRanges->Bus.AddrLen      = PCI_MAX_BUS + 1;
+  BusNumberRanges->End.Desc         = ACPI_END_TAG_DESCRIPTOR;
+  mModelRootBridge->BusNumberRanges = &BusNumberRanges->Bus;
+
+  //
+  // The way PciRootBridgeEnumerator() scans a root bridge
+  //
+  gFullEnumeration = TRUE;
+  ResetAllPpbBusNumber (mModelRootBridge, 0);
+
+  *SubBusNumber  = 0;
+  PaddedBusRange = 0;
+  Status         = PciScanBus (mModelRootBridge, 0, SubBusNumber, &PaddedBusRange);
+
+  ModelRecordDevices (mModelRootBridge);
+  return Status;
+}
+
+UINT32
+PciBusModelSearchCapabilities (
+  IN BOOLEAN  Cached
+  )
+{
+  UINT32  Reads;
+
+  ASSERT (mModelRootBridge != NULL);
+  Reads = mPciBusModelStatistics.Reads;
+  ModelSearchCapabilities (mModelRootBridge, Cached);
+  return mPciBusModelStatistics.Reads - Reads;
+}
+
+VOID
+PciBusModelFreeDevices (
+  VOID
+  )
+{
+  if (mModelRootBridge != NULL) {
+    DestroyRootBridge (mModelRootBridge);
+    mModelRootBridge = NULL;
+  }
+
+  ZeroMem (mPciBusModelDevices, sizeof (mPciBusModelDevices));
+  mPciBusModelDeviceCount = 0;
+}
+
+UINT64
+PciBusModelNow (
+  VOID
+  )
+{
+  return mModelNow;
+}
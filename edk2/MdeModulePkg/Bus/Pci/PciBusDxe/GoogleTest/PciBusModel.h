@@ -0,0 +1,145 @@
+/** @file
+  Interface of the ECAM model to the host test of the bus enumeration of
+  PciBusDxe.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#ifndef PCI_BUS_MODEL_H_
+#define PCI_BUS_MODEL_H_
+
+#define PCI_BUS_MODEL_MAX_DEVICES  32
+
+//
+// The vendor ID of the functions of the model, and their device IDs
+//
+#define PCI_BUS_MODEL_VENDOR_ID         0x1E30
+#define PCI_BUS_MODEL_ROOT_PORT_ID      0x2042
+#define PCI_BUS_MODEL_UPSTREAM_ID       0x2043
+#define PCI_BUS_MODEL_DOWNSTREAM_ID     0x2044
+#define PCI_BUS_MODEL_NVME_ID           0x0001
+#define PCI_BUS_MODEL_NIC_ID            0x0002
+
+//
+// The ECAM model. Times are in nanoseconds.
+//
+typedef struct {
+  UINT64    ReadTime;         // Time a configuration read takes on the link
+  UINT64    WriteTime;        // Time a configuration write takes
+  UINT64    CallTime;         // Time the host takes for a call of the root bridge
+} PCI_BUS_MODEL_CONFIG;
+
+typedef struct {
+  UINT32    Calls;
+  UINT32    Reads;            // DWORD, WORD and byte reads of the ECAM window
+  UINT32    RepeatedReads;    // Reads of a DWORD of a function read before,
+                              // with no write to the function in between
+  UINT32    Writes;
+} PCI_BUS_MODEL_STATISTICS;
+
+//
+// A function the bus enumeration found
+//
+typedef struct {
+  UINT8      Bus;
+  UINT8      Device;
+  UINT8      Function;
+  UINT16     DeviceId;
+  BOOLEAN    Bridge;
+  UINT8      SecondaryBus;    // The bus numbers the bridge was programmed with
+  UINT8      SubordinateBus;
+  BOOLEAN    IsPciExp;
+  UINT32     PciExpressCapabilityOffset;
+  UINT32     AriCapabilityOffset;
+  UINT32     SrIovCapabilityOffset;
+  BOOLEAN    IsAriEnabled;
+  UINT16     InitialVFs;
+  UINT16     ReservedBusNum;
+  UINT64     Bar0Length;
+  BOOLEAN    Bar0Mem64;
+} PCI_BUS_MODEL_DEVICE;
+
+extern PCI_BUS_MODEL_CONFIG      mPciBusModelConfig;
+extern PCI_BUS_MODEL_STATISTICS  mPciBusModelStatistics;
+extern PCI_BUS_MODEL_DEVICE      mPciBusModelDevices[PCI_BUS_MODEL_MAX_DEVICES];
+extern UINTN                     mPciBusModelDeviceCount;
+
+/**
+  Set the model to its default configuration: configuration reads of 800 ns,
+  writes of 200 ns and 50 ns for a call of the root bridge, and reset the
+  clock and the statistics. Take over the Stall (), OpenProtocol () and
+  HandleProtocol () of the boot services, the last two to open the root
+  bridge handle the model owns.
+
+  The root bus of the model has two root ports. The first one leads to an
+  NVMe controller. The second one leads to a switch with three downstream
+  ports: the first one leads to a network controller with two functions
+  supporting ARI and SR-IOV, the second one to an NVMe controller and the
+  third one is empty. All the bus numbers of the bridges are 0.
+
+**/
+VOID
+PciBusModelDefaultConfig (
+  VOID
+  );
+
+/**
+  Free the functions found by the last enumeration and give the boot
+  services back.
+
+**/
+VOID
+PciBusModelFree (
+  VOID
+  );
+
+/**
+  Enumerate the buses of the model the way the PCI bus driver does it for a
+  root bridge on its first start, and record the functions found.
+
+  @param  SubBusNumber           The last bus number the enumeration used.
+
+  @return The status of the bus scan.
+
+**/
+EFI_STATUS
+PciBusModelEnumerate (
+  OUT UINT8  *SubBusNumber
+  );
+
+/**
+  Search the capabilities the bus enumeration searches for in every function
+  found by the last enumeration, with the capability lists read again.
+
+  @param  Cached                 TRUE to search the capability lists read,
+                                 FALSE to search the configuration space
+                                 every time.
+
+  @return The number of configuration reads the searches took.
+
+**/
+UINT32
+PciBusModelSearchCapabilities (
+  IN BOOLEAN  Cached
+  );
+
+/**
+  Free the functions found by the last enumeration.
+
+**/
+VOID
+PciBusModelFreeDevices (
+  VOID
+  );
+
+/**
+  Return the time of the clock, in nanoseconds.
+
+**/
+UINT64
+PciBusModelNow (
+  VOID
+  );
+
+#endif
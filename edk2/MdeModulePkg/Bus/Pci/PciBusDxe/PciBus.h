@@ -101,6 +101,32 @@ struct _PCI_BAR {
   UINT16          Offset;
 };
 
+//
+// A capability list of a PCI function, read from the configuration space the
+// first time it is searched. The legacy list holds at most one capability per
+// DWORD of 0x40-0xFF; a list that does not fit is searched in the
+// configuration space every time.
+//
+#define PCI_MAX_CAPABILITIES  48
+
+typedef enum {
+  PciCapabilityListUnknown = 0,
+  PciCapabilityListCached,
+  PciCapabilityListUncached
+} PCI_CAPABILITY_LIST_STATE;
+
+typedef struct {
+  UINT16    Id;
+  UINT16    Offset;
+  UINT16    Next;
+} PCI_CAPABILITY_ENTRY;
+
+typedef struct {
+  PCI_CAPABILITY_LIST_STATE    State;
+  UINT8                        Count;
+  PCI_CAPABILITY_ENTRY         Entries[PCI_MAX_CAPABILITIES];
+} PCI_CAPABILITY_LIST;
+
 //
 // defined in PCI Card Specification, 8.0
 //
@@ -282,6 +308,12 @@ struct _PCI_IO_DEVICE {
   UINT16                                       BridgeIoAlignment;
   UINT32                                       ResizableBarOffset;
   UINT32                                       ResizableBarNumber;
+
+  //
+  // The capability list and the PCI Express extended capability list
+  //
+  PCI_CAPABILITY_LIST                          CapabilityList;
+  PCI_CAPABILITY_LIST                          ExpressCapabilityList;
 };
 
 #define PCI_IO_DEVICE_FROM_PCI_IO_THIS(a) \
@@ -89,6 +89,136 @@ PciCapabilitySupport (
   return FALSE;
 }
 
+/**
+  Read a capability list of a PCI function into its PCI_IO_DEVICE, with one
+  DWORD read per capability. The legacy list starts at the capability pointer
+  of the configuration header read when the function was found.
+
+  @param PciIoDevice       A pointer to the PCI_IO_DEVICE.
+  @param Express           TRUE for the PCI Express extended capability list.
+
+  @return The capability list, or NULL if it does not fit or could not be read
+          and has to be searched in the configuration space. An extended
+          list ends where the configuration space cannot be accessed.
+
+**/
+STATIC
+PCI_CAPABILITY_LIST *
+PciReadCapabilityList (
+  IN PCI_IO_DEVICE  *PciIoDevice,
+  IN BOOLEAN        Express
+  )
+{
+  PCI_CAPABILITY_LIST   *List;
+  PCI_CAPABILITY_ENTRY  *Entry;
+  EFI_STATUS            Status;
+  UINT32                CapabilityPtr;
+  UINT32                CapabilityEntry;
+
+  List = Express ? &PciIoDevice->ExpressCapabilityList : &PciIoDevice->CapabilityList;
+  if (List->State != PciCapabilityListUnknown) {
+    return (List->State == PciCapabilityListCached) ? List : NULL;
+  }
+
+  List->State = PciCapabilityListUncached;
+  List->Count = 0;
+
+  if (Express) {
+    CapabilityPtr = EFI_PCIE_CAPABILITY_BASE_OFFSET;
+  } else if (IS_CARDBUS_BRIDGE (&PciIoDevice->Pci)) {
+    CapabilityPtr = ((UINT8 *)&PciIoDevice->Pci)[EFI_PCI_CARDBUS_BRIDGE_CAPABILITY_PTR];
+  } else {
+    CapabilityPtr = ((UINT8 *)&PciIoDevice->Pci)[PCI_CAPBILITY_POINTER_OFFSET];
+  }
+
+  while (Express ? (CapabilityPtr != 0) : ((CapabilityPtr >= 0x40) && ((CapabilityPtr & 0x03) == 0x00))) {
+    if (List->Count == PCI_MAX_CAPABILITIES) {
+      return NULL;
+    }
+
+    CapabilityPtr &= 0xFFC;
+    Status         = PciIoDevice->PciIo.Pci.Read (
+                                              &PciIoDevice->PciIo,
+                                              EfiPciIoWidthUint32,
+                                              CapabilityPtr,
+                                              1,
+                                              &CapabilityEntry
+                                              );
+    if (EFI_ERROR (Status)) {
+      return NULL;
+    }
+
+    if (Express && (CapabilityEntry == MAX_UINT32)) {
+      DEBUG ((
+        DEBUG_WARN,
+        "%a: [%02x|%02x|%02x] failed to access config space at offset 0x%x\n",
+        __func__,
+        PciIoDevice->BusNumber,
+        PciIoDevice->DeviceNumber,
+        PciIoDevice->FunctionNumber,
+        CapabilityPtr
+        ));
+      break;
+    }
+
+    Entry         = &List->Entries[List->Count++];
+    Entry->Offset = (UINT16)CapabilityPtr;
+    if (Express) {
+      Entry->Id   = (UINT16)CapabilityEntry;
+      Entry->Next = (UINT16)((CapabilityEntry >> 20) & 0xFFF);
+    } else {
+      Entry->Id   = (UINT8)CapabilityEntry;
+      Entry->Next = (UINT8)(CapabilityEntry >> 8);
+      //
+      // Certain PCI device may incorrectly have capability pointing to itself,
+      // break to avoid dead loop.
+      //
+      if (Entry->Next == CapabilityPtr) {
+        break;
+      }
+    }
+
+    CapabilityPtr = Entry->Next;
+  }
+
+  List->State = PciCapabilityListCached;
+  return List;
+}
+
+/**
+  Search a capability list read by PciReadCapabilityList().
+
+  @param List              The capability list.
+  @param CapId             The capability ID.
+  @param Offset            The offset of the capability returned.
+  @param NextRegBlock      The offset of the next capability returned.
+
+  @retval EFI_SUCCESS      The capability is in the list.
+  @retval EFI_NOT_FOUND    The capability is not in the list.
+
+**/
+STATIC
+EFI_STATUS
+PciSearchCapabilityList (
+  IN  PCI_CAPABILITY_LIST  *List,
+  IN  UINT16               CapId,
+  OUT UINT32               *Offset,
+  OUT UINT32               *NextRegBlock
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < List->Count; Index++) {
+    if (List->Entries[Index].Id == CapId) {
+      *Offset       = List->Entries[Index].Offset;
+      *NextRegBlock = List->Entries[Index].Next;
+      return EFI_SUCCESS;
+    }
+  }
+
+  return EFI_NOT_FOUND;
+}
+
 /**
   Locate capability register block per capability ID.
 
@@ -110,9 +240,12 @@ LocateCapabilityRegBlock (
   OUT UINT8         *NextRegBlock OPTIONAL
   )
 {
-  UINT8   CapabilityPtr;
-  UINT16  CapabilityEntry;
-  UINT8   CapabilityID;
+  UINT8                CapabilityPtr;
+  UINT16               CapabilityEntry;
+  UINT8                CapabilityID;
+  PCI_CAPABILITY_LIST  *List;
+  UINT32               ListOffset;
+  UINT32               ListNext;
 
   //
   // To check the capability of this device supports
@@ -121,6 +254,26 @@ LocateCapabilityRegBlock (
     return EFI_UNSUPPORTED;
   }
 
+  //
+  // A search from the start of the list is answered from the list read the
+  // first time
+  //
+  if (*Offset == 0) {
+    List = PciReadCapabilityList (PciIoDevice, FALSE);
+    if (List != NULL) {
+      if (EFI_ERROR (PciSearchCapabilityList (List, CapId, &ListOffset, &ListNext))) {
+        return EFI_NOT_FOUND;
+      }
+
+      *Offset = (UINT8)ListOffset;
+      if (NextRegBlock != NULL) {
+        *NextRegBlock = (UINT8)ListNext;
+      }
+
+      return EFI_SUCCESS;
+    }
+  }
+
   if (*Offset != 0) {
     CapabilityPtr = *Offset;
   } else {
@@ -199,10 +352,12 @@ LocatePciExpressCapabilityRegBlock (
   OUT UINT32            *NextRegBlock OPTIONAL
   )
 {
-  EFI_STATUS  Status;
-  UINT32      CapabilityPtr;
-  UINT32      CapabilityEntry;
-  UINT16      CapabilityID;
+  EFI_STATUS           Status;
+  UINT32               CapabilityPtr;
+  UINT32               CapabilityEntry;
+  UINT16               CapabilityID;
+  PCI_CAPABILITY_LIST  *List;
+  UINT32               ListNext;
 
   //
   // To check the capability of this device supports
@@ -211,6 +366,22 @@ LocatePciExpressCapabilityRegBlock (
     return EFI_UNSUPPORTED;
   }
 
+  //
+  // A search from the start of the list is answered from the list read the
+  // first time
+  //
+  if (*Offset == 0) {
+    List = PciReadCapabilityList (PciIoDevice, TRUE);
+    if (List != NULL) {
+      Status = PciSearchCapabilityList (List, CapId, Offset, &ListNext);
+      if (!EFI_ERROR (Status) && (NextRegBlock != NULL)) {
+        *NextRegBlock = ListNext;
+      }
+
+      return Status;
+    }
+  }
+
   if (*Offset != 0) {
     CapabilityPtr = *Offset;
   } else {
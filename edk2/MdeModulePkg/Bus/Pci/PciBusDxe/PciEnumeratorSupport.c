@@ -61,14 +61,15 @@ PciDevicePresent (
 
   if (!EFI_ERROR (Status) && ((Pci->Hdr).VendorId != 0xffff)) {
     //
-    // Read the entire config header for the device
+    // Read the rest of the config header for the device, the IDs are read
+    // already
     //
     Status = PciRootBridgeIo->Pci.Read (
                                     PciRootBridgeIo,
                                     EfiPciWidthUint32,
-                                    Address,
-                                    sizeof (PCI_TYPE00) / sizeof (UINT32),
-                                    Pci
+                                    Address + sizeof (UINT32),
+                                    sizeof (PCI_TYPE00) / sizeof (UINT32) - 1,
+                                    (UINT32 *)Pci + 1
                                     );
 
     return EFI_SUCCESS;
@@ -102,7 +103,6 @@ PciPciDeviceInfoCollector (
   UINT8                Func;
   UINT8                SecBus;
   PCI_IO_DEVICE        *PciIoDevice;
-  EFI_PCI_IO_PROTOCOL  *PciIo;
 
   Status = EFI_SUCCESS;
   SecBus = 0;
@@ -151,15 +151,11 @@ PciPciDeviceInfoCollector (
         //
         if (!EFI_ERROR (Status) && (IS_PCI_BRIDGE (&Pci) || IS_CARDBUS_BRIDGE (&Pci))) {
           //
-          // If it is PPB, we need to get the secondary bus to continue the enumeration
+          // If it is PPB, we need to get the secondary bus to continue the enumeration.
+          // The bus numbers are not changed when the bus enumeration is disabled, so
+          // take it from the config header read when the bridge was found.
           //
-          PciIo = &(PciIoDevice->PciIo);
-
-          Status = PciIo->Pci.Read (PciIo, EfiPciIoWidthUint8, PCI_BRIDGE_SECONDARY_BUS_REGISTER_OFFSET, 1, &SecBus);
-
-          if (EFI_ERROR (Status)) {
-            return Status;
-          }
+          SecBus = ((PCI_TYPE01 *)&Pci)->Bridge.SecondaryBus;
 
           //
           // Ensure secondary bus number is greater than the primary bus number to avoid
@@ -1114,18 +1110,13 @@ GetFastBackToBackSupport (
   IN UINT8          StatusIndex
   )
 {
-  EFI_PCI_IO_PROTOCOL  *PciIo;
-  EFI_STATUS           Status;
-  UINT32               StatusRegister;
+  UINT16  StatusRegister;
 
   //
-  // Read the status register
+  // The Fast Back to Back capable bit is read-only, take the status register
+  // from the config header read when the device was found
   //
-  PciIo  = &PciIoDevice->PciIo;
-  Status = PciIo->Pci.Read (PciIo, EfiPciIoWidthUint16, StatusIndex, 1, &StatusRegister);
-  if (EFI_ERROR (Status)) {
-    return EFI_UNSUPPORTED;
-  }
+  StatusRegister = ReadUnaligned16 ((UINT16 *)((UINT8 *)&PciIoDevice->Pci + StatusIndex));
 
   //
   // Check the Fast B2B bit
@@ -2339,6 +2330,7 @@ CreatePciIoDevice (
       UINT16  VFStride;
       UINT16  FirstVFOffset;
       UINT16  Data16;
+      UINT32  Data32;
       UINT32  PFRid;
       UINT32  LastVF;
 
@@ -2394,15 +2386,18 @@ CreatePciIoDevice (
       //
 
       //
-      // Read First FirstVFOffset, InitialVFs, and VFStride
+      // Read First FirstVFOffset, InitialVFs, and VFStride. FirstVFOffset and
+      // VFStride share a DWORD.
       //
       PciIo->Pci.Read (
                    PciIo,
-                   EfiPciIoWidthUint16,
+                   EfiPciIoWidthUint32,
                    PciIoDevice->SrIovCapabilityOffset + EFI_PCIE_CAPABILITY_ID_SRIOV_FIRSTVF,
                    1,
-                   &FirstVFOffset
+                   &Data32
                    );
+      FirstVFOffset = (UINT16)Data32;
+      VFStride      = (UINT16)(Data32 >> 16);
       PciIo->Pci.Read (
                    PciIo,
                    EfiPciIoWidthUint16,
@@ -2410,13 +2405,6 @@ CreatePciIoDevice (
                    1,
                    &PciIoDevice->InitialVFs
                    );
-      PciIo->Pci.Read (
-                   PciIo,
-                   EfiPciIoWidthUint16,
-                   PciIoDevice->SrIovCapabilityOffset + EFI_PCIE_CAPABILITY_ID_SRIOV_VFSTRIDE,
-                   1,
-                   &VFStride
-                   );
       //
       // Calculate LastVF
       //
@@ -2853,15 +2841,11 @@ ResetAllPpbBusNumber (
       }
 
       if (!EFI_ERROR (Status) && (IS_PCI_BRIDGE (&Pci))) {
-        Register = 0;
-        Address  = EFI_PCI_ADDRESS (StartBusNumber, Device, Func, 0x18);
-        Status   = PciRootBridgeIo->Pci.Read (
-                                          PciRootBridgeIo,
-                                          EfiPciWidthUint32,
-                                          Address,
-                                          1,
-                                          &Register
-                                          );
+        //
+        // The bus number registers are in the config header read already
+        //
+        Register     = ReadUnaligned32 ((UINT32 *)((UINT8 *)&Pci + 0x18));
+        Address      = EFI_PCI_ADDRESS (StartBusNumber, Device, Func, 0x18);
         SecondaryBus = (UINT8)(Register >> 8);
 
         if (SecondaryBus != 0) {
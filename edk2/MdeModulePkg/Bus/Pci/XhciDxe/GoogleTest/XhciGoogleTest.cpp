@@ -0,0 +1,349 @@
+/** @file
+  Host test of the event ring dispatch and the asynchronous transfer timer of
+  XhciDxe.
+
+  The scheduler of the driver runs against the software xHCI controller of
+  XhciModel.c. The events of several slots and endpoints are posted out of
+  order and checked to reach only the URBs queued on their endpoint, the
+  event ring is run around its cycle bit several times, a device slot is torn
+  down with transfers queued on it, and the timer of the asynchronous
+  transfers is checked to back off from 1 ms to 8 ms while idle and to come
+  back at once.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+#include <Library/GoogleTestLib.h>
+
+extern "C" {
+  #include <Uefi.h>
+  #include "../Xhci.h"
+  #include "XhciModel.h"
+}
+
+using namespace testing;
+
+typedef struct {
+  UINTN     Calls;
+  UINTN     Length;
+  UINT32    Result;
+  UINT8     Pattern;
+} CALLBACK_RECORD;
+
+STATIC
+EFI_STATUS
+EFIAPI
+RecordCallback (
+  IN VOID    *Data,
+  IN UINTN   DataLength,
+  IN VOID    *Context,
+  IN UINT32  Result
+  )
+{
+  CALLBACK_RECORD  *Record;
+
+  Record          = (CALLBACK_RECORD *)Context;
+  Record->Calls  += 1;
+  Record->Length  = DataLength;
+  Record->Result  = Result;
+  Record->Pattern = (DataLength != 0) ? *(UINT8 *)Data : 0;
+  return EFI_SUCCESS;
+}
+
+class XhciSchedTest : public Test {
+protected:
+  USB_XHCI_INSTANCE    *Xhc;
+
+  VOID
+  SetUp (
+    ) override
+  {
+    Xhc = XhciModelCreate ();
+  }
+
+  VOID
+  TearDown (
+    ) override
+  {
+    XhciModelFree (Xhc);
+  }
+
+  //
+  // Queue a bulk transfer without ringing its doorbell, as XhcTransfer does
+  // before XhcExecTransfer.
+  //
+  URB *
+  Bulk (
+    UINT8  BusAddr,
+    UINT8  EpAddr,
+    VOID   *Data,
+    UINTN  Length
+    )
+  {
+    return XhcCreateUrb (Xhc, BusAddr, EpAddr, EFI_USB_SPEED_SUPER, 512, XHC_BULK_TRANSFER, NULL, Data, Length, NULL, NULL);
+  }
+
+  URB *
+  Interrupt (
+    UINT8            BusAddr,
+    UINT8            EpAddr,
+    CALLBACK_RECORD  *Record
+    )
+  {
+    return XhciInsertAsyncIntTransfer (Xhc, BusAddr, EpAddr, EFI_USB_SPEED_SUPER, 8, 8, RecordCallback, Record);
+  }
+};
+
+//
+// Every event is taken in one pass and reaches the URB queued on the slot and
+// endpoint of the event, whatever the order the events come in.
+//
+TEST_F (XhciSchedTest, EventsReachTheUrbsOfTheirEndpoint) {
+  CALLBACK_RECORD  Records[2];
+  UINT8            Buffers[3][64];
+  URB              *Async[2];
+  URB              *Urbs[3];
+  UINT64           DoorBells;
+  UINTN            Index;
+
+  ZeroMem (Records, sizeof (Records));
+  XhciModelAddDevice (Xhc, 1, 5);
+  XhciModelAddDevice (Xhc, 2, 6);
+  for (Index = 1; Index <= 2; Index++) {
+    ASSERT_EQ (XhciModelAddEndpoint (Xhc, (UINT8)Index, 0x81, ED_INTERRUPT_IN), 3);
+    ASSERT_EQ (XhciModelAddEndpoint (Xhc, (UINT8)Index, 0x82, ED_BULK_IN), 5);
+  }
+
+  Async[0] = Interrupt (5, 0x81, &Records[0]);
+  Async[1] = Interrupt (6, 0x81, &Records[1]);
+  Urbs[0]  = Bulk (5, 0x82, Buffers[0], sizeof (Buffers[0]));
+  Urbs[1]  = Bulk (5, 0x82, Buffers[1], sizeof (Buffers[1]));
+  Urbs[2]  = Bulk (6, 0x82, Buffers[2], sizeof (Buffers[2]));
+  ASSERT_TRUE (Async[0] != NULL && Async[1] != NULL);
+  ASSERT_TRUE (Urbs[0] != NULL && Urbs[1] != NULL && Urbs[2] != NULL);
+  EXPECT_EQ (XhciModelActiveUrbs (Xhc, 1, 3), 1U);
+  EXPECT_EQ (XhciModelActiveUrbs (Xhc, 1, 5), 2U);
+  EXPECT_EQ (XhciModelActiveUrbs (Xhc, 2, 3), 1U);
+  EXPECT_EQ (XhciModelActiveUrbs (Xhc, 2, 5), 1U);
+
+  ASSERT_NE (XhciModelCompleteTransfer (Xhc, 2, 5, TRB_COMPLETION_SUCCESS, 0), nullptr);
+  ASSERT_NE (XhciModelCompleteTransfer (Xhc, 1, 3, TRB_COMPLETION_SHORT_PACKET, 4), nullptr);
+  ASSERT_NE (XhciModelCompleteTransfer (Xhc, 2, 3, TRB_COMPLETION_STALL_ERROR, 8), nullptr);
+  ASSERT_NE (XhciModelCompleteTransfer (Xhc, 1, 5, TRB_COMPLETION_SUCCESS, 16), nullptr);
+  //
+  // Events naming the TRB of the second bulk transfer of slot 1 with the wrong
+  // endpoint, and with the wrong slot.
+  //
+  XhciModelPostTransferEvent (Xhc, 1, 7, Urbs[1]->TrbStart, TRB_COMPLETION_SUCCESS);
+  XhciModelPostTransferEvent (Xhc, 2, 5, Urbs[1]->TrbStart, TRB_COMPLETION_SUCCESS);
+
+  EXPECT_EQ (XhcProcessEventRing (Xhc), 6U);
+
+  EXPECT_TRUE (Urbs[0]->Finished);
+  EXPECT_EQ (Urbs[0]->Result, (UINT32)EFI_USB_NOERROR);
+  EXPECT_EQ (Urbs[0]->Completed, 48U);
+  EXPECT_EQ (Buffers[0][0], 0x15);
+  EXPECT_FALSE (Urbs[1]->Finished);
+  EXPECT_EQ (Urbs[1]->Completed, 0U);
+  EXPECT_TRUE (Urbs[2]->Finished);
+  EXPECT_EQ (Urbs[2]->Result, (UINT32)EFI_USB_NOERROR);
+  EXPECT_EQ (Urbs[2]->Completed, 64U);
+  EXPECT_EQ (Buffers[2][0], 0x25);
+  EXPECT_TRUE (Async[0]->Finished);
+  EXPECT_EQ (Async[0]->Result, (UINT32)EFI_USB_NOERROR);
+  EXPECT_EQ (Async[0]->Completed, 4U);
+  EXPECT_TRUE (Async[1]->Finished);
+  EXPECT_EQ (Async[1]->Result, (UINT32)EFI_USB_ERR_STALL);
+
+  //
+  // The timer hands both to their callbacks, and queues again and rings only
+  // the one that succeeded.
+  //
+  DoorBells = mXhciModelStatistics.DoorBells;
+  XhciModelTick (Xhc);
+  EXPECT_EQ (Records[0].Calls, 1U);
+  EXPECT_EQ (Records[0].Result, (UINT32)EFI_USB_NOERROR);
+  EXPECT_EQ (Records[0].Length, 4U);
+  EXPECT_EQ (Records[0].Pattern, 0x13);
+  EXPECT_EQ (Records[1].Calls, 1U);
+  EXPECT_EQ (Records[1].Result, (UINT32)EFI_USB_ERR_STALL);
+  EXPECT_EQ (mXhciModelStatistics.DoorBells, DoorBells + 1);
+  EXPECT_FALSE (Async[0]->Finished);
+
+  for (Index = 0; Index < 3; Index++) {
+    XhcFreeUrb (Xhc, Urbs[Index]);
+  }
+
+  EXPECT_EQ (XhciModelActiveUrbs (Xhc, 1, 5), 0U);
+  EXPECT_EQ (XhciModelActiveUrbs (Xhc, 2, 5), 0U);
+  EXPECT_EQ (XhciModelActiveUrbs (Xhc, 1, 3), 1U);
+}
+
+//
+// The event ring and the transfer ring are run around several times, with the
+// wrap falling inside a pass. A pass that finds the ring empty does not touch
+// the registers, and a pass with events writes the dequeue pointer once.
+//
+TEST_F (XhciSchedTest, TheEventRingWrapsAroundItsCycleBit) {
+  UINT8   Data[16];
+  URB     *Urbs[7];
+  UINTN   Total;
+  UINTN   Count;
+  UINTN   Round;
+  UINTN   Index;
+  UINT64  ErdpWrites;
+  UINT64  Reads;
+  UINT64  Writes;
+
+  XhciModelAddDevice (Xhc, 1, 1);
+  ASSERT_EQ (XhciModelAddEndpoint (Xhc, 1, 0x82, ED_BULK_IN), 5);
+
+  Total = 0;
+  for (Round = 0; Total < 3 * EVENT_RING_TRB_NUMBER + 5; Round++) {
+    Count = 1 + Round % ARRAY_SIZE (Urbs);
+    for (Index = 0; Index < Count; Index++) {
+      Urbs[Index] = Bulk (1, 0x82, Data, sizeof (Data));
+      ASSERT_NE (Urbs[Index], nullptr);
+      ASSERT_NE (XhciModelCompleteTransfer (Xhc, 1, 5, TRB_COMPLETION_SUCCESS, 0), nullptr);
+    }
+
+    ErdpWrites = mXhciModelStatistics.ErdpWrites;
+    ASSERT_EQ (XhcProcessEventRing (Xhc), Count);
+    EXPECT_EQ (mXhciModelStatistics.ErdpWrites, ErdpWrites + 1);
+    for (Index = 0; Index < Count; Index++) {
+      EXPECT_TRUE (Urbs[Index]->Finished);
+      EXPECT_EQ (Urbs[Index]->Completed, sizeof (Data));
+      XhcFreeUrb (Xhc, Urbs[Index]);
+    }
+
+    Total += Count;
+
+    Reads  = mXhciModelStatistics.RegisterReads;
+    Writes = mXhciModelStatistics.RegisterWrites;
+    EXPECT_EQ (XhcProcessEventRing (Xhc), 0U);
+    EXPECT_EQ (mXhciModelStatistics.RegisterReads, Reads);
+    EXPECT_EQ (mXhciModelStatistics.RegisterWrites, Writes);
+  }
+
+  EXPECT_EQ (Xhc->EventRing.EventRingCCS, ((Total / EVENT_RING_TRB_NUMBER) % 2 == 0) ? 1U : 0U);
+  EXPECT_EQ (Xhc->EventRing.EventRingDequeue, (TRB_TEMPLATE *)Xhc->EventRing.EventRingSeg0 + Total % EVENT_RING_TRB_NUMBER);
+  EXPECT_EQ (mXhciModelStatistics.Events, (UINT64)Total);
+  EXPECT_EQ (Xhc->Statistics.Events, (UINT64)Total);
+}
+
+//
+// Disabling a slot takes the URBs queued on it out of the event dispatch, so a
+// late event for the slot is dropped and the URBs may be freed, while the
+// transfers of the other slots go on.
+//
+TEST_F (XhciSchedTest, TearingDownASlotRemovesItsUrbs) {
+  CALLBACK_RECORD  Records[2];
+  UINT8            Data[64];
+  URB              *Urb;
+  TRB_TEMPLATE     *StaleTrb;
+
+  ZeroMem (Records, sizeof (Records));
+  XhciModelAddDevice (Xhc, 1, 1);
+  XhciModelAddDevice (Xhc, 2, 2);
+  ASSERT_EQ (XhciModelAddEndpoint (Xhc, 1, 0x81, ED_INTERRUPT_IN), 3);
+  ASSERT_EQ (XhciModelAddEndpoint (Xhc, 1, 0x82, ED_BULK_IN), 5);
+  ASSERT_EQ (XhciModelAddEndpoint (Xhc, 2, 0x81, ED_INTERRUPT_IN), 3);
+  ASSERT_NE (Interrupt (1, 0x81, &Records[0]), nullptr);
+  ASSERT_NE (Interrupt (2, 0x81, &Records[1]), nullptr);
+  Urb = Bulk (1, 0x82, Data, sizeof (Data));
+  ASSERT_NE (Urb, nullptr);
+  StaleTrb = Urb->TrbStart;
+
+  ASSERT_EQ (XhcDisableSlotCmd (Xhc, 1), EFI_SUCCESS);
+  EXPECT_FALSE (Xhc->UsbDevContext[1].Enabled);
+  EXPECT_EQ (XhciModelActiveUrbs (Xhc, 1, 3), 0U);
+  EXPECT_EQ (XhciModelActiveUrbs (Xhc, 1, 5), 0U);
+  EXPECT_EQ (XhciModelActiveUrbs (Xhc, 2, 3), 1U);
+
+  XhciModelPostTransferEvent (Xhc, 1, 5, StaleTrb, TRB_COMPLETION_SUCCESS);
+  EXPECT_EQ (XhcProcessEventRing (Xhc), 1U);
+  EXPECT_FALSE (Urb->Finished);
+  XhcFreeUrb (Xhc, Urb);
+
+  ASSERT_NE (XhciModelCompleteTransfer (Xhc, 2, 3, TRB_COMPLETION_SUCCESS, 0), nullptr);
+  XhciModelTick (Xhc);
+  EXPECT_EQ (Records[0].Calls, 0U);
+  EXPECT_EQ (Records[1].Calls, 1U);
+  EXPECT_EQ (Records[1].Pattern, 0x23);
+
+  //
+  // The bus driver removes the transfer of the gone device afterwards.
+  //
+  EXPECT_EQ (XhciDelAsyncIntTransfer (Xhc, 1, 0x81), EFI_SUCCESS);
+  EXPECT_EQ (XhciModelActiveUrbs (Xhc, 2, 3), 1U);
+}
+
+//
+// The timer of the asynchronous transfers doubles its period after every
+// XHC_ASYNC_TIMER_IDLE_POLLS idle ticks up to 8 ms, without touching the
+// registers, and goes back to 1 ms when a transfer completes or starts.
+//
+TEST_F (XhciSchedTest, TheTimerBacksOffWhileIdle) {
+  CALLBACK_RECORD  Record;
+  UINT64           Sets;
+  UINT64           Reads;
+  UINT64           Writes;
+  UINT64           Start;
+  UINTN            Tick;
+
+  ZeroMem (&Record, sizeof (Record));
+  XhciModelAddDevice (Xhc, 1, 1);
+  ASSERT_EQ (XhciModelAddEndpoint (Xhc, 1, 0x81, ED_INTERRUPT_IN), 3);
+  ASSERT_EQ (XhciModelAddEndpoint (Xhc, 1, 0x83, ED_INTERRUPT_IN), 7);
+  ASSERT_NE (Interrupt (1, 0x81, &Record), nullptr);
+  EXPECT_EQ (mXhciModelStatistics.PollPeriod, XHC_ASYNC_TIMER_INTERVAL);
+
+  Sets   = mXhciModelStatistics.PollTimerSets;
+  Reads  = mXhciModelStatistics.RegisterReads;
+  Writes = mXhciModelStatistics.RegisterWrites;
+  for (Tick = 1; Tick <= 4 * XHC_ASYNC_TIMER_IDLE_POLLS + 16; Tick++) {
+    XhciModelTick (Xhc);
+    ASSERT_EQ (
+      mXhciModelStatistics.PollPeriod,
+      MIN (XHC_ASYNC_TIMER_INTERVAL << (Tick / XHC_ASYNC_TIMER_IDLE_POLLS), XHC_ASYNC_TIMER_MAX_INTERVAL)
+      ) << "tick " << Tick;
+  }
+
+  EXPECT_EQ (mXhciModelStatistics.PollPeriod, XHC_ASYNC_TIMER_MAX_INTERVAL);
+  EXPECT_EQ (mXhciModelStatistics.PollTimerSets, Sets + 3);
+  EXPECT_EQ (mXhciModelStatistics.RegisterReads, Reads);
+  EXPECT_EQ (mXhciModelStatistics.RegisterWrites, Writes);
+  EXPECT_EQ (Record.Calls, 0U);
+
+  //
+  // A completion is seen within one period of 8 ms, and brings 1 ms back.
+  //
+  ASSERT_NE (XhciModelCompleteTransfer (Xhc, 1, 3, TRB_COMPLETION_SUCCESS, 0), nullptr);
+  Start = XhciModelNow ();
+  XhciModelTick (Xhc);
+  EXPECT_EQ (Record.Calls, 1U);
+  EXPECT_LE (XhciModelNow () - Start, XHC_ASYNC_TIMER_MAX_INTERVAL);
+  EXPECT_EQ (mXhciModelStatistics.PollPeriod, XHC_ASYNC_TIMER_INTERVAL);
+  EXPECT_EQ (mXhciModelStatistics.PollTimerSets, Sets + 4);
+
+  //
+  // So does a new transfer.
+  //
+  for (Tick = 0; Tick < XHC_ASYNC_TIMER_IDLE_POLLS; Tick++) {
+    XhciModelTick (Xhc);
+  }
+
+  EXPECT_EQ (mXhciModelStatistics.PollPeriod, 2 * XHC_ASYNC_TIMER_INTERVAL);
+  ASSERT_NE (Interrupt (1, 0x83, &Record), nullptr);
+  EXPECT_EQ (mXhciModelStatistics.PollPeriod, XHC_ASYNC_TIMER_INTERVAL);
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
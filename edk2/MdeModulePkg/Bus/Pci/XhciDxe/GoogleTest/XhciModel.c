@@ -0,0 +1,699 @@
+/** @file
+  A software xHCI controller behind a PCI I/O protocol, for the host test of
+  the event ring dispatch and the asynchronous transfer timer of XhciDxe.
+
+  The controller runs the commands of the command ring when doorbell 0 is
+  written, and posts their completion events at once. It keeps a dequeue
+  pointer on the transfer ring of every endpoint, but completes the transfers
+  only when the test asks it to, so the test decides the order the events
+  come in. The registers, the event ring full check and the doorbells are
+  modeled; the ports, the contexts and the interrupters are not. The clock is
+  in 100 ns units and moves with the stalls of the driver and the ticks of
+  the timer. The model takes over the event, timer, stall and pool services
+  of UnitTestUefiBootServicesTableLib for that.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "../Xhci.h"
+#include "XhciModel.h"
+
+#define MODEL_CAPLENGTH   0x20
+#define MODEL_RTSOFF      0x600
+#define MODEL_DBOFF       0x800
+#define MODEL_REGS        16
+#define MODEL_MAX_SLOTS   8
+#define MODEL_MAX_EVENTS  8
+
+typedef struct {
+  TRB_TEMPLATE    *Dequeue;
+  UINT8           Ccs;
+} MODEL_ENDPOINT;
+
+typedef struct {
+  BOOLEAN             Used;
+  EFI_EVENT_NOTIFY    NotifyFunction;
+  VOID                *NotifyContext;
+  EFI_TIMER_DELAY     Type;
+  UINT64              Period;
+  UINT64              Deadline;
+} MODEL_EVENT;
+
+XHCI_MODEL_STATISTICS  mXhciModelStatistics;
+
+STATIC EFI_PCI_IO_PROTOCOL  mModelPciIo;
+STATIC EFI_BOOT_SERVICES    mModelBootServices;
+STATIC MODEL_EVENT          mModelEvents[MODEL_MAX_EVENTS];
+STATIC MODEL_EVENT          *mModelPollTimer;
+
+STATIC UINT64          mModelNow;
+STATIC UINT32          mModelOpRegs[MODEL_REGS];
+STATIC UINT32          mModelRuntimeRegs[MODEL_REGS];
+STATIC TRB_TEMPLATE    *mModelCmdDequeue;
+STATIC UINT8           mModelCmdCcs;
+STATIC TRB_TEMPLATE    *mModelEventRing;
+STATIC UINT32          mModelEventRingSize;
+STATIC UINT32          mModelEventEnqueue;
+STATIC UINT8           mModelEventPcs;
+STATIC MODEL_ENDPOINT  mModelEndpoints[MODEL_MAX_SLOTS + 1][32];
+
+/**
+  Return the TRB a link TRB points to, or the TRB itself if it is not a link
+  TRB, toggling the cycle state as the link TRB says.
+
+**/
+STATIC
+TRB_TEMPLATE *
+ModelFollowLink (
+  IN     TRB_TEMPLATE  *Trb,
+  IN OUT UINT8         *Ccs
+  )
+{
+  LINK_TRB  *Link;
+
+  if ((Trb->Type != TRB_TYPE_LINK) || (Trb->CycleBit != *Ccs)) {
+    return Trb;
+  }
+
+  Link = (LINK_TRB *)Trb;
+  if (Link->TC != 0) {
+    *Ccs ^= 1;
+  }
+
+  return (TRB_TEMPLATE *)(UINTN)(Link->PtrLo | LShiftU64 (Link->PtrHi, 32));
+}
+
+/**
+  Post an event on the event ring. The ring is full when the enqueue pointer
+  would reach the Event Ring Dequeue Pointer the driver last wrote.
+
+**/
+STATIC
+VOID
+ModelPostEvent (
+  IN TRB_TEMPLATE  *Event
+  )
+{
+  TRB_TEMPLATE  *Trb;
+  UINT64        Erdp;
+  UINT32        Dequeue;
+
+  ASSERT (mModelEventRing != NULL);
+  Erdp    = (mModelRuntimeRegs[XHC_ERDP_OFFSET / 4] & ~0xFU) | LShiftU64 (mModelRuntimeRegs[XHC_ERDP_OFFSET / 4 + 1], 32);
+  Dequeue = (UINT32)((Erdp - (UINTN)mModelEventRing) / sizeof (TRB_TEMPLATE));
+  ASSERT ((mModelEventEnqueue + 1) % mModelEventRingSize != Dequeue);
+
+  Trb             = &mModelEventRing[mModelEventEnqueue];
+  Event->CycleBit = mModelEventPcs;
+  CopyMem (Trb, Event, sizeof (TRB_TEMPLATE));
+  if (++mModelEventEnqueue == mModelEventRingSize) {
+    mModelEventEnqueue = 0;
+    mModelEventPcs    ^= 1;
+  }
+
+  mXhciModelStatistics.Events++;
+}
+
+/**
+  Run the commands queued on the command ring. Every command succeeds.
+
+**/
+STATIC
+VOID
+ModelRunCommands (
+  VOID
+  )
+{
+  TRB_TEMPLATE                *Trb;
+  EVT_TRB_COMMAND_COMPLETION  Event;
+  MODEL_ENDPOINT              *Endpoint;
+  UINT8                       SlotId;
+
+  Trb = ModelFollowLink (mModelCmdDequeue, &mModelCmdCcs);
+  while (Trb->CycleBit == mModelCmdCcs) {
+    mXhciModelStatistics.Commands++;
+    SlotId = (UINT8)(Trb->Control >> 8);
+    ASSERT (SlotId <= MODEL_MAX_SLOTS);
+    switch (Trb->Type) {
+      case TRB_TYPE_DIS_SLOT:
+        ZeroMem (mModelEndpoints[SlotId], sizeof (mModelEndpoints[SlotId]));
+        break;
+
+      case TRB_TYPE_SET_TR_DEQUE:
+        Endpoint          = &mModelEndpoints[SlotId][Trb->Control & 0x1F];
+        Endpoint->Dequeue = (TRB_TEMPLATE *)(UINTN)((Trb->Parameter1 & ~0xFU) | LShiftU64 (Trb->Parameter2, 32));
+        Endpoint->Ccs     = (UINT8)(Trb->Parameter1 & BIT0);
+        break;
+
+      default:
+        break;
+    }
+
+    ZeroMem (&Event, sizeof (Event));
+    Event.TRBPtrLo     = XHC_LOW_32BIT (Trb);
+    Event.TRBPtrHi     = XHC_HIGH_32BIT (Trb);
+    Event.Completecode = TRB_COMPLETION_SUCCESS;
+    Event.Type         = TRB_TYPE_COMMAND_COMPLT_EVENT;
+    Event.SlotId       = SlotId;
+    ModelPostEvent ((TRB_TEMPLATE *)&Event);
+    Trb = ModelFollowLink (Trb + 1, &mModelCmdCcs);
+  }
+
+  mModelCmdDequeue = Trb;
+}
+
+STATIC
+UINT32
+ModelReadRegister (
+  IN UINT64  Offset
+  )
+{
+  if (Offset < MODEL_CAPLENGTH) {
+    switch (Offset) {
+      case XHC_CAPLENGTH_OFFSET:
+        return MODEL_CAPLENGTH | (0x0110 << 16);
+
+      case XHC_HCSPARAMS1_OFFSET:
+        return MODEL_MAX_SLOTS | (1 << 8) | (4 << 24);
+
+      case XHC_HCCPARAMS_OFFSET:
+        return BIT0;
+
+      case XHC_DBOFF_OFFSET:
+        return MODEL_DBOFF;
+
+      case XHC_RTSOFF_OFFSET:
+        return MODEL_RTSOFF;
+
+      default:
+        return 0;
+    }
+  }
+
+  if (Offset < MODEL_CAPLENGTH + MODEL_REGS * 4) {
+    if (Offset - MODEL_CAPLENGTH == XHC_PAGESIZE_OFFSET) {
+      return BIT0;
+    }
+
+    return mModelOpRegs[(Offset - MODEL_CAPLENGTH) / 4];
+  }
+
+  if ((Offset >= MODEL_RTSOFF) && (Offset < MODEL_RTSOFF + MODEL_REGS * 4)) {
+    return mModelRuntimeRegs[(Offset - MODEL_RTSOFF) / 4];
+  }
+
+  return 0;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelMemRead (
+  IN     EFI_PCI_IO_PROTOCOL        *This,
+  IN     EFI_PCI_IO_PROTOCOL_WIDTH  Width,
+  IN     UINT8                      BarIndex,
+  IN     UINT64                     Offset,
+  IN     UINTN                      Count,
+  IN OUT VOID                       *Buffer
+  )
+{
+  UINT32  Value;
+
+  ASSERT (Count == 1);
+  mXhciModelStatistics.RegisterReads++;
+  Value = ModelReadRegister (Offset & ~3ULL);
+  if (Width == EfiPciIoWidthUint8) {
+    *(UINT8 *)Buffer = (UINT8)(Value >> ((Offset & 3) * 8));
+  } else {
+    ASSERT (Width == EfiPciIoWidthUint32);
+    *(UINT32 *)Buffer = Value;
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelMemWrite (
+  IN     EFI_PCI_IO_PROTOCOL        *This,
+  IN     EFI_PCI_IO_PROTOCOL_WIDTH  Width,
+  IN     UINT8                      BarIndex,
+  IN     UINT64                     Offset,
+  IN     UINTN                      Count,
+  IN OUT VOID                       *Buffer
+  )
+{
+  UINT32                      Value;
+  UINT32                      Index;
+  EVENT_RING_SEG_TABLE_ENTRY  *Erst;
+
+  ASSERT (Width == EfiPciIoWidthUint32 && Count == 1);
+  mXhciModelStatistics.RegisterWrites++;
+  Value = *(UINT32 *)Buffer;
+
+  if (Offset >= MODEL_DBOFF) {
+    if (Offset == MODEL_DBOFF) {
+      ModelRunCommands ();
+    } else {
+      mXhciModelStatistics.DoorBells++;
+    }
+
+    return EFI_SUCCESS;
+  }
+
+  if ((Offset >= MODEL_CAPLENGTH) && (Offset < MODEL_CAPLENGTH + MODEL_REGS * 4)) {
+    Index = (UINT32)(Offset - MODEL_CAPLENGTH) / 4;
+    if (Index == XHC_USBSTS_OFFSET / 4) {
+      return EFI_SUCCESS;
+    }
+
+    mModelOpRegs[Index] = Value;
+    if (Index == XHC_CRCR_OFFSET / 4 + 1) {
+      mModelCmdDequeue = (TRB_TEMPLATE *)(UINTN)((mModelOpRegs[XHC_CRCR_OFFSET / 4] & ~0x3FU) | LShiftU64 (Value, 32));
+      mModelCmdCcs     = (UINT8)(mModelOpRegs[XHC_CRCR_OFFSET / 4] & XHC_CRCR_RCS);
+    }
+
+    return EFI_SUCCESS;
+  }
+
+  if ((Offset >= MODEL_RTSOFF) && (Offset < MODEL_RTSOFF + MODEL_REGS * 4)) {
+    Index                    = (UINT32)(Offset - MODEL_RTSOFF) / 4;
+    mModelRuntimeRegs[Index] = Value;
+    if (Index == XHC_ERSTBA_OFFSET / 4 + 1) {
+      Erst                = (EVENT_RING_SEG_TABLE_ENTRY *)(UINTN)(mModelRuntimeRegs[XHC_ERSTBA_OFFSET / 4] | LShiftU64 (Value, 32));
+      mModelEventRing     = (TRB_TEMPLATE *)(UINTN)(Erst->PtrLo | LShiftU64 (Erst->PtrHi, 32));
+      mModelEventRingSize = Erst->RingTrbSize;
+      mModelEventEnqueue  = 0;
+      mModelEventPcs      = 1;
+    } else if (Index == XHC_ERDP_OFFSET / 4 + 1) {
+      mXhciModelStatistics.ErdpWrites++;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelMap (
+  IN     EFI_PCI_IO_PROTOCOL            *This,
+  IN     EFI_PCI_IO_PROTOCOL_OPERATION  Operation,
+  IN     VOID                           *HostAddress,
+  IN OUT UINTN                          *NumberOfBytes,
+  OUT    EFI_PHYSICAL_ADDRESS           *DeviceAddress,
+  OUT    VOID                           **Mapping
+  )
+{
+  *DeviceAddress = (EFI_PHYSICAL_ADDRESS)(UINTN)HostAddress;
+  *Mapping       = HostAddress;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelUnmap (
+  IN EFI_PCI_IO_PROTOCOL  *This,
+  IN VOID                 *Mapping
+  )
+{
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelAllocateBuffer (
+  IN  EFI_PCI_IO_PROTOCOL  *This,
+  IN  EFI_ALLOCATE_TYPE    Type,
+  IN  EFI_MEMORY_TYPE      MemoryType,
+  IN  UINTN                Pages,
+  OUT VOID                 **HostAddress,
+  IN  UINT64               Attributes
+  )
+{
+  *HostAddress = AllocatePages (Pages);
+  return (*HostAddress == NULL) ? EFI_OUT_OF_RESOURCES : EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelFreeBuffer (
+  IN  EFI_PCI_IO_PROTOCOL  *This,
+  IN  UINTN                Pages,
+  IN  VOID                 *HostAddress
+  )
+{
+  FreePages (HostAddress, Pages);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction OPTIONAL,
+  IN  VOID              *NotifyContext OPTIONAL,
+  OUT EFI_EVENT         *Event
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < MODEL_MAX_EVENTS; Index++) {
+    if (!mModelEvents[Index].Used) {
+      ZeroMem (&mModelEvents[Index], sizeof (MODEL_EVENT));
+      mModelEvents[Index].Used           = TRUE;
+      mModelEvents[Index].NotifyFunction = NotifyFunction;
+      mModelEvents[Index].NotifyContext  = NotifyContext;
+      mModelEvents[Index].Type           = TimerCancel;
+      *Event                             = &mModelEvents[Index];
+      return EFI_SUCCESS;
+    }
+  }
+
+  return EFI_OUT_OF_RESOURCES;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ((MODEL_EVENT *)Event)->Used = FALSE;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelSetTimer (
+  IN EFI_EVENT        Event,
+  IN EFI_TIMER_DELAY  Type,
+  IN UINT64           TriggerTime
+  )
+{
+  MODEL_EVENT  *ModelEvent;
+
+  ModelEvent           = (MODEL_EVENT *)Event;
+  ModelEvent->Type     = Type;
+  ModelEvent->Period   = TriggerTime;
+  ModelEvent->Deadline = mModelNow + TriggerTime;
+  if (ModelEvent == mModelPollTimer) {
+    mXhciModelStatistics.PollTimerSets++;
+    mXhciModelStatistics.PollPeriod = (Type == TimerPeriodic) ? TriggerTime : 0;
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCheckEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  MODEL_EVENT  *ModelEvent;
+
+  ModelEvent = (MODEL_EVENT *)Event;
+  ASSERT (ModelEvent->Type != TimerCancel);
+  return (mModelNow >= ModelEvent->Deadline) ? EFI_SUCCESS : EFI_NOT_READY;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelStall (
+  IN UINTN  Microseconds
+  )
+{
+  mModelNow += MultU64x32 (Microseconds, 10);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelFreePool (
+  IN VOID  *Buffer
+  )
+{
+  FreePool (Buffer);
+  return EFI_SUCCESS;
+}
+
+USB_XHCI_INSTANCE *
+XhciModelCreate (
+  VOID
+  )
+{
+  USB_XHCI_INSTANCE  *Xhc;
+  EFI_STATUS         Status;
+  UINTN              Index;
+
+  ZeroMem (mModelEvents, sizeof (mModelEvents));
+  ZeroMem (mModelOpRegs, sizeof (mModelOpRegs));
+  ZeroMem (mModelRuntimeRegs, sizeof (mModelRuntimeRegs));
+  ZeroMem (mModelEndpoints, sizeof (mModelEndpoints));
+  mModelNow       = 0;
+  mModelEventRing = NULL;
+
+  ZeroMem (&mModelPciIo, sizeof (mModelPciIo));
+  mModelPciIo.Mem.Read       = ModelMemRead;
+  mModelPciIo.Mem.Write      = ModelMemWrite;
+  mModelPciIo.Map            = ModelMap;
+  mModelPciIo.Unmap          = ModelUnmap;
+  mModelPciIo.AllocateBuffer = ModelAllocateBuffer;
+  mModelPciIo.FreeBuffer     = ModelFreeBuffer;
+
+  CopyMem (&mModelBootServices, gBS, sizeof (EFI_BOOT_SERVICES));
+  gBS->CreateEvent = ModelCreateEvent;
+  gBS->CloseEvent  = ModelCloseEvent;
+  gBS->SetTimer    = ModelSetTimer;
+  gBS->CheckEvent  = ModelCheckEvent;
+  gBS->Stall       = ModelStall;
+  gBS->FreePool    = ModelFreePool;
+
+  Xhc = AllocateZeroPool (sizeof (USB_XHCI_INSTANCE));
+  ASSERT (Xhc != NULL);
+  Xhc->Signature = XHCI_INSTANCE_SIG;
+  Xhc->PciIo     = &mModelPciIo;
+  InitializeListHead (&Xhc->AsyncIntTransfers);
+  InitializeListHead (&Xhc->StreamTransfers);
+  for (Index = 0; Index < ARRAY_SIZE (Xhc->ActiveUrbs); Index++) {
+    InitializeListHead (&Xhc->ActiveUrbs[Index]);
+  }
+
+  Xhc->CapLength        = XhcReadCapReg8 (Xhc, XHC_CAPLENGTH_OFFSET);
+  Xhc->HcSParams1.Dword = XhcReadCapReg (Xhc, XHC_HCSPARAMS1_OFFSET);
+  Xhc->HcSParams2.Dword = XhcReadCapReg (Xhc, XHC_HCSPARAMS2_OFFSET);
+  Xhc->HcCParams.Dword  = XhcReadCapReg (Xhc, XHC_HCCPARAMS_OFFSET);
+  Xhc->DBOff            = XhcReadCapReg (Xhc, XHC_DBOFF_OFFSET);
+  Xhc->RTSOff           = XhcReadCapReg (Xhc, XHC_RTSOFF_OFFSET);
+  Xhc->PageSize         = 1 << (HighBitSet32 (XhcReadOpReg (Xhc, XHC_PAGESIZE_OFFSET) & XHC_PAGESIZE_MASK) + 12);
+
+  Status = gBS->CreateEvent (
+                  EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                  TPL_NOTIFY,
+                  XhcMonitorAsyncRequests,
+                  Xhc,
+                  &Xhc->PollTimer
+                  );
+  ASSERT_EFI_ERROR (Status);
+  mModelPollTimer = (MODEL_EVENT *)Xhc->PollTimer;
+
+  XhcInitSched (Xhc);
+  Xhc->PollInterval = XHC_ASYNC_TIMER_INTERVAL;
+  gBS->SetTimer (Xhc->PollTimer, TimerPeriodic, Xhc->PollInterval);
+
+  ZeroMem (&mXhciModelStatistics, sizeof (mXhciModelStatistics));
+  mXhciModelStatistics.PollPeriod = Xhc->PollInterval;
+  return Xhc;
+}
+
+VOID
+XhciModelFree (
+  IN USB_XHCI_INSTANCE  *Xhc
+  )
+{
+  UINT8  SlotId;
+
+  XhciDelAllAsyncIntTransfers (Xhc);
+  for (SlotId = 1; SlotId <= MODEL_MAX_SLOTS; SlotId++) {
+    if (Xhc->UsbDevContext[SlotId].Enabled) {
+      XhcDisableSlotCmd (Xhc, SlotId);
+    }
+  }
+
+  XhcFreeSched (Xhc);
+  gBS->CloseEvent (Xhc->PollTimer);
+  FreePool (Xhc);
+  mModelPollTimer = NULL;
+  CopyMem (gBS, &mModelBootServices, sizeof (EFI_BOOT_SERVICES));
+}
+
+VOID
+XhciModelAddDevice (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              BusAddr
+  )
+{
+  USB_DEV_CONTEXT  *DevContext;
+  VOID             *OutputContext;
+
+  ASSERT (SlotId != 0 && SlotId <= MODEL_MAX_SLOTS);
+  OutputContext = UsbHcAllocateMem (Xhc->MemPool, sizeof (DEVICE_CONTEXT), FALSE);
+  ASSERT (OutputContext != NULL);
+  ZeroMem (OutputContext, sizeof (DEVICE_CONTEXT));
+
+  DevContext                    = &Xhc->UsbDevContext[SlotId];
+  DevContext->Enabled           = TRUE;
+  DevContext->SlotId            = SlotId;
+  DevContext->BusDevAddr        = BusAddr;
+  DevContext->RouteString.Dword = SlotId;
+  DevContext->OutputContext     = OutputContext;
+  Xhc->DCBAA[SlotId]            = UsbHcGetPciAddrForHostAddr (Xhc->MemPool, OutputContext, sizeof (DEVICE_CONTEXT));
+}
+
+UINT8
+XhciModelAddEndpoint (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              EpAddr,
+  IN UINT8              EpType
+  )
+{
+  TRANSFER_RING   *Ring;
+  DEVICE_CONTEXT  *OutputContext;
+  UINT8           Dci;
+
+  Dci  = XhcEndpointToDci (EpAddr & 0x0F, ((EpAddr & 0x80) != 0) ? EfiUsbDataIn : EfiUsbDataOut);
+  Ring = AllocateZeroPool (sizeof (TRANSFER_RING));
+  ASSERT (Ring != NULL);
+  CreateTransferRing (Xhc, TR_RING_TRB_NUMBER, Ring);
+
+  OutputContext                                            = Xhc->UsbDevContext[SlotId].OutputContext;
+  OutputContext->EP[Dci - 1].EPType                        = EpType;
+  Xhc->UsbDevContext[SlotId].EndpointTransferRing[Dci - 1] = Ring;
+
+  mModelEndpoints[SlotId][Dci].Dequeue = Ring->RingSeg0;
+  mModelEndpoints[SlotId][Dci].Ccs     = 1;
+  return Dci;
+}
+
+VOID
+XhciModelPostTransferEvent (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci,
+  IN TRB_TEMPLATE       *Trb,
+  IN UINT8              CompletionCode
+  )
+{
+  EVT_TRB_TRANSFER  Event;
+
+  ZeroMem (&Event, sizeof (Event));
+  Event.TRBPtrLo     = XHC_LOW_32BIT (Trb);
+  Event.TRBPtrHi     = XHC_HIGH_32BIT (Trb);
+  Event.Completecode = CompletionCode;
+  Event.Type         = TRB_TYPE_TRANS_EVENT;
+  Event.EndpointId   = Dci;
+  Event.SlotId       = SlotId;
+  ModelPostEvent ((TRB_TEMPLATE *)&Event);
+}
+
+TRB_TEMPLATE *
+XhciModelCompleteTransfer (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci,
+  IN UINT8              CompletionCode,
+  IN UINT32             Residual
+  )
+{
+  MODEL_ENDPOINT       *Endpoint;
+  TRB_TEMPLATE         *Trb;
+  TRANSFER_TRB_NORMAL  *Normal;
+  EVT_TRB_TRANSFER     Event;
+
+  Endpoint = &mModelEndpoints[SlotId][Dci];
+  if (Endpoint->Dequeue == NULL) {
+    return NULL;
+  }
+
+  Trb = ModelFollowLink (Endpoint->Dequeue, &Endpoint->Ccs);
+  if (Trb->CycleBit != Endpoint->Ccs) {
+    Endpoint->Dequeue = Trb;
+    return NULL;
+  }
+
+  Normal = (TRANSFER_TRB_NORMAL *)Trb;
+  ASSERT (Residual <= Normal->Length);
+  if ((Trb->Type == TRB_TYPE_NORMAL) && ((Dci & 1) != 0)) {
+    SetMem (
+      (VOID *)(UINTN)(Normal->TRBPtrLo | LShiftU64 (Normal->TRBPtrHi, 32)),
+      Normal->Length - Residual,
+      (UINT8)((SlotId << 4) | Dci)
+      );
+  }
+
+  ZeroMem (&Event, sizeof (Event));
+  Event.TRBPtrLo     = XHC_LOW_32BIT (Trb);
+  Event.TRBPtrHi     = XHC_HIGH_32BIT (Trb);
+  Event.Length       = Residual;
+  Event.Completecode = CompletionCode;
+  Event.Type         = TRB_TYPE_TRANS_EVENT;
+  Event.EndpointId   = Dci;
+  Event.SlotId       = SlotId;
+  ModelPostEvent ((TRB_TEMPLATE *)&Event);
+
+  Endpoint->Dequeue = Trb + 1;
+  return Trb;
+}
+
+VOID
+XhciModelTick (
+  IN USB_XHCI_INSTANCE  *Xhc
+  )
+{
+  ASSERT (mModelPollTimer->Type == TimerPeriodic);
+  mModelNow += mModelPollTimer->Period;
+  mModelPollTimer->NotifyFunction (mModelPollTimer, mModelPollTimer->NotifyContext);
+}
+
+UINT64
+XhciModelNow (
+  VOID
+  )
+{
+  return mModelNow;
+}
+
+UINTN
+XhciModelActiveUrbs (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci
+  )
+{
+  LIST_ENTRY  *Entry;
+  UINTN       Count;
+
+  Count = 0;
+  BASE_LIST_FOR_EACH (Entry, &Xhc->ActiveUrbs[Dci]) {
+    if (EFI_LIST_CONTAINER (Entry, URB, ActiveLink)->SlotId == SlotId) {
+      Count++;
+    }
+  }
+
+  return Count;
+}
@@ -0,0 +1,162 @@
+/** @file
+  Interface of the software xHCI controller model to the host test of the
+  event ring dispatch and the asynchronous transfer timer of XhciDxe.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#ifndef XHCI_MODEL_H_
+#define XHCI_MODEL_H_
+
+typedef struct {
+  UINT64    RegisterReads;
+  UINT64    RegisterWrites;
+  UINT64    ErdpWrites;       // Updates of the Event Ring Dequeue Pointer
+  UINT64    DoorBells;        // Doorbells of the device slots
+  UINT64    Commands;
+  UINT64    Events;
+  UINT64    PollTimerSets;    // Changes of the period of the poll timer
+  UINT64    PollPeriod;       // Period of the poll timer, in 100 ns units
+} XHCI_MODEL_STATISTICS;
+
+extern XHCI_MODEL_STATISTICS  mXhciModelStatistics;
+
+/**
+  Power on the controller model, take over the event, timer, stall and pool
+  services the driver uses, and build a controller instance the way
+  XhcCreateUsbHc and XhcInitSched of the driver binding do, with the
+  asynchronous transfer timer started.
+
+  @return The XHCI instance.
+
+**/
+USB_XHCI_INSTANCE *
+XhciModelCreate (
+  VOID
+  );
+
+/**
+  Free what is left of the asynchronous transfers and of the device slots,
+  free the instance, and give the boot services back.
+
+  @param  Xhc             The XHCI instance.
+
+**/
+VOID
+XhciModelFree (
+  IN USB_XHCI_INSTANCE  *Xhc
+  );
+
+/**
+  Enable a device slot for a device, as XhcInitializeDeviceSlot leaves it.
+
+  @param  Xhc             The XHCI instance.
+  @param  SlotId          The slot id of the device.
+  @param  BusAddr         The device address the bus driver uses.
+
+**/
+VOID
+XhciModelAddDevice (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              BusAddr
+  );
+
+/**
+  Configure an endpoint of a device, as XhcSetConfigCmd leaves it.
+
+  @param  Xhc             The XHCI instance.
+  @param  SlotId          The slot id of the device.
+  @param  EpAddr          The endpoint address, with the direction in BIT7.
+  @param  EpType          The endpoint type of the endpoint context, ED_*.
+
+  @return The device context index of the endpoint.
+
+**/
+UINT8
+XhciModelAddEndpoint (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              EpAddr,
+  IN UINT8              EpType
+  );
+
+/**
+  Complete the next transfer TRB queued on an endpoint: fill its data with the
+  pattern of the endpoint, (SlotId << 4) | Dci, and post its transfer event.
+
+  @param  Xhc             The XHCI instance.
+  @param  SlotId          The slot id of the device.
+  @param  Dci             The device context index of the endpoint.
+  @param  CompletionCode  The completion code of the event, TRB_COMPLETION_*.
+  @param  Residual        The bytes of the TRB not transferred.
+
+  @return The TRB completed, or NULL if none is queued on the endpoint.
+
+**/
+TRB_TEMPLATE *
+XhciModelCompleteTransfer (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci,
+  IN UINT8              CompletionCode,
+  IN UINT32             Residual
+  );
+
+/**
+  Post a transfer event for a TRB, whether it is queued or not.
+
+  @param  Xhc             The XHCI instance.
+  @param  SlotId          The slot id of the event.
+  @param  Dci             The device context index of the event.
+  @param  Trb             The TRB of the event.
+  @param  CompletionCode  The completion code of the event, TRB_COMPLETION_*.
+
+**/
+VOID
+XhciModelPostTransferEvent (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci,
+  IN TRB_TEMPLATE       *Trb,
+  IN UINT8              CompletionCode
+  );
+
+/**
+  Fire the asynchronous transfer timer once, and advance the clock by its
+  period.
+
+  @param  Xhc             The XHCI instance.
+
+**/
+VOID
+XhciModelTick (
+  IN USB_XHCI_INSTANCE  *Xhc
+  );
+
+/**
+  Return the time of the clock, in 100 ns units.
+
+**/
+UINT64
+XhciModelNow (
+  VOID
+  );
+
+/**
+  Return the number of URBs queued on an endpoint for the event dispatch.
+
+  @param  Xhc             The XHCI instance.
+  @param  SlotId          The slot id of the device.
+  @param  Dci             The device context index of the endpoint.
+
+**/
+UINTN
+XhciModelActiveUrbs (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci
+  );
+
+#endif
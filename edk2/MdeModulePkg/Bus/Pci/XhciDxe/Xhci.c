@@ -85,6 +85,17 @@ EFI_USB2_HC_PROTOCOL  gXhciUsb2HcTemplate = {
   0x0
 };
 
+//
+// Template for Xhci's USB Host Controller Stream Protocol Instance.
+//
+EDKII_USB_HC_STREAM_PROTOCOL  gXhciUsbHcStreamTemplate = {
+  XhcAllocateStreamsForEndpoint,
+  XhcFreeStreamsForEndpoint,
+  XhcSubmitStreamTransfer,
+  XhcPollStreamTransfer,
+  XhcCancelStreamTransfer
+};
+
 /**
   Retrieves the capability of root hub ports.
 
@@ -1671,6 +1682,390 @@ XhcAsyncIsochronousTransfer (
   return EFI_UNSUPPORTED;
 }
 
+/**
+  Find the slot and the device context index of a bulk endpoint of a device.
+
+  @param  Xhc              The XHCI Instance.
+  @param  DeviceAddress    The address of the device on the USB bus.
+  @param  EndPointAddress  The address of the endpoint, with the direction.
+  @param  SlotId           The slot id of the device.
+  @param  Dci              The device context index of the endpoint.
+
+  @retval EFI_SUCCESS            The endpoint is a bulk endpoint of the device.
+  @retval EFI_INVALID_PARAMETER  The endpoint is not a bulk endpoint.
+  @retval EFI_DEVICE_ERROR       The device is gone.
+
+**/
+EFI_STATUS
+XhcFindBulkEndpoint (
+  IN  USB_XHCI_INSTANCE  *Xhc,
+  IN  UINT8              DeviceAddress,
+  IN  UINT8              EndPointAddress,
+  OUT UINT8              *SlotId,
+  OUT UINT8              *Dci
+  )
+{
+  UINT8  EpType;
+
+  if ((EndPointAddress & 0x0F) == 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  *SlotId = XhcBusDevAddrToSlotId (Xhc, DeviceAddress);
+  if (*SlotId == 0) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  *Dci = XhcEndpointToDci (
+           EndPointAddress & 0x0F,
+           XHCI_IS_DATAIN (EndPointAddress) ? EfiUsbDataIn : EfiUsbDataOut
+           );
+  if (Xhc->UsbDevContext[*SlotId].EndpointTransferRing[*Dci - 1] == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (Xhc->HcCParams.Data.Csz == 0) {
+    EpType = (UINT8)((DEVICE_CONTEXT *)Xhc->UsbDevContext[*SlotId].OutputContext)->EP[*Dci - 1].EPType;
+  } else {
+    EpType = (UINT8)((DEVICE_CONTEXT_64 *)Xhc->UsbDevContext[*SlotId].OutputContext)->EP[*Dci - 1].EPType;
+  }
+
+  if ((EpType != ED_BULK_OUT) && (EpType != ED_BULK_IN)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Give streams to a bulk endpoint of a device.
+
+  @param  This             This EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param  DeviceAddress    The address of the device on the USB bus.
+  @param  EndPointAddress  The address of the bulk endpoint, with the direction.
+  @param  StreamCount      On input, the number of streams wanted. On output,
+                           the number of streams allocated.
+
+  @retval EFI_SUCCESS            The streams are allocated.
+  @retval EFI_INVALID_PARAMETER  The endpoint is not a bulk endpoint, or
+                                 StreamCount is 0.
+  @retval EFI_ACCESS_DENIED      A transfer is pending on the endpoint.
+  @retval Others                 See XhcAllocateStreams.
+
+**/
+EFI_STATUS
+EFIAPI
+XhcAllocateStreamsForEndpoint (
+  IN     EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN     UINT8                         DeviceAddress,
+  IN     UINT8                         EndPointAddress,
+  IN OUT UINT16                        *StreamCount
+  )
+{
+  USB_XHCI_INSTANCE  *Xhc;
+  UINT8              SlotId;
+  UINT8              Dci;
+  EFI_STATUS         Status;
+  EFI_TPL            OldTpl;
+
+  if ((StreamCount == NULL) || (*StreamCount == 0)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  OldTpl = gBS->RaiseTPL (XHC_TPL);
+  Xhc    = XHC_FROM_STREAM_HC (This);
+
+  Status = XhcFindBulkEndpoint (Xhc, DeviceAddress, EndPointAddress, &SlotId, &Dci);
+  if (EFI_ERROR (Status)) {
+    goto ON_EXIT;
+  }
+
+  if (XhcIsStreamBusy (Xhc, SlotId, Dci, MAX_UINT16)) {
+    Status = EFI_ACCESS_DENIED;
+    goto ON_EXIT;
+  }
+
+  Status = XhcAllocateStreams (Xhc, SlotId, Dci, StreamCount);
+
+ON_EXIT:
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
+/**
+  Take the streams back from a bulk endpoint of a device.
+
+  @param  This             This EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param  DeviceAddress    The address of the device on the USB bus.
+  @param  EndPointAddress  The address of the bulk endpoint, with the direction.
+
+  @retval EFI_SUCCESS            The endpoint is back to a single ring.
+  @retval EFI_ACCESS_DENIED      A transfer is pending on the endpoint.
+  @retval Others                 See XhcFreeStreams.
+
+**/
+EFI_STATUS
+EFIAPI
+XhcFreeStreamsForEndpoint (
+  IN EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN UINT8                         DeviceAddress,
+  IN UINT8                         EndPointAddress
+  )
+{
+  USB_XHCI_INSTANCE  *Xhc;
+  UINT8              SlotId;
+  UINT8              Dci;
+  EFI_STATUS         Status;
+  EFI_TPL            OldTpl;
+
+  OldTpl = gBS->RaiseTPL (XHC_TPL);
+  Xhc    = XHC_FROM_STREAM_HC (This);
+
+  Status = XhcFindBulkEndpoint (Xhc, DeviceAddress, EndPointAddress, &SlotId, &Dci);
+  if (EFI_ERROR (Status)) {
+    goto ON_EXIT;
+  }
+
+  if (XhcIsStreamBusy (Xhc, SlotId, Dci, MAX_UINT16)) {
+    Status = EFI_ACCESS_DENIED;
+    goto ON_EXIT;
+  }
+
+  Status = XhcFreeStreams (Xhc, SlotId, Dci);
+
+ON_EXIT:
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
+/**
+  Start a bulk transfer on a stream of an endpoint, without waiting for it.
+
+  @param  This             This EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param  DeviceAddress    The address of the device on the USB bus.
+  @param  EndPointAddress  The address of the bulk endpoint, with the direction.
+  @param  StreamId         The stream of the transfer, or 0 on an endpoint
+                           without streams.
+  @param  Data             The buffer of the transfer.
+  @param  DataLength       The length of the transfer, in bytes.
+  @param  Transfer         The handle of the started transfer.
+
+  @retval EFI_SUCCESS            The transfer is started.
+  @retval EFI_INVALID_PARAMETER  A parameter is not valid.
+  @retval EFI_ALREADY_STARTED    A transfer is pending on the stream.
+  @retval EFI_OUT_OF_RESOURCES   The URB could not be allocated.
+  @retval EFI_DEVICE_ERROR       The device is gone or the xHC is halted.
+
+**/
+EFI_STATUS
+EFIAPI
+XhcSubmitStreamTransfer (
+  IN  EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN  UINT8                         DeviceAddress,
+  IN  UINT8                         EndPointAddress,
+  IN  UINT16                        StreamId,
+  IN  VOID                          *Data,
+  IN  UINTN                         DataLength,
+  OUT VOID                          **Transfer
+  )
+{
+  USB_XHCI_INSTANCE  *Xhc;
+  USB_DEV_CONTEXT    *DevContext;
+  TRANSFER_RING      *Ring;
+  URB                *Urb;
+  UINT8              SlotId;
+  UINT8              Dci;
+  EFI_STATUS         Status;
+  EFI_TPL            OldTpl;
+
+  if ((Data == NULL) || (DataLength == 0) || (Transfer == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  OldTpl = gBS->RaiseTPL (XHC_TPL);
+  Xhc    = XHC_FROM_STREAM_HC (This);
+
+  if (XhcIsHalt (Xhc) || XhcIsSysError (Xhc)) {
+    DEBUG ((DEBUG_ERROR, "XhcSubmitStreamTransfer: HC is halted\n"));
+    Status = EFI_DEVICE_ERROR;
+    goto ON_EXIT;
+  }
+
+  Status = XhcFindBulkEndpoint (Xhc, DeviceAddress, EndPointAddress, &SlotId, &Dci);
+  if (EFI_ERROR (Status)) {
+    goto ON_EXIT;
+  }
+
+  //
+  // Stream 0 is the single ring of an endpoint without streams, and an
+  // endpoint with streams takes transfers on its streams only.
+  //
+  DevContext = &Xhc->UsbDevContext[SlotId];
+  if ((StreamId > DevContext->StreamCount[Dci - 1]) ||
+      ((StreamId == 0) != (DevContext->StreamCount[Dci - 1] == 0)))
+  {
+    Status = EFI_INVALID_PARAMETER;
+    goto ON_EXIT;
+  }
+
+  if (StreamId == 0) {
+    Ring = DevContext->EndpointTransferRing[Dci - 1];
+  } else {
+    Ring = &DevContext->StreamTransferRing[Dci - 1][StreamId];
+  }
+
+  //
+  // A Normal TRB moves up to 64 KB, and the TD must leave the Link TRB and
+  // one free TRB in the ring.
+  //
+  if (DataLength > (UINTN)(Ring->TrbNumber - 2) * SIZE_64KB) {
+    Status = EFI_INVALID_PARAMETER;
+    goto ON_EXIT;
+  }
+
+  if (XhcIsStreamBusy (Xhc, SlotId, Dci, StreamId)) {
+    Status = EFI_ALREADY_STARTED;
+    goto ON_EXIT;
+  }
+
+  Urb = XhcCreateStreamUrb (Xhc, DeviceAddress, EndPointAddress, StreamId, Data, DataLength);
+  if (Urb == NULL) {
+    DEBUG ((DEBUG_ERROR, "XhcSubmitStreamTransfer: failed to create URB\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto ON_EXIT;
+  }
+
+  *Transfer = Urb;
+  Status    = EFI_SUCCESS;
+
+ON_EXIT:
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
+/**
+  Check whether a stream transfer is done, and free it when it is.
+
+  @param  This             This EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param  Transfer         The handle of the transfer.
+  @param  DataLength       The number of bytes transferred.
+  @param  TransferResult   The result of the transfer.
+
+  @retval EFI_SUCCESS            The transfer is done without error.
+  @retval EFI_NOT_READY          The transfer is still pending.
+  @retval EFI_INVALID_PARAMETER  A parameter is not valid.
+  @retval EFI_DEVICE_ERROR       The transfer is done with an error.
+
+**/
+EFI_STATUS
+EFIAPI
+XhcPollStreamTransfer (
+  IN  EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN  VOID                          *Transfer,
+  OUT UINTN                         *DataLength,
+  OUT UINT32                        *TransferResult
+  )
+{
+  USB_XHCI_INSTANCE  *Xhc;
+  URB                *Urb;
+  EFI_STATUS         Status;
+  EFI_STATUS         RecoveryStatus;
+  EFI_TPL            OldTpl;
+
+  Urb = (URB *)Transfer;
+  if ((Urb == NULL) || (Urb->Signature != XHC_URB_SIG) ||
+      (DataLength == NULL) || (TransferResult == NULL))
+  {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  OldTpl = gBS->RaiseTPL (XHC_TPL);
+  Xhc    = XHC_FROM_STREAM_HC (This);
+
+  //
+  // XhcCheckUrbResult marks a system error when the xHC is halted, but leaves
+  // the URB pending.
+  //
+  if (!XhcCheckUrbResult (Xhc, Urb) && ((Urb->Result & EFI_USB_ERR_SYSTEM) != 0)) {
+    Urb->Finished = TRUE;
+  }
+
+  if (!Urb->Finished) {
+    Status = EFI_NOT_READY;
+    goto ON_EXIT;
+  }
+
+  *DataLength     = Urb->Completed;
+  *TransferResult = Urb->Result;
+  Status          = (Urb->Result == EFI_USB_NOERROR) ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+
+  if ((Urb->Result == EFI_USB_ERR_STALL) || (Urb->Result == EFI_USB_ERR_BABBLE)) {
+    RecoveryStatus = XhcRecoverHaltedEndpoint (Xhc, Urb);
+    if (EFI_ERROR (RecoveryStatus)) {
+      DEBUG ((DEBUG_ERROR, "XhcPollStreamTransfer: XhcRecoverHaltedEndpoint failed!\n"));
+    }
+  }
+
+  RemoveEntryList (&Urb->UrbList);
+  Xhc->PciIo->Flush (Xhc->PciIo);
+  XhcFreeUrb (Xhc, Urb);
+
+ON_EXIT:
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
+/**
+  Take a pending stream transfer back from the xHC and free it.
+
+  @param  This             This EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param  Transfer         The handle of the transfer.
+
+  @retval EFI_SUCCESS            The transfer is canceled.
+  @retval EFI_INVALID_PARAMETER  Transfer is not valid.
+  @retval EFI_DEVICE_ERROR       The endpoint failed to stop. The transfer is
+                                 freed all the same.
+
+**/
+EFI_STATUS
+EFIAPI
+XhcCancelStreamTransfer (
+  IN EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN VOID                          *Transfer
+  )
+{
+  USB_XHCI_INSTANCE  *Xhc;
+  URB                *Urb;
+  EFI_STATUS         Status;
+  EFI_TPL            OldTpl;
+
+  Urb = (URB *)Transfer;
+  if ((Urb == NULL) || (Urb->Signature != XHC_URB_SIG)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  OldTpl = gBS->RaiseTPL (XHC_TPL);
+  Xhc    = XHC_FROM_STREAM_HC (This);
+
+  Status = EFI_SUCCESS;
+  if (!Urb->Finished) {
+    Status = XhcDequeueTrbFromEndpoint (Xhc, Urb);
+    if (Status == EFI_ALREADY_STARTED) {
+      Status = EFI_SUCCESS;
+    } else if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "XhcCancelStreamTransfer: XhcDequeueTrbFromEndpoint failed!\n"));
+      Status = EFI_DEVICE_ERROR;
+    }
+  }
+
+  RemoveEntryList (&Urb->UrbList);
+  Xhc->PciIo->Flush (Xhc->PciIo);
+  XhcFreeUrb (Xhc, Urb);
+
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
 /**
   Entry point for EFI drivers.
 
@@ -1796,6 +2191,7 @@ XhcCreateUsbHc (
   UINT32             PageSize;
   UINT16             ExtCapReg;
   UINT8              ReleaseNumber;
+  UINTN              Index;
 
   Xhc = AllocateZeroPool (sizeof (USB_XHCI_INSTANCE));
 
@@ -1811,6 +2207,7 @@ XhcCreateUsbHc (
   Xhc->DevicePath            = DevicePath;
   Xhc->OriginalPciAttributes = OriginalPciAttributes;
   CopyMem (&Xhc->Usb2Hc, &gXhciUsb2HcTemplate, sizeof (EFI_USB2_HC_PROTOCOL));
+  CopyMem (&Xhc->StreamHc, &gXhciUsbHcStreamTemplate, sizeof (EDKII_USB_HC_STREAM_PROTOCOL));
 
   Status = PciIo->Pci.Read (
                         PciIo,
@@ -1826,6 +2223,10 @@ XhcCreateUsbHc (
   }
 
   InitializeListHead (&Xhc->AsyncIntTransfers);
+  InitializeListHead (&Xhc->StreamTransfers);
+  for (Index = 0; Index < ARRAY_SIZE (Xhc->ActiveUrbs); Index++) {
+    InitializeListHead (&Xhc->ActiveUrbs[Index]);
+  }
 
   //
   // Be caution that the Offset passed to XhcReadCapReg() should be Dword align
@@ -1917,6 +2318,7 @@ XhcExitBootService (
   // and uninstall the XHCI protocl.
   //
   gBS->SetTimer (Xhc->PollTimer, TimerCancel, 0);
+  XhcDumpStatistics (Xhc);
   XhcHaltHC (Xhc, XHC_GENERIC_TIMEOUT);
 
   if (Xhc->PollTimer != NULL) {
@@ -2090,7 +2492,8 @@ XhcDriverBindingStart (
   //
   // Start the asynchronous interrupt monitor
   //
-  Status = gBS->SetTimer (Xhc->PollTimer, TimerPeriodic, XHC_ASYNC_TIMER_INTERVAL);
+  Xhc->PollInterval = XHC_ASYNC_TIMER_INTERVAL;
+  Status            = gBS->SetTimer (Xhc->PollTimer, TimerPeriodic, Xhc->PollInterval);
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR, "XhcDriverBindingStart: failed to start async interrupt monitor\n"));
     XhcHaltHC (Xhc, XHC_GENERIC_TIMEOUT);
@@ -2142,6 +2545,21 @@ XhcDriverBindingStart (
     goto FREE_POOL;
   }
 
+  //
+  // The stream protocol is an extra, the USB bus runs without it.
+  //
+  if (Xhc->HcCParams.Data.MaxPsaSize != 0) {
+    Status = gBS->InstallProtocolInterface (
+                    &Controller,
+                    &gEdkiiUsbHcStreamProtocolGuid,
+                    EFI_NATIVE_INTERFACE,
+                    &Xhc->StreamHc
+                    );
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "XhcDriverBindingStart: failed to install USB HC Stream Protocol - %r\n", Status));
+    }
+  }
+
   DEBUG ((DEBUG_INFO, "XhcDriverBindingStart: XHCI started for controller @ %x\n", Controller));
   return EFI_SUCCESS;
 
@@ -2232,11 +2650,20 @@ XhcDriverBindingStop (
   Xhc   = XHC_FROM_THIS (Usb2Hc);
   PciIo = Xhc->PciIo;
 
+  if (Xhc->HcCParams.Data.MaxPsaSize != 0) {
+    gBS->UninstallProtocolInterface (
+           Controller,
+           &gEdkiiUsbHcStreamProtocolGuid,
+           &Xhc->StreamHc
+           );
+  }
+
   //
   // Stop AsyncRequest Polling timer then stop the XHCI driver
   // and uninstall the XHCI protocl.
   //
   gBS->SetTimer (Xhc->PollTimer, TimerCancel, 0);
+  XhcDumpStatistics (Xhc);
 
   //
   // Disable the device slots occupied by these devices on its downstream ports.
@@ -2267,6 +2694,7 @@ XhcDriverBindingStop (
   XhcHaltHC (Xhc, XHC_GENERIC_TIMEOUT);
   XhcClearBiosOwnership (Xhc);
   XhciDelAllAsyncIntTransfers (Xhc);
+  XhciDelAllStreamTransfers (Xhc);
   XhcFreeSched (Xhc);
 
   if (Xhc->ControllerNameTable) {
@@ -14,6 +14,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <Uefi.h>
 
 #include <Protocol/Usb2HostController.h>
+#include <Protocol/UsbHcStream.h>
 #include <Protocol/PciIo.h>
 
 #include <Guid/EventGroup.h>
@@ -65,6 +66,13 @@ typedef struct _USB_DEV_CONTEXT    USB_DEV_CONTEXT;
 // The unit is 100us, takes 1ms as interval.
 //
 #define XHC_ASYNC_TIMER_INTERVAL  EFI_TIMER_PERIOD_MILLISECONDS(1)
+//
+// While no asynchronous transfer completes, the timer interval doubles every
+// XHC_ASYNC_TIMER_IDLE_POLLS ticks, up to XHC_ASYNC_TIMER_MAX_INTERVAL. The
+// unit of the interval is 100ns, the longest interval is 8ms.
+//
+#define XHC_ASYNC_TIMER_MAX_INTERVAL  EFI_TIMER_PERIOD_MILLISECONDS(8)
+#define XHC_ASYNC_TIMER_IDLE_POLLS    32
 
 //
 // XHC raises TPL to TPL_NOTIFY to serialize all its operations
@@ -72,10 +80,11 @@ typedef struct _USB_DEV_CONTEXT    USB_DEV_CONTEXT;
 //
 #define XHC_TPL  TPL_NOTIFY
 
-#define CMD_RING_TRB_NUMBER    0x100
-#define TR_RING_TRB_NUMBER     0x100
-#define ERST_NUMBER            0x01
-#define EVENT_RING_TRB_NUMBER  0x200
+#define CMD_RING_TRB_NUMBER     0x100
+#define TR_RING_TRB_NUMBER      0x100
+#define STREAM_RING_TRB_NUMBER  0x40
+#define ERST_NUMBER             0x01
+#define EVENT_RING_TRB_NUMBER   0x200
 
 #define CMD_INTER        0
 #define CTRL_INTER       1
@@ -96,6 +105,7 @@ typedef struct _USB_DEV_CONTEXT    USB_DEV_CONTEXT;
 
 #define XHCI_INSTANCE_SIG  SIGNATURE_32 ('x', 'h', 'c', 'i')
 #define XHC_FROM_THIS(a)  CR(a, USB_XHCI_INSTANCE, Usb2Hc, XHCI_INSTANCE_SIG)
+#define XHC_FROM_STREAM_HC(a)  CR(a, USB_XHCI_INSTANCE, StreamHc, XHCI_INSTANCE_SIG)
 
 #define USB_DESC_TYPE_HUB              0x29
 #define USB_DESC_TYPE_HUB_SUPER_SPEED  0x2a
@@ -172,6 +182,16 @@ struct _USB_DEV_CONTEXT {
   //
   VOID                         *EndpointTransferRing[31];
   //
+  // The Primary Stream Array, its number of entries and the transfer rings of the
+  // streams of every endpoint that has streams. The transfer ring of stream n of
+  // an endpoint is StreamTransferRing[Dci - 1][n], for n from 1 to StreamCount[Dci - 1].
+  // The transfer queue of the endpoint is kept for the time the streams are freed.
+  //
+  STREAM_CONTEXT               *StreamContextArray[31];
+  UINT32                       StreamArraySize[31];
+  TRANSFER_RING                *StreamTransferRing[31];
+  UINT16                       StreamCount[31];
+  //
   // The device descriptor which is stored to support XHCI's Evaluate_Context cmd.
   //
   EFI_USB_DEVICE_DESCRIPTOR    DevDesc;
@@ -193,66 +213,97 @@ struct _USB_DEV_CONTEXT {
   UINT8                        *ActiveAlternateSetting;
 };
 
+//
+// Counters of the event ring passes and of the transfer rings, kept for the
+// tuning of the polling.
+//
+typedef struct {
+  UINT64    Polls;                    ///< Passes over the event ring
+  UINT64    WastedPolls;              ///< Passes that found no new event
+  UINT64    Events;                   ///< Events taken from the event ring
+  UINT64    DoorBells;                ///< Doorbells rung for transfer rings
+  UINT64    Trbs;                     ///< TRBs queued on transfer rings
+  UINT32    MaxEventRingOccupancy;    ///< Most events found in one pass
+  UINT32    MaxTransferRingOccupancy; ///< Most TRBs pending on one transfer ring
+} XHC_STATISTICS;
+
 struct _USB_XHCI_INSTANCE {
-  UINT32                      Signature;
-  EFI_PCI_IO_PROTOCOL         *PciIo;
-  UINT64                      OriginalPciAttributes;
-  USBHC_MEM_POOL              *MemPool;
+  UINT32                          Signature;
+  EFI_PCI_IO_PROTOCOL             *PciIo;
+  UINT64                          OriginalPciAttributes;
+  USBHC_MEM_POOL                  *MemPool;
 
-  EFI_USB2_HC_PROTOCOL        Usb2Hc;
+  EFI_USB2_HC_PROTOCOL            Usb2Hc;
+  //
+  // Installed next to Usb2Hc when the controller supports streams
+  //
+  EDKII_USB_HC_STREAM_PROTOCOL    StreamHc;
 
-  EFI_DEVICE_PATH_PROTOCOL    *DevicePath;
+  EFI_DEVICE_PATH_PROTOCOL        *DevicePath;
 
   //
   // ExitBootServicesEvent is used to set OS semaphore and
   // stop the XHC DMA operation after exit boot service.
   //
-  EFI_EVENT                   ExitBootServiceEvent;
-  EFI_EVENT                   PollTimer;
-  LIST_ENTRY                  AsyncIntTransfers;
-
-  UINT8                       CapLength;  ///< Capability Register Length
-  XHC_HCSPARAMS1              HcSParams1; ///< Structural Parameters 1
-  XHC_HCSPARAMS2              HcSParams2; ///< Structural Parameters 2
-  XHC_HCCPARAMS               HcCParams;  ///< Capability Parameters
-  UINT32                      DBOff;      ///< Doorbell Offset
-  UINT32                      RTSOff;     ///< Runtime Register Space Offset
-  UINT16                      MaxInterrupt;
-  UINT32                      PageSize;
-  UINT64                      *ScratchBuf;
-  VOID                        *ScratchMap;
-  UINT32                      MaxScratchpadBufs;
-  UINT64                      *ScratchEntry;
-  UINTN                       *ScratchEntryMap;
-  UINT32                      ExtCapRegBase;
-  UINT32                      UsbLegSupOffset;
-  UINT32                      DebugCapSupOffset;
-  UINT32                      Usb2SupOffset;
-  UINT32                      Usb3SupOffset;
-  UINT64                      *DCBAA;
-  VOID                        *DCBAAMap;
-  UINT32                      MaxSlotsEn;
-  URB                         *PendingUrb;
+  EFI_EVENT                       ExitBootServiceEvent;
+  EFI_EVENT                       PollTimer;
+  UINT64                          PollInterval;
+  UINT32                          IdlePolls;
+  LIST_ENTRY                      AsyncIntTransfers;
+  //
+  // The URBs started through StreamHc that are not polled to completion yet
+  //
+  LIST_ENTRY                      StreamTransfers;
+
+  UINT8                           CapLength;  ///< Capability Register Length
+  XHC_HCSPARAMS1                  HcSParams1; ///< Structural Parameters 1
+  XHC_HCSPARAMS2                  HcSParams2; ///< Structural Parameters 2
+  XHC_HCCPARAMS                   HcCParams;  ///< Capability Parameters
+  UINT32                          DBOff;      ///< Doorbell Offset
+  UINT32                          RTSOff;     ///< Runtime Register Space Offset
+  UINT16                          MaxInterrupt;
+  UINT32                          PageSize;
+  UINT64                          *ScratchBuf;
+  VOID                            *ScratchMap;
+  UINT32                          MaxScratchpadBufs;
+  UINT64                          *ScratchEntry;
+  UINTN                           *ScratchEntryMap;
+  UINT32                          ExtCapRegBase;
+  UINT32                          UsbLegSupOffset;
+  UINT32                          DebugCapSupOffset;
+  UINT32                          Usb2SupOffset;
+  UINT32                          Usb3SupOffset;
+  UINT64                          *DCBAA;
+  VOID                            *DCBAAMap;
+  UINT32                          MaxSlotsEn;
+  URB                             *PendingUrb;
+  //
+  // The URBs queued on the command ring (entry 0) and on the transfer rings,
+  // listed by the DCI of their endpoint, to dispatch the events to.
+  //
+  LIST_ENTRY                      ActiveUrbs[32];
   //
   // Cmd Transfer Ring
   //
-  TRANSFER_RING               CmdRing;
+  TRANSFER_RING                   CmdRing;
   //
   // EventRing
   //
-  EVENT_RING                  EventRing;
+  EVENT_RING                      EventRing;
   //
   // Misc
   //
-  EFI_UNICODE_STRING_TABLE    *ControllerNameTable;
+  EFI_UNICODE_STRING_TABLE        *ControllerNameTable;
 
   //
   // Store device contexts managed by XHCI instance
   // The array supports up to 255 devices, entry 0 is reserved and should not be used.
   //
-  USB_DEV_CONTEXT             UsbDevContext[256];
+  USB_DEV_CONTEXT                 UsbDevContext[256];
 
-  BOOLEAN                     Support64BitDma; // Whether 64 bit DMA may be used with this device
+  BOOLEAN                         Support64BitDma; // Whether 64 bit DMA may be used with this device
+
+  XHC_STATISTICS                  Statistics;
 };
 
 extern EFI_DRIVER_BINDING_PROTOCOL   gXhciDriverBinding;
@@ -720,4 +771,118 @@ XhcAsyncIsochronousTransfer (
   IN     VOID                                *Context
   );
 
+/**
+  Give streams to a bulk endpoint of a device.
+
+  @param  This                  This EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param  DeviceAddress         Target device address.
+  @param  EndPointAddress       Endpoint number and its direction in bit 7.
+  @param  StreamCount           On input, the number of streams wanted. On
+                                output, the number of streams allocated.
+
+  @retval EFI_SUCCESS           The streams are allocated.
+  @retval EFI_INVALID_PARAMETER Some parameters are invalid.
+  @retval EFI_UNSUPPORTED       The controller has no streams.
+  @retval Others                Failed to configure the endpoint.
+
+**/
+EFI_STATUS
+EFIAPI
+XhcAllocateStreamsForEndpoint (
+  IN     EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN     UINT8                         DeviceAddress,
+  IN     UINT8                         EndPointAddress,
+  IN OUT UINT16                        *StreamCount
+  );
+
+/**
+  Take the streams back from a bulk endpoint of a device.
+
+  @param  This                  This EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param  DeviceAddress         Target device address.
+  @param  EndPointAddress       Endpoint number and its direction in bit 7.
+
+  @retval EFI_SUCCESS           The streams are freed.
+  @retval EFI_NOT_FOUND         The endpoint has no streams.
+  @retval EFI_ACCESS_DENIED     A transfer is still pending on the endpoint.
+  @retval Others                Failed to configure the endpoint.
+
+**/
+EFI_STATUS
+EFIAPI
+XhcFreeStreamsForEndpoint (
+  IN EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN UINT8                         DeviceAddress,
+  IN UINT8                         EndPointAddress
+  );
+
+/**
+  Start a bulk transfer on a stream and return without waiting for it.
+
+  @param  This                  This EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param  DeviceAddress         Target device address.
+  @param  EndPointAddress       Endpoint number and its direction in bit 7.
+  @param  StreamId              The stream of the transfer, or 0.
+  @param  Data                  The buffer of the transfer.
+  @param  DataLength            The length of the transfer.
+  @param  Transfer              The handle of the started transfer.
+
+  @retval EFI_SUCCESS           The transfer is started.
+  @retval EFI_INVALID_PARAMETER Some parameters are invalid.
+  @retval EFI_ALREADY_STARTED   A transfer is pending on the stream already.
+  @retval EFI_OUT_OF_RESOURCES  The transfer could not be allocated.
+  @retval EFI_DEVICE_ERROR      The device is gone or the controller failed.
+
+**/
+EFI_STATUS
+EFIAPI
+XhcSubmitStreamTransfer (
+  IN  EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN  UINT8                         DeviceAddress,
+  IN  UINT8                         EndPointAddress,
+  IN  UINT16                        StreamId,
+  IN  VOID                          *Data,
+  IN  UINTN                         DataLength,
+  OUT VOID                          **Transfer
+  );
+
+/**
+  Check whether a transfer started on a stream is done.
+
+  @param  This                  This EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param  Transfer              The handle of the transfer.
+  @param  DataLength            The number of bytes transferred.
+  @param  TransferResult        The result of the transfer.
+
+  @retval EFI_SUCCESS           The transfer is done without error.
+  @retval EFI_NOT_READY         The transfer is still pending.
+  @retval EFI_DEVICE_ERROR      The transfer is done with an error.
+
+**/
+EFI_STATUS
+EFIAPI
+XhcPollStreamTransfer (
+  IN  EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN  VOID                          *Transfer,
+  OUT UINTN                         *DataLength,
+  OUT UINT32                        *TransferResult
+  );
+
+/**
+  Cancel a transfer started on a stream.
+
+  @param  This                  This EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param  Transfer              The handle of the transfer.
+
+  @retval EFI_SUCCESS           The transfer is canceled.
+  @retval EFI_DEVICE_ERROR      Failed to stop the endpoint.
+
+**/
+EFI_STATUS
+EFIAPI
+XhcCancelStreamTransfer (
+  IN EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN VOID                          *Transfer
+  );
+
 #endif
@@ -11,6 +11,53 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 
 #include "Xhci.h"
 
+/**
+  Add a URB to the URBs queued on its endpoint, for the events of the endpoint
+  to be dispatched to it.
+
+  @param  Xhc       The XHCI Instance.
+  @param  Urb       The URB queued.
+  @param  SlotId    The slot id of the device, or 0 for a command.
+  @param  Dci       The device context index of the endpoint, or 0 for a command.
+
+**/
+VOID
+XhcInsertActiveUrb (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN URB                *Urb,
+  IN UINT8              SlotId,
+  IN UINT8              Dci
+  )
+{
+  ASSERT (Dci < 32);
+
+  if (Urb->ActiveLink.ForwardLink != NULL) {
+    return;
+  }
+
+  Urb->SlotId = SlotId;
+  Urb->Dci    = Dci;
+  InsertTailList (&Xhc->ActiveUrbs[Dci], &Urb->ActiveLink);
+}
+
+/**
+  Remove a URB from the URBs queued on its endpoint.
+
+  @param  Urb       The URB to remove.
+
+**/
+VOID
+XhcRemoveActiveUrb (
+  IN URB  *Urb
+  )
+{
+  if (Urb->ActiveLink.ForwardLink != NULL) {
+    RemoveEntryList (&Urb->ActiveLink);
+    Urb->ActiveLink.ForwardLink = NULL;
+    Urb->ActiveLink.BackLink    = NULL;
+  }
+}
+
 /**
   Create a command transfer TRB to support XHCI command interfaces.
 
@@ -43,6 +90,8 @@ XhcCreateCmdTrb (
   Urb->TrbStart->CycleBit = Urb->Ring->RingPCS & BIT0;
   Urb->TrbEnd             = Urb->TrbStart;
 
+  XhcInsertActiveUrb (Xhc, Urb, 0, 0);
+
   return Urb;
 }
 
@@ -202,9 +251,74 @@ XhcFreeUrb (
     Xhc->PciIo->Unmap (Xhc->PciIo, Urb->DataMap);
   }
 
+  XhcRemoveActiveUrb (Urb);
   FreePool (Urb);
 }
 
+/**
+  Create a new URB for a bulk transfer on a stream, and start it.
+
+  @param  Xhc       The XHCI Instance
+  @param  BusAddr   The logical device address assigned by UsbBus driver
+  @param  EpAddr    Endpoint addrress
+  @param  StreamId  The stream of the transfer, or 0 on an endpoint without streams
+  @param  Data      The user data to transfer
+  @param  DataLen   The length of data buffer
+
+  @return Created URB or NULL
+
+**/
+URB *
+XhcCreateStreamUrb (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              BusAddr,
+  IN UINT8              EpAddr,
+  IN UINT16             StreamId,
+  IN VOID               *Data,
+  IN UINTN              DataLen
+  )
+{
+  USB_ENDPOINT  *Ep;
+  EFI_STATUS    Status;
+  URB           *Urb;
+  UINT8         SlotId;
+  UINT8         Dci;
+
+  Urb = AllocateZeroPool (sizeof (URB));
+  if (Urb == NULL) {
+    return NULL;
+  }
+
+  Urb->Signature = XHC_URB_SIG;
+  InitializeListHead (&Urb->UrbList);
+
+  Ep            = &Urb->Ep;
+  Ep->BusAddr   = BusAddr;
+  Ep->EpAddr    = (UINT8)(EpAddr & 0x0F);
+  Ep->Direction = ((EpAddr & 0x80) != 0) ? EfiUsbDataIn : EfiUsbDataOut;
+  Ep->DevSpeed  = EFI_USB_SPEED_SUPER;
+  Ep->Type      = XHC_BULK_TRANSFER;
+
+  Urb->Data     = Data;
+  Urb->DataLen  = DataLen;
+  Urb->StreamId = StreamId;
+
+  Status = XhcCreateTransferTrb (Xhc, Urb);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "XhcCreateStreamUrb: XhcCreateTransferTrb Failed, Status = %r\n", Status));
+    XhcFreeUrb (Xhc, Urb);
+    return NULL;
+  }
+
+  InsertTailList (&Xhc->StreamTransfers, &Urb->UrbList);
+
+  SlotId = XhcBusDevAddrToSlotId (Xhc, BusAddr);
+  Dci    = XhcEndpointToDci (Ep->EpAddr, (UINT8)(Ep->Direction));
+  XhcRingStreamDoorBell (Xhc, SlotId, Dci, StreamId);
+
+  return Urb;
+}
+
 /**
   Create a transfer TRB.
 
@@ -233,6 +347,9 @@ XhcCreateTransferTrb (
   EFI_PHYSICAL_ADDRESS           PhyAddr;
   VOID                           *Map;
   EFI_STATUS                     Status;
+  LIST_ENTRY                     *Entry;
+  URB                            *QueuedUrb;
+  UINTN                          Occupancy;
 
   SlotId = XhcBusDevAddrToSlotId (Xhc, Urb->Ep.BusAddr);
   if (SlotId == 0) {
@@ -247,7 +364,13 @@ XhcCreateTransferTrb (
 
   Dci = XhcEndpointToDci (Urb->Ep.EpAddr, (UINT8)(Urb->Ep.Direction));
   ASSERT (Dci < 32);
-  EPRing        = (TRANSFER_RING *)(UINTN)Xhc->UsbDevContext[SlotId].EndpointTransferRing[Dci-1];
+  if (Urb->StreamId != 0) {
+    ASSERT (Urb->StreamId <= Xhc->UsbDevContext[SlotId].StreamCount[Dci-1]);
+    EPRing = &Xhc->UsbDevContext[SlotId].StreamTransferRing[Dci-1][Urb->StreamId];
+  } else {
+    EPRing = (TRANSFER_RING *)(UINTN)Xhc->UsbDevContext[SlotId].EndpointTransferRing[Dci-1];
+  }
+
   Urb->Ring     = EPRing;
   OutputContext = Xhc->UsbDevContext[SlotId].OutputContext;
   if (Xhc->HcCParams.Data.Csz == 0) {
@@ -458,6 +581,24 @@ XhcCreateTransferTrb (
       break;
   }
 
+  XhcInsertActiveUrb (Xhc, Urb, SlotId, Dci);
+
+  //
+  // Count the TRBs pending on the ring, this URB's included.
+  //
+  Occupancy = 0;
+  BASE_LIST_FOR_EACH (Entry, &Xhc->ActiveUrbs[Dci]) {
+    QueuedUrb = EFI_LIST_CONTAINER (Entry, URB, ActiveLink);
+    if ((QueuedUrb->Ring == EPRing) && !QueuedUrb->Finished) {
+      Occupancy += QueuedUrb->TrbNum;
+    }
+  }
+
+  Xhc->Statistics.Trbs += Urb->TrbNum;
+  if (Occupancy > Xhc->Statistics.MaxTransferRingOccupancy) {
+    Xhc->Statistics.MaxTransferRingOccupancy = (UINT32)Occupancy;
+  }
+
   return EFI_SUCCESS;
 }
 
@@ -695,7 +836,7 @@ XhcRecoverHaltedEndpoint (
   //
   // 3)Ring the doorbell to transit from stop to active
   //
-  XhcRingDoorBell (Xhc, SlotId, Dci);
+  XhcRingEndpointDoorBell (Xhc, SlotId, Dci);
 
 Done:
   return Status;
@@ -768,7 +909,7 @@ XhcDequeueTrbFromEndpoint (
   //
   // 3)Ring the doorbell to transit from stop to active
   //
-  XhcRingDoorBell (Xhc, SlotId, Dci);
+  XhcRingEndpointDoorBell (Xhc, SlotId, Dci);
 
 Done:
   return Status;
@@ -1051,99 +1192,117 @@ IsTransferRingTrb (
 }
 
 /**
-  Check if the Trb is a transaction of the URBs in XHCI's asynchronous transfer list.
+  Find the URB an event is for, among the URBs queued on the endpoint of the
+  event.
 
-  @param Xhc    The XHCI Instance.
-  @param Trb    The TRB to be checked.
-  @param Urb    The pointer to the matched Urb.
+  @param Xhc      The XHCI Instance.
+  @param SlotId   The slot id of the event, or 0 for a command completion event.
+  @param Dci      The device context index of the event, or 0 for a command
+                  completion event.
+  @param Trb      The TRB the event is for.
 
-  @retval TRUE  The Trb is matched with a transaction of the URBs in the async list.
-  @retval FALSE The Trb is not matched with any URBs in the async list.
+  @return The URB, or NULL if no URB queued on the endpoint has the TRB.
 
 **/
-BOOLEAN
-IsAsyncIntTrb (
+URB *
+XhcFindEventUrb (
   IN  USB_XHCI_INSTANCE  *Xhc,
-  IN  TRB_TEMPLATE       *Trb,
-  OUT URB                **Urb
+  IN  UINT8              SlotId,
+  IN  UINT8              Dci,
+  IN  TRB_TEMPLATE       *Trb
   )
 {
   LIST_ENTRY  *Entry;
-  LIST_ENTRY  *Next;
   URB         *CheckedUrb;
 
-  BASE_LIST_FOR_EACH_SAFE (Entry, Next, &Xhc->AsyncIntTransfers) {
-    CheckedUrb = EFI_LIST_CONTAINER (Entry, URB, UrbList);
+  if (Dci >= 32) {
+    return NULL;
+  }
+
+  BASE_LIST_FOR_EACH (Entry, &Xhc->ActiveUrbs[Dci]) {
+    CheckedUrb = EFI_LIST_CONTAINER (Entry, URB, ActiveLink);
+    if (CheckedUrb->SlotId != SlotId) {
+      continue;
+    }
+
+    //
+    // The rings of a finished stream URB may be gone with its streams.
+    //
+    if (CheckedUrb->Finished && (CheckedUrb->StreamId != 0)) {
+      continue;
+    }
+
     if (IsTransferRingTrb (Xhc, Trb, CheckedUrb)) {
-      *Urb = CheckedUrb;
-      return TRUE;
+      return CheckedUrb;
     }
   }
 
-  return FALSE;
+  return NULL;
 }
 
 /**
-  Check the URB's execution result and update the URB's
-  result accordingly.
+  Take all the new events from the event ring in one pass and dispatch them to
+  the URBs queued on their endpoints.
+
+  The ring is checked in memory first, so a pass that finds no event does not
+  touch the registers of the xHC. The Event Ring Dequeue Pointer is written
+  once, after the events of the pass are taken.
 
   @param  Xhc             The XHCI Instance.
-  @param  Urb             The URB to check result.
 
-  @return Whether the result of URB transfer is finialized.
+  @return The number of events taken.
 
 **/
-BOOLEAN
-XhcCheckUrbResult (
-  IN  USB_XHCI_INSTANCE  *Xhc,
-  IN  URB                *Urb
+UINTN
+XhcProcessEventRing (
+  IN  USB_XHCI_INSTANCE  *Xhc
   )
 {
+  EVENT_RING            *EvtRing;
   EVT_TRB_TRANSFER      *EvtTrb;
   TRB_TEMPLATE          *TRBPtr;
   UINTN                 Index;
+  UINTN                 Count;
   UINT8                 TRBType;
+  UINT8                 SlotId;
+  UINT8                 Dci;
   EFI_STATUS            Status;
-  URB                   *AsyncUrb;
   URB                   *CheckedUrb;
-  UINT64                XhcDequeue;
-  UINT32                High;
-  UINT32                Low;
   EFI_PHYSICAL_ADDRESS  PhyAddr;
 
-  ASSERT ((Xhc != NULL) && (Urb != NULL));
-
-  Status   = EFI_SUCCESS;
-  AsyncUrb = NULL;
+  EvtRing = &Xhc->EventRing;
+  Xhc->Statistics.Polls++;
 
-  if (Urb->Finished) {
-    goto EXIT;
-  }
-
-  EvtTrb = NULL;
-
-  if (XhcIsHalt (Xhc) || XhcIsSysError (Xhc)) {
-    Urb->Result |= EFI_USB_ERR_SYSTEM;
-    goto EXIT;
+  if ((EvtRing->EventRingDequeue == EvtRing->EventRingEnqueue) &&
+      (EvtRing->EventRingDequeue->CycleBit != EvtRing->EventRingCCS))
+  {
+    Xhc->Statistics.WastedPolls++;
+    return 0;
   }
 
   //
   // Traverse the event ring to find out all new events from the previous check.
   //
-  XhcSyncEventRing (Xhc, &Xhc->EventRing);
-  for (Index = 0; Index < Xhc->EventRing.TrbNumber; Index++) {
-    Status = XhcCheckNewEvent (Xhc, &Xhc->EventRing, ((TRB_TEMPLATE **)&EvtTrb));
+  XhcSyncEventRing (Xhc, EvtRing);
+  Count = 0;
+  for (Index = 0; Index < EvtRing->TrbNumber; Index++) {
+    Status = XhcCheckNewEvent (Xhc, EvtRing, ((TRB_TEMPLATE **)&EvtTrb));
     if (Status == EFI_NOT_READY) {
-      //
-      // All new events are handled, return directly.
-      //
-      goto EXIT;
+      break;
     }
 
+    Count++;
+
     //
     // Only handle COMMAND_COMPLETETION_EVENT and TRANSFER_EVENT.
     //
-    if ((EvtTrb->Type != TRB_TYPE_COMMAND_COMPLT_EVENT) && (EvtTrb->Type != TRB_TYPE_TRANS_EVENT)) {
+    if (EvtTrb->Type == TRB_TYPE_COMMAND_COMPLT_EVENT) {
+      SlotId = 0;
+      Dci    = 0;
+    } else if (EvtTrb->Type == TRB_TYPE_TRANS_EVENT) {
+      SlotId = (UINT8)EvtTrb->SlotId;
+      Dci    = (UINT8)EvtTrb->EndpointId;
+    } else {
       continue;
     }
 
@@ -1154,18 +1313,13 @@ XhcCheckUrbResult (
     TRBPtr  = (TRB_TEMPLATE *)(UINTN)UsbHcGetHostAddrForPciAddr (Xhc->MemPool, (VOID *)(UINTN)PhyAddr, sizeof (TRB_TEMPLATE));
 
     //
-    // Update the status of URB including the pending URB, the URB that is currently checked,
-    // and URBs in the XHCI's async interrupt transfer list.
-    // This way is used to avoid that those completed async transfer events don't get
-    // handled in time and are flushed by newer coming events.
+    // Update the status of the URB queued on the endpoint of the event, be it the
+    // pending URB, a synchronous one, or one in the XHCI's async interrupt or stream
+    // transfer lists. Every event is taken in the pass, so those completed
+    // transfer events are not flushed by newer coming events.
     //
-    if ((Xhc->PendingUrb != NULL) && IsTransferRingTrb (Xhc, TRBPtr, Xhc->PendingUrb)) {
-      CheckedUrb = Xhc->PendingUrb;
-    } else if (IsTransferRingTrb (Xhc, TRBPtr, Urb)) {
-      CheckedUrb = Urb;
-    } else if (IsAsyncIntTrb (Xhc, TRBPtr, &AsyncUrb)) {
-      CheckedUrb = AsyncUrb;
-    } else {
+    CheckedUrb = XhcFindEventUrb (Xhc, SlotId, Dci, TRBPtr);
+    if (CheckedUrb == NULL) {
       continue;
     }
 
@@ -1173,29 +1327,37 @@ XhcCheckUrbResult (
       case TRB_COMPLETION_STALL_ERROR:
         CheckedUrb->Result  |= EFI_USB_ERR_STALL;
         CheckedUrb->Finished = TRUE;
-        DEBUG ((DEBUG_ERROR, "XhcCheckUrbResult: STALL_ERROR! Completecode = %x\n", EvtTrb->Completecode));
-        goto EXIT;
+        DEBUG ((DEBUG_ERROR, "XhcProcessEventRing: STALL_ERROR! Completecode = %x\n", EvtTrb->Completecode));
+        continue;
 
       case TRB_COMPLETION_BABBLE_ERROR:
         CheckedUrb->Result  |= EFI_USB_ERR_BABBLE;
         CheckedUrb->Finished = TRUE;
-        DEBUG ((DEBUG_ERROR, "XhcCheckUrbResult: BABBLE_ERROR! Completecode = %x\n", EvtTrb->Completecode));
-        goto EXIT;
+        DEBUG ((DEBUG_ERROR, "XhcProcessEventRing: BABBLE_ERROR! Completecode = %x\n", EvtTrb->Completecode));
+        continue;
 
       case TRB_COMPLETION_DATA_BUFFER_ERROR:
         CheckedUrb->Result  |= EFI_USB_ERR_BUFFER;
         CheckedUrb->Finished = TRUE;
-        DEBUG ((DEBUG_ERROR, "XhcCheckUrbResult: ERR_BUFFER! Completecode = %x\n", EvtTrb->Completecode));
-        goto EXIT;
+        DEBUG ((DEBUG_ERROR, "XhcProcessEventRing: ERR_BUFFER! Completecode = %x\n", EvtTrb->Completecode));
+        continue;
 
       case TRB_COMPLETION_USB_TRANSACTION_ERROR:
         CheckedUrb->Result  |= EFI_USB_ERR_TIMEOUT;
         CheckedUrb->Finished = TRUE;
-        DEBUG ((DEBUG_ERROR, "XhcCheckUrbResult: TRANSACTION_ERROR! Completecode = %x\n", EvtTrb->Completecode));
-        goto EXIT;
+        DEBUG ((DEBUG_ERROR, "XhcProcessEventRing: TRANSACTION_ERROR! Completecode = %x\n", EvtTrb->Completecode));
+        continue;
 
       case TRB_COMPLETION_STOPPED:
       case TRB_COMPLETION_STOPPED_LENGTH_INVALID:
+        if ((CheckedUrb->StreamId != 0) && (CheckedUrb != Xhc->PendingUrb)) {
+          //
+          // Stopping an endpoint to cancel the transfer on one stream stops the
+          // transfer running on another. The xHC resumes it on the next doorbell.
+          //
+          continue;
+        }
+
         CheckedUrb->Result  |= EFI_USB_ERR_TIMEOUT;
         CheckedUrb->Finished = TRUE;
         //
@@ -1207,7 +1369,7 @@ XhcCheckUrbResult (
       case TRB_COMPLETION_SHORT_PACKET:
       case TRB_COMPLETION_SUCCESS:
         if (EvtTrb->Completecode == TRB_COMPLETION_SHORT_PACKET) {
-          DEBUG ((DEBUG_VERBOSE, "XhcCheckUrbResult: short packet happens!\n"));
+          DEBUG ((DEBUG_VERBOSE, "XhcProcessEventRing: short packet happens!\n"));
         }
 
         TRBType = (UINT8)(TRBPtr->Type);
@@ -1224,7 +1386,7 @@ XhcCheckUrbResult (
         DEBUG ((DEBUG_ERROR, "Transfer Default Error Occur! Completecode = 0x%x!\n", EvtTrb->Completecode));
         CheckedUrb->Result  |= EFI_USB_ERR_TIMEOUT;
         CheckedUrb->Finished = TRUE;
-        goto EXIT;
+        continue;
     }
 
     //
@@ -1244,7 +1406,15 @@ XhcCheckUrbResult (
     }
   }
 
-EXIT:
+  Xhc->Statistics.Events += Count;
+  if (Count == 0) {
+    Xhc->Statistics.WastedPolls++;
+    return 0;
+  }
+
+  if (Count > Xhc->Statistics.MaxEventRingOccupancy) {
+    Xhc->Statistics.MaxEventRingOccupancy = (UINT32)Count;
+  }
 
   //
   // Advance event ring to last available entry
@@ -1252,19 +1422,72 @@ EXIT:
   // Some 3rd party XHCI external cards don't support single 64-bytes width register access,
   // So divide it to two 32-bytes width register access.
   //
-  Low        = XhcReadRuntimeReg (Xhc, XHC_ERDP_OFFSET);
-  High       = XhcReadRuntimeReg (Xhc, XHC_ERDP_OFFSET + 4);
-  XhcDequeue = (UINT64)(LShiftU64 ((UINT64)High, 32) | Low);
+  PhyAddr = UsbHcGetPciAddrForHostAddr (Xhc->MemPool, EvtRing->EventRingDequeue, sizeof (TRB_TEMPLATE));
+  XhcWriteRuntimeReg (Xhc, XHC_ERDP_OFFSET, XHC_LOW_32BIT (PhyAddr) | BIT3);
+  XhcWriteRuntimeReg (Xhc, XHC_ERDP_OFFSET + 4, XHC_HIGH_32BIT (PhyAddr));
 
-  PhyAddr = UsbHcGetPciAddrForHostAddr (Xhc->MemPool, Xhc->EventRing.EventRingDequeue, sizeof (TRB_TEMPLATE));
+  return Count;
+}
 
-  if ((XhcDequeue & (~0x0F)) != (PhyAddr & (~0x0F))) {
-    //
-    // Some 3rd party XHCI external cards don't support single 64-bytes width register access,
-    // So divide it to two 32-bytes width register access.
-    //
-    XhcWriteRuntimeReg (Xhc, XHC_ERDP_OFFSET, XHC_LOW_32BIT (PhyAddr) | BIT3);
-    XhcWriteRuntimeReg (Xhc, XHC_ERDP_OFFSET + 4, XHC_HIGH_32BIT (PhyAddr));
+/**
+  Remove the URBs queued on the endpoints of a device slot from the event
+  dispatch, before the transfer rings of the slot are freed.
+
+  @param  Xhc             The XHCI Instance.
+  @param  SlotId          The slot id of the device.
+
+**/
+VOID
+XhcRemoveSlotActiveUrbs (
+  IN  USB_XHCI_INSTANCE  *Xhc,
+  IN  UINT8              SlotId
+  )
+{
+  LIST_ENTRY  *Entry;
+  LIST_ENTRY  *Next;
+  URB         *Urb;
+  UINTN       Dci;
+
+  for (Dci = 1; Dci < 32; Dci++) {
+    BASE_LIST_FOR_EACH_SAFE (Entry, Next, &Xhc->ActiveUrbs[Dci]) {
+      Urb = EFI_LIST_CONTAINER (Entry, URB, ActiveLink);
+      if (Urb->SlotId == SlotId) {
+        XhcRemoveActiveUrb (Urb);
+      }
+    }
+  }
+}
+
+/**
+  Check the URB's execution result and update the URB's
+  result accordingly.
+
+  @param  Xhc             The XHCI Instance.
+  @param  Urb             The URB to check result.
+
+  @return Whether the result of URB transfer is finialized.
+
+**/
+BOOLEAN
+XhcCheckUrbResult (
+  IN  USB_XHCI_INSTANCE  *Xhc,
+  IN  URB                *Urb
+  )
+{
+  ASSERT ((Xhc != NULL) && (Urb != NULL));
+
+  if (Urb->Finished) {
+    return TRUE;
+  }
+
+  //
+  // The status register is only read when the event ring is found empty, and
+  // once for both the halted and the system error bits.
+  //
+  if ((XhcProcessEventRing (Xhc) == 0) &&
+      ((XhcReadOpReg (Xhc, XHC_USBSTS_OFFSET) & (XHC_USBSTS_HALT | XHC_USBSTS_HSE)) != 0))
+  {
+    Urb->Result |= EFI_USB_ERR_SYSTEM;
   }
 
   return Urb->Finished;
@@ -1462,6 +1685,37 @@ XhciDelAllAsyncIntTransfers (
   }
 }
 
+/**
+  Remove all the stream transfers the class drivers left behind.
+
+  @param  Xhc    The XHCI Instance.
+
+**/
+VOID
+XhciDelAllStreamTransfers (
+  IN USB_XHCI_INSTANCE  *Xhc
+  )
+{
+  LIST_ENTRY  *Entry;
+  LIST_ENTRY  *Next;
+  URB         *Urb;
+  EFI_STATUS  Status;
+
+  BASE_LIST_FOR_EACH_SAFE (Entry, Next, &Xhc->StreamTransfers) {
+    Urb = EFI_LIST_CONTAINER (Entry, URB, UrbList);
+
+    if (!Urb->Finished) {
+      Status = XhcDequeueTrbFromEndpoint (Xhc, Urb);
+      if (EFI_ERROR (Status)) {
+        DEBUG ((DEBUG_ERROR, "XhciDelAllStreamTransfers: XhcDequeueTrbFromEndpoint failed\n"));
+      }
+    }
+
+    RemoveEntryList (&Urb->UrbList);
+    XhcFreeUrb (Xhc, Urb);
+  }
+}
+
 /**
   Insert a single asynchronous interrupt transfer for
   the device and endpoint.
@@ -1523,12 +1777,14 @@ XhciInsertAsyncIntTransfer (
   // Check the comments in XhcMoniteAsyncRequests
   //
   InsertHeadList (&Xhc->AsyncIntTransfers, &Urb->UrbList);
+  XhcUpdatePollInterval (Xhc, TRUE);
 
   return Urb;
 }
 
 /**
-  Update the queue head for next round of asynchronous transfer
+  Update the queue head for next round of asynchronous transfer. The doorbell
+  is left for XhcMonitorAsyncRequests to ring once the round is queued.
 
   @param  Xhc     The XHCI Instance.
   @param  Urb     The URB to update
@@ -1548,10 +1804,40 @@ XhcUpdateAsyncRequest (
       return;
     }
 
-    Status = RingIntTransferDoorBell (Xhc, Urb);
-    if (EFI_ERROR (Status)) {
-      return;
-    }
+    Urb->DoorBellPending = TRUE;
+  }
+}
+
+/**
+  Set the interval of the asynchronous transfer timer from the last tick. The
+  interval goes back to XHC_ASYNC_TIMER_INTERVAL when a transfer completes, and
+  doubles after every XHC_ASYNC_TIMER_IDLE_POLLS ticks without one, up to
+  XHC_ASYNC_TIMER_MAX_INTERVAL.
+
+  @param  Xhc     The XHCI Instance.
+  @param  Busy    Whether a transfer completed, or a new one was started.
+
+**/
+VOID
+XhcUpdatePollInterval (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN BOOLEAN            Busy
+  )
+{
+  UINT64  Interval;
+
+  Interval = Xhc->PollInterval;
+  if (Busy) {
+    Xhc->IdlePolls = 0;
+    Interval       = XHC_ASYNC_TIMER_INTERVAL;
+  } else if (++Xhc->IdlePolls >= XHC_ASYNC_TIMER_IDLE_POLLS) {
+    Xhc->IdlePolls = 0;
+    Interval       = MIN (Interval * 2, XHC_ASYNC_TIMER_MAX_INTERVAL);
+  }
+
+  if (Interval != Xhc->PollInterval) {
+    Xhc->PollInterval = Interval;
+    gBS->SetTimer (Xhc->PollTimer, TimerPeriodic, Interval);
   }
 }
 
@@ -1613,6 +1899,10 @@ ON_ERROR:
 /**
   Interrupt transfer periodic check handler.
 
+  The new events are taken from the event ring in one pass, then the finished
+  transfers are handed to their callbacks and queued again, and last the
+  doorbells of their endpoints are rung.
+
   @param  Event                 Interrupt event.
   @param  Context               Pointer to USB_XHCI_INSTANCE.
 
@@ -1630,6 +1920,7 @@ XhcMonitorAsyncRequests (
   UINT8              *ProcBuf;
   URB                *Urb;
   UINT8              SlotId;
+  UINTN              Completed;
   EFI_STATUS         Status;
   EFI_TPL            OldTpl;
 
@@ -1637,27 +1928,30 @@ XhcMonitorAsyncRequests (
 
   Xhc = (USB_XHCI_INSTANCE *)Context;
 
+  XhcProcessEventRing (Xhc);
+
+  Completed = 0;
   BASE_LIST_FOR_EACH_SAFE (Entry, Next, &Xhc->AsyncIntTransfers) {
     Urb = EFI_LIST_CONTAINER (Entry, URB, UrbList);
 
     //
-    // Make sure that the device is available before every check.
+    // Check the result of URB execution. If it is still
+    // active, check the next one.
     //
-    SlotId = XhcBusDevAddrToSlotId (Xhc, Urb->Ep.BusAddr);
-    if (SlotId == 0) {
+    if (!Urb->Finished) {
       continue;
     }
 
     //
-    // Check the result of URB execution. If it is still
-    // active, check the next one.
+    // Make sure that the device is available before every check.
     //
-    XhcCheckUrbResult (Xhc, Urb);
-
-    if (!Urb->Finished) {
+    SlotId = XhcBusDevAddrToSlotId (Xhc, Urb->Ep.BusAddr);
+    if (SlotId == 0) {
       continue;
     }
 
+    Completed++;
+
     //
     // Flush any PCI posted write transactions from a PCI host
     // bridge to system memory.
@@ -1715,9 +2009,54 @@ XhcMonitorAsyncRequests (
 
     XhcUpdateAsyncRequest (Xhc, Urb);
   }
+
+  //
+  // Ring the doorbells of the transfers queued again in this round, once the
+  // callbacks are done. A URB removed by a callback is off the list.
+  //
+  BASE_LIST_FOR_EACH (Entry, &Xhc->AsyncIntTransfers) {
+    Urb = EFI_LIST_CONTAINER (Entry, URB, UrbList);
+    if (Urb->DoorBellPending) {
+      Urb->DoorBellPending = FALSE;
+      RingIntTransferDoorBell (Xhc, Urb);
+    }
+  }
+
+  XhcUpdatePollInterval (Xhc, (BOOLEAN)(Completed != 0));
   gBS->RestoreTPL (OldTpl);
 }
 
+/**
+  Print the counters of the event ring passes and of the transfer rings.
+
+  @param  Xhc             The XHCI Instance.
+
+**/
+VOID
+XhcDumpStatistics (
+  IN  USB_XHCI_INSTANCE  *Xhc
+  )
+{
+  XHC_STATISTICS  *Stats;
+
+  Stats = &Xhc->Statistics;
+  DEBUG ((
+    DEBUG_INFO,
+    "XhcDumpStatistics: %ld polls, %ld wasted, %ld events, at most %d in a poll\n",
+    Stats->Polls,
+    Stats->WastedPolls,
+    Stats->Events,
+    Stats->MaxEventRingOccupancy
+    ));
+  DEBUG ((
+    DEBUG_INFO,
+    "XhcDumpStatistics: %ld TRBs on %ld doorbells, at most %d TRBs pending on a ring\n",
+    Stats->Trbs,
+    Stats->DoorBells,
+    Stats->MaxTransferRingOccupancy
+    ));
+}
+
 /**
   Monitor the port status change. Enable/Disable device slot if there is a device attached/detached.
 
@@ -2089,11 +2428,72 @@ XhcRingDoorBell (
     XhcWriteDoorBellReg (Xhc, 0, 0);
   } else {
     XhcWriteDoorBellReg (Xhc, SlotId * sizeof (UINT32), Dci);
+    Xhc->Statistics.DoorBells++;
   }
 
   return EFI_SUCCESS;
 }
 
+/**
+  Ring the door bell to notify XHCI there is a transaction to be executed on a stream.
+
+  @param  Xhc           The XHCI Instance.
+  @param  SlotId        The slot id of the target device.
+  @param  Dci           The device context index of the target endpoint.
+  @param  StreamId      The stream of the endpoint, or 0 for an endpoint without streams.
+
+**/
+VOID
+XhcRingStreamDoorBell (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci,
+  IN UINT16             StreamId
+  )
+{
+  //
+  // 5.6 Doorbell Register: DB Stream ID is in bits 31:16.
+  //
+  XhcWriteDoorBellReg (Xhc, SlotId * sizeof (UINT32), Dci | ((UINT32)StreamId << 16));
+  Xhc->Statistics.DoorBells++;
+}
+
+/**
+  Ring the door bell of an endpoint after it is stopped or reset, to transit it to
+  active. An endpoint with streams is rung for every stream that has a pending
+  transfer, as the xHC only schedules the streams it is told about.
+
+  @param  Xhc           The XHCI Instance.
+  @param  SlotId        The slot id of the target device.
+  @param  Dci           The device context index of the target endpoint.
+
+**/
+VOID
+XhcRingEndpointDoorBell (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci
+  )
+{
+  LIST_ENTRY  *Entry;
+  URB         *Urb;
+
+  if (Xhc->UsbDevContext[SlotId].StreamCount[Dci - 1] == 0) {
+    XhcRingDoorBell (Xhc, SlotId, Dci);
+    return;
+  }
+
+  BASE_LIST_FOR_EACH (Entry, &Xhc->StreamTransfers) {
+    Urb = EFI_LIST_CONTAINER (Entry, URB, UrbList);
+    if (!Urb->Finished && (Urb->StreamId != 0) &&
+        (XhcBusDevAddrToSlotId (Xhc, Urb->Ep.BusAddr) == SlotId) &&
+        (XhcEndpointToDci (Urb->Ep.EpAddr, (UINT8)(Urb->Ep.Direction)) == Dci))
+    {
+      XhcRingStreamDoorBell (Xhc, SlotId, Dci, Urb->StreamId);
+    }
+  }
+}
+
 /**
   Ring the door bell to notify XHCI there is a transaction to be executed through URB.
 
@@ -2550,6 +2950,77 @@ XhcInitializeDeviceSlot64 (
   return Status;
 }
 
+/**
+  Finish the pending URBs of XHCI's stream transfer list that are on the given
+  transfer rings with a system error, before the rings are freed.
+
+  @param  Xhc           The XHCI Instance.
+  @param  Rings         The first of the transfer rings.
+  @param  RingCount     The number of transfer rings.
+
+**/
+VOID
+XhcAbortStreamTransfers (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN TRANSFER_RING      *Rings,
+  IN UINTN              RingCount
+  )
+{
+  LIST_ENTRY  *Entry;
+  URB         *Urb;
+
+  BASE_LIST_FOR_EACH (Entry, &Xhc->StreamTransfers) {
+    Urb = EFI_LIST_CONTAINER (Entry, URB, UrbList);
+    if (!Urb->Finished && (Urb->Ring >= Rings) && (Urb->Ring < Rings + RingCount)) {
+      Urb->Result  |= EFI_USB_ERR_SYSTEM;
+      Urb->Finished = TRUE;
+    }
+  }
+}
+
+/**
+  Free the Primary Stream Array and the stream transfer rings of an endpoint.
+
+  @param  Xhc           The XHCI Instance.
+  @param  SlotId        The slot id of the device.
+  @param  Dci           The device context index of the endpoint.
+
+**/
+VOID
+XhcFreeStreamRings (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci
+  )
+{
+  USB_DEV_CONTEXT  *DevContext;
+  TRANSFER_RING    *Rings;
+  UINTN            Index;
+
+  DevContext = &Xhc->UsbDevContext[SlotId];
+  if (DevContext->StreamCount[Dci - 1] == 0) {
+    return;
+  }
+
+  Rings = DevContext->StreamTransferRing[Dci - 1];
+  XhcAbortStreamTransfers (Xhc, &Rings[1], DevContext->StreamCount[Dci - 1]);
+  for (Index = 1; Index <= DevContext->StreamCount[Dci - 1]; Index++) {
+    UsbHcFreeMem (Xhc->MemPool, Rings[Index].RingSeg0, sizeof (TRB_TEMPLATE) * STREAM_RING_TRB_NUMBER);
+  }
+
+  FreePool (Rings);
+  UsbHcFreeMem (
+    Xhc->MemPool,
+    DevContext->StreamContextArray[Dci - 1],
+    DevContext->StreamArraySize[Dci - 1] * sizeof (STREAM_CONTEXT)
+    );
+
+  DevContext->StreamContextArray[Dci - 1] = NULL;
+  DevContext->StreamArraySize[Dci - 1]    = 0;
+  DevContext->StreamTransferRing[Dci - 1] = NULL;
+  DevContext->StreamCount[Dci - 1]        = 0;
+}
+
 /**
   Disable the specified device slot.
 
@@ -2620,8 +3091,11 @@ XhcDisableSlotCmd (
   //
   // Free the slot related data structure
   //
+  XhcRemoveSlotActiveUrbs (Xhc, SlotId);
   for (Index = 0; Index < 31; Index++) {
+    XhcFreeStreamRings (Xhc, SlotId, (UINT8)(Index + 1));
     if (Xhc->UsbDevContext[SlotId].EndpointTransferRing[Index] != NULL) {
+      XhcAbortStreamTransfers (Xhc, Xhc->UsbDevContext[SlotId].EndpointTransferRing[Index], 1);
       RingSeg = ((TRANSFER_RING *)(UINTN)Xhc->UsbDevContext[SlotId].EndpointTransferRing[Index])->RingSeg0;
       if (RingSeg != NULL) {
         UsbHcFreeMem (Xhc->MemPool, RingSeg, sizeof (TRB_TEMPLATE) * TR_RING_TRB_NUMBER);
@@ -2731,8 +3205,11 @@ XhcDisableSlotCmd64 (
   //
   // Free the slot related data structure
   //
+  XhcRemoveSlotActiveUrbs (Xhc, SlotId);
   for (Index = 0; Index < 31; Index++) {
+    XhcFreeStreamRings (Xhc, SlotId, (UINT8)(Index + 1));
     if (Xhc->UsbDevContext[SlotId].EndpointTransferRing[Index] != NULL) {
+      XhcAbortStreamTransfers (Xhc, Xhc->UsbDevContext[SlotId].EndpointTransferRing[Index], 1);
       RingSeg = ((TRANSFER_RING *)(UINTN)Xhc->UsbDevContext[SlotId].EndpointTransferRing[Index])->RingSeg0;
       if (RingSeg != NULL) {
         UsbHcFreeMem (Xhc->MemPool, RingSeg, sizeof (TRB_TEMPLATE) * TR_RING_TRB_NUMBER);
@@ -3513,6 +3990,14 @@ XhcSetTrDequeuePointer (
   PhyAddr              = UsbHcGetPciAddrForHostAddr (Xhc->MemPool, Urb->Ring->RingEnqueue, sizeof (CMD_SET_TR_DEQ_POINTER));
   CmdSetTRDeq.PtrLo    = XHC_LOW_32BIT (PhyAddr) | Urb->Ring->RingPCS;
   CmdSetTRDeq.PtrHi    = XHC_HIGH_32BIT (PhyAddr);
+  if (Urb->StreamId != 0) {
+    //
+    // Update the Stream Context of the stream, which holds a Primary TR.
+    //
+    CmdSetTRDeq.PtrLo   |= STREAM_CONTEXT_TYPE_PRIMARY_TR << 1;
+    CmdSetTRDeq.StreamID = Urb->StreamId;
+  }
+
   CmdSetTRDeq.CycleBit = 1;
   CmdSetTRDeq.Type     = TRB_TYPE_SET_TR_DEQUE;
   CmdSetTRDeq.Endpoint = Dci;
@@ -3665,7 +4150,9 @@ XhcSetInterface (
       // XHCI 4.3.6 - Setting Alternate Interfaces
       // 2) Free Transfer Rings of all endpoints that will be affected by the Alternate Interface setting.
       //
+      XhcFreeStreamRings (Xhc, SlotId, Dci);
       if (Xhc->UsbDevContext[SlotId].EndpointTransferRing[Dci - 1] != NULL) {
+        XhcAbortStreamTransfers (Xhc, Xhc->UsbDevContext[SlotId].EndpointTransferRing[Dci - 1], 1);
         RingSeg = ((TRANSFER_RING *)(UINTN)Xhc->UsbDevContext[SlotId].EndpointTransferRing[Dci - 1])->RingSeg0;
         if (RingSeg != NULL) {
           UsbHcFreeMem (Xhc->MemPool, RingSeg, sizeof (TRB_TEMPLATE) * TR_RING_TRB_NUMBER);
@@ -3871,7 +4358,9 @@ XhcSetInterface64 (
       // XHCI 4.3.6 - Setting Alternate Interfaces
       // 2) Free Transfer Rings of all endpoints that will be affected by the Alternate Interface setting.
       //
+      XhcFreeStreamRings (Xhc, SlotId, Dci);
       if (Xhc->UsbDevContext[SlotId].EndpointTransferRing[Dci - 1] != NULL) {
+        XhcAbortStreamTransfers (Xhc, Xhc->UsbDevContext[SlotId].EndpointTransferRing[Dci - 1], 1);
         RingSeg = ((TRANSFER_RING *)(UINTN)Xhc->UsbDevContext[SlotId].EndpointTransferRing[Dci - 1])->RingSeg0;
         if (RingSeg != NULL) {
           UsbHcFreeMem (Xhc->MemPool, RingSeg, sizeof (TRB_TEMPLATE) * TR_RING_TRB_NUMBER);
@@ -4201,3 +4690,287 @@ XhcConfigHubContext64 (
 
   return Status;
 }
+
+/**
+  Check whether a transfer is pending on a stream of an endpoint.
+
+  @param  Xhc           The XHCI Instance.
+  @param  SlotId        The slot id of the device.
+  @param  Dci           The device context index of the endpoint.
+  @param  StreamId      The stream to check, or MAX_UINT16 for any stream.
+
+  @retval TRUE          A transfer is pending on the stream.
+  @retval FALSE         No transfer is pending on the stream.
+
+**/
+BOOLEAN
+XhcIsStreamBusy (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci,
+  IN UINT16             StreamId
+  )
+{
+  LIST_ENTRY  *Entry;
+  URB         *Urb;
+
+  BASE_LIST_FOR_EACH (Entry, &Xhc->StreamTransfers) {
+    Urb = EFI_LIST_CONTAINER (Entry, URB, UrbList);
+    if (!Urb->Finished &&
+        ((StreamId == MAX_UINT16) || (Urb->StreamId == StreamId)) &&
+        (XhcBusDevAddrToSlotId (Xhc, Urb->Ep.BusAddr) == SlotId) &&
+        (XhcEndpointToDci (Urb->Ep.EpAddr, (UINT8)(Urb->Ep.Direction)) == Dci))
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**
+  Change the TR Dequeue Pointer and the streams of an endpoint through XHCI's
+  Configure_Endpoint cmd.
+
+  @param  Xhc           The XHCI Instance.
+  @param  SlotId        The slot id of the device.
+  @param  Dci           The device context index of the endpoint.
+  @param  MaxPStreams   The MaxPStreams of the endpoint, 0 for no streams.
+  @param  Dequeue       The TR Dequeue Pointer of the endpoint, with its DCS, or
+                        the Primary Stream Array.
+
+  @retval EFI_SUCCESS   The endpoint is configured.
+  @retval Others        Failed to configure the endpoint.
+
+**/
+EFI_STATUS
+XhcConfigStreamEndpoint (
+  IN USB_XHCI_INSTANCE     *Xhc,
+  IN UINT8                 SlotId,
+  IN UINT8                 Dci,
+  IN UINT8                 MaxPStreams,
+  IN EFI_PHYSICAL_ADDRESS  Dequeue
+  )
+{
+  VOID                        *InputContext;
+  VOID                        *OutputContext;
+  INPUT_CONTRL_CONTEXT        *InputControl;
+  ENDPOINT_CONTEXT            *InputEp;
+  ENDPOINT_CONTEXT            *OutputEp;
+  UINTN                       ContextSize;
+  EFI_PHYSICAL_ADDRESS        PhyAddr;
+  CMD_TRB_CONFIG_ENDPOINT     CmdTrbCfgEP;
+  EVT_TRB_COMMAND_COMPLETION  *EvtTrb;
+  EFI_STATUS                  Status;
+
+  InputContext  = Xhc->UsbDevContext[SlotId].InputContext;
+  OutputContext = Xhc->UsbDevContext[SlotId].OutputContext;
+
+  //
+  // The first 32 bytes of the 64-byte contexts are laid out as the 32-byte ones.
+  //
+  if (Xhc->HcCParams.Data.Csz == 0) {
+    ContextSize = sizeof (INPUT_CONTEXT);
+    ZeroMem (InputContext, ContextSize);
+    CopyMem (&((INPUT_CONTEXT *)InputContext)->Slot, &((DEVICE_CONTEXT *)OutputContext)->Slot, sizeof (SLOT_CONTEXT));
+    InputControl = &((INPUT_CONTEXT *)InputContext)->InputControlContext;
+    InputEp      = &((INPUT_CONTEXT *)InputContext)->EP[Dci - 1];
+    OutputEp     = &((DEVICE_CONTEXT *)OutputContext)->EP[Dci - 1];
+  } else {
+    ContextSize = sizeof (INPUT_CONTEXT_64);
+    ZeroMem (InputContext, ContextSize);
+    CopyMem (&((INPUT_CONTEXT_64 *)InputContext)->Slot, &((DEVICE_CONTEXT_64 *)OutputContext)->Slot, sizeof (SLOT_CONTEXT_64));
+    InputControl = (INPUT_CONTRL_CONTEXT *)&((INPUT_CONTEXT_64 *)InputContext)->InputControlContext;
+    InputEp      = (ENDPOINT_CONTEXT *)&((INPUT_CONTEXT_64 *)InputContext)->EP[Dci - 1];
+    OutputEp     = (ENDPOINT_CONTEXT *)&((DEVICE_CONTEXT_64 *)OutputContext)->EP[Dci - 1];
+  }
+
+  //
+  // XHCI 4.6.6 Configure Endpoint
+  // If a parameter of an enabled endpoint is modified, the Drop Context and Add Context
+  // flags shall be set to '1'. The endpoint keeps all its other parameters.
+  //
+  CopyMem (InputEp, OutputEp, sizeof (ENDPOINT_CONTEXT));
+  InputEp->EPState     = 0;
+  InputEp->MaxPStreams = MaxPStreams;
+  InputEp->LSA         = (MaxPStreams != 0) ? 1 : 0;
+  InputEp->HID         = 0;
+  InputEp->PtrLo       = XHC_LOW_32BIT (Dequeue);
+  InputEp->PtrHi       = XHC_HIGH_32BIT (Dequeue);
+
+  InputControl->Dword1 = BIT0 << Dci;
+  InputControl->Dword2 = BIT0 | (BIT0 << Dci);
+
+  ZeroMem (&CmdTrbCfgEP, sizeof (CmdTrbCfgEP));
+  PhyAddr              = UsbHcGetPciAddrForHostAddr (Xhc->MemPool, InputContext, ContextSize);
+  CmdTrbCfgEP.PtrLo    = XHC_LOW_32BIT (PhyAddr);
+  CmdTrbCfgEP.PtrHi    = XHC_HIGH_32BIT (PhyAddr);
+  CmdTrbCfgEP.CycleBit = 1;
+  CmdTrbCfgEP.Type     = TRB_TYPE_CON_ENDPOINT;
+  CmdTrbCfgEP.SlotId   = Xhc->UsbDevContext[SlotId].SlotId;
+  DEBUG ((DEBUG_INFO, "XhcConfigStreamEndpoint: Slot = 0x%x, Dci = 0x%x, MaxPStreams = %d\n", SlotId, Dci, MaxPStreams));
+  Status = XhcCmdTransfer (
+             Xhc,
+             (TRB_TEMPLATE *)(UINTN)&CmdTrbCfgEP,
+             XHC_GENERIC_TIMEOUT,
+             (TRB_TEMPLATE **)(UINTN)&EvtTrb
+             );
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "XhcConfigStreamEndpoint: Config Endpoint Failed, Status = %r\n", Status));
+  }
+
+  return Status;
+}
+
+/**
+  Give streams to a bulk endpoint through XHCI's Configure_Endpoint cmd.
+
+  Every stream gets a transfer ring of its own, pointed to by its Stream Context in
+  a linear Primary Stream Array, as in XHCI 4.12.2. The transfer ring of the endpoint
+  is kept for the time the streams are freed.
+
+  @param  Xhc           The XHCI Instance.
+  @param  SlotId        The slot id of the device.
+  @param  Dci           The device context index of the endpoint.
+  @param  StreamCount   On input, the number of streams wanted. On output, the
+                        number of streams allocated.
+
+  @retval EFI_SUCCESS           The streams are allocated.
+  @retval EFI_ALREADY_STARTED   The endpoint already has streams.
+  @retval EFI_UNSUPPORTED       The xHC has no streams.
+  @retval EFI_INVALID_PARAMETER The endpoint is not a bulk endpoint.
+  @retval EFI_OUT_OF_RESOURCES  The Primary Stream Array could not be allocated.
+  @retval Others                Failed to configure the endpoint.
+
+**/
+EFI_STATUS
+XhcAllocateStreams (
+  IN     USB_XHCI_INSTANCE  *Xhc,
+  IN     UINT8              SlotId,
+  IN     UINT8              Dci,
+  IN OUT UINT16             *StreamCount
+  )
+{
+  USB_DEV_CONTEXT       *DevContext;
+  STREAM_CONTEXT        *Contexts;
+  TRANSFER_RING         *Rings;
+  UINT32                ArraySize;
+  UINT32                MaxArraySize;
+  UINT16                Count;
+  UINTN                 Index;
+  UINT8                 EPType;
+  EFI_PHYSICAL_ADDRESS  PhyAddr;
+  EFI_STATUS            Status;
+
+  DevContext = &Xhc->UsbDevContext[SlotId];
+  if (DevContext->StreamCount[Dci - 1] != 0) {
+    return EFI_ALREADY_STARTED;
+  }
+
+  //
+  // 5.3.6 HCCPARAMS1: the Primary Stream Array holds up to 2 ^ (MaxPSASize + 1)
+  // Stream Contexts, and a MaxPSASize of 0 means the xHC has no streams.
+  //
+  if (Xhc->HcCParams.Data.MaxPsaSize == 0) {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (Xhc->HcCParams.Data.Csz == 0) {
+    EPType = (UINT8)((DEVICE_CONTEXT *)DevContext->OutputContext)->EP[Dci - 1].EPType;
+  } else {
+    EPType = (UINT8)((DEVICE_CONTEXT_64 *)DevContext->OutputContext)->EP[Dci - 1].EPType;
+  }
+
+  if ((EPType != ED_BULK_IN) && (EPType != ED_BULK_OUT)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  //
+  // Stream ID 0 is reserved, so the array has one more entry than the streams,
+  // rounded up to a power of 2.
+  //
+  MaxArraySize = (UINT32)1 << (Xhc->HcCParams.Data.MaxPsaSize + 1);
+  ArraySize    = 2;
+  while ((ArraySize <= *StreamCount) && (ArraySize < MaxArraySize)) {
+    ArraySize <<= 1;
+  }
+
+  Count = (UINT16)MIN (*StreamCount, ArraySize - 1);
+
+  Contexts = UsbHcAllocateMem (Xhc->MemPool, ArraySize * sizeof (STREAM_CONTEXT), TRUE);
+  if (Contexts == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Rings = AllocateZeroPool ((Count + 1) * sizeof (TRANSFER_RING));
+  if (Rings == NULL) {
+    UsbHcFreeMem (Xhc->MemPool, Contexts, ArraySize * sizeof (STREAM_CONTEXT));
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  ZeroMem (Contexts, ArraySize * sizeof (STREAM_CONTEXT));
+  for (Index = 1; Index <= Count; Index++) {
+    CreateTransferRing (Xhc, STREAM_RING_TRB_NUMBER, &Rings[Index]);
+    PhyAddr               = UsbHcGetPciAddrForHostAddr (Xhc->MemPool, Rings[Index].RingSeg0, sizeof (TRB_TEMPLATE) * STREAM_RING_TRB_NUMBER);
+    Contexts[Index].PtrLo = XHC_LOW_32BIT (PhyAddr) | (STREAM_CONTEXT_TYPE_PRIMARY_TR << 1) | Rings[Index].RingPCS;
+    Contexts[Index].PtrHi = XHC_HIGH_32BIT (PhyAddr);
+  }
+
+  DevContext->StreamContextArray[Dci - 1] = Contexts;
+  DevContext->StreamArraySize[Dci - 1]    = ArraySize;
+  DevContext->StreamTransferRing[Dci - 1] = Rings;
+  DevContext->StreamCount[Dci - 1]        = Count;
+
+  PhyAddr = UsbHcGetPciAddrForHostAddr (Xhc->MemPool, Contexts, ArraySize * sizeof (STREAM_CONTEXT));
+  Status  = XhcConfigStreamEndpoint (Xhc, SlotId, Dci, (UINT8)(HighBitSet32 (ArraySize) - 1), PhyAddr);
+  if (EFI_ERROR (Status)) {
+    XhcFreeStreamRings (Xhc, SlotId, Dci);
+    return Status;
+  }
+
+  *StreamCount = Count;
+  return EFI_SUCCESS;
+}
+
+/**
+  Take the streams back from a bulk endpoint through XHCI's Configure_Endpoint cmd.
+
+  The endpoint goes back to its transfer ring, where it was left when the streams
+  were allocated.
+
+  @param  Xhc           The XHCI Instance.
+  @param  SlotId        The slot id of the device.
+  @param  Dci           The device context index of the endpoint.
+
+  @retval EFI_SUCCESS   The endpoint is back to its transfer ring.
+  @retval EFI_NOT_FOUND The endpoint has no streams.
+  @retval Others        Failed to configure the endpoint.
+
+**/
+EFI_STATUS
+XhcFreeStreams (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci
+  )
+{
+  TRANSFER_RING         *Ring;
+  EFI_PHYSICAL_ADDRESS  PhyAddr;
+  EFI_STATUS            Status;
+
+  if (Xhc->UsbDevContext[SlotId].StreamCount[Dci - 1] == 0) {
+    return EFI_NOT_FOUND;
+  }
+
+  Ring = (TRANSFER_RING *)(UINTN)Xhc->UsbDevContext[SlotId].EndpointTransferRing[Dci - 1];
+  ASSERT (Ring != NULL);
+
+  PhyAddr = UsbHcGetPciAddrForHostAddr (Xhc->MemPool, Ring->RingEnqueue, sizeof (TRB_TEMPLATE));
+  Status  = XhcConfigStreamEndpoint (Xhc, SlotId, Dci, 0, PhyAddr | Ring->RingPCS);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  XhcFreeStreamRings (Xhc, SlotId, Dci);
+  return EFI_SUCCESS;
+}
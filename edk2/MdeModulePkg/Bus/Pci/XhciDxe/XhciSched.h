@@ -174,6 +174,10 @@ typedef struct _URB {
   EFI_ASYNC_USB_TRANSFER_CALLBACK    Callback;
   VOID                               *Context;
   //
+  // The stream of a bulk transfer on an endpoint with streams, or 0
+  //
+  UINT16                             StreamId;
+  //
   // Execute result
   //
   UINT32                             Result;
@@ -191,8 +195,19 @@ typedef struct _URB {
   BOOLEAN                            StartDone;
   BOOLEAN                            EndDone;
   BOOLEAN                            Finished;
+  //
+  // The doorbell of the endpoint is not rung yet for the queued TRBs
+  //
+  BOOLEAN                            DoorBellPending;
 
   TRB_TEMPLATE                       *EvtTrb;
+  //
+  // The endpoint the URB is queued on, SlotId 0 and Dci 0 for a command, and
+  // the link in USB_XHCI_INSTANCE.ActiveUrbs[Dci]
+  //
+  UINT8                              SlotId;
+  UINT8                              Dci;
+  LIST_ENTRY                         ActiveLink;
 } URB;
 
 //
@@ -693,6 +708,27 @@ typedef struct _ENDPOINT_CONTEXT_64 {
   UINT32    RsvdZ15;
 } ENDPOINT_CONTEXT_64;
 
+//
+// 6.2.4.1 Stream Context
+// The Stream Contexts of a Primary Stream Array hold the TR Dequeue Pointers of the
+// Transfer Rings of the streams of an endpoint whose MaxPStreams is not 0.
+//
+typedef struct _STREAM_CONTEXT {
+  UINT32    PtrLo;
+
+  UINT32    PtrHi;
+
+  UINT32    StoppedEDTLA : 24;
+  UINT32    RsvdZ1       : 8;
+
+  UINT32    RsvdZ2;
+} STREAM_CONTEXT;
+
+//
+// 6.2.4.1 Stream Context Type, in bits 3:1 of the TR Dequeue Pointer
+//
+#define STREAM_CONTEXT_TYPE_PRIMARY_TR  1
+
 //
 // 6.2.5.1 Input Control Context
 //
@@ -842,6 +878,17 @@ XhciDelAllAsyncIntTransfers (
   IN USB_XHCI_INSTANCE  *Xhc
   );
 
+/**
+  Remove all the stream transfers the class drivers left behind.
+
+  @param  Xhc                   The XHCI Instance.
+
+**/
+VOID
+XhciDelAllStreamTransfers (
+  IN USB_XHCI_INSTANCE  *Xhc
+  );
+
 /**
   Insert a single asynchronous interrupt transfer for
   the device and endpoint.
@@ -941,6 +988,39 @@ XhcRingDoorBell (
   IN UINT8              Dci
   );
 
+/**
+  Ring the door bell to notify XHCI there is a transaction to be executed on a stream.
+
+  @param  Xhc           The XHCI Instance.
+  @param  SlotId        The slot id of the target device.
+  @param  Dci           The device context index of the target endpoint.
+  @param  StreamId      The stream of the endpoint, or 0 for an endpoint without streams.
+
+**/
+VOID
+XhcRingStreamDoorBell (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci,
+  IN UINT16             StreamId
+  );
+
+/**
+  Ring the door bell of an endpoint after it is stopped or reset, for every stream
+  that has a pending transfer if the endpoint has streams.
+
+  @param  Xhc           The XHCI Instance.
+  @param  SlotId        The slot id of the target device.
+  @param  Dci           The device context index of the target endpoint.
+
+**/
+VOID
+XhcRingEndpointDoorBell (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci
+  );
+
 /**
   Interrupt transfer periodic check handler.
 
@@ -1309,6 +1389,74 @@ CreateEventRing (
   OUT EVENT_RING         *EventRing
   );
 
+/**
+  Set the interval of the asynchronous transfer timer from the last tick.
+
+  @param  Xhc     The XHCI Instance.
+  @param  Busy    Whether a transfer completed, or a new one was started.
+
+**/
+VOID
+XhcUpdatePollInterval (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN BOOLEAN            Busy
+  );
+
+/**
+  Take all the new events from the event ring in one pass and dispatch them to
+  the URBs queued on their endpoints.
+
+  @param  Xhc             The XHCI Instance.
+
+  @return The number of events taken.
+
+**/
+UINTN
+XhcProcessEventRing (
+  IN  USB_XHCI_INSTANCE  *Xhc
+  );
+
+/**
+  Remove the URBs queued on the endpoints of a device slot from the event
+  dispatch, before the transfer rings of the slot are freed.
+
+  @param  Xhc             The XHCI Instance.
+  @param  SlotId          The slot id of the device.
+
+**/
+VOID
+XhcRemoveSlotActiveUrbs (
+  IN  USB_XHCI_INSTANCE  *Xhc,
+  IN  UINT8              SlotId
+  );
+
+/**
+  Print the counters of the event ring passes and of the transfer rings.
+
+  @param  Xhc             The XHCI Instance.
+
+**/
+VOID
+XhcDumpStatistics (
+  IN  USB_XHCI_INSTANCE  *Xhc
+  );
+
+/**
+  Check the URB's execution result and update the URB's
+  result accordingly.
+
+  @param  Xhc             The XHCI Instance.
+  @param  Urb             The URB to check result.
+
+  @return Whether the result of URB transfer is finialized.
+
+**/
+BOOLEAN
+XhcCheckUrbResult (
+  IN  USB_XHCI_INSTANCE  *Xhc,
+  IN  URB                *Urb
+  );
+
 /**
   System software shall use a Reset Endpoint Command (section 4.11.4.7) to remove the Halted
   condition in the xHC. After the successful completion of the Reset Endpoint Command, the Endpoint
@@ -1473,4 +1621,86 @@ XhcCreateTransferTrb (
   IN URB                *Urb
   );
 
+/**
+  Create a new URB for a bulk transfer on a stream, and start it.
+
+  @param  Xhc       The XHCI Instance
+  @param  BusAddr   The logical device address assigned by UsbBus driver
+  @param  EpAddr    Endpoint addrress
+  @param  StreamId  The stream of the transfer, or 0 on an endpoint without streams
+  @param  Data      The user data to transfer
+  @param  DataLen   The length of data buffer
+
+  @return Created URB or NULL
+
+**/
+URB *
+XhcCreateStreamUrb (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              BusAddr,
+  IN UINT8              EpAddr,
+  IN UINT16             StreamId,
+  IN VOID               *Data,
+  IN UINTN              DataLen
+  );
+
+/**
+  Check whether a transfer is pending on a stream of an endpoint.
+
+  @param  Xhc           The XHCI Instance.
+  @param  SlotId        The slot id of the device.
+  @param  Dci           The device context index of the endpoint.
+  @param  StreamId      The stream to check, or MAX_UINT16 for any stream.
+
+  @retval TRUE          A transfer is pending on the stream.
+  @retval FALSE         No transfer is pending on the stream.
+
+**/
+BOOLEAN
+XhcIsStreamBusy (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci,
+  IN UINT16             StreamId
+  );
+
+/**
+  Give streams to a bulk endpoint through XHCI's Configure_Endpoint cmd.
+
+  @param  Xhc           The XHCI Instance.
+  @param  SlotId        The slot id of the device.
+  @param  Dci           The device context index of the endpoint.
+  @param  StreamCount   On input, the number of streams wanted. On output, the
+                        number of streams allocated.
+
+  @retval EFI_SUCCESS   The streams are allocated.
+  @retval Others        Failed to allocate the streams.
+
+**/
+EFI_STATUS
+XhcAllocateStreams (
+  IN     USB_XHCI_INSTANCE  *Xhc,
+  IN     UINT8              SlotId,
+  IN     UINT8              Dci,
+  IN OUT UINT16             *StreamCount
+  );
+
+/**
+  Take the streams back from a bulk endpoint through XHCI's Configure_Endpoint cmd.
+
+  @param  Xhc           The XHCI Instance.
+  @param  SlotId        The slot id of the device.
+  @param  Dci           The device context index of the endpoint.
+
+  @retval EFI_SUCCESS   The endpoint is back to its transfer ring.
+  @retval Others        Failed to free the streams.
+
+**/
+EFI_STATUS
+XhcFreeStreams (
+  IN USB_XHCI_INSTANCE  *Xhc,
+  IN UINT8              SlotId,
+  IN UINT8              Dci
+  );
+
 #endif
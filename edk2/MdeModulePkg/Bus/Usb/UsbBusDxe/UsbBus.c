@@ -25,6 +25,14 @@ EFI_USB_IO_PROTOCOL  mUsbIoProtocol = {
   UsbIoPortReset
 };
 
+EDKII_USB_STREAM_IO_PROTOCOL  mUsbStreamIoProtocol = {
+  UsbStreamIoAllocateStreams,
+  UsbStreamIoFreeStreams,
+  UsbStreamIoSubmitTransfer,
+  UsbStreamIoPollTransfer,
+  UsbStreamIoCancelTransfer
+};
+
 EFI_DRIVER_BINDING_PROTOCOL  mUsbBusDriverBinding = {
   UsbBusControllerDriverSupported,
   UsbBusControllerDriverStart,
@@ -899,6 +907,245 @@ ON_EXIT:
   return Status;
 }
 
+/**
+  Check that an endpoint is a bulk endpoint of the current setting of the
+  interface.
+
+  @param  UsbIf                  The USB interface.
+  @param  Endpoint               The endpoint address, with the direction.
+
+  @return TRUE if the endpoint is a bulk endpoint of the interface.
+
+**/
+BOOLEAN
+UsbStreamIoIsBulkEndpoint (
+  IN USB_INTERFACE  *UsbIf,
+  IN UINT8          Endpoint
+  )
+{
+  USB_ENDPOINT_DESC  *EpDesc;
+
+  if ((USB_ENDPOINT_ADDR (Endpoint) == 0) || (USB_ENDPOINT_ADDR (Endpoint) > 15)) {
+    return FALSE;
+  }
+
+  EpDesc = UsbGetEndpointDesc (UsbIf, Endpoint);
+  return (BOOLEAN)((EpDesc != NULL) && (USB_ENDPOINT_TYPE (&EpDesc->Desc) == USB_ENDPOINT_BULK));
+}
+
+/**
+  Give streams to a bulk endpoint of the interface.
+
+  @param  This                   The stream I/O instance.
+  @param  Endpoint               The bulk endpoint, with the direction.
+  @param  StreamCount            On input, the number of streams wanted. On
+                                 output, the number of streams allocated.
+
+  @retval EFI_SUCCESS            The streams are allocated.
+  @retval EFI_INVALID_PARAMETER  The endpoint is not a bulk endpoint of the
+                                 interface.
+  @retval EFI_UNSUPPORTED        The device is not a SuperSpeed device.
+  @retval Others                 The host controller failed to allocate them.
+
+**/
+EFI_STATUS
+EFIAPI
+UsbStreamIoAllocateStreams (
+  IN     EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN     UINT8                         Endpoint,
+  IN OUT UINT16                        *StreamCount
+  )
+{
+  USB_INTERFACE  *UsbIf;
+  USB_DEVICE     *Dev;
+  EFI_TPL        OldTpl;
+  EFI_STATUS     Status;
+
+  OldTpl = gBS->RaiseTPL (USB_BUS_TPL);
+
+  UsbIf = USB_INTERFACE_FROM_STREAM_IO (This);
+  Dev   = UsbIf->Device;
+
+  if (!UsbStreamIoIsBulkEndpoint (UsbIf, Endpoint)) {
+    Status = EFI_INVALID_PARAMETER;
+    goto ON_EXIT;
+  }
+
+  //
+  // Only the SuperSpeed bulk endpoints have streams.
+  //
+  if (Dev->Speed != EFI_USB_SPEED_SUPER) {
+    Status = EFI_UNSUPPORTED;
+    goto ON_EXIT;
+  }
+
+  Status = Dev->Bus->StreamHc->AllocateStreams (
+                                 Dev->Bus->StreamHc,
+                                 Dev->Address,
+                                 Endpoint,
+                                 StreamCount
+                                 );
+
+ON_EXIT:
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
+/**
+  Take the streams back from a bulk endpoint of the interface.
+
+  @param  This                   The stream I/O instance.
+  @param  Endpoint               The bulk endpoint, with the direction.
+
+  @retval EFI_SUCCESS            The streams are freed.
+  @retval EFI_INVALID_PARAMETER  The endpoint is not a bulk endpoint of the
+                                 interface.
+  @retval Others                 The host controller failed to free them.
+
+**/
+EFI_STATUS
+EFIAPI
+UsbStreamIoFreeStreams (
+  IN EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN UINT8                         Endpoint
+  )
+{
+  USB_INTERFACE  *UsbIf;
+  USB_DEVICE     *Dev;
+  EFI_TPL        OldTpl;
+  EFI_STATUS     Status;
+
+  OldTpl = gBS->RaiseTPL (USB_BUS_TPL);
+
+  UsbIf = USB_INTERFACE_FROM_STREAM_IO (This);
+  Dev   = UsbIf->Device;
+
+  if (!UsbStreamIoIsBulkEndpoint (UsbIf, Endpoint)) {
+    Status = EFI_INVALID_PARAMETER;
+    goto ON_EXIT;
+  }
+
+  Status = Dev->Bus->StreamHc->FreeStreams (Dev->Bus->StreamHc, Dev->Address, Endpoint);
+
+ON_EXIT:
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
+/**
+  Start a bulk transfer on a stream of an endpoint of the interface.
+
+  @param  This                   The stream I/O instance.
+  @param  Endpoint               The bulk endpoint, with the direction.
+  @param  StreamId               The stream, or 0 on an endpoint without
+                                 streams.
+  @param  Data                   The data to transfer.
+  @param  DataLength             The length of the data to transfer.
+  @param  Transfer               The handle of the started transfer.
+
+  @retval EFI_SUCCESS            The transfer is started.
+  @retval EFI_INVALID_PARAMETER  The endpoint is not a bulk endpoint of the
+                                 interface.
+  @retval Others                 The host controller failed to start it.
+
+**/
+EFI_STATUS
+EFIAPI
+UsbStreamIoSubmitTransfer (
+  IN  EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN  UINT8                         Endpoint,
+  IN  UINT16                        StreamId,
+  IN  VOID                          *Data,
+  IN  UINTN                         DataLength,
+  OUT VOID                          **Transfer
+  )
+{
+  USB_INTERFACE  *UsbIf;
+  USB_DEVICE     *Dev;
+  EFI_TPL        OldTpl;
+  EFI_STATUS     Status;
+
+  OldTpl = gBS->RaiseTPL (USB_BUS_TPL);
+
+  UsbIf = USB_INTERFACE_FROM_STREAM_IO (This);
+  Dev   = UsbIf->Device;
+
+  if (!UsbStreamIoIsBulkEndpoint (UsbIf, Endpoint)) {
+    Status = EFI_INVALID_PARAMETER;
+    goto ON_EXIT;
+  }
+
+  Status = Dev->Bus->StreamHc->SubmitTransfer (
+                                 Dev->Bus->StreamHc,
+                                 Dev->Address,
+                                 Endpoint,
+                                 StreamId,
+                                 Data,
+                                 DataLength,
+                                 Transfer
+                                 );
+
+ON_EXIT:
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
+/**
+  Check whether a transfer started on the interface is done.
+
+  @param  This                   The stream I/O instance.
+  @param  Transfer               The handle of the transfer.
+  @param  DataLength             The number of bytes transferred.
+  @param  UsbStatus              The result of the transfer.
+
+  @retval EFI_SUCCESS            The transfer is done without error.
+  @retval EFI_NOT_READY          The transfer is still pending.
+  @retval Others                 The transfer is done with an error.
+
+**/
+EFI_STATUS
+EFIAPI
+UsbStreamIoPollTransfer (
+  IN  EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN  VOID                          *Transfer,
+  OUT UINTN                         *DataLength,
+  OUT UINT32                        *UsbStatus
+  )
+{
+  USB_INTERFACE  *UsbIf;
+
+  UsbIf = USB_INTERFACE_FROM_STREAM_IO (This);
+  return UsbIf->Device->Bus->StreamHc->PollTransfer (
+                                         UsbIf->Device->Bus->StreamHc,
+                                         Transfer,
+                                         DataLength,
+                                         UsbStatus
+                                         );
+}
+
+/**
+  Cancel a transfer started on the interface.
+
+  @param  This                   The stream I/O instance.
+  @param  Transfer               The handle of the transfer.
+
+  @retval EFI_SUCCESS            The transfer is canceled.
+  @retval Others                 The host controller failed to stop it.
+
+**/
+EFI_STATUS
+EFIAPI
+UsbStreamIoCancelTransfer (
+  IN EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN VOID                          *Transfer
+  )
+{
+  USB_INTERFACE  *UsbIf;
+
+  UsbIf = USB_INTERFACE_FROM_STREAM_IO (This);
+  return UsbIf->Device->Bus->StreamHc->CancelTransfer (UsbIf->Device->Bus->StreamHc, Transfer);
+}
+
 /**
   Install Usb Bus Protocol on host controller, and start the Usb bus.
 
@@ -993,6 +1240,21 @@ UsbBusBuildProtocol (
     if (UsbBus->Usb2Hc->MajorRevision == 0x3) {
       UsbBus->MaxDevices = 256;
     }
+
+    //
+    // The bulk streams are optional, only some XHCI controllers have them.
+    //
+    Status = gBS->OpenProtocol (
+                    Controller,
+                    &gEdkiiUsbHcStreamProtocolGuid,
+                    (VOID **)&(UsbBus->StreamHc),
+                    This->DriverBindingHandle,
+                    Controller,
+                    EFI_OPEN_PROTOCOL_GET_PROTOCOL
+                    );
+    if (EFI_ERROR (Status)) {
+      UsbBus->StreamHc = NULL;
+    }
   }
 
   //
@@ -15,6 +15,8 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <Protocol/Usb2HostController.h>
 #include <Protocol/UsbHostController.h>
 #include <Protocol/UsbIo.h>
+#include <Protocol/UsbHcStream.h>
+#include <Protocol/UsbStreamIo.h>
 #include <Protocol/DevicePath.h>
 
 #include <Library/BaseLib.h>
@@ -141,6 +143,9 @@ typedef struct _USB_HUB_API    USB_HUB_API;
 #define USB_INTERFACE_FROM_USBIO(a) \
           CR(a, USB_INTERFACE, UsbIo, USB_INTERFACE_SIGNATURE)
 
+#define USB_INTERFACE_FROM_STREAM_IO(a) \
+          CR(a, USB_INTERFACE, StreamIo, USB_INTERFACE_SIGNATURE)
+
 #define USB_BUS_FROM_THIS(a) \
           CR(a, USB_BUS, BusId, USB_BUS_SIGNATURE)
 
@@ -195,67 +200,73 @@ struct _USB_DEVICE {
 // Stands for different functions of USB device
 //
 struct _USB_INTERFACE {
-  UINTN                       Signature;
-  USB_DEVICE                  *Device;
-  USB_INTERFACE_DESC          *IfDesc;
-  USB_INTERFACE_SETTING       *IfSetting;
+  UINTN                           Signature;
+  USB_DEVICE                      *Device;
+  USB_INTERFACE_DESC              *IfDesc;
+  USB_INTERFACE_SETTING           *IfSetting;
 
   //
   // Handles and protocols
   //
-  EFI_HANDLE                  Handle;
-  EFI_USB_IO_PROTOCOL         UsbIo;
-  EFI_DEVICE_PATH_PROTOCOL    *DevicePath;
-  BOOLEAN                     IsManaged;
+  EFI_HANDLE                      Handle;
+  EFI_USB_IO_PROTOCOL             UsbIo;
+  EDKII_USB_STREAM_IO_PROTOCOL    StreamIo;
+  EFI_DEVICE_PATH_PROTOCOL        *DevicePath;
+  BOOLEAN                         IsManaged;
 
   //
   // Hub device special data
   //
-  BOOLEAN                     IsHub;
-  USB_HUB_API                 *HubApi;
-  UINT8                       NumOfPort;
-  EFI_EVENT                   HubNotify;
+  BOOLEAN                         IsHub;
+  USB_HUB_API                     *HubApi;
+  UINT8                           NumOfPort;
+  EFI_EVENT                       HubNotify;
 
   //
   // Data used only by normal hub devices
   //
-  USB_ENDPOINT_DESC           *HubEp;
-  UINT8                       *ChangeMap;
+  USB_ENDPOINT_DESC               *HubEp;
+  UINT8                           *ChangeMap;
 
   //
   // Data used only by root hub to hand over device to
   // companion UHCI driver if low/full speed devices are
   // connected to EHCI.
   //
-  UINT8                       MaxSpeed;
+  UINT8                           MaxSpeed;
 };
 
 //
 // Stands for the current USB Bus
 //
 struct _USB_BUS {
-  UINTN                       Signature;
-  EFI_USB_BUS_PROTOCOL        BusId;
+  UINTN                           Signature;
+  EFI_USB_BUS_PROTOCOL            BusId;
 
   //
   // Managed USB host controller
   //
-  EFI_HANDLE                  HostHandle;
-  EFI_DEVICE_PATH_PROTOCOL    *DevicePath;
-  EFI_USB2_HC_PROTOCOL        *Usb2Hc;
-  EFI_USB_HC_PROTOCOL         *UsbHc;
+  EFI_HANDLE                      HostHandle;
+  EFI_DEVICE_PATH_PROTOCOL        *DevicePath;
+  EFI_USB2_HC_PROTOCOL            *Usb2Hc;
+  EFI_USB_HC_PROTOCOL             *UsbHc;
+
+  //
+  // Bulk streams of the host controller, or NULL
+  //
+  EDKII_USB_HC_STREAM_PROTOCOL    *StreamHc;
 
   //
   // Recorded the max supported usb devices.
   // XHCI can support up to 255 devices.
   // EHCI/UHCI/OHCI supports up to 127 devices.
   //
-  UINT32                      MaxDevices;
+  UINT32                          MaxDevices;
   //
   // An array of device that is on the bus. Devices[0] is
   // for root hub. Device with address i is at Devices[i].
   //
-  USB_DEVICE                  *Devices[256];
+  USB_DEVICE                      *Devices[256];
 
   //
   // USB Bus driver need to control the recursive connect policy of the bus, only those wanted
@@ -265,7 +276,7 @@ struct _USB_BUS {
   // every wanted child device is stored in a item of the WantedUsbIoDPList, whose structure is
   // DEVICE_PATH_LIST_ITEM
   //
-  LIST_ENTRY    WantedUsbIoDPList;
+  LIST_ENTRY                      WantedUsbIoDPList;
 };
 
 //
@@ -652,6 +663,115 @@ UsbIoPortReset (
   IN EFI_USB_IO_PROTOCOL  *This
   );
 
+/**
+  Give streams to a bulk endpoint of the interface.
+
+  @param  This                   The stream I/O instance.
+  @param  Endpoint               The bulk endpoint, with the direction.
+  @param  StreamCount            On input, the number of streams wanted. On
+                                 output, the number of streams allocated.
+
+  @retval EFI_SUCCESS            The streams are allocated.
+  @retval EFI_INVALID_PARAMETER  The endpoint is not a bulk endpoint of the
+                                 interface.
+  @retval EFI_UNSUPPORTED        The device is not a SuperSpeed device.
+  @retval Others                 The host controller failed to allocate them.
+
+**/
+EFI_STATUS
+EFIAPI
+UsbStreamIoAllocateStreams (
+  IN     EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN     UINT8                         Endpoint,
+  IN OUT UINT16                        *StreamCount
+  );
+
+/**
+  Take the streams back from a bulk endpoint of the interface.
+
+  @param  This                   The stream I/O instance.
+  @param  Endpoint               The bulk endpoint, with the direction.
+
+  @retval EFI_SUCCESS            The streams are freed.
+  @retval EFI_INVALID_PARAMETER  The endpoint is not a bulk endpoint of the
+                                 interface.
+  @retval Others                 The host controller failed to free them.
+
+**/
+EFI_STATUS
+EFIAPI
+UsbStreamIoFreeStreams (
+  IN EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN UINT8                         Endpoint
+  );
+
+/**
+  Start a bulk transfer on a stream of an endpoint of the interface.
+
+  @param  This                   The stream I/O instance.
+  @param  Endpoint               The bulk endpoint, with the direction.
+  @param  StreamId               The stream, or 0 on an endpoint without
+                                 streams.
+  @param  Data                   The data to transfer.
+  @param  DataLength             The length of the data to transfer.
+  @param  Transfer               The handle of the started transfer.
+
+  @retval EFI_SUCCESS            The transfer is started.
+  @retval EFI_INVALID_PARAMETER  The endpoint is not a bulk endpoint of the
+                                 interface.
+  @retval Others                 The host controller failed to start it.
+
+**/
+EFI_STATUS
+EFIAPI
+UsbStreamIoSubmitTransfer (
+  IN  EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN  UINT8                         Endpoint,
+  IN  UINT16                        StreamId,
+  IN  VOID                          *Data,
+  IN  UINTN                         DataLength,
+  OUT VOID                          **Transfer
+  );
+
+/**
+  Check whether a transfer started on the interface is done.
+
+  @param  This                   The stream I/O instance.
+  @param  Transfer               The handle of the transfer.
+  @param  DataLength             The number of bytes transferred.
+  @param  UsbStatus              The result of the transfer.
+
+  @retval EFI_SUCCESS            The transfer is done without error.
+  @retval EFI_NOT_READY          The transfer is still pending.
+  @retval Others                 The transfer is done with an error.
+
+**/
+EFI_STATUS
+EFIAPI
+UsbStreamIoPollTransfer (
+  IN  EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN  VOID                          *Transfer,
+  OUT UINTN                         *DataLength,
+  OUT UINT32                        *UsbStatus
+  );
+
+/**
+  Cancel a transfer started on the interface.
+
+  @param  This                   The stream I/O instance.
+  @param  Transfer               The handle of the transfer.
+
+  @retval EFI_SUCCESS            The transfer is canceled.
+  @retval Others                 The host controller failed to stop it.
+
+**/
+EFI_STATUS
+EFIAPI
+UsbStreamIoCancelTransfer (
+  IN EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN VOID                          *Transfer
+  );
+
 /**
   Install Usb Bus Protocol on host controller, and start the Usb bus.
 
@@ -752,6 +872,7 @@ UsbBusControllerDriverStop (
   );
 
 extern EFI_USB_IO_PROTOCOL           mUsbIoProtocol;
+extern EDKII_USB_STREAM_IO_PROTOCOL  mUsbStreamIoProtocol;
 extern EFI_DRIVER_BINDING_PROTOCOL   mUsbBusDriverBinding;
 extern EFI_COMPONENT_NAME_PROTOCOL   mUsbBusComponentName;
 extern EFI_COMPONENT_NAME2_PROTOCOL  mUsbBusComponentName2;
@@ -67,6 +67,14 @@ UsbFreeInterface (
                   NULL
                   );
   if (!EFI_ERROR (Status)) {
+    if (UsbIf->Device->Bus->StreamHc != NULL) {
+      gBS->UninstallProtocolInterface (
+             UsbIf->Handle,
+             &gEdkiiUsbStreamIoProtocolGuid,
+             &UsbIf->StreamIo
+             );
+    }
+
     if (UsbIf->DevicePath != NULL) {
       FreePool (UsbIf->DevicePath);
     }
@@ -118,6 +126,12 @@ UsbCreateInterface (
     sizeof (EFI_USB_IO_PROTOCOL)
     );
 
+  CopyMem (
+    &(UsbIf->StreamIo),
+    &mUsbStreamIoProtocol,
+    sizeof (EDKII_USB_STREAM_IO_PROTOCOL)
+    );
+
   //
   // Install protocols for USBIO and device path
   //
@@ -173,6 +187,22 @@ UsbCreateInterface (
     goto ON_ERROR;
   }
 
+  //
+  // The stream I/O goes along with the USB I/O when the host controller has
+  // bulk streams. The interface works without it.
+  //
+  if (Device->Bus->StreamHc != NULL) {
+    Status = gBS->InstallProtocolInterface (
+                    &UsbIf->Handle,
+                    &gEdkiiUsbStreamIoProtocolGuid,
+                    EFI_NATIVE_INTERFACE,
+                    &UsbIf->StreamIo
+                    );
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "UsbCreateInterface: failed to install stream I/O - %r\n", Status));
+    }
+  }
+
   return UsbIf;
 
 ON_ERROR:
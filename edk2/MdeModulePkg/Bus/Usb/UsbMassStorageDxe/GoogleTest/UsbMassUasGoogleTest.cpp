@@ -0,0 +1,283 @@
+/** @file
+  Host test of the USB Attached SCSI transport of UsbMassStorageDxe.
+
+  The transport runs against the software UAS device of UsbMassUasModel.c.
+  The device is checked to be taken over UAS only when it and the host
+  controller have streams, and to be put back on its BOT setting when the
+  transport stops. Reads and writes go through the queued path of the boot
+  commands and are compared with the media. A failed command and a hung one
+  are checked to end on their own and leave no transfer behind. The
+  benchmark reports the throughput of a single 64 KB command at a time, as
+  BOT moves it, and of queued commands of 64 KB and 1 MB, on the clock of
+  the model.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+#include <Library/GoogleTestLib.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+  #include <Uefi.h>
+  #include "UsbMassUasModel.h"
+}
+
+using namespace testing;
+
+#define MEDIA_BLOCK_SIZE  512
+#define MEDIA_BLOCKS      (64 * 1024)
+
+class UsbMassUasTest : public Test {
+protected:
+  VOID                  *Device;
+  std::vector<UINT8>    Buffer;
+
+  VOID
+  SetUp (
+    ) override
+  {
+    Device = NULL;
+    UasModelDefaultConfig ();
+  }
+
+  VOID
+  TearDown (
+    ) override
+  {
+    Stop ();
+    UasModelFree ();
+  }
+
+  VOID
+  Start (
+    UINT32  MaxCarrySize
+    )
+  {
+    UasModelCreate (MEDIA_BLOCK_SIZE, MEDIA_BLOCKS);
+    ASSERT_EQ (UasModelStartDriver (MaxCarrySize, &Device), EFI_SUCCESS);
+    ASSERT_EQ (UasModelAlternateSetting (), 1);
+  }
+
+  VOID
+  Stop (
+    )
+  {
+    if (Device != NULL) {
+      UasModelStopDriver (Device);
+      Device = NULL;
+      EXPECT_EQ (UasModelAlternateSetting (), 0);
+      EXPECT_EQ (UasModelStreamEndpoints (), 0U);
+      EXPECT_EQ (UasModelPendingTransfers (), 0U);
+    }
+  }
+
+  VOID
+  CheckRead (
+    UINT64  Lba,
+    UINTN   Blocks
+    )
+  {
+    Buffer.assign (Blocks * MEDIA_BLOCK_SIZE, 0);
+    ASSERT_EQ (UasModelTransfer (Device, FALSE, &Buffer[0], Lba, Blocks), EFI_SUCCESS);
+    ASSERT_EQ (memcmp (&Buffer[0], UasModelMedia () + Lba * MEDIA_BLOCK_SIZE, Blocks * MEDIA_BLOCK_SIZE), 0);
+    ASSERT_EQ (UasModelPendingTransfers (), 0U);
+  }
+
+  VOID
+  CheckWrite (
+    UINT64  Lba,
+    UINTN   Blocks
+    )
+  {
+    UINTN  Index;
+
+    Buffer.resize (Blocks * MEDIA_BLOCK_SIZE);
+    for (Index = 0; Index < Buffer.size (); Index++) {
+      Buffer[Index] = (UINT8)(Index * 13 + Lba);
+    }
+
+    ASSERT_EQ (UasModelTransfer (Device, TRUE, &Buffer[0], Lba, Blocks), EFI_SUCCESS);
+    ASSERT_EQ (memcmp (&Buffer[0], UasModelMedia () + Lba * MEDIA_BLOCK_SIZE, Blocks * MEDIA_BLOCK_SIZE), 0);
+    ASSERT_EQ (UasModelPendingTransfers (), 0U);
+  }
+
+  //
+  // The throughput of sequential reads of the given size, in MB/s of the
+  // clock of the model.
+  //
+  UINT64
+  ReadThroughput (
+    UINTN  Blocks
+    )
+  {
+    UINT64  Lba;
+    UINT64  Start;
+
+    Buffer.resize (Blocks * MEDIA_BLOCK_SIZE);
+    Start = UasModelNow ();
+    for (Lba = 0; Lba + Blocks <= MEDIA_BLOCKS; Lba += Blocks) {
+      EXPECT_EQ (UasModelTransfer (Device, FALSE, &Buffer[0], Lba, Blocks), EFI_SUCCESS);
+    }
+
+    return (UINT64)MEDIA_BLOCKS * MEDIA_BLOCK_SIZE * 1000 / (UasModelNow () - Start);
+  }
+};
+
+TEST_F (UsbMassUasTest, Probe) {
+  UasModelCreate (MEDIA_BLOCK_SIZE, MEDIA_BLOCKS);
+  EXPECT_EQ (UasModelProbe (), EFI_SUCCESS);
+  EXPECT_EQ (mUasModelStatistics.SetInterfaces, 0U);
+
+  //
+  // A device without a UAS setting, a high speed UAS device and a host
+  // controller without streams all stay on BOT
+  //
+  mUasModelConfig.UasSetting = FALSE;
+  UasModelCreate (MEDIA_BLOCK_SIZE, MEDIA_BLOCKS);
+  EXPECT_EQ (UasModelProbe (), EFI_UNSUPPORTED);
+  EXPECT_EQ (UasModelStartDriver (SIZE_1MB, &Device), EFI_UNSUPPORTED);
+
+  mUasModelConfig.UasSetting    = TRUE;
+  mUasModelConfig.DeviceStreams = 0;
+  UasModelCreate (MEDIA_BLOCK_SIZE, MEDIA_BLOCKS);
+  EXPECT_EQ (UasModelProbe (), EFI_UNSUPPORTED);
+  EXPECT_EQ (UasModelStartDriver (SIZE_1MB, &Device), EFI_UNSUPPORTED);
+
+  mUasModelConfig.DeviceStreams = 5;
+  mUasModelConfig.HcStreams     = 0;
+  UasModelCreate (MEDIA_BLOCK_SIZE, MEDIA_BLOCKS);
+  EXPECT_EQ (UasModelStartDriver (SIZE_1MB, &Device), EFI_UNSUPPORTED);
+  EXPECT_EQ (UasModelAlternateSetting (), 0);
+  EXPECT_EQ (mUasModelStatistics.SetInterfaces, 0U);
+  Device = NULL;
+}
+
+TEST_F (UsbMassUasTest, QueueDepth) {
+  Start (SIZE_1MB);
+  EXPECT_EQ (UasModelQueueDepth (Device), 32);
+  EXPECT_EQ (UasModelStreamEndpoints (), 3U);
+  Stop ();
+
+  //
+  // The fewest streams of the device and the host controller set the depth
+  //
+  mUasModelConfig.DeviceStreams = 3;
+  Start (SIZE_1MB);
+  EXPECT_EQ (UasModelQueueDepth (Device), 8);
+  Stop ();
+
+  mUasModelConfig.DeviceStreams = 5;
+  mUasModelConfig.HcStreams     = 4;
+  Start (SIZE_64KB);
+  EXPECT_EQ (UasModelQueueDepth (Device), 4);
+  CheckRead (0, 4096);
+  EXPECT_EQ (mUasModelStatistics.MaxInFlight, 4U);
+}
+
+TEST_F (UsbMassUasTest, ReadWrite) {
+  Start (SIZE_1MB);
+  CheckRead (0, 1);
+  CheckRead (7, 4096);
+  CheckRead (MEDIA_BLOCKS - 9000, 9000);
+  CheckWrite (3, 1000);
+  CheckWrite (5000, 5000);
+  CheckRead (0, 12000);
+  EXPECT_EQ (mUasModelStatistics.Failures, 0U);
+  EXPECT_EQ (mUasModelStatistics.TaskManagements, 0U);
+
+  //
+  // The status and the data transfers are on their streams before the
+  // command reaches the device
+  //
+  EXPECT_EQ (mUasModelStatistics.NotPrimed, 0U);
+  Stop ();
+
+  //
+  // Commands of 64 KB keep many of them in flight
+  //
+  Start (SIZE_64KB);
+  CheckRead (0, 8192);
+  CheckWrite (100, 3000);
+  EXPECT_GE (mUasModelStatistics.Commands, 8192U / 128);
+  EXPECT_GT (mUasModelStatistics.MaxInFlight, 16U);
+}
+
+TEST_F (UsbMassUasTest, CommandError) {
+  mUasModelConfig.FailLba  = 2000;
+  mUasModelConfig.FailOnce = TRUE;
+  Start (SIZE_64KB);
+
+  //
+  // The failed command gets its sense from the Sense IU, and goes again on
+  // its own
+  //
+  CheckRead (0, 4096);
+  EXPECT_EQ (mUasModelStatistics.Failures, 1U);
+  EXPECT_EQ (mUasModelStatistics.TaskManagements, 0U);
+
+  mUasModelConfig.FailLba  = 2000;
+  mUasModelConfig.FailOnce = FALSE;
+  Buffer.resize (4096 * MEDIA_BLOCK_SIZE);
+  EXPECT_EQ (UasModelTransfer (Device, FALSE, &Buffer[0], 0, 4096), EFI_DEVICE_ERROR);
+  EXPECT_EQ (UasModelPendingTransfers (), 0U);
+
+  mUasModelConfig.FailLba = MAX_UINT64;
+  CheckRead (0, 4096);
+}
+
+TEST_F (UsbMassUasTest, CommandHang) {
+  Start (SIZE_64KB);
+  mUasModelConfig.HangCommands = 1;
+
+  //
+  // The hung command times out, the logical unit reset drops it in the
+  // device, and it goes again on its own
+  //
+  CheckRead (0, 4096);
+  EXPECT_EQ (mUasModelStatistics.TaskManagements, 1U);
+  CheckWrite (10, 4096);
+}
+
+TEST_F (UsbMassUasTest, ThroughputBenchmark) {
+  UINT64  Single;
+  UINT64  Queued;
+  UINT64  Large;
+
+  //
+  // One tag and 64 KB commands move data the way BOT does
+  //
+  mUasModelConfig.HcStreams = 1;
+  Start (SIZE_64KB);
+  Single = ReadThroughput (2048);
+  Stop ();
+
+  mUasModelConfig.HcStreams = 1024;
+  Start (SIZE_64KB);
+  Queued = ReadThroughput (2048);
+  Stop ();
+
+  Start (SIZE_1MB);
+  Large = ReadThroughput (2048);
+  Stop ();
+
+  printf (
+    "  1 MB reads: %4llu MB/s single 64 KB command, %4llu MB/s queued 64 KB commands, %4llu MB/s queued 1 MB commands\n",
+    (unsigned long long)Single,
+    (unsigned long long)Queued,
+    (unsigned long long)Large
+    );
+  EXPECT_GT (Queued, Single * 3 / 2);
+  EXPECT_GT (Large, Single * 3 / 2);
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
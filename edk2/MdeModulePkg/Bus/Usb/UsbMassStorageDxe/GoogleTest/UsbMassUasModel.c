@@ -0,0 +1,1142 @@
+/** @file
+  A software UAS device behind a USB I/O and a USB stream I/O protocol, for
+  the host test of the UAS transport of UsbMassStorageDxe.
+
+  The device has a BOT setting and, if configured, a UAS setting with a
+  command, a status, a data-in and a data-out pipe, where the last three
+  have streams. It takes a Command IU on the command pipe at once, works on
+  the command on one of the parallel units of the media for the media
+  latency, then moves its data on the stream of its tag once the host has a
+  transfer there, one command at a time at the link bandwidth, and last
+  returns a Sense IU on the stream of its tag of the status pipe. The clock
+  advances by the time the host takes to start a transfer, and by the
+  stalls of the driver, for which the model takes over the event, timer and
+  stall services of UnitTestUefiBootServicesTableLib. The model also owns the
+  handle of the device and takes over LocateHandleBuffer () and
+  HandleProtocol () to find its protocols: installing a protocol in the
+  database of that library logs through UnitTestLib, which needs a running
+  framework a GoogleTest main does not have.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "../UsbMass.h"
+#include "UsbMassUasModel.h"
+
+#define MODEL_MAX_TRANSFERS  256
+#define MODEL_MAX_TAGS       64
+#define MODEL_MAX_UNITS      64
+#define MODEL_MAX_EVENTS     16
+#define MODEL_CONFIG_SIZE    256
+
+#define MODEL_PIPE_COMMAND   0x01
+#define MODEL_PIPE_STATUS    0x82
+#define MODEL_PIPE_DATA_IN   0x83
+#define MODEL_PIPE_DATA_OUT  0x04
+#define MODEL_PIPE_BOT_IN    0x81
+#define MODEL_PIPE_BOT_OUT   0x02
+
+//
+// The SCSI status and the response codes the device returns
+//
+#define MODEL_STATUS_GOOD             0x00
+#define MODEL_STATUS_CHECK_CONDITION  0x02
+#define MODEL_RC_TMF_COMPLETE         0x00
+#define MODEL_RC_OVERLAPPED_TAG       0x0A
+
+typedef enum {
+  ModelCommandFree,
+  ModelCommandMedia,
+  ModelCommandData,
+  ModelCommandStatus
+} MODEL_COMMAND_STATE;
+
+typedef struct {
+  BOOLEAN    Used;
+  UINT8      Pipe;
+  UINT16     Stream;
+  UINT8      *Data;
+  UINTN      Length;
+  BOOLEAN    Done;
+  UINT64     Time;
+  UINTN      Actual;
+} MODEL_TRANSFER;
+
+typedef struct {
+  MODEL_COMMAND_STATE    State;
+  UINT64                 Time;
+  BOOLEAN                Write;
+  BOOLEAN                Hung;
+  BOOLEAN                NotPrimed;
+  UINT64                 Lba;
+  UINT32                 Blocks;
+  UINT8                  IuId;          // Of the IU that ends the command
+  UINT8                  ResponseCode;
+  UINT8                  Status;
+  UINT8                  SenseKey;
+  UINT8                  Asc;
+} MODEL_COMMAND;
+
+typedef struct {
+  BOOLEAN    Used;
+  BOOLEAN    Armed;
+  UINT64     Deadline;
+} MODEL_EVENT;
+
+UAS_MODEL_CONFIG      mUasModelConfig;
+UAS_MODEL_STATISTICS  mUasModelStatistics;
+
+STATIC EFI_USB_IO_PROTOCOL           mModelUsbIo;
+STATIC EDKII_USB_STREAM_IO_PROTOCOL  mModelStreamIo;
+STATIC EFI_BOOT_SERVICES             mModelBootServices;
+STATIC MODEL_EVENT                   mModelEvents[MODEL_MAX_EVENTS];
+STATIC UINT8                         mModelHandle;
+STATIC BOOLEAN                       mModelHasStreamIo;
+
+STATIC UINT8           mModelConfig[MODEL_CONFIG_SIZE];
+STATIC UINT16          mModelConfigLength;
+STATIC UINT8           mModelSetting;
+STATIC UINT16          mModelStreams[32];
+STATIC MODEL_TRANSFER  mModelTransfers[MODEL_MAX_TRANSFERS];
+STATIC MODEL_COMMAND   mModelCommands[MODEL_MAX_TAGS + 1];
+STATIC UINT32          mModelInFlight;
+STATIC UINT8           *mModelMedia;
+STATIC UINT32          mModelBlockSize;
+STATIC UINTN           mModelBlocks;
+STATIC UINT64          mModelNow;
+STATIC UINT64          mModelUnitFree[MODEL_MAX_UNITS];
+STATIC UINT64          mModelLinkFree;
+
+/**
+  Return the index of an endpoint in mModelStreams.
+
+**/
+STATIC
+UINTN
+ModelEndpointIndex (
+  IN UINT8  Pipe
+  )
+{
+  return (Pipe & 0x0F) | (((Pipe & BIT7) != 0) ? 16 : 0);
+}
+
+/**
+  Check whether an endpoint belongs to the current setting of the interface.
+
+**/
+STATIC
+BOOLEAN
+ModelIsEndpoint (
+  IN UINT8  Pipe
+  )
+{
+  if (mModelSetting == 0) {
+    return (BOOLEAN)((Pipe == MODEL_PIPE_BOT_IN) || (Pipe == MODEL_PIPE_BOT_OUT));
+  }
+
+  return (BOOLEAN)((Pipe == MODEL_PIPE_COMMAND) || (Pipe == MODEL_PIPE_STATUS) ||
+                   (Pipe == MODEL_PIPE_DATA_IN) || (Pipe == MODEL_PIPE_DATA_OUT));
+}
+
+/**
+  Append a descriptor to the configuration descriptor.
+
+**/
+STATIC
+VOID
+ModelAppend (
+  IN CONST UINT8  *Desc
+  )
+{
+  ASSERT (mModelConfigLength + Desc[0] <= MODEL_CONFIG_SIZE);
+  CopyMem (&mModelConfig[mModelConfigLength], Desc, Desc[0]);
+  mModelConfigLength = (UINT16)(mModelConfigLength + Desc[0]);
+}
+
+/**
+  Append a bulk endpoint, its SuperSpeed companion on a SuperSpeed device,
+  and its pipe usage descriptor if PipeId is not 0.
+
+**/
+STATIC
+VOID
+ModelAppendEndpoint (
+  IN UINT8  Pipe,
+  IN UINT8  Streams,
+  IN UINT8  PipeId
+  )
+{
+  BOOLEAN  SuperSpeed;
+  UINT8    Endpoint[7];
+  UINT8    Companion[6];
+  UINT8    PipeUsage[4];
+
+  SuperSpeed = (BOOLEAN)(mUasModelConfig.DeviceStreams != 0);
+
+  Endpoint[0] = sizeof (Endpoint);
+  Endpoint[1] = USB_DESC_TYPE_ENDPOINT;
+  Endpoint[2] = Pipe;
+  Endpoint[3] = USB_ENDPOINT_BULK;
+  Endpoint[4] = 0;
+  Endpoint[5] = SuperSpeed ? 4 : 2;
+  Endpoint[6] = 0;
+  ModelAppend (Endpoint);
+
+  if (SuperSpeed) {
+    ZeroMem (Companion, sizeof (Companion));
+    Companion[0] = sizeof (Companion);
+    Companion[1] = USB_UAS_DESC_TYPE_SS_COMPANION;
+    Companion[2] = 15;
+    Companion[3] = Streams;
+    ModelAppend (Companion);
+  }
+
+  if (PipeId != 0) {
+    PipeUsage[0] = sizeof (PipeUsage);
+    PipeUsage[1] = USB_UAS_DESC_TYPE_PIPE_USAGE;
+    PipeUsage[2] = PipeId;
+    PipeUsage[3] = 0;
+    ModelAppend (PipeUsage);
+  }
+}
+
+/**
+  Build the configuration descriptor: a BOT setting, then the UAS setting.
+
+**/
+STATIC
+VOID
+ModelBuildConfig (
+  VOID
+  )
+{
+  EFI_USB_CONFIG_DESCRIPTOR     *Config;
+  EFI_USB_INTERFACE_DESCRIPTOR  Interface;
+
+  mModelConfigLength = 0;
+  Config             = (EFI_USB_CONFIG_DESCRIPTOR *)mModelConfig;
+  ZeroMem (Config, sizeof (EFI_USB_CONFIG_DESCRIPTOR));
+  Config->Length             = sizeof (EFI_USB_CONFIG_DESCRIPTOR);
+  Config->DescriptorType     = USB_DESC_TYPE_CONFIG;
+  Config->NumInterfaces      = 1;
+  Config->ConfigurationValue = 1;
+  Config->Attributes         = BIT7;
+  mModelConfigLength         = sizeof (EFI_USB_CONFIG_DESCRIPTOR);
+
+  ZeroMem (&Interface, sizeof (Interface));
+  Interface.Length            = sizeof (Interface);
+  Interface.DescriptorType    = USB_DESC_TYPE_INTERFACE;
+  Interface.NumEndpoints      = 2;
+  Interface.InterfaceClass    = USB_MASS_STORE_CLASS;
+  Interface.InterfaceSubClass = USB_MASS_STORE_SCSI;
+  Interface.InterfaceProtocol = USB_MASS_STORE_BOT;
+  ModelAppend ((UINT8 *)&Interface);
+  ModelAppendEndpoint (MODEL_PIPE_BOT_IN, 0, 0);
+  ModelAppendEndpoint (MODEL_PIPE_BOT_OUT, 0, 0);
+
+  if (mUasModelConfig.UasSetting) {
+    Interface.AlternateSetting  = 1;
+    Interface.NumEndpoints      = 4;
+    Interface.InterfaceProtocol = USB_MASS_STORE_UAS;
+    ModelAppend ((UINT8 *)&Interface);
+    ModelAppendEndpoint (MODEL_PIPE_COMMAND, 0, USB_UAS_PIPE_ID_COMMAND);
+    ModelAppendEndpoint (MODEL_PIPE_STATUS, mUasModelConfig.DeviceStreams, USB_UAS_PIPE_ID_STATUS);
+    ModelAppendEndpoint (MODEL_PIPE_DATA_IN, mUasModelConfig.DeviceStreams, USB_UAS_PIPE_ID_DATA_IN);
+    ModelAppendEndpoint (MODEL_PIPE_DATA_OUT, mUasModelConfig.DeviceStreams, USB_UAS_PIPE_ID_DATA_OUT);
+  }
+
+  Config->TotalLength = mModelConfigLength;
+}
+
+/**
+  Find the transfer the host has on a stream of a pipe and the device has not
+  ended yet.
+
+**/
+STATIC
+MODEL_TRANSFER *
+ModelFindTransfer (
+  IN UINT8   Pipe,
+  IN UINT16  Stream
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < MODEL_MAX_TRANSFERS; Index++) {
+    if (mModelTransfers[Index].Used && !mModelTransfers[Index].Done &&
+        (mModelTransfers[Index].Pipe == Pipe) && (mModelTransfers[Index].Stream == Stream))
+    {
+      return &mModelTransfers[Index];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  End a command, or a task management function, with the IU on its stream of
+  the status pipe.
+
+**/
+STATIC
+VOID
+ModelSendStatus (
+  IN UINT16          Tag,
+  IN MODEL_TRANSFER  *Transfer
+  )
+{
+  MODEL_COMMAND      *Command;
+  USB_UAS_STATUS_IU  StatusIu;
+  UINTN              Length;
+
+  Command = &mModelCommands[Tag];
+  ZeroMem (&StatusIu, sizeof (StatusIu));
+  StatusIu.IuId = Command->IuId;
+  StatusIu.Tag  = SwapBytes16 (Tag);
+  if (Command->IuId == USB_UAS_IU_RESPONSE) {
+    StatusIu.U.Response.ResponseCode = Command->ResponseCode;
+    Length                           = 8;
+  } else {
+    StatusIu.U.Sense.Status = Command->Status;
+    Length                  = 16;
+    if (Command->Status != MODEL_STATUS_GOOD) {
+      StatusIu.U.Sense.SenseLength  = SwapBytes16 (18);
+      StatusIu.U.Sense.SenseData[0] = 0x70;
+      StatusIu.U.Sense.SenseData[2] = Command->SenseKey;
+      StatusIu.U.Sense.SenseData[7] = 10;
+      StatusIu.U.Sense.SenseData[12] = Command->Asc;
+      Length                        += 18;
+    }
+  }
+
+  Length = MIN (Length, Transfer->Length);
+  CopyMem (Transfer->Data, &StatusIu, Length);
+  Transfer->Done   = TRUE;
+  Transfer->Time   = mModelNow;
+  Transfer->Actual = Length;
+
+  if (Command->IuId == USB_UAS_IU_SENSE) {
+    mModelInFlight--;
+  }
+
+  Command->State = ModelCommandFree;
+}
+
+/**
+  Move the commands on, as far as the clock and the transfers of the host
+  let them.
+
+**/
+STATIC
+VOID
+ModelAdvance (
+  VOID
+  )
+{
+  MODEL_COMMAND   *Command;
+  MODEL_TRANSFER  *Transfer;
+  UINT16          Tag;
+  UINTN           Length;
+  UINT8           *Media;
+  BOOLEAN         Moved;
+
+  do {
+    Moved = FALSE;
+    for (Tag = 1; Tag <= MODEL_MAX_TAGS; Tag++) {
+      Command = &mModelCommands[Tag];
+      if ((Command->State == ModelCommandFree) || Command->Hung || (Command->Time > mModelNow)) {
+        continue;
+      }
+
+      if (Command->State == ModelCommandMedia) {
+        Command->State = ModelCommandData;
+      }
+
+      if (Command->State == ModelCommandData) {
+        Transfer = ModelFindTransfer (Command->Write ? MODEL_PIPE_DATA_OUT : MODEL_PIPE_DATA_IN, Tag);
+        if (Transfer == NULL) {
+          if (!Command->NotPrimed) {
+            Command->NotPrimed = TRUE;
+            mUasModelStatistics.NotPrimed++;
+          }
+
+          continue;
+        }
+
+        Length = MIN (Transfer->Length, (UINTN)Command->Blocks * mModelBlockSize);
+        Media  = mModelMedia + Command->Lba * mModelBlockSize;
+        if (Command->Write) {
+          CopyMem (Media, Transfer->Data, Length);
+        } else {
+          CopyMem (Transfer->Data, Media, Length);
+        }
+
+        mModelLinkFree = MAX (mModelLinkFree, mModelNow) +
+                         DivU64x64Remainder (MultU64x64 (Length, 1000000000ULL), mUasModelConfig.LinkBandwidth, NULL);
+        Transfer->Done     = TRUE;
+        Transfer->Time     = mModelLinkFree;
+        Transfer->Actual   = Length;
+        Command->State     = ModelCommandStatus;
+        Command->Time      = mModelLinkFree;
+        Command->NotPrimed = FALSE;
+        Moved              = TRUE;
+        continue;
+      }
+
+      Transfer = ModelFindTransfer (MODEL_PIPE_STATUS, Tag);
+      if (Transfer == NULL) {
+        if (!Command->NotPrimed) {
+          Command->NotPrimed = TRUE;
+          mUasModelStatistics.NotPrimed++;
+        }
+
+        continue;
+      }
+
+      ModelSendStatus (Tag, Transfer);
+      Moved = TRUE;
+    }
+  } while (Moved);
+}
+
+/**
+  Take a Command IU.
+
+**/
+STATIC
+VOID
+ModelCommandIu (
+  IN USB_UAS_COMMAND_IU  *Iu
+  )
+{
+  MODEL_COMMAND  *Command;
+  UINT16         Tag;
+  UINT8          *Cdb;
+  UINTN          Unit;
+  UINTN          Index;
+
+  Tag = SwapBytes16 (Iu->Tag);
+  ASSERT ((Tag != 0) && (Tag <= MODEL_MAX_TAGS));
+  Command = &mModelCommands[Tag];
+  if (Command->State != ModelCommandFree) {
+    //
+    // The tag of a command in flight: the device drops both commands.
+    //
+    Command->IuId         = USB_UAS_IU_RESPONSE;
+    Command->ResponseCode = MODEL_RC_OVERLAPPED_TAG;
+    Command->State        = ModelCommandStatus;
+    Command->Hung         = FALSE;
+    mModelInFlight--;
+    mUasModelStatistics.Failures++;
+    return;
+  }
+
+  ZeroMem (Command, sizeof (MODEL_COMMAND));
+  Command->IuId   = USB_UAS_IU_SENSE;
+  Command->Status = MODEL_STATUS_GOOD;
+  Command->Time   = mModelNow;
+  Command->State  = ModelCommandStatus;
+
+  Cdb = Iu->Cdb;
+  switch (Cdb[0]) {
+    case EFI_SCSI_OP_READ10:
+    case EFI_SCSI_OP_WRITE10:
+      Command->Lba    = SwapBytes32 (ReadUnaligned32 ((UINT32 *)&Cdb[2]));
+      Command->Blocks = SwapBytes16 (ReadUnaligned16 ((UINT16 *)&Cdb[7]));
+      Command->Write  = (BOOLEAN)(Cdb[0] == EFI_SCSI_OP_WRITE10);
+      Command->State  = ModelCommandMedia;
+      break;
+
+    case EFI_SCSI_OP_READ16:
+    case EFI_SCSI_OP_WRITE16:
+      Command->Lba    = SwapBytes64 (ReadUnaligned64 ((UINT64 *)&Cdb[2]));
+      Command->Blocks = SwapBytes32 (ReadUnaligned32 ((UINT32 *)&Cdb[10]));
+      Command->Write  = (BOOLEAN)(Cdb[0] == EFI_SCSI_OP_WRITE16);
+      Command->State  = ModelCommandMedia;
+      break;
+
+    case EFI_SCSI_OP_TEST_UNIT_READY:
+      break;
+
+    default:
+      Command->Status   = MODEL_STATUS_CHECK_CONDITION;
+      Command->SenseKey = USB_BOOT_SENSE_ILLEGAL_REQUEST;
+      Command->Asc      = 0x20;
+      break;
+  }
+
+  if (Command->State == ModelCommandMedia) {
+    if (Command->Lba + Command->Blocks > mModelBlocks) {
+      Command->Status   = MODEL_STATUS_CHECK_CONDITION;
+      Command->SenseKey = USB_BOOT_SENSE_ILLEGAL_REQUEST;
+      Command->Asc      = 0x21;
+    } else if ((mUasModelConfig.FailLba >= Command->Lba) && (mUasModelConfig.FailLba < Command->Lba + Command->Blocks)) {
+      Command->Status   = MODEL_STATUS_CHECK_CONDITION;
+      Command->SenseKey = USB_BOOT_SNESE_MEDIUM_ERROR;
+      Command->Asc      = 0x11;
+      mUasModelStatistics.Failures++;
+      if (mUasModelConfig.FailOnce) {
+        mUasModelConfig.FailLba = MAX_UINT64;
+      }
+    }
+
+    //
+    // The media works on the command on its first free unit, and a failed
+    // command ends there without data.
+    //
+    Unit = 0;
+    for (Index = 1; Index < mUasModelConfig.ParallelUnits; Index++) {
+      if (mModelUnitFree[Index] < mModelUnitFree[Unit]) {
+        Unit = Index;
+      }
+    }
+
+    mModelUnitFree[Unit] = MAX (mModelUnitFree[Unit], mModelNow) + mUasModelConfig.MediaLatency;
+    Command->Time        = mModelUnitFree[Unit];
+    if (Command->Status != MODEL_STATUS_GOOD) {
+      Command->State = ModelCommandStatus;
+    }
+  }
+
+  if (mUasModelConfig.HangCommands > 0) {
+    mUasModelConfig.HangCommands--;
+    Command->Hung = TRUE;
+  }
+
+  mUasModelStatistics.Commands++;
+  mModelInFlight++;
+  mUasModelStatistics.MaxInFlight = MAX (mUasModelStatistics.MaxInFlight, mModelInFlight);
+}
+
+/**
+  Take a Task Management IU. The logical unit reset drops all the commands.
+
+**/
+STATIC
+VOID
+ModelTaskManagementIu (
+  IN USB_UAS_TASK_MANAGE_IU  *Iu
+  )
+{
+  MODEL_COMMAND  *Command;
+  UINT16         Tag;
+
+  ASSERT (Iu->Function == USB_UAS_TMF_LOGICAL_UNIT_RESET);
+  ZeroMem (mModelCommands, sizeof (mModelCommands));
+  mModelInFlight = 0;
+  mUasModelStatistics.TaskManagements++;
+
+  Tag = SwapBytes16 (Iu->Tag);
+  ASSERT ((Tag != 0) && (Tag <= MODEL_MAX_TAGS));
+  Command               = &mModelCommands[Tag];
+  Command->IuId         = USB_UAS_IU_RESPONSE;
+  Command->ResponseCode = MODEL_RC_TMF_COMPLETE;
+  Command->State        = ModelCommandStatus;
+  Command->Time         = mModelNow;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelGetInterfaceDescriptor (
+  IN  EFI_USB_IO_PROTOCOL           *This,
+  OUT EFI_USB_INTERFACE_DESCRIPTOR  *Desc
+  )
+{
+  UINTN                         Offset;
+  EFI_USB_INTERFACE_DESCRIPTOR  *Interface;
+
+  for (Offset = 0; Offset < mModelConfigLength; Offset += mModelConfig[Offset]) {
+    Interface = (EFI_USB_INTERFACE_DESCRIPTOR *)&mModelConfig[Offset];
+    if ((Interface->DescriptorType == USB_DESC_TYPE_INTERFACE) && (Interface->AlternateSetting == mModelSetting)) {
+      CopyMem (Desc, Interface, sizeof (EFI_USB_INTERFACE_DESCRIPTOR));
+      return EFI_SUCCESS;
+    }
+  }
+
+  return EFI_NOT_FOUND;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelGetConfigDescriptor (
+  IN  EFI_USB_IO_PROTOCOL        *This,
+  OUT EFI_USB_CONFIG_DESCRIPTOR  *Desc
+  )
+{
+  CopyMem (Desc, mModelConfig, sizeof (EFI_USB_CONFIG_DESCRIPTOR));
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelControlTransfer (
+  IN     EFI_USB_IO_PROTOCOL     *This,
+  IN     EFI_USB_DEVICE_REQUEST  *Request,
+  IN     EFI_USB_DATA_DIRECTION  Direction,
+  IN     UINT32                  Timeout,
+  IN OUT VOID                    *Data OPTIONAL,
+  IN     UINTN                   DataLength OPTIONAL,
+  OUT    UINT32                  *Status
+  )
+{
+  *Status = EFI_USB_NOERROR;
+
+  if ((Request->RequestType == USB_DEV_GET_DESCRIPTOR_REQ_TYPE) &&
+      (Request->Request == USB_REQ_GET_DESCRIPTOR) &&
+      (Request->Value == (USB_DESC_TYPE_CONFIG << 8)))
+  {
+    CopyMem (Data, mModelConfig, MIN (DataLength, mModelConfigLength));
+    return EFI_SUCCESS;
+  }
+
+  if ((Request->RequestType == USB_DEV_SET_INTERFACE_REQ_TYPE) &&
+      (Request->Request == USB_REQ_SET_INTERFACE))
+  {
+    if ((Request->Value > 1) || ((Request->Value == 1) && !mUasModelConfig.UasSetting)) {
+      *Status = EFI_USB_ERR_STALL;
+      return EFI_DEVICE_ERROR;
+    }
+
+    //
+    // The endpoints of the new setting start without streams.
+    //
+    mModelSetting = (UINT8)Request->Value;
+    ZeroMem (mModelStreams, sizeof (mModelStreams));
+    mUasModelStatistics.SetInterfaces++;
+    return EFI_SUCCESS;
+  }
+
+  if ((Request->Request == USB_REQ_CLEAR_FEATURE) && (Request->Value == USB_FEATURE_ENDPOINT_HALT)) {
+    return EFI_SUCCESS;
+  }
+
+  *Status = EFI_USB_ERR_STALL;
+  return EFI_DEVICE_ERROR;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelAllocateStreams (
+  IN     EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN     UINT8                         EndpointAddress,
+  IN OUT UINT16                        *StreamCount
+  )
+{
+  UINT16  *Streams;
+
+  if (!ModelIsEndpoint (EndpointAddress) || (EndpointAddress == MODEL_PIPE_COMMAND) ||
+      (mUasModelConfig.DeviceStreams == 0) || (*StreamCount == 0))
+  {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Streams = &mModelStreams[ModelEndpointIndex (EndpointAddress)];
+  if (*Streams != 0) {
+    return EFI_ALREADY_STARTED;
+  }
+
+  *Streams     = (UINT16)MIN (MIN (*StreamCount, mUasModelConfig.HcStreams), 1U << mUasModelConfig.DeviceStreams);
+  *StreamCount = *Streams;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelFreeStreams (
+  IN EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN UINT8                         EndpointAddress
+  )
+{
+  UINTN  Index;
+
+  if (!ModelIsEndpoint (EndpointAddress)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (mModelStreams[ModelEndpointIndex (EndpointAddress)] == 0) {
+    return EFI_NOT_FOUND;
+  }
+
+  for (Index = 0; Index < MODEL_MAX_TRANSFERS; Index++) {
+    if (mModelTransfers[Index].Used && (mModelTransfers[Index].Pipe == EndpointAddress)) {
+      return EFI_ACCESS_DENIED;
+    }
+  }
+
+  mModelStreams[ModelEndpointIndex (EndpointAddress)] = 0;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelSubmitTransfer (
+  IN  EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN  UINT8                         EndpointAddress,
+  IN  UINT16                        StreamId,
+  IN  VOID                          *Data,
+  IN  UINTN                         DataLength,
+  OUT VOID                          **Transfer
+  )
+{
+  MODEL_TRANSFER  *Entry;
+  UINT16          Streams;
+  UINTN           Index;
+
+  if (!ModelIsEndpoint (EndpointAddress) || (Data == NULL) || (DataLength == 0)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Streams = mModelStreams[ModelEndpointIndex (EndpointAddress)];
+  if ((StreamId > Streams) || ((StreamId == 0) != (Streams == 0))) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  for (Index = 0; Index < MODEL_MAX_TRANSFERS; Index++) {
+    if (mModelTransfers[Index].Used && (mModelTransfers[Index].Pipe == EndpointAddress) &&
+        (mModelTransfers[Index].Stream == StreamId))
+    {
+      return EFI_ALREADY_STARTED;
+    }
+  }
+
+  Entry = NULL;
+  for (Index = 0; Index < MODEL_MAX_TRANSFERS; Index++) {
+    if (!mModelTransfers[Index].Used) {
+      Entry = &mModelTransfers[Index];
+      break;
+    }
+  }
+
+  if (Entry == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  ZeroMem (Entry, sizeof (MODEL_TRANSFER));
+  Entry->Used   = TRUE;
+  Entry->Pipe   = EndpointAddress;
+  Entry->Stream = StreamId;
+  Entry->Data   = Data;
+  Entry->Length = DataLength;
+  *Transfer     = Entry;
+  mModelNow    += mUasModelConfig.TransferTime;
+
+  //
+  // The device takes an IU on the command pipe at once.
+  //
+  if (EndpointAddress == MODEL_PIPE_COMMAND) {
+    if (Entry->Data[0] == USB_UAS_IU_COMMAND) {
+      ModelCommandIu ((USB_UAS_COMMAND_IU *)Data);
+    } else {
+      ASSERT (Entry->Data[0] == USB_UAS_IU_TASK_MANAGE);
+      ModelTaskManagementIu ((USB_UAS_TASK_MANAGE_IU *)Data);
+    }
+
+    Entry->Done   = TRUE;
+    Entry->Time   = mModelNow;
+    Entry->Actual = DataLength;
+  }
+
+  ModelAdvance ();
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelPollTransfer (
+  IN  EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN  VOID                          *Transfer,
+  OUT UINTN                         *DataLength,
+  OUT UINT32                        *TransferResult
+  )
+{
+  MODEL_TRANSFER  *Entry;
+
+  Entry = (MODEL_TRANSFER *)Transfer;
+  ASSERT (Entry->Used);
+  ModelAdvance ();
+  if (!Entry->Done || (Entry->Time > mModelNow)) {
+    return EFI_NOT_READY;
+  }
+
+  *DataLength     = Entry->Actual;
+  *TransferResult = EFI_USB_NOERROR;
+  Entry->Used     = FALSE;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCancelTransfer (
+  IN EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN VOID                          *Transfer
+  )
+{
+  MODEL_TRANSFER  *Entry;
+
+  Entry = (MODEL_TRANSFER *)Transfer;
+  ASSERT (Entry->Used);
+  Entry->Used = FALSE;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction OPTIONAL,
+  IN  VOID              *NotifyContext OPTIONAL,
+  OUT EFI_EVENT         *Event
+  )
+{
+  UINTN  Index;
+
+  ASSERT (NotifyFunction == NULL);
+  for (Index = 0; Index < MODEL_MAX_EVENTS; Index++) {
+    if (!mModelEvents[Index].Used) {
+      ZeroMem (&mModelEvents[Index], sizeof (MODEL_EVENT));
+      mModelEvents[Index].Used = TRUE;
+      *Event                   = &mModelEvents[Index];
+      return EFI_SUCCESS;
+    }
+  }
+
+  return EFI_OUT_OF_RESOURCES;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ((MODEL_EVENT *)Event)->Used = FALSE;
+  return EFI_SUCCESS;
+}
+
+//
+// The trigger time of the timers is in 100 ns units.
+//
+STATIC
+EFI_STATUS
+EFIAPI
+ModelSetTimer (
+  IN EFI_EVENT        Event,
+  IN EFI_TIMER_DELAY  Type,
+  IN UINT64           TriggerTime
+  )
+{
+  MODEL_EVENT  *ModelEvent;
+
+  ModelEvent           = (MODEL_EVENT *)Event;
+  ModelEvent->Armed    = (BOOLEAN)(Type != TimerCancel);
+  ModelEvent->Deadline = mModelNow + MultU64x32 (TriggerTime, 100);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCheckEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  MODEL_EVENT  *ModelEvent;
+
+  ModelEvent = (MODEL_EVENT *)Event;
+  ASSERT (ModelEvent->Armed);
+  return (mModelNow >= ModelEvent->Deadline) ? EFI_SUCCESS : EFI_NOT_READY;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelStall (
+  IN UINTN  Microseconds
+  )
+{
+  mModelNow += MultU64x32 (Microseconds, 1000);
+  ModelAdvance ();
+  return EFI_SUCCESS;
+}
+
+//
+// The transport finds the stream I/O of the host controller by the USB I/O
+// on the same handle, which is the one of the model.
+//
+STATIC
+EFI_STATUS
+EFIAPI
+ModelLocateHandleBuffer (
+  IN     EFI_LOCATE_SEARCH_TYPE  SearchType,
+  IN     EFI_GUID                *Protocol OPTIONAL,
+  IN     VOID                    *SearchKey OPTIONAL,
+  OUT    UINTN                   *NumberHandles,
+  OUT    EFI_HANDLE              **Buffer
+  )
+{
+  if ((SearchType != ByProtocol) || !CompareGuid (Protocol, &gEdkiiUsbStreamIoProtocolGuid)) {
+    return mModelBootServices.LocateHandleBuffer (SearchType, Protocol, SearchKey, NumberHandles, Buffer);
+  }
+
+  if (!mModelHasStreamIo) {
+    return EFI_NOT_FOUND;
+  }
+
+  *Buffer = AllocatePool (sizeof (EFI_HANDLE));
+  if (*Buffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  (*Buffer)[0]   = &mModelHandle;
+  *NumberHandles = 1;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelHandleProtocol (
+  IN  EFI_HANDLE  Handle,
+  IN  EFI_GUID    *Protocol,
+  OUT VOID        **Interface
+  )
+{
+  if (Handle != &mModelHandle) {
+    return mModelBootServices.HandleProtocol (Handle, Protocol, Interface);
+  }
+
+  if (CompareGuid (Protocol, &gEfiUsbIoProtocolGuid)) {
+    *Interface = &mModelUsbIo;
+  } else if (mModelHasStreamIo && CompareGuid (Protocol, &gEdkiiUsbStreamIoProtocolGuid)) {
+    *Interface = &mModelStreamIo;
+  } else {
+    return EFI_UNSUPPORTED;
+  }
+
+  return EFI_SUCCESS;
+}
+
+VOID
+UasModelDefaultConfig (
+  VOID
+  )
+{
+  ZeroMem (&mUasModelConfig, sizeof (mUasModelConfig));
+  mUasModelConfig.UasSetting    = TRUE;
+  mUasModelConfig.DeviceStreams = 5;
+  mUasModelConfig.HcStreams     = 1024;
+  mUasModelConfig.ParallelUnits = 4;
+  mUasModelConfig.MediaLatency  = 100 * 1000;
+  mUasModelConfig.LinkBandwidth = 400000000ULL;
+  mUasModelConfig.TransferTime  = 1000;
+  mUasModelConfig.FailLba       = MAX_UINT64;
+}
+
+VOID
+UasModelCreate (
+  IN UINT32  BlockSize,
+  IN UINTN   Blocks
+  )
+{
+  UINTN  Index;
+
+  ASSERT (mUasModelConfig.ParallelUnits <= MODEL_MAX_UNITS);
+  UasModelFree ();
+
+  mModelBlockSize = BlockSize;
+  mModelBlocks    = Blocks;
+  mModelMedia     = AllocatePool (BlockSize * Blocks);
+  ASSERT (mModelMedia != NULL);
+  for (Index = 0; Index < BlockSize * Blocks; Index++) {
+    mModelMedia[Index] = (UINT8)(Index * 7 + Index / 4093);
+  }
+
+  ModelBuildConfig ();
+  ZeroMem (&mUasModelStatistics, sizeof (mUasModelStatistics));
+  ZeroMem (mModelEvents, sizeof (mModelEvents));
+  ZeroMem (mModelStreams, sizeof (mModelStreams));
+  ZeroMem (mModelTransfers, sizeof (mModelTransfers));
+  ZeroMem (mModelCommands, sizeof (mModelCommands));
+  ZeroMem (mModelUnitFree, sizeof (mModelUnitFree));
+  mModelInFlight = 0;
+  mModelSetting  = 0;
+  mModelNow      = 0;
+  mModelLinkFree = 0;
+
+  ZeroMem (&mModelUsbIo, sizeof (mModelUsbIo));
+  mModelUsbIo.UsbControlTransfer        = ModelControlTransfer;
+  mModelUsbIo.UsbGetConfigDescriptor    = ModelGetConfigDescriptor;
+  mModelUsbIo.UsbGetInterfaceDescriptor = ModelGetInterfaceDescriptor;
+
+  mModelStreamIo.AllocateStreams = ModelAllocateStreams;
+  mModelStreamIo.FreeStreams     = ModelFreeStreams;
+  mModelStreamIo.SubmitTransfer  = ModelSubmitTransfer;
+  mModelStreamIo.PollTransfer    = ModelPollTransfer;
+  mModelStreamIo.CancelTransfer  = ModelCancelTransfer;
+
+  mModelHasStreamIo = (BOOLEAN)(mUasModelConfig.HcStreams != 0);
+
+  CopyMem (&mModelBootServices, gBS, sizeof (EFI_BOOT_SERVICES));
+  gBS->CreateEvent        = ModelCreateEvent;
+  gBS->CloseEvent         = ModelCloseEvent;
+  gBS->SetTimer           = ModelSetTimer;
+  gBS->CheckEvent         = ModelCheckEvent;
+  gBS->Stall              = ModelStall;
+  gBS->LocateHandleBuffer = ModelLocateHandleBuffer;
+  gBS->HandleProtocol     = ModelHandleProtocol;
+}
+
+VOID
+UasModelFree (
+  VOID
+  )
+{
+  if (mModelMedia == NULL) {
+    return;
+  }
+
+  CopyMem (gBS, &mModelBootServices, sizeof (EFI_BOOT_SERVICES));
+  FreePool (mModelMedia);
+  mModelMedia = NULL;
+}
+
+UINT8 *
+UasModelMedia (
+  VOID
+  )
+{
+  return mModelMedia;
+}
+
+UINT64
+UasModelNow (
+  VOID
+  )
+{
+  return mModelNow;
+}
+
+UINT8
+UasModelAlternateSetting (
+  VOID
+  )
+{
+  return mModelSetting;
+}
+
+UINTN
+UasModelStreamEndpoints (
+  VOID
+  )
+{
+  UINTN  Index;
+  UINTN  Count;
+
+  Count = 0;
+  for (Index = 0; Index < ARRAY_SIZE (mModelStreams); Index++) {
+    if (mModelStreams[Index] != 0) {
+      Count++;
+    }
+  }
+
+  return Count;
+}
+
+UINTN
+UasModelPendingTransfers (
+  VOID
+  )
+{
+  UINTN  Index;
+  UINTN  Count;
+
+  Count = 0;
+  for (Index = 0; Index < MODEL_MAX_TRANSFERS; Index++) {
+    if (mModelTransfers[Index].Used) {
+      Count++;
+    }
+  }
+
+  return Count;
+}
+
+EFI_STATUS
+UasModelProbe (
+  VOID
+  )
+{
+  return mUsbUasTransport.Init (&mModelUsbIo, NULL);
+}
+
+EFI_STATUS
+UasModelStartDriver (
+  IN  UINT32  MaxCarrySize,
+  OUT VOID    **Device
+  )
+{
+  USB_MASS_DEVICE  *UsbMass;
+  VOID             *Context;
+  EFI_STATUS       Status;
+
+  Status = mUsbUasTransport.Init (&mModelUsbIo, &Context);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  UsbMass = AllocateZeroPool (sizeof (USB_MASS_DEVICE));
+  ASSERT (UsbMass != NULL);
+  UsbMass->Signature                 = USB_MASS_SIGNATURE;
+  UsbMass->UsbIo                     = &mModelUsbIo;
+  UsbMass->Transport                 = &mUsbUasTransport;
+  UsbMass->Context                   = Context;
+  UsbMass->MaxCarrySize              = MaxCarrySize;
+  UsbMass->BlockIoMedia.MediaPresent = TRUE;
+  UsbMass->BlockIoMedia.BlockSize    = mModelBlockSize;
+  UsbMass->BlockIoMedia.LastBlock    = mModelBlocks - 1;
+  *Device                            = UsbMass;
+  return EFI_SUCCESS;
+}
+
+VOID
+UasModelStopDriver (
+  IN VOID  *Device
+  )
+{
+  USB_MASS_DEVICE  *UsbMass;
+
+  UsbMass = (USB_MASS_DEVICE *)Device;
+  UsbMass->Transport->CleanUp (UsbMass->Context);
+  FreePool (UsbMass);
+}
+
+UINT16
+UasModelQueueDepth (
+  IN VOID  *Device
+  )
+{
+  return ((USB_UAS_PROTOCOL *)((USB_MASS_DEVICE *)Device)->Context)->QueueDepth;
+}
+
+EFI_STATUS
+UasModelTransfer (
+  IN     VOID     *Device,
+  IN     BOOLEAN  Write,
+  IN OUT VOID     *Buffer,
+  IN     UINT64   Lba,
+  IN     UINTN    Blocks
+  )
+{
+  return UsbBootReadWriteBlocks (Device, Write, (UINT32)Lba, Blocks, Buffer);
+}
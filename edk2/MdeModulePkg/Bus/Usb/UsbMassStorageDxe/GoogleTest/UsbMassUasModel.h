@@ -0,0 +1,174 @@
+/** @file
+  Interface of the software UAS device model to the host test of the USB
+  Attached SCSI transport of UsbMassStorageDxe.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#ifndef USB_MASS_UAS_MODEL_H_
+#define USB_MASS_UAS_MODEL_H_
+
+//
+// The device model. Times are in nanoseconds.
+//
+typedef struct {
+  BOOLEAN    UasSetting;      // The interface has a UAS alternate setting
+  UINT8      DeviceStreams;   // Log2 of the streams in the SuperSpeed companions, 0 on high speed
+  UINT16     HcStreams;       // Most streams the host controller gives an endpoint, 0 for none
+  UINT32     ParallelUnits;   // Commands the media works on at once
+  UINT64     MediaLatency;    // Time the media takes for a command
+  UINT64     LinkBandwidth;   // Bytes per second of the link
+  UINT64     TransferTime;    // Time the host takes to start a transfer
+  UINT64     FailLba;         // A command covering this block fails
+  BOOLEAN    FailOnce;        // Only the first command covering FailLba fails
+  UINT32     HangCommands;    // The next commands are taken and never ended
+} UAS_MODEL_CONFIG;
+
+typedef struct {
+  UINT64    Commands;
+  UINT64    Failures;
+  UINT64    NotPrimed;        // Times the device found no transfer on a stream
+  UINT32    MaxInFlight;
+  UINT32    TaskManagements;
+  UINT32    SetInterfaces;
+} UAS_MODEL_STATISTICS;
+
+extern UAS_MODEL_CONFIG      mUasModelConfig;
+extern UAS_MODEL_STATISTICS  mUasModelStatistics;
+
+/**
+  Set the model to its default configuration: a SuperSpeed device with a UAS
+  setting of 32 streams, behind a host controller with streams, 4 parallel
+  units of 100 us and a 400 MB/s link.
+
+**/
+VOID
+UasModelDefaultConfig (
+  VOID
+  );
+
+/**
+  Plug in the device model with a media of the given size, filled with a
+  pattern, reset the clock and the statistics, and take over the boot
+  services the transport waits for the device with and finds its protocols
+  with.
+
+  @param  BlockSize              The size of the blocks of the media.
+  @param  Blocks                 The number of blocks of the media.
+
+**/
+VOID
+UasModelCreate (
+  IN UINT32  BlockSize,
+  IN UINTN   Blocks
+  );
+
+/**
+  Unplug the device model: free the media and give the boot services back.
+
+**/
+VOID
+UasModelFree (
+  VOID
+  );
+
+/**
+  Return the media of the device model.
+
+**/
+UINT8 *
+UasModelMedia (
+  VOID
+  );
+
+/**
+  Return the time of the clock, in nanoseconds.
+
+**/
+UINT64
+UasModelNow (
+  VOID
+  );
+
+/**
+  Return the alternate setting the interface is on.
+
+**/
+UINT8
+UasModelAlternateSetting (
+  VOID
+  );
+
+/**
+  Return the number of endpoints that have streams, and of the transfers not
+  polled to completion or canceled yet.
+
+**/
+UINTN
+UasModelStreamEndpoints (
+  VOID
+  );
+
+UINTN
+UasModelPendingTransfers (
+  VOID
+  );
+
+/**
+  Check whether the UAS transport takes the device, without changing it.
+
+**/
+EFI_STATUS
+UasModelProbe (
+  VOID
+  );
+
+/**
+  Start the UAS transport on the device the way the driver binding does, and
+  build its mass storage device, with the given carry size.
+
+  @param  MaxCarrySize           The most bytes of a READ or WRITE command.
+  @param  Device                 The mass storage device.
+
+  @return The status of the UAS initialization.
+
+**/
+EFI_STATUS
+UasModelStartDriver (
+  IN  UINT32  MaxCarrySize,
+  OUT VOID    **Device
+  );
+
+/**
+  Stop the UAS transport and free the mass storage device.
+
+**/
+VOID
+UasModelStopDriver (
+  IN VOID  *Device
+  );
+
+/**
+  Return the number of tags the UAS transport uses.
+
+**/
+UINT16
+UasModelQueueDepth (
+  IN VOID  *Device
+  );
+
+/**
+  Read or write blocks through the driver.
+
+**/
+EFI_STATUS
+UasModelTransfer (
+  IN     VOID     *Device,
+  IN     BOOLEAN  Write,
+  IN OUT VOID     *Buffer,
+  IN     UINT64   Lba,
+  IN     UINTN    Blocks
+  );
+
+#endif
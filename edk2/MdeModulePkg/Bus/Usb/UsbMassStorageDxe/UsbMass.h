@@ -14,6 +14,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <IndustryStandard/Scsi.h>
 #include <Protocol/BlockIo.h>
 #include <Protocol/UsbIo.h>
+#include <Protocol/UsbStreamIo.h>
 #include <Protocol/DevicePath.h>
 #include <Protocol/DiskInfo.h>
 #include <Library/BaseLib.h>
@@ -28,8 +29,21 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 typedef struct _USB_MASS_TRANSPORT  USB_MASS_TRANSPORT;
 typedef struct _USB_MASS_DEVICE     USB_MASS_DEVICE;
 
+///
+/// A command of a USB_MASS_EXEC_COMMANDS batch, with its result.
+///
+typedef struct {
+  VOID                      *Cmd;
+  UINT8                     CmdLen;
+  EFI_USB_DATA_DIRECTION    DataDir;
+  VOID                      *Data;
+  UINT32                    DataLen;
+  UINT32                    CmdStatus;  ///< USB_MASS_CMD_SUCCESS or USB_MASS_CMD_FAIL
+} USB_MASS_COMMAND;
+
 #include "UsbMassBot.h"
 #include "UsbMassCbi.h"
+#include "UsbMassUas.h"
 #include "UsbMassBoot.h"
 #include "UsbMassDiskInfo.h"
 #include "UsbMassImpl.h"
@@ -99,6 +113,32 @@ EFI_STATUS
   OUT UINT32                  *CmdStatus
   );
 
+/**
+  Execute several USB mass storage commands at once through the transport
+  protocol. Only the transport protocols that queue commands in the device
+  have it.
+
+  @param  Context               The USB Transport Protocol.
+  @param  Commands              The commands, with their results on return
+  @param  Count                 The number of commands
+  @param  Lun                   The logical unit of the commands
+  @param  Timeout               The time to wait for a command to progress
+
+  @retval EFI_SUCCESS           The commands are executed, with their results
+                                in their CmdStatus.
+  @retval Other                 Failed to execute the commands
+
+**/
+typedef
+EFI_STATUS
+(*USB_MASS_EXEC_COMMANDS) (
+  IN     VOID              *Context,
+  IN OUT USB_MASS_COMMAND  *Commands,
+  IN     UINTN             Count,
+  IN     UINT8             Lun,
+  IN     UINT32            Timeout
+  );
+
 /**
   Reset the USB mass storage device by Transport protocol.
 
@@ -155,15 +195,17 @@ EFI_STATUS
 /// two transport protocols. One is the CBI, and the other is BOT.
 /// CBI is being obseleted. The design is made modular by this
 /// structure so that the CBI protocol can be easily removed when
-/// it is no longer necessary.
+/// it is no longer necessary. UAS, which queues the commands in
+/// the device, is used on SuperSpeed devices that have it.
 ///
 struct _USB_MASS_TRANSPORT {
   UINT8                      Protocol;
-  USB_MASS_INIT_TRANSPORT    Init;        ///< Initialize the mass storage transport protocol
-  USB_MASS_EXEC_COMMAND      ExecCommand; ///< Transport command to the device then get result
-  USB_MASS_RESET             Reset;       ///< Reset the device
-  USB_MASS_GET_MAX_LUN       GetMaxLun;   ///< Get max lun, only for bot
-  USB_MASS_CLEAN_UP          CleanUp;     ///< Clean up the resources.
+  USB_MASS_INIT_TRANSPORT    Init;         ///< Initialize the mass storage transport protocol
+  USB_MASS_EXEC_COMMAND      ExecCommand;  ///< Transport command to the device then get result
+  USB_MASS_RESET             Reset;        ///< Reset the device
+  USB_MASS_GET_MAX_LUN       GetMaxLun;    ///< Get max lun, only for bot
+  USB_MASS_CLEAN_UP          CleanUp;      ///< Clean up the resources.
+  USB_MASS_EXEC_COMMANDS     ExecCommands; ///< Run a batch of commands at once, or NULL
 };
 
 struct _USB_MASS_DEVICE {
@@ -181,6 +223,7 @@ struct _USB_MASS_DEVICE {
   EFI_DISK_INFO_PROTOCOL      DiskInfo;
   USB_BOOT_INQUIRY_DATA       InquiryData;
   BOOLEAN                     Cdb16Byte;
+  UINT32                      MaxCarrySize; ///< Most bytes moved by one READ or WRITE command
 };
 
 #endif
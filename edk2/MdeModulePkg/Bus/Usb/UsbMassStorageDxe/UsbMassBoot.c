@@ -793,6 +793,146 @@ UsbBootDetectMedia (
   return Status;
 }
 
+/**
+  Read or write some blocks from the device, handing up to
+  USB_BOOT_MAX_QUEUED_COMMANDS commands at once to a transport that keeps
+  them in flight together.
+
+  A command that fails in the queue goes through the usual sense and retry
+  path on its own, and the queue resumes after it.
+
+  @param  UsbMass                The USB mass storage device to access
+  @param  Write                  TRUE for write operation.
+  @param  Cmd16                  TRUE for the 16 byte READ and WRITE commands.
+  @param  Lba                    The start block number
+  @param  TotalBlock             Total block number to read or write
+  @param  Buffer                 The buffer to read to or write from
+
+  @retval EFI_SUCCESS            Data are read into the buffer or writen into the device.
+  @retval Others                 Failed to read or write all the data
+
+**/
+EFI_STATUS
+UsbBootReadWriteQueued (
+  IN  USB_MASS_DEVICE  *UsbMass,
+  IN  BOOLEAN          Write,
+  IN  BOOLEAN          Cmd16,
+  IN  UINT64           Lba,
+  IN  UINTN            TotalBlock,
+  IN OUT UINT8         *Buffer
+  )
+{
+  UINT8                       Cdbs[USB_BOOT_MAX_QUEUED_COMMANDS][16];
+  USB_MASS_COMMAND            Commands[USB_BOOT_MAX_QUEUED_COMMANDS];
+  USB_BOOT_READ_WRITE_10_CMD  *Cmd10;
+  USB_MASS_TRANSPORT          *Transport;
+  EFI_STATUS                  Status;
+  UINTN                       Queued;
+  UINTN                       Index;
+  UINT32                      Count;
+  UINT32                      CountMax;
+  UINT32                      BlockSize;
+
+  Transport = UsbMass->Transport;
+  BlockSize = UsbMass->BlockIoMedia.BlockSize;
+  CountMax  = UsbMass->MaxCarrySize / BlockSize;
+  if (!Cmd16) {
+    CountMax = MIN (MAX_UINT16, CountMax);
+  }
+
+  while (TotalBlock > 0) {
+    //
+    // Split the blocks into the commands of the next batch.
+    //
+    for (Queued = 0; (Queued < USB_BOOT_MAX_QUEUED_COMMANDS) && (TotalBlock > 0); Queued++) {
+      Count = (UINT32)MIN (TotalBlock, CountMax);
+      ZeroMem (Cdbs[Queued], sizeof (Cdbs[Queued]));
+
+      if (Cmd16) {
+        Cdbs[Queued][0] = Write ? EFI_SCSI_OP_WRITE16 : EFI_SCSI_OP_READ16;
+        Cdbs[Queued][1] = (UINT8)((USB_BOOT_LUN (UsbMass->Lun) & 0xE0));
+        WriteUnaligned64 ((UINT64 *)&Cdbs[Queued][2], SwapBytes64 (Lba));
+        WriteUnaligned32 ((UINT32 *)&Cdbs[Queued][10], SwapBytes32 (Count));
+        Commands[Queued].CmdLen = 16;
+      } else {
+        Cmd10         = (USB_BOOT_READ_WRITE_10_CMD *)Cdbs[Queued];
+        Cmd10->OpCode = Write ? USB_BOOT_WRITE10_OPCODE : USB_BOOT_READ10_OPCODE;
+        Cmd10->Lun    = (UINT8)(USB_BOOT_LUN (UsbMass->Lun));
+        WriteUnaligned32 ((UINT32 *)Cmd10->Lba, SwapBytes32 ((UINT32)Lba));
+        WriteUnaligned16 ((UINT16 *)Cmd10->TransferLen, SwapBytes16 ((UINT16)Count));
+        Commands[Queued].CmdLen = (UINT8)sizeof (USB_BOOT_READ_WRITE_10_CMD);
+      }
+
+      Commands[Queued].Cmd     = Cdbs[Queued];
+      Commands[Queued].DataDir = Write ? EfiUsbDataOut : EfiUsbDataIn;
+      Commands[Queued].Data    = Buffer;
+      Commands[Queued].DataLen = Count * BlockSize;
+
+      Lba        += Count;
+      Buffer     += Count * BlockSize;
+      TotalBlock -= Count;
+    }
+
+    Status = Transport->ExecCommands (
+                          UsbMass->Context,
+                          Commands,
+                          Queued,
+                          UsbMass->Lun,
+                          (UINT32)USB_BOOT_GENERAL_CMD_TIMEOUT
+                          );
+    if (Status == EFI_TIMEOUT) {
+      DEBUG ((DEBUG_ERROR, "UsbBootReadWriteQueued: %r to Exec %d Cmds\n", Status, Queued));
+    }
+
+    for (Index = 0; Index < Queued; Index++) {
+      if (Commands[Index].CmdStatus == USB_MASS_CMD_SUCCESS) {
+        continue;
+      }
+
+      //
+      // Take the sense of the failed command, as UsbBootExecCmd() does, then
+      // retry it alone. The commands behind it go in the next batch.
+      //
+      if (Status != EFI_TIMEOUT) {
+        Status = UsbBootRequestSense (UsbMass);
+        if (Status == EFI_NO_MEDIA) {
+          return Status;
+        }
+      }
+
+      Status = UsbBootExecCmdWithRetry (
+                 UsbMass,
+                 Commands[Index].Cmd,
+                 Commands[Index].CmdLen,
+                 Commands[Index].DataDir,
+                 Commands[Index].Data,
+                 Commands[Index].DataLen,
+                 (UINT32)USB_BOOT_GENERAL_CMD_TIMEOUT
+                 );
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+
+      for (Index++; Index < Queued; Index++) {
+        Count       = Commands[Index].DataLen / BlockSize;
+        Lba        -= Count;
+        Buffer     -= Commands[Index].DataLen;
+        TotalBlock += Count;
+      }
+    }
+
+    DEBUG ((
+      DEBUG_BLKIO,
+      "UsbBoot%sQueued: LBA (0x%lx), %d Cmds\n",
+      Write ? L"Write" : L"Read",
+      Lba,
+      Queued
+      ));
+  }
+
+  return EFI_SUCCESS;
+}
+
 /**
   Read or write some blocks from the device.
 
@@ -823,8 +963,12 @@ UsbBootReadWriteBlocks (
   UINT32                      ByteSize;
   UINT32                      Timeout;
 
+  if (UsbMass->Transport->ExecCommands != NULL) {
+    return UsbBootReadWriteQueued (UsbMass, Write, FALSE, Lba, TotalBlock, Buffer);
+  }
+
   BlockSize = UsbMass->BlockIoMedia.BlockSize;
-  CountMax  = USB_BOOT_MAX_CARRY_SIZE / BlockSize;
+  CountMax  = UsbMass->MaxCarrySize / BlockSize;
   Status    = EFI_SUCCESS;
 
   while (TotalBlock > 0) {
@@ -909,8 +1053,12 @@ UsbBootReadWriteBlocks16 (
   UINT32      ByteSize;
   UINT32      Timeout;
 
+  if (UsbMass->Transport->ExecCommands != NULL) {
+    return UsbBootReadWriteQueued (UsbMass, Write, TRUE, Lba, TotalBlock, Buffer);
+  }
+
   BlockSize = UsbMass->BlockIoMedia.BlockSize;
-  CountMax  = USB_BOOT_MAX_CARRY_SIZE / BlockSize;
+  CountMax  = UsbMass->MaxCarrySize / BlockSize;
   Status    = EFI_SUCCESS;
 
   while (TotalBlock > 0) {
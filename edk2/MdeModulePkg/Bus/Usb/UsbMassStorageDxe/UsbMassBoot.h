@@ -59,9 +59,17 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #define USB_PDT_SIMPLE_DIRECT  0x0E                ///< Simplified direct access device
 
 //
-// Other parameters, Max carried size is 64KB.
+// Other parameters, Max carried size is 64KB, or 1MB on SuperSpeed, where
+// the commands are few enough for a large transfer to pay off.
 //
-#define USB_BOOT_MAX_CARRY_SIZE  SIZE_64KB
+#define USB_BOOT_MAX_CARRY_SIZE              SIZE_64KB
+#define USB_BOOT_MAX_CARRY_SIZE_SUPER_SPEED  SIZE_1MB
+
+//
+// Most READ or WRITE commands handed to the transport at once, when it can
+// queue them.
+//
+#define USB_BOOT_MAX_QUEUED_COMMANDS  32
 
 //
 // Retry mass command times, set by experience
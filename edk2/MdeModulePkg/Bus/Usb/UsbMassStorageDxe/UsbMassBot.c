@@ -18,7 +18,8 @@ USB_MASS_TRANSPORT  mUsbBotTransport = {
   UsbBotExecCommand,
   UsbBotResetDevice,
   UsbBotGetMaxLun,
-  UsbBotCleanUp
+  UsbBotCleanUp,
+  NULL
 };
 
 /**
@@ -8,7 +8,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 
 #include "UsbMass.h"
 
-#define USB_MASS_TRANSPORT_COUNT  3
+#define USB_MASS_TRANSPORT_COUNT  4
 //
 // Array of USB transport interfaces.
 //
@@ -16,6 +16,7 @@ USB_MASS_TRANSPORT  *mUsbMassTransport[USB_MASS_TRANSPORT_COUNT] = {
   &mUsbCbi0Transport,
   &mUsbCbi1Transport,
   &mUsbBotTransport,
+  &mUsbUasTransport,
 };
 
 EFI_DRIVER_BINDING_PROTOCOL  gUSBMassDriverBinding = {
@@ -366,6 +367,40 @@ UsbMassInitMedia (
   return Status;
 }
 
+/**
+  Get the most bytes one READ or WRITE command of the device may move.
+
+  @param  Transport              The transport of the device
+  @param  Context                The context of the transport
+
+  @return The most bytes of a command.
+
+**/
+UINT32
+UsbMassGetMaxCarrySize (
+  IN USB_MASS_TRANSPORT  *Transport,
+  IN VOID                *Context
+  )
+{
+  USB_BOT_PROTOCOL  *UsbBot;
+
+  if (Transport->Protocol == USB_MASS_STORE_UAS) {
+    return USB_BOOT_MAX_CARRY_SIZE_SUPER_SPEED;
+  }
+
+  //
+  // Only the bulk endpoints of a SuperSpeed device have 1024 byte packets.
+  //
+  if (Transport->Protocol == USB_MASS_STORE_BOT) {
+    UsbBot = (USB_BOT_PROTOCOL *)Context;
+    if (UsbBot->BulkInEndpoint->MaxPacketSize >= 1024) {
+      return USB_BOOT_MAX_CARRY_SIZE_SUPER_SPEED;
+    }
+  }
+
+  return USB_BOOT_MAX_CARRY_SIZE;
+}
+
 /**
   Initialize the USB Mass Storage transport.
 
@@ -415,6 +450,18 @@ UsbMassInitTransport (
     goto ON_EXIT;
   }
 
+  //
+  // A UAS device offers UAS on an alternate setting of its BOT interface.
+  // Prefer it when the device and the host controller both have streams.
+  //
+  if (Interface.InterfaceProtocol == USB_MASS_STORE_BOT) {
+    Status = mUsbUasTransport.Init (UsbIo, Context);
+    if (!EFI_ERROR (Status)) {
+      *Transport = &mUsbUasTransport;
+      goto ON_EXIT;
+    }
+  }
+
   Status = EFI_UNSUPPORTED;
 
   //
@@ -507,6 +554,7 @@ UsbMassInitMultiLun (
     UsbMass->Transport           = Transport;
     UsbMass->Context             = Context;
     UsbMass->Lun                 = Index;
+    UsbMass->MaxCarrySize        = UsbMassGetMaxCarrySize (Transport, Context);
 
     //
     // Initialize the media parameter data for EFI_BLOCK_IO_MEDIA of Block I/O Protocol.
@@ -648,6 +696,7 @@ UsbMassInitNonLun (
   UsbMass->OpticalStorage      = FALSE;
   UsbMass->Transport           = Transport;
   UsbMass->Context             = Context;
+  UsbMass->MaxCarrySize        = UsbMassGetMaxCarrySize (Transport, Context);
 
   //
   // Initialize the media parameter data for EFI_BLOCK_IO_MEDIA of Block I/O Protocol.
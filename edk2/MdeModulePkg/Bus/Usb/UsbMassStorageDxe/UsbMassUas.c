@@ -0,0 +1,1029 @@
+/** @file
+  Implementation of the USB Attached SCSI (UAS) transport, according to
+  Universal Serial Bus Mass Storage Class USB Attached SCSI Protocol,
+  Revision 1.0.
+
+Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "UsbMass.h"
+
+//
+// Definition of USB UAS Transport Protocol
+//
+USB_MASS_TRANSPORT  mUsbUasTransport = {
+  USB_MASS_STORE_UAS,
+  UsbUasInit,
+  UsbUasExecCommand,
+  UsbUasResetDevice,
+  UsbUasGetMaxLun,
+  UsbUasCleanUp,
+  UsbUasExecCommands
+};
+
+/**
+  Find the stream I/O protocol that goes with a USB I/O protocol.
+
+  @param  UsbIo                 The USB I/O Protocol instance
+  @param  StreamIo              The stream I/O Protocol instance of the same
+                                interface
+
+  @retval EFI_SUCCESS           The stream I/O Protocol is found.
+  @retval EFI_UNSUPPORTED       The host controller has no bulk streams.
+
+**/
+EFI_STATUS
+UsbUasGetStreamIo (
+  IN  EFI_USB_IO_PROTOCOL           *UsbIo,
+  OUT EDKII_USB_STREAM_IO_PROTOCOL  **StreamIo
+  )
+{
+  EFI_USB_IO_PROTOCOL  *HandleUsbIo;
+  EFI_HANDLE           *Handles;
+  UINTN                HandleCount;
+  UINTN                Index;
+  EFI_STATUS           Status;
+
+  Status = gBS->LocateHandleBuffer (
+                  ByProtocol,
+                  &gEdkiiUsbStreamIoProtocolGuid,
+                  NULL,
+                  &HandleCount,
+                  &Handles
+                  );
+  if (EFI_ERROR (Status)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = EFI_UNSUPPORTED;
+  for (Index = 0; Index < HandleCount; Index++) {
+    if (!EFI_ERROR (gBS->HandleProtocol (Handles[Index], &gEfiUsbIoProtocolGuid, (VOID **)&HandleUsbIo)) &&
+        (HandleUsbIo == UsbIo))
+    {
+      Status = gBS->HandleProtocol (Handles[Index], &gEdkiiUsbStreamIoProtocolGuid, (VOID **)StreamIo);
+      break;
+    }
+  }
+
+  FreePool (Handles);
+  return Status;
+}
+
+/**
+  Read the whole active configuration descriptor, with the descriptors of
+  all the alternate settings and the class specific descriptors, which the
+  USB I/O Protocol doesn't return.
+
+  @param  UsbIo                 The USB I/O Protocol instance
+  @param  Config                The configuration descriptor, to be freed by
+                                the caller
+  @param  Length                The length of the configuration descriptor
+
+  @retval EFI_SUCCESS           The configuration descriptor is read.
+  @retval EFI_UNSUPPORTED       The active configuration is not the first one.
+  @retval Others                Failed to read the descriptor.
+
+**/
+EFI_STATUS
+UsbUasGetConfigDescriptor (
+  IN  EFI_USB_IO_PROTOCOL  *UsbIo,
+  OUT UINT8                **Config,
+  OUT UINTN                *Length
+  )
+{
+  EFI_USB_CONFIG_DESCRIPTOR  ConfigDesc;
+  EFI_USB_DEVICE_REQUEST     Request;
+  EFI_STATUS                 Status;
+  UINT32                     Result;
+  UINT8                      *Buffer;
+
+  Status = UsbIo->UsbGetConfigDescriptor (UsbIo, &ConfigDesc);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (ConfigDesc.TotalLength < sizeof (EFI_USB_CONFIG_DESCRIPTOR)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Buffer = AllocatePool (ConfigDesc.TotalLength);
+  if (Buffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // A mass storage device has a single configuration, read it by index 0.
+  //
+  Request.RequestType = USB_DEV_GET_DESCRIPTOR_REQ_TYPE;
+  Request.Request     = USB_REQ_GET_DESCRIPTOR;
+  Request.Value       = (UINT16)(USB_DESC_TYPE_CONFIG << 8);
+  Request.Index       = 0;
+  Request.Length      = ConfigDesc.TotalLength;
+
+  Status = UsbIo->UsbControlTransfer (
+                    UsbIo,
+                    &Request,
+                    EfiUsbDataIn,
+                    USB_UAS_SEND_IU_TIMEOUT / USB_MASS_1_MILLISECOND,
+                    Buffer,
+                    ConfigDesc.TotalLength,
+                    &Result
+                    );
+  if (!EFI_ERROR (Status) &&
+      (((EFI_USB_CONFIG_DESCRIPTOR *)Buffer)->ConfigurationValue != ConfigDesc.ConfigurationValue))
+  {
+    Status = EFI_UNSUPPORTED;
+  }
+
+  if (EFI_ERROR (Status)) {
+    FreePool (Buffer);
+    return Status;
+  }
+
+  *Config = Buffer;
+  *Length = ConfigDesc.TotalLength;
+  return EFI_SUCCESS;
+}
+
+/**
+  Find the UAS alternate setting of an interface and its four pipes in the
+  configuration descriptor.
+
+  @param  Config                The configuration descriptor
+  @param  Length                The length of the configuration descriptor
+  @param  InterfaceNumber       The interface
+  @param  AlternateSetting      The UAS alternate setting of the interface
+  @param  Pipes                 The endpoint address of each pipe, by pipe ID
+  @param  MaxStreams            The log2 of the streams of each pipe, by pipe ID
+
+  @retval EFI_SUCCESS           The UAS alternate setting is found, with its
+                                four bulk pipes.
+  @retval EFI_UNSUPPORTED       The interface has no UAS alternate setting.
+
+**/
+EFI_STATUS
+UsbUasFindSetting (
+  IN  UINT8  *Config,
+  IN  UINTN  Length,
+  IN  UINT8  InterfaceNumber,
+  OUT UINT8  *AlternateSetting,
+  OUT UINT8  Pipes[USB_UAS_PIPE_ID_DATA_OUT + 1],
+  OUT UINT8  MaxStreams[USB_UAS_PIPE_ID_DATA_OUT + 1]
+  )
+{
+  EFI_USB_INTERFACE_DESCRIPTOR  *Interface;
+  EFI_USB_ENDPOINT_DESCRIPTOR   *EndPoint;
+  UINTN                         Offset;
+  UINT8                         DescLength;
+  UINT8                         PipeId;
+  UINT8                         Streams;
+  BOOLEAN                       Found;
+
+  ZeroMem (Pipes, USB_UAS_PIPE_ID_DATA_OUT + 1);
+  ZeroMem (MaxStreams, USB_UAS_PIPE_ID_DATA_OUT + 1);
+  Found    = FALSE;
+  EndPoint = NULL;
+  Streams  = 0;
+
+  for (Offset = 0; Offset + 2 <= Length; Offset += DescLength) {
+    DescLength = Config[Offset];
+    if ((DescLength < 2) || (Offset + DescLength > Length)) {
+      break;
+    }
+
+    switch (Config[Offset + 1]) {
+      case USB_DESC_TYPE_INTERFACE:
+        if (Found) {
+          //
+          // The descriptors of the UAS setting end here.
+          //
+          Offset = Length;
+          break;
+        }
+
+        Interface = (EFI_USB_INTERFACE_DESCRIPTOR *)&Config[Offset];
+        if ((DescLength >= sizeof (EFI_USB_INTERFACE_DESCRIPTOR)) &&
+            (Interface->InterfaceNumber == InterfaceNumber) &&
+            (Interface->InterfaceClass == USB_MASS_STORE_CLASS) &&
+            (Interface->InterfaceProtocol == USB_MASS_STORE_UAS))
+        {
+          Found             = TRUE;
+          *AlternateSetting = Interface->AlternateSetting;
+        }
+
+        break;
+
+      case USB_DESC_TYPE_ENDPOINT:
+        EndPoint = NULL;
+        if (Found && (DescLength >= sizeof (EFI_USB_ENDPOINT_DESCRIPTOR))) {
+          EndPoint = (EFI_USB_ENDPOINT_DESCRIPTOR *)&Config[Offset];
+          Streams  = 0;
+        }
+
+        break;
+
+      case USB_UAS_DESC_TYPE_SS_COMPANION:
+        //
+        // The SuperSpeed companion follows its endpoint, before the pipe usage.
+        //
+        if ((EndPoint != NULL) && (DescLength >= 4)) {
+          Streams = Config[Offset + 3] & USB_UAS_SS_COMPANION_MAX_STREAMS;
+        }
+
+        break;
+
+      case USB_UAS_DESC_TYPE_PIPE_USAGE:
+        if ((EndPoint != NULL) && (DescLength >= 3) && USB_IS_BULK_ENDPOINT (EndPoint->Attributes)) {
+          PipeId = Config[Offset + 2];
+          if ((PipeId >= USB_UAS_PIPE_ID_COMMAND) && (PipeId <= USB_UAS_PIPE_ID_DATA_OUT)) {
+            Pipes[PipeId]      = EndPoint->EndpointAddress;
+            MaxStreams[PipeId] = Streams;
+          }
+        }
+
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  if (!Found ||
+      (Pipes[USB_UAS_PIPE_ID_COMMAND] == 0) || !USB_IS_OUT_ENDPOINT (Pipes[USB_UAS_PIPE_ID_COMMAND]) ||
+      (Pipes[USB_UAS_PIPE_ID_STATUS] == 0) || !USB_IS_IN_ENDPOINT (Pipes[USB_UAS_PIPE_ID_STATUS]) ||
+      (Pipes[USB_UAS_PIPE_ID_DATA_IN] == 0) || !USB_IS_IN_ENDPOINT (Pipes[USB_UAS_PIPE_ID_DATA_IN]) ||
+      (Pipes[USB_UAS_PIPE_ID_DATA_OUT] == 0) || !USB_IS_OUT_ENDPOINT (Pipes[USB_UAS_PIPE_ID_DATA_OUT]))
+  {
+    return EFI_UNSUPPORTED;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Select an alternate setting of the interface.
+
+  @param  UsbIo                 The USB I/O Protocol instance
+  @param  InterfaceNumber       The interface
+  @param  AlternateSetting      The alternate setting to select
+
+  @retval EFI_SUCCESS           The alternate setting is selected.
+  @retval Others                Failed to select the alternate setting.
+
+**/
+EFI_STATUS
+UsbUasSelectSetting (
+  IN EFI_USB_IO_PROTOCOL  *UsbIo,
+  IN UINT8                InterfaceNumber,
+  IN UINT8                AlternateSetting
+  )
+{
+  EFI_USB_DEVICE_REQUEST  Request;
+  UINT32                  Result;
+
+  Request.RequestType = USB_DEV_SET_INTERFACE_REQ_TYPE;
+  Request.Request     = USB_REQ_SET_INTERFACE;
+  Request.Value       = AlternateSetting;
+  Request.Index       = InterfaceNumber;
+  Request.Length      = 0;
+
+  return UsbIo->UsbControlTransfer (
+                  UsbIo,
+                  &Request,
+                  EfiUsbNoData,
+                  USB_UAS_SEND_IU_TIMEOUT / USB_MASS_1_MILLISECOND,
+                  NULL,
+                  0,
+                  &Result
+                  );
+}
+
+/**
+  Initializes the USB UAS protocol.
+
+  This function looks for an alternate setting of the interface with the
+  UAS protocol, selects it and gives streams to its pipes. It will save its
+  context which is a USB_UAS_PROTOCOL structure in the Context if Context
+  isn't NULL; otherwise it only checks the device, and changes nothing.
+
+  @param  UsbIo                 The USB I/O Protocol instance
+  @param  Context               The buffer to save the context to
+
+  @retval EFI_SUCCESS           The device is successfully initialized.
+  @retval EFI_UNSUPPORTED       The device or the host controller doesn't
+                                support UAS. The interface is left on its
+                                first alternate setting.
+  @retval Other                 The USB UAS initialization fails.
+
+**/
+EFI_STATUS
+UsbUasInit (
+  IN  EFI_USB_IO_PROTOCOL  *UsbIo,
+  OUT VOID                 **Context OPTIONAL
+  )
+{
+  USB_UAS_PROTOCOL              *UsbUas;
+  EDKII_USB_STREAM_IO_PROTOCOL  *StreamIo;
+  EFI_USB_INTERFACE_DESCRIPTOR  Interface;
+  EFI_STATUS                    Status;
+  UINT8                         *Config;
+  UINTN                         ConfigLength;
+  UINT8                         AlternateSetting;
+  UINT8                         Pipes[USB_UAS_PIPE_ID_DATA_OUT + 1];
+  UINT8                         MaxStreams[USB_UAS_PIPE_ID_DATA_OUT + 1];
+  UINT8                         PipeId;
+  UINT8                         Allocated;
+  UINT16                        StreamCount;
+
+  Status = UsbIo->UsbGetInterfaceDescriptor (UsbIo, &Interface);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (EFI_ERROR (UsbUasGetStreamIo (UsbIo, &StreamIo))) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = UsbUasGetConfigDescriptor (UsbIo, &Config, &ConfigLength);
+  if (EFI_ERROR (Status)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = UsbUasFindSetting (Config, ConfigLength, Interface.InterfaceNumber, &AlternateSetting, Pipes, MaxStreams);
+  FreePool (Config);
+  if (EFI_ERROR (Status)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  //
+  // UAS runs on streams on SuperSpeed only. A high speed UAS device goes
+  // through its BOT setting.
+  //
+  if ((MaxStreams[USB_UAS_PIPE_ID_STATUS] == 0) ||
+      (MaxStreams[USB_UAS_PIPE_ID_DATA_IN] == 0) ||
+      (MaxStreams[USB_UAS_PIPE_ID_DATA_OUT] == 0))
+  {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (Context == NULL) {
+    return EFI_SUCCESS;
+  }
+
+  UsbUas = AllocateZeroPool (sizeof (USB_UAS_PROTOCOL));
+  if (UsbUas == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  UsbUas->UsbIo          = UsbIo;
+  UsbUas->StreamIo       = StreamIo;
+  UsbUas->DefaultSetting = Interface.AlternateSetting;
+  UsbUas->CommandPipe    = Pipes[USB_UAS_PIPE_ID_COMMAND];
+  UsbUas->StatusPipe     = Pipes[USB_UAS_PIPE_ID_STATUS];
+  UsbUas->DataInPipe     = Pipes[USB_UAS_PIPE_ID_DATA_IN];
+  UsbUas->DataOutPipe    = Pipes[USB_UAS_PIPE_ID_DATA_OUT];
+  UsbUas->QueueDepth     = USB_UAS_MAX_QUEUE_DEPTH;
+  Allocated              = USB_UAS_PIPE_ID_STATUS;
+
+  //
+  // The streams go with the endpoints of the UAS setting, select it first.
+  //
+  Status = UsbUasSelectSetting (UsbIo, Interface.InterfaceNumber, AlternateSetting);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "UsbUasInit: failed to select UAS setting %d - %r\n", AlternateSetting, Status));
+    goto ON_ERROR;
+  }
+
+  //
+  // A tag is a stream ID of the status and data pipes, so the queue depth is
+  // the fewest streams of the three.
+  //
+  for (PipeId = USB_UAS_PIPE_ID_STATUS; PipeId <= USB_UAS_PIPE_ID_DATA_OUT; PipeId++) {
+    StreamCount = (UINT16)MIN (USB_UAS_MAX_QUEUE_DEPTH, 1 << MaxStreams[PipeId]);
+    Status      = StreamIo->AllocateStreams (StreamIo, Pipes[PipeId], &StreamCount);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "UsbUasInit: failed to allocate streams on pipe %d - %r\n", PipeId, Status));
+      goto ON_ERROR;
+    }
+
+    Allocated          = PipeId + 1;
+    UsbUas->QueueDepth = MIN (UsbUas->QueueDepth, StreamCount);
+  }
+
+  UsbUas->Tags = AllocateZeroPool (UsbUas->QueueDepth * sizeof (USB_UAS_TAG));
+  if (UsbUas->Tags == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto ON_ERROR;
+  }
+
+  Status = UsbIo->UsbGetInterfaceDescriptor (UsbIo, &UsbUas->Interface);
+  if (EFI_ERROR (Status)) {
+    goto ON_ERROR;
+  }
+
+  DEBUG ((DEBUG_INFO, "UsbUasInit: UAS on setting %d with %d tags\n", AlternateSetting, UsbUas->QueueDepth));
+  *Context = UsbUas;
+  return EFI_SUCCESS;
+
+ON_ERROR:
+  while (Allocated > USB_UAS_PIPE_ID_STATUS) {
+    Allocated--;
+    StreamIo->FreeStreams (StreamIo, Pipes[Allocated]);
+  }
+
+  UsbUasSelectSetting (UsbIo, Interface.InterfaceNumber, Interface.AlternateSetting);
+  if (UsbUas->Tags != NULL) {
+    FreePool (UsbUas->Tags);
+  }
+
+  FreePool (UsbUas);
+  return EFI_UNSUPPORTED;
+}
+
+/**
+  Wait for a transfer on the streams to be done, and cancel it if it is not
+  done in time.
+
+  @param  UsbUas                The USB UAS device
+  @param  Transfer              The transfer
+  @param  Timeout               The time to wait, in microseconds
+  @param  Result                The result of the transfer
+
+  @retval EFI_SUCCESS           The transfer is done.
+  @retval EFI_TIMEOUT           The transfer is canceled after the timeout.
+  @retval Others                The transfer failed.
+
+**/
+EFI_STATUS
+UsbUasWaitTransfer (
+  IN  USB_UAS_PROTOCOL  *UsbUas,
+  IN  VOID              *Transfer,
+  IN  UINT32            Timeout,
+  OUT UINT32            *Result
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       Length;
+
+  while (TRUE) {
+    Status = UsbUas->StreamIo->PollTransfer (UsbUas->StreamIo, Transfer, &Length, Result);
+    if (Status != EFI_NOT_READY) {
+      return Status;
+    }
+
+    if (Timeout < USB_UAS_POLL_INTERVAL) {
+      UsbUas->StreamIo->CancelTransfer (UsbUas->StreamIo, Transfer);
+      return EFI_TIMEOUT;
+    }
+
+    gBS->Stall (USB_UAS_POLL_INTERVAL);
+    Timeout -= USB_UAS_POLL_INTERVAL;
+  }
+}
+
+/**
+  Send an Information Unit on the command pipe.
+
+  @param  UsbUas                The USB UAS device
+  @param  Iu                    The Command IU or the Task Management IU
+  @param  IuLength              The length of the IU
+
+  @retval EFI_SUCCESS           The IU is sent.
+  @retval Others                Failed to send the IU.
+
+**/
+EFI_STATUS
+UsbUasSendIu (
+  IN USB_UAS_PROTOCOL  *UsbUas,
+  IN VOID              *Iu,
+  IN UINTN             IuLength
+  )
+{
+  VOID        *Transfer;
+  EFI_STATUS  Status;
+  UINT32      Result;
+
+  Status = UsbUas->StreamIo->SubmitTransfer (
+                               UsbUas->StreamIo,
+                               UsbUas->CommandPipe,
+                               0,
+                               Iu,
+                               IuLength,
+                               &Transfer
+                               );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = UsbUasWaitTransfer (UsbUas, Transfer, USB_UAS_SEND_IU_TIMEOUT, &Result);
+  if (EFI_ERROR (Status) && USB_IS_ERROR (Result, EFI_USB_ERR_STALL)) {
+    UsbClearEndpointStall (UsbUas->UsbIo, UsbUas->CommandPipe);
+  }
+
+  return Status;
+}
+
+/**
+  Take the transfers of a tag back from the host controller.
+
+  @param  UsbUas                The USB UAS device
+  @param  UasTag                The tag
+
+**/
+VOID
+UsbUasCancelTag (
+  IN USB_UAS_PROTOCOL  *UsbUas,
+  IN USB_UAS_TAG       *UasTag
+  )
+{
+  if (UasTag->StatusTransfer != NULL) {
+    UsbUas->StreamIo->CancelTransfer (UsbUas->StreamIo, UasTag->StatusTransfer);
+    UasTag->StatusTransfer = NULL;
+  }
+
+  if (UasTag->DataTransfer != NULL) {
+    UsbUas->StreamIo->CancelTransfer (UsbUas->StreamIo, UasTag->DataTransfer);
+    UasTag->DataTransfer = NULL;
+  }
+}
+
+/**
+  Start a command on a free tag: the status and the data transfers on the
+  streams of the tag first, so that the device finds them ready, then the
+  Command IU.
+
+  @param  UsbUas                The USB UAS device
+  @param  Tag                   The free tag
+  @param  Command               The command
+  @param  Lun                   The logical unit of the command
+
+  @retval EFI_SUCCESS           The command is started.
+  @retval Others                Failed to start the command.
+
+**/
+EFI_STATUS
+UsbUasStartCommand (
+  IN USB_UAS_PROTOCOL  *UsbUas,
+  IN UINT16            Tag,
+  IN USB_MASS_COMMAND  *Command,
+  IN UINT8             Lun
+  )
+{
+  EDKII_USB_STREAM_IO_PROTOCOL  *StreamIo;
+  USB_UAS_TAG                   *UasTag;
+  USB_UAS_COMMAND_IU            *CommandIu;
+  EFI_STATUS                    Status;
+
+  ASSERT ((Command->CmdLen > 0) && (Command->CmdLen <= USB_UAS_MAX_CDB_LEN));
+
+  StreamIo = UsbUas->StreamIo;
+  UasTag   = &UsbUas->Tags[Tag - 1];
+  ZeroMem (UasTag, sizeof (USB_UAS_TAG));
+
+  Status = StreamIo->SubmitTransfer (
+                       StreamIo,
+                       UsbUas->StatusPipe,
+                       Tag,
+                       &UasTag->StatusIu,
+                       sizeof (USB_UAS_STATUS_IU),
+                       &UasTag->StatusTransfer
+                       );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if ((Command->DataDir != EfiUsbNoData) && (Command->DataLen != 0)) {
+    UasTag->DataPipe = (Command->DataDir == EfiUsbDataIn) ? UsbUas->DataInPipe : UsbUas->DataOutPipe;
+    Status           = StreamIo->SubmitTransfer (
+                                   StreamIo,
+                                   UasTag->DataPipe,
+                                   Tag,
+                                   Command->Data,
+                                   Command->DataLen,
+                                   &UasTag->DataTransfer
+                                   );
+    if (EFI_ERROR (Status)) {
+      goto ON_ERROR;
+    }
+  }
+
+  CommandIu         = &UasTag->CommandIu;
+  CommandIu->IuId   = USB_UAS_IU_COMMAND;
+  CommandIu->Tag    = SwapBytes16 (Tag);
+  CommandIu->Lun[1] = Lun;
+  CopyMem (CommandIu->Cdb, Command->Cmd, Command->CmdLen);
+
+  Status = UsbUasSendIu (UsbUas, CommandIu, sizeof (USB_UAS_COMMAND_IU));
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "UsbUasStartCommand: failed to send the Command IU - %r\n", Status));
+    goto ON_ERROR;
+  }
+
+  UasTag->Command = Command;
+  return EFI_SUCCESS;
+
+ON_ERROR:
+  UsbUasCancelTag (UsbUas, UasTag);
+  return Status;
+}
+
+/**
+  Check the transfers of a busy tag, and end its command once they are done.
+
+  @param  UsbUas                The USB UAS device
+  @param  UasTag                The busy tag
+
+  @retval EFI_NOT_READY         The command is still running.
+  @retval EFI_SUCCESS           The command is done, with its result in its
+                                CmdStatus.
+  @retval Others                The transfers of the command failed.
+
+**/
+EFI_STATUS
+UsbUasPollTag (
+  IN USB_UAS_PROTOCOL  *UsbUas,
+  IN USB_UAS_TAG       *UasTag
+  )
+{
+  EDKII_USB_STREAM_IO_PROTOCOL  *StreamIo;
+  USB_UAS_STATUS_IU             *StatusIu;
+  EFI_STATUS                    Status;
+  UINTN                         Length;
+  UINT32                        Result;
+
+  StreamIo = UsbUas->StreamIo;
+  StatusIu = &UasTag->StatusIu;
+
+  if (UasTag->DataTransfer != NULL) {
+    Status = StreamIo->PollTransfer (StreamIo, UasTag->DataTransfer, &Length, &Result);
+    if (Status != EFI_NOT_READY) {
+      UasTag->DataTransfer = NULL;
+      if (EFI_ERROR (Status)) {
+        DEBUG ((DEBUG_ERROR, "UsbUasPollTag: data transfer failed - %r (Result = %x)\n", Status, Result));
+        UasTag->Status = Status;
+        if (USB_IS_ERROR (Result, EFI_USB_ERR_STALL)) {
+          UsbClearEndpointStall (UsbUas->UsbIo, UasTag->DataPipe);
+        }
+      }
+    }
+  }
+
+  if (UasTag->StatusTransfer != NULL) {
+    Status = StreamIo->PollTransfer (StreamIo, UasTag->StatusTransfer, &Length, &Result);
+    if (Status == EFI_NOT_READY) {
+      return EFI_NOT_READY;
+    }
+
+    UasTag->StatusTransfer = NULL;
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "UsbUasPollTag: status transfer failed - %r (Result = %x)\n", Status, Result));
+      UasTag->Status = Status;
+      if (USB_IS_ERROR (Result, EFI_USB_ERR_STALL)) {
+        UsbClearEndpointStall (UsbUas->UsbIo, UsbUas->StatusPipe);
+      }
+    } else if ((StatusIu->IuId != USB_UAS_IU_SENSE) ||
+               (SwapBytes16 (StatusIu->Tag) != (UINT16)(UasTag - UsbUas->Tags + 1)))
+    {
+      //
+      // A Response IU ends a command the device could not take.
+      //
+      DEBUG ((DEBUG_ERROR, "UsbUasPollTag: unexpected IU %x (Response code %x)\n", StatusIu->IuId, StatusIu->U.Response.ResponseCode));
+      UasTag->Status = EFI_DEVICE_ERROR;
+    } else if ((StatusIu->U.Sense.Status != USB_UAS_STATUS_GOOD) && !UsbUas->SenseValid) {
+      UsbUas->SenseValid  = TRUE;
+      UsbUas->SenseLength = MIN (SwapBytes16 (StatusIu->U.Sense.SenseLength), USB_UAS_MAX_SENSE_LEN);
+      CopyMem (UsbUas->SenseData, StatusIu->U.Sense.SenseData, UsbUas->SenseLength);
+    }
+
+    //
+    // Once the status is in, the data of a failed command will not come.
+    //
+    if (EFI_ERROR (UasTag->Status) || (StatusIu->U.Sense.Status != USB_UAS_STATUS_GOOD)) {
+      UsbUasCancelTag (UsbUas, UasTag);
+    }
+  }
+
+  if (UasTag->DataTransfer != NULL) {
+    return EFI_NOT_READY;
+  }
+
+  if (!EFI_ERROR (UasTag->Status) && (StatusIu->U.Sense.Status == USB_UAS_STATUS_GOOD)) {
+    UasTag->Command->CmdStatus = USB_MASS_CMD_SUCCESS;
+  }
+
+  return UasTag->Status;
+}
+
+/**
+  Execute several commands through the USB UAS protocol, keeping up to the
+  queue depth of them in flight on the device.
+
+  Once a command fails, no more commands are sent, and the function returns
+  when the commands in flight are done. The commands not sent keep the
+  USB_MASS_CMD_FAIL status.
+
+  @param  Context               The context of the UAS protocol, that is,
+                                USB_UAS_PROTOCOL
+  @param  Commands              The commands, with their results on return
+  @param  Count                 The number of commands
+  @param  Lun                   The number of logic unit
+  @param  Timeout               The time to wait for a command to progress
+
+  @retval EFI_SUCCESS           The commands are executed, with their results
+                                in their CmdStatus.
+  @retval Other                 Failed to execute the commands
+
+**/
+EFI_STATUS
+UsbUasExecCommands (
+  IN     VOID              *Context,
+  IN OUT USB_MASS_COMMAND  *Commands,
+  IN     UINTN             Count,
+  IN     UINT8             Lun,
+  IN     UINT32            Timeout
+  )
+{
+  USB_UAS_PROTOCOL  *UsbUas;
+  USB_UAS_TAG       *UasTag;
+  EFI_STATUS        Status;
+  EFI_STATUS        TagStatus;
+  UINTN             Next;
+  UINTN             InFlight;
+  UINT32            Remaining;
+  UINT16            Tag;
+  BOOLEAN           Failed;
+  BOOLEAN           Progress;
+
+  UsbUas = (USB_UAS_PROTOCOL *)Context;
+
+  for (Next = 0; Next < Count; Next++) {
+    Commands[Next].CmdStatus = USB_MASS_CMD_FAIL;
+  }
+
+  //
+  // The sense data is of the last command only.
+  //
+  UsbUas->SenseValid = FALSE;
+
+  Status    = EFI_SUCCESS;
+  Next      = 0;
+  InFlight  = 0;
+  Failed    = FALSE;
+  Remaining = Timeout;
+
+  while (((Next < Count) && !Failed) || (InFlight > 0)) {
+    //
+    // Give the next commands to the free tags.
+    //
+    for (Tag = 1; (Tag <= UsbUas->QueueDepth) && (Next < Count) && !Failed; Tag++) {
+      if (UsbUas->Tags[Tag - 1].Command != NULL) {
+        continue;
+      }
+
+      Status = UsbUasStartCommand (UsbUas, Tag, &Commands[Next], Lun);
+      if (EFI_ERROR (Status)) {
+        Failed = TRUE;
+        break;
+      }
+
+      Next++;
+      InFlight++;
+    }
+
+    Progress = FALSE;
+    for (Tag = 1; Tag <= UsbUas->QueueDepth; Tag++) {
+      UasTag = &UsbUas->Tags[Tag - 1];
+      if (UasTag->Command == NULL) {
+        continue;
+      }
+
+      TagStatus = UsbUasPollTag (UsbUas, UasTag);
+      if (TagStatus == EFI_NOT_READY) {
+        continue;
+      }
+
+      if (EFI_ERROR (TagStatus)) {
+        Status = TagStatus;
+      }
+
+      if (UasTag->Command->CmdStatus != USB_MASS_CMD_SUCCESS) {
+        Failed = TRUE;
+      }
+
+      UasTag->Command = NULL;
+      InFlight--;
+      Progress = TRUE;
+    }
+
+    if (Progress) {
+      Remaining = Timeout;
+    } else if (InFlight > 0) {
+      if (Remaining < USB_UAS_POLL_INTERVAL) {
+        //
+        // Take the commands back, and make the device drop them too, so
+        // that their tags are free again.
+        //
+        DEBUG ((DEBUG_ERROR, "UsbUasExecCommands: %d commands timed out\n", InFlight));
+        for (Tag = 1; Tag <= UsbUas->QueueDepth; Tag++) {
+          UasTag = &UsbUas->Tags[Tag - 1];
+          if (UasTag->Command != NULL) {
+            UsbUasCancelTag (UsbUas, UasTag);
+            UasTag->Command = NULL;
+          }
+        }
+
+        UsbUasResetDevice (UsbUas, FALSE);
+        return EFI_TIMEOUT;
+      }
+
+      gBS->Stall (USB_UAS_POLL_INTERVAL);
+      Remaining -= USB_UAS_POLL_INTERVAL;
+    }
+  }
+
+  return Status;
+}
+
+/**
+  Execute a command through the USB UAS protocol.
+
+  @param  Context               The context of the UAS protocol, that is,
+                                USB_UAS_PROTOCOL
+  @param  Cmd                   The high level command
+  @param  CmdLen                The command length
+  @param  DataDir               The direction of the data transfer
+  @param  Data                  The buffer to hold data
+  @param  DataLen               The length of the data
+  @param  Lun                   The number of logic unit
+  @param  Timeout               The time to wait command
+  @param  CmdStatus             The result of high level command execution
+
+  @retval EFI_SUCCESS           The command is executed, with its result in
+                                CmdStatus.
+  @retval Other                 Failed to execute command
+
+**/
+EFI_STATUS
+UsbUasExecCommand (
+  IN  VOID                    *Context,
+  IN  VOID                    *Cmd,
+  IN  UINT8                   CmdLen,
+  IN  EFI_USB_DATA_DIRECTION  DataDir,
+  IN  VOID                    *Data,
+  IN  UINT32                  DataLen,
+  IN  UINT8                   Lun,
+  IN  UINT32                  Timeout,
+  OUT UINT32                  *CmdStatus
+  )
+{
+  USB_UAS_PROTOCOL  *UsbUas;
+  USB_MASS_COMMAND  Command;
+  EFI_STATUS        Status;
+
+  UsbUas = (USB_UAS_PROTOCOL *)Context;
+
+  //
+  // The device returns the sense data in the Sense IU of the failed command
+  // and drops it. Answer the REQUEST SENSE that follows from the saved copy.
+  //
+  if ((*(UINT8 *)Cmd == USB_BOOT_REQUEST_SENSE_OPCODE) && UsbUas->SenseValid && (DataDir == EfiUsbDataIn)) {
+    ZeroMem (Data, DataLen);
+    CopyMem (Data, UsbUas->SenseData, MIN (DataLen, UsbUas->SenseLength));
+    UsbUas->SenseValid = FALSE;
+    *CmdStatus         = USB_MASS_CMD_SUCCESS;
+    return EFI_SUCCESS;
+  }
+
+  Command.Cmd     = Cmd;
+  Command.CmdLen  = CmdLen;
+  Command.DataDir = DataDir;
+  Command.Data    = Data;
+  Command.DataLen = DataLen;
+
+  Status     = UsbUasExecCommands (Context, &Command, 1, Lun, Timeout);
+  *CmdStatus = Command.CmdStatus;
+  return Status;
+}
+
+/**
+  Reset the logical unit by the LOGICAL UNIT RESET task management function.
+
+  @param  Context               The context of the UAS protocol, that is,
+                                USB_UAS_PROTOCOL.
+  @param  ExtendedVerification  Not used. A port reset would take the
+                                streams of the endpoints away.
+
+  @retval EFI_SUCCESS           The device is reset.
+  @retval Others                Failed to reset the device.
+
+**/
+EFI_STATUS
+UsbUasResetDevice (
+  IN  VOID     *Context,
+  IN  BOOLEAN  ExtendedVerification
+  )
+{
+  USB_UAS_PROTOCOL        *UsbUas;
+  USB_UAS_TAG             *UasTag;
+  USB_UAS_TASK_MANAGE_IU  TaskIu;
+  EFI_STATUS              Status;
+  UINT32                  Result;
+
+  UsbUas = (USB_UAS_PROTOCOL *)Context;
+
+  //
+  // No command is in flight between two calls, so the first tag is free.
+  //
+  UasTag = &UsbUas->Tags[0];
+  ZeroMem (UasTag, sizeof (USB_UAS_TAG));
+
+  Status = UsbUas->StreamIo->SubmitTransfer (
+                               UsbUas->StreamIo,
+                               UsbUas->StatusPipe,
+                               1,
+                               &UasTag->StatusIu,
+                               sizeof (USB_UAS_STATUS_IU),
+                               &UasTag->StatusTransfer
+                               );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  ZeroMem (&TaskIu, sizeof (TaskIu));
+  TaskIu.IuId     = USB_UAS_IU_TASK_MANAGE;
+  TaskIu.Tag      = SwapBytes16 (1);
+  TaskIu.Function = USB_UAS_TMF_LOGICAL_UNIT_RESET;
+
+  Status = UsbUasSendIu (UsbUas, &TaskIu, sizeof (TaskIu));
+  if (EFI_ERROR (Status)) {
+    UsbUasCancelTag (UsbUas, UasTag);
+    return Status;
+  }
+
+  Status                 = UsbUasWaitTransfer (UsbUas, UasTag->StatusTransfer, USB_UAS_TASK_MANAGE_TIMEOUT, &Result);
+  UasTag->StatusTransfer = NULL;
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "UsbUasResetDevice: no response - %r\n", Status));
+    return Status;
+  }
+
+  if ((UasTag->StatusIu.IuId != USB_UAS_IU_RESPONSE) ||
+      ((UasTag->StatusIu.U.Response.ResponseCode != USB_UAS_RC_TMF_COMPLETE) &&
+       (UasTag->StatusIu.U.Response.ResponseCode != USB_UAS_RC_TMF_SUCCEEDED)))
+  {
+    return EFI_DEVICE_ERROR;
+  }
+
+  UsbUas->SenseValid = FALSE;
+  return EFI_SUCCESS;
+}
+
+/**
+  Get the max LUN (Logical Unit Number) of the USB UAS device. Only the first
+  logical unit is used.
+
+  @param  Context          The context of the UAS protocol, that is, USB_UAS_PROTOCOL
+  @param  MaxLun           Return pointer to the max number of LUN, that is 0.
+
+  @retval EFI_SUCCESS      Max LUN is got successfully.
+
+**/
+EFI_STATUS
+UsbUasGetMaxLun (
+  IN  VOID   *Context,
+  OUT UINT8  *MaxLun
+  )
+{
+  *MaxLun = 0;
+  return EFI_SUCCESS;
+}
+
+/**
+  Clean up the resource used by this UAS protocol, and put the interface
+  back on its first alternate setting.
+
+  @param  Context         The context of the UAS protocol, that is, USB_UAS_PROTOCOL.
+
+  @retval EFI_SUCCESS     The resource is cleaned up.
+
+**/
+EFI_STATUS
+UsbUasCleanUp (
+  IN  VOID  *Context
+  )
+{
+  USB_UAS_PROTOCOL  *UsbUas;
+
+  UsbUas = (USB_UAS_PROTOCOL *)Context;
+
+  UsbUas->StreamIo->FreeStreams (UsbUas->StreamIo, UsbUas->StatusPipe);
+  UsbUas->StreamIo->FreeStreams (UsbUas->StreamIo, UsbUas->DataInPipe);
+  UsbUas->StreamIo->FreeStreams (UsbUas->StreamIo, UsbUas->DataOutPipe);
+  UsbUasSelectSetting (UsbUas->UsbIo, UsbUas->Interface.InterfaceNumber, UsbUas->DefaultSetting);
+
+  FreePool (UsbUas->Tags);
+  FreePool (UsbUas);
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,289 @@
+/** @file
+  Definition for the USB Attached SCSI (UAS) transport, according to
+  "Universal Serial Bus Mass Storage Class USB Attached SCSI Protocol"
+  Revision 1.0 and the SCSI "USB Attached SCSI" (T10/2095-D) standard.
+
+  UAS sends the SCSI commands on a command pipe and gets their data and
+  status on the bulk streams of the data-in, data-out and status pipes, one
+  stream for each tag, so a device runs several commands at once. It needs
+  the host controller to give streams to the SuperSpeed bulk endpoints of
+  the interface, through the EDKII_USB_STREAM_IO_PROTOCOL.
+
+Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef _EFI_USBMASS_UAS_H_
+#define _EFI_USBMASS_UAS_H_
+
+extern USB_MASS_TRANSPORT  mUsbUasTransport;
+
+#define USB_MASS_STORE_UAS  0x62          ///< USB Attached SCSI
+
+//
+// UAS class specific descriptors
+//
+#define USB_UAS_DESC_TYPE_PIPE_USAGE      0x24
+#define USB_UAS_DESC_TYPE_SS_COMPANION    0x30
+#define USB_UAS_PIPE_ID_COMMAND           0x01
+#define USB_UAS_PIPE_ID_STATUS            0x02
+#define USB_UAS_PIPE_ID_DATA_IN           0x03
+#define USB_UAS_PIPE_ID_DATA_OUT          0x04
+#define USB_UAS_SS_COMPANION_MAX_STREAMS  0x1F    ///< bmAttributes, log2 of the streams
+
+//
+// Information Unit IDs
+//
+#define USB_UAS_IU_COMMAND      0x01
+#define USB_UAS_IU_SENSE        0x03
+#define USB_UAS_IU_RESPONSE     0x04
+#define USB_UAS_IU_TASK_MANAGE  0x05
+
+#define USB_UAS_TMF_LOGICAL_UNIT_RESET  0x08
+#define USB_UAS_RC_TMF_COMPLETE         0x00
+#define USB_UAS_RC_TMF_SUCCEEDED        0x08
+
+#define USB_UAS_STATUS_GOOD  0x00
+
+#define USB_UAS_MAX_CDB_LEN    16
+#define USB_UAS_MAX_SENSE_LEN  252
+
+//
+// The most commands kept in flight on the device, set by experience. A tag
+// is a stream ID, from 1 to the queue depth.
+//
+#define USB_UAS_MAX_QUEUE_DEPTH  32
+
+//
+// Time to wait for the command pipe and for a task management function,
+// and the interval of polling the transfers, set by experience
+//
+#define USB_UAS_SEND_IU_TIMEOUT      (3 * USB_MASS_1_SECOND)
+#define USB_UAS_TASK_MANAGE_TIMEOUT  (3 * USB_MASS_1_SECOND)
+#define USB_UAS_POLL_INTERVAL        10
+
+#pragma pack(1)
+///
+/// The Command IU, with a CDB of up to 16 bytes.
+///
+typedef struct {
+  UINT8     IuId;
+  UINT8     Reserved1;
+  UINT16    Tag;                ///< Big endian
+  UINT8     TaskAttribute;
+  UINT8     Reserved2;
+  UINT8     AddCdbLength;
+  UINT8     Reserved3;
+  UINT8     Lun[8];
+  UINT8     Cdb[USB_UAS_MAX_CDB_LEN];
+} USB_UAS_COMMAND_IU;
+
+///
+/// The Task Management IU.
+///
+typedef struct {
+  UINT8     IuId;
+  UINT8     Reserved1;
+  UINT16    Tag;                ///< Big endian
+  UINT8     Function;
+  UINT8     Reserved2;
+  UINT16    TaskTag;            ///< Big endian
+  UINT8     Lun[8];
+} USB_UAS_TASK_MANAGE_IU;
+
+///
+/// The Sense IU that ends a command, or the Response IU that ends a task
+/// management function. Both come on the status pipe.
+///
+typedef struct {
+  UINT8     IuId;
+  UINT8     Reserved1;
+  UINT16    Tag;                ///< Big endian
+  union {
+    struct {
+      UINT16    StatusQualifier;
+      UINT8     Status;
+      UINT8     Reserved[7];
+      UINT16    SenseLength;    ///< Big endian
+      UINT8     SenseData[USB_UAS_MAX_SENSE_LEN];
+    } Sense;
+    struct {
+      UINT8    AdditionalInfo[3];
+      UINT8    ResponseCode;
+    } Response;
+  } U;
+} USB_UAS_STATUS_IU;
+#pragma pack()
+
+///
+/// A tag of the device, with the transfers of the command it runs.
+///
+typedef struct {
+  USB_UAS_STATUS_IU     StatusIu;
+  USB_UAS_COMMAND_IU    CommandIu;
+  USB_MASS_COMMAND      *Command;
+  VOID                  *StatusTransfer;
+  VOID                  *DataTransfer;
+  UINT8                 DataPipe;
+  EFI_STATUS            Status;           ///< Error of the transfers of the command
+} USB_UAS_TAG;
+
+typedef struct {
+  //
+  // Put Interface at the first field to make it easy to distinguish BOT/CBI/UAS Protocol instance
+  //
+  EFI_USB_INTERFACE_DESCRIPTOR    Interface;
+  EFI_USB_IO_PROTOCOL             *UsbIo;
+  EDKII_USB_STREAM_IO_PROTOCOL    *StreamIo;
+  UINT8                           DefaultSetting; ///< Alternate setting to go back to
+  UINT8                           CommandPipe;
+  UINT8                           StatusPipe;
+  UINT8                           DataInPipe;
+  UINT8                           DataOutPipe;
+  UINT16                          QueueDepth;
+  USB_UAS_TAG                     *Tags;        ///< Tags[Tag - 1]
+
+  //
+  // The sense data of the first failed command since the last REQUEST SENSE,
+  // which UAS returns in the Sense IU instead of keeping it in the device.
+  //
+  BOOLEAN                         SenseValid;
+  UINT16                          SenseLength;
+  UINT8                           SenseData[USB_UAS_MAX_SENSE_LEN];
+} USB_UAS_PROTOCOL;
+
+/**
+  Initializes the USB UAS protocol.
+
+  This function looks for an alternate setting of the interface with the
+  UAS protocol, selects it and gives streams to its pipes. It will save its
+  context which is a USB_UAS_PROTOCOL structure in the Context if Context
+  isn't NULL; otherwise it only checks the device, and changes nothing.
+
+  @param  UsbIo                 The USB I/O Protocol instance
+  @param  Context               The buffer to save the context to
+
+  @retval EFI_SUCCESS           The device is successfully initialized.
+  @retval EFI_UNSUPPORTED       The device or the host controller doesn't
+                                support UAS. The interface is left on its
+                                first alternate setting.
+  @retval Other                 The USB UAS initialization fails.
+
+**/
+EFI_STATUS
+UsbUasInit (
+  IN  EFI_USB_IO_PROTOCOL  *UsbIo,
+  OUT VOID                 **Context OPTIONAL
+  );
+
+/**
+  Execute a command through the USB UAS protocol.
+
+  @param  Context               The context of the UAS protocol, that is,
+                                USB_UAS_PROTOCOL
+  @param  Cmd                   The high level command
+  @param  CmdLen                The command length
+  @param  DataDir               The direction of the data transfer
+  @param  Data                  The buffer to hold data
+  @param  DataLen               The length of the data
+  @param  Lun                   The number of logic unit
+  @param  Timeout               The time to wait command
+  @param  CmdStatus             The result of high level command execution
+
+  @retval EFI_SUCCESS           The command is executed, with its result in
+                                CmdStatus.
+  @retval Other                 Failed to execute command
+
+**/
+EFI_STATUS
+UsbUasExecCommand (
+  IN  VOID                    *Context,
+  IN  VOID                    *Cmd,
+  IN  UINT8                   CmdLen,
+  IN  EFI_USB_DATA_DIRECTION  DataDir,
+  IN  VOID                    *Data,
+  IN  UINT32                  DataLen,
+  IN  UINT8                   Lun,
+  IN  UINT32                  Timeout,
+  OUT UINT32                  *CmdStatus
+  );
+
+/**
+  Execute several commands through the USB UAS protocol, keeping up to the
+  queue depth of them in flight on the device.
+
+  Once a command fails, no more commands are sent, and the function returns
+  when the commands in flight are done. The commands not sent keep the
+  USB_MASS_CMD_FAIL status.
+
+  @param  Context               The context of the UAS protocol, that is,
+                                USB_UAS_PROTOCOL
+  @param  Commands              The commands, with their results on return
+  @param  Count                 The number of commands
+  @param  Lun                   The number of logic unit
+  @param  Timeout               The time to wait for a command to progress
+
+  @retval EFI_SUCCESS           The commands are executed, with their results
+                                in their CmdStatus.
+  @retval Other                 Failed to execute the commands
+
+**/
+EFI_STATUS
+UsbUasExecCommands (
+  IN     VOID              *Context,
+  IN OUT USB_MASS_COMMAND  *Commands,
+  IN     UINTN             Count,
+  IN     UINT8             Lun,
+  IN     UINT32            Timeout
+  );
+
+/**
+  Reset the logical unit by the LOGICAL UNIT RESET task management function.
+
+  @param  Context               The context of the UAS protocol, that is,
+                                USB_UAS_PROTOCOL.
+  @param  ExtendedVerification  Not used. A port reset would take the
+                                streams of the endpoints away.
+
+  @retval EFI_SUCCESS           The device is reset.
+  @retval Others                Failed to reset the device.
+
+**/
+EFI_STATUS
+UsbUasResetDevice (
+  IN  VOID     *Context,
+  IN  BOOLEAN  ExtendedVerification
+  );
+
+/**
+  Get the max LUN (Logical Unit Number) of the USB UAS device. Only the first
+  logical unit is used.
+
+  @param  Context          The context of the UAS protocol, that is, USB_UAS_PROTOCOL
+  @param  MaxLun           Return pointer to the max number of LUN, that is 0.
+
+  @retval EFI_SUCCESS      Max LUN is got successfully.
+
+**/
+EFI_STATUS
+UsbUasGetMaxLun (
+  IN  VOID   *Context,
+  OUT UINT8  *MaxLun
+  );
+
+/**
+  Clean up the resource used by this UAS protocol, and put the interface
+  back on its first alternate setting.
+
+  @param  Context         The context of the UAS protocol, that is, USB_UAS_PROTOCOL.
+
+  @retval EFI_SUCCESS     The resource is cleaned up.
+
+**/
+EFI_STATUS
+UsbUasCleanUp (
+  IN  VOID  *Context
+  );
+
+#endif
@@ -45,6 +45,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <Protocol/HiiPackageList.h>
 #include <Protocol/SmmBase2.h>
 #include <Protocol/PeCoffImageEmulator.h>
+#include <Protocol/TimerDeadline.h>
 #include <Guid/MemoryTypeInformation.h>
 #include <Guid/FirmwareFileSystem2.h>
 #include <Guid/FirmwareFileSystem3.h>
@@ -85,6 +86,8 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <Library/DebugAgentLib.h>
 #include <Library/CpuExceptionHandlerLib.h>
 
+#include "Library/RangeIndex.h"
+
 //
 // attributes for reserved memory before it is promoted to system memory
 //
@@ -177,6 +180,7 @@ typedef struct {
   EFI_GCD_IO_TYPE         GcdIoType;
   EFI_HANDLE              ImageHandle;
   EFI_HANDLE              DeviceHandle;
+  RANGE_INDEX_NODE        IndexNode;
 } EFI_GCD_MAP_ENTRY;
 
 #define LOADED_IMAGE_PRIVATE_DATA_SIGNATURE  SIGNATURE_32('l','d','r','i')
@@ -439,6 +443,17 @@ CalculateEfiHdrCrc (
   IN  OUT EFI_TABLE_HEADER  *Hdr
   );
 
+/**
+  Connects the timer driver to the timer database if it can skip the ticks
+  in between timer events. Called when the Timer Architectural Protocol is
+  installed.
+
+**/
+VOID
+CoreConnectTimerDeadline (
+  VOID
+  );
+
 /**
   Called by the platform code to process a tick.
 
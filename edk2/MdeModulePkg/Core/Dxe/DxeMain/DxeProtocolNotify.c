@@ -153,6 +153,11 @@ GenericProtocolNotify (
     // Register the Core timer tick handler with the Timer AP
     //
     gTimer->RegisterHandler (gTimer, CoreTimerTick);
+
+    //
+    // Tell the timer driver when timer events are due if it can skip ticks
+    //
+    CoreConnectTimerDeadline ();
   }
 
   if (CompareGuid (Entry->ProtocolGuid, &gEfiRuntimeArchProtocolGuid)) {
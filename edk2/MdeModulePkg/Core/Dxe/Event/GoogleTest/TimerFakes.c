@@ -0,0 +1,153 @@
+/** @file
+  Fakes of the services of the DXE core that Timer.c calls and the host test
+  does not build: creating and signaling events, which only counts the
+  signals, and locating the Timer Deadline Protocol, which returns the one
+  the test hands over. The locks are the ones of Library.c, the TPL the one
+  of UnitTestUefiBootServicesTableLib.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "DxeMain.h"
+#include "Event.h"
+
+EFI_TIMER_ARCH_PROTOCOL  *gTimer = NULL;
+
+BOOLEAN                        mTimerFakeCheckPending;
+EDKII_TIMER_DEADLINE_PROTOCOL  *mTimerFakeDeadline;
+
+STATIC IEVENT  mTimerFakeCheckEvent;
+STATIC IEVENT  *mTimerFakeEvents;
+STATIC UINTN   *mTimerFakeSignals;
+STATIC UINTN   mTimerFakeCount;
+
+EFI_TPL
+EFIAPI
+CoreRaiseTpl (
+  IN EFI_TPL  NewTpl
+  )
+{
+  return gBS->RaiseTPL (NewTpl);
+}
+
+VOID
+EFIAPI
+CoreRestoreTpl (
+  IN EFI_TPL  NewTpl
+  )
+{
+  gBS->RestoreTPL (NewTpl);
+}
+
+//
+// The test hands the Timer Deadline Protocol over directly. Installing it in
+// the protocol database of UnitTestUefiBootServicesTableLib logs through
+// UnitTestLib, which needs a running framework a GoogleTest main does not
+// have.
+//
+EFI_STATUS
+EFIAPI
+CoreLocateProtocol (
+  IN  EFI_GUID  *Protocol,
+  IN  VOID      *Registration OPTIONAL,
+  OUT VOID      **Interface
+  )
+{
+  if (!CompareGuid (Protocol, &gEdkiiTimerDeadlineProtocolGuid) || (mTimerFakeDeadline == NULL)) {
+    return EFI_NOT_FOUND;
+  }
+
+  *Interface = mTimerFakeDeadline;
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+CoreCreateEventInternal (
+  IN UINT32            Type,
+  IN EFI_TPL           NotifyTpl,
+  IN EFI_EVENT_NOTIFY  NotifyFunction  OPTIONAL,
+  IN CONST VOID        *NotifyContext  OPTIONAL,
+  IN CONST EFI_GUID    *EventGroup     OPTIONAL,
+  OUT EFI_EVENT        *Event
+  )
+{
+  mTimerFakeCheckEvent.Signature = EVENT_SIGNATURE;
+  mTimerFakeCheckEvent.Type      = Type;
+  *Event                         = &mTimerFakeCheckEvent;
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+CoreSignalEvent (
+  IN EFI_EVENT  UserEvent
+  )
+{
+  IEVENT  *Event;
+
+  Event = UserEvent;
+  if (Event == &mTimerFakeCheckEvent) {
+    mTimerFakeCheckPending = TRUE;
+  } else {
+    ASSERT (Event >= mTimerFakeEvents && Event < mTimerFakeEvents + mTimerFakeCount);
+    mTimerFakeSignals[Event - mTimerFakeEvents]++;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Create the timer events of the test and initialize the timer database.
+
+  @param  Count                  The number of timer events.
+
+**/
+VOID
+TimerFakeInitialize (
+  IN UINTN  Count
+  )
+{
+  UINTN  Index;
+
+  mTimerFakeEvents  = AllocateZeroPool (Count * sizeof (IEVENT));
+  mTimerFakeSignals = AllocateZeroPool (Count * sizeof (UINTN));
+  ASSERT (mTimerFakeEvents != NULL && mTimerFakeSignals != NULL);
+  mTimerFakeCount = Count;
+
+  for (Index = 0; Index < Count; Index++) {
+    mTimerFakeEvents[Index].Signature = EVENT_SIGNATURE;
+    mTimerFakeEvents[Index].Type      = EVT_TIMER | EVT_NOTIFY_SIGNAL;
+  }
+
+  CoreInitializeTimer ();
+}
+
+/**
+  Return a timer event of the test.
+
+  @param  Index                  The index of the event.
+
+**/
+EFI_EVENT
+TimerFakeEvent (
+  IN UINTN  Index
+  )
+{
+  return &mTimerFakeEvents[Index];
+}
+
+/**
+  Return the number of times a timer event of the test was signaled.
+
+  @param  Index                  The index of the event.
+
+**/
+UINTN
+TimerFakeSignalCount (
+  IN UINTN  Index
+  )
+{
+  return mTimerFakeSignals[Index];
+}
@@ -0,0 +1,456 @@
+/** @file
+  Host test of the timer database of the DXE core.
+
+  Timer.c runs on top of the fake events of TimerFakes.c and a fake timer
+  driver that produces the Timer Deadline Protocol. Timers are armed,
+  re-armed and canceled at random, between ticks as well as on them, while
+  the clock of the driver moves in periodic ticks and in the jumps a tickless
+  timer driver makes to the deadline it was given. The signals are compared
+  with a sorted model of the timers on the clock of the driver, and every
+  deadline is checked not to pass the earliest armed timer.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+#include <Library/GoogleTestLib.h>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+extern "C" {
+  #include <Uefi.h>
+  #include <Library/BaseLib.h>
+  #include <Protocol/TimerDeadline.h>
+
+  //
+  // Set when the DXE core signals its timer check event
+  //
+  extern BOOLEAN  mTimerFakeCheckPending;
+
+  //
+  // The Timer Deadline Protocol CoreLocateProtocol () returns
+  //
+  extern EDKII_TIMER_DEADLINE_PROTOCOL  *mTimerFakeDeadline;
+
+  VOID
+  TimerFakeInitialize (
+    IN UINTN  Count
+    );
+
+  EFI_EVENT
+  TimerFakeEvent (
+    IN UINTN  Index
+    );
+
+  UINTN
+  TimerFakeSignalCount (
+    IN UINTN  Index
+    );
+
+  VOID
+  CoreConnectTimerDeadline (
+    VOID
+    );
+
+  EFI_STATUS
+  EFIAPI
+  CoreSetTimer (
+    IN EFI_EVENT        UserEvent,
+    IN EFI_TIMER_DELAY  Type,
+    IN UINT64           TriggerTime
+    );
+
+  VOID
+  EFIAPI
+  CoreTimerTick (
+    IN UINT64  Duration
+    );
+
+  VOID
+  EFIAPI
+  CoreCheckTimers (
+    IN EFI_EVENT  CheckEvent,
+    IN VOID       *Context
+    );
+}
+
+using namespace testing;
+
+#define TIMER_EVENTS      512
+#define TIMER_OPERATIONS  200000
+#define TIMER_TICK        100000
+
+//
+// The clock of the fake timer driver, the time of its last tick, and the
+// last deadline the DXE core gave it with the time it was given at
+//
+STATIC UINT64  mClock;
+STATIC UINT64  mLastTick;
+STATIC UINT64  mDeadline;
+STATIC UINT64  mDeadlineTime;
+
+STATIC
+EFI_STATUS
+EFIAPI
+FakeSetDeadline (
+  IN EDKII_TIMER_DEADLINE_PROTOCOL  *This,
+  IN UINT64                         Deadline
+  )
+{
+  mDeadline     = Deadline;
+  mDeadlineTime = mClock;
+  return EFI_SUCCESS;
+}
+
+STATIC
+UINT64
+EFIAPI
+FakeGetElapsed (
+  IN EDKII_TIMER_DEADLINE_PROTOCOL  *This
+  )
+{
+  return mClock - mLastTick;
+}
+
+STATIC EDKII_TIMER_DEADLINE_PROTOCOL  mFakeTimerDeadline = {
+  FakeSetDeadline,
+  FakeGetElapsed
+};
+
+typedef struct {
+  BOOLEAN    Armed;
+  UINT64     TriggerTime;
+  UINT64     Period;
+  UINTN      Signals;
+} MODEL_TIMER;
+
+class TimerWheelTest : public Test {
+protected:
+  std::vector<MODEL_TIMER>    Model;
+  UINT32                      Seed;
+
+  static VOID
+  SetUpTestSuite (
+    )
+  {
+    TimerFakeInitialize (TIMER_EVENTS);
+
+    mTimerFakeDeadline = &mFakeTimerDeadline;
+    CoreConnectTimerDeadline ();
+  }
+
+  VOID
+  SetUp (
+    ) override
+  {
+    UINTN  Index;
+
+    //
+    // Start from an empty timer database
+    //
+    for (Index = 0; Index < TIMER_EVENTS; Index++) {
+      ASSERT_EQ (CoreSetTimer (TimerFakeEvent (Index), TimerCancel, 0), EFI_SUCCESS);
+    }
+
+    Model.assign (TIMER_EVENTS, MODEL_TIMER ());
+    for (Index = 0; Index < TIMER_EVENTS; Index++) {
+      Model[Index].Signals = TimerFakeSignalCount (Index);
+    }
+
+    Seed = 0x2545F491;
+  }
+
+  UINT32
+  Random (
+    VOID
+    )
+  {
+    Seed = Seed * 1103515245 + 12345;
+    return Seed >> 8;
+  }
+
+  UINT64
+  Random64 (
+    VOID
+    )
+  {
+    return LShiftU64 (Random (), 24) | Random ();
+  }
+
+  //
+  // Mostly short timers: 60% up to 20 ms, 30% up to 10 s and 10% up to
+  // 55 hours, past the reach of the top level of the wheel
+  //
+  UINT64
+  RandomDelay (
+    VOID
+    )
+  {
+    UINT32  Class;
+
+    Class = Random () % 100;
+    if (Class < 60) {
+      return Random () % 200000;
+    } else if (Class < 90) {
+      return Random () % 100000000;
+    }
+
+    return Random64 () % 2000000000000ULL;
+  }
+
+  UINT64
+  EarliestTrigger (
+    VOID
+    )
+  {
+    UINT64  Earliest;
+    UINTN   Index;
+
+    Earliest = MAX_UINT64;
+    for (Index = 0; Index < TIMER_EVENTS; Index++) {
+      if (Model[Index].Armed) {
+        Earliest = MIN (Earliest, Model[Index].TriggerTime);
+      }
+    }
+
+    return Earliest;
+  }
+
+  VOID
+  ModelSetTimer (
+    IN UINTN            Index,
+    IN EFI_TIMER_DELAY  Type,
+    IN UINT64           TriggerTime
+    )
+  {
+    ASSERT_EQ (CoreSetTimer (TimerFakeEvent (Index), Type, TriggerTime), EFI_SUCCESS);
+
+    Model[Index].Armed       = (Type != TimerCancel);
+    Model[Index].TriggerTime = mClock + TriggerTime;
+    Model[Index].Period      = (Type == TimerPeriodic) ? TriggerTime : 0;
+  }
+
+  //
+  // A timer fires on the first check of the timers at or after its trigger
+  // time. A periodic timer that is behind fires again on the next check.
+  //
+  VOID
+  ModelCheckTimers (
+    VOID
+    )
+  {
+    UINT64  SystemTime;
+    UINTN   Index;
+
+    SystemTime = mClock;
+    for (Index = 0; Index < TIMER_EVENTS; Index++) {
+      if (!Model[Index].Armed || (Model[Index].TriggerTime > SystemTime)) {
+        continue;
+      }
+
+      Model[Index].Signals++;
+      if (Model[Index].Period == 0) {
+        Model[Index].Armed = FALSE;
+      } else {
+        Model[Index].TriggerTime += Model[Index].Period;
+        if (Model[Index].TriggerTime <= SystemTime) {
+          Model[Index].TriggerTime = SystemTime;
+        }
+      }
+    }
+  }
+
+  //
+  // Let time pass without a tick, as a tickless timer driver does while it
+  // waits for its deadline
+  //
+  VOID
+  Idle (
+    IN UINT64  Duration
+    )
+  {
+    mClock += Duration;
+  }
+
+  //
+  // Let time pass and tick. The driver restarts its period before it calls
+  // the DXE core, the check event runs once the tick returns.
+  //
+  VOID
+  Tick (
+    IN UINT64  Duration
+    )
+  {
+    UINT64  Elapsed;
+
+    mClock   += Duration;
+    Elapsed   = mClock - mLastTick;
+    mLastTick = mClock;
+    CoreTimerTick (Elapsed);
+    while (mTimerFakeCheckPending) {
+      mTimerFakeCheckPending = FALSE;
+      CoreCheckTimers (NULL, NULL);
+      ModelCheckTimers ();
+    }
+  }
+
+  VOID
+  CheckModel (
+    VOID
+    )
+  {
+    UINT64  Earliest;
+    UINTN   Index;
+
+    for (Index = 0; Index < TIMER_EVENTS; Index++) {
+      ASSERT_EQ (TimerFakeSignalCount (Index), Model[Index].Signals) << "event " << Index;
+    }
+
+    //
+    // Nothing is left behind once the timers are checked, and the timer
+    // driver is never told to wait past the earliest timer. A deadline may
+    // be early, as canceling a timer does not move it.
+    //
+    Earliest = EarliestTrigger ();
+    ASSERT_GT (Earliest, mClock);
+    if (Earliest != MAX_UINT64) {
+      ASSERT_NE (mDeadline, 0ULL);
+      ASSERT_LE (mDeadlineTime + mDeadline, Earliest);
+    }
+  }
+};
+
+TEST_F (TimerWheelTest, RandomTimers) {
+  UINTN   Operation;
+  UINTN   Index;
+  UINT32  Class;
+  UINT64  Due;
+
+  for (Operation = 0; Operation < TIMER_OPERATIONS; Operation++) {
+    if (Random () % 2 == 0) {
+      Idle (Random () % TIMER_TICK);
+    }
+
+    Index = Random () % TIMER_EVENTS;
+    Class = Random () % 100;
+    if (Class < 50) {
+      ModelSetTimer (Index, TimerRelative, RandomDelay ());
+    } else if (Class < 60) {
+      ModelSetTimer (Index, TimerPeriodic, RandomDelay () + 1);
+    } else if (Class < 70) {
+      ModelSetTimer (Index, TimerCancel, 0);
+    }
+
+    //
+    // Tick like a periodic timer driver, or skip to the deadline like a
+    // tickless one
+    //
+    Class = Random () % 100;
+    if (Class < 50) {
+      Tick (TIMER_TICK);
+    } else if (Class < 90) {
+      Due = mDeadlineTime + mDeadline;
+      Tick ((mDeadline != 0 && Due > mClock) ? Due - mClock : TIMER_TICK);
+    } else {
+      Tick (Random64 () % 10000000000ULL);
+    }
+
+    CheckModel ();
+    if (HasFatalFailure ()) {
+      return;
+    }
+  }
+}
+
+TEST_F (TimerWheelTest, TicklessIdle) {
+  UINTN   Index;
+  UINTN   Wakeups;
+  UINT64  Due;
+
+  //
+  // A few long periodic timers: the timer driver only wakes up for them
+  //
+  for (Index = 0; Index < 8; Index++) {
+    ModelSetTimer (Index, TimerPeriodic, 10000000 * (Index + 1));
+  }
+
+  for (Wakeups = 0; Wakeups < 10000; Wakeups++) {
+    ASSERT_NE (mDeadline, 0ULL);
+    Due = mDeadlineTime + mDeadline;
+    Tick ((Due > mClock) ? Due - mClock : 1);
+    CheckModel ();
+    if (HasFatalFailure ()) {
+      return;
+    }
+  }
+
+  //
+  // Every wake up but the ones for the higher levels of the wheel fires a
+  // timer
+  //
+  ASSERT_GE (Model[0].Signals, Wakeups / 4);
+}
+
+TEST_F (TimerWheelTest, ArmBetweenTicks) {
+  UINTN  Signals;
+
+  //
+  // The driver has idled for 900 ms since its last tick when a 10 ms timer
+  // is armed. The timer counts from the actual time, so the driver is told
+  // to come back within 10 ms, and neither a tick 5 ms later nor one at the
+  // old system time fires it. The first tick lets the check of the timers
+  // run past the deadlines the canceled timers left behind.
+  //
+  Tick (10000000);
+  Tick (TIMER_TICK);
+  Idle (9000000);
+  ModelSetTimer (0, TimerRelative, 100000);
+  Signals = Model[0].Signals;
+  ASSERT_EQ (mDeadlineTime, mClock);
+  ASSERT_NE (mDeadline, 0ULL);
+  ASSERT_LE (mDeadline, 100000ULL);
+
+  Tick (50000);
+  CheckModel ();
+  ASSERT_EQ (TimerFakeSignalCount (0), Signals);
+
+  Tick (50000);
+  CheckModel ();
+  ASSERT_EQ (TimerFakeSignalCount (0), Signals + 1);
+}
+
+TEST_F (TimerWheelTest, RearmBenchmark) {
+  UINTN  Index;
+  UINTN  Round;
+
+  for (Index = 0; Index < TIMER_EVENTS; Index++) {
+    ModelSetTimer (Index, TimerRelative, 10000000 + Random () % 100000000);
+  }
+
+  auto  Start = std::chrono::steady_clock::now ();
+  for (Round = 0; Round < 1000; Round++) {
+    for (Index = 0; Index < TIMER_EVENTS; Index++) {
+      ModelSetTimer (Index, TimerRelative, 10000000 + Random () % 100000000);
+    }
+  }
+
+  auto  Elapsed = std::chrono::steady_clock::now () - Start;
+  printf (
+    "  Re-arming one of %u timers: %llu ns\n",
+    TIMER_EVENTS,
+    (unsigned long long)(std::chrono::duration_cast<std::chrono::nanoseconds>(Elapsed).count () / (1000 * TIMER_EVENTS))
+    );
+
+  Tick (TIMER_TICK);
+  CheckModel ();
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
@@ -9,17 +9,48 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include "DxeMain.h"
 #include "Event.h"
 
+//
+// The timer database is a hierarchical timing wheel. Time is counted in
+// wheel ticks of 2^TIMER_WHEEL_SHIFT 100ns units. Level 0 has one slot per
+// wheel tick for the next TIMER_WHEEL_SLOTS ticks, and each higher level has
+// one slot per turn of the level below. Timers move down a level when the
+// wheel reaches their slot, so that inserting and removing a timer never
+// walks the other timers.
+//
+#define TIMER_WHEEL_SHIFT       16
+#define TIMER_WHEEL_LEVEL_BITS  6
+#define TIMER_WHEEL_SLOTS       (1 << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_LEVELS      4
+
 //
 // Internal data
 //
 
-LIST_ENTRY  mEfiTimerList       = INITIALIZE_LIST_HEAD_VARIABLE (mEfiTimerList);
-EFI_LOCK    mEfiTimerLock       = EFI_INITIALIZE_LOCK_VARIABLE (TPL_HIGH_LEVEL - 1);
-EFI_EVENT   mEfiCheckTimerEvent = NULL;
+EFI_LOCK   mEfiTimerLock       = EFI_INITIALIZE_LOCK_VARIABLE (TPL_HIGH_LEVEL - 1);
+EFI_EVENT  mEfiCheckTimerEvent = NULL;
+
+//
+// mEfiTimerWheel         - Timer.Link lists of the timers of each slot
+// mEfiTimerWheelOccupied - Bit n set if slot n of the level may be non empty
+// mEfiTimerWheelTime     - The wheel tick of the current slot of level 0
+//
+LIST_ENTRY  mEfiTimerWheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+UINT64      mEfiTimerWheelOccupied[TIMER_WHEEL_LEVELS];
+UINT64      mEfiTimerWheelTime = 0;
 
 EFI_LOCK  mEfiSystemTimeLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_HIGH_LEVEL);
 UINT64    mEfiSystemTime     = 0;
 
+//
+// The earliest time a queued timer may expire, read by CoreTimerTick()
+//
+UINT64  mEfiTimerNextTrigger = MAX_UINT64;
+
+//
+// Set if the timer driver can skip the ticks in between timer events
+//
+EDKII_TIMER_DEADLINE_PROTOCOL  *mEfiTimerDeadline = NULL;
+
 //
 // Timer functions
 //
@@ -36,33 +67,247 @@ CoreInsertEventTimer (
   IN IEVENT  *Event
   )
 {
-  UINT64      TriggerTime;
-  LIST_ENTRY  *Link;
-  IEVENT      *Event2;
+  UINT64  Expires;
+  UINT64  Delta;
+  UINTN   Level;
+  UINTN   Slot;
 
   ASSERT_LOCKED (&mEfiTimerLock);
 
   //
-  // Get the timer's trigger time
+  // Timers that are already due go to the current slot
   //
-  TriggerTime = Event->Timer.TriggerTime;
+  Expires = RShiftU64 (Event->Timer.TriggerTime, TIMER_WHEEL_SHIFT);
+  if (Expires < mEfiTimerWheelTime) {
+    Expires = mEfiTimerWheelTime;
+  }
 
   //
-  // Insert the timer into the timer database in assending sorted order
+  // Pick the lowest level that reaches the timer. Timers beyond the top
+  // level wait in its last slot and are placed again when it is reached.
   //
-  for (Link = mEfiTimerList.ForwardLink; Link != &mEfiTimerList; Link = Link->ForwardLink) {
-    Event2 = CR (Link, IEVENT, Timer.Link, EVENT_SIGNATURE);
+  Delta = Expires - mEfiTimerWheelTime;
+  for (Level = 0; Level < TIMER_WHEEL_LEVELS - 1; Level++) {
+    if (Delta < LShiftU64 (1, (Level + 1) * TIMER_WHEEL_LEVEL_BITS)) {
+      break;
+    }
+  }
+
+  if (Delta >= LShiftU64 (1, TIMER_WHEEL_LEVELS * TIMER_WHEEL_LEVEL_BITS)) {
+    Expires = mEfiTimerWheelTime + LShiftU64 (1, TIMER_WHEEL_LEVELS * TIMER_WHEEL_LEVEL_BITS) - 1;
+  }
+
+  Slot = (UINTN)RShiftU64 (Expires, Level * TIMER_WHEEL_LEVEL_BITS) & (TIMER_WHEEL_SLOTS - 1);
+  InsertTailList (&mEfiTimerWheel[Level][Slot], &Event->Timer.Link);
+  mEfiTimerWheelOccupied[Level] |= LShiftU64 (1, Slot);
+}
+
+/**
+  Returns the earliest time a queued timer may expire.
+
+  The exact trigger time is taken from the first occupied slot of level 0.
+  The timers of the higher levels are bounded by the time the wheel reaches
+  their slot, when they move down.
+
+  @return The earliest trigger time, or MAX_UINT64 if no timer is queued
+
+**/
+UINT64
+CoreGetNextTimerTrigger (
+  VOID
+  )
+{
+  UINT64      NextTrigger;
+  UINT64      Occupied;
+  UINT64      Turn;
+  UINTN       Level;
+  UINTN       Current;
+  UINTN       Offset;
+  UINTN       Slot;
+  LIST_ENTRY  *Link;
+  IEVENT      *Event;
+
+  ASSERT_LOCKED (&mEfiTimerLock);
+
+  NextTrigger = MAX_UINT64;
+  for (Level = 0; Level < TIMER_WHEEL_LEVELS; Level++) {
+    Turn    = RShiftU64 (mEfiTimerWheelTime, Level * TIMER_WHEEL_LEVEL_BITS);
+    Current = (UINTN)Turn & (TIMER_WHEEL_SLOTS - 1);
+
+    //
+    // The current slot of a higher level has already moved down, so it is
+    // only reached again after a full turn
+    //
+    for (Offset = (Level == 0) ? 0 : 1; Offset <= ((Level == 0) ? TIMER_WHEEL_SLOTS - 1 : TIMER_WHEEL_SLOTS); Offset++) {
+      Slot     = (Current + Offset) & (TIMER_WHEEL_SLOTS - 1);
+      Occupied = RShiftU64 (mEfiTimerWheelOccupied[Level], Slot);
+      if ((Occupied & 1) == 0) {
+        if (Occupied == 0) {
+          //
+          // No occupied slot up to the end of the level, wrap around
+          //
+          Offset += TIMER_WHEEL_SLOTS - 1 - Slot;
+        }
+
+        continue;
+      }
+
+      if (IsListEmpty (&mEfiTimerWheel[Level][Slot])) {
+        mEfiTimerWheelOccupied[Level] &= ~LShiftU64 (1, Slot);
+        continue;
+      }
+
+      if (Level == 0) {
+        for (Link = mEfiTimerWheel[0][Slot].ForwardLink; Link != &mEfiTimerWheel[0][Slot]; Link = Link->ForwardLink) {
+          Event       = CR (Link, IEVENT, Timer.Link, EVENT_SIGNATURE);
+          NextTrigger = MIN (NextTrigger, Event->Timer.TriggerTime);
+        }
+      } else {
+        NextTrigger = MIN (
+                        NextTrigger,
+                        LShiftU64 (Turn + Offset, Level * TIMER_WHEEL_LEVEL_BITS + TIMER_WHEEL_SHIFT)
+                        );
+      }
 
-    if (Event2->Timer.TriggerTime > TriggerTime) {
       break;
     }
   }
 
-  InsertTailList (Link, &Event->Timer.Link);
+  return NextTrigger;
 }
 
 /**
-  Returns the current system time.
+  Publishes the earliest time a queued timer may expire to CoreTimerTick(),
+  and to the timer driver if it can skip the ticks in between.
+
+  @param  SystemTime             The current system time
+
+**/
+VOID
+CoreUpdateNextTimerTrigger (
+  IN UINT64  SystemTime
+  )
+{
+  UINT64  NextTrigger;
+
+  ASSERT_LOCKED (&mEfiTimerLock);
+
+  NextTrigger = CoreGetNextTimerTrigger ();
+
+  CoreAcquireLock (&mEfiSystemTimeLock);
+  mEfiTimerNextTrigger = NextTrigger;
+  CoreReleaseLock (&mEfiSystemTimeLock);
+
+  if (mEfiTimerDeadline != NULL) {
+    if (NextTrigger == MAX_UINT64) {
+      mEfiTimerDeadline->SetDeadline (mEfiTimerDeadline, 0);
+    } else {
+      mEfiTimerDeadline->SetDeadline (mEfiTimerDeadline, (NextTrigger > SystemTime) ? NextTrigger - SystemTime : 1);
+    }
+  }
+}
+
+/**
+  Moves the timers of the slot of a level that the wheel has reached down
+  to the lower levels.
+
+  @param  Level                  The level of the slot, not 0
+
+**/
+VOID
+CoreCascadeTimers (
+  IN UINTN  Level
+  )
+{
+  UINTN       Slot;
+  LIST_ENTRY  *Head;
+  IEVENT      *Event;
+
+  Slot = (UINTN)RShiftU64 (mEfiTimerWheelTime, Level * TIMER_WHEEL_LEVEL_BITS) & (TIMER_WHEEL_SLOTS - 1);
+  Head = &mEfiTimerWheel[Level][Slot];
+
+  mEfiTimerWheelOccupied[Level] &= ~LShiftU64 (1, Slot);
+  while (!IsListEmpty (Head)) {
+    Event = CR (Head->ForwardLink, IEVENT, Timer.Link, EVENT_SIGNATURE);
+    RemoveEntryList (&Event->Timer.Link);
+    CoreInsertEventTimer (Event);
+  }
+}
+
+/**
+  Turns the wheel to a wheel tick, and moves the expired timers of the
+  slots it passes to a list.
+
+  @param  SystemTime             The current system time
+  @param  Expired                The list the expired timers are moved to
+
+**/
+VOID
+CoreAdvanceTimerWheel (
+  IN UINT64          SystemTime,
+  IN OUT LIST_ENTRY  *Expired
+  )
+{
+  UINT64      Target;
+  UINT64      Next;
+  UINT64      Occupied;
+  UINTN       Slot;
+  UINTN       Level;
+  LIST_ENTRY  *Link;
+  IEVENT      *Event;
+
+  Target = RShiftU64 (SystemTime, TIMER_WHEEL_SHIFT);
+  while (TRUE) {
+    Slot = (UINTN)mEfiTimerWheelTime & (TIMER_WHEEL_SLOTS - 1);
+    Link = mEfiTimerWheel[0][Slot].ForwardLink;
+    while (Link != &mEfiTimerWheel[0][Slot]) {
+      Event = CR (Link, IEVENT, Timer.Link, EVENT_SIGNATURE);
+      Link  = Link->ForwardLink;
+
+      if (Event->Timer.TriggerTime <= SystemTime) {
+        RemoveEntryList (&Event->Timer.Link);
+        InsertTailList (Expired, &Event->Timer.Link);
+      }
+    }
+
+    if (IsListEmpty (&mEfiTimerWheel[0][Slot])) {
+      mEfiTimerWheelOccupied[0] &= ~LShiftU64 (1, Slot);
+    }
+
+    if (mEfiTimerWheelTime >= Target) {
+      break;
+    }
+
+    //
+    // Skip to the next occupied slot of level 0, the end of the turn, or the
+    // target, whichever comes first
+    //
+    Next = (mEfiTimerWheelTime | (TIMER_WHEEL_SLOTS - 1)) + 1;
+    if (Slot + 1 < TIMER_WHEEL_SLOTS) {
+      Occupied = RShiftU64 (mEfiTimerWheelOccupied[0], Slot + 1);
+      if (Occupied != 0) {
+        Next = mEfiTimerWheelTime + 1 + (UINT64)LowBitSet64 (Occupied);
+      }
+    }
+
+    mEfiTimerWheelTime = MIN (Next, Target);
+
+    //
+    // At the end of a turn, the next slot of each higher level moves down
+    //
+    for (Level = 1; Level < TIMER_WHEEL_LEVELS; Level++) {
+      if ((mEfiTimerWheelTime & (LShiftU64 (1, Level * TIMER_WHEEL_LEVEL_BITS) - 1)) != 0) {
+        break;
+      }
+
+      CoreCascadeTimers (Level);
+    }
+  }
+}
+
+/**
+  Returns the current system time. If the timer driver skips ticks, the time
+  that has passed since its last tick is included.
 
   @return The current system time
 
@@ -76,13 +321,17 @@ CoreCurrentSystemTime (
 
   CoreAcquireLock (&mEfiSystemTimeLock);
   SystemTime = mEfiSystemTime;
+  if (mEfiTimerDeadline != NULL) {
+    SystemTime += mEfiTimerDeadline->GetElapsed (mEfiTimerDeadline);
+  }
+
   CoreReleaseLock (&mEfiSystemTimeLock);
 
   return SystemTime;
 }
 
 /**
-  Checks the sorted timer list against the current system time.
+  Checks the timer database against the current system time.
   Signals any expired event timer.
 
   @param  CheckEvent             Not used
@@ -96,8 +345,9 @@ CoreCheckTimers (
   IN VOID       *Context
   )
 {
-  UINT64  SystemTime;
-  IEVENT  *Event;
+  UINT64      SystemTime;
+  IEVENT      *Event;
+  LIST_ENTRY  Expired;
 
   //
   // Check the timer database for expired timers
@@ -105,18 +355,14 @@ CoreCheckTimers (
   CoreAcquireLock (&mEfiTimerLock);
   SystemTime = CoreCurrentSystemTime ();
 
-  while (!IsListEmpty (&mEfiTimerList)) {
-    Event = CR (mEfiTimerList.ForwardLink, IEVENT, Timer.Link, EVENT_SIGNATURE);
+  InitializeListHead (&Expired);
+  CoreAdvanceTimerWheel (SystemTime, &Expired);
 
-    //
-    // If this timer is not expired, then we're done
-    //
-    if (Event->Timer.TriggerTime > SystemTime) {
-      break;
-    }
+  while (!IsListEmpty (&Expired)) {
+    Event = CR (Expired.ForwardLink, IEVENT, Timer.Link, EVENT_SIGNATURE);
 
     //
-    // Remove this timer from the timer queue
+    // Remove this timer from the expired list
     //
 
     RemoveEntryList (&Event->Timer.Link);
@@ -151,6 +397,7 @@ CoreCheckTimers (
     }
   }
 
+  CoreUpdateNextTimerTrigger (SystemTime);
   CoreReleaseLock (&mEfiTimerLock);
 }
 
@@ -164,6 +411,14 @@ CoreInitializeTimer (
   )
 {
   EFI_STATUS  Status;
+  UINTN       Level;
+  UINTN       Slot;
+
+  for (Level = 0; Level < TIMER_WHEEL_LEVELS; Level++) {
+    for (Slot = 0; Slot < TIMER_WHEEL_SLOTS; Slot++) {
+      InitializeListHead (&mEfiTimerWheel[Level][Slot]);
+    }
+  }
 
   Status = CoreCreateEventInternal (
              EVT_NOTIFY_SIGNAL,
@@ -176,6 +431,31 @@ CoreInitializeTimer (
   ASSERT_EFI_ERROR (Status);
 }
 
+/**
+  Connects the timer driver to the timer database if it can skip the ticks
+  in between timer events. Called when the Timer Architectural Protocol is
+  installed.
+
+**/
+VOID
+CoreConnectTimerDeadline (
+  VOID
+  )
+{
+  EFI_STATUS                     Status;
+  EDKII_TIMER_DEADLINE_PROTOCOL  *TimerDeadline;
+
+  Status = CoreLocateProtocol (&gEdkiiTimerDeadlineProtocolGuid, NULL, (VOID **)&TimerDeadline);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  CoreAcquireLock (&mEfiTimerLock);
+  mEfiTimerDeadline = TimerDeadline;
+  CoreUpdateNextTimerTrigger (CoreCurrentSystemTime ());
+  CoreReleaseLock (&mEfiTimerLock);
+}
+
 /**
   Called by the platform code to process a tick.
 
@@ -189,8 +469,6 @@ CoreTimerTick (
   IN UINT64  Duration
   )
 {
-  IEVENT  *Event;
-
   //
   // Check runtiem flag in case there are ticks while exiting boot services
   //
@@ -202,15 +480,11 @@ CoreTimerTick (
   mEfiSystemTime += Duration;
 
   //
-  // If the head of the list is expired, fire the timer event
+  // If the earliest timer may have expired, fire the timer event
   // to process it
   //
-  if (!IsListEmpty (&mEfiTimerList)) {
-    Event = CR (mEfiTimerList.ForwardLink, IEVENT, Timer.Link, EVENT_SIGNATURE);
-
-    if (Event->Timer.TriggerTime <= mEfiSystemTime) {
-      CoreSignalEvent (mEfiCheckTimerEvent);
-    }
+  if (mEfiTimerNextTrigger <= mEfiSystemTime) {
+    CoreSignalEvent (mEfiCheckTimerEvent);
   }
 
   CoreReleaseLock (&mEfiSystemTimeLock);
@@ -240,6 +514,7 @@ CoreSetTimer (
   )
 {
   IEVENT  *Event;
+  UINT64  SystemTime;
 
   Event = UserEvent;
 
@@ -277,11 +552,14 @@ CoreSetTimer (
       Event->Timer.Period = TriggerTime;
     }
 
-    Event->Timer.TriggerTime = CoreCurrentSystemTime () + TriggerTime;
+    SystemTime               = CoreCurrentSystemTime ();
+    Event->Timer.TriggerTime = SystemTime + TriggerTime;
     CoreInsertEventTimer (Event);
 
     if (TriggerTime == 0) {
       CoreSignalEvent (mEfiCheckTimerEvent);
+    } else if (Event->Timer.TriggerTime < mEfiTimerNextTrigger) {
+      CoreUpdateNextTimerTrigger (SystemTime);
     }
   }
 
@@ -45,6 +45,12 @@ EFI_LOCK    mGcdIoSpaceLock     = EFI_INITIALIZE_LOCK_VARIABLE (TPL_NOTIFY);
 LIST_ENTRY  mGcdMemorySpaceMap  = INITIALIZE_LIST_HEAD_VARIABLE (mGcdMemorySpaceMap);
 LIST_ENTRY  mGcdIoSpaceMap      = INITIALIZE_LIST_HEAD_VARIABLE (mGcdIoSpaceMap);
 
+//
+// The entries of the GCD maps by address
+//
+RANGE_INDEX  mGcdMemorySpaceIndex = { NULL };
+RANGE_INDEX  mGcdIoSpaceIndex     = { NULL };
+
 EFI_GCD_MAP_ENTRY  mGcdMemorySpaceMapEntryTemplate = {
   EFI_GCD_MAP_SIGNATURE,
   {
@@ -413,6 +419,24 @@ CoreAllocateGcdMapEntry (
   return EFI_SUCCESS;
 }
 
+/**
+  Internal function.  Returns the address index of a GCD map.
+
+  @param  Map                    The GCD map, mGcdMemorySpaceMap or mGcdIoSpaceMap
+
+  @return The index of the entries of Map
+
+**/
+RANGE_INDEX *
+CoreGetGcdMapIndex (
+  IN LIST_ENTRY  *Map
+  )
+{
+  ASSERT ((Map == &mGcdMemorySpaceMap) || (Map == &mGcdIoSpaceMap));
+
+  return (Map == &mGcdMemorySpaceMap) ? &mGcdMemorySpaceIndex : &mGcdIoSpaceIndex;
+}
+
 /**
   Internal function.  Inserts a new descriptor into a sorted list
 
@@ -423,6 +447,7 @@ CoreAllocateGcdMapEntry (
   @param  Length                 The length of the new range in bytes
   @param  TopEntry               Top pad entry to insert if needed.
   @param  BottomEntry            Bottom pad entry to insert if needed.
+  @param  Map                    The GCD map that Link belongs to.
 
   @retval EFI_SUCCESS            The new range was inserted into the linked list
 
@@ -434,17 +459,24 @@ CoreInsertGcdMapEntry (
   IN EFI_PHYSICAL_ADDRESS  BaseAddress,
   IN UINT64                Length,
   IN EFI_GCD_MAP_ENTRY     *TopEntry,
-  IN EFI_GCD_MAP_ENTRY     *BottomEntry
+  IN EFI_GCD_MAP_ENTRY     *BottomEntry,
+  IN LIST_ENTRY            *Map
   )
 {
+  RANGE_INDEX  *Index;
+
   ASSERT (Length != 0);
 
+  Index = CoreGetGcdMapIndex (Map);
+
   if (BaseAddress > Entry->BaseAddress) {
     ASSERT (BottomEntry->Signature == 0);
 
     CopyMem (BottomEntry, Entry, sizeof (EFI_GCD_MAP_ENTRY));
     Entry->BaseAddress      = BaseAddress;
     BottomEntry->EndAddress = BaseAddress - 1;
+    RangeIndexUpdate (Index, &Entry->IndexNode, Entry->BaseAddress, Entry->EndAddress);
+    RangeIndexInsert (Index, &BottomEntry->IndexNode, BottomEntry->BaseAddress, BottomEntry->EndAddress);
     InsertTailList (Link, &BottomEntry->Link);
   }
 
@@ -454,6 +486,8 @@ CoreInsertGcdMapEntry (
     CopyMem (TopEntry, Entry, sizeof (EFI_GCD_MAP_ENTRY));
     TopEntry->BaseAddress = BaseAddress + Length;
     Entry->EndAddress     = BaseAddress + Length - 1;
+    RangeIndexUpdate (Index, &Entry->IndexNode, Entry->BaseAddress, Entry->EndAddress);
+    RangeIndexInsert (Index, &TopEntry->IndexNode, TopEntry->BaseAddress, TopEntry->EndAddress);
     InsertHeadList (Link, &TopEntry->Link);
   }
 
@@ -482,6 +516,7 @@ CoreMergeGcdMapEntry (
   LIST_ENTRY         *AdjacentLink;
   EFI_GCD_MAP_ENTRY  *Entry;
   EFI_GCD_MAP_ENTRY  *AdjacentEntry;
+  RANGE_INDEX        *Index;
 
   //
   // Get adjacent entry
@@ -526,12 +561,16 @@ CoreMergeGcdMapEntry (
     return EFI_UNSUPPORTED;
   }
 
+  Index = CoreGetGcdMapIndex (Map);
+  RangeIndexRemove (Index, &AdjacentEntry->IndexNode);
+
   if (Forward) {
     Entry->EndAddress = AdjacentEntry->EndAddress;
   } else {
     Entry->BaseAddress = AdjacentEntry->BaseAddress;
   }
 
+  RangeIndexUpdate (Index, &Entry->IndexNode, Entry->BaseAddress, Entry->EndAddress);
   RemoveEntryList (AdjacentLink);
   CoreFreePool (AdjacentEntry);
 
@@ -604,7 +643,9 @@ CoreSearchGcdMapEntry (
   IN  LIST_ENTRY            *Map
   )
 {
-  LIST_ENTRY         *Link;
+  RANGE_INDEX        *Index;
+  RANGE_INDEX_NODE   *StartNode;
+  RANGE_INDEX_NODE   *EndNode;
   EFI_GCD_MAP_ENTRY  *Entry;
 
   ASSERT (Length != 0);
@@ -612,26 +653,23 @@ CoreSearchGcdMapEntry (
   *StartLink = NULL;
   *EndLink   = NULL;
 
-  Link = Map->ForwardLink;
-  while (Link != Map) {
-    Entry = CR (Link, EFI_GCD_MAP_ENTRY, Link, EFI_GCD_MAP_SIGNATURE);
-    if ((BaseAddress >= Entry->BaseAddress) && (BaseAddress <= Entry->EndAddress)) {
-      *StartLink = Link;
-    }
-
-    if (*StartLink != NULL) {
-      if (((BaseAddress + Length - 1) >= Entry->BaseAddress) &&
-          ((BaseAddress + Length - 1) <= Entry->EndAddress))
-      {
-        *EndLink = Link;
-        return EFI_SUCCESS;
-      }
-    }
+  Index     = CoreGetGcdMapIndex (Map);
+  StartNode = RangeIndexLookup (Index, BaseAddress);
+  if (StartNode == NULL) {
+    return EFI_NOT_FOUND;
+  }
 
-    Link = Link->ForwardLink;
+  EndNode = RangeIndexLookup (Index, BaseAddress + Length - 1);
+  if ((EndNode == NULL) || (EndNode->Start < StartNode->Start)) {
+    return EFI_NOT_FOUND;
   }
 
-  return EFI_NOT_FOUND;
+  Entry      = CR (StartNode, EFI_GCD_MAP_ENTRY, IndexNode, EFI_GCD_MAP_SIGNATURE);
+  *StartLink = &Entry->Link;
+  Entry      = CR (EndNode, EFI_GCD_MAP_ENTRY, IndexNode, EFI_GCD_MAP_SIGNATURE);
+  *EndLink   = &Entry->Link;
+
+  return EFI_SUCCESS;
 }
 
 /**
@@ -934,7 +972,7 @@ CoreConvertSpace (
   Link = StartLink;
   while (Link != EndLink->ForwardLink) {
     Entry = CR (Link, EFI_GCD_MAP_ENTRY, Link, EFI_GCD_MAP_SIGNATURE);
-    CoreInsertGcdMapEntry (Link, Entry, BaseAddress, Length, TopEntry, BottomEntry);
+    CoreInsertGcdMapEntry (Link, Entry, BaseAddress, Length, TopEntry, BottomEntry, Map);
     switch (Operation) {
       //
       // Add operations
@@ -1322,7 +1360,7 @@ CoreAllocateSpace (
   Link = StartLink;
   while (Link != EndLink->ForwardLink) {
     Entry = CR (Link, EFI_GCD_MAP_ENTRY, Link, EFI_GCD_MAP_SIGNATURE);
-    CoreInsertGcdMapEntry (Link, Entry, *BaseAddress, Length, TopEntry, BottomEntry);
+    CoreInsertGcdMapEntry (Link, Entry, *BaseAddress, Length, TopEntry, BottomEntry, Map);
     Entry->ImageHandle  = ImageHandle;
     Entry->DeviceHandle = DeviceHandle;
     Link                = Link->ForwardLink;
@@ -2547,6 +2585,7 @@ CoreInitializeGcdServices (
   Entry->EndAddress = LShiftU64 (1, SizeOfMemorySpace) - 1;
 
   InsertHeadList (&mGcdMemorySpaceMap, &Entry->Link);
+  RangeIndexInsert (&mGcdMemorySpaceIndex, &Entry->IndexNode, Entry->BaseAddress, Entry->EndAddress);
 
   CoreDumpGcdMemorySpaceMap (TRUE);
 
@@ -2559,6 +2598,7 @@ CoreInitializeGcdServices (
   Entry->EndAddress = LShiftU64 (1, SizeOfIoSpace) - 1;
 
   InsertHeadList (&mGcdIoSpaceMap, &Entry->Link);
+  RangeIndexInsert (&mGcdIoSpaceIndex, &Entry->IndexNode, Entry->BaseAddress, Entry->EndAddress);
 
   CoreDumpGcdIoSpaceMap (TRUE);
 
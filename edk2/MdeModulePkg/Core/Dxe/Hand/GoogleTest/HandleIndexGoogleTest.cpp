@@ -0,0 +1,374 @@
+/** @file
+  Host benchmark of the handle database indexes of the DXE core.
+
+  A protocol call trace shaped like a BDS connect-all is replayed twice: once
+  with the list walks the handle database used before, once with the hashed
+  indexes of HandleIndex.c. Both must give the same answer for every call.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+#include <Library/GoogleTestLib.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+extern "C" {
+  #include <Uefi.h>
+  #include <Protocol/DevicePath.h>
+  #include <Library/BaseLib.h>
+  #include <Library/BaseMemoryLib.h>
+  #include <Library/UefiLib.h>
+  #include "../Handle.h"
+}
+
+using namespace testing;
+
+//
+// Shape of the trace: controllers with a few protocols each, and drivers
+// whose Supported() tests every controller for their protocol.
+//
+#define TRACE_PROTOCOLS  150
+#define TRACE_HANDLES    2000
+#define TRACE_DRIVERS    40
+
+typedef enum {
+  TraceInstall,
+  TraceHandleProtocol,
+  TraceUninstallHandle
+} TRACE_OPERATION;
+
+typedef struct {
+  TRACE_OPERATION    Operation;
+  UINTN              Handle;
+  UINTN              Protocol;
+} TRACE_ENTRY;
+
+//
+// Outcome of a HandleProtocol() call of the trace
+//
+#define RESULT_INVALID_HANDLE  0
+#define RESULT_UNSUPPORTED     1
+#define RESULT_FOUND           2
+
+class HandleIndexTest : public Test {
+protected:
+  LIST_ENTRY                  HandleList;
+  LIST_ENTRY                  ProtocolDatabase;
+  std::vector<EFI_GUID>       Guids;
+  std::vector<IHANDLE *>      Handles;
+  std::vector<TRACE_ENTRY>    Trace;
+  UINT32                      Seed;
+
+  UINT32
+  Random (
+    VOID
+    )
+  {
+    Seed = Seed * 1103515245 + 12345;
+    return Seed >> 8;
+  }
+
+  void
+  SetUp (
+    ) override
+  {
+    UINTN  Index;
+    UINTN  Driver;
+    UINTN  Protocol;
+
+    Seed = 0x5eed;
+    InitializeListHead (&HandleList);
+    InitializeListHead (&ProtocolDatabase);
+
+    Guids.resize (TRACE_PROTOCOLS);
+    for (Index = 0; Index < TRACE_PROTOCOLS; Index++) {
+      for (UINTN Byte = 0; Byte < sizeof (EFI_GUID); Byte++) {
+        ((UINT8 *)&Guids[Index])[Byte] = (UINT8)Random ();
+      }
+    }
+
+    //
+    // Enumeration: every controller gets a device path, a bus protocol and
+    // one more protocol. Protocol 0 plays the device path.
+    //
+    for (Index = 0; Index < TRACE_HANDLES; Index++) {
+      Trace.push_back ({ TraceInstall, Index, 0 });
+      Trace.push_back ({ TraceInstall, Index, 1 + Random () % 8 });
+      Trace.push_back ({ TraceInstall, Index, 9 + Random () % (TRACE_PROTOCOLS - 9) });
+    }
+
+    //
+    // Connect-all: each driver probes each controller
+    //
+    for (Driver = 0; Driver < TRACE_DRIVERS; Driver++) {
+      Protocol = 1 + Random () % (TRACE_PROTOCOLS - 1);
+      for (Index = 0; Index < TRACE_HANDLES; Index++) {
+        Trace.push_back ({ TraceHandleProtocol, Index, 0 });
+        Trace.push_back ({ TraceHandleProtocol, Index, Protocol });
+      }
+    }
+
+    //
+    // Hot-unplug half of the controllers, then probe them all again so
+    // stale handles get validated too
+    //
+    for (Index = 0; Index < TRACE_HANDLES; Index += 2) {
+      Trace.push_back ({ TraceUninstallHandle, Index, 0 });
+    }
+
+    for (Index = 0; Index < TRACE_HANDLES; Index++) {
+      Trace.push_back ({ TraceHandleProtocol, Index, 0 });
+    }
+  }
+
+  void
+  TearDown (
+    ) override
+  {
+    LIST_ENTRY  *Link;
+
+    while (!IsListEmpty (&HandleList)) {
+      Link = GetFirstNode (&HandleList);
+      RemoveHandle (BASE_CR (Link, IHANDLE, AllHandles));
+    }
+
+    while (!IsListEmpty (&ProtocolDatabase)) {
+      Link = GetFirstNode (&ProtocolDatabase);
+      RemoveEntryList (Link);
+      RemoveEntryList (&BASE_CR (Link, PROTOCOL_ENTRY, AllEntries)->IndexLink);
+      delete BASE_CR (Link, PROTOCOL_ENTRY, AllEntries);
+    }
+  }
+
+  //
+  // The handle database lookups before the indexes
+  //
+  BOOLEAN
+  ValidateHandleByList (
+    EFI_HANDLE  UserHandle
+    )
+  {
+    LIST_ENTRY  *Link;
+
+    for (Link = HandleList.BackLink; Link != &HandleList; Link = Link->BackLink) {
+      if (BASE_CR (Link, IHANDLE, AllHandles) == (IHANDLE *)UserHandle) {
+        return TRUE;
+      }
+    }
+
+    return FALSE;
+  }
+
+  PROTOCOL_ENTRY *
+  FindProtocolEntryByList (
+    EFI_GUID  *Protocol
+    )
+  {
+    LIST_ENTRY      *Link;
+    PROTOCOL_ENTRY  *Item;
+
+    for (Link = ProtocolDatabase.ForwardLink; Link != &ProtocolDatabase; Link = Link->ForwardLink) {
+      Item = BASE_CR (Link, PROTOCOL_ENTRY, AllEntries);
+      if (CompareGuid (&Item->ProtocolID, Protocol)) {
+        return Item;
+      }
+    }
+
+    return NULL;
+  }
+
+  PROTOCOL_INTERFACE *
+  FindInterface (
+    IHANDLE         *Handle,
+    PROTOCOL_ENTRY  *ProtEntry
+    )
+  {
+    LIST_ENTRY          *Link;
+    PROTOCOL_INTERFACE  *Prot;
+
+    for (Link = Handle->Protocols.ForwardLink; Link != &Handle->Protocols; Link = Link->ForwardLink) {
+      Prot = BASE_CR (Link, PROTOCOL_INTERFACE, Link);
+      if (Prot->Protocol == ProtEntry) {
+        return Prot;
+      }
+    }
+
+    return NULL;
+  }
+
+  PROTOCOL_ENTRY *
+  CreateProtocolEntry (
+    EFI_GUID  *Protocol
+    )
+  {
+    PROTOCOL_ENTRY  *ProtEntry;
+
+    ProtEntry = CoreLookupProtocolIndex (Protocol);
+    if (ProtEntry == NULL) {
+      ProtEntry            = new PROTOCOL_ENTRY ();
+      ProtEntry->Signature = PROTOCOL_ENTRY_SIGNATURE;
+      CopyGuid (&ProtEntry->ProtocolID, Protocol);
+      InitializeListHead (&ProtEntry->Protocols);
+      InitializeListHead (&ProtEntry->Notify);
+      InsertTailList (&ProtocolDatabase, &ProtEntry->AllEntries);
+      CoreInsertProtocolIndex (ProtEntry);
+    }
+
+    return ProtEntry;
+  }
+
+  void
+  Install (
+    UINTN  Index,
+    UINTN  Protocol
+    )
+  {
+    IHANDLE             *Handle;
+    PROTOCOL_INTERFACE  *Prot;
+
+    if (Handles[Index] == NULL) {
+      Handle            = new IHANDLE ();
+      Handle->Signature = EFI_HANDLE_SIGNATURE;
+      InitializeListHead (&Handle->Protocols);
+      InsertTailList (&HandleList, &Handle->AllHandles);
+      CoreInsertHandleIndex (Handle);
+      Handles[Index] = Handle;
+    }
+
+    Prot            = new PROTOCOL_INTERFACE ();
+    Prot->Signature = PROTOCOL_INTERFACE_SIGNATURE;
+    Prot->Handle    = Handles[Index];
+    Prot->Protocol  = CreateProtocolEntry (&Guids[Protocol]);
+    InsertHeadList (&Handles[Index]->Protocols, &Prot->Link);
+    InsertTailList (&Prot->Protocol->Protocols, &Prot->ByProtocol);
+  }
+
+  void
+  RemoveHandle (
+    IHANDLE  *Handle
+    )
+  {
+    PROTOCOL_INTERFACE  *Prot;
+
+    while (!IsListEmpty (&Handle->Protocols)) {
+      Prot = BASE_CR (GetFirstNode (&Handle->Protocols), PROTOCOL_INTERFACE, Link);
+      RemoveEntryList (&Prot->Link);
+      RemoveEntryList (&Prot->ByProtocol);
+      delete Prot;
+    }
+
+    RemoveEntryList (&Handle->AllHandles);
+    CoreRemoveHandleIndex (Handle);
+    delete Handle;
+  }
+
+  //
+  // Replay the trace and record the outcome of each HandleProtocol() call.
+  // Freed handles keep their address in Addresses, and validating them
+  // only compares that address.
+  //
+  void
+  Replay (
+    BOOLEAN               UseIndex,
+    std::vector<UINT8>  &Results
+    )
+  {
+    std::vector<EFI_HANDLE>  Addresses (TRACE_HANDLES, NULL);
+    PROTOCOL_ENTRY           *ProtEntry;
+    PROTOCOL_INTERFACE       *Prot;
+    EFI_HANDLE               UserHandle;
+    BOOLEAN                  Valid;
+
+    Handles.assign (TRACE_HANDLES, NULL);
+    Results.clear ();
+
+    for (const TRACE_ENTRY &Entry : Trace) {
+      switch (Entry.Operation) {
+        case TraceInstall:
+          Install (Entry.Handle, Entry.Protocol);
+          Addresses[Entry.Handle] = Handles[Entry.Handle];
+          break;
+
+        case TraceUninstallHandle:
+          RemoveHandle (Handles[Entry.Handle]);
+          Handles[Entry.Handle] = NULL;
+          break;
+
+        case TraceHandleProtocol:
+          UserHandle = Addresses[Entry.Handle];
+          Valid      = UseIndex ? CoreIsHandleIndexed (UserHandle) : ValidateHandleByList (UserHandle);
+          Prot       = NULL;
+          if (Valid) {
+            ProtEntry = UseIndex ? CoreLookupProtocolIndex (&Guids[Entry.Protocol]) :
+                        FindProtocolEntryByList (&Guids[Entry.Protocol]);
+            if (ProtEntry != NULL) {
+              Prot = FindInterface ((IHANDLE *)UserHandle, ProtEntry);
+            }
+          }
+
+          Results.push_back (Prot != NULL ? RESULT_FOUND : (Valid ? RESULT_UNSUPPORTED : RESULT_INVALID_HANDLE));
+          break;
+      }
+    }
+
+    TearDown ();
+  }
+};
+
+//
+// Both databases answer every call of the trace the same way, and the
+// indexed one is reported next to the list walk.
+//
+TEST_F (HandleIndexTest, ReplayConnectAllTrace) {
+  std::vector<UINT8>  ByList;
+  std::vector<UINT8>  ByIndex;
+
+  auto  Start = std::chrono::steady_clock::now ();
+
+  Replay (FALSE, ByList);
+  auto  Middle = std::chrono::steady_clock::now ();
+
+  Replay (TRUE, ByIndex);
+  auto  End = std::chrono::steady_clock::now ();
+
+  EXPECT_THAT (ByIndex, ElementsAreArray (ByList));
+  EXPECT_EQ (std::count (ByIndex.begin (), ByIndex.end (), RESULT_INVALID_HANDLE), TRACE_HANDLES / 2);
+  EXPECT_GE (std::count (ByIndex.begin (), ByIndex.end (), RESULT_FOUND), TRACE_HANDLES * TRACE_DRIVERS);
+
+  RecordProperty ("TraceCalls", (int)Trace.size ());
+  RecordProperty ("ListWalkMicroseconds", (int)std::chrono::duration_cast<std::chrono::microseconds>(Middle - Start).count ());
+  RecordProperty ("IndexMicroseconds", (int)std::chrono::duration_cast<std::chrono::microseconds>(End - Middle).count ());
+}
+
+//
+// Handles that were never installed, or were freed, are not valid
+//
+TEST_F (HandleIndexTest, RejectUnknownHandles) {
+  IHANDLE  Unknown;
+
+  Handles.assign (TRACE_HANDLES, NULL);
+  Install (0, 0);
+  Install (1, 0);
+
+  EXPECT_TRUE (CoreIsHandleIndexed (Handles[0]));
+  EXPECT_TRUE (CoreIsHandleIndexed (Handles[1]));
+  EXPECT_FALSE (CoreIsHandleIndexed (&Unknown));
+  EXPECT_FALSE (CoreIsHandleIndexed (NULL));
+
+  RemoveHandle (Handles[0]);
+  EXPECT_TRUE (CoreIsHandleIndexed (Handles[1]));
+
+  EXPECT_EQ (CoreLookupProtocolIndex (&Guids[0]), FindProtocolEntryByList (&Guids[0]));
+  EXPECT_EQ (CoreLookupProtocolIndex (&Guids[1]), (PROTOCOL_ENTRY *)NULL);
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
@@ -10,8 +10,8 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include "Handle.h"
 
 //
-// mProtocolDatabase     - A list of all protocols in the system.  (simple list for now)
-// gHandleList           - A list of all the handles in the system
+// mProtocolDatabase     - A list of all protocols in the system, also hashed by GUID in HandleIndex.c
+// gHandleList           - A list of all the handles in the system, also hashed by address in HandleIndex.c
 // gProtocolDatabaseLock - Lock to protect the mProtocolDatabase
 // gHandleDatabaseKey    -  The Key to show that the handle has been created/modified
 //
@@ -59,20 +59,15 @@ CoreValidateHandle (
   IN  EFI_HANDLE  UserHandle
   )
 {
-  IHANDLE     *Handle;
-  LIST_ENTRY  *Link;
-
   if (UserHandle == NULL) {
     return EFI_INVALID_PARAMETER;
   }
 
   ASSERT_LOCKED (&gProtocolDatabaseLock);
 
-  for (Link = gHandleList.BackLink; Link != &gHandleList; Link = Link->BackLink) {
-    Handle = CR (Link, IHANDLE, AllHandles, EFI_HANDLE_SIGNATURE);
-    if (Handle == (IHANDLE *)UserHandle) {
-      return EFI_SUCCESS;
-    }
+  if (CoreIsHandleIndexed (UserHandle)) {
+    ASSERT_IS_HANDLE ((IHANDLE *)UserHandle);
+    return EFI_SUCCESS;
   }
 
   return EFI_INVALID_PARAMETER;
@@ -94,31 +89,14 @@ CoreFindProtocolEntry (
   IN BOOLEAN   Create
   )
 {
-  LIST_ENTRY      *Link;
-  PROTOCOL_ENTRY  *Item;
   PROTOCOL_ENTRY  *ProtEntry;
 
   ASSERT_LOCKED (&gProtocolDatabaseLock);
 
   //
-  // Search the database for the matching GUID
+  // Search the protocol index for the matching GUID
   //
-
-  ProtEntry = NULL;
-  for (Link = mProtocolDatabase.ForwardLink;
-       Link != &mProtocolDatabase;
-       Link = Link->ForwardLink)
-  {
-    Item = CR (Link, PROTOCOL_ENTRY, AllEntries, PROTOCOL_ENTRY_SIGNATURE);
-    if (CompareGuid (&Item->ProtocolID, Protocol)) {
-      //
-      // This is the protocol entry
-      //
-
-      ProtEntry = Item;
-      break;
-    }
-  }
+  ProtEntry = CoreLookupProtocolIndex (Protocol);
 
   //
   // If the protocol entry was not found and Create is TRUE, then
@@ -140,6 +118,7 @@ CoreFindProtocolEntry (
       // Add it to protocol database
       //
       InsertTailList (&mProtocolDatabase, &ProtEntry->AllEntries);
+      CoreInsertProtocolIndex (ProtEntry);
     }
   }
 
@@ -409,6 +388,7 @@ CoreInstallProtocolInterfaceNotify (
     // in the system
     //
     InsertTailList (&gHandleList, &Handle->AllHandles);
+    CoreInsertHandleIndex (Handle);
   } else {
     Status = CoreValidateHandle (Handle);
     if (EFI_ERROR (Status)) {
@@ -771,6 +751,7 @@ CoreUninstallProtocolInterface (
   if (IsListEmpty (&Handle->Protocols)) {
     Handle->Signature = 0;
     RemoveEntryList (&Handle->AllHandles);
+    CoreRemoveHandleIndex (Handle);
     CoreFreePool (Handle);
   }
 
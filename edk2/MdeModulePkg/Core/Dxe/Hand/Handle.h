@@ -18,6 +18,8 @@ typedef struct {
   UINTN         Signature;
   /// All handles list of IHANDLE
   LIST_ENTRY    AllHandles;
+  /// Link on the handle index bucket of this handle
+  LIST_ENTRY    IndexLink;
   /// List of PROTOCOL_INTERFACE's for this handle
   LIST_ENTRY    Protocols;
   UINTN         LocateRequest;
@@ -38,6 +40,8 @@ typedef struct {
   UINTN         Signature;
   /// Link Entry inserted to mProtocolDatabase
   LIST_ENTRY    AllEntries;
+  /// Link on the protocol index bucket of this protocol
+  LIST_ENTRY    IndexLink;
   /// ID of the protocol
   EFI_GUID      ProtocolID;
   /// All protocol interfaces
@@ -242,6 +246,72 @@ CoreValidateHandle (
   IN  EFI_HANDLE  UserHandle
   );
 
+/**
+  Add a new handle to the handle index.
+  The gProtocolDatabaseLock must be owned
+
+  @param  Handle                 The handle
+
+**/
+VOID
+CoreInsertHandleIndex (
+  IN IHANDLE  *Handle
+  );
+
+/**
+  Remove a handle that is being freed from the handle index.
+  The gProtocolDatabaseLock must be owned
+
+  @param  Handle                 The handle
+
+**/
+VOID
+CoreRemoveHandleIndex (
+  IN IHANDLE  *Handle
+  );
+
+/**
+  Check whether a handle is in the handle index. UserHandle is only compared,
+  never dereferenced, so any value may be passed in.
+  The gProtocolDatabaseLock must be owned
+
+  @param  UserHandle             The handle to check
+
+  @retval TRUE                   UserHandle is a handle of the database.
+  @retval FALSE                  UserHandle is not a handle of the database.
+
+**/
+BOOLEAN
+CoreIsHandleIndexed (
+  IN EFI_HANDLE  UserHandle
+  );
+
+/**
+  Add a new protocol entry to the protocol index.
+  The gProtocolDatabaseLock must be owned
+
+  @param  ProtEntry              The protocol entry
+
+**/
+VOID
+CoreInsertProtocolIndex (
+  IN PROTOCOL_ENTRY  *ProtEntry
+  );
+
+/**
+  Find the protocol entry of a protocol GUID in the protocol index.
+  The gProtocolDatabaseLock must be owned
+
+  @param  Protocol               The ID of the protocol
+
+  @return Protocol entry, or NULL if the protocol has no entry yet
+
+**/
+PROTOCOL_ENTRY *
+CoreLookupProtocolIndex (
+  IN EFI_GUID  *Protocol
+  );
+
 //
 // Externs
 //
@@ -0,0 +1,221 @@
+/** @file
+  Hashed indexes of the handle database.
+
+  Validating a handle and finding the entry of a protocol GUID used to walk
+  the list of all handles and the list of all protocols. Both are now looked
+  up in a hash table. The lists are kept for ordered walks, LocateHandle()
+  and the handle database key.
+
+Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Uefi.h>
+#include <Protocol/DevicePath.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/UefiLib.h>
+
+#include "Handle.h"
+
+//
+// Number of buckets of the indexes, powers of 2
+//
+#define HANDLE_INDEX_SHIFT        10
+#define HANDLE_INDEX_BUCKETS      (1 << HANDLE_INDEX_SHIFT)
+#define PROTOCOL_INDEX_BUCKETS    128
+
+//
+// mHandleIndex   - IHANDLE.IndexLink lists hashed by handle address
+// mProtocolIndex - PROTOCOL_ENTRY.IndexLink lists hashed by protocol GUID
+//
+STATIC LIST_ENTRY  mHandleIndex[HANDLE_INDEX_BUCKETS];
+STATIC LIST_ENTRY  mProtocolIndex[PROTOCOL_INDEX_BUCKETS];
+STATIC BOOLEAN     mHandleIndexInitialized = FALSE;
+
+/**
+  Initialize the buckets of the indexes on first use.
+
+**/
+STATIC
+VOID
+CoreInitializeHandleIndex (
+  VOID
+  )
+{
+  UINTN  Index;
+
+  if (mHandleIndexInitialized) {
+    return;
+  }
+
+  for (Index = 0; Index < HANDLE_INDEX_BUCKETS; Index++) {
+    InitializeListHead (&mHandleIndex[Index]);
+  }
+
+  for (Index = 0; Index < PROTOCOL_INDEX_BUCKETS; Index++) {
+    InitializeListHead (&mProtocolIndex[Index]);
+  }
+
+  mHandleIndexInitialized = TRUE;
+}
+
+/**
+  Return the bucket of a handle.
+
+  @param  UserHandle             The handle
+
+  @return Bucket list head
+
+**/
+STATIC
+LIST_ENTRY *
+CoreHandleIndexBucket (
+  IN EFI_HANDLE  UserHandle
+  )
+{
+  UINT64  Hash;
+
+  //
+  // Handles are pool allocations, so the low bits of the address carry no
+  // information. A multiplicative hash spreads the others.
+  //
+  Hash = MultU64x64 (RShiftU64 ((UINTN)UserHandle, 3), 0x9E3779B97F4A7C15ULL);
+  return &mHandleIndex[(UINTN)RShiftU64 (Hash, 64 - HANDLE_INDEX_SHIFT)];
+}
+
+/**
+  Return the bucket of a protocol GUID.
+
+  @param  Protocol               The ID of the protocol
+
+  @return Bucket list head
+
+**/
+STATIC
+LIST_ENTRY *
+CoreProtocolIndexBucket (
+  IN CONST EFI_GUID  *Protocol
+  )
+{
+  CONST UINT32  *Data;
+  UINT32        Hash;
+
+  Data  = (CONST UINT32 *)Protocol;
+  Hash  = ReadUnaligned32 (&Data[0]) ^ ReadUnaligned32 (&Data[1]) ^
+          ReadUnaligned32 (&Data[2]) ^ ReadUnaligned32 (&Data[3]);
+  Hash ^= Hash >> 16;
+  Hash ^= Hash >> 8;
+  return &mProtocolIndex[Hash & (PROTOCOL_INDEX_BUCKETS - 1)];
+}
+
+/**
+  Add a new handle to the handle index.
+  The gProtocolDatabaseLock must be owned
+
+  @param  Handle                 The handle
+
+**/
+VOID
+CoreInsertHandleIndex (
+  IN IHANDLE  *Handle
+  )
+{
+  CoreInitializeHandleIndex ();
+  InsertHeadList (CoreHandleIndexBucket (Handle), &Handle->IndexLink);
+}
+
+/**
+  Remove a handle that is being freed from the handle index.
+  The gProtocolDatabaseLock must be owned
+
+  @param  Handle                 The handle
+
+**/
+VOID
+CoreRemoveHandleIndex (
+  IN IHANDLE  *Handle
+  )
+{
+  RemoveEntryList (&Handle->IndexLink);
+}
+
+/**
+  Check whether a handle is in the handle index. UserHandle is only compared,
+  never dereferenced, so any value may be passed in.
+  The gProtocolDatabaseLock must be owned
+
+  @param  UserHandle             The handle to check
+
+  @retval TRUE                   UserHandle is a handle of the database.
+  @retval FALSE                  UserHandle is not a handle of the database.
+
+**/
+BOOLEAN
+CoreIsHandleIndexed (
+  IN EFI_HANDLE  UserHandle
+  )
+{
+  LIST_ENTRY  *Bucket;
+  LIST_ENTRY  *Link;
+
+  CoreInitializeHandleIndex ();
+
+  Bucket = CoreHandleIndexBucket (UserHandle);
+  for (Link = Bucket->ForwardLink; Link != Bucket; Link = Link->ForwardLink) {
+    if (BASE_CR (Link, IHANDLE, IndexLink) == (IHANDLE *)UserHandle) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**
+  Add a new protocol entry to the protocol index.
+  The gProtocolDatabaseLock must be owned
+
+  @param  ProtEntry              The protocol entry
+
+**/
+VOID
+CoreInsertProtocolIndex (
+  IN PROTOCOL_ENTRY  *ProtEntry
+  )
+{
+  CoreInitializeHandleIndex ();
+  InsertTailList (CoreProtocolIndexBucket (&ProtEntry->ProtocolID), &ProtEntry->IndexLink);
+}
+
+/**
+  Find the protocol entry of a protocol GUID in the protocol index.
+  The gProtocolDatabaseLock must be owned
+
+  @param  Protocol               The ID of the protocol
+
+  @return Protocol entry, or NULL if the protocol has no entry yet
+
+**/
+PROTOCOL_ENTRY *
+CoreLookupProtocolIndex (
+  IN EFI_GUID  *Protocol
+  )
+{
+  LIST_ENTRY      *Bucket;
+  LIST_ENTRY      *Link;
+  PROTOCOL_ENTRY  *ProtEntry;
+
+  CoreInitializeHandleIndex ();
+
+  Bucket = CoreProtocolIndexBucket (Protocol);
+  for (Link = Bucket->ForwardLink; Link != Bucket; Link = Link->ForwardLink) {
+    ProtEntry = CR (Link, PROTOCOL_ENTRY, IndexLink, PROTOCOL_ENTRY_SIGNATURE);
+    if (CompareGuid (&ProtEntry->ProtocolID, Protocol)) {
+      return ProtEntry;
+    }
+  }
+
+  return NULL;
+}
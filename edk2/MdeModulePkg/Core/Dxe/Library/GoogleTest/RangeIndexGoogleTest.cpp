@@ -0,0 +1,535 @@
+/** @file
+  Host test of the address range index of the DXE core.
+
+  A memory map is carved by random page allocations and frees the way
+  Page.c converts descriptors. Every search of the free descriptors and
+  every address lookup is answered twice: by the list walks the page
+  allocator used before, and by the range index. Both must agree, and the
+  trees are checked for balance and for their span bookkeeping.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+#include <Library/GoogleTestLib.h>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+extern "C" {
+  #include <Uefi.h>
+  #include <Library/BaseLib.h>
+  #include "../RangeIndex.h"
+}
+
+using namespace testing;
+
+#define MAP_BASE        0x80000000ULL
+#define MAP_PAGES       0x40000ULL
+#define MAP_OPERATIONS  20000
+#define FREE_TYPE       0
+
+//
+// A descriptor of the memory map. Type FREE_TYPE is free memory.
+//
+typedef struct {
+  RANGE_INDEX_NODE    MapNode;
+  RANGE_INDEX_NODE    FreeNode;
+  UINT64              Start;
+  UINT64              End;
+  UINTN               Type;
+} MAP_DESCRIPTOR;
+
+typedef struct {
+  UINT64    Start;
+  UINT64    Pages;
+} MAP_ALLOCATION;
+
+class RangeIndexTest : public Test {
+protected:
+  RANGE_INDEX                         MapIndex;
+  RANGE_INDEX                         FreeIndex;
+  std::map<UINT64, MAP_DESCRIPTOR *>  Map;
+  std::vector<MAP_ALLOCATION>         Allocations;
+  UINT32                              Seed;
+
+  void
+  SetUp (
+    ) override
+  {
+    MapIndex.Root  = NULL;
+    FreeIndex.Root = NULL;
+    Seed           = 1;
+  }
+
+  void
+  TearDown (
+    ) override
+  {
+    for (auto &Item : Map) {
+      delete Item.second;
+    }
+  }
+
+  UINT32
+  Random (
+    VOID
+    )
+  {
+    Seed = Seed * 1103515245 + 12345;
+    return Seed >> 8;
+  }
+
+  //
+  // Descriptor bookkeeping, as done by Page.c
+  //
+  void
+  AddDescriptor (
+    UINTN   Type,
+    UINT64  Start,
+    UINT64  End
+    )
+  {
+    MAP_DESCRIPTOR  *Descriptor;
+
+    Descriptor        = new MAP_DESCRIPTOR;
+    Descriptor->Start = Start;
+    Descriptor->End   = End;
+    Descriptor->Type  = Type;
+    Map[Start]        = Descriptor;
+    RangeIndexInsert (&MapIndex, &Descriptor->MapNode, Start, End);
+    if (Type == FREE_TYPE) {
+      RangeIndexInsert (&FreeIndex, &Descriptor->FreeNode, Start, End);
+    }
+  }
+
+  void
+  RemoveDescriptor (
+    MAP_DESCRIPTOR  *Descriptor
+    )
+  {
+    RangeIndexRemove (&MapIndex, &Descriptor->MapNode);
+    if (Descriptor->Type == FREE_TYPE) {
+      RangeIndexRemove (&FreeIndex, &Descriptor->FreeNode);
+    }
+
+    Map.erase (Descriptor->Start);
+    delete Descriptor;
+  }
+
+  void
+  ClipDescriptor (
+    MAP_DESCRIPTOR  *Descriptor,
+    UINT64          Start,
+    UINT64          End
+    )
+  {
+    if (Descriptor->Start != Start) {
+      Map.erase (Descriptor->Start);
+      Map[Start] = Descriptor;
+    }
+
+    Descriptor->Start = Start;
+    Descriptor->End   = End;
+    RangeIndexUpdate (&MapIndex, &Descriptor->MapNode, Start, End);
+    if (Descriptor->Type == FREE_TYPE) {
+      RangeIndexUpdate (&FreeIndex, &Descriptor->FreeNode, Start, End);
+    }
+  }
+
+  //
+  // The list walk CoreConvertPagesEx() used to find a descriptor
+  //
+  MAP_DESCRIPTOR *
+  LinearLookup (
+    UINT64  Address
+    )
+  {
+    for (auto &Item : Map) {
+      if ((Item.second->Start <= Address) && (Item.second->End >= Address)) {
+        return Item.second;
+      }
+    }
+
+    return NULL;
+  }
+
+  MAP_DESCRIPTOR *
+  IndexLookup (
+    UINT64  Address
+    )
+  {
+    RANGE_INDEX_NODE  *Node;
+
+    Node = RangeIndexLookup (&MapIndex, Address);
+    return (Node == NULL) ? NULL : BASE_CR (Node, MAP_DESCRIPTOR, MapNode);
+  }
+
+  //
+  // CoreAddRange() followed by the merge with its neighbours
+  //
+  void
+  AddRange (
+    UINTN   Type,
+    UINT64  Start,
+    UINT64  End
+    )
+  {
+    MAP_DESCRIPTOR  *Neighbour;
+
+    Neighbour = IndexLookup (Start - 1);
+    EXPECT_EQ (Neighbour, LinearLookup (Start - 1));
+    if ((Neighbour != NULL) && (Neighbour->Type == Type)) {
+      Start = Neighbour->Start;
+      RemoveDescriptor (Neighbour);
+    }
+
+    Neighbour = IndexLookup (End + 1);
+    EXPECT_EQ (Neighbour, LinearLookup (End + 1));
+    if ((Neighbour != NULL) && (Neighbour->Type == Type)) {
+      End = Neighbour->End;
+      RemoveDescriptor (Neighbour);
+    }
+
+    AddDescriptor (Type, Start, End);
+  }
+
+  //
+  // CoreConvertPagesEx() for a range within one descriptor
+  //
+  void
+  ConvertRange (
+    UINT64  Start,
+    UINT64  End,
+    UINTN   Type
+    )
+  {
+    MAP_DESCRIPTOR  *Descriptor;
+    UINT64          DescriptorEnd;
+
+    Descriptor = IndexLookup (Start);
+    ASSERT_EQ (Descriptor, LinearLookup (Start));
+    ASSERT_NE (Descriptor, (MAP_DESCRIPTOR *)NULL);
+    ASSERT_GE (Descriptor->End, End);
+    ASSERT_NE (Descriptor->Type, Type);
+
+    DescriptorEnd = Descriptor->End;
+    if ((Descriptor->Start == Start) && (DescriptorEnd == End)) {
+      RemoveDescriptor (Descriptor);
+    } else if (Descriptor->Start == Start) {
+      ClipDescriptor (Descriptor, End + 1, DescriptorEnd);
+    } else if (DescriptorEnd == End) {
+      ClipDescriptor (Descriptor, Descriptor->Start, Start - 1);
+    } else {
+      ClipDescriptor (Descriptor, Descriptor->Start, Start - 1);
+      AddDescriptor (Descriptor->Type, End + 1, DescriptorEnd);
+    }
+
+    AddRange (Type, Start, End);
+  }
+
+  //
+  // The list walk of CoreFindFreePagesI() before the index
+  //
+  UINT64
+  LinearFindFreePages (
+    UINT64  MaxAddress,
+    UINT64  MinAddress,
+    UINT64  NumberOfPages,
+    UINTN   Alignment
+    )
+  {
+    UINT64  NumberOfBytes;
+    UINT64  Target;
+    UINT64  DescStart;
+    UINT64  DescEnd;
+
+    NumberOfBytes = NumberOfPages * EFI_PAGE_SIZE;
+    Target        = 0;
+    for (auto &Item : Map) {
+      if (Item.second->Type != FREE_TYPE) {
+        continue;
+      }
+
+      DescStart = Item.second->Start;
+      DescEnd   = Item.second->End;
+      if ((DescStart >= MaxAddress) || (DescEnd < MinAddress)) {
+        continue;
+      }
+
+      if (DescEnd >= MaxAddress) {
+        DescEnd = MaxAddress;
+      }
+
+      DescEnd = ((DescEnd + 1) & (~((UINT64)Alignment - 1))) - 1;
+      if (DescEnd < DescStart) {
+        continue;
+      }
+
+      if ((DescEnd - DescStart + 1 >= NumberOfBytes) &&
+          (DescEnd - NumberOfBytes + 1 >= MinAddress) &&
+          (DescEnd > Target))
+      {
+        Target = DescEnd;
+      }
+    }
+
+    Target -= NumberOfBytes - 1;
+    return ((Target & EFI_PAGE_MASK) != 0) ? 0 : Target;
+  }
+
+  //
+  // The walk of CoreFindFreePagesI() over the index of free descriptors
+  //
+  UINT64
+  IndexFindFreePages (
+    UINT64  MaxAddress,
+    UINT64  MinAddress,
+    UINT64  NumberOfPages,
+    UINTN   Alignment
+    )
+  {
+    RANGE_INDEX_NODE  *Node;
+    MAP_DESCRIPTOR    *Descriptor;
+    UINT64            NumberOfBytes;
+    UINT64            Target;
+    UINT64            DescStart;
+    UINT64            DescEnd;
+
+    NumberOfBytes = NumberOfPages * EFI_PAGE_SIZE;
+    Target        = 0;
+    DescStart     = 0;
+    for (Node = RangeIndexFindTopDown (&FreeIndex, MaxAddress, NumberOfBytes);
+         Node != NULL;
+         Node = (DescStart == 0) ? NULL : RangeIndexFindTopDown (&FreeIndex, DescStart - 1, NumberOfBytes))
+    {
+      Descriptor = BASE_CR (Node, MAP_DESCRIPTOR, FreeNode);
+      EXPECT_EQ (Descriptor->Type, (UINTN)FREE_TYPE);
+
+      DescStart = Descriptor->Start;
+      DescEnd   = Descriptor->End;
+      if (DescEnd < MinAddress) {
+        break;
+      }
+
+      if (DescEnd >= MaxAddress) {
+        DescEnd = MaxAddress;
+      }
+
+      DescEnd = ((DescEnd + 1) & (~((UINT64)Alignment - 1))) - 1;
+      if (DescEnd < DescStart) {
+        continue;
+      }
+
+      if ((DescEnd - DescStart + 1 >= NumberOfBytes) &&
+          (DescEnd - NumberOfBytes + 1 >= MinAddress))
+      {
+        Target = DescEnd;
+        break;
+      }
+    }
+
+    Target -= NumberOfBytes - 1;
+    return ((Target & EFI_PAGE_MASK) != 0) ? 0 : Target;
+  }
+
+  //
+  // Check the red-black properties and the spans of a subtree, and return
+  // its black height
+  //
+  UINTN
+  CheckSubtree (
+    RANGE_INDEX_NODE                 *Node,
+    std::vector<RANGE_INDEX_NODE *>  &InOrder
+    )
+  {
+    UINTN   LeftHeight;
+    UINTN   RightHeight;
+    UINT64  MaxSpan;
+
+    if (Node == NULL) {
+      return 1;
+    }
+
+    MaxSpan = Node->End - Node->Start;
+    if (Node->Left != NULL) {
+      EXPECT_EQ (Node->Left->Parent, Node);
+      EXPECT_FALSE (Node->Red && Node->Left->Red);
+      MaxSpan = MAX (MaxSpan, Node->Left->MaxSpan);
+    }
+
+    LeftHeight = CheckSubtree (Node->Left, InOrder);
+    InOrder.push_back (Node);
+
+    if (Node->Right != NULL) {
+      EXPECT_EQ (Node->Right->Parent, Node);
+      EXPECT_FALSE (Node->Red && Node->Right->Red);
+      MaxSpan = MAX (MaxSpan, Node->Right->MaxSpan);
+    }
+
+    RightHeight = CheckSubtree (Node->Right, InOrder);
+
+    EXPECT_EQ (LeftHeight, RightHeight);
+    EXPECT_EQ (Node->MaxSpan, MaxSpan);
+    return LeftHeight + (Node->Red ? 0 : 1);
+  }
+
+  void
+  CheckIndexes (
+    VOID
+    )
+  {
+    std::vector<RANGE_INDEX_NODE *>  InOrder;
+    std::vector<RANGE_INDEX_NODE *>  FreeInOrder;
+    std::vector<RANGE_INDEX_NODE *>  Expected;
+    std::vector<RANGE_INDEX_NODE *>  FreeExpected;
+
+    ASSERT_NE (MapIndex.Root, (RANGE_INDEX_NODE *)NULL);
+    EXPECT_FALSE (MapIndex.Root->Red);
+    EXPECT_EQ (MapIndex.Root->Parent, (RANGE_INDEX_NODE *)NULL);
+    CheckSubtree (MapIndex.Root, InOrder);
+    CheckSubtree (FreeIndex.Root, FreeInOrder);
+
+    for (auto &Item : Map) {
+      Expected.push_back (&Item.second->MapNode);
+      if (Item.second->Type == FREE_TYPE) {
+        FreeExpected.push_back (&Item.second->FreeNode);
+      }
+    }
+
+    EXPECT_EQ (InOrder, Expected);
+    EXPECT_EQ (FreeInOrder, FreeExpected);
+  }
+};
+
+//
+// Random allocations and frees with random limits and alignments. Both
+// searches must find the same pages for every request.
+//
+TEST_F (RangeIndexTest, RandomConversions) {
+  UINTN           Operation;
+  UINTN           Victim;
+  UINT64          Pages;
+  UINT64          MaxAddress;
+  UINT64          MinAddress;
+  UINT64          Address;
+  UINTN           Alignment;
+  UINT64          Target;
+  MAP_ALLOCATION  Allocation;
+
+  AddDescriptor (FREE_TYPE, MAP_BASE, MAP_BASE + MAP_PAGES * EFI_PAGE_SIZE - 1);
+
+  for (Operation = 0; Operation < MAP_OPERATIONS; Operation++) {
+    if ((Allocations.size () > 0) && ((Random () % 100) < 45)) {
+      Victim     = Random () % Allocations.size ();
+      Allocation = Allocations[Victim];
+      Allocations.erase (Allocations.begin () + Victim);
+      ConvertRange (Allocation.Start, Allocation.Start + Allocation.Pages * EFI_PAGE_SIZE - 1, FREE_TYPE);
+    } else {
+      Pages      = ((Random () % 8) == 0) ? 1 + Random () % 512 : 1 + Random () % 16;
+      Alignment  = EFI_PAGE_SIZE << (((Random () % 4) == 0) ? Random () % 5 : 0);
+      MaxAddress = ((Random () % 4) == 0) ? MAP_BASE + (Random () % MAP_PAGES) * EFI_PAGE_SIZE - 1 : MAX_UINT64;
+      MinAddress = ((Random () % 8) == 0) ? MAP_BASE + (Random () % MAP_PAGES) * EFI_PAGE_SIZE : 0;
+
+      Target = IndexFindFreePages (MaxAddress, MinAddress, Pages, Alignment);
+      ASSERT_EQ (Target, LinearFindFreePages (MaxAddress, MinAddress, Pages, Alignment));
+      if (Target != 0) {
+        ConvertRange (Target, Target + Pages * EFI_PAGE_SIZE - 1, 1 + Random () % 3);
+        Allocations.push_back ({ Target, Pages });
+      }
+    }
+
+    Address = MAP_BASE + (Random () % (MAP_PAGES + 16)) * EFI_PAGE_SIZE + Random () % EFI_PAGE_SIZE;
+    EXPECT_EQ (IndexLookup (Address), LinearLookup (Address));
+
+    if ((Operation % 256) == 0) {
+      CheckIndexes ();
+    }
+  }
+
+  CheckIndexes ();
+}
+
+//
+// Ranges that cover the whole 64-bit address space, as the first entry of a
+// GCD map may, must not overflow the spans
+//
+TEST_F (RangeIndexTest, WholeAddressSpace) {
+  MAP_DESCRIPTOR  *Descriptor;
+
+  AddDescriptor (FREE_TYPE, 0, MAX_UINT64);
+  EXPECT_EQ (MapIndex.Root->MaxSpan, MAX_UINT64);
+  EXPECT_EQ (IndexLookup (0), Map[0]);
+  EXPECT_EQ (IndexLookup (MAX_UINT64), Map[0]);
+  EXPECT_EQ (RangeIndexFindTopDown (&FreeIndex, MAX_UINT64, SIZE_4GB), &Map[0]->FreeNode);
+  EXPECT_EQ (RangeIndexFindTopDown (&FreeIndex, SIZE_4GB - 1, SIZE_4GB), &Map[0]->FreeNode);
+  EXPECT_EQ (RangeIndexFindTopDown (&FreeIndex, SIZE_4GB - 2, SIZE_4GB), (RANGE_INDEX_NODE *)NULL);
+
+  ConvertRange (SIZE_4GB, SIZE_8GB - 1, 1);
+  CheckIndexes ();
+  EXPECT_EQ (Map.size (), 3U);
+
+  Descriptor = IndexLookup (SIZE_8GB);
+  ASSERT_NE (Descriptor, (MAP_DESCRIPTOR *)NULL);
+  EXPECT_EQ (Descriptor->End, MAX_UINT64);
+  EXPECT_EQ (RangeIndexFindTopDown (&FreeIndex, SIZE_8GB - 1, SIZE_4GB), &Map[0]->FreeNode);
+
+  ConvertRange (SIZE_4GB, SIZE_8GB - 1, FREE_TYPE);
+  CheckIndexes ();
+  EXPECT_EQ (Map.size (), 1U);
+}
+
+//
+// A map fragmented into thousands of descriptors, with the only range
+// large enough for the request at its bottom
+//
+TEST_F (RangeIndexTest, FragmentedMap) {
+  UINT64  Address;
+  UINTN   Index;
+  UINT64  Target;
+  UINT64  Sum;
+
+  AddDescriptor (FREE_TYPE, MAP_BASE, MAP_BASE + SIZE_16MB - 1);
+  for (Address = MAP_BASE + SIZE_16MB; Address < MAP_BASE + SIZE_16MB + 4000 * SIZE_8KB; Address += SIZE_8KB) {
+    AddDescriptor (1, Address, Address + EFI_PAGE_SIZE - 1);
+    AddDescriptor (FREE_TYPE, Address + EFI_PAGE_SIZE, Address + SIZE_8KB - 1);
+  }
+
+  CheckIndexes ();
+
+  Sum        = 0;
+  auto  Start = std::chrono::steady_clock::now ();
+  for (Index = 0; Index < 1000; Index++) {
+    Sum += LinearFindFreePages (MAX_UINT64, 0, 16, EFI_PAGE_SIZE);
+  }
+
+  auto  Linear = std::chrono::steady_clock::now () - Start;
+
+  Start = std::chrono::steady_clock::now ();
+  for (Index = 0; Index < 1000; Index++) {
+    Target = IndexFindFreePages (MAX_UINT64, 0, 16, EFI_PAGE_SIZE);
+    Sum   -= Target;
+  }
+
+  auto  Indexed = std::chrono::steady_clock::now () - Start;
+
+  EXPECT_EQ (Sum, 0U);
+  EXPECT_EQ (Target, MAP_BASE + SIZE_16MB - 16 * EFI_PAGE_SIZE);
+
+  std::printf (
+    "%u descriptors: list walk %.0f ns, index %.0f ns per search\n",
+    (unsigned)Map.size (),
+    (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Linear).count () / 1000,
+    (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Indexed).count () / 1000
+    );
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
@@ -0,0 +1,604 @@
+/** @file
+  Address range index of the DXE Core.
+
+  A red-black tree of non-overlapping address ranges, keyed by their start
+  address. Each node also records the largest span found in its subtree, so
+  that the highest range large enough for a request can be found without
+  visiting the smaller ones.
+
+  The nodes are embedded in the descriptors they index. The tree never
+  allocates memory, so it can be used by the page allocator and the GCD
+  services while they hold their locks.
+
+Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "DxeMain.h"
+
+/**
+  Return TRUE if Node is a red node. Leaves are black.
+
+  @param  Node               The node to check, or NULL.
+
+**/
+STATIC
+BOOLEAN
+RangeIndexIsRed (
+  IN RANGE_INDEX_NODE  *Node
+  )
+{
+  return (BOOLEAN)((Node != NULL) && Node->Red);
+}
+
+/**
+  Recompute the largest span of the subtree of Node from its children.
+
+  @param  Node               The node to update.
+
+**/
+STATIC
+VOID
+RangeIndexUpdateSpan (
+  IN RANGE_INDEX_NODE  *Node
+  )
+{
+  UINT64  MaxSpan;
+
+  MaxSpan = Node->End - Node->Start;
+  if ((Node->Left != NULL) && (Node->Left->MaxSpan > MaxSpan)) {
+    MaxSpan = Node->Left->MaxSpan;
+  }
+
+  if ((Node->Right != NULL) && (Node->Right->MaxSpan > MaxSpan)) {
+    MaxSpan = Node->Right->MaxSpan;
+  }
+
+  Node->MaxSpan = MaxSpan;
+}
+
+/**
+  Recompute the largest span of Node and all of its ancestors.
+
+  @param  Node               The lowest node to update, or NULL.
+
+**/
+STATIC
+VOID
+RangeIndexPropagateSpan (
+  IN RANGE_INDEX_NODE  *Node
+  )
+{
+  while (Node != NULL) {
+    RangeIndexUpdateSpan (Node);
+    Node = Node->Parent;
+  }
+}
+
+/**
+  Replace the subtree rooted at Node with the subtree rooted at Child.
+
+  @param  Index              The range index.
+  @param  Node               The node to replace.
+  @param  Child              The replacement, or NULL.
+
+**/
+STATIC
+VOID
+RangeIndexTransplant (
+  IN RANGE_INDEX       *Index,
+  IN RANGE_INDEX_NODE  *Node,
+  IN RANGE_INDEX_NODE  *Child
+  )
+{
+  if (Node->Parent == NULL) {
+    Index->Root = Child;
+  } else if (Node == Node->Parent->Left) {
+    Node->Parent->Left = Child;
+  } else {
+    Node->Parent->Right = Child;
+  }
+
+  if (Child != NULL) {
+    Child->Parent = Node->Parent;
+  }
+}
+
+/**
+  Rotate the subtree rooted at Node to the left.
+
+  @param  Index              The range index.
+  @param  Node               The root of the subtree, which has a right child.
+
+**/
+STATIC
+VOID
+RangeIndexRotateLeft (
+  IN RANGE_INDEX       *Index,
+  IN RANGE_INDEX_NODE  *Node
+  )
+{
+  RANGE_INDEX_NODE  *Right;
+
+  Right       = Node->Right;
+  Node->Right = Right->Left;
+  if (Right->Left != NULL) {
+    Right->Left->Parent = Node;
+  }
+
+  RangeIndexTransplant (Index, Node, Right);
+  Right->Left  = Node;
+  Node->Parent = Right;
+
+  RangeIndexUpdateSpan (Node);
+  RangeIndexUpdateSpan (Right);
+}
+
+/**
+  Rotate the subtree rooted at Node to the right.
+
+  @param  Index              The range index.
+  @param  Node               The root of the subtree, which has a left child.
+
+**/
+STATIC
+VOID
+RangeIndexRotateRight (
+  IN RANGE_INDEX       *Index,
+  IN RANGE_INDEX_NODE  *Node
+  )
+{
+  RANGE_INDEX_NODE  *Left;
+
+  Left       = Node->Left;
+  Node->Left = Left->Right;
+  if (Left->Right != NULL) {
+    Left->Right->Parent = Node;
+  }
+
+  RangeIndexTransplant (Index, Node, Left);
+  Left->Right  = Node;
+  Node->Parent = Left;
+
+  RangeIndexUpdateSpan (Node);
+  RangeIndexUpdateSpan (Left);
+}
+
+/**
+  Add a range to the index. The range must not overlap any range already in
+  the index.
+
+  @param  Index              The range index.
+  @param  Node               The node of the range, embedded in its descriptor.
+  @param  Start              The first address of the range.
+  @param  End                The last address of the range.
+
+**/
+VOID
+RangeIndexInsert (
+  IN RANGE_INDEX       *Index,
+  IN RANGE_INDEX_NODE  *Node,
+  IN UINT64            Start,
+  IN UINT64            End
+  )
+{
+  RANGE_INDEX_NODE  *Parent;
+  RANGE_INDEX_NODE  *Current;
+  RANGE_INDEX_NODE  *Uncle;
+
+  ASSERT (Start <= End);
+
+  Node->Start   = Start;
+  Node->End     = End;
+  Node->MaxSpan = End - Start;
+  Node->Left    = NULL;
+  Node->Right   = NULL;
+  Node->Red     = TRUE;
+
+  Parent  = NULL;
+  Current = Index->Root;
+  while (Current != NULL) {
+    ASSERT ((End < Current->Start) || (Start > Current->End));
+    Parent  = Current;
+    Current = (Start < Current->Start) ? Current->Left : Current->Right;
+  }
+
+  Node->Parent = Parent;
+  if (Parent == NULL) {
+    Index->Root = Node;
+  } else if (Start < Parent->Start) {
+    Parent->Left = Node;
+  } else {
+    Parent->Right = Node;
+  }
+
+  RangeIndexPropagateSpan (Parent);
+
+  //
+  // Restore the red-black properties
+  //
+  while (RangeIndexIsRed (Node->Parent)) {
+    Parent = Node->Parent;
+    if (Parent == Parent->Parent->Left) {
+      Uncle = Parent->Parent->Right;
+      if (RangeIndexIsRed (Uncle)) {
+        Parent->Red         = FALSE;
+        Uncle->Red          = FALSE;
+        Parent->Parent->Red = TRUE;
+        Node                = Parent->Parent;
+        continue;
+      }
+
+      if (Node == Parent->Right) {
+        Node = Parent;
+        RangeIndexRotateLeft (Index, Node);
+        Parent = Node->Parent;
+      }
+
+      Parent->Red         = FALSE;
+      Parent->Parent->Red = TRUE;
+      RangeIndexRotateRight (Index, Parent->Parent);
+    } else {
+      Uncle = Parent->Parent->Left;
+      if (RangeIndexIsRed (Uncle)) {
+        Parent->Red         = FALSE;
+        Uncle->Red          = FALSE;
+        Parent->Parent->Red = TRUE;
+        Node                = Parent->Parent;
+        continue;
+      }
+
+      if (Node == Parent->Left) {
+        Node = Parent;
+        RangeIndexRotateRight (Index, Node);
+        Parent = Node->Parent;
+      }
+
+      Parent->Red         = FALSE;
+      Parent->Parent->Red = TRUE;
+      RangeIndexRotateLeft (Index, Parent->Parent);
+    }
+  }
+
+  Index->Root->Red = FALSE;
+}
+
+/**
+  Remove a range from the index.
+
+  @param  Index              The range index.
+  @param  Node               The node of the range.
+
+**/
+VOID
+RangeIndexRemove (
+  IN RANGE_INDEX       *Index,
+  IN RANGE_INDEX_NODE  *Node
+  )
+{
+  RANGE_INDEX_NODE  *Child;
+  RANGE_INDEX_NODE  *ChildParent;
+  RANGE_INDEX_NODE  *Next;
+  RANGE_INDEX_NODE  *Sibling;
+  BOOLEAN           RemovedRed;
+
+  RemovedRed = Node->Red;
+  if (Node->Left == NULL) {
+    Child       = Node->Right;
+    ChildParent = Node->Parent;
+    RangeIndexTransplant (Index, Node, Child);
+  } else if (Node->Right == NULL) {
+    Child       = Node->Left;
+    ChildParent = Node->Parent;
+    RangeIndexTransplant (Index, Node, Child);
+  } else {
+    //
+    // Move the successor of Node into its place
+    //
+    Next = Node->Right;
+    while (Next->Left != NULL) {
+      Next = Next->Left;
+    }
+
+    RemovedRed = Next->Red;
+    Child      = Next->Right;
+    if (Next->Parent == Node) {
+      ChildParent = Next;
+    } else {
+      ChildParent = Next->Parent;
+      RangeIndexTransplant (Index, Next, Child);
+      Next->Right         = Node->Right;
+      Next->Right->Parent = Next;
+    }
+
+    RangeIndexTransplant (Index, Node, Next);
+    Next->Left         = Node->Left;
+    Next->Left->Parent = Next;
+    Next->Red          = Node->Red;
+  }
+
+  Node->Parent = NULL;
+  Node->Left   = NULL;
+  Node->Right  = NULL;
+
+  RangeIndexPropagateSpan (ChildParent);
+
+  if (RemovedRed) {
+    return;
+  }
+
+  //
+  // Restore the red-black properties
+  //
+  while ((Child != Index->Root) && !RangeIndexIsRed (Child)) {
+    if (Child == ChildParent->Left) {
+      Sibling = ChildParent->Right;
+      if (RangeIndexIsRed (Sibling)) {
+        Sibling->Red     = FALSE;
+        ChildParent->Red = TRUE;
+        RangeIndexRotateLeft (Index, ChildParent);
+        Sibling = ChildParent->Right;
+      }
+
+      if (!RangeIndexIsRed (Sibling->Left) && !RangeIndexIsRed (Sibling->Right)) {
+        Sibling->Red = TRUE;
+        Child        = ChildParent;
+        ChildParent  = Child->Parent;
+        continue;
+      }
+
+      if (!RangeIndexIsRed (Sibling->Right)) {
+        Sibling->Left->Red = FALSE;
+        Sibling->Red       = TRUE;
+        RangeIndexRotateRight (Index, Sibling);
+        Sibling = ChildParent->Right;
+      }
+
+      Sibling->Red        = ChildParent->Red;
+      ChildParent->Red    = FALSE;
+      Sibling->Right->Red = FALSE;
+      RangeIndexRotateLeft (Index, ChildParent);
+    } else {
+      Sibling = ChildParent->Left;
+      if (RangeIndexIsRed (Sibling)) {
+        Sibling->Red     = FALSE;
+        ChildParent->Red = TRUE;
+        RangeIndexRotateRight (Index, ChildParent);
+        Sibling = ChildParent->Left;
+      }
+
+      if (!RangeIndexIsRed (Sibling->Left) && !RangeIndexIsRed (Sibling->Right)) {
+        Sibling->Red = TRUE;
+        Child        = ChildParent;
+        ChildParent  = Child->Parent;
+        continue;
+      }
+
+      if (!RangeIndexIsRed (Sibling->Left)) {
+        Sibling->Right->Red = FALSE;
+        Sibling->Red        = TRUE;
+        RangeIndexRotateLeft (Index, Sibling);
+        Sibling = ChildParent->Left;
+      }
+
+      Sibling->Red       = ChildParent->Red;
+      ChildParent->Red   = FALSE;
+      Sibling->Left->Red = FALSE;
+      RangeIndexRotateRight (Index, ChildParent);
+    }
+
+    Child = Index->Root;
+  }
+
+  if (Child != NULL) {
+    Child->Red = FALSE;
+  }
+}
+
+/**
+  Change the bounds of a range in the index. The new bounds must keep the
+  range between its neighbours, as when a descriptor is clipped or merged in
+  place.
+
+  @param  Index              The range index.
+  @param  Node               The node of the range.
+  @param  Start              The new first address of the range.
+  @param  End                The new last address of the range.
+
+**/
+VOID
+RangeIndexUpdate (
+  IN RANGE_INDEX       *Index,
+  IN RANGE_INDEX_NODE  *Node,
+  IN UINT64            Start,
+  IN UINT64            End
+  )
+{
+  ASSERT (Start <= End);
+  ASSERT ((RangeIndexPrevious (Node) == NULL) || (RangeIndexPrevious (Node)->End < Start));
+  ASSERT ((RangeIndexNext (Node) == NULL) || (RangeIndexNext (Node)->Start > End));
+
+  Node->Start = Start;
+  Node->End   = End;
+  RangeIndexPropagateSpan (Node);
+}
+
+/**
+  Find the range that contains an address.
+
+  @param  Index              The range index.
+  @param  Address            The address to look up.
+
+  @return The node of the range that contains Address, or NULL.
+
+**/
+RANGE_INDEX_NODE *
+RangeIndexLookup (
+  IN RANGE_INDEX  *Index,
+  IN UINT64       Address
+  )
+{
+  RANGE_INDEX_NODE  *Node;
+
+  Node = Index->Root;
+  while (Node != NULL) {
+    if (Address < Node->Start) {
+      Node = Node->Left;
+    } else if (Address > Node->End) {
+      Node = Node->Right;
+    } else {
+      break;
+    }
+  }
+
+  return Node;
+}
+
+/**
+  Return the range that follows a range in address order.
+
+  @param  Node               The node of the range.
+
+  @return The node of the next range, or NULL if Node is the last one.
+
+**/
+RANGE_INDEX_NODE *
+RangeIndexNext (
+  IN RANGE_INDEX_NODE  *Node
+  )
+{
+  if (Node->Right != NULL) {
+    Node = Node->Right;
+    while (Node->Left != NULL) {
+      Node = Node->Left;
+    }
+
+    return Node;
+  }
+
+  while ((Node->Parent != NULL) && (Node == Node->Parent->Right)) {
+    Node = Node->Parent;
+  }
+
+  return Node->Parent;
+}
+
+/**
+  Return the range that precedes a range in address order.
+
+  @param  Node               The node of the range.
+
+  @return The node of the previous range, or NULL if Node is the first one.
+
+**/
+RANGE_INDEX_NODE *
+RangeIndexPrevious (
+  IN RANGE_INDEX_NODE  *Node
+  )
+{
+  if (Node->Left != NULL) {
+    Node = Node->Left;
+    while (Node->Right != NULL) {
+      Node = Node->Right;
+    }
+
+    return Node;
+  }
+
+  while ((Node->Parent != NULL) && (Node == Node->Parent->Left)) {
+    Node = Node->Parent;
+  }
+
+  return Node->Parent;
+}
+
+/**
+  Find the last range of a subtree that starts below an address and spans at
+  least a number of bytes.
+
+  @param  Node               The root of the subtree.
+  @param  Below              The ranges must start below this address.
+  @param  Span               The minimum span, the size in bytes minus one.
+
+  @return The node of the range, or NULL.
+
+**/
+STATIC
+RANGE_INDEX_NODE *
+RangeIndexFindLast (
+  IN RANGE_INDEX_NODE  *Node,
+  IN UINT64            Below,
+  IN UINT64            Span
+  )
+{
+  RANGE_INDEX_NODE  *Found;
+
+  while ((Node != NULL) && (Node->MaxSpan >= Span)) {
+    if (Node->Start < Below) {
+      Found = RangeIndexFindLast (Node->Right, Below, Span);
+      if (Found != NULL) {
+        return Found;
+      }
+
+      if (Node->End - Node->Start >= Span) {
+        return Node;
+      }
+    }
+
+    Node = Node->Left;
+  }
+
+  return NULL;
+}
+
+/**
+  Find the highest range that holds Length bytes at or below Limit.
+
+  The range that contains Limit is only considered up to Limit. All other
+  candidates lie entirely below it. Callers that reject the returned range
+  continue the search with a Limit just below its start.
+
+  @param  Index              The range index.
+  @param  Limit              The last address that may be used.
+  @param  Length             The number of bytes needed, not zero.
+
+  @return The node of the range, or NULL if no range is large enough.
+
+**/
+RANGE_INDEX_NODE *
+RangeIndexFindTopDown (
+  IN RANGE_INDEX  *Index,
+  IN UINT64       Limit,
+  IN UINT64       Length
+  )
+{
+  RANGE_INDEX_NODE  *Node;
+  RANGE_INDEX_NODE  *Floor;
+
+  ASSERT (Length != 0);
+
+  //
+  // Find the last range that starts at or below Limit
+  //
+  Floor = NULL;
+  Node  = Index->Root;
+  while (Node != NULL) {
+    if (Node->Start > Limit) {
+      Node = Node->Left;
+    } else {
+      Floor = Node;
+      Node  = Node->Right;
+    }
+  }
+
+  if (Floor == NULL) {
+    return NULL;
+  }
+
+  if (MIN (Floor->End, Limit) - Floor->Start >= Length - 1) {
+    return Floor;
+  }
+
+  return RangeIndexFindLast (Index->Root, Floor->Start, Length - 1);
+}
@@ -0,0 +1,143 @@
+/** @file
+  Address range index of the DXE Core.
+
+Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef RANGE_INDEX_H_
+#define RANGE_INDEX_H_
+
+//
+// Node of an address range index. The ranges of an index do not overlap and
+// are ordered by Start. MaxSpan is the largest End - Start of the subtree.
+//
+typedef struct _RANGE_INDEX_NODE RANGE_INDEX_NODE;
+struct _RANGE_INDEX_NODE {
+  RANGE_INDEX_NODE    *Parent;
+  RANGE_INDEX_NODE    *Left;
+  RANGE_INDEX_NODE    *Right;
+  UINT64              Start;
+  UINT64              End;
+  UINT64              MaxSpan;
+  BOOLEAN             Red;
+};
+
+typedef struct {
+  RANGE_INDEX_NODE    *Root;
+} RANGE_INDEX;
+
+/**
+  Add a range to the index. The range must not overlap any range already in
+  the index.
+
+  @param  Index              The range index.
+  @param  Node               The node of the range, embedded in its descriptor.
+  @param  Start              The first address of the range.
+  @param  End                The last address of the range.
+
+**/
+VOID
+RangeIndexInsert (
+  IN RANGE_INDEX       *Index,
+  IN RANGE_INDEX_NODE  *Node,
+  IN UINT64            Start,
+  IN UINT64            End
+  );
+
+/**
+  Remove a range from the index.
+
+  @param  Index              The range index.
+  @param  Node               The node of the range.
+
+**/
+VOID
+RangeIndexRemove (
+  IN RANGE_INDEX       *Index,
+  IN RANGE_INDEX_NODE  *Node
+  );
+
+/**
+  Change the bounds of a range in the index. The new bounds must keep the
+  range between its neighbours, as when a descriptor is clipped or merged in
+  place.
+
+  @param  Index              The range index.
+  @param  Node               The node of the range.
+  @param  Start              The new first address of the range.
+  @param  End                The new last address of the range.
+
+**/
+VOID
+RangeIndexUpdate (
+  IN RANGE_INDEX       *Index,
+  IN RANGE_INDEX_NODE  *Node,
+  IN UINT64            Start,
+  IN UINT64            End
+  );
+
+/**
+  Find the range that contains an address.
+
+  @param  Index              The range index.
+  @param  Address            The address to look up.
+
+  @return The node of the range that contains Address, or NULL.
+
+**/
+RANGE_INDEX_NODE *
+RangeIndexLookup (
+  IN RANGE_INDEX  *Index,
+  IN UINT64       Address
+  );
+
+/**
+  Return the range that follows a range in address order.
+
+  @param  Node               The node of the range.
+
+  @return The node of the next range, or NULL if Node is the last one.
+
+**/
+RANGE_INDEX_NODE *
+RangeIndexNext (
+  IN RANGE_INDEX_NODE  *Node
+  );
+
+/**
+  Return the range that precedes a range in address order.
+
+  @param  Node               The node of the range.
+
+  @return The node of the previous range, or NULL if Node is the first one.
+
+**/
+RANGE_INDEX_NODE *
+RangeIndexPrevious (
+  IN RANGE_INDEX_NODE  *Node
+  );
+
+/**
+  Find the highest range that holds Length bytes at or below Limit.
+
+  The range that contains Limit is only considered up to Limit. All other
+  candidates lie entirely below it. Callers that reject the returned range
+  continue the search with a Limit just below its start.
+
+  @param  Index              The range index.
+  @param  Limit              The last address that may be used.
+  @param  Length             The number of bytes needed, not zero.
+
+  @return The node of the range, or NULL if no range is large enough.
+
+**/
+RANGE_INDEX_NODE *
+RangeIndexFindTopDown (
+  IN RANGE_INDEX  *Index,
+  IN UINT64       Limit,
+  IN UINT64       Length
+  );
+
+#endif
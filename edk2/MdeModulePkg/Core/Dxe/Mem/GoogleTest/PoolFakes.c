@@ -0,0 +1,196 @@
+/** @file
+  Fakes of the services of the DXE core that Pool.c calls and the host test
+  does not build: the page allocator, which takes the pool pages from the
+  host heap and counts them for the fragmentation report, and heap guard,
+  which is off. The locks are the ones of Library.c, the TPL is the one of
+  UnitTestUefiBootServicesTableLib.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "DxeMain.h"
+#include "Imem.h"
+#include "HeapGuard.h"
+
+EFI_LOCK  gMemoryLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_NOTIFY);
+BOOLEAN   mOnGuarding = FALSE;
+
+UINTN  mPoolFakePages;
+UINTN  mPoolFakePeakPages;
+UINTN  mPoolFakePageCalls;
+
+EFI_TPL
+EFIAPI
+CoreRaiseTpl (
+  IN EFI_TPL  NewTpl
+  )
+{
+  return gBS->RaiseTPL (NewTpl);
+}
+
+VOID
+EFIAPI
+CoreRestoreTpl (
+  IN EFI_TPL  NewTpl
+  )
+{
+  gBS->RestoreTPL (NewTpl);
+}
+
+VOID
+CoreAcquireMemoryLock (
+  VOID
+  )
+{
+  CoreAcquireLock (&gMemoryLock);
+}
+
+VOID
+CoreReleaseMemoryLock (
+  VOID
+  )
+{
+  CoreReleaseLock (&gMemoryLock);
+}
+
+VOID *
+CoreAllocatePoolPages (
+  IN EFI_MEMORY_TYPE  PoolType,
+  IN UINTN            NumberOfPages,
+  IN UINTN            Alignment,
+  IN BOOLEAN          NeedGuard
+  )
+{
+  VOID  *Buffer;
+
+  mPoolFakePageCalls++;
+  Buffer = AllocateAlignedPages (NumberOfPages, Alignment);
+  if (Buffer != NULL) {
+    mPoolFakePages    += NumberOfPages;
+    mPoolFakePeakPages = MAX (mPoolFakePeakPages, mPoolFakePages);
+  }
+
+  return Buffer;
+}
+
+VOID
+CoreFreePoolPages (
+  IN EFI_PHYSICAL_ADDRESS  Memory,
+  IN UINTN                 NumberOfPages
+  )
+{
+  ASSERT (mPoolFakePages >= NumberOfPages);
+  mPoolFakePageCalls++;
+  mPoolFakePages -= NumberOfPages;
+  FreeAlignedPages ((VOID *)(UINTN)Memory, NumberOfPages);
+}
+
+BOOLEAN
+IsHeapGuardEnabled (
+  UINT8  GuardType
+  )
+{
+  return FALSE;
+}
+
+BOOLEAN
+IsPoolTypeToGuard (
+  IN EFI_MEMORY_TYPE  MemoryType
+  )
+{
+  return FALSE;
+}
+
+BOOLEAN
+EFIAPI
+IsMemoryGuarded (
+  IN EFI_PHYSICAL_ADDRESS  Address
+  )
+{
+  return FALSE;
+}
+
+VOID
+SetGuardForMemory (
+  IN EFI_PHYSICAL_ADDRESS  Memory,
+  IN UINTN                 NumberOfPages
+  )
+{
+}
+
+VOID
+UnsetGuardForMemory (
+  IN EFI_PHYSICAL_ADDRESS  Memory,
+  IN UINTN                 NumberOfPages
+  )
+{
+}
+
+VOID
+AdjustMemoryF (
+  IN OUT EFI_PHYSICAL_ADDRESS  *Memory,
+  IN OUT UINTN                 *NumberOfPages
+  )
+{
+}
+
+VOID *
+AdjustPoolHeadA (
+  IN EFI_PHYSICAL_ADDRESS  Memory,
+  IN UINTN                 NoPages,
+  IN UINTN                 Size
+  )
+{
+  return (VOID *)(UINTN)Memory;
+}
+
+VOID *
+AdjustPoolHeadF (
+  IN EFI_PHYSICAL_ADDRESS  Memory
+  )
+{
+  return (VOID *)(UINTN)Memory;
+}
+
+VOID
+EFIAPI
+GuardFreedPagesChecked (
+  IN  EFI_PHYSICAL_ADDRESS  BaseAddress,
+  IN  UINTN                 Pages
+  )
+{
+}
+
+EFI_STATUS
+EFIAPI
+ApplyMemoryProtectionPolicy (
+  IN  EFI_MEMORY_TYPE       OldType,
+  IN  EFI_MEMORY_TYPE       NewType,
+  IN  EFI_PHYSICAL_ADDRESS  Memory,
+  IN  UINT64                Length
+  )
+{
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+CoreUpdateProfile (
+  IN EFI_PHYSICAL_ADDRESS   CallerAddress,
+  IN MEMORY_PROFILE_ACTION  Action,
+  IN EFI_MEMORY_TYPE        MemoryType,
+  IN UINTN                  Size,
+  IN VOID                   *Buffer,
+  IN CHAR8                  *ActionString OPTIONAL
+  )
+{
+  return EFI_SUCCESS;
+}
+
+VOID
+InstallMemoryAttributesTableOnMemoryAllocation (
+  IN EFI_MEMORY_TYPE  MemoryType
+  )
+{
+}
@@ -0,0 +1,324 @@
+/** @file
+  Host stress benchmark of the pool allocator of the DXE core.
+
+  Pool.c runs on top of the fake page allocator of PoolFakes.c. A random
+  trace shaped like the pool traffic of a DXE boot is replayed against it,
+  with every buffer filled and checked, and the pages the pool holds are
+  compared with the bytes handed out to report fragmentation.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+#include <Library/GoogleTestLib.h>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+extern "C" {
+  #include <Uefi.h>
+  #include <Library/BaseLib.h>
+  #include <Library/BaseMemoryLib.h>
+
+  //
+  // The pages the pool holds from the fake page allocator, their peak, and
+  // the number of calls into the page allocator
+  //
+  extern UINTN  mPoolFakePages;
+  extern UINTN  mPoolFakePeakPages;
+  extern UINTN  mPoolFakePageCalls;
+
+  VOID
+  CoreInitializePool (
+    VOID
+    );
+
+  EFI_STATUS
+  EFIAPI
+  CoreInternalAllocatePool (
+    IN EFI_MEMORY_TYPE  PoolType,
+    IN UINTN            Size,
+    OUT VOID            **Buffer
+    );
+
+  EFI_STATUS
+  EFIAPI
+  CoreInternalFreePool (
+    IN VOID              *Buffer,
+    OUT EFI_MEMORY_TYPE  *PoolType OPTIONAL
+    );
+}
+
+using namespace testing;
+
+#define STRESS_OPERATIONS  400000
+#define STRESS_LIVE_MAX    4096
+#define STRESS_WARMUP      SIZE_1MB
+
+typedef struct {
+  UINT8              *Buffer;
+  UINTN              Size;
+  EFI_MEMORY_TYPE    Type;
+  UINT8              Tag;
+} STRESS_BLOCK;
+
+class PoolStressTest : public Test {
+protected:
+  std::vector<STRESS_BLOCK>    Live;
+  UINTN                        LiveBytes;
+  UINTN                        PeakLiveBytes;
+  UINT32                       Seed;
+
+  UINT32
+  Random (
+    VOID
+    )
+  {
+    Seed = Seed * 1103515245 + 12345;
+    return Seed >> 8;
+  }
+
+  //
+  // Mostly small buffers: 70% up to 512 bytes, 20% up to 4 KB, 8% mid-size
+  // up to 48 KB and 2% large ones up to 128 KB
+  //
+  UINTN
+  RandomSize (
+    VOID
+    )
+  {
+    UINT32  Class;
+
+    Class = Random () % 100;
+    if (Class < 70) {
+      return 1 + Random () % 512;
+    } else if (Class < 90) {
+      return 513 + Random () % (SIZE_4KB - 512);
+    } else if (Class < 98) {
+      return SIZE_4KB + 1 + Random () % (48 * SIZE_1KB - SIZE_4KB);
+    }
+
+    return 48 * SIZE_1KB + 1 + Random () % (80 * SIZE_1KB);
+  }
+
+  //
+  // Most pool is boot services data, some of it runtime and ACPI
+  //
+  EFI_MEMORY_TYPE
+  RandomType (
+    VOID
+    )
+  {
+    UINT32  Class;
+
+    Class = Random () % 100;
+    if (Class < 90) {
+      return EfiBootServicesData;
+    } else if (Class < 95) {
+      return EfiRuntimeServicesData;
+    }
+
+    return EfiACPIReclaimMemory;
+  }
+
+  void
+  SetUp (
+    ) override
+  {
+    Seed          = 0x5eed;
+    LiveBytes     = 0;
+    PeakLiveBytes = 0;
+    CoreInitializePool ();
+    mPoolFakePages     = 0;
+    mPoolFakePeakPages = 0;
+    mPoolFakePageCalls = 0;
+  }
+
+  void
+  Allocate (
+    IN UINTN            Size,
+    IN EFI_MEMORY_TYPE  Type
+    )
+  {
+    STRESS_BLOCK  Block;
+
+    Block.Size = Size;
+    Block.Type = Type;
+    Block.Tag  = (UINT8)Random ();
+    ASSERT_EQ (CoreInternalAllocatePool (Type, Size, (VOID **)&Block.Buffer), EFI_SUCCESS);
+    ASSERT_EQ ((UINTN)Block.Buffer & (sizeof (UINT64) - 1), (UINTN)0);
+    SetMem (Block.Buffer, Size, Block.Tag);
+
+    Live.push_back (Block);
+    LiveBytes    += Size;
+    PeakLiveBytes = MAX (PeakLiveBytes, LiveBytes);
+  }
+
+  void
+  Free (
+    IN UINTN  Index
+    )
+  {
+    STRESS_BLOCK     Block;
+    EFI_MEMORY_TYPE  Type;
+
+    Block = Live[Index];
+    ASSERT_EQ (Block.Buffer[0], Block.Tag);
+    ASSERT_EQ (Block.Buffer[Block.Size / 2], Block.Tag);
+    ASSERT_EQ (Block.Buffer[Block.Size - 1], Block.Tag);
+    ASSERT_EQ (CoreInternalFreePool (Block.Buffer, &Type), EFI_SUCCESS);
+    ASSERT_EQ (Type, Block.Type);
+
+    Live[Index] = Live.back ();
+    Live.pop_back ();
+    LiveBytes -= Block.Size;
+  }
+
+  void
+  FreeAll (
+    VOID
+    )
+  {
+    while (!Live.empty ()) {
+      Free (Live.size () - 1);
+    }
+  }
+};
+
+//
+// Replay the boot-like trace and report throughput and fragmentation
+//
+TEST_F (PoolStressTest, BootTrace) {
+  UINTN   Operation;
+  UINTN   HeldBytes;
+  double  Ratio;
+  double  WorstRatio;
+
+  WorstRatio = 0;
+
+  auto  Start = std::chrono::steady_clock::now ();
+
+  for (Operation = 0; Operation < STRESS_OPERATIONS; Operation++) {
+    if (Live.empty () || ((Live.size () < STRESS_LIVE_MAX) && (Random () % 100 < 55))) {
+      Allocate (RandomSize (), RandomType ());
+    } else {
+      Free (Random () % Live.size ());
+    }
+
+    if (HasFatalFailure ()) {
+      return;
+    }
+
+    if (((Operation % 1024) == 0) && (LiveBytes >= STRESS_WARMUP)) {
+      HeldBytes  = EFI_PAGES_TO_SIZE (mPoolFakePages);
+      Ratio      = (double)HeldBytes / (double)LiveBytes;
+      WorstRatio = MAX (WorstRatio, Ratio);
+    }
+  }
+
+  auto  Elapsed = std::chrono::steady_clock::now () - Start;
+
+  std::printf (
+    "  %u operations in %lld ms, %.0f ns per operation\n",
+    STRESS_OPERATIONS,
+    (long long)std::chrono::duration_cast<std::chrono::milliseconds>(Elapsed).count (),
+    (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Elapsed).count () / STRESS_OPERATIONS
+    );
+  std::printf (
+    "  %llu calls into the page allocator\n",
+    (unsigned long long)mPoolFakePageCalls
+    );
+  std::printf (
+    "  peak live %llu KB, peak pool pages %llu KB, worst held/live %.2f\n",
+    (unsigned long long)(PeakLiveBytes / SIZE_1KB),
+    (unsigned long long)(EFI_PAGES_TO_SIZE (mPoolFakePeakPages) / SIZE_1KB),
+    WorstRatio
+    );
+
+  FreeAll ();
+  ASSERT_FALSE (HasFatalFailure ());
+
+  std::printf (
+    "  pool pages still held after freeing everything: %llu\n",
+    (unsigned long long)mPoolFakePages
+    );
+
+  EXPECT_LT (WorstRatio, 2.0);
+  EXPECT_LE (EFI_PAGES_TO_SIZE (mPoolFakePeakPages), 2 * PeakLiveBytes);
+
+  //
+  // Only arenas pinned by blocks parked in the magazines may stay: at most
+  // 8 blocks in each of 4 lists of boot services data
+  //
+  EXPECT_LE (mPoolFakePages, (UINTN)(4 * 8 * EFI_SIZE_TO_PAGES (SIZE_32KB)));
+}
+
+//
+// Short-lived small buffers, the hot case the magazines are for
+//
+TEST_F (PoolStressTest, SmallChurn) {
+  UINTN  Operation;
+  VOID   *Buffer[8];
+  UINTN  Index;
+
+  auto  Start = std::chrono::steady_clock::now ();
+
+  for (Operation = 0; Operation < STRESS_OPERATIONS; Operation++) {
+    for (Index = 0; Index < ARRAY_SIZE (Buffer); Index++) {
+      ASSERT_EQ (CoreInternalAllocatePool (EfiBootServicesData, 16 + 64 * Index, &Buffer[Index]), EFI_SUCCESS);
+    }
+
+    for (Index = 0; Index < ARRAY_SIZE (Buffer); Index++) {
+      ASSERT_EQ (CoreInternalFreePool (Buffer[Index], NULL), EFI_SUCCESS);
+    }
+  }
+
+  auto  Elapsed = std::chrono::steady_clock::now () - Start;
+
+  std::printf (
+    "  %.1f ns per AllocatePool/FreePool pair\n",
+    (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Elapsed).count () / (STRESS_OPERATIONS * ARRAY_SIZE (Buffer))
+    );
+
+  EXPECT_LE (mPoolFakePeakPages, (UINTN)EFI_SIZE_TO_PAGES (SIZE_32KB));
+}
+
+//
+// Mid-size boot services pool shares an arena, other types take pages
+//
+TEST_F (PoolStressTest, MidSizeFromArena) {
+  Allocate (10000, EfiBootServicesData);
+  Allocate (10000, EfiBootServicesData);
+  ASSERT_FALSE (HasFatalFailure ());
+  EXPECT_EQ (mPoolFakePages, (UINTN)EFI_SIZE_TO_PAGES (SIZE_32KB));
+
+  Allocate (10000, EfiRuntimeServicesData);
+  ASSERT_FALSE (HasFatalFailure ());
+  EXPECT_EQ (mPoolFakePages, (UINTN)EFI_SIZE_TO_PAGES (SIZE_32KB) + EFI_SIZE_TO_PAGES (10000 + 40));
+
+  FreeAll ();
+  ASSERT_FALSE (HasFatalFailure ());
+  EXPECT_EQ (mPoolFakePages, (UINTN)0);
+}
+
+//
+// Every size up to the largest bin and a bit beyond
+//
+TEST_F (PoolStressTest, EverySize) {
+  UINTN  Size;
+
+  for (Size = 1; Size <= 64 * SIZE_1KB; Size += 7) {
+    Allocate (Size, EfiBootServicesData);
+    Free (0);
+    ASSERT_FALSE (HasFatalFailure ());
+  }
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
@@ -41,6 +41,9 @@ typedef struct {
 
   UINT64             VirtualStart;
   UINT64             Attribute;
+
+  RANGE_INDEX_NODE   MapNode;  ///< Node in the index of all descriptors
+  RANGE_INDEX_NODE   FreeNode; ///< Node in the index of EfiConventionalMemory descriptors
 } MEMORY_MAP;
 
 //
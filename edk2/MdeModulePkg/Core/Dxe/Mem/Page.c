@@ -44,6 +44,12 @@ UINTN       mFreeMapStack = 0;
 /// This list maintain the free memory map list
 ///
 LIST_ENTRY  mFreeMemoryMapEntryList           = INITIALIZE_LIST_HEAD_VARIABLE (mFreeMemoryMapEntryList);
+///
+/// mMemoryMapIndex  - all descriptors of gMemoryMap by address
+/// mFreeMemoryIndex - the EfiConventionalMemory descriptors of gMemoryMap by address
+///
+RANGE_INDEX  mMemoryMapIndex  = { NULL };
+RANGE_INDEX  mFreeMemoryIndex = { NULL };
 BOOLEAN     mMemoryTypeInformationInitialized = FALSE;
 
 EFI_MEMORY_TYPE_STATISTICS  mMemoryTypeStatistics[EfiMaxMemoryType + 1] = {
@@ -119,6 +125,71 @@ CoreReleaseMemoryLock (
   CoreReleaseLock (&gMemoryLock);
 }
 
+/**
+  Internal function.  Adds a descriptor entry of gMemoryMap to the indexes.
+
+  @param  Entry                  The entry to index
+
+**/
+STATIC
+VOID
+IndexMemoryMapEntry (
+  IN MEMORY_MAP  *Entry
+  )
+{
+  RangeIndexInsert (&mMemoryMapIndex, &Entry->MapNode, Entry->Start, Entry->End);
+  if (Entry->Type == EfiConventionalMemory) {
+    RangeIndexInsert (&mFreeMemoryIndex, &Entry->FreeNode, Entry->Start, Entry->End);
+  }
+}
+
+/**
+  Internal function.  Updates the indexes after a descriptor entry was
+  clipped in place.  An emptied entry is left to RemoveMemoryMapEntry().
+
+  @param  Entry                  The clipped entry
+
+**/
+STATIC
+VOID
+UpdateMemoryMapEntryIndex (
+  IN MEMORY_MAP  *Entry
+  )
+{
+  if (Entry->Start > Entry->End) {
+    return;
+  }
+
+  RangeIndexUpdate (&mMemoryMapIndex, &Entry->MapNode, Entry->Start, Entry->End);
+  if (Entry->Type == EfiConventionalMemory) {
+    RangeIndexUpdate (&mFreeMemoryIndex, &Entry->FreeNode, Entry->Start, Entry->End);
+  }
+}
+
+/**
+  Internal function.  Finds the descriptor entry that contains an address.
+
+  @param  Address                The address to look up
+
+  @return The entry that contains Address, or NULL if it is not in the map
+
+**/
+STATIC
+MEMORY_MAP *
+LookupMemoryMapEntry (
+  IN UINT64  Address
+  )
+{
+  RANGE_INDEX_NODE  *Node;
+
+  Node = RangeIndexLookup (&mMemoryMapIndex, Address);
+  if (Node == NULL) {
+    return NULL;
+  }
+
+  return CR (Node, MEMORY_MAP, MapNode, MEMORY_MAP_SIGNATURE);
+}
+
 /**
   Internal function.  Removes a descriptor entry.
 
@@ -130,6 +201,11 @@ RemoveMemoryMapEntry (
   IN OUT MEMORY_MAP  *Entry
   )
 {
+  RangeIndexRemove (&mMemoryMapIndex, &Entry->MapNode);
+  if (Entry->Type == EfiConventionalMemory) {
+    RangeIndexRemove (&mFreeMemoryIndex, &Entry->FreeNode);
+  }
+
   RemoveEntryList (&Entry->Link);
   Entry->Link.ForwardLink = NULL;
 
@@ -161,7 +237,6 @@ CoreAddRange (
   IN UINT64                Attribute
   )
 {
-  LIST_ENTRY  *Link;
   MEMORY_MAP  *Entry;
 
   ASSERT ((Start & EFI_PAGE_MASK) == 0);
@@ -210,26 +285,16 @@ CoreAddRange (
   // and the same Attribute
   //
 
-  Link = gMemoryMap.ForwardLink;
-  while (Link != &gMemoryMap) {
-    Entry = CR (Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-    Link  = Link->ForwardLink;
-
-    if (Entry->Type != Type) {
-      continue;
-    }
-
-    if (Entry->Attribute != Attribute) {
-      continue;
-    }
+  Entry = (Start == 0) ? NULL : LookupMemoryMapEntry (Start - 1);
+  if ((Entry != NULL) && (Entry->Type == Type) && (Entry->Attribute == Attribute)) {
+    Start = Entry->Start;
+    RemoveMemoryMapEntry (Entry);
+  }
 
-    if (Entry->End + 1 == Start) {
-      Start = Entry->Start;
-      RemoveMemoryMapEntry (Entry);
-    } else if (Entry->Start == End + 1) {
-      End = Entry->End;
-      RemoveMemoryMapEntry (Entry);
-    }
+  Entry = (End == MAX_UINT64) ? NULL : LookupMemoryMapEntry (End + 1);
+  if ((Entry != NULL) && (Entry->Type == Type) && (Entry->Attribute == Attribute)) {
+    End = Entry->End;
+    RemoveMemoryMapEntry (Entry);
   }
 
   //
@@ -244,6 +309,7 @@ CoreAddRange (
   mMapStack[mMapDepth].VirtualStart = 0;
   mMapStack[mMapDepth].Attribute    = Attribute;
   InsertTailList (&gMemoryMap, &mMapStack[mMapDepth].Link);
+  IndexMemoryMapEntry (&mMapStack[mMapDepth]);
 
   mMapDepth += 1;
   ASSERT (mMapDepth < MAX_MAP_DEPTH);
@@ -315,9 +381,10 @@ CoreFreeMemoryMapStack (
   VOID
   )
 {
-  MEMORY_MAP  *Entry;
-  MEMORY_MAP  *Entry2;
-  LIST_ENTRY  *Link2;
+  MEMORY_MAP        *Entry;
+  MEMORY_MAP        *Entry2;
+  LIST_ENTRY        *Link2;
+  RANGE_INDEX_NODE  *Node;
 
   ASSERT_LOCKED (&gMemoryLock);
 
@@ -350,18 +417,21 @@ CoreFreeMemoryMapStack (
       //
       // Move this entry to general memory
       //
-      RemoveEntryList (&mMapStack[mMapDepth].Link);
-      mMapStack[mMapDepth].Link.ForwardLink = NULL;
+      RemoveMemoryMapEntry (&mMapStack[mMapDepth]);
 
       CopyMem (Entry, &mMapStack[mMapDepth], sizeof (MEMORY_MAP));
       Entry->FromPages = TRUE;
+      IndexMemoryMapEntry (Entry);
 
       //
-      // Find insertion location
+      // Find insertion location. The entries from pages are kept in address
+      // order, so insert before the next one of them.
       //
-      for (Link2 = gMemoryMap.ForwardLink; Link2 != &gMemoryMap; Link2 = Link2->ForwardLink) {
-        Entry2 = CR (Link2, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-        if (Entry2->FromPages && (Entry2->Start > Entry->Start)) {
+      Link2 = &gMemoryMap;
+      for (Node = RangeIndexNext (&Entry->MapNode); Node != NULL; Node = RangeIndexNext (Node)) {
+        Entry2 = CR (Node, MEMORY_MAP, MapNode, MEMORY_MAP_SIGNATURE);
+        if (Entry2->FromPages) {
+          Link2 = &Entry2->Link;
           break;
         }
       }
@@ -741,7 +811,6 @@ CoreConvertPagesEx (
   UINT64           RangeEnd;
   UINT64           Attribute;
   EFI_MEMORY_TYPE  MemType;
-  LIST_ENTRY       *Link;
   MEMORY_MAP       *Entry;
 
   Entry         = NULL;
@@ -766,15 +835,8 @@ CoreConvertPagesEx (
     //
     // Find the entry that the covers the range
     //
-    for (Link = gMemoryMap.ForwardLink; Link != &gMemoryMap; Link = Link->ForwardLink) {
-      Entry = CR (Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-
-      if ((Entry->Start <= Start) && (Entry->End > Start)) {
-        break;
-      }
-    }
-
-    if (Link == &gMemoryMap) {
+    Entry = LookupMemoryMapEntry (Start);
+    if (Entry == NULL) {
       DEBUG ((DEBUG_ERROR | DEBUG_PAGE, "ConvertPages: failed to find range %lx - %lx\n", Start, End));
       return EFI_NOT_FOUND;
     }
@@ -860,11 +922,13 @@ CoreConvertPagesEx (
       // Clip start
       //
       Entry->Start = RangeEnd + 1;
+      UpdateMemoryMapEntryIndex (Entry);
     } else if (Entry->End == RangeEnd) {
       //
       // Clip end
       //
       Entry->End = Start - 1;
+      UpdateMemoryMapEntryIndex (Entry);
     } else {
       //
       // Pull it out of the center, clip current
@@ -886,9 +950,11 @@ CoreConvertPagesEx (
 
       Entry->End = Start - 1;
       ASSERT (Entry->Start < Entry->End);
+      UpdateMemoryMapEntryIndex (Entry);
 
       Entry = &mMapStack[mMapDepth];
       InsertTailList (&gMemoryMap, &Entry->Link);
+      IndexMemoryMapEntry (Entry);
 
       mMapDepth += 1;
       ASSERT (mMapDepth < MAX_MAP_DEPTH);
@@ -1035,13 +1101,13 @@ CoreFindFreePagesI (
   IN BOOLEAN          NeedGuard
   )
 {
-  UINT64      NumberOfBytes;
-  UINT64      Target;
-  UINT64      DescStart;
-  UINT64      DescEnd;
-  UINT64      DescNumberOfBytes;
-  LIST_ENTRY  *Link;
-  MEMORY_MAP  *Entry;
+  UINT64            NumberOfBytes;
+  UINT64            Target;
+  UINT64            DescStart;
+  UINT64            DescEnd;
+  UINT64            DescNumberOfBytes;
+  RANGE_INDEX_NODE  *Node;
+  MEMORY_MAP        *Entry;
 
   if ((MaxAddress < EFI_PAGE_MASK) || (NumberOfPages == 0)) {
     return 0;
@@ -1070,25 +1136,28 @@ CoreFindFreePagesI (
 
   NumberOfBytes = LShiftU64 (NumberOfPages, EFI_PAGE_SHIFT);
   Target        = 0;
+  DescStart     = 0;
 
-  for (Link = gMemoryMap.ForwardLink; Link != &gMemoryMap; Link = Link->ForwardLink) {
-    Entry = CR (Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-
-    //
-    // If it's not a free entry, don't bother with it
-    //
-    if (Entry->Type != EfiConventionalMemory) {
-      continue;
-    }
+  //
+  // Walk the free entries top-down, skipping the ones too small for the
+  // request. Entries do not overlap, so the first one that fits is the
+  // highest match.
+  //
+  for (Node = RangeIndexFindTopDown (&mFreeMemoryIndex, MaxAddress, NumberOfBytes);
+       Node != NULL;
+       Node = (DescStart == 0) ? NULL : RangeIndexFindTopDown (&mFreeMemoryIndex, DescStart - 1, NumberOfBytes))
+  {
+    Entry = CR (Node, MEMORY_MAP, FreeNode, MEMORY_MAP_SIGNATURE);
+    ASSERT (Entry->Type == EfiConventionalMemory);
 
     DescStart = Entry->Start;
     DescEnd   = Entry->End;
 
     //
-    // If desc is past max allowed address or below min allowed address, skip it
+    // If desc is below min allowed address, so are all the remaining ones
     //
-    if ((DescStart >= MaxAddress) || (DescEnd < MinAddress)) {
-      continue;
+    if (DescEnd < MinAddress) {
+      break;
     }
 
     //
@@ -1119,23 +1188,19 @@ CoreFindFreePagesI (
         continue;
       }
 
-      //
-      // If this is the best match so far remember it
-      //
-      if (DescEnd > Target) {
-        if (NeedGuard) {
-          DescEnd = AdjustMemoryS (
-                      DescEnd + 1 - DescNumberOfBytes,
-                      DescNumberOfBytes,
-                      NumberOfBytes
-                      );
-          if (DescEnd == 0) {
-            continue;
-          }
+      if (NeedGuard) {
+        DescEnd = AdjustMemoryS (
+                    DescEnd + 1 - DescNumberOfBytes,
+                    DescNumberOfBytes,
+                    NumberOfBytes
+                    );
+        if (DescEnd == 0) {
+          continue;
         }
-
-        Target = DescEnd;
       }
+
+      Target = DescEnd;
+      break;
     }
   }
 
@@ -1529,7 +1594,6 @@ CoreInternalFreePages (
   )
 {
   EFI_STATUS  Status;
-  LIST_ENTRY  *Link;
   MEMORY_MAP  *Entry;
   UINTN       Alignment;
   BOOLEAN     IsGuarded;
@@ -1543,15 +1607,8 @@ CoreInternalFreePages (
   // Find the entry that the covers the range
   //
   IsGuarded = FALSE;
-  Entry     = NULL;
-  for (Link = gMemoryMap.ForwardLink; Link != &gMemoryMap; Link = Link->ForwardLink) {
-    Entry = CR (Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-    if ((Entry->Start <= Memory) && (Entry->End > Memory)) {
-      break;
-    }
-  }
-
-  if (Link == &gMemoryMap) {
+  Entry     = LookupMemoryMapEntry (Memory);
+  if ((Entry == NULL) || (Entry->End == Memory)) {
     Status = EFI_NOT_FOUND;
     goto Done;
   }
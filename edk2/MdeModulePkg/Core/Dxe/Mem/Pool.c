@@ -19,6 +19,21 @@ typedef struct {
   LIST_ENTRY    Link;
 } POOL_FREE;
 
+//
+// A freed block parked in a pool magazine. Its signature is not the one of
+// POOL_FREE, so the page scan of CoreFreePoolI() takes it for a block in
+// use and keeps the page. A parked block only leaves the magazine to be
+// handed out again, so its page stays allocated until the block is freed
+// to the free lists on a later free with a full magazine.
+//
+#define POOL_CACHED_SIGNATURE  SIGNATURE_32('p','c','h','0')
+typedef struct _POOL_CACHED POOL_CACHED;
+struct _POOL_CACHED {
+  UINT32         Signature;
+  UINT32         Index;
+  POOL_CACHED    *Next;
+};
+
 #define POOL_HEAD_SIGNATURE      SIGNATURE_32('p','h','d','0')
 #define POOLPAGE_HEAD_SIGNATURE  SIGNATURE_32('p','h','d','1')
 typedef struct {
@@ -40,16 +55,29 @@ typedef struct {
 
 #define POOL_OVERHEAD  (SIZE_OF_POOL_HEAD + sizeof(POOL_TAIL))
 
+//
+// The tail only backs the consistency checks of CoreFreePoolI(). RELEASE
+// builds leave it out, which saves 16 bytes on every pool block.
+//
+#ifdef MDEPKG_NDEBUG
+#define POOL_TAIL_ENABLED  FALSE
+#else
+#define POOL_TAIL_ENABLED  TRUE
+#endif
+
 #define HEAD_TO_TAIL(a)   \
   ((POOL_TAIL *) (((CHAR8 *) (a)) + (a)->Size - sizeof(POOL_TAIL)));
 
 //
 // Each element is the sum of the 2 previous ones: this allows us to migrate
 // blocks between bins by splitting them up, while not wasting too much memory
-// as we would in a strict power-of-2 sequence
+// as we would in a strict power-of-2 sequence. The bins above the page
+// allocation granularity are only used when pool is carved out of larger
+// pages: the arenas of boot services pool, and runtime pool where the
+// runtime page allocation granularity is 64 KB.
 //
 STATIC CONST UINT16  mPoolSizeTable[] = {
-  128, 256, 384, 640, 1024, 1664, 2688, 4352, 7040, 11392, 18432, 29824
+  128, 256, 384, 640, 1024, 1664, 2688, 4352, 7040, 11392, 18432, 29824, 48256
 };
 
 #define SIZE_TO_LIST(a)  (GetPoolIndexFromSize (a))
@@ -57,6 +85,36 @@ STATIC CONST UINT16  mPoolSizeTable[] = {
 
 #define MAX_POOL_LIST  (ARRAY_SIZE (mPoolSizeTable))
 
+//
+// Every bin size is a multiple of 128 bytes, so the bin of a size is looked
+// up per 128 byte unit
+//
+#define POOL_SIZE_SHIFT  7
+
+STATIC UINT8  mPoolIndexTable[48256 >> POOL_SIZE_SHIFT];
+
+//
+// Boot services pool is carved out of 32 KB arenas, so that the mid-size
+// bins are served from the free lists instead of whole pages, and the page
+// allocator is entered less often. Pool of the types that show up in the OS
+// memory map stays at the page allocation granularity.
+//
+#define POOL_ARENA_SIZE  SIZE_32KB
+
+//
+// Boot services pool also keeps magazines of recently freed small blocks.
+// Most pool traffic of the DXE phase is short-lived small buffers, which a
+// magazine hands back without touching the free lists or scanning the pool
+// page for blocks to coalesce.
+//
+#define POOL_MAGAZINE_LISTS  4
+#define POOL_MAGAZINE_DEPTH  8
+
+typedef struct {
+  POOL_CACHED    *Top;
+  UINTN          Count;
+} POOL_MAGAZINE;
+
 #define MAX_POOL_SIZE  (MAX_ADDRESS - POOL_OVERHEAD)
 
 //
@@ -82,6 +140,11 @@ POOL  mPoolHead[EfiMaxMemoryType];
 //
 LIST_ENTRY  mPoolHeadList = INITIALIZE_LIST_HEAD_VARIABLE (mPoolHeadList);
 
+//
+// Magazines of the boot services pool types
+//
+STATIC POOL_MAGAZINE  mPoolMagazine[EfiMaxMemoryType][POOL_MAGAZINE_LISTS];
+
 /**
   Get pool size table index from the specified size.
 
@@ -96,15 +159,137 @@ GetPoolIndexFromSize (
   UINTN  Size
   )
 {
-  UINTN  Index;
+  if (Size == 0) {
+    return 0;
+  }
 
-  for (Index = 0; Index < MAX_POOL_LIST; Index++) {
-    if (mPoolSizeTable[Index] >= Size) {
-      return Index;
-    }
+  if (Size > LIST_TO_SIZE (MAX_POOL_LIST - 1)) {
+    return MAX_POOL_LIST;
   }
 
-  return MAX_POOL_LIST;
+  return mPoolIndexTable[(Size - 1) >> POOL_SIZE_SHIFT];
+}
+
+/**
+  Check whether the pool of a memory type is boot services pool, which is
+  never reported to the OS and may use arenas and magazines.
+
+  @param  PoolType      The memory type of the pool.
+
+  @retval TRUE          The pool is boot services pool.
+  @retval FALSE         The pool is visible in the OS memory map.
+
+**/
+STATIC
+BOOLEAN
+IsBootServicesPool (
+  IN EFI_MEMORY_TYPE  PoolType
+  )
+{
+  return (BOOLEAN)((PoolType == EfiBootServicesData) ||
+                   (PoolType == EfiBootServicesCode));
+}
+
+/**
+  Get the size of the pages that pool blocks are carved out of.
+
+  @param  PoolType      The memory type of the pool.
+  @param  Granularity   The page allocation granularity of the memory type.
+
+  @return               The size of a pool arena.
+
+**/
+STATIC
+UINTN
+GetPoolArenaSize (
+  IN EFI_MEMORY_TYPE  PoolType,
+  IN UINTN            Granularity
+  )
+{
+  if (IsBootServicesPool (PoolType)) {
+    return MAX (Granularity, POOL_ARENA_SIZE);
+  }
+
+  return Granularity;
+}
+
+/**
+  Take a recently freed block from the magazine of a pool list.
+
+  @param  Pool          The pool head of the memory type.
+  @param  Index         The pool list of the block.
+
+  @return The block, or NULL if the magazine is empty.
+
+**/
+STATIC
+POOL_HEAD *
+PopPoolMagazine (
+  IN POOL   *Pool,
+  IN UINTN  Index
+  )
+{
+  POOL_MAGAZINE  *Magazine;
+  POOL_CACHED    *Cached;
+
+  if ((Index >= POOL_MAGAZINE_LISTS) || !IsBootServicesPool (Pool->MemoryType)) {
+    return NULL;
+  }
+
+  Magazine = &mPoolMagazine[Pool->MemoryType][Index];
+  Cached   = Magazine->Top;
+  if (Cached == NULL) {
+    return NULL;
+  }
+
+  ASSERT (Cached->Signature == POOL_CACHED_SIGNATURE);
+  ASSERT (Cached->Index == Index);
+
+  Magazine->Top = Cached->Next;
+  Magazine->Count--;
+
+  return (POOL_HEAD *)Cached;
+}
+
+/**
+  Park a freed block in the magazine of its pool list.
+
+  @param  Pool          The pool head of the memory type.
+  @param  Index         The pool list of the block.
+  @param  Head          The freed block.
+
+  @retval TRUE          The block is parked in the magazine.
+  @retval FALSE         The magazine is full, or the pool list has none.
+
+**/
+STATIC
+BOOLEAN
+PushPoolMagazine (
+  IN POOL       *Pool,
+  IN UINTN      Index,
+  IN POOL_HEAD  *Head
+  )
+{
+  POOL_MAGAZINE  *Magazine;
+  POOL_CACHED    *Cached;
+
+  if ((Index >= POOL_MAGAZINE_LISTS) || !IsBootServicesPool (Pool->MemoryType)) {
+    return FALSE;
+  }
+
+  Magazine = &mPoolMagazine[Pool->MemoryType][Index];
+  if (Magazine->Count >= POOL_MAGAZINE_DEPTH) {
+    return FALSE;
+  }
+
+  Cached            = (POOL_CACHED *)Head;
+  Cached->Signature = POOL_CACHED_SIGNATURE;
+  Cached->Index     = (UINT32)Index;
+  Cached->Next      = Magazine->Top;
+  Magazine->Top     = Cached;
+  Magazine->Count++;
+
+  return TRUE;
 }
 
 /**
@@ -118,6 +303,7 @@ CoreInitializePool (
 {
   UINTN  Type;
   UINTN  Index;
+  UINTN  Unit;
 
   for (Type = 0; Type < EfiMaxMemoryType; Type++) {
     mPoolHead[Type].Signature  = 0;
@@ -127,6 +313,21 @@ CoreInitializePool (
       InitializeListHead (&mPoolHead[Type].FreeList[Index]);
     }
   }
+
+  ZeroMem (mPoolMagazine, sizeof (mPoolMagazine));
+
+  //
+  // Unit covers the sizes from (Unit << POOL_SIZE_SHIFT) + 1 up to
+  // (Unit + 1) << POOL_SIZE_SHIFT
+  //
+  Index = 0;
+  for (Unit = 0; Unit < ARRAY_SIZE (mPoolIndexTable); Unit++) {
+    while (LIST_TO_SIZE (Index) < ((Unit + 1) << POOL_SIZE_SHIFT)) {
+      Index++;
+    }
+
+    mPoolIndexTable[Unit] = (UINT8)Index;
+  }
 }
 
 /**
@@ -365,6 +566,7 @@ CoreAllocatePoolI (
   UINTN      Offset, MaxOffset;
   UINTN      NoPages;
   UINTN      Granularity;
+  UINTN      ArenaSize;
   BOOLEAN    HasPoolTail;
   BOOLEAN    PageAsPool;
 
@@ -380,11 +582,14 @@ CoreAllocatePoolI (
     Granularity = DEFAULT_PAGE_ALLOCATION_GRANULARITY;
   }
 
+  ArenaSize = GetPoolArenaSize (PoolType, Granularity);
+
   //
   // Adjust the size by the pool header & tail overhead
   //
 
-  HasPoolTail = !(NeedGuard &&
+  HasPoolTail = POOL_TAIL_ENABLED &&
+                !(NeedGuard &&
                   ((PcdGet8 (PcdHeapGuardPropertyMask) & BIT7) == 0));
   PageAsPool = (IsHeapGuardEnabled (GUARD_HEAP_TYPE_FREED) && !mOnGuarding);
 
@@ -395,7 +600,11 @@ CoreAllocatePoolI (
   //
   Size = ALIGN_VARIABLE (Size);
 
-  Size += POOL_OVERHEAD;
+  Size += SIZE_OF_POOL_HEAD;
+  if (HasPoolTail) {
+    Size += sizeof (POOL_TAIL);
+  }
+
   Index = SIZE_TO_LIST (Size);
   Pool  = LookupPoolHead (PoolType);
   if (Pool == NULL) {
@@ -408,11 +617,7 @@ CoreAllocatePoolI (
   // If allocation is over max size, just allocate pages for the request
   // (slow)
   //
-  if ((Index >= SIZE_TO_LIST (Granularity)) || NeedGuard || PageAsPool) {
-    if (!HasPoolTail) {
-      Size -= sizeof (POOL_TAIL);
-    }
-
+  if ((Index >= SIZE_TO_LIST (ArenaSize)) || NeedGuard || PageAsPool) {
     NoPages  = EFI_SIZE_TO_PAGES (Size) + EFI_SIZE_TO_PAGES (Granularity) - 1;
     NoPages &= ~(UINTN)(EFI_SIZE_TO_PAGES (Granularity) - 1);
     Head     = CoreAllocatePoolPagesI (PoolType, NoPages, Granularity, NeedGuard);
@@ -423,17 +628,25 @@ CoreAllocatePoolI (
     goto Done;
   }
 
+  //
+  // Hand out a recently freed block of the same size if there is one
+  //
+  Head = PopPoolMagazine (Pool, Index);
+  if (Head != NULL) {
+    goto Done;
+  }
+
   //
   // If there's no free pool in the proper list size, go get some more pages
   //
   if (IsListEmpty (&Pool->FreeList[Index])) {
     Offset    = LIST_TO_SIZE (Index);
-    MaxOffset = Granularity;
+    MaxOffset = ArenaSize;
 
     //
     // Check the bins holding larger blocks, and carve one up if needed
     //
-    while (++Index < SIZE_TO_LIST (Granularity)) {
+    while (++Index < SIZE_TO_LIST (ArenaSize)) {
       if (!IsListEmpty (&Pool->FreeList[Index])) {
         Free = CR (Pool->FreeList[Index].ForwardLink, POOL_FREE, Link, POOL_FREE_SIGNATURE);
         RemoveEntryList (&Free->Link);
@@ -448,8 +661,8 @@ CoreAllocatePoolI (
     //
     NewPage = CoreAllocatePoolPagesI (
                 PoolType,
-                EFI_SIZE_TO_PAGES (Granularity),
-                Granularity,
+                EFI_SIZE_TO_PAGES (ArenaSize),
+                ArenaSize,
                 NeedGuard
                 );
     if (NewPage == NULL) {
@@ -515,11 +728,11 @@ Done:
       Tail->Signature = POOL_TAIL_SIGNATURE;
       Tail->Size      = Size;
 
-      Size -= POOL_OVERHEAD;
-    } else {
-      Size -= SIZE_OF_POOL_HEAD;
+      Size -= sizeof (POOL_TAIL);
     }
 
+    Size -= SIZE_OF_POOL_HEAD;
+
     DEBUG_CLEAR_MEMORY (Buffer, Size);
 
     DEBUG ((
@@ -693,6 +906,7 @@ CoreFreePoolI (
   UINTN      Offset;
   BOOLEAN    AllFree;
   UINTN      Granularity;
+  UINTN      ArenaSize;
   BOOLEAN    IsGuarded;
   BOOLEAN    HasPoolTail;
   BOOLEAN    PageAsPool;
@@ -716,7 +930,8 @@ CoreFreePoolI (
 
   IsGuarded = IsPoolTypeToGuard (Head->Type) &&
               IsMemoryGuarded ((EFI_PHYSICAL_ADDRESS)(UINTN)Head);
-  HasPoolTail = !(IsGuarded &&
+  HasPoolTail = POOL_TAIL_ENABLED &&
+                !(IsGuarded &&
                   ((PcdGet8 (PcdHeapGuardPropertyMask) & BIT7) == 0));
   PageAsPool = (Head->Signature == POOLPAGE_HEAD_SIGNATURE);
 
@@ -763,6 +978,8 @@ CoreFreePoolI (
     Granularity = DEFAULT_PAGE_ALLOCATION_GRANULARITY;
   }
 
+  ArenaSize = GetPoolArenaSize (Head->Type, Granularity);
+
   if (PoolType != NULL) {
     *PoolType = Head->Type;
   }
@@ -776,7 +993,7 @@ CoreFreePoolI (
   //
   // If it's not on the list, it must be pool pages
   //
-  if ((Index >= SIZE_TO_LIST (Granularity)) || IsGuarded || PageAsPool) {
+  if ((Index >= SIZE_TO_LIST (ArenaSize)) || IsGuarded || PageAsPool) {
     //
     // Return the memory pages back to free memory
     //
@@ -796,7 +1013,7 @@ CoreFreePoolI (
         NoPages
         );
     }
-  } else {
+  } else if (!PushPoolMagazine (Pool, Index, Head)) {
     //
     // Put the pool entry onto the free pool list
     //
@@ -810,7 +1027,7 @@ CoreFreePoolI (
     // See if all the pool entries in the same page as Free are freed pool
     // entries
     //
-    NewPage = (CHAR8 *)((UINTN)Free & ~(Granularity - 1));
+    NewPage = (CHAR8 *)((UINTN)Free & ~(ArenaSize - 1));
     Free    = (POOL_FREE *)&NewPage[0];
     ASSERT (Free != NULL);
 
@@ -818,7 +1035,7 @@ CoreFreePoolI (
       AllFree = TRUE;
       Offset  = 0;
 
-      while ((Offset < Granularity) && (AllFree)) {
+      while ((Offset < ArenaSize) && (AllFree)) {
         Free = (POOL_FREE *)&NewPage[Offset];
         ASSERT (Free != NULL);
         if (Free->Signature != POOL_FREE_SIGNATURE) {
@@ -838,7 +1055,7 @@ CoreFreePoolI (
         ASSERT (Free != NULL);
         Offset = 0;
 
-        while (Offset < Granularity) {
+        while (Offset < ArenaSize) {
           Free = (POOL_FREE *)&NewPage[Offset];
           ASSERT (Free != NULL);
           RemoveEntryList (&Free->Link);
@@ -851,7 +1068,7 @@ CoreFreePoolI (
         CoreFreePoolPagesI (
           Pool->MemoryType,
           (EFI_PHYSICAL_ADDRESS)(UINTN)NewPage,
-          EFI_SIZE_TO_PAGES (Granularity)
+          EFI_SIZE_TO_PAGES (ArenaSize)
           );
       }
     }
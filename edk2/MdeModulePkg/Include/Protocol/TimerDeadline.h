@@ -0,0 +1,79 @@
+/** @file
+  Timer Deadline Protocol.
+
+  Produced by a timer driver that can program its next interrupt at an
+  arbitrary time, next to the Timer Architectural Protocol. The DXE Core uses
+  it to tell the driver when the next timer event is due, so that the driver
+  may skip the ticks in between while the system is idle.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef TIMER_DEADLINE_H_
+#define TIMER_DEADLINE_H_
+
+#define EDKII_TIMER_DEADLINE_PROTOCOL_GUID \
+  { \
+    0x5c1f2a6e, 0x93b4, 0x4d07, { 0xa8, 0x31, 0x6e, 0x0d, 0x47, 0xb2, 0xc9, 0x15 } \
+  }
+
+typedef struct _EDKII_TIMER_DEADLINE_PROTOCOL EDKII_TIMER_DEADLINE_PROTOCOL;
+
+/**
+  Set the time until the next timer event of the DXE Core is due.
+
+  The timer driver must call the handler registered through the Timer
+  Architectural Protocol no later than Deadline from the time of this call,
+  and no later than its timer period if Deadline is shorter than the period.
+  It may defer the handler up to Deadline otherwise, and up to a limit of its
+  own choosing if no timer event is pending. The handler still receives the
+  time that has actually passed.
+
+  This function is called at TPL_HIGH_LEVEL - 1 or below.
+
+  @param[in] This        The EDKII_TIMER_DEADLINE_PROTOCOL instance.
+  @param[in] Deadline    The number of 100 ns units until the next timer event
+                         is due, or 0 if no timer event is pending.
+
+  @retval EFI_SUCCESS    The deadline was recorded.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_TIMER_SET_DEADLINE)(
+  IN EDKII_TIMER_DEADLINE_PROTOCOL  *This,
+  IN UINT64                         Deadline
+  );
+
+/**
+  Get the time that has passed since the timer driver last called the handler
+  registered through the Timer Architectural Protocol.
+
+  The DXE Core only learns of the passing time from the handler. While the
+  driver skips ticks, it adds this time to its system time, so that a timer
+  event set between two calls of the handler counts from the actual time.
+
+  This function may be called at any TPL up to TPL_HIGH_LEVEL.
+
+  @param[in] This        The EDKII_TIMER_DEADLINE_PROTOCOL instance.
+
+  @return The number of 100 ns units since the handler was last called, or 0
+          if the timer is disabled.
+
+**/
+typedef
+UINT64
+(EFIAPI *EDKII_TIMER_GET_ELAPSED)(
+  IN EDKII_TIMER_DEADLINE_PROTOCOL  *This
+  );
+
+struct _EDKII_TIMER_DEADLINE_PROTOCOL {
+  EDKII_TIMER_SET_DEADLINE    SetDeadline;
+  EDKII_TIMER_GET_ELAPSED     GetElapsed;
+};
+
+extern EFI_GUID  gEdkiiTimerDeadlineProtocolGuid;
+
+#endif
@@ -0,0 +1,175 @@
+/** @file
+  USB Host Controller Stream Protocol.
+
+  Produced by a USB host controller driver, next to the EFI_USB2_HC_PROTOCOL,
+  when the controller supports the bulk streams of USB 3. It lets the USB bus
+  driver give the streams of a SuperSpeed bulk endpoint to a class driver,
+  and run several transfers on an endpoint at once, one on each stream.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef USB_HC_STREAM_H_
+#define USB_HC_STREAM_H_
+
+#include <Protocol/Usb2HostController.h>
+
+#define EDKII_USB_HC_STREAM_PROTOCOL_GUID \
+  { \
+    0x823f6a55, 0xb295, 0x459d, { 0x93, 0xec, 0xdb, 0xf0, 0xb3, 0xc1, 0xbd, 0x7d } \
+  }
+
+typedef struct _EDKII_USB_HC_STREAM_PROTOCOL EDKII_USB_HC_STREAM_PROTOCOL;
+
+/**
+  Give streams to a bulk endpoint of a device.
+
+  Once the streams are allocated, the transfers on the endpoint must name one
+  of them, and the EFI_USB2_HC_PROTOCOL must not be used on the endpoint any
+  more until the streams are freed.
+
+  @param[in]      This             The EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param[in]      DeviceAddress    The address of the device on the USB bus.
+  @param[in]      EndpointAddress  The address of the bulk endpoint, with the
+                                   direction in bit 7.
+  @param[in, out] StreamCount      On input, the number of streams wanted. On
+                                   output, the number of streams allocated.
+                                   The stream IDs run from 1 to StreamCount.
+
+  @retval EFI_SUCCESS              The streams are allocated.
+  @retval EFI_INVALID_PARAMETER    The endpoint is not a bulk endpoint of the
+                                   device, or StreamCount is 0.
+  @retval EFI_ALREADY_STARTED      The endpoint already has streams.
+  @retval EFI_UNSUPPORTED          The controller has no streams.
+  @retval EFI_OUT_OF_RESOURCES     The stream contexts could not be allocated.
+  @retval EFI_DEVICE_ERROR         The controller failed to configure the
+                                   endpoint.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_USB_HC_STREAM_ALLOCATE)(
+  IN     EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN     UINT8                         DeviceAddress,
+  IN     UINT8                         EndpointAddress,
+  IN OUT UINT16                        *StreamCount
+  );
+
+/**
+  Take the streams back from a bulk endpoint of a device.
+
+  The transfers still pending on the streams must be canceled first.
+
+  @param[in] This             The EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param[in] DeviceAddress    The address of the device on the USB bus.
+  @param[in] EndpointAddress  The address of the bulk endpoint, with the
+                              direction in bit 7.
+
+  @retval EFI_SUCCESS         The endpoint is back to a single transfer ring.
+  @retval EFI_NOT_FOUND       The endpoint has no streams.
+  @retval EFI_ACCESS_DENIED   A transfer is still pending on the endpoint.
+  @retval EFI_DEVICE_ERROR    The controller failed to configure the endpoint.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_USB_HC_STREAM_FREE)(
+  IN EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN UINT8                         DeviceAddress,
+  IN UINT8                         EndpointAddress
+  );
+
+/**
+  Start a bulk transfer and return without waiting for it.
+
+  A stream holds one transfer at a time. StreamId 0 starts the transfer on an
+  endpoint without streams, which holds one transfer at a time as well.
+
+  @param[in]  This             The EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param[in]  DeviceAddress    The address of the device on the USB bus.
+  @param[in]  EndpointAddress  The address of the bulk endpoint, with the
+                               direction in bit 7.
+  @param[in]  StreamId         The stream of the transfer, or 0.
+  @param[in]  Data             The buffer of the transfer. It must stay valid
+                               until the transfer is done.
+  @param[in]  DataLength       The length of the transfer, in bytes.
+  @param[out] Transfer         The handle of the started transfer.
+
+  @retval EFI_SUCCESS            The transfer is started.
+  @retval EFI_INVALID_PARAMETER  A parameter is not valid, or the stream does
+                                 not exist.
+  @retval EFI_ALREADY_STARTED    A transfer is pending on the stream already.
+  @retval EFI_OUT_OF_RESOURCES   The transfer could not be allocated.
+  @retval EFI_DEVICE_ERROR       The device is gone or the controller failed.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_USB_HC_STREAM_SUBMIT_TRANSFER)(
+  IN  EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN  UINT8                         DeviceAddress,
+  IN  UINT8                         EndpointAddress,
+  IN  UINT16                        StreamId,
+  IN  VOID                          *Data,
+  IN  UINTN                         DataLength,
+  OUT VOID                          **Transfer
+  );
+
+/**
+  Check whether a transfer is done.
+
+  Once this function returns anything but EFI_NOT_READY, the transfer handle
+  is freed. A transfer that stalls the endpoint has the halt cleared in the
+  controller; the class driver clears it in the device.
+
+  @param[in]  This            The EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param[in]  Transfer        The handle of the transfer.
+  @param[out] DataLength      The number of bytes transferred.
+  @param[out] TransferResult  The EFI_USB_ERR_* result of the transfer.
+
+  @retval EFI_SUCCESS         The transfer is done without error.
+  @retval EFI_NOT_READY       The transfer is still pending.
+  @retval EFI_DEVICE_ERROR    The transfer is done with the error in
+                              TransferResult.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_USB_HC_STREAM_POLL_TRANSFER)(
+  IN  EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN  VOID                          *Transfer,
+  OUT UINTN                         *DataLength,
+  OUT UINT32                        *TransferResult
+  );
+
+/**
+  Take a pending transfer back from the controller and free it.
+
+  @param[in] This       The EDKII_USB_HC_STREAM_PROTOCOL instance.
+  @param[in] Transfer   The handle of the transfer.
+
+  @retval EFI_SUCCESS       The transfer is canceled.
+  @retval EFI_DEVICE_ERROR  The controller failed to stop the endpoint. The
+                            transfer is freed all the same.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_USB_HC_STREAM_CANCEL_TRANSFER)(
+  IN EDKII_USB_HC_STREAM_PROTOCOL  *This,
+  IN VOID                          *Transfer
+  );
+
+struct _EDKII_USB_HC_STREAM_PROTOCOL {
+  EDKII_USB_HC_STREAM_ALLOCATE           AllocateStreams;
+  EDKII_USB_HC_STREAM_FREE               FreeStreams;
+  EDKII_USB_HC_STREAM_SUBMIT_TRANSFER    SubmitTransfer;
+  EDKII_USB_HC_STREAM_POLL_TRANSFER      PollTransfer;
+  EDKII_USB_HC_STREAM_CANCEL_TRANSFER    CancelTransfer;
+};
+
+extern EFI_GUID  gEdkiiUsbHcStreamProtocolGuid;
+
+#endif
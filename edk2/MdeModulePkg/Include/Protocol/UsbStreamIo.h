@@ -0,0 +1,154 @@
+/** @file
+  USB Stream I/O Protocol.
+
+  Produced by the USB bus driver, next to the EFI_USB_IO_PROTOCOL, on the
+  interfaces of the devices behind a host controller that supports bulk
+  streams. It lets a class driver, such as a USB Attached SCSI driver, use
+  the streams of the SuperSpeed bulk endpoints of its interface and run
+  several transfers at once.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef USB_STREAM_IO_H_
+#define USB_STREAM_IO_H_
+
+#include <Protocol/UsbIo.h>
+
+#define EDKII_USB_STREAM_IO_PROTOCOL_GUID \
+  { \
+    0xa9d3f767, 0xf482, 0x487c, { 0xb0, 0x0d, 0x64, 0x8e, 0x97, 0x39, 0x12, 0xe1 } \
+  }
+
+typedef struct _EDKII_USB_STREAM_IO_PROTOCOL EDKII_USB_STREAM_IO_PROTOCOL;
+
+/**
+  Give streams to a bulk endpoint of the interface.
+
+  Once the streams are allocated, the transfers on the endpoint must go
+  through this protocol and name one of them, until the streams are freed.
+
+  @param[in]      This             The EDKII_USB_STREAM_IO_PROTOCOL instance.
+  @param[in]      EndpointAddress  The address of the bulk endpoint, with the
+                                   direction in bit 7.
+  @param[in, out] StreamCount      On input, the number of streams wanted. On
+                                   output, the number of streams allocated.
+                                   The stream IDs run from 1 to StreamCount.
+
+  @retval EFI_SUCCESS              The streams are allocated.
+  @retval EFI_INVALID_PARAMETER    The endpoint is not a bulk endpoint of the
+                                   interface, or StreamCount is 0.
+  @retval EFI_UNSUPPORTED          The device is not a SuperSpeed device.
+  @retval Others                   See EDKII_USB_HC_STREAM_ALLOCATE.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_USB_STREAM_IO_ALLOCATE)(
+  IN     EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN     UINT8                         EndpointAddress,
+  IN OUT UINT16                        *StreamCount
+  );
+
+/**
+  Take the streams back from a bulk endpoint of the interface.
+
+  @param[in] This             The EDKII_USB_STREAM_IO_PROTOCOL instance.
+  @param[in] EndpointAddress  The address of the bulk endpoint, with the
+                              direction in bit 7.
+
+  @retval EFI_SUCCESS         The endpoint is back to plain bulk transfers.
+  @retval Others              See EDKII_USB_HC_STREAM_FREE.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_USB_STREAM_IO_FREE)(
+  IN EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN UINT8                         EndpointAddress
+  );
+
+/**
+  Start a bulk transfer and return without waiting for it.
+
+  @param[in]  This             The EDKII_USB_STREAM_IO_PROTOCOL instance.
+  @param[in]  EndpointAddress  The address of the bulk endpoint, with the
+                               direction in bit 7.
+  @param[in]  StreamId         The stream of the transfer, or 0 on an
+                               endpoint without streams.
+  @param[in]  Data             The buffer of the transfer. It must stay valid
+                               until the transfer is done.
+  @param[in]  DataLength       The length of the transfer, in bytes.
+  @param[out] Transfer         The handle of the started transfer.
+
+  @retval EFI_SUCCESS          The transfer is started.
+  @retval Others               See EDKII_USB_HC_STREAM_SUBMIT_TRANSFER.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_USB_STREAM_IO_SUBMIT_TRANSFER)(
+  IN  EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN  UINT8                         EndpointAddress,
+  IN  UINT16                        StreamId,
+  IN  VOID                          *Data,
+  IN  UINTN                         DataLength,
+  OUT VOID                          **Transfer
+  );
+
+/**
+  Check whether a transfer is done.
+
+  Once this function returns anything but EFI_NOT_READY, the transfer handle
+  is freed.
+
+  @param[in]  This            The EDKII_USB_STREAM_IO_PROTOCOL instance.
+  @param[in]  Transfer        The handle of the transfer.
+  @param[out] DataLength      The number of bytes transferred.
+  @param[out] TransferResult  The EFI_USB_ERR_* result of the transfer.
+
+  @retval EFI_SUCCESS         The transfer is done without error.
+  @retval EFI_NOT_READY       The transfer is still pending.
+  @retval EFI_DEVICE_ERROR    The transfer is done with the error in
+                              TransferResult.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_USB_STREAM_IO_POLL_TRANSFER)(
+  IN  EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN  VOID                          *Transfer,
+  OUT UINTN                         *DataLength,
+  OUT UINT32                        *TransferResult
+  );
+
+/**
+  Take a pending transfer back from the controller and free it.
+
+  @param[in] This       The EDKII_USB_STREAM_IO_PROTOCOL instance.
+  @param[in] Transfer   The handle of the transfer.
+
+  @retval EFI_SUCCESS   The transfer is canceled.
+  @retval Others        See EDKII_USB_HC_STREAM_CANCEL_TRANSFER.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_USB_STREAM_IO_CANCEL_TRANSFER)(
+  IN EDKII_USB_STREAM_IO_PROTOCOL  *This,
+  IN VOID                          *Transfer
+  );
+
+struct _EDKII_USB_STREAM_IO_PROTOCOL {
+  EDKII_USB_STREAM_IO_ALLOCATE           AllocateStreams;
+  EDKII_USB_STREAM_IO_FREE               FreeStreams;
+  EDKII_USB_STREAM_IO_SUBMIT_TRANSFER    SubmitTransfer;
+  EDKII_USB_STREAM_IO_POLL_TRANSFER      PollTransfer;
+  EDKII_USB_STREAM_IO_CANCEL_TRANSFER    CancelTransfer;
+};
+
+extern EFI_GUID  gEdkiiUsbStreamIoProtocolGuid;
+
+#endif
@@ -0,0 +1,359 @@
+/** @file
+  Host test of the partition probing of PartitionDxe.
+
+  The GPT and the MBR probing run against the RAM disk images of
+  PartitionModel.c. The partitions found are checked against the images, a
+  damaged primary or backup GPT is checked to be restored from the other
+  one, and a reconnect of a disk is checked to take the partition map from
+  the cache until the partition table or the media changes. The reads are
+  checked to go through DiskIo at the TPL of the driver binding, and to be
+  read again through DiskIo when DiskIo2 does not complete them. The benchmark
+  reports the time to probe a set of GPT disks through DiskIo alone, through
+  DiskIo2, and on their reconnect, on the clock of the model.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+#include <Library/GoogleTestLib.h>
+#include <cstdio>
+#include <cstring>
+
+extern "C" {
+  #include <Uefi.h>
+  #include <Protocol/PartitionInfo.h>
+  #include "PartitionModel.h"
+}
+
+using namespace testing;
+
+#define DISK_BLOCK_SIZE   512
+#define DISK_BLOCKS       (32 * 1024)
+#define PARTITION_BLOCKS  2048
+#define GPT_FIRST_LBA     34
+#define BENCHMARK_DISKS   4
+
+//
+// PARTITION_READ_TIMEOUT in nanoseconds
+//
+#define READ_TIMEOUT  (5ULL * 1000 * 1000 * 1000)
+
+class PartitionTest : public Test {
+protected:
+  VOID  *Disk;
+
+  VOID
+  SetUp (
+    ) override
+  {
+    PartitionModelDefaultConfig ();
+    Disk = PartitionModelCreateDisk (DISK_BLOCK_SIZE, DISK_BLOCKS);
+  }
+
+  VOID
+  TearDown (
+    ) override
+  {
+    PartitionModelFreeDisk (Disk);
+    PartitionModelFree ();
+  }
+
+  //
+  // Every disk gets a GUID of its own, so a disk of an earlier test is never
+  // found in the cache.
+  //
+  VOID
+  MakeGuid (
+    EFI_GUID  *Guid
+    )
+  {
+    static UINT32  Seed = 0;
+
+    memset (Guid, 0, sizeof (*Guid));
+    Guid->Data1 = ++Seed;
+    Guid->Data2 = 0x9A7B;
+    Guid->Data3 = 0x4C2D;
+  }
+
+  VOID
+  WriteGpt (
+    VOID   *Target,
+    UINTN  Partitions
+    )
+  {
+    EFI_GUID  Guid;
+
+    MakeGuid (&Guid);
+    PartitionModelWriteGpt (Target, &Guid, Partitions, PARTITION_BLOCKS);
+  }
+
+  VOID
+  CheckGptChildren (
+    UINTN  Partitions
+    )
+  {
+    UINTN  Index;
+
+    ASSERT_EQ (mPartitionModelChildCount, Partitions);
+    for (Index = 0; Index < Partitions; Index++) {
+      EXPECT_EQ (mPartitionModelChildren[Index].PartitionNumber, Index + 1);
+      EXPECT_EQ (mPartitionModelChildren[Index].Type, (UINT32)PARTITION_TYPE_GPT);
+      EXPECT_EQ (mPartitionModelChildren[Index].System, Index == 0);
+      EXPECT_EQ (mPartitionModelChildren[Index].Start, GPT_FIRST_LBA + Index * PARTITION_BLOCKS);
+      EXPECT_EQ (mPartitionModelChildren[Index].End, GPT_FIRST_LBA + (Index + 1) * PARTITION_BLOCKS - 1);
+      EXPECT_EQ (mPartitionModelChildren[Index].BlockSize, (UINT32)DISK_BLOCK_SIZE);
+    }
+  }
+
+  VOID
+  ResetStatistics (
+    )
+  {
+    memset (&mPartitionModelStatistics, 0, sizeof (mPartitionModelStatistics));
+  }
+
+  //
+  // The time to probe the disks, in microseconds of the clock of the model.
+  //
+  UINT64
+  ProbeTime (
+    VOID   **Disks,
+    UINTN  Count
+    )
+  {
+    UINT64  Start;
+    UINTN   Index;
+
+    Start = PartitionModelNow ();
+    for (Index = 0; Index < Count; Index++) {
+      EXPECT_EQ (PartitionModelProbe (Disks[Index]), EFI_SUCCESS);
+      EXPECT_EQ (mPartitionModelChildCount, 4U);
+    }
+
+    return (PartitionModelNow () - Start) / 1000;
+  }
+};
+
+TEST_F (PartitionTest, GptChildren) {
+  WriteGpt (Disk, 4);
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+  CheckGptChildren (4);
+  EXPECT_EQ (mPartitionModelStatistics.Writes, 0U);
+
+  //
+  // The protective MBR and both headers are read at once, then both
+  // partition entry arrays
+  //
+  EXPECT_EQ (mPartitionModelStatistics.Reads, 5U);
+  EXPECT_EQ (mPartitionModelStatistics.AsyncReads, 5U);
+  EXPECT_EQ (mPartitionModelStatistics.MaxInFlight, 3U);
+}
+
+TEST_F (PartitionTest, DiskIoOnly) {
+  mPartitionModelConfig.DiskIo2 = FALSE;
+  WriteGpt (Disk, 7);
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+  CheckGptChildren (7);
+  EXPECT_EQ (mPartitionModelStatistics.Reads, 5U);
+  EXPECT_EQ (mPartitionModelStatistics.AsyncReads, 0U);
+}
+
+TEST_F (PartitionTest, DriverBindingTpl) {
+  //
+  // The driver binding probes at TPL_CALLBACK, where the reads are not
+  // waited for through DiskIo2
+  //
+  mPartitionModelConfig.Tpl = TPL_CALLBACK;
+  WriteGpt (Disk, 4);
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+  CheckGptChildren (4);
+  EXPECT_EQ (mPartitionModelStatistics.Reads, 5U);
+  EXPECT_EQ (mPartitionModelStatistics.AsyncReads, 0U);
+}
+
+TEST_F (PartitionTest, StuckDiskIo2) {
+  //
+  // Each of the two batches is canceled after the timeout and read again
+  // through DiskIo
+  //
+  mPartitionModelConfig.Stuck = TRUE;
+  WriteGpt (Disk, 4);
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+  CheckGptChildren (4);
+  EXPECT_EQ (mPartitionModelStatistics.Cancels, 2U);
+  EXPECT_EQ (mPartitionModelStatistics.AsyncReads, 5U);
+  EXPECT_EQ (mPartitionModelStatistics.Reads, 10U);
+  EXPECT_GE (PartitionModelNow (), 2 * READ_TIMEOUT);
+  EXPECT_LT (PartitionModelNow (), 3 * READ_TIMEOUT);
+}
+
+TEST_F (PartitionTest, RestorePrimary) {
+  UINT8  *Image;
+
+  WriteGpt (Disk, 3);
+  Image = PartitionModelImage (Disk);
+  memset (Image + DISK_BLOCK_SIZE, 0, DISK_BLOCK_SIZE);
+
+  //
+  // The partitions come from the backup table, which is written back to
+  // the primary place
+  //
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+  CheckGptChildren (3);
+  EXPECT_EQ (mPartitionModelStatistics.Writes, 2U);
+  EXPECT_EQ (memcmp (Image + DISK_BLOCK_SIZE, "EFI PART", 8), 0);
+
+  ResetStatistics ();
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+  CheckGptChildren (3);
+  EXPECT_EQ (mPartitionModelStatistics.Writes, 0U);
+}
+
+TEST_F (PartitionTest, RestoreBackup) {
+  UINT8  *Image;
+
+  WriteGpt (Disk, 3);
+  Image = PartitionModelImage (Disk);
+  Image[(UINTN)(DISK_BLOCKS - 1) * DISK_BLOCK_SIZE + 8] ^= 0xFF;
+
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+  CheckGptChildren (3);
+  EXPECT_EQ (mPartitionModelStatistics.Writes, 2U);
+  EXPECT_EQ (memcmp (Image + (UINTN)(DISK_BLOCKS - 1) * DISK_BLOCK_SIZE, "EFI PART", 8), 0);
+
+  ResetStatistics ();
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+  EXPECT_EQ (mPartitionModelStatistics.Writes, 0U);
+}
+
+TEST_F (PartitionTest, DamagedEntries) {
+  UINT8  *Image;
+
+  //
+  // A primary partition entry array that fails its CRC makes the backup
+  // table the one used
+  //
+  WriteGpt (Disk, 5);
+  Image                            = PartitionModelImage (Disk);
+  Image[2 * DISK_BLOCK_SIZE + 40] ^= 0x01;
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+  CheckGptChildren (5);
+  EXPECT_GT (mPartitionModelStatistics.Writes, 0U);
+
+  //
+  // With both tables damaged the disk is no GPT disk
+  //
+  WriteGpt (Disk, 5);
+  Image[2 * DISK_BLOCK_SIZE + 40]                         ^= 0x01;
+  Image[(UINTN)(DISK_BLOCKS - 33) * DISK_BLOCK_SIZE + 40] ^= 0x01;
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_NOT_FOUND);
+  EXPECT_EQ (mPartitionModelChildCount, 0U);
+}
+
+TEST_F (PartitionTest, CachedReconnect) {
+  WriteGpt (Disk, 4);
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+
+  //
+  // The reconnect reads the protective MBR and the headers only
+  //
+  ResetStatistics ();
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+  CheckGptChildren (4);
+  EXPECT_EQ (mPartitionModelStatistics.Reads, 3U);
+  EXPECT_EQ (mPartitionModelStatistics.BytesRead, 3U * DISK_BLOCK_SIZE);
+
+  //
+  // A new partition table on the disk is read again
+  //
+  WriteGpt (Disk, 6);
+  ResetStatistics ();
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+  CheckGptChildren (6);
+  EXPECT_EQ (mPartitionModelStatistics.Reads, 5U);
+
+  //
+  // So is the same partition table on a new media
+  //
+  PartitionModelChangeMedia (Disk);
+  ResetStatistics ();
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+  CheckGptChildren (6);
+  EXPECT_EQ (mPartitionModelStatistics.Reads, 5U);
+
+  ResetStatistics ();
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+  CheckGptChildren (6);
+  EXPECT_EQ (mPartitionModelStatistics.Reads, 3U);
+}
+
+TEST_F (PartitionTest, MbrDisk) {
+  UINTN  Index;
+
+  PartitionModelWriteMbr (Disk, 0x12345678, 3, PARTITION_BLOCKS);
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_SUCCESS);
+  ASSERT_EQ (mPartitionModelChildCount, 3U);
+  for (Index = 0; Index < 3; Index++) {
+    EXPECT_EQ (mPartitionModelChildren[Index].Type, (UINT32)PARTITION_TYPE_MBR);
+    EXPECT_EQ (mPartitionModelChildren[Index].System, Index == 0);
+    EXPECT_EQ (mPartitionModelChildren[Index].Start, 1 + Index * PARTITION_BLOCKS);
+    EXPECT_EQ (mPartitionModelChildren[Index].End, (Index + 1) * PARTITION_BLOCKS);
+  }
+
+  //
+  // A blank disk has no partitions
+  //
+  memset (PartitionModelImage (Disk), 0, DISK_BLOCK_SIZE);
+  EXPECT_EQ (PartitionModelProbe (Disk), EFI_NOT_FOUND);
+  EXPECT_EQ (mPartitionModelChildCount, 0U);
+}
+
+TEST_F (PartitionTest, ProbeBenchmark) {
+  VOID    *Disks[BENCHMARK_DISKS];
+  UINT64  Sync;
+  UINT64  Async;
+  UINT64  Cached;
+  UINTN   Index;
+
+  for (Index = 0; Index < BENCHMARK_DISKS; Index++) {
+    Disks[Index] = PartitionModelCreateDisk (DISK_BLOCK_SIZE, DISK_BLOCKS);
+    WriteGpt (Disks[Index], 4);
+  }
+
+  mPartitionModelConfig.DiskIo2 = FALSE;
+  Sync                          = ProbeTime (Disks, BENCHMARK_DISKS);
+
+  //
+  // A new media keeps the disks out of the cache
+  //
+  for (Index = 0; Index < BENCHMARK_DISKS; Index++) {
+    PartitionModelChangeMedia (Disks[Index]);
+  }
+
+  mPartitionModelConfig.DiskIo2 = TRUE;
+  Async                         = ProbeTime (Disks, BENCHMARK_DISKS);
+  Cached                        = ProbeTime (Disks, BENCHMARK_DISKS);
+
+  printf (
+    "  %d GPT disks: %4llu us through DiskIo, %4llu us through DiskIo2, %4llu us on reconnect\n",
+    BENCHMARK_DISKS,
+    (unsigned long long)Sync,
+    (unsigned long long)Async,
+    (unsigned long long)Cached
+    );
+  EXPECT_LT (Async * 2, Sync);
+  EXPECT_LT (Cached * 3, Async * 2);
+
+  for (Index = 0; Index < BENCHMARK_DISKS; Index++) {
+    PartitionModelFreeDisk (Disks[Index]);
+  }
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
@@ -0,0 +1,631 @@
+/** @file
+  RAM disks behind a DiskIo and a DiskIo2 protocol for the host test of the
+  partition probing of PartitionDxe, and the events, delays and TPL of the
+  boot services the probing uses, taken over from
+  UnitTestUefiBootServicesTableLib.
+
+  The disks serve their images the way the block I/O of RamDiskDxe does,
+  which cannot be built into a host application itself. Each read or write
+  takes the time the host needs to start it, then the disk latency and its
+  transfer time at the disk bandwidth. The reads of DiskIo2 are in flight
+  together, and the clock jumps to the completion of a read when the driver
+  polls its event. The reads of a stuck disk never complete until they are
+  canceled, and the delays of the driver advance the clock meanwhile.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "../Partition.h"
+#include "PartitionModel.h"
+
+#define MODEL_MAX_EVENTS       16
+#define MODEL_GPT_ENTRIES      128
+#define MODEL_DISK_SIGNATURE   SIGNATURE_32 ('M', 'D', 's', 'k')
+
+typedef struct {
+  UINT32                   Signature;
+  EFI_BLOCK_IO_PROTOCOL    BlockIo;
+  EFI_BLOCK_IO_MEDIA       Media;
+  EFI_DISK_IO_PROTOCOL     DiskIo;
+  EFI_DISK_IO2_PROTOCOL    DiskIo2;
+  UINT8                    *Image;
+  UINT64                   Size;
+} MODEL_DISK;
+
+#define MODEL_DISK_FROM_DISK_IO(a)   CR (a, MODEL_DISK, DiskIo, MODEL_DISK_SIGNATURE)
+#define MODEL_DISK_FROM_DISK_IO2(a)  CR (a, MODEL_DISK, DiskIo2, MODEL_DISK_SIGNATURE)
+
+typedef struct {
+  BOOLEAN               Used;
+  BOOLEAN               Armed;
+  UINT64                Deadline;     // MAX_UINT64 while the read is stuck
+  EFI_DISK_IO2_TOKEN    *Token;
+} MODEL_EVENT;
+
+PARTITION_MODEL_CONFIG      mPartitionModelConfig;
+PARTITION_MODEL_STATISTICS  mPartitionModelStatistics;
+PARTITION_MODEL_CHILD       mPartitionModelChildren[PARTITION_MODEL_MAX_CHILDREN];
+UINTN                       mPartitionModelChildCount;
+
+STATIC EFI_BOOT_SERVICES  mModelBootServices;
+STATIC BOOLEAN            mModelTakenOver;
+STATIC MODEL_EVENT        mModelEvents[MODEL_MAX_EVENTS];
+STATIC UINT64             mModelNow;
+STATIC UINT32             mModelMediaId;
+STATIC EFI_TPL            mModelTpl;
+
+STATIC EFI_DEVICE_PATH_PROTOCOL  mModelDevicePath = {
+  END_DEVICE_PATH_TYPE,
+  END_ENTIRE_DEVICE_PATH_SUBTYPE,
+  { END_DEVICE_PATH_LENGTH, 0 }
+};
+
+STATIC EFI_GUID  mModelBasicDataGuid = {
+  0xEBD0A0A2, 0xB9E5, 0x4433, { 0x87, 0xC0, 0x68, 0xB6, 0xB7, 0x26, 0x99, 0xC7 }
+};
+
+/**
+  Record the child handle instead of installing it.
+
+**/
+EFI_STATUS
+PartitionInstallChildHandle (
+  IN  EFI_DRIVER_BINDING_PROTOCOL  *This,
+  IN  EFI_HANDLE                   ParentHandle,
+  IN  EFI_DISK_IO_PROTOCOL         *ParentDiskIo,
+  IN  EFI_DISK_IO2_PROTOCOL        *ParentDiskIo2,
+  IN  EFI_BLOCK_IO_PROTOCOL        *ParentBlockIo,
+  IN  EFI_BLOCK_IO2_PROTOCOL       *ParentBlockIo2,
+  IN  EFI_DEVICE_PATH_PROTOCOL     *ParentDevicePath,
+  IN  EFI_DEVICE_PATH_PROTOCOL     *DevicePathNode,
+  IN  EFI_PARTITION_INFO_PROTOCOL  *PartitionInfo,
+  IN  EFI_LBA                      Start,
+  IN  EFI_LBA                      End,
+  IN  UINT32                       BlockSize,
+  IN  EFI_GUID                     *TypeGuid
+  )
+{
+  PARTITION_MODEL_CHILD  *Child;
+
+  if (mPartitionModelChildCount == PARTITION_MODEL_MAX_CHILDREN) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Child                  = &mPartitionModelChildren[mPartitionModelChildCount++];
+  Child->PartitionNumber = ((HARDDRIVE_DEVICE_PATH *)DevicePathNode)->PartitionNumber;
+  Child->Type            = PartitionInfo->Type;
+  Child->System          = (BOOLEAN)(PartitionInfo->System != 0);
+  Child->Start           = Start;
+  Child->End             = End;
+  Child->BlockSize       = BlockSize;
+  return EFI_SUCCESS;
+}
+
+/**
+  Return the time a read or a write of the given size takes on the disk.
+
+**/
+STATIC
+UINT64
+ModelAccessTime (
+  IN UINTN  Size
+  )
+{
+  return mPartitionModelConfig.Latency +
+         DivU64x64Remainder (MultU64x32 (Size, 1000000000), mPartitionModelConfig.Bandwidth, NULL);
+}
+
+/**
+  Move data between a buffer and the image, with the checks of the block I/O
+  of RamDiskDxe.
+
+**/
+STATIC
+EFI_STATUS
+ModelAccess (
+  IN     MODEL_DISK  *Disk,
+  IN     UINT32      MediaId,
+  IN     UINT64      Offset,
+  IN     UINTN       Size,
+  IN OUT VOID        *Buffer,
+  IN     BOOLEAN     Write
+  )
+{
+  if (MediaId != Disk->Media.MediaId) {
+    return EFI_MEDIA_CHANGED;
+  }
+
+  if ((Offset > Disk->Size) || (Size > Disk->Size - Offset)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (Write) {
+    CopyMem (Disk->Image + Offset, Buffer, Size);
+  } else {
+    CopyMem (Buffer, Disk->Image + Offset, Size);
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Return the number of reads in flight.
+
+**/
+STATIC
+UINT32
+ModelInFlight (
+  VOID
+  )
+{
+  UINTN   Index;
+  UINT32  InFlight;
+
+  InFlight = 0;
+  for (Index = 0; Index < MODEL_MAX_EVENTS; Index++) {
+    if (mModelEvents[Index].Used && mModelEvents[Index].Armed && (mModelEvents[Index].Deadline > mModelNow)) {
+      InFlight++;
+    }
+  }
+
+  return InFlight;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelReadDisk (
+  IN  EFI_DISK_IO_PROTOCOL  *This,
+  IN  UINT32                MediaId,
+  IN  UINT64                Offset,
+  IN  UINTN                 BufferSize,
+  OUT VOID                  *Buffer
+  )
+{
+  mPartitionModelStatistics.Reads++;
+  mPartitionModelStatistics.BytesRead += BufferSize;
+  mModelNow                           += mPartitionModelConfig.SubmitTime + ModelAccessTime (BufferSize);
+  return ModelAccess (MODEL_DISK_FROM_DISK_IO (This), MediaId, Offset, BufferSize, Buffer, FALSE);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelWriteDisk (
+  IN EFI_DISK_IO_PROTOCOL  *This,
+  IN UINT32                MediaId,
+  IN UINT64                Offset,
+  IN UINTN                 BufferSize,
+  IN VOID                  *Buffer
+  )
+{
+  mPartitionModelStatistics.Writes++;
+  mModelNow += mPartitionModelConfig.SubmitTime + ModelAccessTime (BufferSize);
+  return ModelAccess (MODEL_DISK_FROM_DISK_IO (This), MediaId, Offset, BufferSize, Buffer, TRUE);
+}
+
+/**
+  A read with an event completes after its access time, the clock runs on
+  while it is in flight.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+ModelReadDiskEx (
+  IN     EFI_DISK_IO2_PROTOCOL  *This,
+  IN     UINT32                 MediaId,
+  IN     UINT64                 Offset,
+  IN OUT EFI_DISK_IO2_TOKEN     *Token,
+  IN     UINTN                  BufferSize,
+  OUT    VOID                   *Buffer
+  )
+{
+  MODEL_DISK   *Disk;
+  MODEL_EVENT  *ModelEvent;
+
+  Disk = MODEL_DISK_FROM_DISK_IO2 (This);
+  if ((Token == NULL) || (Token->Event == NULL)) {
+    return ModelReadDisk (&Disk->DiskIo, MediaId, Offset, BufferSize, Buffer);
+  }
+
+  if (MediaId != Disk->Media.MediaId) {
+    return EFI_MEDIA_CHANGED;
+  }
+
+  mPartitionModelStatistics.Reads++;
+  mPartitionModelStatistics.AsyncReads++;
+  mPartitionModelStatistics.BytesRead += BufferSize;
+  mModelNow                           += mPartitionModelConfig.SubmitTime;
+
+  ModelEvent        = (MODEL_EVENT *)Token->Event;
+  ModelEvent->Armed = TRUE;
+  ModelEvent->Token = Token;
+  if (mPartitionModelConfig.Stuck) {
+    ModelEvent->Deadline = MAX_UINT64;
+  } else {
+    Token->TransactionStatus = ModelAccess (Disk, MediaId, Offset, BufferSize, Buffer, FALSE);
+    ModelEvent->Deadline     = mModelNow + ModelAccessTime (BufferSize);
+  }
+
+  mPartitionModelStatistics.MaxInFlight = MAX (mPartitionModelStatistics.MaxInFlight, ModelInFlight ());
+  return EFI_SUCCESS;
+}
+
+/**
+  Abort the reads in flight the way DiskIoDxe does, signaling their events
+  with EFI_ABORTED.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCancel (
+  IN EFI_DISK_IO2_PROTOCOL  *This
+  )
+{
+  UINTN  Index;
+
+  mPartitionModelStatistics.Cancels++;
+  for (Index = 0; Index < MODEL_MAX_EVENTS; Index++) {
+    if (mModelEvents[Index].Used && mModelEvents[Index].Armed && (mModelEvents[Index].Deadline > mModelNow)) {
+      mModelEvents[Index].Token->TransactionStatus = EFI_ABORTED;
+      mModelEvents[Index].Deadline                 = mModelNow;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCreateEvent (
+  IN  UINT32            Type,
+  IN  EFI_TPL           NotifyTpl,
+  IN  EFI_EVENT_NOTIFY  NotifyFunction OPTIONAL,
+  IN  VOID              *NotifyContext OPTIONAL,
+  OUT EFI_EVENT         *Event
+  )
+{
+  UINTN  Index;
+
+  ASSERT (NotifyFunction == NULL);
+  for (Index = 0; Index < MODEL_MAX_EVENTS; Index++) {
+    if (!mModelEvents[Index].Used) {
+      ZeroMem (&mModelEvents[Index], sizeof (MODEL_EVENT));
+      mModelEvents[Index].Used = TRUE;
+      *Event                   = &mModelEvents[Index];
+      return EFI_SUCCESS;
+    }
+  }
+
+  return EFI_OUT_OF_RESOURCES;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCloseEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  ((MODEL_EVENT *)Event)->Used = FALSE;
+  return EFI_SUCCESS;
+}
+
+/**
+  The driver polls the events of its reads, so the clock jumps to the
+  completion of the read. A stuck read is never complete.
+
+**/
+STATIC
+EFI_STATUS
+EFIAPI
+ModelCheckEvent (
+  IN EFI_EVENT  Event
+  )
+{
+  MODEL_EVENT  *ModelEvent;
+
+  ModelEvent = (MODEL_EVENT *)Event;
+  if (!ModelEvent->Armed || (ModelEvent->Deadline == MAX_UINT64)) {
+    return EFI_NOT_READY;
+  }
+
+  mModelNow         = MAX (mModelNow, ModelEvent->Deadline);
+  ModelEvent->Armed = FALSE;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+ModelStall (
+  IN UINTN  Microseconds
+  )
+{
+  mModelNow += MultU64x32 (Microseconds, 1000);
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_TPL
+EFIAPI
+ModelRaiseTpl (
+  IN EFI_TPL  NewTpl
+  )
+{
+  EFI_TPL  OldTpl;
+
+  ASSERT (NewTpl >= mModelTpl);
+  OldTpl    = mModelTpl;
+  mModelTpl = NewTpl;
+  return OldTpl;
+}
+
+STATIC
+VOID
+EFIAPI
+ModelRestoreTpl (
+  IN EFI_TPL  OldTpl
+  )
+{
+  ASSERT (OldTpl <= mModelTpl);
+  mModelTpl = OldTpl;
+}
+
+VOID
+PartitionModelDefaultConfig (
+  VOID
+  )
+{
+  PartitionModelFree ();
+
+  ZeroMem (&mPartitionModelConfig, sizeof (mPartitionModelConfig));
+  mPartitionModelConfig.DiskIo2    = TRUE;
+  mPartitionModelConfig.Latency    = 100000;
+  mPartitionModelConfig.Bandwidth  = 1000000000;
+  mPartitionModelConfig.SubmitTime = 1000;
+  mPartitionModelConfig.Tpl        = TPL_APPLICATION;
+
+  ZeroMem (&mPartitionModelStatistics, sizeof (mPartitionModelStatistics));
+  ZeroMem (mModelEvents, sizeof (mModelEvents));
+  mModelNow = 0;
+  mModelTpl = TPL_APPLICATION;
+
+  CopyMem (&mModelBootServices, gBS, sizeof (EFI_BOOT_SERVICES));
+  gBS->CreateEvent = ModelCreateEvent;
+  gBS->CloseEvent  = ModelCloseEvent;
+  gBS->CheckEvent  = ModelCheckEvent;
+  gBS->Stall       = ModelStall;
+  gBS->RaiseTPL    = ModelRaiseTpl;
+  gBS->RestoreTPL  = ModelRestoreTpl;
+  mModelTakenOver  = TRUE;
+}
+
+VOID
+PartitionModelFree (
+  VOID
+  )
+{
+  if (!mModelTakenOver) {
+    return;
+  }
+
+  CopyMem (gBS, &mModelBootServices, sizeof (EFI_BOOT_SERVICES));
+  mModelTakenOver = FALSE;
+}
+
+VOID *
+PartitionModelCreateDisk (
+  IN UINT32  BlockSize,
+  IN UINT64  Blocks
+  )
+{
+  MODEL_DISK  *Disk;
+
+  Disk = AllocateZeroPool (sizeof (MODEL_DISK));
+  ASSERT (Disk != NULL);
+  Disk->Size  = MultU64x32 (Blocks, BlockSize);
+  Disk->Image = AllocateZeroPool ((UINTN)Disk->Size);
+  ASSERT (Disk->Image != NULL);
+
+  Disk->Signature          = MODEL_DISK_SIGNATURE;
+  Disk->BlockIo.Revision   = EFI_BLOCK_IO_PROTOCOL_REVISION;
+  Disk->BlockIo.Media      = &Disk->Media;
+  Disk->Media.MediaId      = ++mModelMediaId;
+  Disk->Media.MediaPresent = TRUE;
+  Disk->Media.BlockSize    = BlockSize;
+  Disk->Media.LastBlock    = Blocks - 1;
+  Disk->DiskIo.Revision    = EFI_DISK_IO_PROTOCOL_REVISION;
+  Disk->DiskIo.ReadDisk    = ModelReadDisk;
+  Disk->DiskIo.WriteDisk   = ModelWriteDisk;
+  Disk->DiskIo2.Revision   = EFI_DISK_IO2_PROTOCOL_REVISION;
+  Disk->DiskIo2.ReadDiskEx = ModelReadDiskEx;
+  Disk->DiskIo2.Cancel     = ModelCancel;
+  return Disk;
+}
+
+VOID
+PartitionModelFreeDisk (
+  IN VOID  *Disk
+  )
+{
+  FreePool (((MODEL_DISK *)Disk)->Image);
+  FreePool (Disk);
+}
+
+UINT8 *
+PartitionModelImage (
+  IN VOID  *Disk
+  )
+{
+  return ((MODEL_DISK *)Disk)->Image;
+}
+
+VOID
+PartitionModelChangeMedia (
+  IN VOID  *Disk
+  )
+{
+  ((MODEL_DISK *)Disk)->Media.MediaId = ++mModelMediaId;
+}
+
+/**
+  Write a GPT header and its partition entry array to the image.
+
+**/
+STATIC
+VOID
+ModelWriteGptTable (
+  IN MODEL_DISK                  *Disk,
+  IN EFI_PARTITION_TABLE_HEADER  *Header,
+  IN EFI_PARTITION_ENTRY         *Entries,
+  IN EFI_LBA                     MyLba,
+  IN EFI_LBA                     AlternateLba,
+  IN EFI_LBA                     EntryLba
+  )
+{
+  UINT32  BlockSize;
+
+  BlockSize                      = Disk->Media.BlockSize;
+  Header->MyLBA                  = MyLba;
+  Header->AlternateLBA           = AlternateLba;
+  Header->PartitionEntryLBA      = EntryLba;
+  Header->Header.CRC32           = 0;
+  Header->Header.CRC32           = CalculateCrc32 (Header, Header->Header.HeaderSize);
+  ZeroMem (Disk->Image + MultU64x32 (MyLba, BlockSize), BlockSize);
+  CopyMem (Disk->Image + MultU64x32 (MyLba, BlockSize), Header, sizeof (EFI_PARTITION_TABLE_HEADER));
+  CopyMem (Disk->Image + MultU64x32 (EntryLba, BlockSize), Entries, MODEL_GPT_ENTRIES * sizeof (EFI_PARTITION_ENTRY));
+}
+
+VOID
+PartitionModelWriteGpt (
+  IN VOID      *Disk,
+  IN EFI_GUID  *DiskGuid,
+  IN UINTN     Partitions,
+  IN UINT64    PartitionBlocks
+  )
+{
+  MODEL_DISK                  *ModelDisk;
+  MASTER_BOOT_RECORD          *Pmbr;
+  EFI_PARTITION_TABLE_HEADER  Header;
+  EFI_PARTITION_ENTRY         *Entries;
+  UINT32                      BlockSize;
+  EFI_LBA                     LastBlock;
+  UINTN                       EntryBlocks;
+  UINTN                       Index;
+
+  ModelDisk   = (MODEL_DISK *)Disk;
+  BlockSize   = ModelDisk->Media.BlockSize;
+  LastBlock   = ModelDisk->Media.LastBlock;
+  EntryBlocks = MODEL_GPT_ENTRIES * sizeof (EFI_PARTITION_ENTRY) / BlockSize;
+
+  Pmbr = (MASTER_BOOT_RECORD *)ModelDisk->Image;
+  ZeroMem (Pmbr, sizeof (MASTER_BOOT_RECORD));
+  Pmbr->Partition[0].OSIndicator = PMBR_GPT_PARTITION;
+  *(UINT32 *)Pmbr->Partition[0].StartingLBA = 1;
+  *(UINT32 *)Pmbr->Partition[0].SizeInLBA   = (UINT32)MIN (LastBlock, MAX_UINT32);
+  Pmbr->Signature = MBR_SIGNATURE;
+
+  Entries = AllocateZeroPool (MODEL_GPT_ENTRIES * sizeof (EFI_PARTITION_ENTRY));
+  ASSERT (Entries != NULL);
+  for (Index = 0; Index < Partitions; Index++) {
+    CopyGuid (&Entries[Index].PartitionTypeGUID, (Index == 0) ? &gEfiPartTypeSystemPartGuid : &mModelBasicDataGuid);
+    CopyGuid (&Entries[Index].UniquePartitionGUID, DiskGuid);
+    Entries[Index].UniquePartitionGUID.Data4[7] = (UINT8)(Index + 1);
+    Entries[Index].StartingLBA                  = 2 + EntryBlocks + Index * PartitionBlocks;
+    Entries[Index].EndingLBA                    = Entries[Index].StartingLBA + PartitionBlocks - 1;
+  }
+
+  ZeroMem (&Header, sizeof (Header));
+  Header.Header.Signature         = EFI_PTAB_HEADER_ID;
+  Header.Header.Revision          = 0x00010000;
+  Header.Header.HeaderSize        = sizeof (EFI_PARTITION_TABLE_HEADER);
+  Header.FirstUsableLBA           = 2 + EntryBlocks;
+  Header.LastUsableLBA            = LastBlock - 1 - EntryBlocks;
+  Header.NumberOfPartitionEntries = MODEL_GPT_ENTRIES;
+  Header.SizeOfPartitionEntry     = sizeof (EFI_PARTITION_ENTRY);
+  Header.PartitionEntryArrayCRC32 = CalculateCrc32 (Entries, MODEL_GPT_ENTRIES * sizeof (EFI_PARTITION_ENTRY));
+  CopyGuid (&Header.DiskGUID, DiskGuid);
+
+  ModelWriteGptTable (ModelDisk, &Header, Entries, PRIMARY_PART_HEADER_LBA, LastBlock, PRIMARY_PART_HEADER_LBA + 1);
+  ModelWriteGptTable (ModelDisk, &Header, Entries, LastBlock, PRIMARY_PART_HEADER_LBA, LastBlock - EntryBlocks);
+  FreePool (Entries);
+}
+
+VOID
+PartitionModelWriteMbr (
+  IN VOID    *Disk,
+  IN UINT32  Signature,
+  IN UINTN   Partitions,
+  IN UINT32  PartitionBlocks
+  )
+{
+  MASTER_BOOT_RECORD  *Mbr;
+  UINTN               Index;
+
+  ASSERT (Partitions <= MAX_MBR_PARTITIONS);
+  Mbr = (MASTER_BOOT_RECORD *)((MODEL_DISK *)Disk)->Image;
+  ZeroMem (Mbr, sizeof (MASTER_BOOT_RECORD));
+  for (Index = 0; Index < Partitions; Index++) {
+    Mbr->Partition[Index].OSIndicator = (Index == 0) ? EFI_PARTITION : 0x83;
+    *(UINT32 *)Mbr->Partition[Index].StartingLBA = (UINT32)(1 + Index * PartitionBlocks);
+    *(UINT32 *)Mbr->Partition[Index].SizeInLBA   = PartitionBlocks;
+  }
+
+  *(UINT32 *)Mbr->UniqueMbrSignature = Signature;
+  Mbr->Signature                     = MBR_SIGNATURE;
+}
+
+EFI_STATUS
+PartitionModelProbe (
+  IN VOID  *Disk
+  )
+{
+  MODEL_DISK             *ModelDisk;
+  EFI_DISK_IO2_PROTOCOL  *DiskIo2;
+  EFI_STATUS             Status;
+  EFI_TPL                OldTpl;
+
+  ModelDisk                 = (MODEL_DISK *)Disk;
+  DiskIo2                   = mPartitionModelConfig.DiskIo2 ? &ModelDisk->DiskIo2 : NULL;
+  mPartitionModelChildCount = 0;
+  ZeroMem (mPartitionModelChildren, sizeof (mPartitionModelChildren));
+
+  OldTpl = gBS->RaiseTPL (mPartitionModelConfig.Tpl);
+
+  Status = PartitionInstallGptChildHandles (
+             NULL,
+             (EFI_HANDLE)ModelDisk,
+             &ModelDisk->DiskIo,
+             DiskIo2,
+             &ModelDisk->BlockIo,
+             NULL,
+             &mModelDevicePath
+             );
+  if (EFI_ERROR (Status) && (Status != EFI_MEDIA_CHANGED) && (Status != EFI_NO_MEDIA)) {
+    Status = PartitionInstallMbrChildHandles (
+               NULL,
+               (EFI_HANDLE)ModelDisk,
+               &ModelDisk->DiskIo,
+               DiskIo2,
+               &ModelDisk->BlockIo,
+               NULL,
+               &mModelDevicePath
+               );
+  }
+
+  gBS->RestoreTPL (OldTpl);
+  return Status;
+}
+
+UINT64
+PartitionModelNow (
+  VOID
+  )
+{
+  return mModelNow;
+}
@@ -0,0 +1,176 @@
+/** @file
+  Interface of the RAM disk model to the host test of the partition probing
+  of PartitionDxe.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#ifndef PARTITION_MODEL_H_
+#define PARTITION_MODEL_H_
+
+#define PARTITION_MODEL_MAX_CHILDREN  32
+
+//
+// The disk model. Times are in nanoseconds.
+//
+typedef struct {
+  BOOLEAN    DiskIo2;         // The disks have a DiskIo2 protocol
+  UINT64     Latency;         // Time the disk takes for a read or a write
+  UINT64     Bandwidth;       // Bytes per second of the disk
+  UINT64     SubmitTime;      // Time the host takes to start a read or a write
+  BOOLEAN    Stuck;           // The reads of DiskIo2 never complete
+  EFI_TPL    Tpl;             // The TPL the partitions are probed at
+} PARTITION_MODEL_CONFIG;
+
+typedef struct {
+  UINT32    Reads;
+  UINT32    AsyncReads;
+  UINT64    BytesRead;
+  UINT32    Writes;
+  UINT32    MaxInFlight;
+  UINT32    Cancels;
+} PARTITION_MODEL_STATISTICS;
+
+//
+// A child handle the partition driver installed
+//
+typedef struct {
+  UINT32      PartitionNumber;
+  UINT32      Type;           // PARTITION_TYPE_GPT or PARTITION_TYPE_MBR
+  BOOLEAN     System;
+  EFI_LBA     Start;
+  EFI_LBA     End;
+  UINT32      BlockSize;
+} PARTITION_MODEL_CHILD;
+
+extern PARTITION_MODEL_CONFIG      mPartitionModelConfig;
+extern PARTITION_MODEL_STATISTICS  mPartitionModelStatistics;
+extern PARTITION_MODEL_CHILD       mPartitionModelChildren[PARTITION_MODEL_MAX_CHILDREN];
+extern UINTN                       mPartitionModelChildCount;
+
+/**
+  Set the model to its default configuration: disks with DiskIo2, a latency
+  of 100 us, a bandwidth of 1 GB/s and 1 us to start a command, probed at
+  TPL_APPLICATION. Reset the clock and the statistics, and take over the
+  boot services the probing uses for events, delays and the TPL.
+
+**/
+VOID
+PartitionModelDefaultConfig (
+  VOID
+  );
+
+/**
+  Give the boot services back.
+
+**/
+VOID
+PartitionModelFree (
+  VOID
+  );
+
+/**
+  Register a zeroed RAM disk image of the given size.
+
+  @param  BlockSize              The block size of the RAM disk.
+  @param  Blocks                 The number of blocks of the RAM disk.
+
+  @return The RAM disk.
+
+**/
+VOID *
+PartitionModelCreateDisk (
+  IN UINT32  BlockSize,
+  IN UINT64  Blocks
+  );
+
+/**
+  Unregister a RAM disk and free its image.
+
+**/
+VOID
+PartitionModelFreeDisk (
+  IN VOID  *Disk
+  );
+
+/**
+  Return the image of a RAM disk.
+
+**/
+UINT8 *
+PartitionModelImage (
+  IN VOID  *Disk
+  );
+
+/**
+  Replace the media of a RAM disk, so its media ID changes.
+
+**/
+VOID
+PartitionModelChangeMedia (
+  IN VOID  *Disk
+  );
+
+/**
+  Write a protective MBR, and a primary and a backup GPT of 128 entries to
+  the image, describing partitions of the given size one after another. The
+  first partition is an EFI system partition.
+
+  @param  Disk                   The RAM disk.
+  @param  DiskGuid               The disk GUID.
+  @param  Partitions             The number of partitions.
+  @param  PartitionBlocks        The size of each partition in blocks.
+
+**/
+VOID
+PartitionModelWriteGpt (
+  IN VOID      *Disk,
+  IN EFI_GUID  *DiskGuid,
+  IN UINTN     Partitions,
+  IN UINT64    PartitionBlocks
+  );
+
+/**
+  Write a legacy MBR to the image describing partitions of the given size
+  one after another. The first partition is an EFI system partition.
+
+  @param  Disk                   The RAM disk.
+  @param  Signature              The unique MBR signature.
+  @param  Partitions             The number of partitions, at most 4.
+  @param  PartitionBlocks        The size of each partition in blocks.
+
+**/
+VOID
+PartitionModelWriteMbr (
+  IN VOID    *Disk,
+  IN UINT32  Signature,
+  IN UINTN   Partitions,
+  IN UINT32  PartitionBlocks
+  );
+
+/**
+  Probe the partitions of a RAM disk the way the driver binding does, the
+  GPT first and the MBR next at the configured TPL, and record the child
+  handles installed.
+
+  @param  Disk                   The RAM disk.
+
+  @return The status of the partition detection.
+
+**/
+EFI_STATUS
+PartitionModelProbe (
+  IN VOID  *Disk
+  );
+
+/**
+  Return the time of the clock, in nanoseconds.
+
+**/
+UINT64
+PartitionModelNow (
+  VOID
+  );
+
+#endif
@@ -10,8 +10,9 @@
   PartitionInstallGptChildHandles() routine will read disk partition content and
   do basic validation before PartitionInstallChildHandle().
 
-  PartitionValidGptTable(), PartitionCheckGptEntry() routine will accept disk
-  partition content and validate the GPT table and GPT entry.
+  PartitionValidGptTable(), PartitionValidGptHeader(), PartitionCheckGptEntry()
+  routine will accept disk partition content and validate the GPT table and
+  GPT entry.
 
 Copyright (c) 2018 Qualcomm Datacenter Technologies, Inc.
 Copyright (c) 2006 - 2019, Intel Corporation. All rights reserved.<BR>
@@ -21,6 +22,106 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 
 #include "Partition.h"
 
+//
+// The validated GPT partition maps of the disks connected so far, the most
+// recently used first
+//
+LIST_ENTRY  mPartitionGptCache      = INITIALIZE_LIST_HEAD_VARIABLE (mPartitionGptCache);
+UINTN       mPartitionGptCacheCount = 0;
+
+/**
+  Read a batch of regions of the disk. With DiskIo2 and below TPL_CALLBACK
+  all the reads of the batch are in flight at once, otherwise they go one
+  after another through DiskIo. The reads through DiskIo2 that have not
+  completed after PARTITION_READ_TIMEOUT are canceled and read through DiskIo.
+
+  @param[in]      DiskIo    Disk Io protocol.
+  @param[in]      DiskIo2   Disk Io2 protocol, may be NULL.
+  @param[in]      MediaId   Id of the media the reads are for.
+  @param[in, out] Requests  The reads. The status of each is returned in it.
+  @param[in]      Count     The number of reads.
+
+**/
+VOID
+PartitionReadDisks (
+  IN     EFI_DISK_IO_PROTOCOL    *DiskIo,
+  IN     EFI_DISK_IO2_PROTOCOL   *DiskIo2,
+  IN     UINT32                  MediaId,
+  IN OUT PARTITION_READ_REQUEST  *Requests,
+  IN     UINTN                   Count
+  );
+
+/**
+  Check a GPT partition table header read from the disk.
+
+  Caution: This function may receive untrusted input.
+  The GPT partition table header is external input, so this routine
+  will do basic validation for GPT partition table header before return.
+
+  @param[in]      BlockSize  The block size of the disk.
+  @param[in]      Lba        The Lba the header was read from.
+  @param[in, out] PartHdr    The block holding the header.
+
+  @retval TRUE      The partition table header is valid
+  @retval FALSE     The partition table header is not valid
+
+**/
+BOOLEAN
+PartitionValidGptHeader (
+  IN     UINT32                      BlockSize,
+  IN     EFI_LBA                     Lba,
+  IN OUT EFI_PARTITION_TABLE_HEADER  *PartHdr
+  );
+
+/**
+  Check the CRC of a partition entry array against the CRC field of its
+  partition table header.
+
+  @param[in]  PartHeader  Partition table header structure
+  @param[in]  PartEntry   The partition entry array
+
+  @retval TRUE      the CRC is valid
+  @retval FALSE     the CRC is invalid
+
+**/
+BOOLEAN
+PartitionCheckGptEntryArray (
+  IN  EFI_PARTITION_TABLE_HEADER  *PartHeader,
+  IN  EFI_PARTITION_ENTRY         *PartEntry
+  );
+
+/**
+  Find the cached partition map of a disk.
+
+  @param[in]  BlockIo     Parent BlockIo interface.
+  @param[in]  PartHeader  The valid primary partition table header of the disk.
+
+  @return The cached partition map, or NULL if the disk has none or the
+          header differs from the one the map was built from.
+
+**/
+PARTITION_GPT_CACHE_ENTRY *
+PartitionGptCacheLookup (
+  IN  EFI_BLOCK_IO_PROTOCOL       *BlockIo,
+  IN  EFI_PARTITION_TABLE_HEADER  *PartHeader
+  );
+
+/**
+  Cache the validated partition map of a disk, replacing an older map of
+  the same disk.
+
+  @param[in]  BlockIo     Parent BlockIo interface.
+  @param[in]  PartHeader  The valid primary partition table header of the disk.
+  @param[in]  PartEntry   The partition entry array checked against it.
+
+**/
+VOID
+PartitionGptCacheInsert (
+  IN  EFI_BLOCK_IO_PROTOCOL       *BlockIo,
+  IN  EFI_PARTITION_TABLE_HEADER  *PartHeader,
+  IN  EFI_PARTITION_ENTRY         *PartEntry
+  );
+
 /**
   Install child handles if the Handle supports GPT partition structure.
 
@@ -196,22 +297,31 @@ PartitionInstallGptChildHandles (
   EFI_STATUS                   Status;
   UINT32                       BlockSize;
   EFI_LBA                      LastBlock;
+  EFI_LBA                      BackupLba;
+  UINT8                        *Blocks;
   MASTER_BOOT_RECORD           *ProtectiveMbr;
   EFI_PARTITION_TABLE_HEADER   *PrimaryHeader;
   EFI_PARTITION_TABLE_HEADER   *BackupHeader;
+  EFI_PARTITION_TABLE_HEADER   *PartHeader;
   EFI_PARTITION_ENTRY          *PartEntry;
+  EFI_PARTITION_ENTRY          *BackupEntry;
   EFI_PARTITION_ENTRY          *Entry;
   EFI_PARTITION_ENTRY_STATUS   *PEntryStatus;
+  PARTITION_GPT_CACHE_ENTRY    *CacheEntry;
+  PARTITION_READ_REQUEST       Requests[3];
+  BOOLEAN                      PrimaryValid;
+  BOOLEAN                      BackupValid;
   UINTN                        Index;
   EFI_STATUS                   GptValidStatus;
   HARDDRIVE_DEVICE_PATH        HdDev;
   UINT32                       MediaId;
   EFI_PARTITION_INFO_PROTOCOL  PartitionInfo;
 
-  ProtectiveMbr = NULL;
+  Blocks        = NULL;
   PrimaryHeader = NULL;
   BackupHeader  = NULL;
   PartEntry     = NULL;
+  BackupEntry   = NULL;
   PEntryStatus  = NULL;
 
   BlockSize = BlockIo->Media->BlockSize;
@@ -231,31 +341,37 @@ PartitionInstallGptChildHandles (
   }
 
   //
-  // Allocate a buffer for the Protective MBR
+  // Allocate a buffer for the Protective MBR and the blocks the primary and
+  // the backup partition table headers are normally in
   //
-  ProtectiveMbr = AllocatePool (BlockSize);
-  if (ProtectiveMbr == NULL) {
+  Blocks = AllocateZeroPool (3 * (UINTN)BlockSize);
+  if (Blocks == NULL) {
     return EFI_NOT_FOUND;
   }
 
   //
-  // Read the Protective MBR from LBA #0
+  // Read the Protective MBR from LBA #0 together with both headers
   //
-  Status = DiskIo->ReadDisk (
-                     DiskIo,
-                     MediaId,
-                     0,
-                     BlockSize,
-                     ProtectiveMbr
-                     );
-  if (EFI_ERROR (Status)) {
-    GptValidStatus = Status;
+  ZeroMem (Requests, sizeof (Requests));
+  Requests[0].Offset = 0;
+  Requests[0].Size   = BlockSize;
+  Requests[0].Buffer = Blocks;
+  Requests[1].Offset = MultU64x32 (PRIMARY_PART_HEADER_LBA, BlockSize);
+  Requests[1].Size   = BlockSize;
+  Requests[1].Buffer = Blocks + BlockSize;
+  Requests[2].Offset = MultU64x32 (LastBlock, BlockSize);
+  Requests[2].Size   = BlockSize;
+  Requests[2].Buffer = Blocks + 2 * (UINTN)BlockSize;
+  PartitionReadDisks (DiskIo, DiskIo2, MediaId, Requests, ARRAY_SIZE (Requests));
+  if (EFI_ERROR (Requests[0].Status)) {
+    GptValidStatus = Requests[0].Status;
     goto Done;
   }
 
   //
   // Verify that the Protective MBR is valid
   //
+  ProtectiveMbr = (MASTER_BOOT_RECORD *)Blocks;
   for (Index = 0; Index < MAX_MBR_PARTITIONS; Index++) {
     if ((ProtectiveMbr->Partition[Index].OSIndicator == PMBR_GPT_PARTITION) &&
         (UNPACK_UINT32 (ProtectiveMbr->Partition[Index].StartingLBA) == 1)
@@ -282,16 +398,99 @@ PartitionInstallGptChildHandles (
     goto Done;
   }
 
+  PrimaryValid = FALSE;
+  if (!EFI_ERROR (Requests[1].Status) &&
+      PartitionValidGptHeader (BlockSize, PRIMARY_PART_HEADER_LBA, Requests[1].Buffer))
+  {
+    CopyMem (PrimaryHeader, Requests[1].Buffer, sizeof (EFI_PARTITION_TABLE_HEADER));
+    PrimaryValid = TRUE;
+  }
+
   //
-  // Check primary and backup partition tables
+  // A disk whose partition tables were validated on an earlier connect gets
+  // its partition entries from the cache, as long as its primary header is
+  // still the same
   //
-  if (!PartitionValidGptTable (BlockIo, DiskIo, PRIMARY_PART_HEADER_LBA, PrimaryHeader)) {
-    DEBUG ((DEBUG_INFO, " Not Valid primary partition table\n"));
+  CacheEntry = NULL;
+  if (PrimaryValid) {
+    CacheEntry = PartitionGptCacheLookup (BlockIo, PrimaryHeader);
+  }
 
-    if (!PartitionValidGptTable (BlockIo, DiskIo, LastBlock, BackupHeader)) {
-      DEBUG ((DEBUG_INFO, " Not Valid backup partition table\n"));
+  if (CacheEntry != NULL) {
+    DEBUG ((DEBUG_INFO, " Partition table of disk %g found in cache\n", &PrimaryHeader->DiskGUID));
+    PartEntry = AllocateCopyPool (CacheEntry->EntriesSize, CacheEntry->Entries);
+    if (PartEntry == NULL) {
+      DEBUG ((DEBUG_ERROR, "Allocate pool error\n"));
       goto Done;
-    } else {
+    }
+
+    PartHeader = PrimaryHeader;
+  } else {
+    //
+    // The backup header is read again if the primary header puts it
+    // somewhere else than the last block
+    //
+    BackupLba = LastBlock;
+    if (PrimaryValid && (PrimaryHeader->AlternateLBA != LastBlock)) {
+      BackupLba          = PrimaryHeader->AlternateLBA;
+      Requests[2].Offset = MultU64x32 (BackupLba, BlockSize);
+      PartitionReadDisks (DiskIo, DiskIo2, MediaId, &Requests[2], 1);
+    }
+
+    BackupValid = FALSE;
+    if (!EFI_ERROR (Requests[2].Status) &&
+        PartitionValidGptHeader (BlockSize, BackupLba, Requests[2].Buffer))
+    {
+      CopyMem (BackupHeader, Requests[2].Buffer, sizeof (EFI_PARTITION_TABLE_HEADER));
+      BackupValid = TRUE;
+    }
+
+    //
+    // Read the EFI Partition Entries of both tables at once
+    //
+    ZeroMem (Requests, sizeof (Requests));
+    if (PrimaryValid) {
+      PartEntry = AllocatePool (PrimaryHeader->NumberOfPartitionEntries * PrimaryHeader->SizeOfPartitionEntry);
+      if (PartEntry == NULL) {
+        DEBUG ((DEBUG_ERROR, "Allocate pool error\n"));
+        goto Done;
+      }
+
+      Requests[0].Offset = MultU64x32 (PrimaryHeader->PartitionEntryLBA, BlockSize);
+      Requests[0].Size   = PrimaryHeader->NumberOfPartitionEntries * PrimaryHeader->SizeOfPartitionEntry;
+      Requests[0].Buffer = PartEntry;
+    }
+
+    if (BackupValid) {
+      BackupEntry = AllocatePool (BackupHeader->NumberOfPartitionEntries * BackupHeader->SizeOfPartitionEntry);
+      if (BackupEntry == NULL) {
+        DEBUG ((DEBUG_ERROR, "Allocate pool error\n"));
+        goto Done;
+      }
+
+      Requests[1].Offset = MultU64x32 (BackupHeader->PartitionEntryLBA, BlockSize);
+      Requests[1].Size   = BackupHeader->NumberOfPartitionEntries * BackupHeader->SizeOfPartitionEntry;
+      Requests[1].Buffer = BackupEntry;
+    }
+
+    PartitionReadDisks (DiskIo, DiskIo2, MediaId, Requests, 2);
+
+    //
+    // Check primary and backup partition tables
+    //
+    PrimaryValid = (BOOLEAN)(PrimaryValid && !EFI_ERROR (Requests[0].Status) &&
+                             PartitionCheckGptEntryArray (PrimaryHeader, PartEntry));
+    BackupValid = (BOOLEAN)(BackupValid && !EFI_ERROR (Requests[1].Status) &&
+                            PartitionCheckGptEntryArray (BackupHeader, BackupEntry));
+
+    if (!PrimaryValid) {
+      DEBUG ((DEBUG_INFO, " Not Valid primary partition table\n"));
+
+      if (!BackupValid) {
+        DEBUG ((DEBUG_INFO, " Not Valid backup partition table\n"));
+        goto Done;
+      }
+
       DEBUG ((DEBUG_INFO, " Valid backup partition table\n"));
       DEBUG ((DEBUG_INFO, " Restore primary partition table by the backup\n"));
       if (!PartitionRestoreGptTable (BlockIo, DiskIo, BackupHeader)) {
@@ -299,50 +498,45 @@ PartitionInstallGptChildHandles (
       }
 
       if (PartitionValidGptTable (BlockIo, DiskIo, BackupHeader->AlternateLBA, PrimaryHeader)) {
-        DEBUG ((DEBUG_INFO, " Restore backup partition table success\n"));
+        DEBUG ((DEBUG_INFO, " Restore primary partition table success\n"));
       }
-    }
-  } else if (!PartitionValidGptTable (BlockIo, DiskIo, PrimaryHeader->AlternateLBA, BackupHeader)) {
-    DEBUG ((DEBUG_INFO, " Valid primary and !Valid backup partition table\n"));
-    DEBUG ((DEBUG_INFO, " Restore backup partition table by the primary\n"));
-    if (!PartitionRestoreGptTable (BlockIo, DiskIo, PrimaryHeader)) {
-      DEBUG ((DEBUG_INFO, " Restore backup partition table error\n"));
-    }
 
-    if (PartitionValidGptTable (BlockIo, DiskIo, PrimaryHeader->AlternateLBA, BackupHeader)) {
-      DEBUG ((DEBUG_INFO, " Restore backup partition table success\n"));
-    }
-  }
+      //
+      // The partitions are the ones the backup table describes
+      //
+      Entry       = PartEntry;
+      PartEntry   = BackupEntry;
+      BackupEntry = Entry;
+      PartHeader  = BackupHeader;
+    } else if (!BackupValid) {
+      DEBUG ((DEBUG_INFO, " Valid primary and !Valid backup partition table\n"));
+      DEBUG ((DEBUG_INFO, " Restore backup partition table by the primary\n"));
+      if (!PartitionRestoreGptTable (BlockIo, DiskIo, PrimaryHeader)) {
+        DEBUG ((DEBUG_INFO, " Restore backup partition table error\n"));
+      }
 
-  DEBUG ((DEBUG_INFO, " Valid primary and Valid backup partition table\n"));
+      if (PartitionValidGptTable (BlockIo, DiskIo, PrimaryHeader->AlternateLBA, BackupHeader)) {
+        DEBUG ((DEBUG_INFO, " Restore backup partition table success\n"));
+      }
 
-  //
-  // Read the EFI Partition Entries
-  //
-  PartEntry = AllocatePool (PrimaryHeader->NumberOfPartitionEntries * PrimaryHeader->SizeOfPartitionEntry);
-  if (PartEntry == NULL) {
-    DEBUG ((DEBUG_ERROR, "Allocate pool error\n"));
-    goto Done;
-  }
+      PartHeader = PrimaryHeader;
+    } else {
+      DEBUG ((DEBUG_INFO, " Valid primary and Valid backup partition table\n"));
 
-  Status = DiskIo->ReadDisk (
-                     DiskIo,
-                     MediaId,
-                     MultU64x32 (PrimaryHeader->PartitionEntryLBA, BlockSize),
-                     PrimaryHeader->NumberOfPartitionEntries * (PrimaryHeader->SizeOfPartitionEntry),
-                     PartEntry
-                     );
-  if (EFI_ERROR (Status)) {
-    GptValidStatus = Status;
-    DEBUG ((DEBUG_ERROR, " Partition Entry ReadDisk error\n"));
-    goto Done;
+      //
+      // Only a disk with both tables intact is cached, so that a damaged
+      // table is still found and restored on the next connect
+      //
+      PartitionGptCacheInsert (BlockIo, PrimaryHeader, PartEntry);
+      PartHeader = PrimaryHeader;
+    }
   }
 
   DEBUG ((DEBUG_INFO, " Partition entries read block success\n"));
 
-  DEBUG ((DEBUG_INFO, " Number of partition entries: %d\n", PrimaryHeader->NumberOfPartitionEntries));
+  DEBUG ((DEBUG_INFO, " Number of partition entries: %d\n", PartHeader->NumberOfPartitionEntries));
 
-  PEntryStatus = AllocateZeroPool (PrimaryHeader->NumberOfPartitionEntries * sizeof (EFI_PARTITION_ENTRY_STATUS));
+  PEntryStatus = AllocateZeroPool (PartHeader->NumberOfPartitionEntries * sizeof (EFI_PARTITION_ENTRY_STATUS));
   if (PEntryStatus == NULL) {
     DEBUG ((DEBUG_ERROR, "Allocate pool error\n"));
     goto Done;
@@ -351,7 +545,7 @@ PartitionInstallGptChildHandles (
   //
   // Check the integrity of partition entries
   //
-  PartitionCheckGptEntry (PrimaryHeader, PartEntry, PEntryStatus);
+  PartitionCheckGptEntry (PartHeader, PartEntry, PEntryStatus);
 
   //
   // If we got this far the GPT layout of the disk is valid and we should return true
@@ -361,8 +555,8 @@ PartitionInstallGptChildHandles (
   //
   // Create child device handles
   //
-  for (Index = 0; Index < PrimaryHeader->NumberOfPartitionEntries; Index++) {
-    Entry = (EFI_PARTITION_ENTRY *)((UINT8 *)PartEntry + Index * PrimaryHeader->SizeOfPartitionEntry);
+  for (Index = 0; Index < PartHeader->NumberOfPartitionEntries; Index++) {
+    Entry = (EFI_PARTITION_ENTRY *)((UINT8 *)PartEntry + Index * PartHeader->SizeOfPartitionEntry);
     if (CompareGuid (&Entry->PartitionTypeGUID, &gEfiPartTypeUnusedGuid) ||
         PEntryStatus[Index].OutOfRange ||
         PEntryStatus[Index].Overlap ||
@@ -419,13 +613,16 @@ PartitionInstallGptChildHandles (
                BlockSize,
                &Entry->PartitionTypeGUID
                );
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, " Partition %d not installed: %r\n", (UINT32)Index + 1, Status));
+    }
   }
 
   DEBUG ((DEBUG_INFO, "Prepare to Free Pool\n"));
 
 Done:
-  if (ProtectiveMbr != NULL) {
-    FreePool (ProtectiveMbr);
+  if (Blocks != NULL) {
+    FreePool (Blocks);
   }
 
   if (PrimaryHeader != NULL) {
@@ -440,6 +637,10 @@ Done:
     FreePool (PartEntry);
   }
 
+  if (BackupEntry != NULL) {
+    FreePool (BackupEntry);
+  }
+
   if (PEntryStatus != NULL) {
     FreePool (PEntryStatus);
   }
@@ -500,21 +701,7 @@ PartitionValidGptTable (
     return FALSE;
   }
 
-  if ((PartHdr->Header.Signature != EFI_PTAB_HEADER_ID) ||
-      !PartitionCheckCrc (BlockSize, &PartHdr->Header) ||
-      (PartHdr->MyLBA != Lba) ||
-      (PartHdr->SizeOfPartitionEntry < sizeof (EFI_PARTITION_ENTRY))
-      )
-  {
-    DEBUG ((DEBUG_INFO, "Invalid efi partition table header\n"));
-    FreePool (PartHdr);
-    return FALSE;
-  }
-
-  //
-  // Ensure the NumberOfPartitionEntries * SizeOfPartitionEntry doesn't overflow.
-  //
-  if (PartHdr->NumberOfPartitionEntries > DivU64x32 (MAX_UINTN, PartHdr->SizeOfPartitionEntry)) {
+  if (!PartitionValidGptHeader (BlockSize, Lba, PartHdr)) {
     FreePool (PartHdr);
     return FALSE;
   }
@@ -551,8 +738,7 @@ PartitionCheckGptEntryArrayCRC (
 {
   EFI_STATUS  Status;
   UINT8       *Ptr;
-  UINT32      Crc;
-  UINTN       Size;
+  BOOLEAN     Valid;
 
   //
   // Read the EFI Partition Entries
@@ -575,20 +761,327 @@ PartitionCheckGptEntryArrayCRC (
     return FALSE;
   }
 
+  Valid = PartitionCheckGptEntryArray (PartHeader, (EFI_PARTITION_ENTRY *)Ptr);
+  FreePool (Ptr);
+
+  return Valid;
+}
+
+/**
+  Check the CRC of a partition entry array against the CRC field of its
+  partition table header.
+
+  @param[in]  PartHeader  Partition table header structure
+  @param[in]  PartEntry   The partition entry array
+
+  @retval TRUE      the CRC is valid
+  @retval FALSE     the CRC is invalid
+
+**/
+BOOLEAN
+PartitionCheckGptEntryArray (
+  IN  EFI_PARTITION_TABLE_HEADER  *PartHeader,
+  IN  EFI_PARTITION_ENTRY         *PartEntry
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      Crc;
+  UINTN       Size;
+
   Size = PartHeader->NumberOfPartitionEntries * PartHeader->SizeOfPartitionEntry;
 
-  Status = gBS->CalculateCrc32 (Ptr, Size, &Crc);
+  Status = gBS->CalculateCrc32 (PartEntry, Size, &Crc);
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR, "CheckPEntryArrayCRC: Crc calculation failed\n"));
-    FreePool (Ptr);
     return FALSE;
   }
 
-  FreePool (Ptr);
-
   return (BOOLEAN)(PartHeader->PartitionEntryArrayCRC32 == Crc);
 }
 
+/**
+  Check a GPT partition table header read from the disk.
+
+  Caution: This function may receive untrusted input.
+  The GPT partition table header is external input, so this routine
+  will do basic validation for GPT partition table header before return.
+
+  @param[in]      BlockSize  The block size of the disk.
+  @param[in]      Lba        The Lba the header was read from.
+  @param[in, out] PartHdr    The block holding the header.
+
+  @retval TRUE      The partition table header is valid
+  @retval FALSE     The partition table header is not valid
+
+**/
+BOOLEAN
+PartitionValidGptHeader (
+  IN     UINT32                      BlockSize,
+  IN     EFI_LBA                     Lba,
+  IN OUT EFI_PARTITION_TABLE_HEADER  *PartHdr
+  )
+{
+  if ((PartHdr->Header.Signature != EFI_PTAB_HEADER_ID) ||
+      !PartitionCheckCrc (BlockSize, &PartHdr->Header) ||
+      (PartHdr->MyLBA != Lba) ||
+      (PartHdr->SizeOfPartitionEntry < sizeof (EFI_PARTITION_ENTRY))
+      )
+  {
+    DEBUG ((DEBUG_INFO, "Invalid efi partition table header\n"));
+    return FALSE;
+  }
+
+  //
+  // Ensure the NumberOfPartitionEntries * SizeOfPartitionEntry doesn't overflow.
+  //
+  if (PartHdr->NumberOfPartitionEntries > DivU64x32 (MAX_UINTN, PartHdr->SizeOfPartitionEntry)) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+  Read a batch of regions of the disk. With DiskIo2 and below TPL_CALLBACK
+  all the reads of the batch are in flight at once, otherwise they go one
+  after another through DiskIo. The reads through DiskIo2 that have not
+  completed after PARTITION_READ_TIMEOUT are canceled and read through DiskIo.
+
+  @param[in]      DiskIo    Disk Io protocol.
+  @param[in]      DiskIo2   Disk Io2 protocol, may be NULL.
+  @param[in]      MediaId   Id of the media the reads are for.
+  @param[in, out] Requests  The reads. The status of each is returned in it.
+  @param[in]      Count     The number of reads.
+
+**/
+VOID
+PartitionReadDisks (
+  IN     EFI_DISK_IO_PROTOCOL    *DiskIo,
+  IN     EFI_DISK_IO2_PROTOCOL   *DiskIo2,
+  IN     UINT32                  MediaId,
+  IN OUT PARTITION_READ_REQUEST  *Requests,
+  IN     UINTN                   Count
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       Index;
+  UINTN       Pending;
+  UINTN       Timeout;
+
+  //
+  // The driver binding runs at TPL_CALLBACK. A disk that completes its
+  // reads from an event at TPL_CALLBACK would never signal them while the
+  // batch is waited for there, so the reads are only issued together when
+  // the caller runs below it.
+  //
+  if (EfiGetCurrentTpl () >= TPL_CALLBACK) {
+    DiskIo2 = NULL;
+  }
+
+  Pending = 0;
+  for (Index = 0; Index < Count; Index++) {
+    Requests[Index].Token.Event = NULL;
+    if (Requests[Index].Size == 0) {
+      Requests[Index].Status = EFI_SUCCESS;
+      continue;
+    }
+
+    if (DiskIo2 != NULL) {
+      Status = gBS->CreateEvent (0, 0, NULL, NULL, &Requests[Index].Token.Event);
+      if (!EFI_ERROR (Status)) {
+        Requests[Index].Status = DiskIo2->ReadDiskEx (
+                                            DiskIo2,
+                                            MediaId,
+                                            Requests[Index].Offset,
+                                            &Requests[Index].Token,
+                                            Requests[Index].Size,
+                                            Requests[Index].Buffer
+                                            );
+        if (EFI_ERROR (Requests[Index].Status)) {
+          gBS->CloseEvent (Requests[Index].Token.Event);
+          Requests[Index].Token.Event = NULL;
+        } else {
+          Pending++;
+        }
+
+        continue;
+      }
+
+      Requests[Index].Token.Event = NULL;
+    }
+
+    Requests[Index].Status = DiskIo->ReadDisk (
+                                       DiskIo,
+                                       MediaId,
+                                       Requests[Index].Offset,
+                                       Requests[Index].Size,
+                                       Requests[Index].Buffer
+                                       );
+  }
+
+  for (Timeout = 0; Pending > 0; Timeout += PARTITION_READ_POLL_INTERVAL) {
+    for (Index = 0; Index < Count; Index++) {
+      if ((Requests[Index].Token.Event != NULL) &&
+          (gBS->CheckEvent (Requests[Index].Token.Event) == EFI_SUCCESS))
+      {
+        Requests[Index].Status = Requests[Index].Token.TransactionStatus;
+        gBS->CloseEvent (Requests[Index].Token.Event);
+        Requests[Index].Token.Event = NULL;
+        Pending--;
+      }
+    }
+
+    if ((Pending == 0) || (Timeout >= PARTITION_READ_TIMEOUT)) {
+      break;
+    }
+
+    gBS->Stall (PARTITION_READ_POLL_INTERVAL);
+  }
+
+  if (Pending == 0) {
+    return;
+  }
+
+  //
+  // The disk did not complete the batch in time. Cancel the reads still in
+  // flight, so DiskIo2 does not write their buffers any more, and read them
+  // through DiskIo.
+  //
+  DEBUG ((DEBUG_WARN, "%a: reads timed out, retrying through DiskIo\n", __func__));
+  DiskIo2->Cancel (DiskIo2);
+  for (Index = 0; Index < Count; Index++) {
+    if (Requests[Index].Token.Event == NULL) {
+      continue;
+    }
+
+    gBS->CloseEvent (Requests[Index].Token.Event);
+    Requests[Index].Token.Event = NULL;
+    Requests[Index].Status      = DiskIo->ReadDisk (
+                                            DiskIo,
+                                            MediaId,
+                                            Requests[Index].Offset,
+                                            Requests[Index].Size,
+                                            Requests[Index].Buffer
+                                            );
+  }
+}
+
+/**
+  Find the cached partition map of a disk.
+
+  @param[in]  BlockIo     Parent BlockIo interface.
+  @param[in]  PartHeader  The valid primary partition table header of the disk.
+
+  @return The cached partition map, or NULL if the disk has none or the
+          header differs from the one the map was built from.
+
+**/
+PARTITION_GPT_CACHE_ENTRY *
+PartitionGptCacheLookup (
+  IN  EFI_BLOCK_IO_PROTOCOL       *BlockIo,
+  IN  EFI_PARTITION_TABLE_HEADER  *PartHeader
+  )
+{
+  LIST_ENTRY                 *Link;
+  PARTITION_GPT_CACHE_ENTRY  *CacheEntry;
+
+  for (Link = GetFirstNode (&mPartitionGptCache);
+       !IsNull (&mPartitionGptCache, Link);
+       Link = GetNextNode (&mPartitionGptCache, Link))
+  {
+    CacheEntry = PARTITION_GPT_CACHE_FROM_LINK (Link);
+    if (!CompareGuid (&CacheEntry->Header.DiskGUID, &PartHeader->DiskGUID) ||
+        (CacheEntry->MediaId != BlockIo->Media->MediaId))
+    {
+      continue;
+    }
+
+    //
+    // The header covers the CRC of the partition entries, so the same header
+    // on the same media means the same partition entries
+    //
+    if ((CacheEntry->BlockSize != BlockIo->Media->BlockSize) ||
+        (CacheEntry->LastBlock != BlockIo->Media->LastBlock) ||
+        (CompareMem (&CacheEntry->Header, PartHeader, sizeof (EFI_PARTITION_TABLE_HEADER)) != 0))
+    {
+      return NULL;
+    }
+
+    RemoveEntryList (Link);
+    InsertHeadList (&mPartitionGptCache, Link);
+    return CacheEntry;
+  }
+
+  return NULL;
+}
+
+/**
+  Cache the validated partition map of a disk, replacing an older map of
+  the same disk.
+
+  @param[in]  BlockIo     Parent BlockIo interface.
+  @param[in]  PartHeader  The valid primary partition table header of the disk.
+  @param[in]  PartEntry   The partition entry array checked against it.
+
+**/
+VOID
+PartitionGptCacheInsert (
+  IN  EFI_BLOCK_IO_PROTOCOL       *BlockIo,
+  IN  EFI_PARTITION_TABLE_HEADER  *PartHeader,
+  IN  EFI_PARTITION_ENTRY         *PartEntry
+  )
+{
+  LIST_ENTRY                 *Link;
+  PARTITION_GPT_CACHE_ENTRY  *CacheEntry;
+
+  for (Link = GetFirstNode (&mPartitionGptCache);
+       !IsNull (&mPartitionGptCache, Link);
+       Link = GetNextNode (&mPartitionGptCache, Link))
+  {
+    CacheEntry = PARTITION_GPT_CACHE_FROM_LINK (Link);
+    if (CompareGuid (&CacheEntry->Header.DiskGUID, &PartHeader->DiskGUID) &&
+        (CacheEntry->MediaId == BlockIo->Media->MediaId))
+    {
+      RemoveEntryList (Link);
+      FreePool (CacheEntry->Entries);
+      FreePool (CacheEntry);
+      mPartitionGptCacheCount--;
+      break;
+    }
+  }
+
+  CacheEntry = AllocateZeroPool (sizeof (PARTITION_GPT_CACHE_ENTRY));
+  if (CacheEntry == NULL) {
+    return;
+  }
+
+  CacheEntry->EntriesSize = PartHeader->NumberOfPartitionEntries * PartHeader->SizeOfPartitionEntry;
+  CacheEntry->Entries     = AllocateCopyPool (CacheEntry->EntriesSize, PartEntry);
+  if (CacheEntry->Entries == NULL) {
+    FreePool (CacheEntry);
+    return;
+  }
+
+  CacheEntry->Signature = PARTITION_GPT_CACHE_SIGNATURE;
+  CacheEntry->MediaId   = BlockIo->Media->MediaId;
+  CacheEntry->BlockSize = BlockIo->Media->BlockSize;
+  CacheEntry->LastBlock = BlockIo->Media->LastBlock;
+  CopyMem (&CacheEntry->Header, PartHeader, sizeof (EFI_PARTITION_TABLE_HEADER));
+  InsertHeadList (&mPartitionGptCache, &CacheEntry->Link);
+  mPartitionGptCacheCount++;
+
+  //
+  // Drop the least recently used map once the cache is full
+  //
+  if (mPartitionGptCacheCount > PARTITION_GPT_CACHE_MAX_ENTRIES) {
+    CacheEntry = PARTITION_GPT_CACHE_FROM_LINK (GetPreviousNode (&mPartitionGptCache, &mPartitionGptCache));
+    RemoveEntryList (&CacheEntry->Link);
+    FreePool (CacheEntry->Entries);
+    FreePool (CacheEntry);
+    mPartitionGptCacheCount--;
+  }
+}
+
 /**
   Restore Partition Table to its alternate place
   (Primary -> Backup or Backup -> Primary).
@@ -103,6 +103,48 @@ typedef struct {
   BOOLEAN    OsSpecific;
 } EFI_PARTITION_ENTRY_STATUS;
 
+//
+// A read of the partition structures, issued together with the other reads
+// of its batch
+//
+typedef struct {
+  UINT64                Offset;
+  UINTN                 Size;
+  VOID                  *Buffer;
+  EFI_STATUS            Status;
+  EFI_DISK_IO2_TOKEN    Token;
+} PARTITION_READ_REQUEST;
+
+//
+// How long a batch of reads through DiskIo2 may take, and how often its
+// events are polled meanwhile, in microseconds
+//
+#define PARTITION_READ_TIMEOUT        (5 * 1000 * 1000)
+#define PARTITION_READ_POLL_INTERVAL  10
+
+//
+// The validated GPT partition map of a disk, kept while the driver is loaded
+// so that a reconnect of the disk does not read and check the partition
+// entries again. It is keyed by the disk GUID and the media ID, and only
+// used while the primary header on the disk matches the one it was built
+// from.
+//
+#define PARTITION_GPT_CACHE_SIGNATURE    SIGNATURE_32 ('P', 'G', 'p', 't')
+#define PARTITION_GPT_CACHE_MAX_ENTRIES  16
+
+typedef struct {
+  UINT32                        Signature;
+  LIST_ENTRY                    Link;
+  UINT32                        MediaId;
+  UINT32                        BlockSize;
+  EFI_LBA                       LastBlock;
+  EFI_PARTITION_TABLE_HEADER    Header;
+  UINTN                         EntriesSize;
+  EFI_PARTITION_ENTRY           *Entries;
+} PARTITION_GPT_CACHE_ENTRY;
+
+#define PARTITION_GPT_CACHE_FROM_LINK(a)  CR (a, PARTITION_GPT_CACHE_ENTRY, Link, PARTITION_GPT_CACHE_SIGNATURE)
+
 //
 // Function Prototypes
 //
@@ -3,12 +3,69 @@
   (Fault Tolerant Write) protocol.
 
 Copyright (c) 2006 - 2015, Intel Corporation. All rights reserved.<BR>
+Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
 SPDX-License-Identifier: BSD-2-Clause-Patent
 
 **/
 
 #include "Variable.h"
 
+VARIABLE_RECLAIM_STATISTICS  mVariableReclaimStatistics;
+
+/**
+  Gets the time elapsed since a value of the performance counter.
+
+  @param  Begin          The value of the performance counter at the start.
+
+  @return The elapsed time in nanoseconds.
+
+**/
+STATIC
+UINT64
+GetElapsedTime (
+  IN UINT64  Begin
+  )
+{
+  UINT64  End;
+  UINT64  StartValue;
+  UINT64  EndValue;
+
+  End = GetPerformanceCounter ();
+  GetPerformanceCounterProperties (&StartValue, &EndValue);
+  if (StartValue > EndValue) {
+    //
+    // The counter counts down.
+    //
+    return (Begin >= End) ? GetTimeInNanoSecond (Begin - End) : 0;
+  }
+
+  return (End >= Begin) ? GetTimeInNanoSecond (End - Begin) : 0;
+}
+
+/**
+  Counts a write of the variable store in the latency histogram.
+
+  @param  NanoSeconds    The time the write took.
+
+**/
+STATIC
+VOID
+RecordReclaimLatency (
+  IN UINT64  NanoSeconds
+  )
+{
+  UINT64  MicroSeconds;
+  UINTN   Bucket;
+
+  MicroSeconds = DivU64x32 (NanoSeconds, 1000);
+  Bucket       = (MicroSeconds == 0) ? 0 : (UINTN)HighBitSet64 (MicroSeconds) + 1;
+  if (Bucket >= VARIABLE_RECLAIM_LATENCY_BUCKETS) {
+    Bucket = VARIABLE_RECLAIM_LATENCY_BUCKETS - 1;
+  }
+
+  mVariableReclaimStatistics.LatencyHistogram[Bucket]++;
+}
+
 /**
   Gets LBA of block and offset by given address.
 
@@ -92,6 +149,13 @@ GetLbaAndOffsetByAddress (
   volume block device. The destination is specified by parameter
   VariableBase. Fault Tolerant Write protocol is used for writing.
 
+  A reclaim leaves the variables ahead of the first deleted one in place,
+  and the free space past the last variable erased, so only the span from
+  the first to the last byte that differs from the store is written. The
+  blocks outside of it are neither erased nor rewritten, which shortens
+  the write and the wear of the flash. The span is written with a single
+  FTW record, so the update of the store remains atomic.
+
   @param  VariableBase   Base address of variable to write
   @param  VariableBuffer Point to the variable data buffer.
 
@@ -106,12 +170,21 @@ FtwVariableSpace (
   IN VARIABLE_STORE_HEADER  *VariableBuffer
   )
 {
-  EFI_STATUS                         Status;
-  EFI_HANDLE                         FvbHandle;
-  EFI_LBA                            VarLba;
-  UINTN                              VarOffset;
-  UINTN                              FtwBufferSize;
-  EFI_FAULT_TOLERANT_WRITE_PROTOCOL  *FtwProtocol;
+  EFI_STATUS                          Status;
+  EFI_HANDLE                          FvbHandle;
+  EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL  *Fvb;
+  EFI_LBA                             VarLba;
+  UINTN                               VarOffset;
+  UINTN                               FtwBufferSize;
+  EFI_FAULT_TOLERANT_WRITE_PROTOCOL   *FtwProtocol;
+  UINTN                               BlockSize;
+  UINTN                               NumberOfBlocks;
+  UINT8                               *Store;
+  UINT8                               *Buffer;
+  UINTN                               Start;
+  UINTN                               End;
+  UINTN                               Block;
+  UINT64                              Begin;
 
   //
   // Locate fault tolerant write protocol.
@@ -124,7 +197,7 @@ FtwVariableSpace (
   //
   // Locate Fvb handle by address.
   //
-  Status = GetFvbInfoByAddress (VariableBase, &FvbHandle, NULL);
+  Status = GetFvbInfoByAddress (VariableBase, &FvbHandle, &Fvb);
   if (EFI_ERROR (Status)) {
     return Status;
   }
@@ -137,21 +210,72 @@ FtwVariableSpace (
     return EFI_ABORTED;
   }
 
+  Status = Fvb->GetBlockSize (Fvb, VarLba, &BlockSize, &NumberOfBlocks);
+  if (EFI_ERROR (Status)) {
+    return EFI_ABORTED;
+  }
+
   FtwBufferSize = ((VARIABLE_STORE_HEADER *)((UINTN)VariableBase))->Size;
   ASSERT (FtwBufferSize == VariableBuffer->Size);
 
+  //
+  // Find the span of the store that changes.
+  //
+  Store  = (UINT8 *)(UINTN)VariableBase;
+  Buffer = (UINT8 *)VariableBuffer;
+  for (Start = 0; Start < FtwBufferSize; Start = End) {
+    End = MIN (FtwBufferSize, Start + BlockSize - (VarOffset + Start) % BlockSize);
+    if (CompareMem (Store + Start, Buffer + Start, End - Start) != 0) {
+      break;
+    }
+  }
+
+  if (Start == FtwBufferSize) {
+    mVariableReclaimStatistics.SkippedWrites++;
+    return EFI_SUCCESS;
+  }
+
+  while (Store[Start] == Buffer[Start]) {
+    Start++;
+  }
+
+  End = FtwBufferSize;
+  while (Store[End - 1] == Buffer[End - 1]) {
+    End--;
+  }
+
+  Begin = 0;
+  if (!AtRuntime ()) {
+    Begin = GetPerformanceCounter ();
+  }
+
   //
   // FTW write record.
   //
   Status = FtwProtocol->Write (
                           FtwProtocol,
-                          VarLba,                // LBA
-                          VarOffset,             // Offset
-                          FtwBufferSize,         // NumBytes
-                          NULL,                  // PrivateData NULL
-                          FvbHandle,             // Fvb Handle
-                          (VOID *)VariableBuffer // write buffer
+                          VarLba + (VarOffset + Start) / BlockSize, // LBA
+                          (VarOffset + Start) % BlockSize,          // Offset
+                          End - Start,                              // NumBytes
+                          NULL,                                     // PrivateData NULL
+                          FvbHandle,                                // Fvb Handle
+                          Buffer + Start                            // write buffer
                           );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (!AtRuntime ()) {
+    RecordReclaimLatency (GetElapsedTime (Begin));
+  }
+
+  mVariableReclaimStatistics.Writes++;
+  mVariableReclaimStatistics.BytesWritten += End - Start;
+  for (Block = (VarOffset + Start) / BlockSize; Block <= (VarOffset + End - 1) / BlockSize; Block++) {
+    if (Block < VARIABLE_RECLAIM_MAX_BLOCKS) {
+      mVariableReclaimStatistics.BlockGeneration[Block]++;
+    }
+  }
 
   return Status;
 }
@@ -0,0 +1,213 @@
+/** @file
+  A variable store in memory for the host test of the variable store index,
+  and a fake of AtRuntime (), the one service of the variable driver that the
+  index and the parsing code call.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "../VariableParsing.h"
+#include "../VariableIndex.h"
+
+//
+// The store is indexed as the volatile one
+//
+#define FAKE_STORE_TYPE  VariableStoreTypeVolatile
+
+BOOLEAN  mVariableFakeAtRuntime;
+
+STATIC VARIABLE_STORE_HEADER  *mFakeStore;
+STATIC UINTN                  mFakeLastOffset;
+STATIC BOOLEAN                mFakeAuthFormat;
+
+BOOLEAN
+AtRuntime (
+  VOID
+  )
+{
+  return mVariableFakeAtRuntime;
+}
+
+VOID
+VariableFakeCreateStore (
+  IN UINTN    Size,
+  IN BOOLEAN  AuthFormat
+  )
+{
+  if (mFakeStore != NULL) {
+    FreePool (mFakeStore);
+  }
+
+  if (mVariableIndex[FAKE_STORE_TYPE].Buckets != NULL) {
+    FreePool (mVariableIndex[FAKE_STORE_TYPE].Buckets);
+  }
+
+  ZeroMem (&mVariableIndex[FAKE_STORE_TYPE], sizeof (VARIABLE_INDEX));
+
+  mFakeStore = AllocatePool (Size);
+  ASSERT (mFakeStore != NULL);
+  SetMem (mFakeStore, Size, 0xFF);
+  CopyGuid (&mFakeStore->Signature, AuthFormat ? &gEfiAuthenticatedVariableGuid : &gEfiVariableGuid);
+  mFakeStore->Size   = (UINT32)Size;
+  mFakeStore->Format = VARIABLE_STORE_FORMATTED;
+  mFakeStore->State  = VARIABLE_STORE_HEALTHY;
+  mFakeLastOffset    = (UINTN)GetStartPointer (mFakeStore) - (UINTN)mFakeStore;
+  mFakeAuthFormat    = AuthFormat;
+}
+
+UINTN
+VariableFakeAppend (
+  IN CONST CHAR16    *Name,
+  IN CONST EFI_GUID  *Guid,
+  IN UINT32          Attributes,
+  IN UINTN           DataSize,
+  IN UINT8           State
+  )
+{
+  VARIABLE_HEADER  *Variable;
+  UINTN            NameSize;
+  UINTN            VarSize;
+  UINTN            Offset;
+
+  NameSize = StrSize (Name);
+  VarSize  = GetVariableHeaderSize (mFakeAuthFormat) + NameSize + GET_PAD_SIZE (NameSize) + DataSize + GET_PAD_SIZE (DataSize);
+  if (mFakeLastOffset + HEADER_ALIGN (VarSize) > mFakeStore->Size) {
+    return 0;
+  }
+
+  Offset   = mFakeLastOffset;
+  Variable = (VARIABLE_HEADER *)((UINTN)mFakeStore + Offset);
+  ZeroMem (Variable, GetVariableHeaderSize (mFakeAuthFormat));
+  Variable->StartId    = VARIABLE_DATA;
+  Variable->State      = State;
+  Variable->Attributes = Attributes;
+  SetNameSizeOfVariable (Variable, NameSize, mFakeAuthFormat);
+  SetDataSizeOfVariable (Variable, DataSize, mFakeAuthFormat);
+  CopyGuid (GetVendorGuidPtr (Variable, mFakeAuthFormat), Guid);
+  CopyMem (GetVariableNamePtr (Variable, mFakeAuthFormat), Name, NameSize);
+  SetMem (GetVariableDataPtr (Variable, mFakeAuthFormat), DataSize, (UINT8)Offset);
+
+  mFakeLastOffset += HEADER_ALIGN (VarSize);
+  return Offset;
+}
+
+VOID
+VariableFakeSetState (
+  IN UINTN  Offset,
+  IN UINT8  State
+  )
+{
+  ((VARIABLE_HEADER *)((UINTN)mFakeStore + Offset))->State &= State;
+}
+
+VOID
+VariableFakeReclaim (
+  VOID
+  )
+{
+  VARIABLE_HEADER  *Variable;
+  VARIABLE_HEADER  *Next;
+  UINT8            *Buffer;
+  UINT8            *CurrPtr;
+
+  Buffer = AllocatePool (mFakeStore->Size);
+  ASSERT (Buffer != NULL);
+  SetMem (Buffer, mFakeStore->Size, 0xFF);
+  CopyMem (Buffer, mFakeStore, sizeof (VARIABLE_STORE_HEADER));
+  CurrPtr = (UINT8 *)GetStartPointer ((VARIABLE_STORE_HEADER *)Buffer);
+
+  for (Variable = GetStartPointer (mFakeStore);
+       IsValidVariableHeader (Variable, GetEndPointer (mFakeStore));
+       Variable = Next)
+  {
+    Next = GetNextVariablePtr (Variable, mFakeAuthFormat);
+    if ((Variable->State == VAR_ADDED) || (Variable->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED))) {
+      CopyMem (CurrPtr, Variable, (UINTN)Next - (UINTN)Variable);
+      CurrPtr += (UINTN)Next - (UINTN)Variable;
+    }
+  }
+
+  CopyMem (mFakeStore, Buffer, mFakeStore->Size);
+  FreePool (Buffer);
+  mFakeLastOffset = (UINTN)CurrPtr - (UINTN)Buffer;
+  VariableIndexReset (FAKE_STORE_TYPE);
+}
+
+VOID
+VariableFakeRelocate (
+  VOID
+  )
+{
+  VARIABLE_INDEX  *Index;
+  VOID            *Store;
+  UINT8           *Buffer;
+  UINTN           BucketSize;
+  UINTN           Size;
+
+  Store = AllocateCopyPool (mFakeStore->Size, mFakeStore);
+  ASSERT (Store != NULL);
+  Index = &mVariableIndex[FAKE_STORE_TYPE];
+  if (Index->Store != NULL) {
+    BucketSize = (Index->BucketMask + 1) * sizeof (UINT32);
+    Size       = BucketSize + Index->EntryCapacity * sizeof (VARIABLE_INDEX_ENTRY);
+    Buffer     = AllocateCopyPool (Size, Index->Buckets);
+    ASSERT (Buffer != NULL);
+    SetMem (Index->Buckets, Size, 0xA5);
+    FreePool (Index->Buckets);
+    Index->Store   = Store;
+    Index->Buckets = (UINT32 *)Buffer;
+    Index->Entries = (VARIABLE_INDEX_ENTRY *)(Buffer + BucketSize);
+  }
+
+  SetMem (mFakeStore, mFakeStore->Size, 0xA5);
+  FreePool (mFakeStore);
+  mFakeStore = Store;
+}
+
+EFI_STATUS
+VariableFakeFind (
+  IN  CONST CHAR16    *Name,
+  IN  CONST EFI_GUID  *Guid,
+  IN  BOOLEAN         IgnoreRtCheck,
+  IN  BOOLEAN         Indexed,
+  OUT UINTN           *Offset,
+  OUT UINTN           *InDeletedOffset
+  )
+{
+  VARIABLE_POINTER_TRACK  PtrTrack;
+  EFI_STATUS              Status;
+
+  PtrTrack.StartPtr = GetStartPointer (mFakeStore);
+  PtrTrack.EndPtr   = GetEndPointer (mFakeStore);
+  PtrTrack.Volatile = TRUE;
+
+  Status = EFI_UNSUPPORTED;
+  if (Indexed) {
+    Status = FindVariableInIndex (
+               FAKE_STORE_TYPE,
+               mFakeStore,
+               (CHAR16 *)Name,
+               (EFI_GUID *)Guid,
+               IgnoreRtCheck,
+               &PtrTrack,
+               mFakeAuthFormat
+               );
+  }
+
+  if (Status == EFI_UNSUPPORTED) {
+    Status = FindVariableEx ((CHAR16 *)Name, (EFI_GUID *)Guid, IgnoreRtCheck, &PtrTrack, mFakeAuthFormat);
+  }
+
+  *Offset          = (PtrTrack.CurrPtr == NULL) ? 0 : (UINTN)PtrTrack.CurrPtr - (UINTN)mFakeStore;
+  *InDeletedOffset = (PtrTrack.InDeletedTransitionPtr == NULL) ? 0 : (UINTN)PtrTrack.InDeletedTransitionPtr - (UINTN)mFakeStore;
+  return Status;
+}
+
+BOOLEAN
+VariableFakeIndexOverflow (
+  VOID
+  )
+{
+  return mVariableIndex[FAKE_STORE_TYPE].Overflow;
+}
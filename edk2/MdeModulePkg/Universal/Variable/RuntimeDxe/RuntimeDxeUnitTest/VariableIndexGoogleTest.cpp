@@ -0,0 +1,478 @@
+/** @file
+  Host based tests of the variable store index.
+
+  Random sequences of appends, state changes, reclaims and relocations are
+  applied to a store, and every lookup through the index is checked against
+  the linear search of FindVariableEx (). A benchmark reports the latency of
+  both searches.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+extern "C" {
+  #include <Uefi.h>
+  #include <Library/BaseLib.h>
+  #include <Guid/VariableFormat.h>
+  //
+  // Returned by AtRuntime ()
+  //
+  extern BOOLEAN  mVariableFakeAtRuntime;
+
+  //
+  // The store of VariableIndexFakes.c, indexed as the volatile one
+  //
+  VOID
+  VariableFakeCreateStore (
+    IN UINTN    Size,
+    IN BOOLEAN  AuthFormat
+    );
+
+  //
+  // Returns the offset of the header of the variable, or 0 if the store is full
+  //
+  UINTN
+  VariableFakeAppend (
+    IN CONST CHAR16    *Name,
+    IN CONST EFI_GUID  *Guid,
+    IN UINT32          Attributes,
+    IN UINTN           DataSize,
+    IN UINT8           State
+    );
+
+  //
+  // Like a write to flash, this can only clear bits of the state
+  //
+  VOID
+  VariableFakeSetState (
+    IN UINTN  Offset,
+    IN UINT8  State
+    );
+
+  VOID
+  VariableFakeReclaim (
+    VOID
+    );
+
+  //
+  // Moves the store and its index, as SetVirtualAddressMap () does
+  //
+  VOID
+  VariableFakeRelocate (
+    VOID
+    );
+
+  EFI_STATUS
+  VariableFakeFind (
+    IN  CONST CHAR16    *Name,
+    IN  CONST EFI_GUID  *Guid,
+    IN  BOOLEAN         IgnoreRtCheck,
+    IN  BOOLEAN         Indexed,
+    OUT UINTN           *Offset,
+    OUT UINTN           *InDeletedOffset
+    );
+
+  BOOLEAN
+  VariableFakeIndexOverflow (
+    VOID
+    );
+}
+
+#define NAME_COUNT  256
+#define GUID_COUNT  3
+
+static const EFI_GUID  mGuids[GUID_COUNT] = {
+  { 0x8BE4DF61, 0x93CA, 0x11D2, { 0xAA, 0x0D, 0x00, 0xE0, 0x98, 0x03, 0x2B, 0x8C }
+  },
+  { 0xD719B2CB, 0x3D3A, 0x4596, { 0xA3, 0xBC, 0xDA, 0xD0, 0x0E, 0x67, 0x65, 0x6F }
+  },
+  { 0x8BE4DF61, 0x93CA, 0x11D2, { 0xAA, 0x0D, 0x00, 0xE0, 0x98, 0x03, 0x2B, 0x8D }
+  }
+};
+
+/**
+  Format a variable name.
+**/
+static
+void
+MakeName (
+  CHAR16      *Name,
+  const char  *Format,
+  UINT32      Value
+  )
+{
+  char   Buffer[16];
+  UINTN  Index;
+
+  snprintf (Buffer, sizeof (Buffer), Format, Value);
+  for (Index = 0; Buffer[Index] != '\0'; Index++) {
+    Name[Index] = (CHAR16)Buffer[Index];
+  }
+
+  Name[Index] = 0;
+}
+
+class VariableIndexTest : public ::testing::TestWithParam<BOOLEAN> {
+protected:
+  CHAR16  Names[NAME_COUNT][16];
+  UINT32  Seed;
+
+  void
+  SetUp (
+    ) override
+  {
+    for (UINTN Index = 0; Index < NAME_COUNT; Index++) {
+      MakeName (Names[Index], "Boot%04X", (UINT32)Index);
+    }
+
+    //
+    // A name that is a prefix of another one
+    //
+    MakeName (Names[NAME_COUNT - 1], "Boot", 0);
+    Seed                   = 0x1234567;
+    mVariableFakeAtRuntime = FALSE;
+  }
+
+  UINT32
+  Random (
+    UINT32  Limit
+    )
+  {
+    Seed = Seed * 1103515245 + 12345;
+    return (Seed >> 8) % Limit;
+  }
+
+  void
+  CheckLookup (
+    const CHAR16    *Name,
+    const EFI_GUID  *Guid,
+    BOOLEAN         IgnoreRtCheck
+    )
+  {
+    EFI_STATUS  Status[2];
+    UINTN       Offset[2];
+    UINTN       InDeletedOffset[2];
+
+    Status[0] = VariableFakeFind (Name, Guid, IgnoreRtCheck, FALSE, &Offset[0], &InDeletedOffset[0]);
+    Status[1] = VariableFakeFind (Name, Guid, IgnoreRtCheck, TRUE, &Offset[1], &InDeletedOffset[1]);
+    ASSERT_EQ (Status[0], Status[1]);
+    ASSERT_EQ (Offset[0], Offset[1]);
+    ASSERT_EQ (InDeletedOffset[0], InDeletedOffset[1]);
+  }
+
+  void
+  CheckAll (
+    )
+  {
+    for (UINTN Index = 0; Index < NAME_COUNT; Index++) {
+      for (UINTN GuidIndex = 0; GuidIndex < GUID_COUNT; GuidIndex++) {
+        CheckLookup (Names[Index], &mGuids[GuidIndex], FALSE);
+        CheckLookup (Names[Index], &mGuids[GuidIndex], TRUE);
+        if (HasFatalFailure ()) {
+          return;
+        }
+      }
+    }
+
+    static const CHAR16  Empty[1] = { 0 };
+
+    CheckLookup (Empty, &mGuids[0], FALSE);
+  }
+};
+
+TEST_P (VariableIndexTest, RandomOperations) {
+  std::vector<UINTN>  Offsets;
+
+  VariableFakeCreateStore (0x10000, GetParam ());
+  for (UINTN Step = 0; Step < 4000; Step++) {
+    UINT32  Operation = Random (100);
+
+    if (Operation < 60) {
+      //
+      // Update a variable the way UpdateVariable () does. Few names are
+      // updated, so that they pile up copies in every state.
+      //
+      const CHAR16    *Name = Names[Random (NAME_COUNT / 16)];
+      const EFI_GUID  *Guid = &mGuids[Random (GUID_COUNT)];
+      UINTN           Old;
+      UINTN           InDeleted;
+      UINTN           New;
+
+      VariableFakeFind (Name, Guid, TRUE, FALSE, &Old, &InDeleted);
+      if (Old != 0) {
+        VariableFakeSetState (Old, VAR_IN_DELETED_TRANSITION & VAR_ADDED);
+      }
+
+      New = VariableFakeAppend (
+              Name,
+              Guid,
+              EFI_VARIABLE_BOOTSERVICE_ACCESS | ((Random (4) != 0) ? EFI_VARIABLE_RUNTIME_ACCESS : 0),
+              Random (64),
+              VAR_ADDED
+              );
+      if (New == 0) {
+        VariableFakeReclaim ();
+        Offsets.clear ();
+        continue;
+      }
+
+      Offsets.push_back (New);
+      if ((Old != 0) && (Random (8) != 0)) {
+        VariableFakeSetState (Old, VAR_IN_DELETED_TRANSITION & VAR_ADDED & VAR_DELETED);
+      }
+    } else if (Operation < 85) {
+      if (!Offsets.empty ()) {
+        static const UINT8  States[] = {
+          VAR_IN_DELETED_TRANSITION & VAR_ADDED,
+          VAR_IN_DELETED_TRANSITION & VAR_ADDED & VAR_DELETED
+        };
+
+        VariableFakeSetState (Offsets[Random ((UINT32)Offsets.size ())], States[Random (2)]);
+      }
+    } else if (Operation < 90) {
+      VariableFakeReclaim ();
+      Offsets.clear ();
+    } else if (Operation < 95) {
+      mVariableFakeAtRuntime = !mVariableFakeAtRuntime;
+    } else {
+      VariableFakeRelocate ();
+      Offsets.clear ();
+    }
+
+    for (UINTN Lookup = 0; Lookup < 8; Lookup++) {
+      CheckLookup (Names[Random (NAME_COUNT)], &mGuids[Random (GUID_COUNT)], (BOOLEAN)Random (2));
+      ASSERT_FALSE (HasFatalFailure ()) << "Step " << Step;
+    }
+  }
+
+  mVariableFakeAtRuntime = FALSE;
+  CheckAll ();
+  ASSERT_FALSE (VariableFakeIndexOverflow ());
+}
+
+TEST_P (VariableIndexTest, CopyStates) {
+  static const UINT8  States[] = {
+    VAR_ADDED,
+    VAR_IN_DELETED_TRANSITION & VAR_ADDED,
+    VAR_IN_DELETED_TRANSITION & VAR_ADDED & VAR_DELETED
+  };
+  UINTN               Copies[5];
+
+  //
+  // Every combination of states of five copies of a variable, with other
+  // variables in between
+  //
+  for (UINTN Combination = 0; Combination < 3 * 3 * 3 * 3 * 3; Combination++) {
+    UINTN  Digits = Combination;
+
+    VariableFakeCreateStore (0x2000, GetParam ());
+    for (UINTN Copy = 0; Copy < 5; Copy++) {
+      Copies[Copy] = VariableFakeAppend (Names[0], &mGuids[0], EFI_VARIABLE_BOOTSERVICE_ACCESS, Copy, VAR_ADDED);
+      VariableFakeAppend (Names[Copy + 1], &mGuids[0], EFI_VARIABLE_BOOTSERVICE_ACCESS, Copy, VAR_ADDED);
+    }
+
+    CheckLookup (Names[0], &mGuids[0], FALSE);
+    for (UINTN Copy = 0; Copy < 5; Copy++) {
+      VariableFakeSetState (Copies[Copy], States[Digits % 3]);
+      Digits /= 3;
+    }
+
+    CheckLookup (Names[0], &mGuids[0], FALSE);
+    ASSERT_FALSE (HasFatalFailure ()) << "Combination " << Combination;
+  }
+}
+
+TEST_P (VariableIndexTest, HeaderValidOnly) {
+  UINTN  Pending;
+
+  //
+  // A variable still being written when the store is indexed, which turns
+  // VAR_ADDED once its data is in
+  //
+  VariableFakeCreateStore (0x2000, GetParam ());
+  VariableFakeAppend (Names[0], &mGuids[0], EFI_VARIABLE_BOOTSERVICE_ACCESS, 8, VAR_ADDED);
+  Pending = VariableFakeAppend (Names[1], &mGuids[0], EFI_VARIABLE_BOOTSERVICE_ACCESS, 8, VAR_HEADER_VALID_ONLY);
+  CheckLookup (Names[1], &mGuids[0], FALSE);
+  VariableFakeSetState (Pending, VAR_ADDED);
+  CheckLookup (Names[1], &mGuids[0], FALSE);
+
+  //
+  // One left by an interrupted update, with variables after it
+  //
+  VariableFakeAppend (Names[2], &mGuids[0], EFI_VARIABLE_BOOTSERVICE_ACCESS, 8, VAR_HEADER_VALID_ONLY);
+  VariableFakeAppend (Names[3], &mGuids[0], EFI_VARIABLE_BOOTSERVICE_ACCESS, 8, VAR_ADDED);
+  CheckAll ();
+}
+
+TEST_P (VariableIndexTest, Overflow) {
+  CHAR16  Name[8];
+  UINTN   Count;
+
+  //
+  // Variables with short names and no data are smaller than the store
+  // space each index entry stands for, unless they have authenticated
+  // headers.
+  //
+  VariableFakeCreateStore (0x1000, GetParam ());
+  for (Count = 0; ; Count++) {
+    MakeName (Name, "%x", (UINT32)Count);
+    if (VariableFakeAppend (Name, &mGuids[0], EFI_VARIABLE_BOOTSERVICE_ACCESS, 0, VAR_ADDED) == 0) {
+      break;
+    }
+
+    CheckLookup (Name, &mGuids[0], FALSE);
+    ASSERT_FALSE (HasFatalFailure ());
+  }
+
+  ASSERT_EQ (VariableFakeIndexOverflow (), !GetParam ());
+  MakeName (Name, "%x", 0);
+  CheckLookup (Name, &mGuids[0], FALSE);
+
+  //
+  // Reclaim the space of most variables, and the index works again
+  //
+  for (UINTN Index = 0; Index < Count; Index += 4) {
+    UINTN  Offset;
+    UINTN  InDeleted;
+
+    MakeName (Name, "%x", (UINT32)Index);
+    VariableFakeFind (Name, &mGuids[0], FALSE, FALSE, &Offset, &InDeleted);
+    ASSERT_NE (Offset, 0U);
+    VariableFakeSetState (Offset, VAR_IN_DELETED_TRANSITION & VAR_ADDED & VAR_DELETED);
+  }
+
+  for (UINTN Index = 1; Index < Count; Index++) {
+    UINTN  Offset;
+    UINTN  InDeleted;
+
+    if (Index % 4 == 0) {
+      continue;
+    }
+
+    MakeName (Name, "%x", (UINT32)Index);
+    VariableFakeFind (Name, &mGuids[0], FALSE, FALSE, &Offset, &InDeleted);
+    VariableFakeSetState (Offset, VAR_IN_DELETED_TRANSITION & VAR_ADDED & VAR_DELETED);
+  }
+
+  VariableFakeReclaim ();
+  for (UINTN Index = 0; Index < Count; Index++) {
+    MakeName (Name, "%x", (UINT32)Index);
+    CheckLookup (Name, &mGuids[0], FALSE);
+    ASSERT_FALSE (HasFatalFailure ());
+  }
+
+  ASSERT_FALSE (VariableFakeIndexOverflow ());
+}
+
+TEST_P (VariableIndexTest, CompactWhenFull) {
+  UINTN  Last[4] = { 0 };
+
+  //
+  // Keep updating a few small variables. The index fills up with the
+  // entries of deleted headers, and drops them to make room.
+  //
+  VariableFakeCreateStore (0x4000, GetParam ());
+  for (UINTN Step = 0; ; Step++) {
+    UINTN  Offset;
+
+    Offset = VariableFakeAppend (Names[Step % 4], &mGuids[0], EFI_VARIABLE_BOOTSERVICE_ACCESS, 0, VAR_ADDED);
+    if (Offset == 0) {
+      break;
+    }
+
+    if (Last[Step % 4] != 0) {
+      VariableFakeSetState (Last[Step % 4], VAR_IN_DELETED_TRANSITION & VAR_ADDED & VAR_DELETED);
+    }
+
+    Last[Step % 4] = Offset;
+    CheckLookup (Names[Step % 4], &mGuids[0], FALSE);
+    ASSERT_FALSE (HasFatalFailure ());
+  }
+
+  CheckAll ();
+  ASSERT_FALSE (VariableFakeIndexOverflow ());
+}
+
+TEST_P (VariableIndexTest, FirstLookupAtRuntime) {
+  VariableFakeCreateStore (0x4000, GetParam ());
+  for (UINTN Index = 0; Index < 64; Index++) {
+    VariableFakeAppend (Names[Index], &mGuids[0], EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS, 8, VAR_ADDED);
+  }
+
+  //
+  // No index can be allocated at runtime, so the search stays linear
+  //
+  mVariableFakeAtRuntime = TRUE;
+  CheckAll ();
+}
+
+TEST_P (VariableIndexTest, LookupLatency) {
+  static const UINTN  Counts[] = { 64, 256, 1024 };
+
+  for (UINTN Count : Counts) {
+    std::vector<CHAR16>  Lookups[2];
+    UINTN                Rounds = 1000000 / Count;
+    double               Seconds[2][2];
+
+    VariableFakeCreateStore (0x40000, GetParam ());
+    for (UINTN Miss = 0; Miss < 2; Miss++) {
+      Lookups[Miss].resize (Count * 16);
+      for (UINTN Index = 0; Index < Count; Index++) {
+        MakeName (&Lookups[Miss][Index * 16], Miss ? "Missing%04X" : "Variable%04X", (UINT32)Index);
+      }
+    }
+
+    for (UINTN Index = 0; Index < Count; Index++) {
+      ASSERT_NE (VariableFakeAppend (&Lookups[0][Index * 16], &mGuids[Index % GUID_COUNT], EFI_VARIABLE_BOOTSERVICE_ACCESS, 64, VAR_ADDED), 0U);
+    }
+
+    for (UINTN Indexed = 0; Indexed < 2; Indexed++) {
+      for (UINTN Miss = 0; Miss < 2; Miss++) {
+        UINTN  Found = 0;
+        auto   Start = std::chrono::steady_clock::now ();
+
+        for (UINTN Round = 0; Round < Rounds; Round++) {
+          UINTN  Offset;
+          UINTN  InDeleted;
+          UINTN  Index = (Round * 7919) % Count;
+
+          if (!EFI_ERROR (VariableFakeFind (&Lookups[Miss][Index * 16], &mGuids[Index % GUID_COUNT], FALSE, (BOOLEAN)Indexed, &Offset, &InDeleted))) {
+            Found++;
+          }
+        }
+
+        Seconds[Indexed][Miss] = std::chrono::duration<double>(std::chrono::steady_clock::now () - Start).count ();
+        ASSERT_EQ (Found, Miss ? 0 : Rounds);
+      }
+    }
+
+    printf (
+      "  %4u variables: hit %8.0f ns linear, %5.0f ns indexed; miss %8.0f ns linear, %5.0f ns indexed\n",
+      (unsigned)Count,
+      Seconds[0][0] * 1e9 / Rounds,
+      Seconds[1][0] * 1e9 / Rounds,
+      Seconds[0][1] * 1e9 / Rounds,
+      Seconds[1][1] * 1e9 / Rounds
+      );
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P (
+  HeaderFormats,
+  VariableIndexTest,
+  ::testing::Values ((BOOLEAN)FALSE, (BOOLEAN)TRUE)
+  );
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
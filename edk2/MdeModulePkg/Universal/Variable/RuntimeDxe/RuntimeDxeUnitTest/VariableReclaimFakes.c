@@ -0,0 +1,255 @@
+/** @file
+  A flash device in memory, with its FVB and FTW protocols, for the host test
+  of the reclaim writes of the variable store, and fakes of the services of
+  the variable driver that Reclaim.c calls to reach it.
+
+  The fake FTW erases and rewrites every block that a write touches, and
+  advances the performance counter of the fake TimerLib by the time that
+  takes, so that the test measures the writes in flash time.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "../Variable.h"
+
+#define FAKE_FVB_HANDLE  ((EFI_HANDLE)(UINTN)0x5A5A)
+
+BOOLEAN     mReclaimFakeAtRuntime;
+EFI_STATUS  mReclaimFakeFtwStatus;
+UINT64      mReclaimFakeBlockWriteTime;
+
+STATIC UINT8   *mFakeFlash;
+STATIC UINTN   mFakeBlockSize;
+STATIC UINTN   mFakeNumberOfBlocks;
+STATIC UINT32  *mFakeEraseCount;
+STATIC UINT32  mFakeFtwWrites;
+STATIC UINT64  mFakeClock;
+
+STATIC
+EFI_STATUS
+EFIAPI
+FakeFvbGetPhysicalAddress (
+  IN  CONST EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL  *This,
+  OUT EFI_PHYSICAL_ADDRESS                      *Address
+  )
+{
+  *Address = (EFI_PHYSICAL_ADDRESS)(UINTN)mFakeFlash;
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+FakeFvbGetBlockSize (
+  IN  CONST EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL  *This,
+  IN  EFI_LBA                                   Lba,
+  OUT UINTN                                     *BlockSize,
+  OUT UINTN                                     *NumberOfBlocks
+  )
+{
+  if (Lba >= mFakeNumberOfBlocks) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  *BlockSize      = mFakeBlockSize;
+  *NumberOfBlocks = mFakeNumberOfBlocks - (UINTN)Lba;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL  mFakeFvb = {
+  NULL,
+  NULL,
+  FakeFvbGetPhysicalAddress,
+  FakeFvbGetBlockSize,
+  NULL,
+  NULL,
+  NULL,
+  NULL
+};
+
+STATIC
+EFI_STATUS
+EFIAPI
+FakeFtwWrite (
+  IN EFI_FAULT_TOLERANT_WRITE_PROTOCOL  *This,
+  IN EFI_LBA                            Lba,
+  IN UINTN                              Offset,
+  IN UINTN                              Length,
+  IN VOID                               *PrivateData,
+  IN EFI_HANDLE                         FvbHandle,
+  IN VOID                               *Buffer
+  )
+{
+  UINTN  Block;
+  UINTN  LastBlock;
+
+  ASSERT (FvbHandle == FAKE_FVB_HANDLE);
+  ASSERT (Length != 0);
+
+  LastBlock = (UINTN)Lba + (Offset + Length - 1) / mFakeBlockSize;
+  if (LastBlock >= mFakeNumberOfBlocks) {
+    return EFI_BAD_BUFFER_SIZE;
+  }
+
+  if (EFI_ERROR (mReclaimFakeFtwStatus)) {
+    return mReclaimFakeFtwStatus;
+  }
+
+  for (Block = (UINTN)Lba; Block <= LastBlock; Block++) {
+    mFakeEraseCount[Block]++;
+    mFakeClock += mReclaimFakeBlockWriteTime;
+  }
+
+  CopyMem (mFakeFlash + (UINTN)Lba * mFakeBlockSize + Offset, Buffer, Length);
+  mFakeFtwWrites++;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_FAULT_TOLERANT_WRITE_PROTOCOL  mFakeFtw = {
+  NULL,
+  NULL,
+  FakeFtwWrite,
+  NULL,
+  NULL,
+  NULL
+};
+
+VARIABLE_STORE_HEADER *
+ReclaimFakeCreateFlash (
+  IN UINTN  BlockSize,
+  IN UINTN  NumberOfBlocks,
+  IN UINTN  StoreSize
+  )
+{
+  EFI_FIRMWARE_VOLUME_HEADER  *FvHeader;
+  VARIABLE_STORE_HEADER       *Store;
+  UINTN                       HeaderLength;
+
+  if (mFakeFlash != NULL) {
+    FreePool (mFakeFlash);
+    FreePool (mFakeEraseCount);
+  }
+
+  HeaderLength = sizeof (EFI_FIRMWARE_VOLUME_HEADER) + sizeof (EFI_FV_BLOCK_MAP_ENTRY);
+  ASSERT (HeaderLength + StoreSize <= BlockSize * NumberOfBlocks);
+
+  mFakeFlash          = AllocatePool (BlockSize * NumberOfBlocks);
+  mFakeEraseCount     = AllocateZeroPool (NumberOfBlocks * sizeof (UINT32));
+  mFakeBlockSize      = BlockSize;
+  mFakeNumberOfBlocks = NumberOfBlocks;
+  mFakeFtwWrites      = 0;
+  ASSERT (mFakeFlash != NULL && mFakeEraseCount != NULL);
+  SetMem (mFakeFlash, BlockSize * NumberOfBlocks, 0xFF);
+
+  FvHeader                        = (EFI_FIRMWARE_VOLUME_HEADER *)mFakeFlash;
+  FvHeader->FvLength              = BlockSize * NumberOfBlocks;
+  FvHeader->HeaderLength          = (UINT16)HeaderLength;
+  FvHeader->BlockMap[0].NumBlocks = (UINT32)NumberOfBlocks;
+  FvHeader->BlockMap[0].Length    = (UINT32)BlockSize;
+  FvHeader->BlockMap[1].NumBlocks = 0;
+  FvHeader->BlockMap[1].Length    = 0;
+
+  Store = (VARIABLE_STORE_HEADER *)(mFakeFlash + HeaderLength);
+  CopyGuid (&Store->Signature, &gEfiVariableGuid);
+  Store->Size   = (UINT32)StoreSize;
+  Store->Format = VARIABLE_STORE_FORMATTED;
+  Store->State  = VARIABLE_STORE_HEALTHY;
+
+  ZeroMem (&mVariableReclaimStatistics, sizeof (mVariableReclaimStatistics));
+  return Store;
+}
+
+UINT32
+ReclaimFakeEraseCount (
+  IN EFI_LBA  Lba
+  )
+{
+  return mFakeEraseCount[Lba];
+}
+
+UINT32
+ReclaimFakeFtwWrites (
+  VOID
+  )
+{
+  return mFakeFtwWrites;
+}
+
+BOOLEAN
+AtRuntime (
+  VOID
+  )
+{
+  return mReclaimFakeAtRuntime;
+}
+
+EFI_STATUS
+GetFtwProtocol (
+  OUT VOID  **FtwProtocol
+  )
+{
+  *FtwProtocol = &mFakeFtw;
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+GetFvbInfoByAddress (
+  IN  EFI_PHYSICAL_ADDRESS                Address,
+  OUT EFI_HANDLE                          *FvbHandle OPTIONAL,
+  OUT EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL  **FvbProtocol OPTIONAL
+  )
+{
+  if ((Address < (UINTN)mFakeFlash) || (Address >= (UINTN)mFakeFlash + mFakeBlockSize * mFakeNumberOfBlocks)) {
+    return EFI_NOT_FOUND;
+  }
+
+  if (FvbHandle != NULL) {
+    *FvbHandle = FAKE_FVB_HANDLE;
+  }
+
+  if (FvbProtocol != NULL) {
+    *FvbProtocol = &mFakeFvb;
+  }
+
+  return EFI_SUCCESS;
+}
+
+//
+// The performance counter counts up in nanoseconds.
+//
+UINT64
+EFIAPI
+GetPerformanceCounter (
+  VOID
+  )
+{
+  return mFakeClock;
+}
+
+UINT64
+EFIAPI
+GetPerformanceCounterProperties (
+  OUT UINT64  *StartValue OPTIONAL,
+  OUT UINT64  *EndValue OPTIONAL
+  )
+{
+  if (StartValue != NULL) {
+    *StartValue = 0;
+  }
+
+  if (EndValue != NULL) {
+    *EndValue = MAX_UINT64;
+  }
+
+  return 1000000000;
+}
+
+UINT64
+EFIAPI
+GetTimeInNanoSecond (
+  IN UINT64  Ticks
+  )
+{
+  return Ticks;
+}
@@ -0,0 +1,356 @@
+/** @file
+  Host based tests of the reclaim writes of the variable store.
+
+  The store lives in a simulated flash device. Reclaims are modelled by
+  compacting a copy of the store and handing it to FtwVariableSpace (), which
+  must leave the flash holding the copy while erasing no block outside of
+  the span that changed. A workload of frequently updated variables reports
+  the wear and the latency of the writes against a rewrite of the whole
+  store.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+extern "C" {
+  #include <Uefi.h>
+  #include "../Variable.h"
+  //
+  // Returned by AtRuntime ()
+  //
+  extern BOOLEAN  mReclaimFakeAtRuntime;
+
+  //
+  // Returned by the FTW writes. A write that fails leaves the flash as it was.
+  //
+  extern EFI_STATUS  mReclaimFakeFtwStatus;
+
+  //
+  // The time the fake FTW takes to rewrite a block, in nanoseconds
+  //
+  extern UINT64  mReclaimFakeBlockWriteTime;
+
+  //
+  // Creates a firmware volume in memory that holds an empty variable store
+  // after its header, and resets the reclaim statistics
+  //
+  VARIABLE_STORE_HEADER *
+  ReclaimFakeCreateFlash (
+    IN UINTN  BlockSize,
+    IN UINTN  NumberOfBlocks,
+    IN UINTN  StoreSize
+    );
+
+  UINT32
+  ReclaimFakeEraseCount (
+    IN EFI_LBA  Lba
+    );
+
+  UINT32
+  ReclaimFakeFtwWrites (
+    VOID
+    );
+}
+
+#define BLOCK_SIZE        0x1000
+#define NUMBER_OF_BLOCKS  16
+#define STORE_SIZE        0xE000
+
+class VariableReclaimTest : public ::testing::Test {
+protected:
+  VARIABLE_STORE_HEADER  *Store;
+  UINTN                  StoreLba;
+  UINTN                  StoreOffset;
+  //
+  // The records of the store, as offsets and sizes, and the image the next
+  // write must leave in the flash.
+  //
+  std::vector<UINTN>     Offsets;
+  std::vector<UINTN>     Sizes;
+  std::vector<UINT8>     Image;
+  std::mt19937           Random;
+
+  void
+  SetUp (
+    ) override
+  {
+    Store                      = ReclaimFakeCreateFlash (BLOCK_SIZE, NUMBER_OF_BLOCKS, STORE_SIZE);
+    StoreLba                   = 0;
+    StoreOffset                = sizeof (EFI_FIRMWARE_VOLUME_HEADER) + sizeof (EFI_FV_BLOCK_MAP_ENTRY);
+    mReclaimFakeAtRuntime      = FALSE;
+    mReclaimFakeFtwStatus      = EFI_SUCCESS;
+    mReclaimFakeBlockWriteTime = 0;
+    Random.seed (1);
+    Image.assign ((UINT8 *)Store, (UINT8 *)Store + STORE_SIZE);
+    Offsets.clear ();
+    Sizes.clear ();
+  }
+
+  UINTN
+  End (
+    )
+  {
+    return Offsets.empty () ? sizeof (VARIABLE_STORE_HEADER) : Offsets.back () + Sizes.back ();
+  }
+
+  //
+  // Append a record to the store, as SetVariable () does in place.
+  //
+  bool
+  Append (
+    UINTN  Size
+    )
+  {
+    UINTN  Offset;
+
+    Offset = End ();
+    if (Offset + Size > STORE_SIZE) {
+      return false;
+    }
+
+    for (UINTN Index = 0; Index < Size; Index++) {
+      Image[Offset + Index] = (UINT8)Random ();
+    }
+
+    memcpy ((UINT8 *)Store + Offset, &Image[Offset], Size);
+    Offsets.push_back (Offset);
+    Sizes.push_back (Size);
+    return true;
+  }
+
+  //
+  // Drop the records marked in Deleted from the image, moving the others
+  // down, as Reclaim () does.
+  //
+  void
+  Compact (
+    const std::vector<bool>  &Deleted
+    )
+  {
+    std::vector<UINT8>  Compacted (Image.begin (), Image.begin () + sizeof (VARIABLE_STORE_HEADER));
+    std::vector<UINTN>  NewOffsets;
+    std::vector<UINTN>  NewSizes;
+
+    for (UINTN Index = 0; Index < Offsets.size (); Index++) {
+      if (!Deleted[Index]) {
+        NewOffsets.push_back (Compacted.size ());
+        NewSizes.push_back (Sizes[Index]);
+        Compacted.insert (Compacted.end (), Image.begin () + Offsets[Index], Image.begin () + Offsets[Index] + Sizes[Index]);
+      }
+    }
+
+    Compacted.resize (STORE_SIZE, 0xFF);
+    Image   = Compacted;
+    Offsets = NewOffsets;
+    Sizes   = NewSizes;
+  }
+
+  //
+  // The blocks, counted from the one that holds the store header, that
+  // differ between the flash and the image.
+  //
+  void
+  ChangedBlocks (
+    UINTN  *First,
+    UINTN  *Last
+    )
+  {
+    *First = MAX_UINTN;
+    *Last  = 0;
+    for (UINTN Index = 0; Index < STORE_SIZE; Index++) {
+      if (((UINT8 *)Store)[Index] != Image[Index]) {
+        *First = MIN (*First, (StoreOffset + Index) / BLOCK_SIZE);
+        *Last  = (StoreOffset + Index) / BLOCK_SIZE;
+      }
+    }
+  }
+
+  void
+  ExpectFlashHoldsImage (
+    )
+  {
+    ASSERT_EQ (memcmp (Store, Image.data (), STORE_SIZE), 0);
+  }
+
+  void
+  ExpectGenerationsMatchErases (
+    )
+  {
+    for (UINTN Block = 0; Block < NUMBER_OF_BLOCKS; Block++) {
+      EXPECT_EQ (mVariableReclaimStatistics.BlockGeneration[Block], ReclaimFakeEraseCount (StoreLba + Block)) << "block " << Block;
+    }
+  }
+};
+
+//
+// A reclaim that finds nothing to drop does not write the store.
+//
+TEST_F (VariableReclaimTest, UnchangedStoreIsNotWritten) {
+  while (Append (100 + Random () % 400)) {
+  }
+
+  Compact (std::vector<bool>(Offsets.size (), false));
+  ASSERT_EQ (FtwVariableSpace ((UINTN)Store, (VARIABLE_STORE_HEADER *)Image.data ()), EFI_SUCCESS);
+  EXPECT_EQ (ReclaimFakeFtwWrites (), 0u);
+  EXPECT_EQ (mVariableReclaimStatistics.SkippedWrites, 1u);
+  EXPECT_EQ (mVariableReclaimStatistics.Writes, 0u);
+  ExpectFlashHoldsImage ();
+}
+
+//
+// Dropping a variable near the end of a full store only rewrites the blocks
+// from that variable on.
+//
+TEST_F (VariableReclaimTest, OnlyTheChangedSpanIsWritten) {
+  UINTN  First;
+  UINTN  Last;
+
+  while (Append (100 + Random () % 400)) {
+  }
+
+  std::vector<bool>  Deleted (Offsets.size (), false);
+
+  Deleted[Offsets.size () - 3] = true;
+  Compact (Deleted);
+  ChangedBlocks (&First, &Last);
+  ASSERT_EQ (FtwVariableSpace ((UINTN)Store, (VARIABLE_STORE_HEADER *)Image.data ()), EFI_SUCCESS);
+  ExpectFlashHoldsImage ();
+  EXPECT_EQ (ReclaimFakeFtwWrites (), 1u);
+  EXPECT_LE (Last - First + 1, 2u);
+  for (UINTN Block = 0; Block < NUMBER_OF_BLOCKS; Block++) {
+    EXPECT_EQ (ReclaimFakeEraseCount (StoreLba + Block), (Block >= First && Block <= Last) ? 1u : 0u) << "block " << Block;
+  }
+
+  ExpectGenerationsMatchErases ();
+  EXPECT_EQ (mVariableReclaimStatistics.Writes, 1u);
+}
+
+//
+// Random sequences of appends and reclaims, with most deletions among the
+// recent variables, as the frequent updates of a few variables make them.
+//
+TEST_F (VariableReclaimTest, RandomReclaims) {
+  UINTN   First;
+  UINTN   Last;
+  UINTN   Erases;
+  UINT64  Written;
+
+  Erases  = 0;
+  Written = 0;
+  for (UINTN Round = 0; Round < 500; Round++) {
+    while (Append (40 + Random () % 600)) {
+    }
+
+    std::vector<bool>  Deleted (Offsets.size (), false);
+
+    for (UINTN Index = 0; Index < Offsets.size (); Index++) {
+      Deleted[Index] = (Random () % 100) < ((Index * 4 >= Offsets.size () * 3) ? 60u : 2u);
+    }
+
+    Compact (Deleted);
+    ChangedBlocks (&First, &Last);
+    ASSERT_EQ (FtwVariableSpace ((UINTN)Store, (VARIABLE_STORE_HEADER *)Image.data ()), EFI_SUCCESS);
+    ExpectFlashHoldsImage ();
+    if (First != MAX_UINTN) {
+      Erases += Last - First + 1;
+    }
+  }
+
+  for (UINTN Block = 0; Block < NUMBER_OF_BLOCKS; Block++) {
+    Written += ReclaimFakeEraseCount (StoreLba + Block);
+  }
+
+  EXPECT_EQ (Written, Erases);
+  ExpectGenerationsMatchErases ();
+  EXPECT_EQ (mVariableReclaimStatistics.Writes + mVariableReclaimStatistics.SkippedWrites, 500u);
+  printf (
+    "%u reclaims erased %llu blocks, against %u for whole store rewrites\n",
+    500,
+    (unsigned long long)Written,
+    500 * (unsigned)((StoreOffset + STORE_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE)
+    );
+}
+
+//
+// The writes at boot time are counted in the latency histogram, by their
+// duration in microseconds.
+//
+TEST_F (VariableReclaimTest, LatencyHistogram) {
+  UINTN  Bucket;
+  UINTN  Count;
+
+  mReclaimFakeBlockWriteTime = 1000 * 1000;
+  while (Append (200)) {
+  }
+
+  //
+  // Changing the last record rewrites one block, or two if it straddles a
+  // block boundary: 1 or 2 ms, which fall in bucket 10 or 11.
+  //
+  std::vector<bool>  Deleted (Offsets.size (), false);
+
+  Deleted.back () = true;
+  Compact (Deleted);
+  ASSERT_EQ (FtwVariableSpace ((UINTN)Store, (VARIABLE_STORE_HEADER *)Image.data ()), EFI_SUCCESS);
+  Count = 0;
+  for (Bucket = 0; Bucket < VARIABLE_RECLAIM_LATENCY_BUCKETS; Bucket++) {
+    Count += mVariableReclaimStatistics.LatencyHistogram[Bucket];
+  }
+
+  EXPECT_EQ (Count, 1u);
+  EXPECT_EQ (mVariableReclaimStatistics.LatencyHistogram[10] + mVariableReclaimStatistics.LatencyHistogram[11], 1u);
+
+  //
+  // Dropping the first record rewrites the whole store, 15 ms: bucket 14.
+  //
+  Deleted.assign (Offsets.size (), false);
+  Deleted.front () = true;
+  Compact (Deleted);
+  ASSERT_EQ (FtwVariableSpace ((UINTN)Store, (VARIABLE_STORE_HEADER *)Image.data ()), EFI_SUCCESS);
+  EXPECT_EQ (mVariableReclaimStatistics.LatencyHistogram[14], 1u);
+
+  //
+  // The writes at runtime are not timed.
+  //
+  mReclaimFakeAtRuntime = TRUE;
+  Deleted.assign (Offsets.size (), false);
+  Deleted.front () = true;
+  Compact (Deleted);
+  ASSERT_EQ (FtwVariableSpace ((UINTN)Store, (VARIABLE_STORE_HEADER *)Image.data ()), EFI_SUCCESS);
+  ExpectFlashHoldsImage ();
+  EXPECT_EQ (mVariableReclaimStatistics.Writes, 3u);
+  EXPECT_EQ (mVariableReclaimStatistics.LatencyHistogram[14], 1u);
+}
+
+//
+// A failed write is reported, and not counted.
+//
+TEST_F (VariableReclaimTest, FailedWrite) {
+  while (Append (300)) {
+  }
+
+  std::vector<bool>  Deleted (Offsets.size (), false);
+
+  Deleted[1]            = true;
+  mReclaimFakeFtwStatus = EFI_DEVICE_ERROR;
+  Compact (Deleted);
+  EXPECT_EQ (FtwVariableSpace ((UINTN)Store, (VARIABLE_STORE_HEADER *)Image.data ()), EFI_DEVICE_ERROR);
+  EXPECT_EQ (mVariableReclaimStatistics.Writes, 0u);
+  EXPECT_EQ (mVariableReclaimStatistics.BytesWritten, 0u);
+  ExpectGenerationsMatchErases ();
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
@@ -26,6 +26,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 **/
 
 #include "Variable.h"
+#include "VariableIndex.h"
 #include "VariableNonVolatile.h"
 #include "VariableParsing.h"
 #include "VariableRuntimeCache.h"
@@ -792,6 +793,12 @@ Reclaim (
   }
 
 Done:
+  //
+  // The variables have moved, so the index of the store is rebuilt at the
+  // next lookup.
+  //
+  VariableIndexReset (IsVolatile ? VariableStoreTypeVolatile : VariableStoreTypeNv);
+
   DoneStatus = EFI_SUCCESS;
   if (IsVolatile || mVariableModuleGlobal->VariableGlobal.EmuNvMode) {
     DoneStatus = SynchronizeRuntimeVariableCache (
@@ -885,13 +892,24 @@ FindVariable (
     PtrTrack->EndPtr   = GetEndPointer (VariableStoreHeader[Type]);
     PtrTrack->Volatile = (BOOLEAN)(Type == VariableStoreTypeVolatile);
 
-    Status =  FindVariableEx (
-                VariableName,
-                VendorGuid,
-                IgnoreRtCheck,
-                PtrTrack,
-                mVariableModuleGlobal->VariableGlobal.AuthFormat
-                );
+    Status = FindVariableInIndex (
+               Type,
+               VariableStoreHeader[Type],
+               VariableName,
+               VendorGuid,
+               IgnoreRtCheck,
+               PtrTrack,
+               mVariableModuleGlobal->VariableGlobal.AuthFormat
+               );
+    if (Status == EFI_UNSUPPORTED) {
+      Status =  FindVariableEx (
+                  VariableName,
+                  VendorGuid,
+                  IgnoreRtCheck,
+                  PtrTrack,
+                  mVariableModuleGlobal->VariableGlobal.AuthFormat
+                  );
+    }
     if (!EFI_ERROR (Status)) {
       return Status;
     }
@@ -3260,6 +3278,84 @@ ReclaimForOS (
   }
 }
 
+/**
+  Reclaim the non-volatile variable store ahead of need, when it is getting
+  full and enough of it is taken up by deleted variables.
+
+  Deleted variables must take up enough of the store for the reclaim to be
+  worth the erase cycle it costs. Called while the system is idle at boot
+  time, this takes the cost of the reclaim off the SetVariable () call that
+  would otherwise run out of space.
+
+  The caller must hold the variable services lock.
+
+  @retval EFI_SUCCESS           The store was reclaimed.
+  @retval EFI_NOT_READY         The store does not need to be reclaimed.
+  @return Others                The reclaim failed.
+
+**/
+EFI_STATUS
+ReclaimInBackground (
+  VOID
+  )
+{
+  STATIC UINTN           CheckedOffset;
+  VARIABLE_STORE_HEADER  *VariableStoreHeader;
+  VARIABLE_HEADER        *Variable;
+  VARIABLE_HEADER        *NextVariable;
+  UINTN                  LastVariableOffset;
+  UINTN                  DeletedSize;
+  BOOLEAN                AuthFormat;
+
+  if (mVariableModuleGlobal->VariableGlobal.EmuNvMode || AtRuntime ()) {
+    return EFI_NOT_READY;
+  }
+
+  //
+  // The store only needs to be checked again after a variable was written.
+  //
+  LastVariableOffset = mVariableModuleGlobal->NonVolatileLastVariableOffset;
+  if (LastVariableOffset == CheckedOffset) {
+    return EFI_NOT_READY;
+  }
+
+  VariableStoreHeader = mNvVariableCache;
+  if (VariableStoreHeader->Size - LastVariableOffset >= VariableStoreHeader->Size / VARIABLE_BACKGROUND_RECLAIM_FREE) {
+    return EFI_NOT_READY;
+  }
+
+  CheckedOffset = LastVariableOffset;
+
+  //
+  // Variables in any state other than ADDED or IN_DELETED_TRANSITION are
+  // dropped by the reclaim.
+  //
+  AuthFormat  = mVariableModuleGlobal->VariableGlobal.AuthFormat;
+  DeletedSize = 0;
+  Variable    = GetStartPointer (VariableStoreHeader);
+  while (IsValidVariableHeader (Variable, GetEndPointer (VariableStoreHeader))) {
+    NextVariable = GetNextVariablePtr (Variable, AuthFormat);
+    if ((Variable->State != VAR_ADDED) && (Variable->State != (VAR_IN_DELETED_TRANSITION & VAR_ADDED))) {
+      DeletedSize += (UINTN)NextVariable - (UINTN)Variable;
+    }
+
+    Variable = NextVariable;
+  }
+
+  if (DeletedSize < VariableStoreHeader->Size / VARIABLE_BACKGROUND_RECLAIM_DELETED) {
+    return EFI_NOT_READY;
+  }
+
+  return Reclaim (
+           mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase,
+           &mVariableModuleGlobal->NonVolatileLastVariableOffset,
+           FALSE,
+           NULL,
+           NULL,
+           0
+           );
+}
+
 /**
   Get maximum variable size, covering both non-volatile and volatile variables.
 
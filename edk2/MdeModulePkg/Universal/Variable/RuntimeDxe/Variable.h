@@ -33,6 +33,7 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #include <Library/VarCheckLib.h>
 #include <Library/VariableFlashInfoLib.h>
 #include <Library/SafeIntLib.h>
+#include <Library/TimerLib.h>
 #include <Guid/GlobalVariable.h>
 #include <Guid/EventGroup.h>
 #include <Guid/VariableFormat.h>
@@ -123,6 +124,46 @@ typedef struct {
   EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL    *FvbInstance;
 } VARIABLE_MODULE_GLOBAL;
 
+///
+/// The number of blocks of the non-volatile store whose rewrites are counted.
+///
+#define VARIABLE_RECLAIM_MAX_BLOCKS  64
+
+///
+/// The number of buckets of the latency histogram of the reclaim writes.
+/// Bucket 0 counts the writes that took less than 1 microsecond, bucket N
+/// the writes that took [2^(N-1), 2^N) microseconds, and the last bucket
+/// also counts the slower ones.
+///
+#define VARIABLE_RECLAIM_LATENCY_BUCKETS  24
+
+///
+/// The non-volatile store is reclaimed in the background once less than
+/// 1/VARIABLE_BACKGROUND_RECLAIM_FREE of it is free, provided at least
+/// 1/VARIABLE_BACKGROUND_RECLAIM_DELETED of it is held by deleted variables.
+///
+#define VARIABLE_BACKGROUND_RECLAIM_FREE     4
+#define VARIABLE_BACKGROUND_RECLAIM_DELETED  8
+
+typedef struct {
+  //
+  // The number of FTW writes of the store, and of reclaims that left the
+  // store as it was and so did not write it.
+  //
+  UINT32    Writes;
+  UINT32    SkippedWrites;
+  UINT64    BytesWritten;
+  //
+  // The number of times each block of the store, counted from the one that
+  // holds the store header, has been rewritten.
+  //
+  UINT32    BlockGeneration[VARIABLE_RECLAIM_MAX_BLOCKS];
+  //
+  // The latency of the writes done at boot time.
+  //
+  UINT32    LatencyHistogram[VARIABLE_RECLAIM_LATENCY_BUCKETS];
+} VARIABLE_RECLAIM_STATISTICS;
+
 /**
   Flush the HOB variable to flash.
 
@@ -142,6 +183,8 @@ FlushHobVariableToFlash (
   This function writes a buffer to variable storage space into a firmware
   volume block device. The destination is specified by the parameter
   VariableBase. Fault Tolerant Write protocol is used for writing.
+  Only the span of the store that differs from the buffer is written, so
+  the blocks that hold no change are neither erased nor rewritten.
 
   @param  VariableBase   Base address of the variable to write.
   @param  VariableBuffer Point to the variable data buffer.
@@ -377,6 +420,22 @@ ReclaimForOS (
   VOID
   );
 
+/**
+  Reclaim the non-volatile variable store ahead of need, when it is getting
+  full and enough of it is taken up by deleted variables.
+
+  The caller must hold the variable services lock.
+
+  @retval EFI_SUCCESS           The store was reclaimed.
+  @retval EFI_NOT_READY         The store does not need to be reclaimed.
+  @return Others                The reclaim failed.
+
+**/
+EFI_STATUS
+ReclaimInBackground (
+  VOID
+  );
+
 /**
   Get maximum variable size, covering both non-volatile and volatile variables.
 
@@ -692,6 +751,8 @@ extern VAR_CHECK_REQUEST_SOURCE    mRequestSource;
 
 extern AUTH_VAR_LIB_CONTEXT_OUT  mAuthContextOut;
 
+extern VARIABLE_RECLAIM_STATISTICS  mVariableReclaimStatistics;
+
 /**
   Finds variable in storage blocks of volatile and non-volatile storage areas.
 
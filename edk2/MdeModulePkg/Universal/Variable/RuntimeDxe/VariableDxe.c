@@ -11,9 +11,11 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 **/
 
 #include "Variable.h"
+#include "VariableIndex.h"
 
 #include <Protocol/VariablePolicy.h>
 #include <Library/VariablePolicyLib.h>
+#include <Guid/IdleLoopEvent.h>
 
 EFI_STATUS
 EFIAPI
@@ -266,6 +268,12 @@ VariableClassAddressChangeEvent (
   EfiConvertPointer (0x0, (VOID **)&mNvVariableCache);
   EfiConvertPointer (0x0, (VOID **)&mNvFvHeaderCache);
 
+  for (Index = 0; Index < VariableStoreTypeMax; Index++) {
+    EfiConvertPointer (EFI_OPTIONAL_PTR, (VOID **)&mVariableIndex[Index].Store);
+    EfiConvertPointer (EFI_OPTIONAL_PTR, (VOID **)&mVariableIndex[Index].Buckets);
+    EfiConvertPointer (EFI_OPTIONAL_PTR, (VOID **)&mVariableIndex[Index].Entries);
+  }
+
   if (mAuthContextOut.AddressPointer != NULL) {
     for (Index = 0; Index < mAuthContextOut.AddressPointerCount; Index++) {
       EfiConvertPointer (0x0, (VOID **)mAuthContextOut.AddressPointer[Index]);
@@ -396,6 +404,38 @@ VariableWriteServiceInitializeDxe (
   ASSERT_EFI_ERROR (Status);
 }
 
+/**
+  Notification function of the gIdleLoopEventGuid event group.
+
+  While the system waits at boot time, reclaims the non-volatile variable
+  store if it is getting full, rather than leaving that to the SetVariable ()
+  call that runs out of space.
+
+  @param[in] Event    Event whose notification function is being invoked.
+  @param[in] Context  Pointer to the notification function's context.
+
+**/
+VOID
+EFIAPI
+OnIdleLoop (
+  IN  EFI_EVENT  Event,
+  IN  VOID       *Context
+  )
+{
+  EFI_STATUS  Status;
+
+  if (EFI_ERROR (EfiAcquireLockOrFail (&mVariableModuleGlobal->VariableGlobal.VariableServicesLock))) {
+    return;
+  }
+
+  Status = ReclaimInBackground ();
+  EfiReleaseLock (&mVariableModuleGlobal->VariableGlobal.VariableServicesLock);
+
+  if (Status != EFI_NOT_READY) {
+    DEBUG ((DEBUG_INFO, "Variable: background reclaim - %r\n", Status));
+  }
+}
+
 /**
   Fault Tolerant Write protocol notification event handler.
 
@@ -425,6 +465,7 @@ FtwNotificationEvent (
   UINTN                               FtwMaxBlockSize;
   UINT32                              NvStorageVariableSize;
   UINT64                              NvStorageVariableSize64;
+  EFI_EVENT                           IdleLoopEvent;
 
   //
   // Ensure FTW protocol is installed.
@@ -492,6 +533,20 @@ FtwNotificationEvent (
   //
   VariableWriteServiceInitializeDxe ();
 
+  //
+  // Reclaim the store while the system is idle, ahead of the SetVariable ()
+  // calls that would otherwise stall on it.
+  //
+  Status = gBS->CreateEventEx (
+                  EVT_NOTIFY_SIGNAL,
+                  TPL_CALLBACK,
+                  OnIdleLoop,
+                  NULL,
+                  &gIdleLoopEventGuid,
+                  &IdleLoopEvent
+                  );
+  ASSERT_EFI_ERROR (Status);
+
   //
   // Close the notify event to avoid install gEfiVariableWriteArchProtocolGuid again.
   //
@@ -0,0 +1,340 @@
+/** @file
+  Hash index of the variable stores owned by the variable driver.
+
+  Each store searched by FindVariable () gets an index on its first lookup.
+  The index only has to be told when the variables of a store move, which
+  Reclaim () does through VariableIndexReset (). Variables appended by
+  UpdateVariable () are picked up at the next lookup, and state changes are
+  seen when the headers are read. The index memory comes from the runtime
+  pool and is converted at SetVirtualAddressMap () along with the stores.
+
+  Caution: This module requires additional review when modified.
+  This driver will have external input - variable data. They may be input in SMM mode.
+  This external input must be validated carefully to avoid security issue like
+  buffer overflow, integer overflow.
+
+Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "VariableParsing.h"
+#include "VariableIndex.h"
+
+VARIABLE_INDEX  mVariableIndex[VariableStoreTypeMax];
+
+/**
+  Hash a variable name and vendor GUID.
+
+  The name is hashed up to its terminator, or up to NameSize bytes when it
+  has none, in which case Terminated is set to FALSE.
+
+  @param[in]   Name         The name of the variable.
+  @param[in]   NameSize     The maximum size of the name in bytes.
+  @param[in]   Guid         The vendor GUID of the variable.
+  @param[out]  Terminated   Whether the name is terminated within NameSize.
+
+  @return The hash.
+
+**/
+STATIC
+UINT32
+VariableIndexHash (
+  IN  CONST CHAR16    *Name,
+  IN  UINTN           NameSize,
+  IN  CONST EFI_GUID  *Guid,
+  OUT BOOLEAN         *Terminated
+  )
+{
+  UINT32  Hash;
+  UINTN   Index;
+
+  //
+  // FNV-1a over the characters of the name, then the first word of the GUID
+  //
+  Hash        = 0x811C9DC5;
+  *Terminated = FALSE;
+  for (Index = 0; Index < NameSize / sizeof (CHAR16); Index++) {
+    if (Name[Index] == 0) {
+      *Terminated = TRUE;
+      break;
+    }
+
+    Hash = (Hash ^ Name[Index]) * 0x01000193;
+  }
+
+  return (Hash ^ Guid->Data1) * 0x01000193;
+}
+
+/**
+  Empty an index, keeping its memory.
+
+  @param[in, out]  Index   The index.
+
+**/
+STATIC
+VOID
+VariableIndexEmpty (
+  IN OUT VARIABLE_INDEX  *Index
+  )
+{
+  SetMem32 (Index->Buckets, (Index->BucketMask + 1) * sizeof (UINT32), VARIABLE_INDEX_END);
+  Index->EntryCount    = 0;
+  Index->IndexedOffset = (UINT32)((UINTN)GetStartPointer (Index->Store) - (UINTN)Index->Store);
+  Index->Overflow      = FALSE;
+}
+
+/**
+  Allocate the index of a variable store.
+
+  @param[in, out]  Index   The index.
+  @param[in]       Store   The variable store.
+
+  @retval EFI_SUCCESS            The index is allocated and empty.
+  @retval EFI_OUT_OF_RESOURCES   There is no memory for the index.
+
+**/
+STATIC
+EFI_STATUS
+VariableIndexAllocate (
+  IN OUT VARIABLE_INDEX         *Index,
+  IN     VARIABLE_STORE_HEADER  *Store
+  )
+{
+  UINT32  EntryCapacity;
+  UINT32  BucketCount;
+  UINT8   *Buffer;
+
+  EntryCapacity = MAX (Store->Size / VARIABLE_INDEX_BYTES_PER_ENTRY, 16);
+  BucketCount   = (UINT32)GetPowerOfTwo32 (EntryCapacity / 2);
+
+  Buffer = AllocateRuntimePool (BucketCount * sizeof (UINT32) + EntryCapacity * sizeof (VARIABLE_INDEX_ENTRY));
+  if (Buffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  if (Index->Buckets != NULL) {
+    FreePool (Index->Buckets);
+  }
+
+  Index->Store         = Store;
+  Index->Buckets       = (UINT32 *)Buffer;
+  Index->Entries       = (VARIABLE_INDEX_ENTRY *)(Buffer + BucketCount * sizeof (UINT32));
+  Index->BucketMask    = BucketCount - 1;
+  Index->EntryCapacity = EntryCapacity;
+  VariableIndexEmpty (Index);
+  return EFI_SUCCESS;
+}
+
+/**
+  Add the headers appended to a store since the last update of its index.
+
+  Headers that are neither added nor in deleted transition are skipped, as
+  FindVariableEx () never returns them and, once deleted, their state never
+  goes back. A header in VAR_HEADER_VALID_ONLY state moves on to VAR_ADDED
+  when UpdateVariable () has written the data after it, so while it is the
+  last header of the store the update stops in front of it, to read it again
+  next time. One with headers after it was left by an interrupted update and
+  stays that way. When the index is full, it is rebuilt without the entries
+  of the headers deleted since, and it overflows if that does not make room.
+
+  @param[in, out]  Index        The index.
+  @param[in]       AuthFormat   TRUE indicates authenticated variables are used.
+                                FALSE indicates authenticated variables are not used.
+
+**/
+STATIC
+VOID
+VariableIndexUpdate (
+  IN OUT VARIABLE_INDEX  *Index,
+  IN     BOOLEAN         AuthFormat
+  )
+{
+  VARIABLE_HEADER       *Variable;
+  VARIABLE_HEADER       *EndPtr;
+  VARIABLE_INDEX_ENTRY  *Entry;
+  UINT32                Hash;
+  BOOLEAN               Terminated;
+  BOOLEAN               Rebuilt;
+
+  Rebuilt  = FALSE;
+  EndPtr   = GetEndPointer (Index->Store);
+  Variable = (VARIABLE_HEADER *)((UINTN)Index->Store + Index->IndexedOffset);
+  while (IsValidVariableHeader (Variable, EndPtr)) {
+    if ((Variable->State == VAR_HEADER_VALID_ONLY) &&
+        !IsValidVariableHeader (GetNextVariablePtr (Variable, AuthFormat), EndPtr))
+    {
+      break;
+    }
+
+    if ((Variable->State == VAR_ADDED) ||
+        (Variable->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)))
+    {
+      Hash = VariableIndexHash (
+               GetVariableNamePtr (Variable, AuthFormat),
+               NameSizeOfVariable (Variable, AuthFormat),
+               GetVendorGuidPtr (Variable, AuthFormat),
+               &Terminated
+               );
+      if (!Terminated) {
+        //
+        // The name compares equal to any longer name it is a prefix of,
+        // which a hash cannot express.
+        //
+        Index->Overflow = TRUE;
+        return;
+      }
+
+      if (Index->EntryCount == Index->EntryCapacity) {
+        if (Rebuilt) {
+          Index->Overflow = TRUE;
+          return;
+        }
+
+        VariableIndexEmpty (Index);
+        Rebuilt  = TRUE;
+        Variable = GetStartPointer (Index->Store);
+        continue;
+      }
+
+      Entry         = &Index->Entries[Index->EntryCount];
+      Entry->Hash   = Hash;
+      Entry->Offset = (UINT32)((UINTN)Variable - (UINTN)Index->Store);
+      Entry->Next   = Index->Buckets[Hash & Index->BucketMask];
+      Index->Buckets[Hash & Index->BucketMask] = Index->EntryCount;
+      Index->EntryCount++;
+    }
+
+    Variable = GetNextVariablePtr (Variable, AuthFormat);
+  }
+
+  Index->IndexedOffset = (UINT32)((UINTN)Variable - (UINTN)Index->Store);
+}
+
+/**
+  Find the variable in the specified variable store through its index.
+
+  The search has the same result as FindVariableEx () over the whole store.
+  The index of the store is allocated at the first lookup in it, and is
+  brought up to date with the variables appended since the previous one.
+
+  @param[in]       Type                The type of the variable store.
+  @param[in]       Store               The variable store.
+  @param[in]       VariableName        Name of the variable to be found.
+  @param[in]       VendorGuid          Vendor GUID to be found.
+  @param[in]       IgnoreRtCheck       Ignore EFI_VARIABLE_RUNTIME_ACCESS attribute
+                                       check at runtime when searching variable.
+  @param[in, out]  PtrTrack            Variable Track Pointer structure that contains Variable Information.
+  @param[in]       AuthFormat          TRUE indicates authenticated variables are used.
+                                       FALSE indicates authenticated variables are not used.
+
+  @retval EFI_SUCCESS                  Variable found successfully.
+  @retval EFI_NOT_FOUND                Variable not found.
+  @retval EFI_UNSUPPORTED              The store has no usable index, or VariableName
+                                       is an empty string. Use FindVariableEx () instead.
+
+**/
+EFI_STATUS
+FindVariableInIndex (
+  IN     VARIABLE_STORE_TYPE     Type,
+  IN     VARIABLE_STORE_HEADER   *Store,
+  IN     CHAR16                  *VariableName,
+  IN     EFI_GUID                *VendorGuid,
+  IN     BOOLEAN                 IgnoreRtCheck,
+  IN OUT VARIABLE_POINTER_TRACK  *PtrTrack,
+  IN     BOOLEAN                 AuthFormat
+  )
+{
+  VARIABLE_INDEX   *Index;
+  VARIABLE_HEADER  *Variable;
+  VARIABLE_HEADER  *AddedVariable;
+  VARIABLE_HEADER  *InDeletedVariable;
+  UINT32           Hash;
+  UINT32           Entry;
+  BOOLEAN          Terminated;
+
+  if (VariableName[0] == 0) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Index = &mVariableIndex[Type];
+  if (Index->Store != Store) {
+    if (AtRuntime () || EFI_ERROR (VariableIndexAllocate (Index, Store))) {
+      return EFI_UNSUPPORTED;
+    }
+  }
+
+  if (!Index->Overflow) {
+    VariableIndexUpdate (Index, AuthFormat);
+  }
+
+  if (Index->Overflow) {
+    return EFI_UNSUPPORTED;
+  }
+
+  //
+  // The chain lists the headers from the highest offset down, so the last
+  // added variable met is the first one in the store, and the in deleted
+  // transition variable to return with it is the first one met after it.
+  //
+  Hash              = VariableIndexHash (VariableName, MAX_UINTN, VendorGuid, &Terminated);
+  AddedVariable     = NULL;
+  InDeletedVariable = NULL;
+  for (Entry = Index->Buckets[Hash & Index->BucketMask]; Entry != VARIABLE_INDEX_END; Entry = Index->Entries[Entry].Next) {
+    if (Index->Entries[Entry].Hash != Hash) {
+      continue;
+    }
+
+    Variable = (VARIABLE_HEADER *)((UINTN)Store + Index->Entries[Entry].Offset);
+    if ((Variable->State != VAR_ADDED) &&
+        (Variable->State != (VAR_IN_DELETED_TRANSITION & VAR_ADDED)))
+    {
+      continue;
+    }
+
+    if (!IgnoreRtCheck && AtRuntime () && ((Variable->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) == 0)) {
+      continue;
+    }
+
+    if (!CompareGuid (VendorGuid, GetVendorGuidPtr (Variable, AuthFormat)) ||
+        (CompareMem (VariableName, GetVariableNamePtr (Variable, AuthFormat), NameSizeOfVariable (Variable, AuthFormat)) != 0))
+    {
+      continue;
+    }
+
+    if (Variable->State == VAR_ADDED) {
+      AddedVariable     = Variable;
+      InDeletedVariable = NULL;
+    } else if (InDeletedVariable == NULL) {
+      InDeletedVariable = Variable;
+    }
+  }
+
+  if (AddedVariable != NULL) {
+    PtrTrack->CurrPtr                = AddedVariable;
+    PtrTrack->InDeletedTransitionPtr = InDeletedVariable;
+  } else {
+    PtrTrack->CurrPtr                = InDeletedVariable;
+    PtrTrack->InDeletedTransitionPtr = NULL;
+  }
+
+  return (PtrTrack->CurrPtr == NULL) ? EFI_NOT_FOUND : EFI_SUCCESS;
+}
+
+/**
+  Empty the index of a variable store whose variables have been moved, such
+  as by a reclaim. The index is rebuilt at the next lookup, in the memory it
+  already has, so this may be called at runtime.
+
+  @param[in]  Type                     The type of the variable store.
+
+**/
+VOID
+VariableIndexReset (
+  IN VARIABLE_STORE_TYPE  Type
+  )
+{
+  if (mVariableIndex[Type].Store != NULL) {
+    VariableIndexEmpty (&mVariableIndex[Type]);
+  }
+}
@@ -0,0 +1,110 @@
+/** @file
+  Hash index of the variable stores owned by the variable driver.
+
+  The index maps the name and GUID of each variable to the offset of its
+  header, so a lookup by name no longer walks the whole store.
+
+Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef _VARIABLE_INDEX_H_
+#define _VARIABLE_INDEX_H_
+
+#include "Variable.h"
+
+///
+/// Bytes of variable store per index entry. A store packed with smaller
+/// variables than this overflows its index and is searched linearly.
+///
+#define VARIABLE_INDEX_BYTES_PER_ENTRY  64
+
+///
+/// Marks the end of a hash chain.
+///
+#define VARIABLE_INDEX_END  MAX_UINT32
+
+typedef struct {
+  UINT32    Hash;
+  UINT32    Offset;
+  UINT32    Next;
+} VARIABLE_INDEX_ENTRY;
+
+typedef struct {
+  //
+  // The store the index covers, NULL until the first lookup in it.
+  //
+  VARIABLE_STORE_HEADER    *Store;
+  //
+  // Heads of the hash chains, and the entries. A chain lists its entries
+  // from the highest header offset down.
+  //
+  UINT32                   *Buckets;
+  VARIABLE_INDEX_ENTRY     *Entries;
+  UINT32                   BucketMask;
+  UINT32                   EntryCapacity;
+  UINT32                   EntryCount;
+  //
+  // Offset of the first header not yet added to the index. Variables are
+  // only ever appended to a store between two reclaims, so the headers
+  // from here on are added at the next lookup.
+  //
+  UINT32                   IndexedOffset;
+  //
+  // Set when the store cannot be indexed. Lookups fall back to a linear
+  // search until the next reset.
+  //
+  BOOLEAN                  Overflow;
+} VARIABLE_INDEX;
+
+extern VARIABLE_INDEX  mVariableIndex[VariableStoreTypeMax];
+
+/**
+  Find the variable in the specified variable store through its index.
+
+  The search has the same result as FindVariableEx () over the whole store.
+  The index of the store is allocated at the first lookup in it, and is
+  brought up to date with the variables appended since the previous one.
+
+  @param[in]       Type                The type of the variable store.
+  @param[in]       Store               The variable store.
+  @param[in]       VariableName        Name of the variable to be found.
+  @param[in]       VendorGuid          Vendor GUID to be found.
+  @param[in]       IgnoreRtCheck       Ignore EFI_VARIABLE_RUNTIME_ACCESS attribute
+                                       check at runtime when searching variable.
+  @param[in, out]  PtrTrack            Variable Track Pointer structure that contains Variable Information.
+  @param[in]       AuthFormat          TRUE indicates authenticated variables are used.
+                                       FALSE indicates authenticated variables are not used.
+
+  @retval EFI_SUCCESS                  Variable found successfully.
+  @retval EFI_NOT_FOUND                Variable not found.
+  @retval EFI_UNSUPPORTED              The store has no usable index, or VariableName
+                                       is an empty string. Use FindVariableEx () instead.
+
+**/
+EFI_STATUS
+FindVariableInIndex (
+  IN     VARIABLE_STORE_TYPE     Type,
+  IN     VARIABLE_STORE_HEADER   *Store,
+  IN     CHAR16                  *VariableName,
+  IN     EFI_GUID                *VendorGuid,
+  IN     BOOLEAN                 IgnoreRtCheck,
+  IN OUT VARIABLE_POINTER_TRACK  *PtrTrack,
+  IN     BOOLEAN                 AuthFormat
+  );
+
+/**
+  Empty the index of a variable store whose variables have been moved, such
+  as by a reclaim. The index is rebuilt at the next lookup, in the memory it
+  already has, so this may be called at runtime.
+
+  @param[in]  Type                     The type of the variable store.
+
+**/
+VOID
+VariableIndexReset (
+  IN VARIABLE_STORE_TYPE  Type
+  );
+
+#endif
@@ -10,8 +10,8 @@ SPDX-License-Identifier: BSD-2-Clause-Patent
 #ifndef _VARIABLE_PARSING_H_
 #define _VARIABLE_PARSING_H_
 
-#include <Guid/ImageAuthentication.h>
 #include "Variable.h"
+#include <Guid/ImageAuthentication.h>
 
 /**
 
@@ -181,6 +181,21 @@ RiscVSetSupervisorAddressTranslationRegister (
   IN UINT64
   );
 
+UINT64
+RiscVGetSupervisorAddressTranslationRegister (
+  VOID
+  );
+
+VOID
+RiscVLocalTlbFlushAll (
+  VOID
+  );
+
+VOID
+RiscVLocalTlbFlush (
+  IN UINTN  VirtAddr
+  );
+
 UINT64
 RiscVReadTimer (
   VOID
@@ -553,6 +553,70 @@ InternalAsciiHexCharToUintn (
   IN      CHAR8  Char
   );
 
+//
+// Reflected polynomials of CRC32 and CRC32C, and the quotients of x^96 by
+// them used by the carry-less multiply kernel.
+//
+#define CRC32_REFLECTED_POLYNOMIAL   0xEDB88320
+#define CRC32_REFLECTED_QUOTIENT     0x5A72D812FB808B20ULL
+#define CRC32C_REFLECTED_POLYNOMIAL  0x82F63B78
+#define CRC32C_REFLECTED_QUOTIENT    0xA434F61C6F5389F8ULL
+
+extern CONST UINT32  mCrcTable[256];
+extern CONST UINT32  mCrc32cLookupTable[256];
+extern CONST UINT32  mCrc32SliceTable[7][256];
+extern CONST UINT32  mCrc32cSliceTable[7][256];
+
+/**
+  Updates a reflected 32-bit CRC with the contents of a buffer, eight bytes
+  per step.
+
+  @param[in]  Crc         The current value of the CRC.
+  @param[in]  Buffer      A pointer to the data.
+  @param[in]  Length      The number of bytes in Buffer.
+  @param[in]  ByteTable   The byte table of the polynomial.
+  @param[in]  SliceTable  Rows 1 to 7 of the slice-by-8 table of the
+                          polynomial.
+
+  @return The updated CRC.
+
+**/
+UINT32
+InternalCrc32SliceBy8 (
+  IN UINT32        Crc,
+  IN CONST UINT8   *Buffer,
+  IN UINTN         Length,
+  IN CONST UINT32  *ByteTable,
+  IN CONST UINT32  (*SliceTable)[256]
+  );
+
+/**
+  Updates a reflected 32-bit CRC with the contents of a buffer, one 64-bit
+  word per step, using the carry-less multiply instructions of the RISC-V
+  Zbc extension.
+
+  @param[in]  Crc         The current value of the CRC.
+  @param[in]  Buffer      A pointer to the data.
+  @param[in]  Length      The number of bytes in Buffer.
+  @param[in]  Polynomial  The polynomial in the reflected bit order, without
+                          its x^32 term.
+  @param[in]  Quotient    The quotient of x^96 by the polynomial in the
+                          reflected bit order, without its x^64 term.
+  @param[in]  ByteTable   The byte table of the polynomial.
+
+  @return The updated CRC.
+
+**/
+UINT32
+InternalCrc32Zbc (
+  IN UINT32        Crc,
+  IN CONST UINT8   *Buffer,
+  IN UINTN         Length,
+  IN UINT32        Polynomial,
+  IN UINT64        Quotient,
+  IN CONST UINT32  *ByteTable
+  );
+
 //
 // Ia32 and x64 specific functions
 //
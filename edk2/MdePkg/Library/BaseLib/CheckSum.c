@@ -602,9 +602,7 @@ CalculateCrc32 (
   IN  UINTN  Length
   )
 {
-  UINTN   Index;
   UINT32  Crc;
-  UINT8   *Ptr;
 
   ASSERT (Buffer != NULL);
   ASSERT (Length <= (MAX_ADDRESS - ((UINTN)Buffer) + 1));
@@ -612,10 +610,18 @@ CalculateCrc32 (
   //
   // Compute CRC
   //
-  Crc = 0xffffffff;
-  for (Index = 0, Ptr = Buffer; Index < Length; Index++, Ptr++) {
-    Crc = (Crc >> 8) ^ mCrcTable[(UINT8)Crc ^ *Ptr];
-  }
+ #ifdef MDEPKG_BASELIB_RISCV_ZBC
+  Crc = InternalCrc32Zbc (
+          0xffffffff,
+          Buffer,
+          Length,
+          CRC32_REFLECTED_POLYNOMIAL,
+          CRC32_REFLECTED_QUOTIENT,
+          mCrcTable
+          );
+ #else
+  Crc = InternalCrc32SliceBy8 (0xffffffff, Buffer, Length, mCrcTable, mCrc32SliceTable);
+ #endif
 
   return Crc ^ 0xffffffff;
 }
@@ -687,7 +693,7 @@ CalculateCrc16Ansi (
   return ~Crc;
 }
 
-GLOBAL_REMOVE_IF_UNREFERENCED STATIC CONST UINT32  mCrc32cLookupTable[256] = {
+GLOBAL_REMOVE_IF_UNREFERENCED CONST UINT32  mCrc32cLookupTable[256] = {
   0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c,
   0x26a1e7e8, 0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
   0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c,
@@ -750,15 +756,20 @@ CalculateCrc32c (
   IN UINT32      InitialValue
   )
 {
-  CONST UINT8  *Buf;
-  UINT32       Crc;
-
-  Buf = Buffer;
-  Crc = ~InitialValue;
+  UINT32  Crc;
 
-  while (Length-- != 0) {
-    Crc = mCrc32cLookupTable[(Crc & 0xFF) ^ *(Buf++)] ^ (Crc >> 8);
-  }
+ #ifdef MDEPKG_BASELIB_RISCV_ZBC
+  Crc = InternalCrc32Zbc (
+          ~InitialValue,
+          Buffer,
+          Length,
+          CRC32C_REFLECTED_POLYNOMIAL,
+          CRC32C_REFLECTED_QUOTIENT,
+          mCrc32cLookupTable
+          );
+ #else
+  Crc = InternalCrc32SliceBy8 (~InitialValue, Buffer, Length, mCrc32cLookupTable, mCrc32cSliceTable);
+ #endif
 
   return ~Crc;
 }
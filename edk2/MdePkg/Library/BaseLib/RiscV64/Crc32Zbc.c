@@ -0,0 +1,160 @@
+/** @file
+  Carry-less multiply kernel of the CRC32 and CRC32C calculations for RISC-V
+  cores that implement the Zbc extension.
+
+  Each 64-bit word S of the message, with the CRC folded into its low half,
+  is reduced to a 32-bit remainder by Barrett reduction:
+
+    CRC = clmul (clmulh (S, QT) + S, P)
+
+  where P is the polynomial and QT is the quotient of x^96 / P without its
+  x^64 term, both in the reflected bit order. In that order the high half
+  of a product is reached with clmul and a shift, and the low 32 bits of the
+  final product sit at the top of a clmulr result.
+
+  Off RISC-V the instructions are emulated so the host based unit tests can
+  check the reduction against the table kernels.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include "BaseLibInternals.h"
+
+#if defined (MDE_CPU_RISCV64)
+
+//
+// The instructions are encoded with .insn so the kernel assembles with
+// toolchains and -march settings that do not know about Zbc.
+//
+STATIC
+inline
+UINT64
+ClMul (
+  IN UINT64  A,
+  IN UINT64  B
+  )
+{
+  UINT64  Result;
+
+  __asm__ (".insn r 0x33, 1, 5, %0, %1, %2" : "=r" (Result) : "r" (A), "r" (B));
+  return Result;
+}
+
+STATIC
+inline
+UINT64
+ClMulR (
+  IN UINT64  A,
+  IN UINT64  B
+  )
+{
+  UINT64  Result;
+
+  __asm__ (".insn r 0x33, 2, 5, %0, %1, %2" : "=r" (Result) : "r" (A), "r" (B));
+  return Result;
+}
+
+#else
+
+/**
+  Returns the low 64 bits of the carry-less product of A and B.
+**/
+STATIC
+UINT64
+ClMul (
+  IN UINT64  A,
+  IN UINT64  B
+  )
+{
+  UINT64  Result;
+  UINTN   Bit;
+
+  Result = 0;
+  for (Bit = 0; Bit < 64; Bit++) {
+    if (((B >> Bit) & 1) != 0) {
+      Result ^= A << Bit;
+    }
+  }
+
+  return Result;
+}
+
+/**
+  Returns bits 126 to 63 of the carry-less product of A and B.
+**/
+STATIC
+UINT64
+ClMulR (
+  IN UINT64  A,
+  IN UINT64  B
+  )
+{
+  UINT64  Result;
+  UINTN   Bit;
+
+  Result = 0;
+  for (Bit = 0; Bit < 64; Bit++) {
+    if (((B >> Bit) & 1) != 0) {
+      Result ^= A >> (63 - Bit);
+    }
+  }
+
+  return Result;
+}
+
+#endif
+
+/**
+  Updates a reflected 32-bit CRC with the contents of a buffer, one 64-bit
+  word per step, using carry-less multiplication.
+
+  The bytes up to the first 64-bit boundary and the bytes after the last
+  full word are folded one at a time through ByteTable. The CRC is neither
+  inverted on entry nor on exit.
+
+  @param[in]  Crc         The current value of the CRC.
+  @param[in]  Buffer      A pointer to the data.
+  @param[in]  Length      The number of bytes in Buffer.
+  @param[in]  Polynomial  The polynomial in the reflected bit order, without
+                          its x^32 term.
+  @param[in]  Quotient    The quotient of x^96 by the polynomial in the
+                          reflected bit order, without its x^64 term.
+  @param[in]  ByteTable   The byte table of the polynomial.
+
+  @return The updated CRC.
+
+**/
+UINT32
+InternalCrc32Zbc (
+  IN UINT32        Crc,
+  IN CONST UINT8   *Buffer,
+  IN UINTN         Length,
+  IN UINT32        Polynomial,
+  IN UINT64        Quotient,
+  IN CONST UINT32  *ByteTable
+  )
+{
+  UINT64  Word;
+  UINT64  Product;
+
+  while ((Length != 0) && (((UINTN)Buffer & (sizeof (UINT64) - 1)) != 0)) {
+    Crc = (Crc >> 8) ^ ByteTable[(UINT8)Crc ^ *Buffer];
+    Buffer++;
+    Length--;
+  }
+
+  for ( ; Length >= sizeof (UINT64); Length -= sizeof (UINT64), Buffer += sizeof (UINT64)) {
+    Word    = *(CONST UINT64 *)Buffer ^ Crc;
+    Product = (ClMul (Word, Quotient) << 1) ^ Word;
+    Crc     = (UINT32)(ClMulR (Product, (UINT64)Polynomial << 32) >> 32);
+  }
+
+  while (Length != 0) {
+    Crc = (Crc >> 8) ^ ByteTable[(UINT8)Crc ^ *Buffer];
+    Buffer++;
+    Length--;
+  }
+
+  return Crc;
+}
@@ -0,0 +1,99 @@
+/** @file
+  CompareMem() kernel for RISC-V.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "MemLibRiscV64.h"
+
+/**
+  Compares two memory buffers of a given length.
+
+  @param  DestinationBuffer The first memory buffer
+  @param  SourceBuffer      The second memory buffer
+  @param  Length            The length of DestinationBuffer and SourceBuffer memory
+                            regions to compare. Must be non-zero.
+
+  @return 0                 All Length bytes of the two buffers are identical.
+  @retval Non-zero          The first mismatched byte in SourceBuffer subtracted from the first
+                            mismatched byte in DestinationBuffer.
+
+**/
+INTN
+EFIAPI
+InternalMemCompareMem (
+  IN      CONST VOID  *DestinationBuffer,
+  IN      CONST VOID  *SourceBuffer,
+  IN      UINTN       Length
+  )
+{
+  CONST UINT8  *Destination;
+  CONST UINT8  *Source;
+  CONST UINTN  *DestinationWord;
+  CONST UINTN  *SourceWord;
+  UINTN        Words;
+  UINTN        Shift;
+  UINTN        Previous;
+  UINTN        Next;
+  UINTN        Compared;
+
+  Destination = (CONST UINT8 *)DestinationBuffer;
+  Source      = (CONST UINT8 *)SourceBuffer;
+
+  if (Length >= MEM_WORD_THRESHOLD) {
+    while (((UINTN)Destination & MEM_WORD_MASK) != 0) {
+      if (*Destination != *Source) {
+        return (INTN)*Destination - (INTN)*Source;
+      }
+
+      Destination++;
+      Source++;
+      Length--;
+    }
+
+    //
+    // Skip the equal words. The bytes of the first word that differs are
+    // compared one at a time below.
+    //
+    DestinationWord = (CONST UINTN *)Destination;
+    Words           = Length / MEM_WORD_SIZE;
+    Shift           = ((UINTN)Source & MEM_WORD_MASK) * 8;
+    if (Shift == 0) {
+      SourceWord = (CONST UINTN *)Source;
+      while ((Words != 0) && (*DestinationWord == *SourceWord)) {
+        DestinationWord++;
+        SourceWord++;
+        Words--;
+      }
+    } else {
+      SourceWord = (CONST UINTN *)((UINTN)Source & ~MEM_WORD_MASK);
+      Previous   = *SourceWord++;
+      while (Words != 0) {
+        Next = *SourceWord;
+        if (*DestinationWord != ((Previous >> Shift) | (Next << (MEM_WORD_BITS - Shift)))) {
+          break;
+        }
+
+        Previous = Next;
+        DestinationWord++;
+        SourceWord++;
+        Words--;
+      }
+    }
+
+    Compared     = (CONST UINT8 *)DestinationWord - Destination;
+    Destination += Compared;
+    Source      += Compared;
+    Length      -= Compared;
+  }
+
+  for ( ; Length != 0; Length--, Destination++, Source++) {
+    if (*Destination != *Source) {
+      return (INTN)*Destination - (INTN)*Source;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,204 @@
+/** @file
+  CopyMem() kernel for RISC-V.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "MemLibRiscV64.h"
+
+/**
+  Copy Length bytes from Source to Destination, front to back.
+
+  @param  Destination       The target of the copy request.
+  @param  Source            The place to copy from.
+  @param  Length            The number of bytes to copy.
+
+**/
+STATIC
+VOID
+InternalMemCopyForward (
+  OUT     UINT8        *Destination,
+  IN      CONST UINT8  *Source,
+  IN      UINTN        Length
+  )
+{
+  UINTN        *DestinationWord;
+  CONST UINTN  *SourceWord;
+  UINTN        Words;
+  UINTN        Shift;
+  UINTN        Previous;
+  UINTN        Next;
+
+  if (Length >= MEM_WORD_THRESHOLD) {
+    while (((UINTN)Destination & MEM_WORD_MASK) != 0) {
+      *Destination++ = *Source++;
+      Length--;
+    }
+
+    DestinationWord = (UINTN *)Destination;
+    Words           = Length / MEM_WORD_SIZE;
+    Shift           = ((UINTN)Source & MEM_WORD_MASK) * 8;
+    if (Shift == 0) {
+      SourceWord = (CONST UINTN *)Source;
+      for ( ; Words >= 4; Words -= 4) {
+        DestinationWord[0] = SourceWord[0];
+        DestinationWord[1] = SourceWord[1];
+        DestinationWord[2] = SourceWord[2];
+        DestinationWord[3] = SourceWord[3];
+        DestinationWord   += 4;
+        SourceWord        += 4;
+      }
+
+      while (Words-- != 0) {
+        *DestinationWord++ = *SourceWord++;
+      }
+    } else {
+      //
+      // Each destination word takes the upper bytes of one aligned source
+      // word and the lower bytes of the next
+      //
+      SourceWord = (CONST UINTN *)((UINTN)Source & ~MEM_WORD_MASK);
+      Previous   = *SourceWord++;
+      for ( ; Words >= 2; Words -= 2) {
+        Next               = SourceWord[0];
+        DestinationWord[0] = (Previous >> Shift) | (Next << (MEM_WORD_BITS - Shift));
+        Previous           = SourceWord[1];
+        DestinationWord[1] = (Next >> Shift) | (Previous << (MEM_WORD_BITS - Shift));
+        DestinationWord   += 2;
+        SourceWord        += 2;
+      }
+
+      if (Words != 0) {
+        Next               = *SourceWord;
+        *DestinationWord++ = (Previous >> Shift) | (Next << (MEM_WORD_BITS - Shift));
+      }
+    }
+
+    Source     += (UINT8 *)DestinationWord - Destination;
+    Destination = (UINT8 *)DestinationWord;
+    Length     &= MEM_WORD_MASK;
+  }
+
+  while (Length-- != 0) {
+    *Destination++ = *Source++;
+  }
+}
+
+/**
+  Copy Length bytes from Source to Destination, back to front.
+
+  @param  Destination       The target of the copy request.
+  @param  Source            The place to copy from.
+  @param  Length            The number of bytes to copy.
+
+**/
+STATIC
+VOID
+InternalMemCopyBackward (
+  OUT     UINT8        *Destination,
+  IN      CONST UINT8  *Source,
+  IN      UINTN        Length
+  )
+{
+  UINTN        *DestinationWord;
+  CONST UINTN  *SourceWord;
+  UINTN        Words;
+  UINTN        Shift;
+  UINTN        Previous;
+  UINTN        Next;
+
+  Destination += Length;
+  Source      += Length;
+
+  if (Length >= MEM_WORD_THRESHOLD) {
+    while (((UINTN)Destination & MEM_WORD_MASK) != 0) {
+      *--Destination = *--Source;
+      Length--;
+    }
+
+    DestinationWord = (UINTN *)Destination;
+    Words           = Length / MEM_WORD_SIZE;
+    Shift           = ((UINTN)Source & MEM_WORD_MASK) * 8;
+    if (Shift == 0) {
+      SourceWord = (CONST UINTN *)Source;
+      for ( ; Words >= 4; Words -= 4) {
+        DestinationWord   -= 4;
+        SourceWord        -= 4;
+        DestinationWord[3] = SourceWord[3];
+        DestinationWord[2] = SourceWord[2];
+        DestinationWord[1] = SourceWord[1];
+        DestinationWord[0] = SourceWord[0];
+      }
+
+      while (Words-- != 0) {
+        *--DestinationWord = *--SourceWord;
+      }
+    } else {
+      SourceWord = (CONST UINTN *)((UINTN)Source & ~MEM_WORD_MASK);
+      Previous   = *SourceWord;
+      for ( ; Words >= 2; Words -= 2) {
+        DestinationWord    -= 2;
+        SourceWord         -= 2;
+        Next                = SourceWord[1];
+        DestinationWord[1]  = (Next >> Shift) | (Previous << (MEM_WORD_BITS - Shift));
+        Previous            = SourceWord[0];
+        DestinationWord[0]  = (Previous >> Shift) | (Next << (MEM_WORD_BITS - Shift));
+      }
+
+      if (Words != 0) {
+        Next               = *--SourceWord;
+        *--DestinationWord = (Next >> Shift) | (Previous << (MEM_WORD_BITS - Shift));
+      }
+    }
+
+    Source     -= Destination - (UINT8 *)DestinationWord;
+    Destination = (UINT8 *)DestinationWord;
+    Length     &= MEM_WORD_MASK;
+  }
+
+  while (Length-- != 0) {
+    *--Destination = *--Source;
+  }
+}
+
+/**
+  Copy Length bytes from Source to Destination.
+
+  @param  DestinationBuffer The target of the copy request.
+  @param  SourceBuffer      The place to copy from.
+  @param  Length            The number of bytes to copy.
+
+  @return Destination.
+
+**/
+VOID *
+EFIAPI
+InternalMemCopyMem (
+  OUT     VOID        *DestinationBuffer,
+  IN      CONST VOID  *SourceBuffer,
+  IN      UINTN       Length
+  )
+{
+  //
+  // Copy back to front only if the start of the destination overlaps the
+  // end of the source
+  //
+  if (((UINTN)DestinationBuffer > (UINTN)SourceBuffer) &&
+      ((UINTN)DestinationBuffer - (UINTN)SourceBuffer < Length))
+  {
+    InternalMemCopyBackward (DestinationBuffer, SourceBuffer, Length);
+    return DestinationBuffer;
+  }
+
+ #ifdef MDEPKG_MEMLIB_XTHEADVECTOR
+  if (Length >= MEM_VECTOR_THRESHOLD) {
+    return InternalMemCopyMemVector (DestinationBuffer, SourceBuffer, Length);
+  }
+
+ #endif
+
+  InternalMemCopyForward (DestinationBuffer, SourceBuffer, Length);
+  return DestinationBuffer;
+}
@@ -0,0 +1,100 @@
+/** @file
+  Internal definitions of the RISC-V kernels of the Base Memory Library.
+
+  The kernels move whole words once the destination is word aligned. A source
+  that is not aligned the same way is read in aligned words that are shifted
+  into place, as misaligned accesses may trap to the SBI firmware and be
+  emulated one byte at a time.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef MEM_LIB_RISCV64_H_
+#define MEM_LIB_RISCV64_H_
+
+#include "../MemLibInternals.h"
+
+#define MEM_WORD_SIZE   sizeof (UINTN)
+#define MEM_WORD_MASK   (MEM_WORD_SIZE - 1)
+#define MEM_WORD_BITS   (MEM_WORD_SIZE * 8)
+
+//
+// A word with each byte set to 0x01, and one with each byte set to 0x80
+//
+#define MEM_WORD_ONES   ((UINTN)0x0101010101010101ULL)
+#define MEM_WORD_HIGHS  ((UINTN)0x8080808080808080ULL)
+
+//
+// Buffers shorter than this are handled one byte at a time
+//
+#define MEM_WORD_THRESHOLD  (2 * MEM_WORD_SIZE)
+
+#ifdef MDEPKG_MEMLIB_XTHEADVECTOR
+
+//
+// Buffers from this size up are handled by the XTheadVector kernels, which
+// cost a few CSR accesses to set up. They clobber the caller-saved vector
+// registers only, and put sstatus back as they found it.
+//
+#define MEM_VECTOR_THRESHOLD  256
+
+/**
+  Copy Length bytes from Source to Destination with XTheadVector, front to
+  back.
+
+  @param  DestinationBuffer The target of the copy request.
+  @param  SourceBuffer      The place to copy from.
+  @param  Length            The number of bytes to copy.
+
+  @return Destination.
+
+**/
+VOID *
+EFIAPI
+InternalMemCopyMemVector (
+  OUT     VOID        *DestinationBuffer,
+  IN      CONST VOID  *SourceBuffer,
+  IN      UINTN       Length
+  );
+
+/**
+  Set Buffer to Value for Length bytes with XTheadVector.
+
+  @param  Buffer   The memory to set.
+  @param  Length   The number of bytes to set.
+  @param  Value    The value of the set operation.
+
+  @return Buffer
+
+**/
+VOID *
+EFIAPI
+InternalMemSetMemVector (
+  OUT     VOID   *Buffer,
+  IN      UINTN  Length,
+  IN      UINT8  Value
+  );
+
+#endif
+
+/**
+  Set Length bytes of Buffer to a repeating pattern. Pattern holds the bytes
+  the pattern has at word aligned addresses.
+
+  @param  Buffer   The memory to set.
+  @param  Length   The number of bytes to set.
+  @param  Pattern  The pattern.
+
+  @return Buffer
+
+**/
+VOID *
+InternalMemSetPattern (
+  OUT     VOID   *Buffer,
+  IN      UINTN  Length,
+  IN      UINTN  Pattern
+  );
+
+#endif
@@ -0,0 +1,284 @@
+/** @file
+  ScanMem() and IsZeroBuffer() kernels for RISC-V.
+
+  The aligned part of a buffer is searched a word at a time: an element of
+  the word equals Value if the same element of the word XOR Value is zero,
+  which the borrow of a subtraction exposes in the top bit of the element.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "MemLibRiscV64.h"
+
+/**
+  Skip the words of a buffer that do not hold the element of a pattern.
+
+  @param  Word     The word aligned buffer to scan.
+  @param  Words    The number of words to scan.
+  @param  Pattern  The element to search for, repeated across a word.
+  @param  Ones     A word with the lowest bit of each element set.
+  @param  Highs    A word with the highest bit of each element set.
+
+  @return The first word that holds the element, or the end of the buffer.
+
+**/
+STATIC
+CONST UINTN *
+InternalMemScanWords (
+  IN      CONST UINTN  *Word,
+  IN      UINTN        Words,
+  IN      UINTN        Pattern,
+  IN      UINTN        Ones,
+  IN      UINTN        Highs
+  )
+{
+  UINTN  Match;
+
+  for ( ; Words != 0; Words--, Word++) {
+    Match = *Word ^ Pattern;
+    if (((Match - Ones) & ~Match & Highs) != 0) {
+      break;
+    }
+  }
+
+  return Word;
+}
+
+/**
+  Scans a target buffer for an 8-bit value, and returns a pointer to the
+  matching 8-bit value in the target buffer.
+
+  @param  Buffer  The pointer to the target buffer to scan.
+  @param  Length  The count of 8-bit value to scan. Must be non-zero.
+  @param  Value   The value to search for in the target buffer.
+
+  @return The pointer to the first occurrence, or NULL if not found.
+
+**/
+CONST VOID *
+EFIAPI
+InternalMemScanMem8 (
+  IN      CONST VOID  *Buffer,
+  IN      UINTN       Length,
+  IN      UINT8       Value
+  )
+{
+  CONST UINT8  *Pointer;
+  CONST UINTN  *Word;
+
+  Pointer = (CONST UINT8 *)Buffer;
+  if (Length >= MEM_WORD_THRESHOLD) {
+    for ( ; ((UINTN)Pointer & MEM_WORD_MASK) != 0; Pointer++, Length--) {
+      if (*Pointer == Value) {
+        return Pointer;
+      }
+    }
+
+    Word = InternalMemScanWords (
+             (CONST UINTN *)Pointer,
+             Length / MEM_WORD_SIZE,
+             MEM_WORD_ONES * Value,
+             MEM_WORD_ONES,
+             MEM_WORD_HIGHS
+             );
+    Length -= (CONST UINT8 *)Word - Pointer;
+    Pointer = (CONST UINT8 *)Word;
+  }
+
+  for ( ; Length != 0; Length--, Pointer++) {
+    if (*Pointer == Value) {
+      return Pointer;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Scans a target buffer for a 16-bit value, and returns a pointer to the
+  matching 16-bit value in the target buffer.
+
+  @param  Buffer  The pointer to the target buffer to scan.
+  @param  Length  The count of 16-bit value to scan. Must be non-zero.
+  @param  Value   The value to search for in the target buffer.
+
+  @return The pointer to the first occurrence, or NULL if not found.
+
+**/
+CONST VOID *
+EFIAPI
+InternalMemScanMem16 (
+  IN      CONST VOID  *Buffer,
+  IN      UINTN       Length,
+  IN      UINT16      Value
+  )
+{
+  CONST UINT16  *Pointer;
+  CONST UINTN   *Word;
+
+  Pointer = (CONST UINT16 *)Buffer;
+  if (Length * sizeof (UINT16) >= MEM_WORD_THRESHOLD) {
+    for ( ; ((UINTN)Pointer & MEM_WORD_MASK) != 0; Pointer++, Length--) {
+      if (*Pointer == Value) {
+        return Pointer;
+      }
+    }
+
+    Word = InternalMemScanWords (
+             (CONST UINTN *)Pointer,
+             Length * sizeof (UINT16) / MEM_WORD_SIZE,
+             (UINTN)0x0001000100010001ULL * Value,
+             (UINTN)0x0001000100010001ULL,
+             (UINTN)0x8000800080008000ULL
+             );
+    Length -= (CONST UINT16 *)Word - Pointer;
+    Pointer = (CONST UINT16 *)Word;
+  }
+
+  for ( ; Length != 0; Length--, Pointer++) {
+    if (*Pointer == Value) {
+      return Pointer;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Scans a target buffer for a 32-bit value, and returns a pointer to the
+  matching 32-bit value in the target buffer.
+
+  @param  Buffer  The pointer to the target buffer to scan.
+  @param  Length  The count of 32-bit value to scan. Must be non-zero.
+  @param  Value   The value to search for in the target buffer.
+
+  @return The pointer to the first occurrence, or NULL if not found.
+
+**/
+CONST VOID *
+EFIAPI
+InternalMemScanMem32 (
+  IN      CONST VOID  *Buffer,
+  IN      UINTN       Length,
+  IN      UINT32      Value
+  )
+{
+  CONST UINT32  *Pointer;
+  CONST UINTN   *Word;
+
+  Pointer = (CONST UINT32 *)Buffer;
+  if (Length * sizeof (UINT32) >= MEM_WORD_THRESHOLD) {
+    for ( ; ((UINTN)Pointer & MEM_WORD_MASK) != 0; Pointer++, Length--) {
+      if (*Pointer == Value) {
+        return Pointer;
+      }
+    }
+
+    Word = InternalMemScanWords (
+             (CONST UINTN *)Pointer,
+             Length * sizeof (UINT32) / MEM_WORD_SIZE,
+             (UINTN)0x0000000100000001ULL * Value,
+             (UINTN)0x0000000100000001ULL,
+             (UINTN)0x8000000080000000ULL
+             );
+    Length -= (CONST UINT32 *)Word - Pointer;
+    Pointer = (CONST UINT32 *)Word;
+  }
+
+  for ( ; Length != 0; Length--, Pointer++) {
+    if (*Pointer == Value) {
+      return Pointer;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Scans a target buffer for a 64-bit value, and returns a pointer to the
+  matching 64-bit value in the target buffer.
+
+  @param  Buffer  The pointer to the target buffer to scan.
+  @param  Length  The count of 64-bit value to scan. Must be non-zero.
+  @param  Value   The value to search for in the target buffer.
+
+  @return The pointer to the first occurrence, or NULL if not found.
+
+**/
+CONST VOID *
+EFIAPI
+InternalMemScanMem64 (
+  IN      CONST VOID  *Buffer,
+  IN      UINTN       Length,
+  IN      UINT64      Value
+  )
+{
+  CONST UINT64  *Pointer;
+
+  Pointer = (CONST UINT64 *)Buffer;
+  for ( ; Length != 0; Length--, Pointer++) {
+    if (*Pointer == Value) {
+      return Pointer;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Checks whether the contents of a buffer are all zeros.
+
+  @param  Buffer  The pointer to the buffer to be checked.
+  @param  Length  The size of the buffer (in bytes) to be checked.
+
+  @retval TRUE    Contents of the buffer are all zeros.
+  @retval FALSE   Contents of the buffer are not all zeros.
+
+**/
+BOOLEAN
+EFIAPI
+InternalMemIsZeroBuffer (
+  IN CONST VOID  *Buffer,
+  IN UINTN       Length
+  )
+{
+  CONST UINT8  *Pointer;
+  CONST UINTN  *Word;
+  UINTN        Words;
+
+  Pointer = (CONST UINT8 *)Buffer;
+  if (Length >= MEM_WORD_THRESHOLD) {
+    for ( ; ((UINTN)Pointer & MEM_WORD_MASK) != 0; Pointer++, Length--) {
+      if (*Pointer != 0) {
+        return FALSE;
+      }
+    }
+
+    Word  = (CONST UINTN *)Pointer;
+    Words = Length / MEM_WORD_SIZE;
+    for ( ; Words >= 4; Words -= 4, Word += 4) {
+      if ((Word[0] | Word[1] | Word[2] | Word[3]) != 0) {
+        return FALSE;
+      }
+    }
+
+    for ( ; Words != 0; Words--, Word++) {
+      if (*Word != 0) {
+        return FALSE;
+      }
+    }
+
+    Pointer = (CONST UINT8 *)Word;
+    Length &= MEM_WORD_MASK;
+  }
+
+  for ( ; Length != 0; Length--, Pointer++) {
+    if (*Pointer != 0) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
@@ -0,0 +1,189 @@
+/** @file
+  SetMem() and ZeroMem() kernels for RISC-V.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include "MemLibRiscV64.h"
+
+/**
+  Set Length bytes of Buffer to a repeating pattern. Pattern holds the bytes
+  the pattern has at word aligned addresses.
+
+  @param  Buffer   The memory to set.
+  @param  Length   The number of bytes to set.
+  @param  Pattern  The pattern.
+
+  @return Buffer
+
+**/
+VOID *
+InternalMemSetPattern (
+  OUT     VOID   *Buffer,
+  IN      UINTN  Length,
+  IN      UINTN  Pattern
+  )
+{
+  UINT8  *Pointer;
+  UINTN  *Word;
+  UINTN  Words;
+
+  Pointer = (UINT8 *)Buffer;
+  if (Length >= MEM_WORD_THRESHOLD) {
+    while (((UINTN)Pointer & MEM_WORD_MASK) != 0) {
+      *Pointer = (UINT8)(Pattern >> (((UINTN)Pointer & MEM_WORD_MASK) * 8));
+      Pointer++;
+      Length--;
+    }
+
+    Word  = (UINTN *)Pointer;
+    Words = Length / MEM_WORD_SIZE;
+    for ( ; Words >= 4; Words -= 4) {
+      Word[0] = Pattern;
+      Word[1] = Pattern;
+      Word[2] = Pattern;
+      Word[3] = Pattern;
+      Word   += 4;
+    }
+
+    while (Words-- != 0) {
+      *Word++ = Pattern;
+    }
+
+    Pointer = (UINT8 *)Word;
+    Length &= MEM_WORD_MASK;
+  }
+
+  for ( ; Length != 0; Length--, Pointer++) {
+    *Pointer = (UINT8)(Pattern >> (((UINTN)Pointer & MEM_WORD_MASK) * 8));
+  }
+
+  return Buffer;
+}
+
+/**
+  Set Buffer to Value for Size bytes.
+
+  @param  Buffer   The memory to set.
+  @param  Length   The number of bytes to set.
+  @param  Value    The value of the set operation.
+
+  @return Buffer
+
+**/
+VOID *
+EFIAPI
+InternalMemSetMem (
+  OUT     VOID   *Buffer,
+  IN      UINTN  Length,
+  IN      UINT8  Value
+  )
+{
+ #ifdef MDEPKG_MEMLIB_XTHEADVECTOR
+  if (Length >= MEM_VECTOR_THRESHOLD) {
+    return InternalMemSetMemVector (Buffer, Length, Value);
+  }
+
+ #endif
+
+  return InternalMemSetPattern (Buffer, Length, MEM_WORD_ONES * Value);
+}
+
+/**
+  Fills a target buffer with a 16-bit value, and returns the target buffer.
+
+  @param  Buffer  The pointer to the target buffer to fill.
+  @param  Length  The count of 16-bit value to fill.
+  @param  Value   The value with which to fill Length bytes of Buffer.
+
+  @return Buffer
+
+**/
+VOID *
+EFIAPI
+InternalMemSetMem16 (
+  OUT     VOID    *Buffer,
+  IN      UINTN   Length,
+  IN      UINT16  Value
+  )
+{
+  return InternalMemSetPattern (Buffer, Length * sizeof (UINT16), (UINTN)0x0001000100010001ULL * Value);
+}
+
+/**
+  Fills a target buffer with a 32-bit value, and returns the target buffer.
+
+  @param  Buffer  The pointer to the target buffer to fill.
+  @param  Length  The count of 32-bit value to fill.
+  @param  Value   The value with which to fill Length bytes of Buffer.
+
+  @return Buffer
+
+**/
+VOID *
+EFIAPI
+InternalMemSetMem32 (
+  OUT     VOID    *Buffer,
+  IN      UINTN   Length,
+  IN      UINT32  Value
+  )
+{
+  return InternalMemSetPattern (Buffer, Length * sizeof (UINT32), (UINTN)0x0000000100000001ULL * Value);
+}
+
+/**
+  Fills a target buffer with a 64-bit value, and returns the target buffer.
+
+  @param  Buffer  The pointer to the target buffer to fill.
+  @param  Length  The count of 64-bit value to fill.
+  @param  Value   The value with which to fill Length bytes of Buffer.
+
+  @return Buffer
+
+**/
+VOID *
+EFIAPI
+InternalMemSetMem64 (
+  OUT     VOID    *Buffer,
+  IN      UINTN   Length,
+  IN      UINT64  Value
+  )
+{
+  UINT64  *Pointer;
+
+  Pointer = (UINT64 *)Buffer;
+  for ( ; Length >= 4; Length -= 4) {
+    Pointer[0] = Value;
+    Pointer[1] = Value;
+    Pointer[2] = Value;
+    Pointer[3] = Value;
+    Pointer   += 4;
+  }
+
+  while (Length-- != 0) {
+    *Pointer++ = Value;
+  }
+
+  return Buffer;
+}
+
+/**
+  Set Buffer to 0 for Size bytes.
+
+  @param  Buffer The memory to set.
+  @param  Length The number of bytes to set
+
+  @return Buffer
+
+**/
+VOID *
+EFIAPI
+InternalMemZeroMem (
+  OUT     VOID   *Buffer,
+  IN      UINTN  Length
+  )
+{
+  return InternalMemSetMem (Buffer, Length, 0);
+}
@@ -0,0 +1,224 @@
+/** @file
+  Host based tests of the CRC32 and CRC32C kernels of BaseLib.
+
+  The slice-by-8 and carry-less multiply kernels are checked against the
+  byte at a time table lookup they replace, over a range of lengths and
+  buffer alignments, and the tables are checked against a bitwise
+  calculation. The carry-less multiply instructions are emulated on the
+  host. A benchmark reports the throughput of CalculateCrc32 () next to
+  the byte loop.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+extern "C" {
+  #include "BaseLibInternals.h"
+}
+
+#define MAX_OFFSET  8
+
+//
+// Lengths up to a few steps in full, then some long and odd ones
+//
+static const UINTN  mLengths[] = {
+  0,   1,   2,   3,   4,   5,   7,   8,   9,   11,  12,  15,  16,  17,  23,  24,
+  25,  31,  32,  33,  63,  64,  65,  127, 128, 129, 255, 256, 257, 1000, 4095, 4096,
+  4097
+};
+
+class BaseLibCrc32Test : public ::testing::Test {
+protected:
+  std::vector<UINT8>  Buffer;
+
+  void
+  SetUp (
+    ) override
+  {
+    UINT32  Seed;
+
+    Buffer.resize (65536 + MAX_OFFSET);
+    Seed = 0x7654321;
+    for (UINT8 &Byte : Buffer) {
+      Seed = Seed * 1103515245 + 12345;
+      Byte = (UINT8)(Seed >> 16);
+    }
+  }
+};
+
+/**
+  Updates a reflected CRC one bit at a time.
+**/
+static
+UINT32
+BitwiseCrc (
+  UINT32       Crc,
+  const UINT8  *Data,
+  UINTN        Length,
+  UINT32       Polynomial
+  )
+{
+  while (Length-- != 0) {
+    Crc ^= *Data++;
+    for (UINTN Bit = 0; Bit < 8; Bit++) {
+      Crc = (Crc >> 1) ^ (((Crc & 1) != 0) ? Polynomial : 0);
+    }
+  }
+
+  return Crc;
+}
+
+/**
+  Updates a reflected CRC one byte at a time, as BaseLib used to.
+**/
+static
+UINT32
+ByteLoopCrc (
+  UINT32        Crc,
+  const UINT8   *Data,
+  UINTN         Length,
+  const UINT32  *ByteTable
+  )
+{
+  while (Length-- != 0) {
+    Crc = (Crc >> 8) ^ ByteTable[(UINT8)Crc ^ *Data++];
+  }
+
+  return Crc;
+}
+
+TEST_F (BaseLibCrc32Test, CheckValues) {
+  static const CHAR8  Check[] = "123456789";
+
+  EXPECT_EQ (CalculateCrc32 ((VOID *)Check, 9), 0xCBF43926U);
+  EXPECT_EQ (CalculateCrc32c (Check, 9, 0), 0xE3069283U);
+  EXPECT_EQ (CalculateCrc32 (Buffer.data (), 0), 0U);
+  EXPECT_EQ (CalculateCrc32c (Buffer.data (), 0, 0x12345678), 0x12345678U);
+}
+
+TEST_F (BaseLibCrc32Test, Tables) {
+  for (UINTN Index = 0; Index < 256; Index++) {
+    UINT8  Byte = (UINT8)Index;
+
+    ASSERT_EQ (mCrcTable[Index], BitwiseCrc (0, &Byte, 1, CRC32_REFLECTED_POLYNOMIAL));
+    ASSERT_EQ (mCrc32cLookupTable[Index], BitwiseCrc (0, &Byte, 1, CRC32C_REFLECTED_POLYNOMIAL));
+  }
+
+  for (UINTN Row = 0; Row < 7; Row++) {
+    const UINT32  *Previous   = (Row == 0) ? mCrcTable : mCrc32SliceTable[Row - 1];
+    const UINT32  *PreviousC  = (Row == 0) ? mCrc32cLookupTable : mCrc32cSliceTable[Row - 1];
+
+    for (UINTN Index = 0; Index < 256; Index++) {
+      ASSERT_EQ (mCrc32SliceTable[Row][Index], (Previous[Index] >> 8) ^ mCrcTable[Previous[Index] & 0xFF]);
+      ASSERT_EQ (mCrc32cSliceTable[Row][Index], (PreviousC[Index] >> 8) ^ mCrc32cLookupTable[PreviousC[Index] & 0xFF]);
+    }
+  }
+}
+
+TEST_F (BaseLibCrc32Test, SliceBy8) {
+  for (UINTN Length : mLengths) {
+    for (UINTN Offset = 0; Offset < MAX_OFFSET; Offset++) {
+      const UINT8  *Data = Buffer.data () + Offset;
+
+      ASSERT_EQ (
+        InternalCrc32SliceBy8 (0xFFFFFFFF, Data, Length, mCrcTable, mCrc32SliceTable),
+        ByteLoopCrc (0xFFFFFFFF, Data, Length, mCrcTable)
+        ) << "Length " << Length << " offset " << Offset;
+      ASSERT_EQ (
+        InternalCrc32SliceBy8 (0x0BADF00D, Data, Length, mCrc32cLookupTable, mCrc32cSliceTable),
+        ByteLoopCrc (0x0BADF00D, Data, Length, mCrc32cLookupTable)
+        ) << "Length " << Length << " offset " << Offset;
+    }
+  }
+}
+
+TEST_F (BaseLibCrc32Test, Zbc) {
+  for (UINTN Length : mLengths) {
+    for (UINTN Offset = 0; Offset < MAX_OFFSET; Offset++) {
+      const UINT8  *Data = Buffer.data () + Offset;
+
+      ASSERT_EQ (
+        InternalCrc32Zbc (
+          0xFFFFFFFF,
+          Data,
+          Length,
+          CRC32_REFLECTED_POLYNOMIAL,
+          CRC32_REFLECTED_QUOTIENT,
+          mCrcTable
+          ),
+        ByteLoopCrc (0xFFFFFFFF, Data, Length, mCrcTable)
+        ) << "Length " << Length << " offset " << Offset;
+      ASSERT_EQ (
+        InternalCrc32Zbc (
+          0x0BADF00D,
+          Data,
+          Length,
+          CRC32C_REFLECTED_POLYNOMIAL,
+          CRC32C_REFLECTED_QUOTIENT,
+          mCrc32cLookupTable
+          ),
+        ByteLoopCrc (0x0BADF00D, Data, Length, mCrc32cLookupTable)
+        ) << "Length " << Length << " offset " << Offset;
+    }
+  }
+}
+
+TEST_F (BaseLibCrc32Test, Crc32cChaining) {
+  UINT32  Whole;
+
+  Whole = CalculateCrc32c (Buffer.data (), 4097, 0);
+  for (UINTN Split : mLengths) {
+    UINT32  Crc;
+
+    Crc = CalculateCrc32c (Buffer.data (), Split, 0);
+    Crc = CalculateCrc32c (Buffer.data () + Split, 4097 - Split, Crc);
+    ASSERT_EQ (Crc, Whole) << "Split " << Split;
+  }
+}
+
+TEST_F (BaseLibCrc32Test, Crc32Throughput) {
+  static const UINTN  Sizes[] = { 64, 512, 4096, 65536 };
+
+  for (UINTN Size : Sizes) {
+    UINTN   Rounds = (64 * 1024 * 1024) / Size;
+    double  Seconds[2];
+    UINT32  Crc[2];
+
+    for (UINTN Kernel = 0; Kernel < 2; Kernel++) {
+      auto  Start = std::chrono::steady_clock::now ();
+
+      Crc[Kernel] = 0;
+      for (UINTN Round = 0; Round < Rounds; Round++) {
+        if (Kernel == 0) {
+          Crc[Kernel] ^= ByteLoopCrc (0xFFFFFFFF, Buffer.data (), Size, mCrcTable) ^ 0xFFFFFFFF;
+        } else {
+          Crc[Kernel] ^= CalculateCrc32 (Buffer.data (), Size);
+        }
+      }
+
+      Seconds[Kernel] = std::chrono::duration<double>(std::chrono::steady_clock::now () - Start).count ();
+    }
+
+    printf (
+      "  %6u bytes: byte loop %7.0f MB/s, CalculateCrc32 %7.0f MB/s\n",
+      (unsigned)Size,
+      64.0 / Seconds[0],
+      64.0 / Seconds[1]
+      );
+    ASSERT_EQ (Crc[0], Crc[1]);
+  }
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
@@ -0,0 +1,351 @@
+/** @file
+  Host based tests of the RISC-V kernels of BaseMemoryLibOptDxe.
+
+  The kernels are checked against the C library for every pairing of source
+  and destination alignment over short lengths, and for a range of long
+  ones, with guard bytes around each buffer. A benchmark reports the copy
+  throughput next to a byte loop.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+**/
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+extern "C" {
+  #include "MemLibInternals.h"
+}
+
+#define GUARD_SIZE   64
+#define GUARD_BYTE   0xA5
+#define MAX_OFFSET   16
+
+//
+// Lengths up to a few words in full, then some long and odd ones
+//
+static const UINTN  mLengths[] = {
+  0,   1,   2,   3,   4,   5,   7,   8,   9,   15,  16,  17,  23,  24,  25,  31,
+  32,  33,  39,  40,  47,  48,  63,  64,  65,  127, 128, 129, 255, 256, 257, 1000,
+  4095, 4096, 4097, 65537
+};
+
+class MemLibRiscV64Test : public ::testing::Test {
+protected:
+  std::vector<UINT8>  Source;
+  std::vector<UINT8>  Destination;
+  std::vector<UINT8>  Expected;
+  UINT32              Seed;
+
+  void
+  SetUp (
+    ) override
+  {
+    Source.resize (65537 + 2 * GUARD_SIZE + MAX_OFFSET);
+    Destination.resize (Source.size ());
+    Seed = 0x1234567;
+    for (UINT8 &Byte : Source) {
+      Byte = (UINT8)Random ();
+    }
+  }
+
+  UINT32
+  Random (
+    )
+  {
+    Seed = Seed * 1103515245 + 12345;
+    return Seed >> 8;
+  }
+
+  void
+  ResetDestination (
+    )
+  {
+    memset (Destination.data (), GUARD_BYTE, Destination.size ());
+    Expected = Destination;
+  }
+
+  UINT8 *
+  At (
+    std::vector<UINT8>  &Buffer,
+    UINTN               Offset
+    )
+  {
+    return Buffer.data () + GUARD_SIZE + Offset;
+  }
+};
+
+TEST_F (MemLibRiscV64Test, CopyMem) {
+  for (UINTN Length : mLengths) {
+    for (UINTN SourceOffset = 0; SourceOffset < MAX_OFFSET; SourceOffset++) {
+      for (UINTN DestinationOffset = 0; DestinationOffset < MAX_OFFSET; DestinationOffset++) {
+        ResetDestination ();
+        memcpy (At (Expected, DestinationOffset), At (Source, SourceOffset), Length);
+        ASSERT_EQ (
+          InternalMemCopyMem (At (Destination, DestinationOffset), At (Source, SourceOffset), Length),
+          At (Destination, DestinationOffset)
+          );
+        ASSERT_TRUE (Destination == Expected) << "length " << Length << " offsets " << SourceOffset << "/" << DestinationOffset;
+      }
+    }
+  }
+}
+
+TEST_F (MemLibRiscV64Test, CopyMemOverlap) {
+  for (UINTN Length : mLengths) {
+    if (Length > 4097) {
+      continue;
+    }
+
+    for (UINTN From = 0; From < 2 * MAX_OFFSET; From++) {
+      for (UINTN To = 0; To < 2 * MAX_OFFSET; To++) {
+        Destination = Source;
+        Expected    = Source;
+        memmove (At (Expected, To), At (Expected, From), Length);
+        InternalMemCopyMem (At (Destination, To), At (Destination, From), Length);
+        ASSERT_TRUE (Destination == Expected) << "length " << Length << " from " << From << " to " << To;
+      }
+    }
+  }
+}
+
+TEST_F (MemLibRiscV64Test, SetMem) {
+  for (UINTN Length : mLengths) {
+    for (UINTN Offset = 0; Offset < MAX_OFFSET; Offset++) {
+      ResetDestination ();
+      memset (At (Expected, Offset), 0x3C, Length);
+      ASSERT_EQ (InternalMemSetMem (At (Destination, Offset), Length, 0x3C), At (Destination, Offset));
+      ASSERT_TRUE (Destination == Expected) << "length " << Length << " offset " << Offset;
+
+      ResetDestination ();
+      memset (At (Expected, Offset), 0, Length);
+      ASSERT_EQ (InternalMemZeroMem (At (Destination, Offset), Length), At (Destination, Offset));
+      ASSERT_TRUE (Destination == Expected) << "length " << Length << " offset " << Offset;
+    }
+  }
+}
+
+TEST_F (MemLibRiscV64Test, SetMemWide) {
+  UINT16  Value16;
+  UINT32  Value32;
+  UINT64  Value64;
+
+  Value16 = 0xBEEF;
+  Value32 = 0xDEADBEEF;
+  Value64 = 0x0123456789ABCDEFULL;
+  for (UINTN Length : mLengths) {
+    if (Length > 4097) {
+      continue;
+    }
+
+    for (UINTN Offset = 0; Offset < MAX_OFFSET; Offset += 2) {
+      ResetDestination ();
+      for (UINTN Index = 0; Index < Length; Index++) {
+        memcpy (At (Expected, Offset + Index * 2), &Value16, 2);
+      }
+
+      InternalMemSetMem16 (At (Destination, Offset), Length, Value16);
+      ASSERT_TRUE (Destination == Expected) << "length " << Length << " offset " << Offset;
+    }
+
+    for (UINTN Offset = 0; Offset < MAX_OFFSET; Offset += 4) {
+      ResetDestination ();
+      for (UINTN Index = 0; Index < Length; Index++) {
+        memcpy (At (Expected, Offset + Index * 4), &Value32, 4);
+      }
+
+      InternalMemSetMem32 (At (Destination, Offset), Length, Value32);
+      ASSERT_TRUE (Destination == Expected) << "length " << Length << " offset " << Offset;
+    }
+
+    for (UINTN Offset = 0; Offset < MAX_OFFSET; Offset += 8) {
+      ResetDestination ();
+      for (UINTN Index = 0; Index < Length; Index++) {
+        memcpy (At (Expected, Offset + Index * 8), &Value64, 8);
+      }
+
+      InternalMemSetMem64 (At (Destination, Offset), Length, Value64);
+      ASSERT_TRUE (Destination == Expected) << "length " << Length << " offset " << Offset;
+    }
+  }
+}
+
+TEST_F (MemLibRiscV64Test, CompareMem) {
+  for (UINTN Length : mLengths) {
+    if (Length == 0) {
+      continue;
+    }
+
+    for (UINTN SourceOffset = 0; SourceOffset < MAX_OFFSET; SourceOffset++) {
+      for (UINTN DestinationOffset = 0; DestinationOffset < MAX_OFFSET; DestinationOffset += 3) {
+        memcpy (At (Destination, DestinationOffset), At (Source, SourceOffset), Length);
+        ASSERT_EQ (InternalMemCompareMem (At (Destination, DestinationOffset), At (Source, SourceOffset), Length), 0);
+
+        //
+        // The first of two differing bytes decides, whichever way it goes
+        //
+        UINTN  First  = Random () % Length;
+        UINTN  Second = First + (Length - First) / 2;
+        At (Destination, DestinationOffset)[Second] ^= 0x80;
+        At (Destination, DestinationOffset)[First]  += 1 + Random () % 255;
+        INTN  Expect = (INTN)At (Destination, DestinationOffset)[First] - (INTN)At (Source, SourceOffset)[First];
+
+        ASSERT_EQ (InternalMemCompareMem (At (Destination, DestinationOffset), At (Source, SourceOffset), Length), Expect)
+          << "length " << Length << " offsets " << SourceOffset << "/" << DestinationOffset << " byte " << First;
+      }
+    }
+  }
+}
+
+TEST_F (MemLibRiscV64Test, ScanMem) {
+  for (UINTN Length : mLengths) {
+    if ((Length == 0) || (Length > 4097)) {
+      continue;
+    }
+
+    for (UINTN Offset = 0; Offset < MAX_OFFSET; Offset++) {
+      UINT8  *Buffer = At (Destination, Offset);
+
+      //
+      // Bytes that differ from the value in a single bit are the ones the
+      // word scan could mistake for it
+      //
+      memset (Buffer, 0x5A ^ 0x01, Length);
+      ASSERT_EQ (InternalMemScanMem8 (Buffer, Length, 0x5A), nullptr);
+      for (UINTN Index = Length; Index-- > 0;) {
+        Buffer[Index] = 0x5A;
+        ASSERT_EQ (InternalMemScanMem8 (Buffer, Length, 0x5A), Buffer + Index) << "length " << Length << " offset " << Offset;
+      }
+
+      memset (Buffer, 0, Length);
+      ASSERT_EQ (InternalMemScanMem8 (Buffer, Length, 0), Buffer);
+      ASSERT_EQ (InternalMemScanMem8 (Buffer, Length, 0x80), nullptr);
+    }
+
+    for (UINTN Offset = 0; Offset < MAX_OFFSET; Offset += 2) {
+      UINT16  *Buffer = (UINT16 *)At (Destination, Offset);
+
+      for (UINTN Index = 0; Index < Length / 2; Index++) {
+        Buffer[Index] = 0x0100;
+      }
+
+      if (Length / 2 != 0) {
+        ASSERT_EQ (InternalMemScanMem16 (Buffer, Length / 2, 0x0001), nullptr);
+      }
+
+      for (UINTN Index = Length / 2; Index-- > 0;) {
+        Buffer[Index] = 0x0001;
+        ASSERT_EQ (InternalMemScanMem16 (Buffer, Length / 2, 0x0001), Buffer + Index);
+      }
+    }
+
+    for (UINTN Offset = 0; Offset < MAX_OFFSET; Offset += 4) {
+      UINT32  *Buffer = (UINT32 *)At (Destination, Offset);
+
+      for (UINTN Index = 0; Index < Length / 4; Index++) {
+        Buffer[Index] = 0x00010000;
+      }
+
+      for (UINTN Index = Length / 4; Index-- > 0;) {
+        Buffer[Index] = 0x00000001;
+        ASSERT_EQ (InternalMemScanMem32 (Buffer, Length / 4, 0x00000001), Buffer + Index);
+      }
+    }
+
+    for (UINTN Offset = 0; Offset < MAX_OFFSET; Offset += 8) {
+      UINT64  *Buffer = (UINT64 *)At (Destination, Offset);
+
+      for (UINTN Index = 0; Index < Length / 8; Index++) {
+        Buffer[Index] = 1ULL << 32;
+      }
+
+      for (UINTN Index = Length / 8; Index-- > 0;) {
+        Buffer[Index] = 1;
+        ASSERT_EQ (InternalMemScanMem64 (Buffer, Length / 8, 1), Buffer + Index);
+      }
+    }
+  }
+}
+
+TEST_F (MemLibRiscV64Test, IsZeroBuffer) {
+  for (UINTN Length : mLengths) {
+    if (Length == 0) {
+      continue;
+    }
+
+    for (UINTN Offset = 0; Offset < MAX_OFFSET; Offset++) {
+      UINT8  *Buffer = At (Destination, Offset);
+      UINTN  Index   = Random () % Length;
+
+      ResetDestination ();
+      memset (Buffer, 0, Length);
+      ASSERT_TRUE (InternalMemIsZeroBuffer (Buffer, Length));
+      Buffer[Index] = 1;
+      ASSERT_FALSE (InternalMemIsZeroBuffer (Buffer, Length)) << "length " << Length << " byte " << Index;
+    }
+  }
+}
+
+//
+// What the generic BaseMemoryLib does for buffers that are not aligned alike
+//
+static void
+CopyBytes (
+  volatile UINT8        *Destination,
+  const volatile UINT8  *Source,
+  UINTN                 Length
+  )
+{
+  while (Length-- != 0) {
+    *Destination++ = *Source++;
+  }
+}
+
+TEST_F (MemLibRiscV64Test, CopyMemThroughput) {
+  static const UINTN  Sizes[]   = { 64, 256, 4096, 65536 };
+  static const UINTN  Offsets[] = { 0, 0, 1, 0, 3, 5 };
+
+  for (UINTN Size : Sizes) {
+    for (UINTN Pair = 0; Pair < sizeof (Offsets) / sizeof (Offsets[0]); Pair += 2) {
+      UINT8  *Target   = At (Destination, Offsets[Pair + 1]);
+      UINT8  *From     = At (Source, Offsets[Pair]);
+      UINTN  Rounds    = (64 * 1024 * 1024) / Size;
+      double Seconds[2];
+
+      for (UINTN Kernel = 0; Kernel < 2; Kernel++) {
+        auto  Start = std::chrono::steady_clock::now ();
+        for (UINTN Round = 0; Round < Rounds; Round++) {
+          if (Kernel == 0) {
+            CopyBytes (Target, From, Size);
+          } else {
+            InternalMemCopyMem (Target, From, Size);
+          }
+        }
+
+        Seconds[Kernel] = std::chrono::duration<double>(std::chrono::steady_clock::now () - Start).count ();
+      }
+
+      printf (
+        "  %6u bytes, offsets %u/%u: byte loop %7.0f MB/s, CopyMem %7.0f MB/s\n",
+        (unsigned)Size,
+        (unsigned)Offsets[Pair],
+        (unsigned)Offsets[Pair + 1],
+        64.0 / Seconds[0],
+        64.0 / Seconds[1]
+        );
+      ASSERT_EQ (memcmp (Target, From, Size), 0);
+    }
+  }
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  testing::InitGoogleTest (&argc, argv);
+  return RUN_ALL_TESTS ();
+}
@@ -16,6 +16,7 @@
 STATIC BOOLEAN           mInterruptState = FALSE;
 STATIC EFI_HANDLE        mCpuHandle      = NULL;
 STATIC UINTN             mBootHartId;
+STATIC BOOLEAN           mAccessAttributesReported;
 RISCV_EFI_BOOT_PROTOCOL  gRiscvBootProtocol;
 
 /**
@@ -296,8 +297,32 @@ CpuSetMemoryAttributes (
   IN UINT64                 Attributes
   )
 {
-  DEBUG ((DEBUG_INFO, "%a: Set memory attributes not supported yet\n", __func__));
-  return EFI_SUCCESS;
+  EFI_STATUS  Status;
+
+  Status = RiscVSetMemoryAttributes (BaseAddress, Length, Attributes);
+  if (Status != EFI_UNSUPPORTED) {
+    return Status;
+  }
+
+  //
+  // Paging is disabled. The PMAs set the memory type, so the cache
+  // attributes hold as they are, but nothing enforces the access ones.
+  //
+  if ((Attributes & EFI_MEMORY_ACCESS_MASK) == 0) {
+    return EFI_SUCCESS;
+  }
+
+  DEBUG ((
+    mAccessAttributesReported ? DEBUG_VERBOSE : DEBUG_ERROR,
+    "%a: Paging is disabled, access attributes 0x%lx of 0x%lx - 0x%lx are not enforced\n",
+    __func__,
+    Attributes & EFI_MEMORY_ACCESS_MASK,
+    BaseAddress,
+    BaseAddress + Length - 1
+    ));
+  mAccessAttributesReported = TRUE;
+
+  return EFI_UNSUPPORTED;
 }
 
 /**
@@ -340,6 +365,15 @@ InitializeCpu (
   //
   DisableInterrupts ();
 
+  //
+  // Enable paging before the DXE core applies the memory protection policy
+  // through the CPU Architectural Protocol
+  //
+  Status = RiscVConfigureMmu ();
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: Failed to configure the MMU, memory protection is disabled (Status=%r)\n", __func__, Status));
+  }
+
   //
   // Install Boot protocol
   //
@@ -26,6 +26,14 @@ EFI_TIMER_ARCH_PROTOCOL  mTimer = {
   TimerDriverGenerateSoftInterrupt
 };
 
+//
+// The Timer Deadline Protocol that lets the DXE Core skip idle ticks
+//
+EDKII_TIMER_DEADLINE_PROTOCOL  mTimerDeadlineProtocol = {
+  TimerDriverSetDeadline,
+  TimerDriverGetElapsed
+};
+
 //
 // Pointer to the CPU Architectural Protocol instance
 //
@@ -38,10 +46,81 @@ EFI_CPU_ARCH_PROTOCOL  *mCpu;
 STATIC EFI_TIMER_NOTIFY  mTimerNotifyFunction;
 
 //
-// The current period of the timer interrupt
+// The current period of the timer interrupt in 100 ns units, and the value
+// of the timer counter the next timer event of the DXE Core is due at, or
+// MAX_UINT64 if none is pending. The timer ticks at its period until the
+// DXE Core sets a deadline.
 //
-STATIC UINT64  mTimerPeriod     = 0;
-STATIC UINT64  mLastPeriodStart = 0;
+STATIC UINT64   mTimerPeriod      = 0;
+STATIC BOOLEAN  mTimerDeadlineSet = FALSE;
+STATIC UINT64   mTimerDeadline    = MAX_UINT64;
+STATIC UINT64   mLastPeriodStart  = 0;
+
+/**
+  Convert a value of the timer counter to 100 ns units.
+
+  @param Ticks           The timer counter value
+
+  @return The time in 100 ns units
+
+**/
+STATIC
+UINT64
+TimerTicksToTime (
+  IN UINT64  Ticks
+  )
+{
+  UINT64  Frequency;
+  UINT64  Remainder;
+  UINT64  Time;
+
+  Frequency = PcdGet64 (PcdCpuCoreCrystalClockFrequency);
+  Time      = MultU64x32 (DivU64x64Remainder (Ticks, Frequency, &Remainder), 10000000);
+  return Time + DivU64x64Remainder (MultU64x32 (Remainder, 10000000), Frequency, NULL);
+}
+
+/**
+  Convert a time in 100 ns units to ticks of the timer counter.
+
+  @param Time            The time in 100 ns units
+
+  @return The number of timer counter ticks
+
+**/
+STATIC
+UINT64
+TimerTimeToTicks (
+  IN UINT64  Time
+  )
+{
+  return DivU64x32 (MultU64x64 (Time, PcdGet64 (PcdCpuCoreCrystalClockFrequency)), 10000000);
+}
+
+/**
+  Program the timer interrupt for the next tick, after the timer period or
+  up to the deadline of the DXE Core if that is later. The timer interrupt
+  comes at least every MAX_TIMER_IDLE_DURATION.
+
+**/
+STATIC
+VOID
+TimerProgramNextTick (
+  VOID
+  )
+{
+  UINT64  PeriodEnd;
+  UINT64  Next;
+
+  PeriodEnd = mLastPeriodStart + TimerTimeToTicks (mTimerPeriod);
+  if (!mTimerDeadlineSet) {
+    Next = PeriodEnd;
+  } else {
+    Next = MIN (mTimerDeadline, mLastPeriodStart + TimerTimeToTicks (MAX_TIMER_IDLE_DURATION));
+    Next = MAX (Next, PeriodEnd);
+  }
+
+  SbiSetTimer (Next);
+}
 
 /**
   Timer Interrupt Handler.
@@ -58,6 +137,7 @@ TimerInterruptHandler (
 {
   EFI_TPL  OriginalTPL;
   UINT64   PeriodStart;
+  UINT64   Duration;
 
   PeriodStart = RiscVReadTimer ();
 
@@ -71,7 +151,15 @@ TimerInterruptHandler (
     // time to increment slower. So when we take an interrupt,
     // account for the actual time passed.
     //
-    mTimerNotifyFunction (PeriodStart - mLastPeriodStart);
+    // The period restarts before the handler runs, so that the time the
+    // DXE Core reads through TimerDriverGetElapsed() does not count this
+    // duration twice.
+    //
+    Duration         = TimerTicksToTime (PeriodStart) - TimerTicksToTime (mLastPeriodStart);
+    mLastPeriodStart = PeriodStart;
+    mTimerNotifyFunction (Duration);
+  } else {
+    mLastPeriodStart = PeriodStart;
   }
 
   if (mTimerPeriod == 0) {
@@ -80,8 +168,7 @@ TimerInterruptHandler (
     return;
   }
 
-  mLastPeriodStart          = PeriodStart;
-  SbiSetTimer (PeriodStart += mTimerPeriod);
+  TimerProgramNextTick ();
   RiscVEnableTimerInterrupt (); // enable SMode timer int
   gBS->RestoreTPL (OriginalTPL);
 }
@@ -171,9 +258,9 @@ TimerDriverSetTimerPeriod (
     return EFI_SUCCESS;
   }
 
-  mTimerPeriod     = TimerPeriod / 10; // convert unit from 100ns to 1us
+  mTimerPeriod     = TimerPeriod;
   mLastPeriodStart = RiscVReadTimer ();
-  SbiSetTimer (mLastPeriodStart + mTimerPeriod);
+  TimerProgramNextTick ();
 
   mCpu->EnableInterrupt (mCpu);
   RiscVEnableTimerInterrupt (); // enable SMode timer int
@@ -207,6 +294,69 @@ TimerDriverGetTimerPeriod (
   return EFI_SUCCESS;
 }
 
+/**
+  Set the time until the next timer event of the DXE Core is due, so that the
+  timer interrupts in between can be skipped.
+
+  The deadline counts from the current value of the timer counter, which the
+  DXE Core has seen through TimerDriverGetElapsed(). It is kept as a value of
+  the counter, so that the ticks in between do not move it.
+
+  @param This            The EDKII_TIMER_DEADLINE_PROTOCOL instance.
+  @param Deadline        The number of 100 ns units until the next timer event
+                         is due, or 0 if no timer event is pending.
+
+  @retval EFI_SUCCESS    The deadline was recorded.
+
+**/
+EFI_STATUS
+EFIAPI
+TimerDriverSetDeadline (
+  IN EDKII_TIMER_DEADLINE_PROTOCOL  *This,
+  IN UINT64                         Deadline
+  )
+{
+  EFI_TPL  OriginalTPL;
+
+  OriginalTPL       = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+  mTimerDeadlineSet = TRUE;
+  if (Deadline == 0) {
+    mTimerDeadline = MAX_UINT64;
+  } else {
+    mTimerDeadline = RiscVReadTimer () + TimerTimeToTicks (MIN (Deadline, MAX_TIMER_IDLE_DURATION));
+  }
+
+  if (mTimerPeriod != 0) {
+    TimerProgramNextTick ();
+  }
+
+  gBS->RestoreTPL (OriginalTPL);
+  return EFI_SUCCESS;
+}
+
+/**
+  Get the time that has passed since the last timer interrupt, which the DXE
+  Core has not been told about yet.
+
+  @param This            The EDKII_TIMER_DEADLINE_PROTOCOL instance.
+
+  @return The number of 100 ns units since the last timer interrupt, or 0 if
+          the timer is disabled.
+
+**/
+UINT64
+EFIAPI
+TimerDriverGetElapsed (
+  IN EDKII_TIMER_DEADLINE_PROTOCOL  *This
+  )
+{
+  if (mTimerPeriod == 0) {
+    return 0;
+  }
+
+  return TimerTicksToTime (RiscVReadTimer ()) - TimerTicksToTime (mLastPeriodStart);
+}
+
 /**
 
   This function generates a soft timer interrupt. If the platform does not support soft
@@ -292,12 +442,15 @@ TimerDriverInitialize (
   ASSERT_EFI_ERROR (Status);
 
   //
-  // Install the Timer Architectural Protocol onto a new handle
+  // Install the Timer Architectural Protocol onto a new handle, along with
+  // the Timer Deadline Protocol
   //
   Status = gBS->InstallMultipleProtocolInterfaces (
                   &mTimerHandle,
                   &gEfiTimerArchProtocolGuid,
                   &mTimer,
+                  &gEdkiiTimerDeadlineProtocolGuid,
+                  &mTimerDeadlineProtocol,
                   NULL
                   );
   ASSERT_EFI_ERROR (Status);
@@ -14,11 +14,13 @@
 
 #include <Protocol/Cpu.h>
 #include <Protocol/Timer.h>
+#include <Protocol/TimerDeadline.h>
 
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/BaseLib.h>
 #include <Library/DebugLib.h>
 #include <Library/IoLib.h>
+#include <Library/PcdLib.h>
 
 //
 // RISC-V use 100us timer.
@@ -26,6 +28,12 @@
 //
 #define DEFAULT_TIMER_TICK_DURATION  100000
 
+//
+// The longest time between two timer interrupts while no timer event is
+// pending: 1 s in 100 ns units
+//
+#define MAX_TIMER_IDLE_DURATION  10000000
+
 extern VOID
 RiscvSetTimerPeriod (
   UINT32  TimerPeriod
@@ -150,6 +158,42 @@ TimerDriverGetTimerPeriod (
   )
 ;
 
+/**
+  Set the time until the next timer event of the DXE Core is due, so that the
+  timer interrupts in between can be skipped.
+
+  @param This            The EDKII_TIMER_DEADLINE_PROTOCOL instance.
+  @param Deadline        The number of 100 ns units until the next timer event
+                         is due, or 0 if no timer event is pending.
+
+  @retval EFI_SUCCESS    The deadline was recorded.
+
+**/
+EFI_STATUS
+EFIAPI
+TimerDriverSetDeadline (
+  IN EDKII_TIMER_DEADLINE_PROTOCOL  *This,
+  IN UINT64                         Deadline
+  )
+;
+
+/**
+  Get the time that has passed since the last timer interrupt, which the DXE
+  Core has not been told about yet.
+
+  @param This            The EDKII_TIMER_DEADLINE_PROTOCOL instance.
+
+  @return The number of 100 ns units since the last timer interrupt, or 0 if
+          the timer is disabled.
+
+**/
+UINT64
+EFIAPI
+TimerDriverGetElapsed (
+  IN EDKII_TIMER_DEADLINE_PROTOCOL  *This
+  )
+;
+
 /**
 
   This function generates a soft timer interrupt. If the platform does not support soft
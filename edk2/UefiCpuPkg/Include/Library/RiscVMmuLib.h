@@ -0,0 +1,59 @@
+/** @file
+  Public include file for the RISC-V MMU library.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef RISCV_MMU_LIB_H_
+#define RISCV_MMU_LIB_H_
+
+//
+// Encodings of the memory type in the leaf page table entries
+//
+#define RISCV_MMU_MEMORY_TYPE_NONE    0   // Memory types come from the PMAs
+#define RISCV_MMU_MEMORY_TYPE_SVPBMT  1   // Svpbmt, PTE bits 62:61
+#define RISCV_MMU_MEMORY_TYPE_THEAD   2   // T-Head extended attributes, PTE bits 63:59
+
+/**
+  Build an identity map of the GCD memory space and enable paging in the
+  smallest translation mode, up to PcdCpuRiscVMmuMaxSatpMode, that can map
+  all of it and that the CPU implements.
+
+  @retval EFI_SUCCESS           Paging is enabled.
+  @retval EFI_UNSUPPORTED       No translation mode can map the memory space,
+                                paging stays disabled.
+  @retval EFI_OUT_OF_RESOURCES  The page tables could not be allocated.
+
+**/
+EFI_STATUS
+EFIAPI
+RiscVConfigureMmu (
+  VOID
+  );
+
+/**
+  Set the attributes of a memory region in the identity map.
+
+  @param[in]  BaseAddress   Start of the region, 4 KB aligned.
+  @param[in]  Length        Size of the region, a multiple of 4 KB.
+  @param[in]  Attributes    EFI_MEMORY_* cache and access attributes. When no
+                            cache attribute is given, the memory type of the
+                            region is kept.
+
+  @retval EFI_SUCCESS           The attributes were set.
+  @retval EFI_INVALID_PARAMETER The region is not aligned or out of range.
+  @retval EFI_UNSUPPORTED       Paging is not enabled.
+  @retval EFI_OUT_OF_RESOURCES  A page table could not be allocated.
+
+**/
+EFI_STATUS
+EFIAPI
+RiscVSetMemoryAttributes (
+  IN EFI_PHYSICAL_ADDRESS  BaseAddress,
+  IN UINT64                Length,
+  IN UINT64                Attributes
+  );
+
+#endif
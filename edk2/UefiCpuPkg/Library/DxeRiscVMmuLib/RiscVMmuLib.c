@@ -0,0 +1,337 @@
+/** @file
+  RISC-V MMU library for the DXE phase.
+
+  The identity map covers the GCD memory space with the largest pages
+  possible. SetMemoryAttributes() only splits the entries at the edges of a
+  region and merges them back once the region is uniform again.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <PiDxe.h>
+#include <Register/RiscV64/RiscVEncoding.h>
+#include <Library/BaseLib.h>
+#include <Library/DebugLib.h>
+#include <Library/DxeServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PcdLib.h>
+
+#include "RiscVPageTable.h"
+
+#define THEAD_SXSTATUS_MAEE  BIT21
+
+#define SATP64_MODE_SHIFT    60
+
+//
+// Sv39 and Sv48 use 3 and 4 levels of page tables
+//
+#define SATP_MODE_LEVELS(Mode)  ((UINTN)(Mode) - SATP_MODE_SV39 + 3)
+
+STATIC RISCV_PAGE_TABLE  mPageTable;
+STATIC BOOLEAN           mMmuEnabled;
+STATIC UINTN             mMemoryTypeEncoding;
+
+/**
+  Read the T-Head supervisor extended status register.
+
+  @return The value of sxstatus.
+
+**/
+UINT64
+RiscVMmuReadTHeadSxStatus (
+  VOID
+  );
+
+/**
+  Return the memory type encoding to use in the page table entries.
+
+  @return RISCV_MMU_MEMORY_TYPE_*.
+
+**/
+STATIC
+UINTN
+RiscVMmuGetMemoryTypeEncoding (
+  VOID
+  )
+{
+  UINTN  Encoding;
+
+  Encoding = PcdGet8 (PcdCpuRiscVMmuMemoryTypeEncoding);
+
+  //
+  // The T-Head attribute bits are reserved, and must be zero, unless the
+  // machine mode firmware has enabled them.
+  //
+  if ((Encoding == RISCV_MMU_MEMORY_TYPE_THEAD) &&
+      ((RiscVMmuReadTHeadSxStatus () & THEAD_SXSTATUS_MAEE) == 0))
+  {
+    DEBUG ((DEBUG_WARN, "%a: MAEE is disabled, memory types come from the PMAs\n", __func__));
+    Encoding = RISCV_MMU_MEMORY_TYPE_NONE;
+  }
+
+  return Encoding;
+}
+
+/**
+  Build the identity map of the GCD memory space.
+
+  @param[in]  MemorySpaceMap    The GCD memory space map.
+  @param[in]  NumberOfDescriptors Number of descriptors of the map.
+  @param[in]  Levels            Number of levels of the page table.
+
+  @retval EFI_SUCCESS           The identity map was built.
+  @retval Other                 The identity map could not be built.
+
+**/
+STATIC
+EFI_STATUS
+RiscVMmuBuildIdentityMap (
+  IN EFI_GCD_MEMORY_SPACE_DESCRIPTOR  *MemorySpaceMap,
+  IN UINTN                            NumberOfDescriptors,
+  IN UINTN                            Levels
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       Index;
+  UINT64      EfiAttributes;
+  UINT64      Attributes;
+  UINT64      Mask;
+
+  Status = RiscVPageTableInit (&mPageTable, Levels);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  for (Index = 0; Index < NumberOfDescriptors; Index++) {
+    if (MemorySpaceMap[Index].GcdMemoryType == EfiGcdMemoryTypeNonExistent) {
+      continue;
+    }
+
+    EfiAttributes = MemorySpaceMap[Index].Attributes & EFI_CACHE_ATTRIBUTE_MASK;
+    if (EfiAttributes == 0) {
+      switch (MemorySpaceMap[Index].GcdMemoryType) {
+        case EfiGcdMemoryTypeSystemMemory:
+        case EfiGcdMemoryTypePersistent:
+        case EfiGcdMemoryTypeMoreReliable:
+          EfiAttributes = EFI_MEMORY_WB;
+          break;
+        default:
+          EfiAttributes = EFI_MEMORY_UC;
+          break;
+      }
+    }
+
+    RiscVPageTableEfiToPte (EfiAttributes, mMemoryTypeEncoding, &Attributes, &Mask);
+    Status = RiscVPageTableMap (
+               &mPageTable,
+               MemorySpaceMap[Index].BaseAddress,
+               MemorySpaceMap[Index].Length,
+               Attributes,
+               Mask
+               );
+    if (EFI_ERROR (Status)) {
+      DEBUG ((
+        DEBUG_ERROR,
+        "%a: Failed to map 0x%lx - 0x%lx (Status=%r)\n",
+        __func__,
+        MemorySpaceMap[Index].BaseAddress,
+        MemorySpaceMap[Index].BaseAddress + MemorySpaceMap[Index].Length - 1,
+        Status
+        ));
+      return Status;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Report the GCD memory space that lies beyond the reach of a page table.
+
+  @param[in]  MemorySpaceMap    The GCD memory space map.
+  @param[in]  NumberOfDescriptors Number of descriptors of the map.
+  @param[in]  Levels            Number of levels of the page table.
+
+**/
+STATIC
+VOID
+RiscVMmuReportUnreachable (
+  IN EFI_GCD_MEMORY_SPACE_DESCRIPTOR  *MemorySpaceMap,
+  IN UINTN                            NumberOfDescriptors,
+  IN UINTN                            Levels
+  )
+{
+  UINTN   Index;
+  UINT64  Limit;
+
+  Limit = RiscVPageTableLimit (Levels);
+  for (Index = 0; Index < NumberOfDescriptors; Index++) {
+    if ((MemorySpaceMap[Index].GcdMemoryType != EfiGcdMemoryTypeNonExistent) &&
+        (MemorySpaceMap[Index].BaseAddress + MemorySpaceMap[Index].Length > Limit))
+    {
+      DEBUG ((
+        DEBUG_ERROR,
+        "%a: 0x%lx - 0x%lx (GCD type %d) is beyond the reach of Sv%d\n",
+        __func__,
+        MemorySpaceMap[Index].BaseAddress,
+        MemorySpaceMap[Index].BaseAddress + MemorySpaceMap[Index].Length - 1,
+        MemorySpaceMap[Index].GcdMemoryType,
+        12 + 9 * Levels
+        ));
+    }
+  }
+}
+
+/**
+  Build an identity map of the GCD memory space and enable paging in the
+  smallest translation mode, up to PcdCpuRiscVMmuMaxSatpMode, that can map
+  all of it and that the CPU implements.
+
+  Nothing is left out of the identity map: once paging is enabled, an
+  address it does not map faults. When the memory space reaches beyond
+  every mode allowed, paging stays disabled and the ranges out of reach are
+  reported as errors.
+
+  @retval EFI_SUCCESS           Paging is enabled.
+  @retval EFI_UNSUPPORTED       No translation mode can map the memory space,
+                                paging stays disabled.
+  @retval EFI_OUT_OF_RESOURCES  The page tables could not be allocated.
+
+**/
+EFI_STATUS
+EFIAPI
+RiscVConfigureMmu (
+  VOID
+  )
+{
+  EFI_STATUS                       Status;
+  EFI_GCD_MEMORY_SPACE_DESCRIPTOR  *MemorySpaceMap;
+  UINTN                            NumberOfDescriptors;
+  UINTN                            Index;
+  UINT64                           End;
+  UINT64                           Mode;
+  UINT64                           MaxMode;
+  UINT64                           Satp;
+
+  if (mMmuEnabled) {
+    return EFI_SUCCESS;
+  }
+
+  Status = gDS->GetMemorySpaceMap (&NumberOfDescriptors, &MemorySpaceMap);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  End = 0;
+  for (Index = 0; Index < NumberOfDescriptors; Index++) {
+    if (MemorySpaceMap[Index].GcdMemoryType != EfiGcdMemoryTypeNonExistent) {
+      End = MAX (End, MemorySpaceMap[Index].BaseAddress + MemorySpaceMap[Index].Length);
+    }
+  }
+
+  mMemoryTypeEncoding = RiscVMmuGetMemoryTypeEncoding ();
+
+  Status  = EFI_UNSUPPORTED;
+  MaxMode = MIN (PcdGet64 (PcdCpuRiscVMmuMaxSatpMode), SATP_MODE_SV48);
+  for (Mode = SATP_MODE_SV39; Mode <= MaxMode; Mode++) {
+    if (End > RiscVPageTableLimit (SATP_MODE_LEVELS (Mode))) {
+      continue;
+    }
+
+    Status = RiscVMmuBuildIdentityMap (MemorySpaceMap, NumberOfDescriptors, SATP_MODE_LEVELS (Mode));
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+
+    //
+    // A write of an unsupported mode leaves satp unchanged.
+    //
+    Satp = LShiftU64 (Mode, SATP64_MODE_SHIFT) | RShiftU64 ((UINTN)mPageTable.Root, EFI_PAGE_SHIFT);
+    RiscVLocalTlbFlushAll ();
+    RiscVSetSupervisorAddressTranslationRegister (Satp);
+    RiscVLocalTlbFlushAll ();
+    if (RiscVGetSupervisorAddressTranslationRegister () == Satp) {
+      mMmuEnabled = TRUE;
+      break;
+    }
+
+    DEBUG ((DEBUG_INFO, "%a: satp mode %ld is not implemented\n", __func__, Mode));
+    Status = EFI_UNSUPPORTED;
+  }
+
+  if (mMmuEnabled) {
+    DEBUG ((
+      DEBUG_INFO,
+      "%a: Sv%d paging enabled up to 0x%lx, memory type encoding %d\n",
+      __func__,
+      12 + 9 * mPageTable.Levels,
+      End,
+      mMemoryTypeEncoding
+      ));
+  } else {
+    DEBUG ((
+      DEBUG_ERROR,
+      "%a: No translation mode can map up to 0x%lx, paging stays disabled (Status=%r)\n",
+      __func__,
+      End,
+      Status
+      ));
+    if ((MaxMode >= SATP_MODE_SV39) && (End > RiscVPageTableLimit (SATP_MODE_LEVELS (MaxMode)))) {
+      RiscVMmuReportUnreachable (MemorySpaceMap, NumberOfDescriptors, SATP_MODE_LEVELS (MaxMode));
+    }
+  }
+
+  FreePool (MemorySpaceMap);
+
+  return Status;
+}
+
+/**
+  Set the attributes of a memory region in the identity map.
+
+  @param[in]  BaseAddress   Start of the region, 4 KB aligned.
+  @param[in]  Length        Size of the region, a multiple of 4 KB.
+  @param[in]  Attributes    EFI_MEMORY_* cache and access attributes. When no
+                            cache attribute is given, the memory type of the
+                            region is kept.
+
+  @retval EFI_SUCCESS           The attributes were set.
+  @retval EFI_INVALID_PARAMETER The region is not aligned or out of range.
+  @retval EFI_UNSUPPORTED       Paging is not enabled.
+  @retval EFI_OUT_OF_RESOURCES  A page table could not be allocated.
+
+**/
+EFI_STATUS
+EFIAPI
+RiscVSetMemoryAttributes (
+  IN EFI_PHYSICAL_ADDRESS  BaseAddress,
+  IN UINT64                Length,
+  IN UINT64                Attributes
+  )
+{
+  EFI_STATUS  Status;
+  UINT64      PteAttributes;
+  UINT64      Mask;
+
+  if (!mMmuEnabled) {
+    return EFI_UNSUPPORTED;
+  }
+
+  //
+  // Refill the pool first: the allocation may update the page table itself.
+  //
+  Status = RiscVPageTableReserve (&mPageTable);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  RiscVPageTableEfiToPte (Attributes, mMemoryTypeEncoding, &PteAttributes, &Mask);
+  Status = RiscVPageTableMap (&mPageTable, BaseAddress, Length, PteAttributes, Mask);
+
+  RiscVLocalTlbFlushAll ();
+  RiscVPageTableRecycle (&mPageTable);
+
+  return Status;
+}
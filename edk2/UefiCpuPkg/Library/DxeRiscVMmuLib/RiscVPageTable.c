@@ -0,0 +1,541 @@
+/** @file
+  RISC-V page table management.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+#include "RiscVPageTable.h"
+
+#define PTE_IS_VALID(Pte)  (((Pte) & RISCV_PTE_V) != 0)
+#define PTE_IS_TABLE(Pte)  (PTE_IS_VALID (Pte) && (((Pte) & RISCV_PTE_RWX) == 0))
+#define PTE_IS_LEAF(Pte)   (PTE_IS_VALID (Pte) && (((Pte) & RISCV_PTE_RWX) != 0))
+
+#define PTE_ADDRESS(Pte)   LShiftU64 (RShiftU64 ((Pte) & RISCV_PTE_PPN_MASK, RISCV_PTE_PPN_SHIFT), EFI_PAGE_SHIFT)
+#define ADDRESS_PPN(Addr)  (LShiftU64 (RShiftU64 ((Addr), EFI_PAGE_SHIFT), RISCV_PTE_PPN_SHIFT) & RISCV_PTE_PPN_MASK)
+
+/**
+  Return the size of the region mapped by an entry of a level.
+
+  @param[in]  Level   The level, 0 for 4 KB pages.
+
+  @return The size in bytes.
+
+**/
+STATIC
+UINT64
+RiscVPageTableEntrySize (
+  IN UINTN  Level
+  )
+{
+  return LShiftU64 (SIZE_4KB, Level * RISCV_PAGE_TABLE_LEVEL_SHIFT);
+}
+
+/**
+  Take a zeroed page table page from the pool.
+
+  @param[in, out] PageTable     The page table.
+
+  @return The page, or NULL if the pool is empty.
+
+**/
+STATIC
+UINT64 *
+RiscVPageTableAllocate (
+  IN OUT RISCV_PAGE_TABLE  *PageTable
+  )
+{
+  UINT64  *Page;
+
+  Page = PageTable->FreePages;
+  if (Page == NULL) {
+    return NULL;
+  }
+
+  PageTable->FreePages = (UINT64 *)(UINTN)Page[0];
+  PageTable->FreeCount--;
+
+  ZeroMem (Page, EFI_PAGE_SIZE);
+  return Page;
+}
+
+/**
+  Release a page table page. It goes back to the pool after the next TLB
+  flush, as the page walk caches may still hold it.
+
+  @param[in, out] PageTable     The page table.
+  @param[in]      Page          The page.
+
+**/
+STATIC
+VOID
+RiscVPageTableRelease (
+  IN OUT RISCV_PAGE_TABLE  *PageTable,
+  IN     UINT64            *Page
+  )
+{
+  Page[0]                 = (UINT64)(UINTN)PageTable->RetiredPages;
+  PageTable->RetiredPages = Page;
+}
+
+/**
+  Make sure the pool holds enough pages for one update.
+
+  Allocating the pages may call RiscVSetMemoryAttributes() recursively, which
+  then runs from the pages already in the pool.
+
+  @param[in, out] PageTable     The page table.
+
+  @retval EFI_SUCCESS           The pool holds enough pages.
+  @retval EFI_OUT_OF_RESOURCES  The pool could not be refilled.
+
+**/
+EFI_STATUS
+RiscVPageTableReserve (
+  IN OUT RISCV_PAGE_TABLE  *PageTable
+  )
+{
+  UINT64  *Pages;
+  UINTN   Index;
+
+  if ((PageTable->FreeCount >= RISCV_PAGE_TABLE_POOL_LOW) || PageTable->Refilling) {
+    return EFI_SUCCESS;
+  }
+
+  PageTable->Refilling = TRUE;
+  Pages                = AllocatePages (RISCV_PAGE_TABLE_POOL_CHUNK);
+  PageTable->Refilling = FALSE;
+
+  if (Pages == NULL) {
+    return (PageTable->FreeCount != 0) ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
+  }
+
+  for (Index = 0; Index < RISCV_PAGE_TABLE_POOL_CHUNK; Index++) {
+    Pages[0]             = (UINT64)(UINTN)PageTable->FreePages;
+    PageTable->FreePages = Pages;
+    PageTable->FreeCount++;
+    Pages += RISCV_PAGE_TABLE_ENTRIES;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Return the pages released by the last updates to the pool, once the TLB
+  has been flushed.
+
+  @param[in, out] PageTable     The page table.
+
+**/
+VOID
+RiscVPageTableRecycle (
+  IN OUT RISCV_PAGE_TABLE  *PageTable
+  )
+{
+  UINT64  *Page;
+
+  while (PageTable->RetiredPages != NULL) {
+    Page                    = PageTable->RetiredPages;
+    PageTable->RetiredPages = (UINT64 *)(UINTN)Page[0];
+
+    Page[0]              = (UINT64)(UINTN)PageTable->FreePages;
+    PageTable->FreePages = Page;
+    PageTable->FreeCount++;
+  }
+}
+
+/**
+  Create an empty page table.
+
+  @param[out] PageTable     The page table.
+  @param[in]  Levels        Number of levels, 3 for Sv39 or 4 for Sv48.
+
+  @retval EFI_SUCCESS           The page table was created.
+  @retval EFI_INVALID_PARAMETER Levels is not supported.
+  @retval EFI_OUT_OF_RESOURCES  The root table could not be allocated.
+
+**/
+EFI_STATUS
+RiscVPageTableInit (
+  OUT RISCV_PAGE_TABLE  *PageTable,
+  IN  UINTN             Levels
+  )
+{
+  EFI_STATUS  Status;
+
+  if ((Levels != 3) && (Levels != 4)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  ZeroMem (PageTable, sizeof (*PageTable));
+  PageTable->Levels = Levels;
+
+  Status = RiscVPageTableReserve (PageTable);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  PageTable->Root = RiscVPageTableAllocate (PageTable);
+  return EFI_SUCCESS;
+}
+
+/**
+  Return the end of the address range a page table can identity map.
+
+  Virtual addresses are sign extended from their top bit, so only the lower
+  half of the virtual address space can hold an identity map.
+
+  @param[in]  Levels        Number of levels of the page table.
+
+  @return The first address that cannot be identity mapped.
+
+**/
+UINT64
+RiscVPageTableLimit (
+  IN UINTN  Levels
+  )
+{
+  return LShiftU64 (1, EFI_PAGE_SHIFT + Levels * RISCV_PAGE_TABLE_LEVEL_SHIFT - 1);
+}
+
+/**
+  Convert EFI memory attributes to leaf page table entry bits.
+
+  @param[in]  EfiAttributes       EFI_MEMORY_* cache and access attributes.
+  @param[in]  MemoryTypeEncoding  RISCV_MMU_MEMORY_TYPE_*.
+  @param[out] Attributes          The page table entry bits, without the PPN.
+  @param[out] Mask                The bits of valid entries to replace with
+                                  Attributes. The memory type is kept when
+                                  EfiAttributes holds no cache attribute.
+
+**/
+VOID
+RiscVPageTableEfiToPte (
+  IN  UINT64  EfiAttributes,
+  IN  UINTN   MemoryTypeEncoding,
+  OUT UINT64  *Attributes,
+  OUT UINT64  *Mask
+  )
+{
+  UINT64  Pte;
+  UINT64  MemoryType;
+
+  Pte   = RISCV_PTE_V | RISCV_PTE_RWX | RISCV_PTE_G | RISCV_PTE_A | RISCV_PTE_D;
+  *Mask = RISCV_PTE_V | RISCV_PTE_RWX;
+
+  if ((EfiAttributes & EFI_MEMORY_RP) != 0) {
+    Pte &= ~(UINT64)RISCV_PTE_V;
+  }
+
+  if ((EfiAttributes & (EFI_MEMORY_RO | EFI_MEMORY_WP)) != 0) {
+    Pte &= ~(UINT64)RISCV_PTE_W;
+  }
+
+  if ((EfiAttributes & EFI_MEMORY_XP) != 0) {
+    Pte &= ~(UINT64)RISCV_PTE_X;
+  }
+
+  //
+  // Cacheable unless told otherwise. Write-through has no encoding of its
+  // own and is mapped as non-cacheable, which is always safe.
+  //
+  if ((EfiAttributes & (EFI_MEMORY_UC | EFI_MEMORY_UCE)) != 0) {
+    MemoryType = (MemoryTypeEncoding == RISCV_MMU_MEMORY_TYPE_SVPBMT) ? RISCV_PTE_SVPBMT_IO : RISCV_PTE_THEAD_IO;
+  } else if ((EfiAttributes & (EFI_MEMORY_WC | EFI_MEMORY_WT)) != 0) {
+    MemoryType = (MemoryTypeEncoding == RISCV_MMU_MEMORY_TYPE_SVPBMT) ? RISCV_PTE_SVPBMT_NC : RISCV_PTE_THEAD_NC;
+  } else {
+    MemoryType = (MemoryTypeEncoding == RISCV_MMU_MEMORY_TYPE_SVPBMT) ? RISCV_PTE_SVPBMT_PMA : RISCV_PTE_THEAD_PMA;
+  }
+
+  if ((MemoryTypeEncoding == RISCV_MMU_MEMORY_TYPE_SVPBMT) ||
+      (MemoryTypeEncoding == RISCV_MMU_MEMORY_TYPE_THEAD))
+  {
+    Pte |= MemoryType;
+    if ((EfiAttributes & EFI_CACHE_ATTRIBUTE_MASK) != 0) {
+      *Mask |= RISCV_PTE_MEMORY_TYPE_MASK;
+    }
+  }
+
+  *Attributes = Pte;
+}
+
+/**
+  Compute the new value of a leaf entry.
+
+  @param[in]  Pte           The current entry.
+  @param[in]  Address       Address mapped by the entry.
+  @param[in]  Attributes    Page table entry bits, without the PPN.
+  @param[in]  Mask          Bits of a valid entry to replace with Attributes.
+
+  @return The new entry.
+
+**/
+STATIC
+UINT64
+RiscVPageTableLeaf (
+  IN UINT64  Pte,
+  IN UINT64  Address,
+  IN UINT64  Attributes,
+  IN UINT64  Mask
+  )
+{
+  if (PTE_IS_VALID (Pte)) {
+    Attributes = (Pte & ~RISCV_PTE_PPN_MASK & ~Mask) | (Attributes & Mask);
+  }
+
+  if (!PTE_IS_VALID (Attributes)) {
+    return 0;
+  }
+
+  return Attributes | ADDRESS_PPN (Address);
+}
+
+/**
+  Replace a table by a single entry of its parent if all of its entries are
+  invalid, or are leaves with the same attributes mapping a contiguous
+  region.
+
+  @param[in, out] PageTable     The page table.
+  @param[in, out] Entry         The entry of the parent that points to the table.
+  @param[in]      Level         Level of the parent entry.
+  @param[in]      Address       Address mapped by the parent entry.
+
+**/
+STATIC
+VOID
+RiscVPageTableMerge (
+  IN OUT RISCV_PAGE_TABLE  *PageTable,
+  IN OUT UINT64            *Entry,
+  IN     UINTN             Level,
+  IN     UINT64            Address
+  )
+{
+  UINT64  *Table;
+  UINT64  First;
+  UINT64  Step;
+  UINTN   Index;
+
+  Table = (UINT64 *)(UINTN)PTE_ADDRESS (*Entry);
+  First = Table[0];
+
+  if (First == 0) {
+    for (Index = 1; Index < RISCV_PAGE_TABLE_ENTRIES; Index++) {
+      if (Table[Index] != 0) {
+        return;
+      }
+    }
+  } else {
+    if ((Level > RISCV_PAGE_TABLE_MAX_LEAF_LEVEL) || !PTE_IS_LEAF (First) ||
+        (PTE_ADDRESS (First) != Address))
+    {
+      return;
+    }
+
+    Step = ADDRESS_PPN (RiscVPageTableEntrySize (Level - 1));
+    for (Index = 1; Index < RISCV_PAGE_TABLE_ENTRIES; Index++) {
+      if (Table[Index] != First + Index * Step) {
+        return;
+      }
+    }
+  }
+
+  *Entry = First;
+  RiscVPageTableRelease (PageTable, Table);
+}
+
+/**
+  Update the entries of a table that map part of a region.
+
+  @param[in, out] PageTable     The page table.
+  @param[in, out] Table         The table.
+  @param[in]      Level         Level of the entries of the table.
+  @param[in]      TableAddress  Address mapped by the first entry of the table.
+  @param[in]      Start         Start of the region.
+  @param[in]      End           End of the region, exclusive.
+  @param[in]      Attributes    Page table entry bits, without the PPN.
+  @param[in]      Mask          Bits of valid entries to replace with Attributes.
+
+  @retval EFI_SUCCESS           The entries were updated.
+  @retval EFI_OUT_OF_RESOURCES  The page table pool is exhausted.
+
+**/
+STATIC
+EFI_STATUS
+RiscVPageTableUpdate (
+  IN OUT RISCV_PAGE_TABLE  *PageTable,
+  IN OUT UINT64            *Table,
+  IN     UINTN             Level,
+  IN     UINT64            TableAddress,
+  IN     UINT64            Start,
+  IN     UINT64            End,
+  IN     UINT64            Attributes,
+  IN     UINT64            Mask
+  )
+{
+  EFI_STATUS  Status;
+  UINT64      EntrySize;
+  UINT64      EntryAddress;
+  UINT64      EntryEnd;
+  UINT64      *SubTable;
+  UINTN       Index;
+  UINTN       SubIndex;
+
+  EntrySize = RiscVPageTableEntrySize (Level);
+  Index     = (UINTN)DivU64x64Remainder (Start - TableAddress, EntrySize, NULL);
+
+  for ( ; (Index < RISCV_PAGE_TABLE_ENTRIES) && (Start < End); Index++) {
+    EntryAddress = TableAddress + Index * EntrySize;
+    EntryEnd     = EntryAddress + EntrySize;
+
+    if ((Start == EntryAddress) && (End >= EntryEnd) &&
+        (Level <= RISCV_PAGE_TABLE_MAX_LEAF_LEVEL) && !PTE_IS_TABLE (Table[Index]))
+    {
+      Table[Index] = RiscVPageTableLeaf (Table[Index], EntryAddress, Attributes, Mask);
+    } else {
+      if (!PTE_IS_TABLE (Table[Index])) {
+        //
+        // Split the entry. The new table is complete before it is linked,
+        // so the region stays mapped all along.
+        //
+        SubTable = RiscVPageTableAllocate (PageTable);
+        if (SubTable == NULL) {
+          return EFI_OUT_OF_RESOURCES;
+        }
+
+        if (PTE_IS_LEAF (Table[Index])) {
+          for (SubIndex = 0; SubIndex < RISCV_PAGE_TABLE_ENTRIES; SubIndex++) {
+            SubTable[SubIndex] = (Table[Index] & ~RISCV_PTE_PPN_MASK) |
+                                 ADDRESS_PPN (EntryAddress + SubIndex * RiscVPageTableEntrySize (Level - 1));
+          }
+        }
+
+        Table[Index] = ADDRESS_PPN ((UINTN)SubTable) | RISCV_PTE_V;
+      }
+
+      Status = RiscVPageTableUpdate (
+                 PageTable,
+                 (UINT64 *)(UINTN)PTE_ADDRESS (Table[Index]),
+                 Level - 1,
+                 EntryAddress,
+                 Start,
+                 MIN (End, EntryEnd),
+                 Attributes,
+                 Mask
+                 );
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+
+      RiscVPageTableMerge (PageTable, &Table[Index], Level, EntryAddress);
+    }
+
+    Start = EntryEnd;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Update the identity map of a region.
+
+  Entries that cover the region completely become leaves, as large as
+  possible. Partially covered leaves are split, and tables whose entries end
+  up uniform are merged back into a leaf of their parent.
+
+  @param[in, out] PageTable     The page table.
+  @param[in]      BaseAddress   Start of the region, 4 KB aligned.
+  @param[in]      Length        Size of the region, a multiple of 4 KB.
+  @param[in]      Attributes    Page table entry bits, without the PPN.
+  @param[in]      Mask          Bits of valid entries to replace with Attributes.
+                                Entries that are not valid take all of Attributes.
+
+  @retval EFI_SUCCESS           The region was updated.
+  @retval EFI_INVALID_PARAMETER The region is not aligned or out of range.
+  @retval EFI_OUT_OF_RESOURCES  The page table pool is exhausted.
+
+**/
+EFI_STATUS
+RiscVPageTableMap (
+  IN OUT RISCV_PAGE_TABLE  *PageTable,
+  IN     UINT64            BaseAddress,
+  IN     UINT64            Length,
+  IN     UINT64            Attributes,
+  IN     UINT64            Mask
+  )
+{
+  EFI_STATUS  Status;
+
+  if ((Length == 0) || ((BaseAddress & EFI_PAGE_MASK) != 0) || ((Length & EFI_PAGE_MASK) != 0) ||
+      (BaseAddress >= RiscVPageTableLimit (PageTable->Levels)) ||
+      (Length > RiscVPageTableLimit (PageTable->Levels) - BaseAddress))
+  {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Status = RiscVPageTableReserve (PageTable);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return RiscVPageTableUpdate (
+           PageTable,
+           PageTable->Root,
+           PageTable->Levels - 1,
+           0,
+           BaseAddress,
+           BaseAddress + Length,
+           Attributes & ~RISCV_PTE_PPN_MASK,
+           Mask & ~RISCV_PTE_PPN_MASK
+           );
+}
+
+/**
+  Find the leaf entry that maps an address.
+
+  @param[in]  PageTable     The page table.
+  @param[in]  Address       The address.
+  @param[out] Level         Level of the entry, 0 for a 4 KB page.
+
+  @return The leaf entry, or 0 if the address is not mapped.
+
+**/
+UINT64
+RiscVPageTableLookup (
+  IN  RISCV_PAGE_TABLE  *PageTable,
+  IN  UINT64            Address,
+  OUT UINTN             *Level OPTIONAL
+  )
+{
+  UINT64  *Table;
+  UINT64  Pte;
+  UINTN   Current;
+  UINTN   Index;
+
+  if (Address >= RiscVPageTableLimit (PageTable->Levels)) {
+    return 0;
+  }
+
+  Table = PageTable->Root;
+  for (Current = PageTable->Levels; Current > 0; Current--) {
+    Index = (UINTN)RShiftU64 (Address, EFI_PAGE_SHIFT + (Current - 1) * RISCV_PAGE_TABLE_LEVEL_SHIFT) &
+            (RISCV_PAGE_TABLE_ENTRIES - 1);
+    Pte = Table[Index];
+    if (!PTE_IS_TABLE (Pte)) {
+      if (Level != NULL) {
+        *Level = Current - 1;
+      }
+
+      return PTE_IS_LEAF (Pte) ? Pte : 0;
+    }
+
+    Table = (UINT64 *)(UINTN)PTE_ADDRESS (Pte);
+  }
+
+  return 0;
+}
@@ -0,0 +1,201 @@
+/** @file
+  RISC-V page table management, independent of the running CPU so that it
+  can be tested on the host.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef RISCV_PAGE_TABLE_H_
+#define RISCV_PAGE_TABLE_H_
+
+#include <Uefi.h>
+#include <Library/RiscVMmuLib.h>
+
+#define RISCV_PTE_V  BIT0
+#define RISCV_PTE_R  BIT1
+#define RISCV_PTE_W  BIT2
+#define RISCV_PTE_X  BIT3
+#define RISCV_PTE_U  BIT4
+#define RISCV_PTE_G  BIT5
+#define RISCV_PTE_A  BIT6
+#define RISCV_PTE_D  BIT7
+
+#define RISCV_PTE_RWX  (RISCV_PTE_R | RISCV_PTE_W | RISCV_PTE_X)
+
+#define RISCV_PTE_PPN_MASK   0x003FFFFFFFFFFC00ULL
+#define RISCV_PTE_PPN_SHIFT  10
+
+//
+// Svpbmt memory types
+//
+#define RISCV_PTE_SVPBMT_PMA   0
+#define RISCV_PTE_SVPBMT_NC    BIT61
+#define RISCV_PTE_SVPBMT_IO    BIT62
+#define RISCV_PTE_SVPBMT_MASK  (BIT62 | BIT61)
+
+//
+// T-Head extended memory attributes: strong order, cacheable, bufferable,
+// shareable and trustable
+//
+#define RISCV_PTE_THEAD_SO    BIT63
+#define RISCV_PTE_THEAD_C     BIT62
+#define RISCV_PTE_THEAD_B     BIT61
+#define RISCV_PTE_THEAD_SH    BIT60
+#define RISCV_PTE_THEAD_SEC   BIT59
+#define RISCV_PTE_THEAD_PMA   (RISCV_PTE_THEAD_C | RISCV_PTE_THEAD_B | RISCV_PTE_THEAD_SH)
+#define RISCV_PTE_THEAD_NC    (RISCV_PTE_THEAD_B | RISCV_PTE_THEAD_SH)
+#define RISCV_PTE_THEAD_IO    (RISCV_PTE_THEAD_SO | RISCV_PTE_THEAD_SH)
+#define RISCV_PTE_THEAD_MASK  (BIT63 | BIT62 | BIT61 | BIT60 | BIT59)
+
+#define RISCV_PTE_MEMORY_TYPE_MASK  (RISCV_PTE_SVPBMT_MASK | RISCV_PTE_THEAD_MASK)
+
+#define RISCV_PAGE_TABLE_ENTRIES      512
+#define RISCV_PAGE_TABLE_LEVEL_SHIFT  9
+
+//
+// Leaf entries are used up to 1 GB pages
+//
+#define RISCV_PAGE_TABLE_MAX_LEAF_LEVEL  2
+
+//
+// Pages kept in the pool so that an update never has to allocate memory:
+// the allocation could call back into SetMemoryAttributes().
+//
+#define RISCV_PAGE_TABLE_POOL_LOW    8
+#define RISCV_PAGE_TABLE_POOL_CHUNK  16
+
+typedef struct {
+  UINT64     *Root;
+  UINTN      Levels;        // 3 for Sv39, 4 for Sv48
+  UINT64     *FreePages;    // Pool of page table pages, linked through their first entry
+  UINTN      FreeCount;
+  UINT64     *RetiredPages; // Pages released by the last update, still in the TLB
+  BOOLEAN    Refilling;
+} RISCV_PAGE_TABLE;
+
+/**
+  Create an empty page table.
+
+  @param[out] PageTable     The page table.
+  @param[in]  Levels        Number of levels, 3 for Sv39 or 4 for Sv48.
+
+  @retval EFI_SUCCESS           The page table was created.
+  @retval EFI_INVALID_PARAMETER Levels is not supported.
+  @retval EFI_OUT_OF_RESOURCES  The root table could not be allocated.
+
+**/
+EFI_STATUS
+RiscVPageTableInit (
+  OUT RISCV_PAGE_TABLE  *PageTable,
+  IN  UINTN             Levels
+  );
+
+/**
+  Return the end of the address range a page table can identity map.
+
+  @param[in]  Levels        Number of levels of the page table.
+
+  @return The first address that cannot be identity mapped.
+
+**/
+UINT64
+RiscVPageTableLimit (
+  IN UINTN  Levels
+  );
+
+/**
+  Convert EFI memory attributes to leaf page table entry bits.
+
+  @param[in]  EfiAttributes       EFI_MEMORY_* cache and access attributes.
+  @param[in]  MemoryTypeEncoding  RISCV_MMU_MEMORY_TYPE_*.
+  @param[out] Attributes          The page table entry bits, without the PPN.
+  @param[out] Mask                The bits of valid entries to replace with
+                                  Attributes. The memory type is kept when
+                                  EfiAttributes holds no cache attribute.
+
+**/
+VOID
+RiscVPageTableEfiToPte (
+  IN  UINT64  EfiAttributes,
+  IN  UINTN   MemoryTypeEncoding,
+  OUT UINT64  *Attributes,
+  OUT UINT64  *Mask
+  );
+
+/**
+  Update the identity map of a region.
+
+  Entries that cover the region completely become leaves, as large as
+  possible. Partially covered leaves are split, and tables whose entries end
+  up uniform are merged back into a leaf of their parent.
+
+  @param[in, out] PageTable     The page table.
+  @param[in]      BaseAddress   Start of the region, 4 KB aligned.
+  @param[in]      Length        Size of the region, a multiple of 4 KB.
+  @param[in]      Attributes    Page table entry bits, without the PPN.
+  @param[in]      Mask          Bits of valid entries to replace with Attributes.
+                                Entries that are not valid take all of Attributes.
+
+  @retval EFI_SUCCESS           The region was updated.
+  @retval EFI_INVALID_PARAMETER The region is not aligned or out of range.
+  @retval EFI_OUT_OF_RESOURCES  The page table pool is exhausted.
+
+**/
+EFI_STATUS
+RiscVPageTableMap (
+  IN OUT RISCV_PAGE_TABLE  *PageTable,
+  IN     UINT64            BaseAddress,
+  IN     UINT64            Length,
+  IN     UINT64            Attributes,
+  IN     UINT64            Mask
+  );
+
+/**
+  Find the leaf entry that maps an address.
+
+  @param[in]  PageTable     The page table.
+  @param[in]  Address       The address.
+  @param[out] Level         Level of the entry, 0 for a 4 KB page.
+
+  @return The leaf entry, or 0 if the address is not mapped.
+
+**/
+UINT64
+RiscVPageTableLookup (
+  IN  RISCV_PAGE_TABLE  *PageTable,
+  IN  UINT64            Address,
+  OUT UINTN             *Level OPTIONAL
+  );
+
+/**
+  Make sure the pool holds enough pages for one update.
+
+  Allocating the pages may call RiscVSetMemoryAttributes() recursively, which
+  then runs from the pages already in the pool.
+
+  @param[in, out] PageTable     The page table.
+
+  @retval EFI_SUCCESS           The pool holds enough pages.
+  @retval EFI_OUT_OF_RESOURCES  The pool could not be refilled.
+
+**/
+EFI_STATUS
+RiscVPageTableReserve (
+  IN OUT RISCV_PAGE_TABLE  *PageTable
+  );
+
+/**
+  Return the pages released by the last updates to the pool, once the TLB
+  has been flushed.
+
+  @param[in, out] PageTable     The page table.
+
+**/
+VOID
+RiscVPageTableRecycle (
+  IN OUT RISCV_PAGE_TABLE  *PageTable
+  );
+
+#endif
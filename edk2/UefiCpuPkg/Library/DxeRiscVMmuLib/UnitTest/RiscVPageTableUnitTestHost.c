@@ -0,0 +1,403 @@
+/** @file
+  Unit tests of the RISC-V page table management of DxeRiscVMmuLib.
+
+  Copyright (c) 2023, Academy of Intelligent Innovation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/UnitTestLib.h>
+
+#include "../RiscVPageTable.h"
+
+#define UNIT_TEST_APP_NAME     "RISC-V Page Table Unit Tests"
+#define UNIT_TEST_APP_VERSION  "1.0"
+
+#define PTE_ADDRESS(Pte)  LShiftU64 (RShiftU64 ((Pte) & RISCV_PTE_PPN_MASK, RISCV_PTE_PPN_SHIFT), EFI_PAGE_SHIFT)
+
+/**
+  Update a region of a page table with EFI memory attributes, as
+  RiscVSetMemoryAttributes() does.
+
+  @param[in, out] PageTable     The page table.
+  @param[in]      BaseAddress   Start of the region.
+  @param[in]      Length        Size of the region.
+  @param[in]      EfiAttributes EFI_MEMORY_* attributes.
+  @param[in]      Encoding      RISCV_MMU_MEMORY_TYPE_*.
+
+  @return The status returned by RiscVPageTableMap().
+
+**/
+STATIC
+EFI_STATUS
+SetAttributes (
+  IN OUT RISCV_PAGE_TABLE  *PageTable,
+  IN     UINT64            BaseAddress,
+  IN     UINT64            Length,
+  IN     UINT64            EfiAttributes,
+  IN     UINTN             Encoding
+  )
+{
+  EFI_STATUS  Status;
+  UINT64      Attributes;
+  UINT64      Mask;
+
+  RiscVPageTableEfiToPte (EfiAttributes, Encoding, &Attributes, &Mask);
+  Status = RiscVPageTableMap (PageTable, BaseAddress, Length, Attributes, Mask);
+  RiscVPageTableRecycle (PageTable);
+  return Status;
+}
+
+/**
+  Check the leaf entry of an address.
+
+  @param[in]  PageTable     The page table.
+  @param[in]  Address       The address.
+  @param[in]  Level         Expected level of the leaf.
+  @param[in]  Bits          Expected bits of the leaf, without the PPN.
+
+  @retval  TRUE    The leaf is as expected and maps the address to itself.
+  @retval  FALSE   The leaf is not as expected.
+
+**/
+STATIC
+BOOLEAN
+IsLeaf (
+  IN RISCV_PAGE_TABLE  *PageTable,
+  IN UINT64            Address,
+  IN UINTN             Level,
+  IN UINT64            Bits
+  )
+{
+  UINT64  Pte;
+  UINTN   PteLevel;
+  UINT64  Size;
+
+  Pte = RiscVPageTableLookup (PageTable, Address, &PteLevel);
+  if ((Pte == 0) || (PteLevel != Level) || ((Pte & ~RISCV_PTE_PPN_MASK) != Bits)) {
+    return FALSE;
+  }
+
+  Size = LShiftU64 (SIZE_4KB, Level * RISCV_PAGE_TABLE_LEVEL_SHIFT);
+  return (BOOLEAN)(PTE_ADDRESS (Pte) == (Address & ~(Size - 1)));
+}
+
+/**
+  Check the parameter checks of the page table functions.
+
+  @param[in]  Context    Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+TestCaseForParameter (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  RISCV_PAGE_TABLE  PageTable;
+
+  UT_ASSERT_EQUAL (RiscVPageTableInit (&PageTable, 2), EFI_INVALID_PARAMETER);
+  UT_ASSERT_EQUAL (RiscVPageTableInit (&PageTable, 5), EFI_INVALID_PARAMETER);
+  UT_ASSERT_NOT_EFI_ERROR (RiscVPageTableInit (&PageTable, 3));
+
+  UT_ASSERT_EQUAL (RiscVPageTableLimit (3), SIZE_256GB);
+  UT_ASSERT_EQUAL (RiscVPageTableLimit (4), LShiftU64 (SIZE_64TB, 1));
+
+  //
+  // Unaligned, empty and out of range regions are rejected
+  //
+  UT_ASSERT_EQUAL (SetAttributes (&PageTable, 0x1000, 0x800, EFI_MEMORY_WB, RISCV_MMU_MEMORY_TYPE_NONE), EFI_INVALID_PARAMETER);
+  UT_ASSERT_EQUAL (SetAttributes (&PageTable, 0x1800, 0x1000, EFI_MEMORY_WB, RISCV_MMU_MEMORY_TYPE_NONE), EFI_INVALID_PARAMETER);
+  UT_ASSERT_EQUAL (SetAttributes (&PageTable, 0x1000, 0, EFI_MEMORY_WB, RISCV_MMU_MEMORY_TYPE_NONE), EFI_INVALID_PARAMETER);
+  UT_ASSERT_EQUAL (SetAttributes (&PageTable, SIZE_256GB, SIZE_4KB, EFI_MEMORY_WB, RISCV_MMU_MEMORY_TYPE_NONE), EFI_INVALID_PARAMETER);
+  UT_ASSERT_EQUAL (SetAttributes (&PageTable, SIZE_256GB - SIZE_4KB, SIZE_8KB, EFI_MEMORY_WB, RISCV_MMU_MEMORY_TYPE_NONE), EFI_INVALID_PARAMETER);
+  UT_ASSERT_EQUAL (SetAttributes (&PageTable, SIZE_4KB, MAX_UINT64 & ~EFI_PAGE_MASK, EFI_MEMORY_WB, RISCV_MMU_MEMORY_TYPE_NONE), EFI_INVALID_PARAMETER);
+
+  //
+  // Nothing is mapped by the rejected calls
+  //
+  UT_ASSERT_EQUAL (RiscVPageTableLookup (&PageTable, 0x1000, NULL), 0);
+  UT_ASSERT_EQUAL (RiscVPageTableLookup (&PageTable, SIZE_256GB, NULL), 0);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Check the page table entry bits of EFI memory attributes.
+
+  @param[in]  Context    Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+TestCaseForAttributeEncoding (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  UINT64  Access;
+  UINT64  Attributes;
+  UINT64  Mask;
+
+  Access = RISCV_PTE_V | RISCV_PTE_RWX | RISCV_PTE_G | RISCV_PTE_A | RISCV_PTE_D;
+
+  RiscVPageTableEfiToPte (EFI_MEMORY_WB, RISCV_MMU_MEMORY_TYPE_NONE, &Attributes, &Mask);
+  UT_ASSERT_EQUAL (Attributes, Access);
+
+  RiscVPageTableEfiToPte (EFI_MEMORY_UC, RISCV_MMU_MEMORY_TYPE_SVPBMT, &Attributes, &Mask);
+  UT_ASSERT_EQUAL (Attributes, Access | RISCV_PTE_SVPBMT_IO);
+  UT_ASSERT_EQUAL (Mask & RISCV_PTE_MEMORY_TYPE_MASK, RISCV_PTE_MEMORY_TYPE_MASK);
+
+  RiscVPageTableEfiToPte (EFI_MEMORY_WC, RISCV_MMU_MEMORY_TYPE_SVPBMT, &Attributes, &Mask);
+  UT_ASSERT_EQUAL (Attributes, Access | RISCV_PTE_SVPBMT_NC);
+
+  RiscVPageTableEfiToPte (EFI_MEMORY_WB, RISCV_MMU_MEMORY_TYPE_THEAD, &Attributes, &Mask);
+  UT_ASSERT_EQUAL (Attributes, Access | RISCV_PTE_THEAD_C | RISCV_PTE_THEAD_B | RISCV_PTE_THEAD_SH);
+
+  RiscVPageTableEfiToPte (EFI_MEMORY_WT, RISCV_MMU_MEMORY_TYPE_THEAD, &Attributes, &Mask);
+  UT_ASSERT_EQUAL (Attributes, Access | RISCV_PTE_THEAD_B | RISCV_PTE_THEAD_SH);
+
+  RiscVPageTableEfiToPte (EFI_MEMORY_UC, RISCV_MMU_MEMORY_TYPE_THEAD, &Attributes, &Mask);
+  UT_ASSERT_EQUAL (Attributes, Access | RISCV_PTE_THEAD_SO | RISCV_PTE_THEAD_SH);
+
+  //
+  // Access attributes alone keep the memory type
+  //
+  RiscVPageTableEfiToPte (EFI_MEMORY_RO | EFI_MEMORY_XP, RISCV_MMU_MEMORY_TYPE_THEAD, &Attributes, &Mask);
+  UT_ASSERT_EQUAL (Attributes & (RISCV_PTE_W | RISCV_PTE_X), 0);
+  UT_ASSERT_EQUAL (Mask & RISCV_PTE_MEMORY_TYPE_MASK, 0);
+
+  RiscVPageTableEfiToPte (EFI_MEMORY_RP, RISCV_MMU_MEMORY_TYPE_NONE, &Attributes, &Mask);
+  UT_ASSERT_EQUAL (Attributes & RISCV_PTE_V, 0);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Check that an identity map uses 1 GB leaves, that a non-cacheable DMA
+  buffer splits them down to 4 KB pages at its edges only, and that the
+  leaves are merged back once the buffer is cacheable again.
+
+  @param[in]  Context    Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+TestCaseForSplitAndMerge (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  RISCV_PAGE_TABLE  PageTable;
+  UINT64            Pma;
+  UINT64            Nc;
+  UINT64            Mask;
+  UINTN             FreeCount;
+
+  RiscVPageTableEfiToPte (EFI_MEMORY_WB, RISCV_MMU_MEMORY_TYPE_THEAD, &Pma, &Mask);
+  RiscVPageTableEfiToPte (EFI_MEMORY_WC, RISCV_MMU_MEMORY_TYPE_THEAD, &Nc, &Mask);
+
+  UT_ASSERT_NOT_EFI_ERROR (RiscVPageTableInit (&PageTable, 3));
+  UT_ASSERT_NOT_EFI_ERROR (SetAttributes (&PageTable, 0, SIZE_4GB, EFI_MEMORY_WB, RISCV_MMU_MEMORY_TYPE_THEAD));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0, 2, Pma));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x80203000, 2, Pma));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, SIZE_4GB - SIZE_4KB, 2, Pma));
+  UT_ASSERT_EQUAL (RiscVPageTableLookup (&PageTable, SIZE_4GB, NULL), 0);
+
+  FreeCount = PageTable.FreeCount;
+
+  //
+  // A two page buffer in the middle of a 2 MB page
+  //
+  UT_ASSERT_NOT_EFI_ERROR (SetAttributes (&PageTable, 0x80203000, SIZE_8KB, EFI_MEMORY_WC, RISCV_MMU_MEMORY_TYPE_THEAD));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x80203000, 0, Nc));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x80204000, 0, Nc));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x80202000, 0, Pma));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x80205000, 0, Pma));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x80000000, 1, Pma));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x80400000, 1, Pma));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x40000000, 2, Pma));
+  UT_ASSERT_EQUAL (PageTable.FreeCount, FreeCount - 2);
+
+  //
+  // Restoring the buffer merges the tables back into the 1 GB leaf
+  //
+  UT_ASSERT_NOT_EFI_ERROR (SetAttributes (&PageTable, 0x80203000, SIZE_8KB, EFI_MEMORY_WB, RISCV_MMU_MEMORY_TYPE_THEAD));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x80203000, 2, Pma));
+  UT_ASSERT_EQUAL (PageTable.FreeCount, FreeCount);
+
+  //
+  // A 2 MB aligned buffer only needs a 2 MB leaf
+  //
+  UT_ASSERT_NOT_EFI_ERROR (SetAttributes (&PageTable, 0x80200000, SIZE_4MB, EFI_MEMORY_WC, RISCV_MMU_MEMORY_TYPE_THEAD));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x80200000, 1, Nc));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x80400000, 1, Nc));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x80600000, 1, Pma));
+  UT_ASSERT_EQUAL (PageTable.FreeCount, FreeCount - 1);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Check the access attributes: read-only and non-executable pages keep
+  their memory type, and read-protected pages are unmapped.
+
+  @param[in]  Context    Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+TestCaseForAccessAttributes (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  RISCV_PAGE_TABLE  PageTable;
+  UINT64            Io;
+  UINT64            Mask;
+
+  RiscVPageTableEfiToPte (EFI_MEMORY_UC, RISCV_MMU_MEMORY_TYPE_SVPBMT, &Io, &Mask);
+
+  UT_ASSERT_NOT_EFI_ERROR (RiscVPageTableInit (&PageTable, 3));
+  UT_ASSERT_NOT_EFI_ERROR (SetAttributes (&PageTable, 0, SIZE_1GB, EFI_MEMORY_UC, RISCV_MMU_MEMORY_TYPE_SVPBMT));
+
+  UT_ASSERT_NOT_EFI_ERROR (SetAttributes (&PageTable, 0x10000, SIZE_4KB, EFI_MEMORY_RO | EFI_MEMORY_XP, RISCV_MMU_MEMORY_TYPE_SVPBMT));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x10000, 0, Io & ~(UINT64)(RISCV_PTE_W | RISCV_PTE_X)));
+
+  //
+  // A null pointer guard page
+  //
+  UT_ASSERT_NOT_EFI_ERROR (SetAttributes (&PageTable, 0, SIZE_4KB, EFI_MEMORY_RP, RISCV_MMU_MEMORY_TYPE_SVPBMT));
+  UT_ASSERT_EQUAL (RiscVPageTableLookup (&PageTable, 0, NULL), 0);
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x1000, 0, Io));
+
+  //
+  // Unmapped pages take all the attributes again when mapped
+  //
+  UT_ASSERT_NOT_EFI_ERROR (SetAttributes (&PageTable, 0, SIZE_4KB, EFI_MEMORY_XP, RISCV_MMU_MEMORY_TYPE_SVPBMT));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0, 0, (Io & ~(UINT64)RISCV_PTE_X & ~RISCV_PTE_SVPBMT_MASK)));
+
+  UT_ASSERT_NOT_EFI_ERROR (SetAttributes (&PageTable, 0, 0x11000, EFI_MEMORY_UC, RISCV_MMU_MEMORY_TYPE_SVPBMT));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0, 2, Io));
+
+  //
+  // Unmapping a whole table releases it
+  //
+  UT_ASSERT_NOT_EFI_ERROR (SetAttributes (&PageTable, 0, SIZE_1GB, EFI_MEMORY_RP, RISCV_MMU_MEMORY_TYPE_SVPBMT));
+  UT_ASSERT_EQUAL (RiscVPageTableLookup (&PageTable, SIZE_512MB, NULL), 0);
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Check a four level page table mapping the SG2042 peripherals above the
+  reach of three levels.
+
+  @param[in]  Context    Unused.
+
+  @retval  UNIT_TEST_PASSED             The test case was successful.
+  @retval  UNIT_TEST_ERROR_TEST_FAILED  A test case assertion has failed.
+**/
+UNIT_TEST_STATUS
+EFIAPI
+TestCaseForFourLevels (
+  IN UNIT_TEST_CONTEXT  Context
+  )
+{
+  RISCV_PAGE_TABLE  PageTable;
+  UINT64            Io;
+  UINT64            Mask;
+
+  RiscVPageTableEfiToPte (EFI_MEMORY_UC, RISCV_MMU_MEMORY_TYPE_THEAD, &Io, &Mask);
+
+  UT_ASSERT_NOT_EFI_ERROR (RiscVPageTableInit (&PageTable, 4));
+  UT_ASSERT_NOT_EFI_ERROR (SetAttributes (&PageTable, 0x7000000000, SIZE_4GB, EFI_MEMORY_UC, RISCV_MMU_MEMORY_TYPE_THEAD));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x7000000000, 2, Io));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x7030001000, 2, Io));
+  UT_ASSERT_EQUAL (RiscVPageTableLookup (&PageTable, 0x7100000000, NULL), 0);
+  UT_ASSERT_EQUAL (RiscVPageTableLookup (&PageTable, 0, NULL), 0);
+
+  UT_ASSERT_NOT_EFI_ERROR (SetAttributes (&PageTable, 0x7030001000, SIZE_4KB, EFI_MEMORY_UC | EFI_MEMORY_XP, RISCV_MMU_MEMORY_TYPE_THEAD));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x7030001000, 0, Io & ~(UINT64)RISCV_PTE_X));
+  UT_ASSERT_TRUE (IsLeaf (&PageTable, 0x7030200000, 1, Io));
+
+  return UNIT_TEST_PASSED;
+}
+
+/**
+  Initialize the unit test framework, suite, and unit tests for the
+  RISC-V page table management and run the unit tests.
+
+  @retval  EFI_SUCCESS           All test cases were dispatched.
+  @retval  EFI_OUT_OF_RESOURCES  There are not enough resources available to
+                                 initialize the unit tests.
+**/
+EFI_STATUS
+EFIAPI
+UefiTestMain (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  UNIT_TEST_FRAMEWORK_HANDLE  Framework;
+  UNIT_TEST_SUITE_HANDLE      TestSuite;
+
+  Framework = NULL;
+
+  DEBUG ((DEBUG_INFO, "%a v%a\n", UNIT_TEST_APP_NAME, UNIT_TEST_APP_VERSION));
+
+  Status = InitUnitTestFramework (&Framework, UNIT_TEST_APP_NAME, gEfiCallerBaseName, UNIT_TEST_APP_VERSION);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in InitUnitTestFramework. Status = %r\n", Status));
+    goto EXIT;
+  }
+
+  Status = CreateUnitTestSuite (&TestSuite, Framework, "RISC-V Page Table Tests", "RiscVPageTable", NULL, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "Failed in CreateUnitTestSuite for RISC-V Page Table Tests\n"));
+    Status = EFI_OUT_OF_RESOURCES;
+    goto EXIT;
+  }
+
+  AddTestCase (TestSuite, "Check the parameter checks", "Parameter", TestCaseForParameter, NULL, NULL, NULL);
+  AddTestCase (TestSuite, "Check the encoding of the attributes", "Encoding", TestCaseForAttributeEncoding, NULL, NULL, NULL);
+  AddTestCase (TestSuite, "Check splitting and merging large pages", "SplitMerge", TestCaseForSplitAndMerge, NULL, NULL, NULL);
+  AddTestCase (TestSuite, "Check the access attributes", "Access", TestCaseForAccessAttributes, NULL, NULL, NULL);
+  AddTestCase (TestSuite, "Check a four level page table", "FourLevels", TestCaseForFourLevels, NULL, NULL, NULL);
+
+  Status = RunAllTestSuites (Framework);
+
+EXIT:
+  if (Framework != NULL) {
+    FreeUnitTestFramework (Framework);
+  }
+
+  return Status;
+}
+
+/**
+  Standard POSIX C entry point for host based unit test execution.
+
+  @param Argc  Number of arguments.
+  @param Argv  Array of arguments.
+
+  @return Test application exit code.
+**/
+INT32
+main (
+  INT32  Argc,
+  CHAR8  *Argv[]
+  )
+{
+  return UefiTestMain ();
+}